@@ -0,0 +1,113 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef	_INET_CC_H
+#define	_INET_CC_H
+
+/*
+ * TCP congestion control algorithms.  See tcp_cc.c for details.
+ *
+ * An algorithm is a cc_algo_t, registered by name with cc_register().
+ * Every connection points to one algorithm, and keeps the algorithm's
+ * per-connection state in its tcp_ccv.  TCP calls the hooks below from
+ * the squeue of the connection, so they need no locking of their own.
+ * Any hook may be NULL.
+ */
+
+#include <sys/types.h>
+#include <sys/list.h>
+#include <netinet/tcp.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	CC_ALGO_NAME_MAX	TCP_CA_NAME_MAX
+
+/* Types of ack_received() */
+#define	CC_ACK		1	/* new data was acknowledged */
+#define	CC_DUPACK	2	/* duplicate ACK during fast recovery */
+
+/* Types of cong_signal() */
+#define	CC_NDUPACK	1	/* dupack threshold reached: fast retransmit */
+#define	CC_ECN		2	/* ECN-Echo, once per window */
+#define	CC_RTO		3	/* retransmission timeout */
+
+struct tcp_s;
+
+typedef struct cc_var {
+	struct tcp_s	*ccv_tcp;
+	void		*ccv_data;	/* algorithm private data */
+	uint32_t	ccv_bytes_acked; /* acknowledged by the current ACK */
+	uint32_t	ccv_rtt;	/* latest RTT sample, in ms */
+} cc_var_t;
+
+typedef struct cc_algo {
+	char	cc_name[CC_ALGO_NAME_MAX];
+
+	/* Allocate and free ccv_data; cb_init() must not sleep. */
+	int	(*cc_cb_init)(cc_var_t *);
+	void	(*cc_cb_destroy)(cc_var_t *);
+
+	/* The connection is established, and tcp_cwnd initialized. */
+	void	(*cc_conn_init)(cc_var_t *);
+
+	/*
+	 * Grow tcp_cwnd on an ACK.  CC_ACK is only passed for an ACK of new
+	 * data that carries no ECN-Echo, CC_DUPACK for a duplicate ACK past
+	 * the dupack threshold when SACK is not in use.
+	 */
+	void	(*cc_ack_received)(cc_var_t *, int);
+
+	/*
+	 * Shrink tcp_cwnd and tcp_cwnd_ssthresh on congestion.  CC_NDUPACK
+	 * and CC_ECN are only passed once per window (tcp_cwr is clear).
+	 * On CC_RTO, tcp_cwnd must become one MSS; tcp_cwnd_ssthresh should
+	 * only be reduced if tcp_cwr is clear or tcp_rexmit is set.
+	 */
+	void	(*cc_cong_signal)(cc_var_t *, int);
+
+	/* Fast recovery is over: all the data sent before it is acked. */
+	void	(*cc_post_recovery)(cc_var_t *);
+
+	/* TCP restarted tcp_cwnd after being idle for an RTO. */
+	void	(*cc_after_idle)(cc_var_t *);
+
+	/* Private to tcp_cc.c */
+	list_node_t	cc_link;
+	uint_t		cc_refcnt;	/* connections and stacks using it */
+} cc_algo_t;
+
+#ifdef	_KERNEL
+
+extern cc_algo_t	cc_newreno;
+
+extern void	cc_init(void);
+extern void	cc_fini(void);
+extern int	cc_register(cc_algo_t *);
+extern int	cc_unregister(cc_algo_t *);
+extern cc_algo_t *cc_lookup(const char *, boolean_t);
+extern void	cc_hold(cc_algo_t *);
+extern void	cc_rele(cc_algo_t *);
+extern int	cc_list_names(char *, size_t);
+
+/* NewReno hooks, for other algorithms to fall back on */
+extern void	newreno_ack_received(cc_var_t *, int);
+extern void	newreno_cong_signal(cc_var_t *, int);
+extern void	newreno_post_recovery(cc_var_t *);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _INET_CC_H */
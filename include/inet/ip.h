@@ -552,6 +552,7 @@ extern	void ip_mcast_mapping(struct ill_s *, uchar_t *, uchar_t *);
 #define	DCEF_PMTU		0x0002	/* Different than interface MTU */
 #define	DCEF_UINFO		0x0004	/* dce_uinfo set */
 #define	DCEF_TOO_SMALL_PMTU	0x0008	/* Smaller than IPv4 MIN */
+#define	DCEF_TFO		0x0010	/* dce_tfo_cookie set */
 
 #ifdef _KERNEL
 /*
@@ -2319,6 +2320,9 @@ struct ip_recv_attr_s {
 	squeue_t	*ira_target_sqp;
 	mblk_t		*ira_target_sqp_mp;
 
+	/* UDP receive coalescing when IRAF_UDP_GRO is set */
+	struct udp_gro_s *ira_udp_gro;
+
 	/* Always initialized independently of ira_flags settings */
 	uint32_t	ira_xmit_hint;	/* For ECMP and GLD TX ring fanout */
 	zoneid_t	ira_zoneid;	/* ALL_ZONES unless local delivery */
@@ -2403,7 +2407,7 @@ struct ip_recv_attr_s {
 
 #define	IRAF_L2DST_MULTICAST	0x01000000	/* Multicast at L2 */
 #define	IRAF_L2DST_BROADCAST	0x02000000	/* Broadcast at L2 */
-/* Unused 0x04000000 */
+#define	IRAF_UDP_GRO		0x04000000	/* ira_udp_gro is set */
 /* Unused 0x08000000 */
 
 /* Below starts with 0x10000000 */
@@ -2420,6 +2424,9 @@ struct ip_recv_attr_s {
  */
 #define	IRA_FREE_CRED		0x00000001	/* ira_cred needs to be rele */
 
+/* Longest TCP Fast Open cookie (RFC 7413) a dce_t can hold */
+#define	DCE_TFO_COOKIE_MAX	16
+
 /*
  * Optional destination cache entry for path MTU information,
  * and ULP metrics.
@@ -2450,6 +2457,11 @@ struct dce_s {
 	uint64_t	dce_last_change_time;	/* Path MTU. In seconds */
 
 	ip_stack_t	*dce_ipst;	/* Does not have a netstack_hold */
+
+	/* TCP Fast Open cookie from this destination if DCEF_TFO */
+	uint8_t		dce_tfo_cookie[DCE_TFO_COOKIE_MAX];
+	uint8_t		dce_tfo_cookie_len;
+	uint16_t	dce_tfo_mss;	/* Peer MSS when the cookie came */
 };
 
 /*
@@ -3391,6 +3403,9 @@ typedef	void			(*ip_flow_enable_t)(void *, ip_mac_tx_cookie_t);
 typedef void			*(*ip_dld_callb_t)(void *,
     ip_flow_enable_t, void *);
 typedef boolean_t		(*ip_dld_fctl_t)(void *, ip_mac_tx_cookie_t);
+typedef boolean_t		(*ip_mac_steer_t)(void *, void *, uint32_t,
+    uint32_t, uint32_t);
+typedef void			(*ip_mac_gro_t)(void *, boolean_t);
 typedef int			(*ip_capab_func_t)(void *, uint_t,
     void *, uint_t);
 
@@ -3424,6 +3439,8 @@ struct ill_rx_ring {
 	ip_mac_rx_t		rr_rx;		/* Driver receive function */
 	ip_accept_t		rr_ip_accept;	/* IP accept function */
 	void			*rr_rx_handle;	/* Handle for Rx ring */
+	ip_mac_steer_t		rr_steer;	/* Flow steering func */
+	ip_mac_gro_t		rr_gro;		/* Rx coalescing on/off func */
 	squeue_t		*rr_sqp; /* Squeue the ring is bound to */
 	ill_t			*rr_ill;	/* back pointer to ill */
 	ip_ring_state_t		rr_ring_state;	/* State of this ring */
@@ -3460,6 +3477,8 @@ struct ill_dld_capab_s {
  * IP squeues exports
  */
 extern boolean_t	ip_squeue_fanout;
+extern boolean_t	ip_squeue_rfs;
+extern uint_t		ip_squeue_rfs_interval;
 
 #define	IP_SQUEUE_GET(hint) ip_squeue_random(hint)
 
@@ -3474,6 +3493,8 @@ extern void ip_squeue_clean_ring(ill_t *, ill_rx_ring_t *);
 extern void ip_squeue_quiesce_ring(ill_t *, ill_rx_ring_t *);
 extern void ip_squeue_restart_ring(ill_t *, ill_rx_ring_t *);
 extern void ip_squeue_clean_all(ill_t *);
+extern void ip_squeue_steer(conn_t *, ipha_t *, uint32_t, ip_recv_attr_t *);
+extern void ip_squeue_gro(ill_t *);
 extern boolean_t	ip_source_routed(ipha_t *, ip_stack_t *);
 
 extern int tcp_wput(queue_t *, mblk_t *);
@@ -3504,6 +3525,9 @@ extern int	dce_update_uinfo_v6(const in6_addr_t *, uint_t, iulp_t *,
     ip_stack_t *);
 extern int	dce_update_uinfo(const in6_addr_t *, uint_t, iulp_t *,
     ip_stack_t *);
+extern int	dce_update_tfo(const in6_addr_t *, uint_t, const uint8_t *,
+    uint_t, uint_t, ip_stack_t *);
+extern boolean_t dce_get_tfo(dce_t *, uint8_t *, uint_t *, uint_t *);
 extern void	dce_increment_generation(dce_t *);
 extern void	dce_increment_all_generations(boolean_t, ip_stack_t *);
 extern void	dce_refrele(dce_t *);
@@ -3590,6 +3614,9 @@ extern int	inet_pton(int, char *, void *);
 #define	SQTAG_TCP_SHUTDOWN_OUTPUT	43
 #define	SQTAG_TCP_IXA_CLEANUP		44
 #define	SQTAG_TCP_SEND_SYNACK		45
+#define	SQTAG_TCP_PACE			46
+#define	SQTAG_TCP_FASTOPEN		47
+#define	SQTAG_TCP_RFS			48
 
 extern sin_t	sin_null;	/* Zero address for quick clears */
 extern sin6_t	sin6_null;	/* Zero address for quick clears */
@@ -82,6 +82,12 @@ extern int ipfil_sendpkt(const struct sockaddr *, mblk_t *, uint_t, zoneid_t);
 extern void  irb_refhold_rn(struct radix_node *);
 extern void  irb_refrele_rn(struct radix_node *);
 
+extern void	ip_fib_init(ip_stack_t *);
+extern void	ip_fib_fini(ip_stack_t *);
+extern void	ip_fib_changed_v4(ip_stack_t *);
+extern void	ip_fib_changed_v6(ire_t *, boolean_t);
+extern int	ip_fib_plen_v6(const in6_addr_t *, ip_stack_t *);
+
 #endif /* _KERNEL */
 
 #ifdef	__cplusplus
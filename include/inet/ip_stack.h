@@ -86,6 +86,9 @@ typedef struct ip_stat {
 	kstat_named_t	conn_in_recvpktinfo;
 	kstat_named_t	conn_in_recvtclass;
 	kstat_named_t	conn_in_timestamp;
+	kstat_named_t	ip_rfs_misrouted;
+	kstat_named_t	ip_rfs_steered;
+	kstat_named_t	ip_rfs_nosteer;
 } ip_stat_t;
 
 
@@ -247,6 +250,21 @@ struct ip_stack {
 
 	uint32_t	ips_ip6_ftable_hash_size;
 
+	/*
+	 * Compressed trie copies of the forwarding tables; see ip_fib.c.
+	 * ips_fib_v4 and ips_fib_gen_v4 are protected by the radix tree lock
+	 * of ips_ip_ftable, and the v6 ones by ips_ip6_ire_head_lock.  The
+	 * rebuild state is protected by ips_fib_lock.
+	 */
+	struct poptrie	*ips_fib_v4;
+	struct poptrie	*ips_fib_v6;
+	uint64_t	ips_fib_gen_v4;
+	uint64_t	ips_fib_gen_v6;
+	kmutex_t	ips_fib_lock;
+	kcondvar_t	ips_fib_cv;
+	timeout_id_t	ips_fib_tid;
+	uint_t		ips_fib_flags;
+
 	ire_stats_t 	ips_ire_stats_v4;	/* IPv4 ire statistics */
 	ire_stats_t 	ips_ire_stats_v6;	/* IPv6 ire statistics */
 
@@ -132,6 +132,23 @@ typedef struct
 	pc_t	ctb_stack[CONN_STACK_DEPTH];
 } conn_trace_t;
 
+/*
+ * SO_REUSEPORT group.  TCP listeners, or unconnected UDP endpoints, of the
+ * same user that are bound to the same local address and port with
+ * SO_REUSEPORT set form a group, and ipcl_classify_v4/v6 spread new
+ * connections and datagrams across the members.  The group is protected by
+ * the connf_lock of the fanout bucket the members are in.
+ */
+typedef struct ipcl_reuseport_s {
+	uint_t		rp_cnt;		/* # of members */
+	uint_t		rp_size;	/* # of slots in rp_conns */
+	uint_t		rp_naffine;	/* # of members with SO_INCOMING_CPU */
+	struct conn_s	*rp_conns[1];	/* Members */
+} ipcl_reuseport_t;
+
+#define	IPCL_REUSEPORT_SIZE(n)						\
+	(offsetof(ipcl_reuseport_t, rp_conns) + (n) * sizeof (struct conn_s *))
+
 typedef struct ip_helper_minor_info_s {
 	dev_t	ip_minfo_dev;		/* Device */
 	vmem_t	*ip_minfo_arena;	/* Arena */
@@ -278,7 +295,10 @@ struct conn_s {
 		conn_ipv6_recvpathmtu : 1,	/* IPV6_RECVPATHMTU */
 		conn_mcbc_bind : 1,		/* Bound to multi/broadcast */
 
-		conn_pad_to_bit_31 : 12;
+		conn_reuseport : 1,		/* SO_REUSEPORT state */
+		conn_incoming_cpu_set : 1,	/* SO_INCOMING_CPU set */
+
+		conn_pad_to_bit_31 : 10;
 
 	boolean_t	conn_blocked;		/* conn is flow-controlled */
 
@@ -308,6 +328,10 @@ struct conn_s {
 	connf_t		*conn_fanout;		/* Hash bucket we're part of */
 	struct conn_s	*conn_next;		/* Hash chain next */
 	struct conn_s	*conn_prev;		/* Hash chain prev */
+	ipcl_reuseport_t *conn_reuseport_grp;	/* SO_REUSEPORT group */
+	processorid_t	conn_incoming_cpu;	/* SO_INCOMING_CPU */
+	processorid_t	conn_rfs_cpu;		/* CPU the socket is used on */
+	clock_t		conn_rfs_lbolt;		/* last ip_squeue_steer() */
 
 	struct {
 		in6_addr_t connua_laddr;	/* Local address - match */
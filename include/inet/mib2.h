@@ -1305,6 +1305,18 @@ typedef struct mib2_tcpConnEntry {
 	uint32_t	tcpConnCreationProcess;
 	/* system uptime when the connection was created */
 	uint64_t	tcpConnCreationTime;
+	struct tcpConnCcInfo_s {
+				/* congestion window, in bytes */
+		Gauge		cc_cwnd;
+				/* slow start threshold, in bytes */
+		Gauge		cc_ssthresh;
+				/* smoothed round-trip time, in ms */
+		Gauge		cc_srtt;
+				/* round-trip time variation, in ms */
+		Gauge		cc_rttvar;
+				/* congestion control algorithm */
+		char		cc_algo[16];	/* TCP_CA_NAME_MAX */
+	}		tcpConnCcInfo;
 } mib2_tcpConnEntry_t;
 #define	MIB_FIRST_NEW_ELM_mib2_tcpConnEntry_t	tcpConnCreationProcess
 
@@ -1360,6 +1372,18 @@ typedef struct mib2_tcp6ConnEntry {
 	uint32_t	tcp6ConnCreationProcess;
 	/* system uptime when the connection was created */
 	uint64_t	tcp6ConnCreationTime;
+	struct tcp6ConnCcInfo_s {
+				/* congestion window, in bytes */
+		Gauge		cc_cwnd;
+				/* slow start threshold, in bytes */
+		Gauge		cc_ssthresh;
+				/* smoothed round-trip time, in ms */
+		Gauge		cc_srtt;
+				/* round-trip time variation, in ms */
+		Gauge		cc_rttvar;
+				/* congestion control algorithm */
+		char		cc_algo[16];	/* TCP_CA_NAME_MAX */
+	}		tcp6ConnCcInfo;
 } mib2_tcp6ConnEntry_t;
 #define	MIB_FIRST_NEW_ELM_mib2_tcp6ConnEntry_t	tcp6ConnCreationProcess
 
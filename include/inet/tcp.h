@@ -46,6 +46,7 @@ extern "C" {
 #include <inet/mib2.h>
 #include <inet/tcp_stack.h>
 #include <inet/tcp_sack.h>
+#include <inet/cc.h>
 
 /* TCP states */
 #define	TCPS_CLOSED		-6
@@ -252,8 +253,14 @@ typedef struct tcp_s {
 
 		tcp_lso :1,		/* Lower layer is capable of LSO */
 		tcp_is_wnd_shrnk : 1,	/* Window has shrunk */
+		tcp_tfo_connect : 1,	/* TCP_FASTOPEN_CONNECT option */
+		tcp_tfo_active : 1,	/* TFO option in the SYN */
 
-		tcp_pad_to_bit_31 : 18;
+		tcp_tfo_deferred : 1,	/* Our SYN waits for data */
+		tcp_tfo_early : 1,	/* Connected before the handshake */
+		tcp_tfo_accepted : 1,	/* Took the data in the peer's SYN */
+
+		tcp_pad_to_bit_31 : 13;
 
 	uint32_t	tcp_initial_pmtu; /* Initial outgoing Path MTU. */
 
@@ -282,6 +289,9 @@ typedef struct tcp_s {
 	uint32_t tcp_cwnd_max;
 	uint32_t tcp_csuna;		/* Clear (no rexmits in window) suna */
 
+	cc_algo_t *tcp_cc_algo;		/* Congestion control algorithm */
+	cc_var_t tcp_ccv;		/* and its state for this connection */
+
 	clock_t	tcp_rtt_sa;		/* Round trip smoothed average */
 	clock_t	tcp_rtt_sd;		/* Round trip smoothed deviation */
 	clock_t	tcp_rtt_update;		/* Round trip update(s) */
@@ -493,6 +503,25 @@ typedef struct tcp_s {
 	/* FIN-WAIT-2 flush timeout */
 	uint32_t		tcp_fin_wait_2_flush_interval;
 
+	/*
+	 * Pacing, see tcp_pace.c.  The wheel linkage and tcp_pace_state
+	 * are protected by the tcp_pace_lock of the squeue.
+	 */
+	uint64_t		tcp_pace_max_rate; /* SO_MAX_PACING_RATE */
+	hrtime_t		tcp_pace_next;	/* when we may send again */
+	struct tcp_s		*tcp_pace_wnext;
+	struct tcp_s		*tcp_pace_wprev;
+	int64_t			tcp_pace_tick;	/* wheel tick we are due at */
+	uint_t			tcp_pace_state;
+	mblk_t			tcp_pace_mp;	/* to resume output */
+
+	/* TCP Fast Open, see tcp_fastopen.c */
+	uint_t			tcp_fastopen_qlen; /* TCP_FASTOPEN */
+	uint32_t		tcp_tfo_syn_len; /* data sent with our SYN */
+	uint16_t		tcp_tfo_mss;	/* peer MSS, from the DCE */
+	uint8_t			tcp_tfo_cookie_len;
+	uint8_t			tcp_tfo_cookie[DCE_TFO_COOKIE_MAX];
+
 #ifdef DEBUG
 	pc_t			tcmp_stk[15];
 #endif
@@ -91,6 +91,7 @@ extern sock_downcalls_t sock_tcp_downcalls;
 #define	TCPOPT_REAL_SACK_LEN	4
 #define	TCPOPT_MAX_SACK_LEN	36
 #define	TCPOPT_HEADER_LEN	2
+#define	TCPOPT_TFO_MAX_LEN	(TCPOPT_HEADER_LEN+DCE_TFO_COOKIE_MAX)
 
 /* Round up the value to the nearest mss. */
 #define	MSS_ROUNDUP(value, mss)		((((value) - 1) / (mss) + 1) * (mss))
@@ -148,6 +149,33 @@ extern kmem_cache_t *tcp_timercache;
 
 #define	TCP_TIME_WAIT_BUCKETS	((TCP_TIME_WAIT_MAX / TCP_TIME_WAIT_DELAY) + 1)
 
+/*
+ * Paced connections waiting to send are kept on a per-squeue timing wheel
+ * of TCP_PACE_SLOTS slots, each 2^TCP_PACE_SHIFT ns (131us) long, so that
+ * the wheel spans 33ms.  See tcp_pace.c.
+ */
+#define	TCP_PACE_SHIFT		17
+#define	TCP_PACE_SLOTS		256
+
+/* tcp_pace_state */
+#define	TCP_PACE_IDLE		0
+#define	TCP_PACE_QUEUED		1	/* on the wheel */
+#define	TCP_PACE_RUNNING	2	/* tcp_pace_mp is on the squeue */
+
+#define	TCP_PACED(tcp)							\
+	((tcp)->tcp_pace_max_rate != 0 || (tcp)->tcp_tcps->tcps_pacing)
+
+/*
+ * TCP Fast Open, see tcp_fastopen.c.  tcps_fastopen is made of the
+ * TCP_FASTOPEN_* bits.  Our cookies are TCP_TFO_COOKIE_LEN bytes long; we
+ * cache any of the sizes RFC 7413 allows for other servers.
+ */
+#define	TCP_FASTOPEN_CLIENT	0x1
+#define	TCP_FASTOPEN_SERVER	0x2
+
+#define	TCP_TFO_COOKIE_LEN	8
+#define	TCP_TFO_COOKIE_MIN	4
+
 /*
  * For scalability, we must not run a timer for every TCP connection
  * in TIME_WAIT state.  To see why, consider (for time wait interval of
@@ -205,8 +233,74 @@ typedef struct tcp_squeue_priv_s {
 	tcp_t		*tcp_time_wait_bucket[TCP_TIME_WAIT_BUCKETS];
 	tcp_t		*tcp_free_list;
 	uint_t		tcp_free_list_cnt;
+
+	/* Pacing wheel, see tcp_pace.c */
+	kmutex_t	tcp_pace_lock;
+	callout_id_t	tcp_pace_tid;
+	int64_t		tcp_pace_schedule;
+	int64_t		tcp_pace_last;
+	uint_t		tcp_pace_cnt;
+	tcp_t		*tcp_pace_wheel[TCP_PACE_SLOTS];
 } tcp_squeue_priv_t;
 
+/*
+ * A detached TIME_WAIT connection does not need a tcp_t and conn_t, only
+ * enough to answer the segments which may still arrive for it.  So, unless
+ * tcps_time_wait_compact is turned off, tcp_time_wait_append() copies that
+ * into a tcp_tw_t and frees the connection at once, the way it is done for
+ * loopback connections.
+ *
+ * The records of a tcp_stack_t are kept in a hash table on the 4-tuple,
+ * tcps_tw_fanout, which is looked up for the segments which find no
+ * connection in the classifier, and for outgoing connections to check for
+ * a clash.  They are also on a list in the order they were added.  Since
+ * all of them last tcps_time_wait_interval, this is also the order they
+ * expire in, so one callout per stack collects them from the head of the
+ * list.  (Should the interval be made smaller, the records already on the
+ * list just stay a little longer.)  A duplicate FIN only sets tw_restart;
+ * the collector then puts the record back at the tail instead of freeing
+ * it.
+ *
+ * tcps_tw_lock protects the list and the callout; each bucket of the hash
+ * has its own lock, taken after tcps_tw_lock.  The input path removes a
+ * record from the hash when the 4-tuple is reused, but only the collector
+ * frees it.
+ */
+typedef struct tcp_tw_s {
+	struct tcp_tw_s	*tw_hash_next;
+	struct tcp_tw_s	**tw_ptphn;		/* NULL if not hashed */
+	struct tcp_tw_s	*tw_next;		/* tcps_tw_head list */
+	int64_t		tw_expire;
+	int64_t		tw_created;
+	in6_addr_t	tw_laddr;
+	in6_addr_t	tw_faddr;
+	uint32_t	tw_ports;		/* as conn_ports */
+	uint32_t	tw_snxt;
+	uint32_t	tw_rnxt;
+	uint32_t	tw_rwnd;
+	uint32_t	tw_ts_recent;
+	int64_t		tw_last_rcv_lbolt;
+	uint16_t	tw_win;			/* tw_rwnd, scaled */
+	uint8_t		tw_ipversion;
+	uint8_t		tw_ts_ok : 1,
+			tw_restart : 1,
+			tw_pad : 6;
+} tcp_tw_t;
+
+typedef struct tcp_tw_fanout_s {
+	kmutex_t	twf_lock;
+	tcp_tw_t	*twf_head;
+} tcp_tw_fanout_t;
+
+#define	TCP_TW_HASH(faddr, ports, size)					\
+	((unsigned)(ntohl((faddr)->s6_addr32[3]) ^ ((ports) >> 24) ^	\
+	((ports) >> 16) ^ ((ports) >> 8) ^ (ports)) % (size))
+
+#define	TCP_TW_MATCH(tw, laddr, faddr, ports)				\
+	((tw)->tw_ports == (ports) &&					\
+	IN6_ARE_ADDR_EQUAL(&(tw)->tw_faddr, (faddr)) &&			\
+	IN6_ARE_ADDR_EQUAL(&(tw)->tw_laddr, (laddr)))
+
 /*
  * Parameters for TCP Initial Send Sequence number (ISS) generation. The ISS
  * for outgoing connections is calculated as proposed in RFC 6528 section 3,
@@ -220,6 +314,11 @@ typedef struct tcp_squeue_priv_s {
 #define	TSTMP_GEQ(a, b)	((int32_t)((a)-(b)) >= 0)
 #define	TSTMP_LT(a, b)	((int32_t)((a)-(b)) < 0)
 
+/*
+ *  PAWS needs a timer for 24 days.  This is the number of ticks in 24 days
+ */
+#define	PAWS_TIMEOUT	((clock_t)(24*24*60*60*hz))
+
 /*
  * Initialize cwnd according to RFC 3390.  def_max_init_cwnd is
  * either tcp_slow_start_initial or tcp_slow_start_after idle
@@ -267,6 +366,35 @@ typedef struct tcp_squeue_priv_s {
 	tcp->tcp_cwnd_cnt = 0;						\
 }
 
+/*
+ * Call the hooks of the congestion control algorithm of the connection
+ * (see tcp_cc.c).
+ */
+#define	TCP_CC_ACK_RECEIVED(tcp, type, acked)				\
+{									\
+	cc_algo_t *_algo = (tcp)->tcp_cc_algo;				\
+									\
+	(tcp)->tcp_ccv.ccv_bytes_acked = (acked);			\
+	if (_algo->cc_ack_received != NULL)				\
+		_algo->cc_ack_received(&(tcp)->tcp_ccv, (type));	\
+}
+
+#define	TCP_CC_CALL(tcp, hook)						\
+{									\
+	cc_algo_t *_algo = (tcp)->tcp_cc_algo;				\
+									\
+	if (_algo->hook != NULL)					\
+		_algo->hook(&(tcp)->tcp_ccv);				\
+}
+
+#define	TCP_CC_CONG_SIGNAL(tcp, type)					\
+{									\
+	cc_algo_t *_algo = (tcp)->tcp_cc_algo;				\
+									\
+	if (_algo->cc_cong_signal != NULL)				\
+		_algo->cc_cong_signal(&(tcp)->tcp_ccv, (type));		\
+}
+
 /*
  * Set ECN capable transport (ECT) code point in IP header.
  *
@@ -303,6 +431,8 @@ typedef struct tcp_opt_s {
 	uint32_t	tcp_opt_wscale;
 	uint32_t	tcp_opt_ts_val;
 	uint32_t	tcp_opt_ts_ecr;
+	uchar_t		*tcp_opt_tfo_cookie;
+	uint_t		tcp_opt_tfo_len;
 	tcp_t		*tcp;
 } tcp_opt_t;
 
@@ -314,6 +444,7 @@ typedef struct tcp_opt_s {
 #define	TCP_OPT_TSTAMP_PRESENT	4
 #define	TCP_OPT_SACK_OK_PRESENT	8
 #define	TCP_OPT_SACK_PRESENT	16
+#define	TCP_OPT_TFO_PRESENT	32
 
 /*
  * Write-side flow-control is implemented via the per instance STREAMS
@@ -556,6 +687,10 @@ extern uint32_t tcp_early_abort;
 #define	tcps_wroff_xtra			tcps_propinfo_tbl[56].prop_cur_uval
 #define	tcps_dev_flow_ctl		tcps_propinfo_tbl[57].prop_cur_bval
 #define	tcps_reass_timeout		tcps_propinfo_tbl[58].prop_cur_uval
+#define	tcps_pacing			tcps_propinfo_tbl[59].prop_cur_bval
+#define	tcps_fastopen			tcps_propinfo_tbl[60].prop_cur_uval
+#define	tcps_time_wait_compact		tcps_propinfo_tbl[61].prop_cur_bval
+#define	tcps_time_wait_reuse		tcps_propinfo_tbl[62].prop_cur_bval
 
 extern struct qinit tcp_rinitv4, tcp_rinitv6;
 extern boolean_t do_tcp_fusion;
@@ -633,6 +768,40 @@ extern in_port_t	tcp_bindi(tcp_t *, in_port_t, const in6_addr_t *,
 extern in_port_t	tcp_update_next_port(in_port_t, const tcp_t *,
 			    boolean_t);
 
+/*
+ * Congestion control related functions in tcp_cc.c.
+ */
+extern void	tcp_cc_init(tcp_t *, tcp_t *);
+extern void	tcp_cc_fini(tcp_t *);
+extern int	tcp_cc_switch(tcp_t *, cc_algo_t *);
+extern void	tcp_cc_set_default(tcp_stack_t *, cc_algo_t *);
+extern void	tcp_cc_get_default(tcp_stack_t *, char *, size_t);
+extern void	tcp_cc_get_name(tcp_t *, char *, size_t);
+
+/*
+ * Pacing related functions in tcp_pace.c.
+ */
+extern uint64_t	tcp_pace_rate(tcp_t *);
+extern int	tcp_pace_allowance(tcp_t *, int32_t, uint64_t, hrtime_t);
+extern void	tcp_pace_sent(tcp_t *, uint32_t, uint64_t, hrtime_t, boolean_t);
+extern void	tcp_pace_schedule(tcp_t *, hrtime_t);
+extern void	tcp_pace_cancel(tcp_t *);
+extern void	tcp_pace_collector(void *);
+
+/*
+ * TCP Fast Open related functions in tcp_fastopen.c.
+ */
+extern boolean_t tcp_fastopen_connect(tcp_t *);
+extern void	tcp_fastopen_send_syn(tcp_t *);
+extern void	tcp_fastopen_synack(tcp_t *, tcp_opt_t *, int);
+extern void	tcp_fastopen_fallback(tcp_t *, boolean_t);
+extern uint_t	tcp_fastopen_opt(tcp_t *, int32_t, uint8_t *, uint_t);
+extern uint32_t	tcp_fastopen_listen(tcp_t *, tcp_t *, mblk_t *,
+    ip_recv_attr_t *);
+extern void	tcp_fastopen_accept(void *, mblk_t *, void *,
+    ip_recv_attr_t *);
+extern void	tcp_fastopen_deliver(tcp_t *);
+
 /*
  * Fusion related functions in tcp_fusion.c.
  */
@@ -665,6 +834,9 @@ extern int	tcp_wput_fallback(queue_t *, mblk_t *);
 extern void	tcp_xmit_ctl(char *, tcp_t *, uint32_t, uint32_t, int);
 extern void	tcp_xmit_listeners_reset(mblk_t *, ip_recv_attr_t *,
 		    ip_stack_t *i, conn_t *);
+extern void	tcp_xmit_reply(char *, mblk_t *, uint32_t, uint32_t, int,
+		    uint16_t, const uint32_t *, ip_recv_attr_t *, ip_stack_t *,
+		    conn_t *);
 extern mblk_t	*tcp_xmit_mp(tcp_t *, mblk_t *, int32_t, int32_t *,
 		    mblk_t **, uint32_t, boolean_t, uint32_t *, boolean_t);
 
@@ -745,6 +917,14 @@ extern void		tcp_time_wait_collector(void *);
 extern boolean_t	tcp_time_wait_remove(tcp_t *, tcp_squeue_priv_t *);
 extern void		tcp_time_wait_processing(tcp_t *, mblk_t *, uint32_t,
 			    uint32_t, int, tcpha_t *, ip_recv_attr_t *);
+extern boolean_t	tcp_time_wait_input(mblk_t *, ip_recv_attr_t *,
+			    tcp_stack_t *, uint32_t *);
+extern int		tcp_time_wait_connect(tcp_t *);
+extern void		tcp_time_wait_init(tcp_stack_t *);
+extern void		tcp_time_wait_fini(tcp_stack_t *);
+
+extern kmem_cache_t	*tcp_tw_cache;
+extern uint_t		tcp_time_wait_fanout_size;
 
 /*
  * Misc functions in tcp_misc.c.
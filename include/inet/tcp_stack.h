@@ -80,6 +80,7 @@ struct tcp_stack {
 	kstat_t		*tcps_kstat;	/* kstat exporting tcp_stat_t data */
 
 	MD5_CTX		tcps_iss_key;
+	MD5_CTX		tcps_tfo_key;	/* TCP Fast Open cookies */
 
 	/* Packet dropper for TCP IPsec policy drops. */
 	ipdropper_t	tcps_dropper;
@@ -120,6 +121,19 @@ struct tcp_stack {
 	 */
 	tcp_stats_cpu_t	**tcps_sc;
 	int		tcps_sc_cnt;
+
+	/* Default congestion control algorithm, protected by cc_lock. */
+	struct cc_algo	*tcps_cc_algo;
+
+	/* Compact TIME_WAIT records, see tcp_impl.h and tcp_time_wait.c. */
+	struct tcp_tw_fanout_s *tcps_tw_fanout;
+	uint_t		tcps_tw_fanout_size;
+	kmutex_t	tcps_tw_lock;
+	struct tcp_tw_s	*tcps_tw_head;
+	struct tcp_tw_s	*tcps_tw_tail;
+	timeout_id_t	tcps_tw_tid;
+	uint_t		tcps_tw_cnt;
+	kstat_t		*tcps_tw_kstat;
 };
 
 typedef struct tcp_stack tcp_stack_t;
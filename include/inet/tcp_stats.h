@@ -121,6 +121,17 @@ typedef struct tcp_stat {
 	kstat_named_t	tcp_rst_unsent;
 	kstat_named_t	tcp_reclaim_cnt;
 	kstat_named_t	tcp_reass_timeout;
+	kstat_named_t	tcp_out_paced_bytes;
+	kstat_named_t	tcp_out_burst_bytes;
+	kstat_named_t	tcp_pace_delayed;
+	kstat_named_t	tcp_pace_wakeups;
+	kstat_named_t	tcp_fastopen_active;
+	kstat_named_t	tcp_fastopen_accepted;
+	kstat_named_t	tcp_fastopen_failed;
+	kstat_named_t	tcp_fastopen_fallback;
+	kstat_named_t	tcp_time_wait_compact;
+	kstat_named_t	tcp_time_wait_reuse;
+	kstat_named_t	tcp_rfs_switch;
 #ifdef TCP_DEBUG_COUNTER
 	kstat_named_t	tcp_time_wait;
 	kstat_named_t	tcp_rput_time_wait;
@@ -177,6 +188,17 @@ typedef struct tcp_stat_counter_s {
 	uint64_t	tcp_rst_unsent;
 	uint64_t	tcp_reclaim_cnt;
 	uint64_t	tcp_reass_timeout;
+	uint64_t	tcp_out_paced_bytes;
+	uint64_t	tcp_out_burst_bytes;
+	uint64_t	tcp_pace_delayed;
+	uint64_t	tcp_pace_wakeups;
+	uint64_t	tcp_fastopen_active;
+	uint64_t	tcp_fastopen_accepted;
+	uint64_t	tcp_fastopen_failed;
+	uint64_t	tcp_fastopen_fallback;
+	uint64_t	tcp_time_wait_compact;
+	uint64_t	tcp_time_wait_reuse;
+	uint64_t	tcp_rfs_switch;
 #ifdef TCP_DEBUG_COUNTER
 	uint64_t	tcp_time_wait;
 	uint64_t	tcp_rput_time_wait;
@@ -178,8 +178,11 @@ typedef	struct udp_s {
 		udp_issocket : 1,	/* socket mode; sockfs is on top */
 		udp_nat_t_endpoint : 1,	/* UDP_NAT_T_ENDPOINT option */
 		udp_rcvhdr : 1,		/* UDP_RCVHDR option */
+		udp_gro : 1,		/* UDP_GRO option */
 
-		udp_pad_to_bit_31 : 29;
+		udp_pad_to_bit_31 : 28;
+
+	uint_t		udp_segsize;	/* UDP_SEGMENT option */
 
 	/* Following 2 fields protected by the uf_lock */
 	struct udp_s	*udp_bind_hash; /* Bind hash chain */
@@ -198,6 +201,29 @@ typedef	struct udp_s {
 	struct sockaddr_storage	udp_delayed_addr;
 } udp_t;
 
+/*
+ * Receive coalescing state, one per ip_input chain; see udp_gro_hold().
+ * Each slot holds a T_UNITDATA_IND for one conn_t, followed by the payloads
+ * of the datagrams merged into it.
+ */
+#define	UDP_GRO_SLOTS	4
+
+typedef struct udp_gro_slot_s {
+	conn_t		*ugs_connp;	/* NULL if the slot is free */
+	mblk_t		*ugs_mp;	/* T_UNITDATA_IND */
+	mblk_t		*ugs_tail;	/* Last payload mblk */
+	in6_addr_t	ugs_src;	/* Source address, maybe v4-mapped */
+	in_port_t	ugs_sport;	/* Source port */
+	boolean_t	ugs_closed;	/* Got a short segment */
+	uint_t		ugs_segsize;	/* Size of the first payload */
+	uint_t		ugs_len;	/* Total payload */
+	uint_t		ugs_nsegs;
+} udp_gro_slot_t;
+
+typedef struct udp_gro_s {
+	udp_gro_slot_t	ug_slot[UDP_GRO_SLOTS];
+} udp_gro_t;
+
 /* UDP Protocol header aligned */
 typedef	struct udpahdr_s {
 	in_port_t	uha_src_port;		/* Source port */
@@ -233,6 +259,8 @@ typedef	struct udpahdr_s {
 #endif /* DEBUG */
 
 extern int	udp_opt_default(queue_t *, t_scalar_t, t_scalar_t, uchar_t *);
+extern void	udp_gro_init(udp_gro_t *);
+extern void	udp_gro_flush(udp_gro_t *);
 extern int	udp_tpi_opt_get(queue_t *, t_scalar_t, t_scalar_t, uchar_t *);
 extern int	udp_tpi_opt_set(queue_t *, uint_t, int, int, uint_t, uchar_t *,
 		    uint_t *, uchar_t *, void *, cred_t *);
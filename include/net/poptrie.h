@@ -0,0 +1,106 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _NET_POPTRIE_H
+#define	_NET_POPTRIE_H
+
+/*
+ * Multibit compressed trie for longest prefix match, shared between the IP
+ * forwarding table and userland.  A trie is built in one go from a list of
+ * routes and is immutable afterwards; see poptrie.c.
+ */
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	POPTRIE_DIR_BITS	16	/* bits resolved by the top array */
+#define	POPTRIE_STRIDE		6	/* bits resolved by each node */
+#define	POPTRIE_DIR_LEAF	0x80000000U
+
+typedef struct poptrie_node {
+	uint64_t	pn_vec;		/* slots that have a child node */
+	uint64_t	pn_leafvec;	/* slots that start a run of leaves */
+	uint32_t	pn_base0;	/* index of the first leaf */
+	uint32_t	pn_base1;	/* index of the first child */
+} poptrie_node_t;
+
+typedef struct poptrie {
+	uint32_t	*pt_dir;	/* node index, or leaf | DIR_LEAF */
+	poptrie_node_t	*pt_nodes;
+	uintptr_t	*pt_leaves;	/* route values, 0 for no route */
+	uint32_t	pt_nnodes;
+	uint32_t	pt_nleaves;
+	uint32_t	pt_nroutes;
+	uint_t		pt_keybits;	/* 32 or 128 */
+} poptrie_t;
+
+/*
+ * A route to be loaded into the trie.  The key is in host byte order, most
+ * significant word first, with an IPv4 address in the top 32 bits of
+ * pr_key[0].  pr_value must not be zero.
+ */
+typedef struct poptrie_route {
+	uint64_t	pr_key[2];
+	uintptr_t	pr_value;
+	uint_t		pr_plen;
+} poptrie_route_t;
+
+extern poptrie_t *poptrie_build(poptrie_route_t *, uint32_t, uint_t);
+extern void poptrie_free(poptrie_t *);
+extern size_t poptrie_size(const poptrie_t *);
+extern uintptr_t poptrie_lookup(const poptrie_t *, const uint64_t *);
+
+/*
+ * The IPv4 lookup is on the forwarding path, so it is inlined; addr is in
+ * host byte order.
+ */
+static inline uint_t
+poptrie_popcnt(uint64_t v)
+{
+	v = v - ((v >> 1) & 0x5555555555555555ULL);
+	v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return ((uint_t)((v * 0x0101010101010101ULL) >> 56));
+}
+
+static inline uintptr_t
+poptrie_lookup4(const poptrie_t *pt, uint32_t addr)
+{
+	const poptrie_node_t *pn;
+	uint64_t key = (uint64_t)addr << 32;
+	uint64_t bit;
+	uint32_t idx;
+	uint_t off;
+
+	idx = pt->pt_dir[addr >> (32 - POPTRIE_DIR_BITS)];
+	if (idx & POPTRIE_DIR_LEAF)
+		return (pt->pt_leaves[idx & ~POPTRIE_DIR_LEAF]);
+
+	pn = &pt->pt_nodes[idx];
+	for (off = POPTRIE_DIR_BITS; ; off += POPTRIE_STRIDE) {
+		bit = 1ULL << ((key << off) >> (64 - POPTRIE_STRIDE));
+		if (!(pn->pn_vec & bit))
+			break;
+		pn = &pt->pt_nodes[pn->pn_base1 +
+		    poptrie_popcnt(pn->pn_vec & ((bit << 1) - 1)) - 1];
+	}
+	return (pt->pt_leaves[pn->pn_base0 +
+	    poptrie_popcnt(pn->pn_leafvec & ((bit << 1) - 1)) - 1]);
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _NET_POPTRIE_H */
@@ -64,6 +64,10 @@ typedef struct aio_result32_t {
 #define	AIORESERVED1	23	/* reserved for the aio implementation */
 #define	AIORESERVED2	24
 #define	AIORESERVED3	25
+#define	AIORING_SETUP	26	/* aio rings, see <sys/aio_ring.h> */
+#define	AIORING_ENTER	27
+#define	AIORING_WORK	28
+#define	AIORING_DESTROY	29
 #if	defined(_LP64) && !defined(_KERNEL)
 #define	AIOLIO64	AIOLIO
 #define	AIOSUSPEND64	AIOSUSPEND
@@ -130,6 +130,8 @@ typedef struct aio {
 	int 		aio_notifycnt;		/* # user-level notifications */
 	kmutex_t	aio_portq_mutex;	/* mutex for aio_portq */
 	aio_req_t 	*aio_hash[AIO_HASHSZ];	/* hash list of requests */
+	kmutex_t	aio_ring_mutex;		/* protects aio_rings */
+	struct aio_ring	*aio_rings;		/* aio rings, see aio_ring.c */
 } aio_t;
 
 /*
@@ -46,6 +46,18 @@ extern int aphysio(int (*)(), int (*)(), dev_t, int, void (*)(),
 		struct aio_req *);
 extern int anocancel(struct buf *);
 
+/*
+ * async I/O to files, for file systems implementing fop_aio().
+ */
+struct vnode;
+struct cred;
+struct caller_context;
+
+extern int aio_vnio_start(struct aio_req *, int, caddr_t *);
+extern void aio_vnio_done(struct aio_req *, size_t, int);
+extern int aio_vnio_rw(struct vnode *, struct aio_req *, int, struct cred *,
+		struct caller_context *);
+
 #endif /* _KERNEL */
 
 #ifdef	__cplusplus
@@ -0,0 +1,211 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _SYS_AIO_RING_H
+#define	_SYS_AIO_RING_H
+
+/*
+ * Asynchronous I/O rings.
+ *
+ * An aio ring is a pair of queues shared between a process and the kernel:
+ * the submission queue (SQ), to which the process adds requests, and the
+ * completion queue (CQ), to which the kernel posts their results.  Both
+ * live in a single mapping created by aioring_setup(3C), so requests can be
+ * queued and completions reaped without a system call per operation.
+ *
+ * The process fills in the SQE at index (sq_tail & (entries - 1)) and then
+ * advances arh_sq_tail; the kernel advances arh_sq_head as it takes
+ * requests.  The kernel writes the CQE at (cq_tail & (cq_entries - 1)) and
+ * then advances arh_cq_tail; the process advances arh_cq_head once it has
+ * consumed a CQE.  The kernel never takes a request unless there is room in
+ * the CQ for its completion, so completions are never dropped.
+ *
+ * Requests are executed by worker threads of the process that are parked
+ * in the kernel.  A ring with no workers executes requests synchronously
+ * in aioring_enter().
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Request opcodes.
+ */
+#define	AIORING_OP_NOP		0
+#define	AIORING_OP_READ		1	/* pread(2), or read(2) */
+#define	AIORING_OP_WRITE	2	/* pwrite(2), or write(2) */
+#define	AIORING_OP_FSYNC	3	/* fsync(3C), or fdatasync(3C) */
+#define	AIORING_OP_POLL		4	/* poll(2) with no timeout */
+#define	AIORING_OP_ACCEPT	5	/* accept4(3SOCKET) */
+#define	AIORING_NOPS		6
+
+/*
+ * sqe_off value for reads and writes at (and updating) the file offset,
+ * as with read(2) and write(2).  Required for files that can't seek.
+ */
+#define	AIORING_OFF_CUR		((uint64_t)-1)
+
+/* sqe_flags */
+#define	AIORING_SQE_DSYNC	0x01	/* AIORING_OP_FSYNC: data only */
+
+/*
+ * Submission queue entry.
+ *
+ *	opcode		sqe_addr	sqe_len		sqe_addr2
+ *	READ/WRITE	buffer		length		-
+ *	POLL		pollfd_t array	nfds		-
+ *	ACCEPT		sockaddr	-		socklen_t
+ *
+ * sqe_aflags holds the accept4(3SOCKET) flags.  Buffers, pollfd arrays and
+ * addresses must remain valid until the request completes.
+ */
+typedef struct aioring_sqe {
+	uint8_t		sqe_opcode;	/* AIORING_OP_* */
+	uint8_t		sqe_flags;	/* AIORING_SQE_* */
+	uint16_t	sqe_pad;
+	int32_t		sqe_fd;		/* file descriptor */
+	uint64_t	sqe_off;	/* file offset, or AIORING_OFF_CUR */
+	uint64_t	sqe_addr;
+	uint32_t	sqe_len;
+	uint32_t	sqe_aflags;
+	uint64_t	sqe_addr2;
+	uint64_t	sqe_user;	/* returned in the completion */
+} aioring_sqe_t;
+
+/*
+ * Completion queue entry.  cqe_res is the return value of the equivalent
+ * system call and cqe_error its errno (0 on success).
+ */
+typedef struct aioring_cqe {
+	uint64_t	cqe_user;	/* sqe_user of the request */
+	int64_t		cqe_res;
+	int32_t		cqe_error;
+	uint32_t	cqe_pad;
+} aioring_cqe_t;
+
+/*
+ * Header at the start of the ring mapping.  Each index is in its own
+ * cache line, since the process and the kernel update them concurrently.
+ */
+typedef struct aioring_hdr {
+	volatile uint32_t	arh_sq_head;	/* written by the kernel */
+	uint32_t		arh_pad0[15];
+	volatile uint32_t	arh_sq_tail;	/* written by the process */
+	uint32_t		arh_pad1[15];
+	volatile uint32_t	arh_cq_head;	/* written by the process */
+	uint32_t		arh_pad2[15];
+	volatile uint32_t	arh_cq_tail;	/* written by the kernel */
+	volatile uint32_t	arh_flags;	/* AIORING_HDR_* */
+	uint32_t		arh_pad3[14];
+} aioring_hdr_t;
+
+/*
+ * arh_flags: an AIORING_SETUP_SQPOLL ring's workers have stopped polling
+ * the SQ, and aioring_enter() must be called to have new entries taken.
+ */
+#define	AIORING_HDR_NEED_WAKEUP	0x01
+
+/* arp_flags */
+#define	AIORING_SETUP_SQPOLL	0x01	/* idle workers poll the SQ */
+
+/*
+ * aioring_setup(3C) parameters.
+ */
+typedef struct aioring_params {
+	uint32_t	arp_entries;	/* in: SQ entries, out: rounded up */
+	uint32_t	arp_cq_entries;	/* out: CQ entries */
+	uint32_t	arp_flags;	/* in: AIORING_SETUP_* */
+	uint32_t	arp_workers;	/* in: worker threads to start */
+	int32_t		arp_port;	/* in: event port, or -1 */
+	uint32_t	arp_pad;
+	uint64_t	arp_portuser;	/* in: user value for port events */
+	uint64_t	arp_addr;	/* out: address of the ring mapping */
+	uint64_t	arp_size;	/* out: size of the ring mapping */
+	uint32_t	arp_sq_off;	/* out: offset of the SQE array */
+	uint32_t	arp_cq_off;	/* out: offset of the CQE array */
+} aioring_params_t;
+
+#define	AIORING_MAX_ENTRIES	4096
+
+/* aioring_enter() flags */
+#define	AIORING_ENTER_GETEVENTS	0x01	/* wait for min_complete CQEs */
+
+#ifdef _KERNEL
+
+#include <sys/mutex.h>
+#include <sys/condvar.h>
+#include <sys/port_kernel.h>
+
+/*
+ * Requests that were interrupted before they could complete, to be retried
+ * by the next worker to look for work.
+ */
+typedef struct aio_ring_retry {
+	struct aio_ring_retry	*arr_next;
+	aioring_sqe_t		arr_sqe;
+} aio_ring_retry_t;
+
+typedef struct aio_ring {
+	struct aio_ring	*ar_next;	/* next ring of the process */
+	int		ar_id;		/* ring identifier */
+	kmutex_t	ar_lock;	/* protects everything below */
+	kcondvar_t	ar_workcv;	/* idle workers wait here */
+	kcondvar_t	ar_cqcv;	/* aioring_enter() waits here */
+	uint_t		ar_flags;	/* AR_* and AIORING_SETUP_* */
+	uint_t		ar_refcnt;	/* process's list + workers */
+	uint_t		ar_workers;	/* threads in aio_ring_work() */
+	uint_t		ar_idle;	/* ... of which are waiting */
+	uint_t		ar_cqwaiters;	/* threads waiting for CQEs */
+	uint_t		ar_inflight;	/* requests taken, not posted */
+	uint32_t	ar_sq_entries;
+	uint32_t	ar_cq_entries;
+	uint32_t	ar_sq_head;	/* kernel's copy of arh_sq_head */
+	uint32_t	ar_cq_tail;	/* kernel's copy of arh_cq_tail */
+	aio_ring_retry_t *ar_retry;	/* interrupted requests */
+	aioring_hdr_t	*ar_hdr;	/* kernel mapping of the ring */
+	aioring_sqe_t	*ar_sq;
+	aioring_cqe_t	*ar_cq;
+	caddr_t		ar_uaddr;	/* process's mapping of the ring */
+	size_t		ar_size;
+	struct anon_map	*ar_amp;
+	struct kproject	*ar_proj;	/* charged for the locked pages */
+	port_kevent_t	*ar_portev;	/* completion notice event */
+	void		*ar_portsrc;
+	int		ar_port;
+	uint_t		ar_portpend;	/* completions since the notice */
+} aio_ring_t;
+
+#define	AR_CLOSING	0x100		/* ring is being destroyed */
+#define	AR_SETUP	0x200		/* being set up; see aio_ring_setup() */
+
+extern int aio_ring_setup(aioring_params_t *, long *);
+extern int aio_ring_enter(int, uint_t, uint_t, uint_t, timespec_t *, long *);
+extern int aio_ring_work(int);
+extern int aio_ring_destroy(int);
+extern void aio_ring_exit(void);
+
+#else	/* _KERNEL */
+
+extern int aioring_setup(aioring_params_t *);
+extern int aioring_enter(int, uint_t, uint_t, uint_t, const timespec_t *);
+extern int aioring_destroy(int);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_AIO_RING_H */
@@ -230,6 +230,8 @@ typedef struct callout_hash {
  *	Callout list is present in the callout heap.
  * CALLOUT_LIST_FLAG_QUEUED
  *	Callout list is present in the callout queue.
+ * CALLOUT_LIST_FLAG_WHEELED
+ *	Callout list is present in the callout wheel.
  */
 #define	CALLOUT_LIST_FLAG_FREE			0x1
 #define	CALLOUT_LIST_FLAG_ABSOLUTE		0x2
@@ -237,6 +239,7 @@ typedef struct callout_hash {
 #define	CALLOUT_LIST_FLAG_NANO			0x8
 #define	CALLOUT_LIST_FLAG_HEAPED		0x10
 #define	CALLOUT_LIST_FLAG_QUEUED		0x20
+#define	CALLOUT_LIST_FLAG_WHEELED		0x40
 
 struct callout_list {
 	callout_list_t	*cl_next;	/* next in clhash */
@@ -244,6 +247,9 @@ struct callout_list {
 	hrtime_t	cl_expiration;	/* expiration for callouts in list */
 	callout_hash_t	cl_callouts;	/* list of callouts */
 	int		cl_flags;	/* callout flags */
+	callout_list_t	*cl_wnext;	/* next in wheel slot */
+	callout_list_t	*cl_wprev;	/* prev in wheel slot */
+	callout_hash_t	*cl_slot;	/* wheel slot, if wheeled */
 };
 
 /*
@@ -265,6 +271,35 @@ typedef struct callout_heap {
 #endif
 } callout_heap_t;
 
+/*
+ * Callout timing wheel. Callout lists whose resolution is at least a clock
+ * tick are kept in a hierarchical timing wheel instead of the heap, which
+ * makes inserting and removing one O(1). Level 0 has a slot per tick for
+ * the next CALLOUT_WHEEL_SLOTS ticks; each level above has slots that are
+ * CALLOUT_WHEEL_SLOTS times as wide as those of the level below, and its
+ * lists are cascaded down to the lower levels as their time approaches.
+ * Expirations further out than the wheel spans are parked in the top level
+ * and re-cascaded until they fit.
+ *
+ * cw_bitmap has a bit set for each non-empty slot, so that the next slot
+ * to be processed can be found without walking empty ones.
+ */
+#define	CALLOUT_WHEEL_BITS	6
+#define	CALLOUT_WHEEL_SLOTS	(1 << CALLOUT_WHEEL_BITS)
+#define	CALLOUT_WHEEL_MASK	(CALLOUT_WHEEL_SLOTS - 1)
+#define	CALLOUT_WHEEL_LEVELS	4
+#define	CALLOUT_WHEEL_SHIFT(l)	((l) * CALLOUT_WHEEL_BITS)
+#define	CALLOUT_WHEEL_SPAN	\
+	(1ULL << CALLOUT_WHEEL_SHIFT(CALLOUT_WHEEL_LEVELS))
+
+typedef struct callout_wheel {
+	uint64_t	cw_now;		/* first tick not yet processed */
+	hrtime_t	cw_next;	/* expiration the cyclic is set to */
+	ulong_t		cw_num;		/* callout lists in the wheel */
+	uint64_t	cw_bitmap[CALLOUT_WHEEL_LEVELS];
+	callout_hash_t	cw_slots[CALLOUT_WHEEL_LEVELS][CALLOUT_WHEEL_SLOTS];
+} callout_wheel_t;
+
 /*
  * When the heap contains too many empty callout lists, it needs to be
  * cleaned up. The decision to clean up the heap is a function of the
@@ -296,6 +331,17 @@ typedef struct callout_heap {
  *	Number of callout structures allocated.
  * CALLOUT_CLEANUPS
  *	Number of times a callout table is cleaned up.
+ * CALLOUT_WHEEL_TIMEOUTS
+ *	Callouts created in the callout wheel since boot.
+ * CALLOUT_WHEEL_UNTIMEOUTS
+ *	Number of cancelled callouts that were in the callout wheel.
+ * CALLOUT_WHEEL_BATCHES
+ *	Number of callout lists expired from the callout wheel.
+ * CALLOUT_WHEEL_CASCADES
+ *	Number of callout lists moved down a level of the callout wheel.
+ * CALLOUT_WHEEL_COALESCED
+ *	Number of callouts deferred, within their slack, to share an
+ *	expiration with others.
  */
 typedef enum callout_stat_type {
 	CALLOUT_TIMEOUTS,
@@ -306,6 +352,11 @@ typedef enum callout_stat_type {
 	CALLOUT_EXPIRATIONS,
 	CALLOUT_ALLOCATIONS,
 	CALLOUT_CLEANUPS,
+	CALLOUT_WHEEL_TIMEOUTS,
+	CALLOUT_WHEEL_UNTIMEOUTS,
+	CALLOUT_WHEEL_BATCHES,
+	CALLOUT_WHEEL_CASCADES,
+	CALLOUT_WHEEL_COALESCED,
 	CALLOUT_NUM_STATS
 } callout_stat_type_t;
 
@@ -375,8 +426,12 @@ typedef struct callout_table {
 	int		ct_nreap;	/* # heap entries that need reaping */
 	cyclic_id_t	ct_qcyclic;	/* cyclic for the callout queue */
 	callout_hash_t	ct_queue;	/* overflow queue of callouts */
-#ifndef _LP64
-	char		ct_pad[12];	/* cache alignment */
+	callout_wheel_t	*ct_wheel;	/* timing wheel for low-res callouts */
+	cyclic_id_t	ct_wcyclic;	/* cyclic for the callout wheel */
+#ifdef _LP64
+	char		ct_pad[48];	/* cache alignment */
+#else
+	char		ct_pad[4];	/* cache alignment */
 #endif
 	/*
 	 * This structure should be aligned to a 64-byte (cache-line)
@@ -404,6 +459,16 @@ typedef struct callout_table {
 		ct_kstat_data[CALLOUT_ALLOCATIONS].value.ui64
 #define	ct_cleanups							\
 		ct_kstat_data[CALLOUT_CLEANUPS].value.ui64
+#define	ct_wheel_timeouts						\
+		ct_kstat_data[CALLOUT_WHEEL_TIMEOUTS].value.ui64
+#define	ct_wheel_untimeouts						\
+		ct_kstat_data[CALLOUT_WHEEL_UNTIMEOUTS].value.ui64
+#define	ct_wheel_batches						\
+		ct_kstat_data[CALLOUT_WHEEL_BATCHES].value.ui64
+#define	ct_wheel_cascades						\
+		ct_kstat_data[CALLOUT_WHEEL_CASCADES].value.ui64
+#define	ct_wheel_coalesced						\
+		ct_kstat_data[CALLOUT_WHEEL_COALESCED].value.ui64
 
 /*
  * CALLOUT_CHUNK is the minimum initial size of each heap, and the amount
@@ -439,6 +504,13 @@ typedef struct callout_table {
 
 #define	CALLOUT_TOLERANCE	200000		/* nanoseconds */
 
+/*
+ * A low-resolution callout may be deferred by up to 1/2^CALLOUT_SLACK_SHIFT
+ * of its interval, so that it can share an expiration (and a callout list)
+ * with others.
+ */
+#define	CALLOUT_SLACK_SHIFT	8
+
 extern void		callout_init(void);
 extern void		membar_sync(void);
 extern void		callout_cpu_online(cpu_t *);
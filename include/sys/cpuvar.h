@@ -228,6 +228,13 @@ typedef struct cpu {
 	 */
 	volatile uint_t		cpu_generation;	/* tracking on/off-line */
 
+	/*
+	 * Bumped by the dispatcher on every context switch except those of
+	 * an interrupt thread blocking (and resuming the thread it pinned);
+	 * each is an epoch quiescent state.
+	 */
+	volatile ulong_t	cpu_epoch_qs;
+
 	/*
 	 * New members must be added /before/ this member, as the CTF tools
 	 * rely on this being the last field before cpu_m, so they can
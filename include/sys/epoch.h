@@ -0,0 +1,57 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _SYS_EPOCH_H
+#define	_SYS_EPOCH_H
+
+/*
+ * Epoch-based deferred reclamation.  See epoch.c for details.
+ *
+ * A reader brackets its lookups of a shared structure with epoch_enter()
+ * and epoch_exit(), and takes no lock.  A writer unlinks an object under
+ * whatever lock serializes the writers, and hands it to call_epoch(),
+ * whose callback frees it once no reader can still be looking at it.
+ *
+ * An epoch section disables kernel preemption: it must not block, and it
+ * must not be entered above LOCK_LEVEL.
+ */
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct epoch_cb {
+	struct epoch_cb	*ec_next;
+	void		(*ec_func)(struct epoch_cb *);
+} epoch_cb_t;
+
+#ifdef	_KERNEL
+
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+
+#define	epoch_enter()		kpreempt_disable()
+#define	epoch_exit()		kpreempt_enable()
+#define	EPOCH_HELD()		(curthread->t_preempt != 0)
+
+extern void	call_epoch(epoch_cb_t *, void (*)(epoch_cb_t *));
+extern void	epoch_synchronize(void);
+extern void	epoch_init(void);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_EPOCH_H */
@@ -257,6 +257,8 @@ struct fem {
 			      caller_context_t *ct);
 	int (*femop_retzcbuf)(femarg_t *vf, xuio_t *xuio, cred_t *cr,
 			      caller_context_t *ct);
+	int (*femop_aio)(femarg_t *vf, struct aio_req *aio, int rw,
+			 cred_t *cr, caller_context_t *ct);
 };
 
 struct fsem {
@@ -372,6 +374,8 @@ extern int vhead_reqzcbuf(vnode_t *vp, enum uio_rw ioflag, xuio_t *xuiop,
 			  cred_t *cr, caller_context_t *ct);
 extern int vhead_retzcbuf(vnode_t *vp, xuio_t *xuiop, cred_t *cr,
 			  caller_context_t *ct);
+extern int vhead_aio(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cr,
+		     caller_context_t *ct);
 
 extern int fshead_mount(vfs_t *vfsp, vnode_t *mvp, struct mounta *uap,
 			cred_t *cr);
@@ -488,6 +492,8 @@ extern int vnext_reqzcbuf(femarg_t *vf, enum uio_rw ioflag, xuio_t *xuiop,
 			cred_t *cr, caller_context_t *ct);
 extern int vnext_retzcbuf(femarg_t *vf, xuio_t *xuiop, cred_t *cr,
 			caller_context_t *ct);
+extern int vnext_aio(femarg_t *vf, struct aio_req *aio, int rw, cred_t *cr,
+			caller_context_t *ct);
 
 extern int vfsnext_mount(fsemarg_t *vf, vnode_t *mvp, struct mounta *uap,
 			cred_t *cr);
@@ -83,6 +83,9 @@ struct lock_descriptor {
 		flk_callback_t	*l_callbacks;	/* callbacks, or NULL */
 		zoneid_t	l_zoneid;	/* zone of request */
 		file_t		*l_ofd;		/* OFD-style reference */
+	struct	lock_descriptor	*l_ileft;	/* interval tree left child */
+	struct	lock_descriptor	*l_iright;	/* interval tree right child */
+		uoff_t		l_imax;		/* max l_end in subtree */
 };
 
 typedef struct 	lock_descriptor	lock_descriptor_t;
@@ -90,12 +93,18 @@ typedef struct 	lock_descriptor	lock_descriptor_t;
 /*
  * Each graph holds locking information for some number of vnodes.  The
  * active and sleeping lists are circular, with a dummy head element.
+ *
+ * The locks on both lists are also indexed by an interval tree, ordered by
+ * vnode and then by start offset, so that the locks of a vnode which
+ * overlap a given range can be found without walking all of them.
  */
 
 struct	graph {
 	kmutex_t	gp_mutex;	/* mutex for this graph */
 	struct	lock_descriptor	active_locks;
 	struct	lock_descriptor	sleeping_locks;
+	struct	lock_descriptor	*active_tree;	/* index of active_locks */
+	struct	lock_descriptor	*sleeping_tree;	/* index of sleeping_locks */
 	int index;	/* index of this graph into the hash table */
 	int mark;	/* used for coloring the graph */
 };
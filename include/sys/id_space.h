@@ -36,9 +36,16 @@ extern "C" {
 
 #ifdef _KERNEL
 
-typedef vmem_t id_space_t;
+typedef struct id_space id_space_t;
+
+/*
+ * id_space_xcreate() flags
+ */
+#define	ID_SPACE_VMEM	0x1	/* keep in a vmem arena */
+#define	ID_SPACE_BITMAP	0x2	/* keep in a bitmap, whatever its size */
 
 id_space_t *id_space_create(const char *, id_t, id_t);
+id_space_t *id_space_xcreate(const char *, id_t, id_t, int);
 void id_space_destroy(id_space_t *);
 void id_space_extend(id_space_t *, id_t, id_t);
 id_t id_alloc(id_space_t *);
@@ -231,6 +231,7 @@ typedef struct kmem_slab {
 	uint32_t		slab_stuck_offset; /* unmoved buffer offset */
 	uint16_t		slab_later_count; /* cf KMEM_CBRC_LATER */
 	uint16_t		slab_flags;	/* bits to mark the slab */
+	int			slab_lgrp;	/* lgroup it was created on */
 } kmem_slab_t;
 
 #define	KMEM_HASH_INITIAL	64
@@ -354,6 +355,8 @@ struct kmem_cache {
 	uint64_t	cache_lookup_depth;	/* hash lookup depth */
 	uint64_t	cache_depot_contention;	/* mutex contention count */
 	uint64_t	cache_depot_contention_prev; /* previous snapshot */
+	uint64_t	cache_remote_alloc;	/* rounds from remote lgroups */
+	uint64_t	cache_remote_free;	/* magazines sent home */
 
 	/*
 	 * Cache properties
@@ -405,6 +408,7 @@ struct kmem_cache {
 	kmem_magtype_t	*cache_magtype;		/* magazine type */
 	kmem_maglist_t	cache_full;		/* full magazines */
 	kmem_maglist_t	cache_empty;		/* empty magazines */
+	kmem_maglist_t	*cache_lgrp_full;	/* full magazines per lgroup */
 	kmem_dump_t	cache_dump;		/* used during crash dump */
 
 	/*
@@ -59,7 +59,8 @@ extern "C" {
 #define	LS_THREAD_LOCK_HIGH_ACQUIRE	22
 #define	LS_THREAD_LOCK_HIGH_SPIN	23
 #define	LS_TURNSTILE_INTERLOCK_SPIN	24
-#define	LS_NPROBES			25
+#define	LS_MUTEX_ENTER_QSPIN		25
+#define	LS_NPROBES			26
 
 #define	LS_MUTEX_ENTER			"mutex_enter"
 #define	LS_MUTEX_EXIT			"mutex_exit"
@@ -82,6 +83,7 @@ extern "C" {
 #define	LS_ACQUIRE			"acquire"
 #define	LS_RELEASE			"release"
 #define	LS_SPIN				"spin"
+#define	LS_QSPIN			"qspin"
 #define	LS_BLOCK			"block"
 #define	LS_UPGRADE			"upgrade"
 #define	LS_DOWNGRADE			"downgrade"
@@ -95,6 +97,7 @@ extern "C" {
 #define	LSA_RELEASE			(LS_TYPE_ADAPTIVE "-" LS_RELEASE)
 #define	LSA_SPIN			(LS_TYPE_ADAPTIVE "-" LS_SPIN)
 #define	LSA_BLOCK			(LS_TYPE_ADAPTIVE "-" LS_BLOCK)
+#define	LSA_QSPIN			(LS_TYPE_ADAPTIVE "-" LS_QSPIN)
 #define	LSS_ACQUIRE			(LS_TYPE_SPIN "-" LS_ACQUIRE)
 #define	LSS_RELEASE			(LS_TYPE_SPIN "-" LS_RELEASE)
 #define	LSS_SPIN			(LS_TYPE_SPIN "-" LS_SPIN)
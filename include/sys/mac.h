@@ -408,6 +408,9 @@ typedef enum {
 
 typedef	int	(*mac_intr_enable_t)(mac_intr_handle_t);
 typedef	int	(*mac_intr_disable_t)(mac_intr_handle_t);
+typedef	boolean_t (*mac_rx_steer_t)(void *, void *, uint32_t, uint32_t,
+    uint32_t);
+typedef	void	(*mac_rx_gro_set_t)(void *, boolean_t);
 
 typedef	struct mac_intr_s {
 	mac_intr_handle_t	mi_handle;
@@ -429,6 +432,16 @@ typedef struct mac_rx_fifo_s {
 	 * and get a squeue assigned on that CPU.
 	 */
 	uint_t			mrf_cpu_id;
+	/*
+	 * Moves the IPv4 TCP flow given by its addresses and ports from
+	 * mrf_rx_arg to another fifo of the same client.
+	 */
+	mac_rx_steer_t		mrf_steer;
+	/*
+	 * Lets the fifo merge the TCP segments it receives, or stops it.
+	 * Off until the client turns it on.
+	 */
+	mac_rx_gro_set_t	mrf_gro;
 } mac_rx_fifo_t;
 
 #define	mrf_intr_handle		mrf_intr.mi_handle
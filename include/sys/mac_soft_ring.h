@@ -46,7 +46,11 @@ extern "C" {
 
 #define	MAX_SR_FANOUT	24
 
+/* Default slots in the TCP flow steering table of an Rx SRS */
+#define	MAC_SRS_STEER_SIZE	4096
+
 extern boolean_t mac_soft_ring_enable;
+extern uint_t mac_srs_steer_size;
 extern boolean_t mac_latency_optimize;
 
 typedef struct mac_soft_ring_s mac_soft_ring_t;
@@ -110,6 +114,9 @@ struct mac_soft_ring_s {
 	uint32_t	s_ring_total_inpkt;
 	uint32_t	s_ring_total_rbytes;
 	uint32_t	s_ring_drops;
+	boolean_t	s_ring_gro;		/* client allows GRO */
+	uint64_t	s_ring_gro_merged;	/* segments merged by GRO */
+	uint64_t	s_ring_gro_flushes;	/* merged segments passed up */
 	struct mac_client_impl_s *s_ring_mcip;
 	kstat_t		*s_ring_ksp;
 
@@ -324,6 +331,8 @@ struct mac_soft_ring_set_s {
 	int		srs_soft_ring_condemned_count;
 	mac_soft_ring_t	**srs_tcp_soft_rings;
 	int		srs_tcp_ring_count;
+	uint8_t		*srs_tcp_steer;	/* see mac_soft_ring_steer() */
+	uint_t		srs_tcp_steer_size;
 	mac_soft_ring_t	**srs_udp_soft_rings;
 	int		srs_udp_ring_count;
 	mac_soft_ring_t	**srs_oth_soft_rings;
@@ -693,6 +702,9 @@ extern void mac_client_update_classifier(mac_client_impl_t *, boolean_t);
 
 extern void mac_soft_ring_intr_enable(void *);
 extern boolean_t mac_soft_ring_intr_disable(void *);
+extern boolean_t mac_soft_ring_steer(void *, void *, uint32_t, uint32_t,
+    uint32_t);
+extern void mac_soft_ring_gro(void *, boolean_t);
 extern mac_soft_ring_t *mac_soft_ring_create(int, clock_t, uint16_t,
     pri_t, mac_client_impl_t *, mac_soft_ring_set_t *,
     processorid_t, mac_direct_rx_t, void *, mac_resource_handle_t);
@@ -702,6 +714,7 @@ extern void mac_soft_ring_free(mac_soft_ring_t *);
 extern void mac_soft_ring_signal(mac_soft_ring_t *, uint_t);
 extern void mac_rx_soft_ring_process(mac_client_impl_t *, mac_soft_ring_t *,
     mblk_t *, mblk_t *, int, size_t);
+extern mblk_t *mac_rx_gro(mac_soft_ring_t *, mblk_t *);
 extern mac_tx_cookie_t mac_tx_soft_ring_process(mac_soft_ring_t *,
     mblk_t *, uint16_t, mblk_t **);
 extern void mac_srs_worker_quiesce(mac_soft_ring_set_t *);
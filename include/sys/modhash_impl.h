@@ -40,11 +40,14 @@ extern "C" {
 
 #include <sys/ksynch.h>
 #include <sys/modhash.h>
+#include <sys/epoch.h>
 
 struct mod_hash_entry {
 	mod_hash_key_t mhe_key;			/* stored hash key	*/
 	mod_hash_val_t mhe_val;			/* stored hash value	*/
 	struct mod_hash_entry *mhe_next;	/* next item in chain	*/
+	void (*mhe_kdtor)(mod_hash_key_t);	/* key dtor, once removed */
+	epoch_cb_t mhe_epoch;			/* deferred free	*/
 };
 
 struct mod_hash_stat {
@@ -45,6 +45,7 @@ extern "C" {
 #define	PORT_SOURCE_ALERT	5
 #define	PORT_SOURCE_MQ		6
 #define	PORT_SOURCE_FILE	7
+#define	PORT_SOURCE_AIORING	8
 
 typedef struct port_event {
 	int		portev_events;	/* event data is source specific */
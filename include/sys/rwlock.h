@@ -44,7 +44,8 @@ extern "C" {
 
 typedef enum {
 	RW_DRIVER = 2,		/* driver (DDI) rwlock */
-	RW_DEFAULT = 4		/* kernel default rwlock */
+	RW_DEFAULT = 4,		/* kernel default rwlock */
+	RW_PERCPU = 8		/* read-mostly rwlock, per-CPU reader counts */
 } krw_type_t;
 
 typedef enum {
@@ -36,6 +36,8 @@
 #ifndef _ASM
 
 #include <sys/rwlock.h>
+#include <sys/mutex.h>
+#include <sys/condvar.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -45,6 +47,28 @@ typedef struct rwlock_impl {
 	uintptr_t	rw_wwwh;	/* waiters, write wanted, hold count */
 } rwlock_impl_t;
 
+/*
+ * State of an RW_PERCPU rwlock.  The lock word points to it (see
+ * RW_PERCPU_TAG below); readers only touch their CPU's rwp_cpu[] entry.
+ * Threads blocked on the lock wait on rwp_cv and rwp_drain_cv rather than a
+ * turnstile, so there is no priority inheritance: a low-priority writer
+ * is not boosted by the higher-priority threads waiting for it.
+ */
+typedef struct rwlock_percpu_cpu {
+	volatile ulong_t rpc_readers;		/* enters - exits on this CPU */
+	char		rpc_pad[64 - sizeof (ulong_t)];
+} rwlock_percpu_cpu_t;
+
+typedef struct rwlock_percpu {
+	kmutex_t	rwp_lock;		/* protects writer state */
+	kcondvar_t	rwp_cv;			/* writer gone */
+	kcondvar_t	rwp_drain_cv;		/* readers gone */
+	volatile uint_t	rwp_writer;		/* lock claimed by a writer */
+	struct _kthread	*volatile rwp_owner;	/* writer, once drained */
+	size_t		rwp_size;		/* size of allocation */
+	rwlock_percpu_cpu_t *rwp_cpu;		/* [max_ncpus], cache-aligned */
+} rwlock_percpu_t;
+
 #endif	/* _ASM */
 
 #define	RW_HAS_WAITERS		1
@@ -60,6 +84,18 @@ typedef struct rwlock_impl {
 #define	RW_WRITE_CLAIMED	(RW_WRITE_LOCKED | RW_WRITE_WANTED)
 #define	RW_DOUBLE_LOCK		(RW_WRITE_LOCK(0) | RW_READ_LOCK)
 
+/*
+ * The lock word of an RW_PERCPU rwlock holds a pointer to its rwlock_percpu_t
+ * tagged with RW_WRITE_LOCKED | RW_WRITE_WANTED, but never RW_HAS_WAITERS: an
+ * ordinary rwlock only has RW_WRITE_WANTED set along with RW_HAS_WAITERS.
+ * The tag sends every rw_enter() and rw_exit() to rw_enter_sleep() and
+ * rw_exit_wakeup(), which hand RW_PERCPU locks off to their own code.
+ */
+#define	RW_PERCPU_TAG		(RW_WRITE_LOCKED | RW_WRITE_WANTED)
+#define	RW_ISPERCPU(lp)							\
+	(((lp)->rw_wwwh & (RW_PERCPU_TAG | RW_HAS_WAITERS)) == RW_PERCPU_TAG)
+#define	RW_PERCPU_STATE(lp)	((rwlock_percpu_t *)((lp)->rw_wwwh & RW_OWNER))
+
 /*
  * These macros are used by both the implementation of rw_*() routines and
  * by the implementation of the rwlock-related DTrace subroutines.  (DTrace
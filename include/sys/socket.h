@@ -148,6 +148,9 @@ struct so_snd_bufinfo {
 #define	SO_ALLZONES	0x1014		/* bind in all zones */
 #define	SO_EXCLBIND	0x1015		/* exclusive binding */
 #define	SO_VRRP		0x1017		/* VRRP control socket */
+#define	SO_MAX_PACING_RATE 0x1018	/* TCP pacing rate limit */
+#define	SO_REUSEPORT	0x1019		/* balance a port across sockets */
+#define	SO_INCOMING_CPU	0x101a		/* CPU to prefer in SO_REUSEPORT */
 
 #ifdef	_KERNEL
 #define	SO_SRCADDR	0x2001		/* Internal: AF_UNIX source address */
@@ -330,6 +333,23 @@ struct msghdr32 {
 #endif	/* _SYSCALL32 */
 #endif	/* _KERNEL */
 
+/*
+ * Message header for recvmmsg and sendmmsg calls.
+ */
+struct mmsghdr {
+	struct msghdr	msg_hdr;		/* message header */
+	unsigned int	msg_len;		/* bytes transferred */
+};
+
+#if	defined(_KERNEL) && defined(_SYSCALL32)
+
+struct mmsghdr32 {
+	struct msghdr32	msg_hdr;	/* message header */
+	uint32_t	msg_len;	/* bytes transferred */
+};
+
+#endif	/* _KERNEL && _SYSCALL32 */
+
 #define	MSG_OOB		0x1		/* process out-of-band data */
 #define	MSG_PEEK	0x2		/* peek at incoming message */
 #define	MSG_DONTROUTE	0x4		/* send without using routing tables */
@@ -342,6 +362,8 @@ struct msghdr32 {
 #define	MSG_NOSIGNAL	0x200		/* Don't generate SIGPIPE */
 #define	MSG_DUPCTRL	0x800		/* Save control message for use with */
 					/* with left over data */
+#define	MSG_WAITFORONE	0x1000		/* recvmmsg: block for the first only */
+#define	MSG_FASTOPEN	0x2000		/* Connect, data in SYN (TCP only) */
 
 /* Obsolete but kept for compilation compatability. Use IOV_MAX. */
 #define	MSG_MAXIOVLEN	16
@@ -410,6 +432,7 @@ struct cmsghdr {
 	((unsigned int)_CMSG_DATA_ALIGN(sizeof (struct cmsghdr)) + (l))
 
 #if !defined(_KERNEL) || defined(_BOOT)
+struct timespec;
 extern int accept(int, struct sockaddr *_RESTRICT_KYWD, socklen_t *);
 extern int accept4(int, struct sockaddr *_RESTRICT_KYWD, socklen_t *, int);
 extern int bind(int, const struct sockaddr *, socklen_t);
@@ -422,8 +445,11 @@ extern int socketpair(int, int, int, int *);
 extern ssize_t recv(int, void *, size_t, int);
 extern ssize_t recvfrom(int, void *_RESTRICT_KYWD, size_t, int,
 	struct sockaddr *_RESTRICT_KYWD, socklen_t *);
+extern int recvmmsg(int, struct mmsghdr *, unsigned int, int,
+	struct timespec *);
 extern ssize_t recvmsg(int, struct msghdr *, int);
 extern ssize_t send(int, const void *, size_t, int);
+extern int sendmmsg(int, struct mmsghdr *, unsigned int, int);
 extern ssize_t sendmsg(int, const struct msghdr *, int);
 extern ssize_t sendto(int, const void *, size_t, int, const struct sockaddr *,
 	socklen_t);
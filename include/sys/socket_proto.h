@@ -32,6 +32,7 @@ extern "C" {
 #include <sys/socket.h>
 #include <sys/cred.h>
 #include <sys/stream.h>
+#include <sys/processor.h>
 
 /*
  * Generation count
@@ -124,6 +125,7 @@ struct sock_downcalls_s {
 	int	(*sd_ioctl)(sock_lower_handle_t, int, intptr_t, int,
 		    int32_t *, cred_t *);
 	int	(*sd_close)(sock_lower_handle_t, int, cred_t *);
+	void	(*sd_rcv_cpu)(sock_lower_handle_t, processorid_t);
 };
 
 typedef sock_lower_handle_t (*so_proto_create_func_t)(int, int, int,
@@ -215,6 +215,7 @@ struct sonode {
 	kcondvar_t	so_rcv_cv;	/* wait for data */
 	uint_t		so_rcv_wanted;	/* # of bytes wanted by app */
 	timeout_id_t	so_rcv_timer_tid;
+	processorid_t	so_rcv_cpu;	/* CPU last read on, for sd_rcv_cpu */
 
 #define	so_rcv_thresh	so_proto_props.sopp_rcvthresh
 #define	so_rcv_timer_interval so_proto_props.sopp_rcvtimer
@@ -607,6 +608,7 @@ struct sendfile_stats {
 	uint32_t ss_full_waits;
 	uint32_t ss_empty_waits;
 	uint32_t ss_file_segmap;
+	uint32_t ss_file_loaned;
 };
 
 /*
@@ -41,6 +41,7 @@ extern "C" {
 #endif
 
 typedef struct taskq_bucket taskq_bucket_t;
+typedef struct taskq_cpu taskq_cpu_t;
 
 typedef struct taskq_ent {
 	struct taskq_ent	*tqent_next;
@@ -53,6 +54,7 @@ typedef struct taskq_ent {
 	}			tqent_un;
 	kthread_t		*tqent_thread;
 	kcondvar_t		tqent_cv;
+	hrtime_t		tqent_time;	/* enqueue time (PERCPU) */
 } taskq_ent_t;
 
 #define	TQENT_FLAG_PREALLOC	0x1
@@ -91,6 +93,49 @@ struct taskq_bucket {
 #define	TQBUCKET_CLOSE		0x01
 #define	TQBUCKET_SUSPEND	0x02
 
+/*
+ * Per-CPU queue of a TASKQ_PERCPU task queue.  Each queue has its own list of
+ * pending tasks, entry cache and set of worker threads.  Idle workers steal
+ * pending tasks from sibling queues in the same lgroup.
+ *
+ * tqc_active counts the tasks dispatched to this queue which have not yet
+ * completed, no matter which queue's worker runs them.  The statistics are
+ * charged to the queue a task was dispatched to.
+ */
+struct taskq_cpu {
+	kmutex_t	tqc_lock;
+	kcondvar_t	tqc_dispatch_cv;	/* idle workers wait here */
+	kcondvar_t	tqc_wait_cv;		/* taskq_wait(), exit */
+	taskq_t		*tqc_taskq;		/* Enclosing taskq */
+	taskq_ent_t	tqc_task;		/* pending tasks */
+	taskq_ent_t	*tqc_freelist;		/* cached entries */
+	int		tqc_nfree;		/* # of cached entries */
+	int		tqc_maxfree;		/* max # of cached entries */
+	int		tqc_active;		/* # of uncompleted tasks */
+	int		tqc_nidle;		/* # of idle workers */
+	int		tqc_nthreads;		/* # of workers */
+	uint_t		tqc_flags;
+	int		tqc_id;			/* index in tq_cpus */
+	int		tqc_lgrpid;		/* lgroup, or LGRP_NONE */
+
+	/*
+	 * Statistics.
+	 */
+	uint64_t	tqc_tasks;		/* # of tasks dispatched */
+	uint64_t	tqc_executed;		/* # of tasks executed */
+	uint64_t	tqc_local;		/* ... by our own workers */
+	uint64_t	tqc_steals;		/* ... by sibling workers */
+	uint64_t	tqc_nomem;		/* # of failed allocations */
+	hrtime_t	tqc_totaltime;		/* time spent in tasks */
+	hrtime_t	tqc_queuetime;		/* time spent in queue */
+	hrtime_t	tqc_maxqueuetime;	/* max time spent in queue */
+};
+
+/*
+ * Per-CPU queue flags.
+ */
+#define	TQCPU_CLOSE		0x01
+
 #define	TASKQ_INTERFACE_FLAGS	0x0000ffff	/* defined in <sys/taskq.h> */
 
 /*
@@ -127,6 +172,8 @@ struct taskq {
 	taskq_bucket_t	*tq_buckets;	/* Per-cpu array of buckets */
 	int		tq_instance;
 	uint_t		tq_nbuckets;	/* # of buckets	(2^n)	    */
+	taskq_cpu_t	**tq_cpus;	/* Per-cpu queues (TASKQ_PERCPU) */
+	uint_t		tq_ncpuqs;	/* # of per-cpu queues */
 	union {
 		kthread_t *_tq_thread;
 		kthread_t **_tq_threadlist;
@@ -144,6 +144,7 @@ extern int vmem_contains(vmem_t *, void *, size_t);
 extern void vmem_walk(vmem_t *, int, void (*)(void *, void *, size_t), void *);
 extern size_t vmem_size(vmem_t *, int);
 extern void vmem_qcache_reap(vmem_t *vmp);
+extern void vmem_reap(void);
 
 #ifdef	__cplusplus
 }
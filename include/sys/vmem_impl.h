@@ -110,6 +110,18 @@ typedef struct vmem_kstat {
 	kstat_named_t	vk_contains_search;	/* vmem_contains() search cnt */
 } vmem_kstat_t;
 
+/*
+ * Per-CPU magazine of free quantum-sized segments; see vmem_pcpu_alloc().
+ * On LP64 each one fills a cache line.
+ */
+#define	VMEM_PCPU_ROUNDS	6
+
+typedef struct vmem_pcpu {
+	kmutex_t	vp_lock;		/* protects this magazine */
+	int		vp_rounds;		/* # of segments in vp_round */
+	void		*vp_round[VMEM_PCPU_ROUNDS];	/* the segments */
+} vmem_pcpu_t;
+
 struct vmem {
 	char		vm_name[VMEM_NAMELEN];	/* arena name */
 	kcondvar_t	vm_cv;		/* cv for blocking allocations */
@@ -136,6 +148,8 @@ struct vmem {
 	vmem_seg_t	vm_rotor;	/* rotor for VM_NEXTFIT allocations */
 	vmem_seg_t	*vm_hash0[VMEM_HASH_INITIAL];	/* initial hash table */
 	void		*vm_qcache[VMEM_NQCACHE_MAX];	/* quantum caches */
+	vmem_pcpu_t	*vm_pcpu;	/* per-CPU magazines, or NULL */
+	uint64_t	vm_pcpu_alloc;	/* vk_alloc at last vmem_update() */
 	vmem_freelist_t	vm_freelist[VMEM_FREELISTS + 1]; /* power-of-2 flists */
 	vmem_kstat_t	vm_kstat;	/* kstat data */
 };
@@ -124,6 +124,7 @@ typedef struct vopstats {
 	kstat_named_t	nvnevent;	/* fop_vnevent */
 	kstat_named_t	nreqzcbuf;	/* fop_reqzcbuf */
 	kstat_named_t	nretzcbuf;	/* fop_retzcbuf */
+	kstat_named_t	naio;		/* fop_aio */
 } vopstats_t;
 
 /*
@@ -881,6 +882,7 @@ struct page;
 struct seg;
 struct as;
 struct pollhead;
+struct aio_req;
 struct taskq;
 
 #ifdef	_KERNEL
@@ -979,6 +981,8 @@ typedef struct vnodeops {
 			    cred_t *, caller_context_t *);
 	int (*vop_retzcbuf)(struct vnode *, xuio_t *, cred_t *,
 			    caller_context_t *);
+	int (*vop_aio)(struct vnode *, struct aio_req *, int, cred_t *,
+		       caller_context_t *);
 } vnodeops_t;
 
 typedef int (*fs_generic_func_p) ();	/* Generic vop/vfsop/femop/fsemop ptr */
@@ -1068,6 +1072,8 @@ extern int	fop_vnevent(vnode_t *, vnevent_t, vnode_t *, char *,
 extern int	fop_reqzcbuf(vnode_t *, enum uio_rw, xuio_t *, cred_t *,
 				caller_context_t *);
 extern int	fop_retzcbuf(vnode_t *, xuio_t *, cred_t *, caller_context_t *);
+extern int	fop_aio(vnode_t *, struct aio_req *, int, cred_t *,
+				caller_context_t *);
 
 #endif	/* _KERNEL */
 
@@ -1117,6 +1123,7 @@ extern int	fop_retzcbuf(vnode_t *, xuio_t *, cred_t *, caller_context_t *);
 #define	VOPNAME_VNEVENT		"vnevent"
 #define	VOPNAME_REQZCBUF	"reqzcbuf"
 #define	VOPNAME_RETZCBUF	"retzcbuf"
+#define	VOPNAME_AIO		"aio"
 
 /*
  * Flags for fop_lookup
@@ -381,6 +381,10 @@ FOP_DISPATCH(fop_retzcbuf_dispatch, vop_retzcbuf, vhead_retzcbuf,
     (struct vnode *vnode, xuio_t *uio, cred_t *cr, caller_context_t *ct,
      bool check_fem),
     (vnode, uio, cr, ct))
+FOP_DISPATCH(fop_aio_dispatch, vop_aio, vhead_aio,
+    (struct vnode *vnode, struct aio_req *aio, int rw, cred_t *cr,
+     caller_context_t *ct, bool check_fem),
+    (vnode, aio, rw, cr, ct))
 
 #undef FOP_DISPATCH
 
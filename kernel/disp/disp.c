@@ -904,6 +904,7 @@ swtch()
 			restore_mstate(next);
 
 			CPU_STATS_ADDQ(cp, sys, pswitch, 1);
+			cp->cpu_epoch_qs++;
 			cp->cpu_last_swtch = t->t_disp_time = ddi_get_lbolt();
 			TRACE_0(TR_FAC_DISP, TR_RESUME_START, "resume_start");
 
@@ -966,6 +967,7 @@ swtch_from_zombie()
 	next = disp();			/* returns with spl high */
 	ASSERT(CPU_ON_INTR(CPU) == 0);	/* not called with PIL > 10 */
 	CPU_STATS_ADDQ(CPU, sys, pswitch, 1);
+	cpu->cpu_epoch_qs++;
 	ASSERT(next != curthread);
 	TRACE_0(TR_FAC_DISP, TR_RESUME_START, "resume_start");
 
@@ -1071,6 +1073,7 @@ swtch_to(kthread_t *next)
 	 * Update context switch statistics.
 	 */
 	CPU_STATS_ADDQ(cp, sys, pswitch, 1);
+	cp->cpu_epoch_qs++;
 
 	TRACE_0(TR_FAC_DISP, TR_RESUME_START, "resume_start");
 
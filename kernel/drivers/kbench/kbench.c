@@ -0,0 +1,306 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Kernel micro-benchmark driver.
+ *
+ * This pseudo driver is only shipped with the os-tests.  It runs one of the
+ * in-kernel benchmarks listed in kbench.h each time the kbench command asks
+ * for it with KBENCH_IOC_RUN, and hands the results back as name/value
+ * pairs.  Only one benchmark runs at a time, so that they don't skew each
+ * other.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/modctl.h>
+#include <sys/conf.h>
+#include <sys/ddi.h>
+#include <sys/sunddi.h>
+#include <sys/devops.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/cred.h>
+#include <sys/errno.h>
+#include <sys/kmem.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+
+#include "kbench.h"
+
+static dev_info_t *kbench_dip;
+static kmutex_t kbench_lock;	/* held while a benchmark runs */
+
+static void (*kbench_funcs[KBENCH_NBENCH])(kbench_run_t *) = {
+	kbench_taskq,
+	kbench_rwlock,
+	kbench_epoch,
+	kbench_flock,
+	kbench_vmem
+};
+
+/*
+ * Add a result to 'kb'; results past KBENCH_MAXRES are dropped.
+ */
+void
+kbench_result(kbench_run_t *kb, const char *name, uint64_t value)
+{
+	kbench_res_t *kr;
+
+	if (kb->kb_nres >= KBENCH_MAXRES)
+		return;
+	kr = &kb->kb_res[kb->kb_nres++];
+	(void) strlcpy(kr->kr_name, name, sizeof (kr->kr_name));
+	kr->kr_value = value;
+}
+
+/*
+ * Collect the online CPUs, and return them and their number in 'ncpusp'.
+ */
+processorid_t *
+kbench_cpus(int *ncpusp)
+{
+	processorid_t *cpus;
+	cpu_t *cp;
+	int ncpus = 0;
+
+	cpus = kmem_alloc(sizeof (processorid_t) * max_ncpus, KM_SLEEP);
+	mutex_enter(&cpu_lock);
+	cp = cpu_active;
+	do {
+		if (ncpus < max_ncpus)
+			cpus[ncpus++] = cp->cpu_id;
+	} while ((cp = cp->cpu_next_onln) != cpu_active);
+	mutex_exit(&cpu_lock);
+
+	*ncpusp = ncpus;
+	return (cpus);
+}
+
+void
+kbench_cpus_free(processorid_t *cpus)
+{
+	kmem_free(cpus, sizeof (processorid_t) * max_ncpus);
+}
+
+/*
+ * Fill 'steps' with the numbers of CPUs a benchmark is run on, 1, 2, 4, ...
+ * up to 'ncpus', and return how many there are.
+ */
+int
+kbench_steps(int ncpus, int *steps)
+{
+	int nsteps = 0;
+	int n;
+
+	for (n = 1; n < ncpus && nsteps < KBENCH_MAXSTEPS - 1; n <<= 1)
+		steps[nsteps++] = n;
+	steps[nsteps++] = ncpus;
+	return (nsteps);
+}
+
+/*
+ * Start a thread running func(arg), bound to CPU 'cpuid' before it starts
+ * running.  The caller holds cpu_lock, which keeps the CPUs from going away
+ * until they are bound; one which went offline since the caller looked is
+ * replaced by the current CPU.  The thread must clear its affinity before
+ * it exits.
+ */
+void
+kbench_thread_bind(void (*func)(void *), void *arg, processorid_t cpuid,
+    pri_t pri)
+{
+	kthread_t *t;
+	cpu_t *cp;
+
+	ASSERT(MUTEX_HELD(&cpu_lock));
+
+	t = thread_create(NULL, 0, func, arg, 0, &p0, TS_STOPPED, pri);
+	if ((cp = cpu_get(cpuid)) == NULL || !cpu_is_online(cp))
+		cp = CPU;
+	thread_affinity_set(t, cp->cpu_id);
+	thread_lock(t);
+	t->t_schedflag |= TS_ALLSTART;
+	setrun_locked(t);
+	thread_unlock(t);
+}
+
+/*ARGSUSED*/
+static int
+kbench_open(dev_t *devp, int flag, int otyp, cred_t *credp)
+{
+	if (otyp != OTYP_CHR)
+		return (EINVAL);
+	return (drv_priv(credp));
+}
+
+/*ARGSUSED*/
+static int
+kbench_close(dev_t dev, int flag, int otyp, cred_t *credp)
+{
+	return (0);
+}
+
+/*ARGSUSED*/
+static int
+kbench_ioctl(dev_t dev, int cmd, intptr_t arg, int mode, cred_t *credp,
+    int *rvalp)
+{
+	kbench_run_t *kb;
+	int error = 0;
+
+	if (cmd != KBENCH_IOC_RUN)
+		return (ENOTTY);
+
+	kb = kmem_zalloc(sizeof (kbench_run_t), KM_SLEEP);
+	if (ddi_copyin((void *)arg, kb, sizeof (kbench_run_t), mode) != 0) {
+		error = EFAULT;
+		goto out;
+	}
+	if (kb->kb_bench >= KBENCH_NBENCH) {
+		error = EINVAL;
+		goto out;
+	}
+	if (!mutex_tryenter(&kbench_lock)) {
+		error = EBUSY;
+		goto out;
+	}
+
+	kb->kb_nres = 0;
+	kbench_funcs[kb->kb_bench](kb);
+	mutex_exit(&kbench_lock);
+
+	if (ddi_copyout(kb, (void *)arg, sizeof (kbench_run_t), mode) != 0)
+		error = EFAULT;
+out:
+	kmem_free(kb, sizeof (kbench_run_t));
+	return (error);
+}
+
+/*ARGSUSED*/
+static int
+kbench_getinfo(dev_info_t *dip, ddi_info_cmd_t infocmd, void *arg,
+    void **result)
+{
+	switch (infocmd) {
+	case DDI_INFO_DEVT2DEVINFO:
+		*result = kbench_dip;
+		return (DDI_SUCCESS);
+	case DDI_INFO_DEVT2INSTANCE:
+		*result = (void *)0;
+		return (DDI_SUCCESS);
+	default:
+		return (DDI_FAILURE);
+	}
+}
+
+static int
+kbench_attach(dev_info_t *dip, ddi_attach_cmd_t cmd)
+{
+	if (cmd != DDI_ATTACH)
+		return (DDI_FAILURE);
+
+	if (ddi_create_minor_node(dip, ddi_get_name(dip), S_IFCHR,
+	    ddi_get_instance(dip), DDI_PSEUDO, 0) != DDI_SUCCESS)
+		return (DDI_FAILURE);
+
+	kbench_dip = dip;
+	return (DDI_SUCCESS);
+}
+
+static int
+kbench_detach(dev_info_t *dip, ddi_detach_cmd_t cmd)
+{
+	if (cmd != DDI_DETACH)
+		return (DDI_FAILURE);
+
+	ddi_remove_minor_node(dip, NULL);
+	kbench_dip = NULL;
+	return (DDI_SUCCESS);
+}
+
+static struct cb_ops kbench_cb_ops = {
+	kbench_open,	/* open */
+	kbench_close,	/* close */
+	nodev,		/* strategy */
+	nodev,		/* print */
+	nodev,		/* dump */
+	nodev,		/* read */
+	nodev,		/* write */
+	kbench_ioctl,	/* ioctl */
+	nodev,		/* devmap */
+	nodev,		/* mmap */
+	nodev,		/* segmap */
+	nochpoll,	/* chpoll */
+	ddi_prop_op,	/* prop_op */
+	NULL,		/* cb_str */
+	D_NEW | D_MP,
+	CB_REV,
+	NULL,
+	NULL
+};
+
+static struct dev_ops kbench_ops = {
+	DEVO_REV,
+	0,
+	kbench_getinfo,
+	nulldev,
+	nulldev,
+	kbench_attach,
+	kbench_detach,
+	nodev,
+	&kbench_cb_ops,
+	NULL,
+	NULL,
+	ddi_quiesce_not_needed,		/* quiesce */
+};
+
+static struct modldrv modldrv = {
+	&mod_driverops,
+	"kernel micro-benchmarks",
+	&kbench_ops
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1,
+	&modldrv,
+	NULL
+};
+
+int
+_init(void)
+{
+	int error;
+
+	mutex_init(&kbench_lock, NULL, MUTEX_DEFAULT, NULL);
+	if ((error = mod_install(&modlinkage)) != 0)
+		mutex_destroy(&kbench_lock);
+	return (error);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
+
+int
+_fini(void)
+{
+	int error;
+
+	if ((error = mod_remove(&modlinkage)) == 0)
+		mutex_destroy(&kbench_lock);
+	return (error);
+}
@@ -0,0 +1,84 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+#ifndef _KBENCH_H
+#define	_KBENCH_H
+
+/*
+ * Interface between the kbench test driver and the os-tests kbench command.
+ */
+
+#include <sys/types.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	KBENCH_IOC	(('k' << 24) | ('b' << 16) | ('n' << 8))
+#define	KBENCH_IOC_RUN	(KBENCH_IOC | 1)	/* run kb_bench */
+
+/*
+ * Benchmarks, in the order the kbench command runs them by default.
+ */
+typedef enum {
+	KBENCH_TASKQ,
+	KBENCH_RWLOCK,
+	KBENCH_EPOCH,
+	KBENCH_FLOCK,
+	KBENCH_VMEM,
+	KBENCH_NBENCH
+} kbench_t;
+
+#define	KBENCH_MAXRES	128
+#define	KBENCH_NAMELEN	32
+
+typedef struct kbench_res {
+	char		kr_name[KBENCH_NAMELEN];
+	uint64_t	kr_value;
+} kbench_res_t;
+
+/*
+ * Argument of KBENCH_IOC_RUN; its layout is the same for ILP32 and LP64
+ * callers.  kb_nres and kb_res are filled in by the driver.
+ */
+typedef struct kbench_run {
+	uint32_t	kb_bench;
+	uint32_t	kb_nres;
+	kbench_res_t	kb_res[KBENCH_MAXRES];
+} kbench_run_t;
+
+#ifdef	_KERNEL
+
+#include <sys/thread.h>
+#include <sys/processor.h>
+
+#define	KBENCH_MAXSTEPS	32	/* # of CPU steps, enough for any NCPU */
+
+extern void kbench_result(kbench_run_t *, const char *, uint64_t);
+extern processorid_t *kbench_cpus(int *);
+extern void kbench_cpus_free(processorid_t *);
+extern int kbench_steps(int, int *);
+extern void kbench_thread_bind(void (*)(void *), void *, processorid_t,
+    pri_t);
+
+extern void kbench_taskq(kbench_run_t *);
+extern void kbench_rwlock(kbench_run_t *);
+extern void kbench_epoch(kbench_run_t *);
+extern void kbench_flock(kbench_run_t *);
+extern void kbench_vmem(kbench_run_t *);
+
+#endif	/* _KERNEL */
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _KBENCH_H */
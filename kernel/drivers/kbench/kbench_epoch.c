@@ -0,0 +1,276 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Epoch reclamation torture test.
+ *
+ * This runs, for epoch_torture_secs seconds:
+ *
+ *   - a reader thread bound to each online CPU, which enters an epoch
+ *     section, picks up the current object, checks it a number of times
+ *     while spinning for up to epoch_torture_hold_us, and leaves -- over
+ *     and over for epoch_torture_batch_us, then sleeps for a tick so that
+ *     the rest of the system gets to run;
+ *
+ *   - epoch_torture_nwriters writer threads, which replace the current
+ *     object with a new one and hand the old one to call_epoch() -- or,
+ *     once every epoch_torture_syncratio replacements, wait for a grace
+ *     period with epoch_synchronize() and free it themselves.
+ *
+ * An object is poisoned when it is freed, and kept in a quarantine of the
+ * last ET_QUARANTINE freed objects before its memory is returned, so that a
+ * reader still using it sees the poison rather than a reallocated object.
+ * A reader that sees a poisoned object counts an error (and panics if
+ * epoch_torture_panic is set).  When the run is over, every object handed
+ * to call_epoch() must have been freed.  "errors" must be zero:
+ *
+ *	# /opt/os-tests/tests/kbench/kbench epoch
+ *
+ * The unix:0:epoch kstat shows how many grace periods were needed, and how
+ * many CPUs had to be forced to switch.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/epoch.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/atomic.h>
+#include <sys/sysmacros.h>
+#include <sys/stddef.h>
+#include <sys/ddi.h>
+#include <sys/cmn_err.h>
+
+#include "kbench.h"
+
+int epoch_torture_secs = 10;
+int epoch_torture_nwriters = 2;
+uint_t epoch_torture_syncratio = 1000;
+uint_t epoch_torture_hold_us = 20;
+uint_t epoch_torture_batch_us = 5000;
+int epoch_torture_panic = 0;
+
+#define	ET_QUARANTINE	4096	/* freed objects kept poisoned */
+
+#define	ET_ALIVE	0x11ab1eaa11ab1eaaULL
+#define	ET_DEAD		0xdeadbeefdeadbeefULL
+
+typedef struct et_obj {
+	volatile uint64_t eo_magic;
+	uint64_t	eo_gen;
+	epoch_cb_t	eo_epoch;
+} et_obj_t;
+
+/*
+ * State of the current run; kbench runs one benchmark at a time.
+ */
+static struct et_state {
+	kmutex_t	et_lock;
+	kcondvar_t	et_cv;
+	et_obj_t	*volatile et_cur;	/* the current object */
+	volatile boolean_t et_stop;
+	int		et_nthreads;		/* # of threads still running */
+	et_obj_t	*et_quarantine[ET_QUARANTINE];
+	uint_t		et_qnext;
+	uint64_t	et_gen;
+	uint64_t	et_reads;
+	uint64_t	et_updates;
+	uint64_t	et_deferred;
+	uint64_t	et_callbacks;
+	uint64_t	et_synchronized;
+	uint64_t	et_errors;
+} et;
+
+static void
+et_error(et_obj_t *eo)
+{
+	atomic_inc_64(&et.et_errors);
+	if (epoch_torture_panic) {
+		panic("epoch_torture: object %p used after free (magic %llx)",
+		    (void *)eo, (u_longlong_t)eo->eo_magic);
+	}
+}
+
+static et_obj_t *
+et_obj_alloc(void)
+{
+	et_obj_t *eo = kmem_zalloc(sizeof (et_obj_t), KM_SLEEP);
+
+	eo->eo_magic = ET_ALIVE;
+	eo->eo_gen = atomic_inc_64_nv(&et.et_gen);
+	return (eo);
+}
+
+/*
+ * Poison 'eo', and free the object it pushes out of the quarantine.
+ */
+static void
+et_obj_free(et_obj_t *eo)
+{
+	et_obj_t *old;
+
+	if (eo->eo_magic != ET_ALIVE)
+		et_error(eo);
+	eo->eo_magic = ET_DEAD;
+
+	mutex_enter(&et.et_lock);
+	old = et.et_quarantine[et.et_qnext];
+	et.et_quarantine[et.et_qnext] = eo;
+	et.et_qnext = (et.et_qnext + 1) % ET_QUARANTINE;
+	mutex_exit(&et.et_lock);
+
+	if (old != NULL)
+		kmem_free(old, sizeof (et_obj_t));
+}
+
+static void
+et_obj_cb(epoch_cb_t *ec)
+{
+	et_obj_free((et_obj_t *)((uintptr_t)ec - offsetof(et_obj_t, eo_epoch)));
+	atomic_inc_64(&et.et_callbacks);
+}
+
+static void
+et_thread_exit(void)
+{
+	mutex_enter(&et.et_lock);
+	if (--et.et_nthreads == 0)
+		cv_broadcast(&et.et_cv);
+	mutex_exit(&et.et_lock);
+	thread_exit();
+}
+
+static void
+et_reader(void *arg)
+{
+	uint64_t reads = 0;
+	uint_t spins = 0;
+	hrtime_t until, batch = 0;
+	et_obj_t *eo;
+
+	while (!et.et_stop) {
+		if (gethrtime() > batch) {
+			delay(1);
+			batch = gethrtime() +
+			    epoch_torture_batch_us * (NANOSEC / MICROSEC);
+		}
+		epoch_enter();
+		eo = et.et_cur;
+		until = gethrtime() + (spins++ % (epoch_torture_hold_us + 1)) *
+		    (NANOSEC / MICROSEC);
+		do {
+			if (eo->eo_magic != ET_ALIVE)
+				et_error(eo);
+		} while (gethrtime() < until);
+		if (eo->eo_magic != ET_ALIVE)
+			et_error(eo);
+		epoch_exit();
+		reads++;
+	}
+
+	atomic_add_64(&et.et_reads, reads);
+	thread_affinity_clear(curthread);
+	et_thread_exit();
+}
+
+static void
+et_writer(void *arg)
+{
+	uint64_t i;
+	et_obj_t *eo;
+
+	for (i = 1; !et.et_stop; i++) {
+		eo = et_obj_alloc();
+		membar_producer();
+		eo = atomic_swap_ptr((void *)&et.et_cur, eo);
+
+		if (epoch_torture_syncratio != 0 &&
+		    i % epoch_torture_syncratio == 0) {
+			epoch_synchronize();
+			et_obj_free(eo);
+			atomic_inc_64(&et.et_synchronized);
+		} else {
+			call_epoch(&eo->eo_epoch, et_obj_cb);
+			atomic_inc_64(&et.et_deferred);
+		}
+		atomic_inc_64(&et.et_updates);
+	}
+
+	et_thread_exit();
+}
+
+void
+kbench_epoch(kbench_run_t *kb)
+{
+	processorid_t *cpus;
+	int ncpus, i;
+
+	bzero(&et, sizeof (et));
+	mutex_init(&et.et_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&et.et_cv, NULL, CV_DEFAULT, NULL);
+	et.et_cur = et_obj_alloc();
+
+	cpus = kbench_cpus(&ncpus);
+	et.et_nthreads = ncpus + epoch_torture_nwriters;
+
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < ncpus; i++)
+		kbench_thread_bind(et_reader, NULL, cpus[i], minclsyspri);
+	mutex_exit(&cpu_lock);
+	kbench_cpus_free(cpus);
+
+	/*
+	 * SYS threads are not time-sliced, so the writers run above the
+	 * readers in order to get any CPU time while the readers spin.
+	 */
+	for (i = 0; i < epoch_torture_nwriters; i++) {
+		(void) thread_create(NULL, 0, et_writer, NULL, 0, &p0,
+		    TS_RUN, minclsyspri + 1);
+	}
+
+	delay(drv_usectohz((clock_t)epoch_torture_secs * MICROSEC));
+
+	mutex_enter(&et.et_lock);
+	et.et_stop = B_TRUE;
+	while (et.et_nthreads != 0)
+		cv_wait(&et.et_cv, &et.et_lock);
+	mutex_exit(&et.et_lock);
+
+	/*
+	 * Every deferred object must have been freed once the callbacks
+	 * queued so far have run.
+	 */
+	et_obj_free(et.et_cur);
+	epoch_synchronize();
+	if (et.et_callbacks != et.et_deferred)
+		atomic_inc_64(&et.et_errors);
+
+	for (i = 0; i < ET_QUARANTINE; i++) {
+		if (et.et_quarantine[i] != NULL)
+			kmem_free(et.et_quarantine[i], sizeof (et_obj_t));
+	}
+	mutex_destroy(&et.et_lock);
+	cv_destroy(&et.et_cv);
+
+	kbench_result(kb, "secs", epoch_torture_secs);
+	kbench_result(kb, "readers", ncpus);
+	kbench_result(kb, "writers", epoch_torture_nwriters);
+	kbench_result(kb, "reads", et.et_reads);
+	kbench_result(kb, "updates", et.et_updates);
+	kbench_result(kb, "deferred", et.et_deferred);
+	kbench_result(kb, "callbacks", et.et_callbacks);
+	kbench_result(kb, "synchronized", et.et_synchronized);
+	kbench_result(kb, "errors", et.et_errors);
+}
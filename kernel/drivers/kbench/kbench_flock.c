@@ -0,0 +1,216 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Byte-range lock storm micro-benchmark.
+ *
+ * This measures how many non-conflicting F_SETLK lock/unlock pairs per
+ * second can be done on a single file which already holds a growing number
+ * of byte-range locks (none, then 16, 256, ... up to flock_bench_maxlocks),
+ * the way a database keeps thousands of record locks on one file.  A kernel
+ * thread bound to each online CPU does flock_bench_nops pairs, each time
+ * taking a write lock on a byte of its own between two of the locks already
+ * held, and releasing it.
+ *
+ * The results are lock/unlock pairs per second, in "setlk_<nlocks>":
+ *
+ *	# /opt/os-tests/tests/kbench/kbench flock
+ *
+ * Any request which failed (none should) is counted in "errors".
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/vnode.h>
+#include <sys/flock.h>
+#include <sys/file.h>
+#include <sys/fcntl.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/atomic.h>
+#include <sys/sysmacros.h>
+#include <sys/sunddi.h>
+
+#include "kbench.h"
+
+/*
+ * Number of lock/unlock pairs done by each thread of a run, and the number
+ * of locks held on the file during the last run.
+ */
+uint64_t flock_bench_nops = 1 << 16;
+uint_t flock_bench_maxlocks = 1 << 16;
+
+#define	FLB_HOLDER	1	/* owner of the locks held during a run */
+#define	FLB_PID		100	/* owner of the first thread's locks */
+
+typedef struct flb_run {
+	kmutex_t	fr_lock;
+	kcondvar_t	fr_cv;
+	vnode_t		*fr_vp;
+	uint_t		fr_nslots;	/* gaps between the held locks */
+	uint_t		fr_stride;	/* bytes per gap */
+	int		fr_ready;	/* # of threads waiting for fr_go */
+	int		fr_done;	/* # of threads done */
+	boolean_t	fr_go;
+	uint64_t	fr_errors;
+} flb_run_t;
+
+typedef struct flb_thread {
+	flb_run_t	*ft_run;
+	int		ft_id;
+} flb_thread_t;
+
+static int
+flock_bench_setlk(vnode_t *vp, short type, uoff_t off, pid_t pid)
+{
+	flock64_t fl;
+
+	bzero(&fl, sizeof (fl));
+	fl.l_type = type;
+	fl.l_whence = 0;
+	fl.l_start = off;
+	fl.l_len = 1;
+	fl.l_pid = pid;
+	return (reclock(vp, &fl, SETFLCK, FREAD | FWRITE, 0, NULL));
+}
+
+static void
+flock_bench_worker(void *arg)
+{
+	flb_thread_t *ft = arg;
+	flb_run_t *fr = ft->ft_run;
+	pid_t pid = FLB_PID + ft->ft_id;
+	uint64_t i, errors = 0;
+	uoff_t off;
+
+	mutex_enter(&fr->fr_lock);
+	fr->fr_ready++;
+	cv_broadcast(&fr->fr_cv);
+	while (!fr->fr_go)
+		cv_wait(&fr->fr_cv, &fr->fr_lock);
+	mutex_exit(&fr->fr_lock);
+
+	for (i = 0; i < flock_bench_nops; i++) {
+		/* spread the requests over the whole file */
+		off = (uoff_t)((i * 7919 + ft->ft_id) % fr->fr_nslots) *
+		    fr->fr_stride + 1 + ft->ft_id;
+		if (flock_bench_setlk(fr->fr_vp, F_WRLCK, off, pid) != 0)
+			errors++;
+		if (flock_bench_setlk(fr->fr_vp, F_UNLCK, off, pid) != 0)
+			errors++;
+	}
+
+	thread_affinity_clear(curthread);
+
+	mutex_enter(&fr->fr_lock);
+	fr->fr_errors += errors;
+	fr->fr_done++;
+	cv_broadcast(&fr->fr_cv);
+	mutex_exit(&fr->fr_lock);
+	thread_exit();
+}
+
+/*
+ * Hold 'nlocks' locks on a new vnode, do lock/unlock pairs between them
+ * from the first 'nthr' CPUs of 'cpus', and return the number of pairs per
+ * second.
+ */
+static uint64_t
+flock_bench_run(uint_t nlocks, processorid_t *cpus, int nthr,
+    uint64_t *errorsp)
+{
+	flb_run_t fr;
+	flb_thread_t *ft;
+	hrtime_t start, end;
+	uint_t n;
+	int i;
+
+	bzero(&fr, sizeof (fr));
+	mutex_init(&fr.fr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&fr.fr_cv, NULL, CV_DEFAULT, NULL);
+	fr.fr_vp = vn_alloc(KM_SLEEP);
+	fr.fr_vp->v_type = VREG;
+	fr.fr_nslots = MAX(nlocks, 1);
+	fr.fr_stride = nthr + 1;
+
+	for (n = 0; n < nlocks; n++) {
+		if (flock_bench_setlk(fr.fr_vp, F_RDLCK,
+		    (uoff_t)n * fr.fr_stride, FLB_HOLDER) != 0)
+			fr.fr_errors++;
+	}
+
+	ft = kmem_alloc(sizeof (flb_thread_t) * nthr, KM_SLEEP);
+
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < nthr; i++) {
+		ft[i].ft_run = &fr;
+		ft[i].ft_id = i;
+		kbench_thread_bind(flock_bench_worker, &ft[i], cpus[i],
+		    maxclsyspri);
+	}
+	mutex_exit(&cpu_lock);
+
+	mutex_enter(&fr.fr_lock);
+	while (fr.fr_ready != nthr)
+		cv_wait(&fr.fr_cv, &fr.fr_lock);
+	start = gethrtime();
+	fr.fr_go = B_TRUE;
+	cv_broadcast(&fr.fr_cv);
+	while (fr.fr_done != nthr)
+		cv_wait(&fr.fr_cv, &fr.fr_lock);
+	end = gethrtime();
+	mutex_exit(&fr.fr_lock);
+
+	cleanlocks(fr.fr_vp, IGN_PID, 0);
+	vn_free(fr.fr_vp);
+	kmem_free(ft, sizeof (flb_thread_t) * nthr);
+	mutex_destroy(&fr.fr_lock);
+	cv_destroy(&fr.fr_cv);
+
+	*errorsp += fr.fr_errors;
+	return ((flock_bench_nops * nthr * NANOSEC) / MAX(end - start, 1));
+}
+
+void
+kbench_flock(kbench_run_t *kb)
+{
+	processorid_t *cpus;
+	uint_t steps[KBENCH_MAXSTEPS];
+	uint64_t errors = 0;
+	int nsteps, ncpus, i;
+	uint_t n;
+	char name[KBENCH_NAMELEN];
+
+	cpus = kbench_cpus(&ncpus);
+
+	nsteps = 0;
+	steps[nsteps++] = 0;
+	for (n = 16; n < flock_bench_maxlocks && nsteps < KBENCH_MAXSTEPS - 1;
+	    n <<= 4)
+		steps[nsteps++] = n;
+	if (flock_bench_maxlocks != 0)
+		steps[nsteps++] = flock_bench_maxlocks;
+
+	kbench_result(kb, "ncpus", ncpus);
+	kbench_result(kb, "nops", flock_bench_nops);
+	for (i = 0; i < nsteps; i++) {
+		(void) snprintf(name, sizeof (name), "setlk_%u", steps[i]);
+		kbench_result(kb, name,
+		    flock_bench_run(steps[i], cpus, ncpus, &errors));
+	}
+	kbench_result(kb, "errors", errors);
+
+	kbench_cpus_free(cpus);
+}
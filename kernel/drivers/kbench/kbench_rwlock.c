@@ -0,0 +1,161 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Read-mostly rwlock micro-benchmark.
+ *
+ * This measures how many times per second an RW_DEFAULT and an RW_PERCPU
+ * rwlock can be entered and exited as reader as the number of CPUs doing so
+ * grows (1, 2, 4, ... up to all online CPUs).  Each reader is a kernel
+ * thread bound to its own CPU, which does rwlock_bench_nenters enter/exit
+ * pairs; one in every rwlock_bench_wrratio of them takes the lock as writer
+ * instead, so that the cost of draining the readers is included.
+ *
+ * The results are enters per second, in "default_<ncpus>" and
+ * "percpu_<ncpus>":
+ *
+ *	# /opt/os-tests/tests/kbench/kbench rwlock
+ *
+ * Running the above under "lockstat -C -H -s 0" shows the contention and
+ * hold times of both locks side by side.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/rwlock.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/sysmacros.h>
+#include <sys/sunddi.h>
+
+#include "kbench.h"
+
+/*
+ * Number of enters done by each thread of a run, and how many of them are
+ * done for every one done as writer (0 for none).
+ */
+uint64_t rwlock_bench_nenters = 1 << 20;
+uint_t rwlock_bench_wrratio = 10000;
+
+typedef struct rwb_run {
+	kmutex_t	rr_lock;
+	kcondvar_t	rr_cv;
+	krwlock_t	*rr_rwlock;
+	int		rr_ready;	/* # of threads waiting for rr_go */
+	int		rr_done;	/* # of threads done */
+	boolean_t	rr_go;
+} rwb_run_t;
+
+static void
+rwlock_bench_reader(void *arg)
+{
+	rwb_run_t *rr = arg;
+	uint64_t i;
+
+	mutex_enter(&rr->rr_lock);
+	rr->rr_ready++;
+	cv_broadcast(&rr->rr_cv);
+	while (!rr->rr_go)
+		cv_wait(&rr->rr_cv, &rr->rr_lock);
+	mutex_exit(&rr->rr_lock);
+
+	for (i = 1; i <= rwlock_bench_nenters; i++) {
+		if (rwlock_bench_wrratio != 0 &&
+		    i % rwlock_bench_wrratio == 0) {
+			rw_enter(rr->rr_rwlock, RW_WRITER);
+			rw_exit(rr->rr_rwlock);
+		} else {
+			rw_enter(rr->rr_rwlock, RW_READER);
+			rw_exit(rr->rr_rwlock);
+		}
+	}
+
+	thread_affinity_clear(curthread);
+
+	mutex_enter(&rr->rr_lock);
+	rr->rr_done++;
+	cv_broadcast(&rr->rr_cv);
+	mutex_exit(&rr->rr_lock);
+	thread_exit();
+}
+
+/*
+ * Enter 'type' rwlock from the first 'nthr' CPUs of 'cpus' and return the
+ * number of enters per second.
+ */
+static uint64_t
+rwlock_bench_run(krw_type_t type, processorid_t *cpus, int nthr)
+{
+	rwb_run_t rr;
+	krwlock_t rwlock;
+	hrtime_t start, end;
+	int i;
+
+	bzero(&rr, sizeof (rr));
+	mutex_init(&rr.rr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&rr.rr_cv, NULL, CV_DEFAULT, NULL);
+	rw_init(&rwlock, NULL, type, NULL);
+	rr.rr_rwlock = &rwlock;
+
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < nthr; i++) {
+		kbench_thread_bind(rwlock_bench_reader, &rr, cpus[i],
+		    maxclsyspri);
+	}
+	mutex_exit(&cpu_lock);
+
+	mutex_enter(&rr.rr_lock);
+	while (rr.rr_ready != nthr)
+		cv_wait(&rr.rr_cv, &rr.rr_lock);
+	start = gethrtime();
+	rr.rr_go = B_TRUE;
+	cv_broadcast(&rr.rr_cv);
+	while (rr.rr_done != nthr)
+		cv_wait(&rr.rr_cv, &rr.rr_lock);
+	end = gethrtime();
+	mutex_exit(&rr.rr_lock);
+
+	rw_destroy(&rwlock);
+	mutex_destroy(&rr.rr_lock);
+	cv_destroy(&rr.rr_cv);
+
+	return ((rwlock_bench_nenters * nthr * NANOSEC) /
+	    MAX(end - start, 1));
+}
+
+void
+kbench_rwlock(kbench_run_t *kb)
+{
+	processorid_t *cpus;
+	int steps[KBENCH_MAXSTEPS];
+	int nsteps, ncpus, i;
+	char name[KBENCH_NAMELEN];
+
+	cpus = kbench_cpus(&ncpus);
+	nsteps = kbench_steps(ncpus, steps);
+
+	kbench_result(kb, "ncpus", ncpus);
+	kbench_result(kb, "nenters", rwlock_bench_nenters);
+	kbench_result(kb, "wrratio", rwlock_bench_wrratio);
+	for (i = 0; i < nsteps; i++) {
+		(void) snprintf(name, sizeof (name), "default_%d", steps[i]);
+		kbench_result(kb, name,
+		    rwlock_bench_run(RW_DEFAULT, cpus, steps[i]));
+		(void) snprintf(name, sizeof (name), "percpu_%d", steps[i]);
+		kbench_result(kb, name,
+		    rwlock_bench_run(RW_PERCPU, cpus, steps[i]));
+	}
+
+	kbench_cpus_free(cpus);
+}
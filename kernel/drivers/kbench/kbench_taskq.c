@@ -0,0 +1,165 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Task queue dispatch micro-benchmark.
+ *
+ * This measures how many empty tasks per second can be pushed through a
+ * regular, shared-list task queue and through a TASKQ_PERCPU task queue as
+ * the number of dispatching CPUs grows (1, 2, 4, ... up to all online CPUs).
+ * Each dispatcher is a kernel thread bound to its own CPU, which dispatches
+ * its share of taskq_bench_ntasks tasks as fast as it can; a run ends when
+ * the last task has completed.
+ *
+ * The results are tasks per second, in "shared_<ncpus>" and
+ * "percpu_<ncpus>":
+ *
+ *	# /opt/os-tests/tests/kbench/kbench taskq
+ *
+ * The stealing behaviour of the TASKQ_PERCPU task queue during the runs can
+ * be watched with "kstat -c taskq_p".
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/taskq.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/sysmacros.h>
+#include <sys/sunddi.h>
+
+#include "kbench.h"
+
+/*
+ * Total number of tasks dispatched by each run, and the number of worker
+ * threads per online CPU in both task queues.
+ */
+uint64_t taskq_bench_ntasks = 1 << 20;
+int taskq_bench_nthreads = 1;
+
+#define	TQB_MINALLOC	64	/* cached entries per CPU */
+
+typedef struct tqb_run {
+	kmutex_t	tr_lock;
+	kcondvar_t	tr_cv;
+	taskq_t		*tr_tq;
+	uint64_t	tr_ntasks;	/* tasks per dispatcher */
+	int		tr_ready;	/* # of dispatchers waiting for tr_go */
+	int		tr_done;	/* # of dispatchers done */
+	boolean_t	tr_go;
+} tqb_run_t;
+
+static void
+taskq_bench_dispatcher(void *arg)
+{
+	tqb_run_t *tr = arg;
+	uint64_t i;
+
+	mutex_enter(&tr->tr_lock);
+	tr->tr_ready++;
+	cv_broadcast(&tr->tr_cv);
+	while (!tr->tr_go)
+		cv_wait(&tr->tr_cv, &tr->tr_lock);
+	mutex_exit(&tr->tr_lock);
+
+	for (i = 0; i < tr->tr_ntasks; i++)
+		(void) taskq_dispatch(tr->tr_tq, nulltask, NULL, TQ_SLEEP);
+
+	thread_affinity_clear(curthread);
+
+	mutex_enter(&tr->tr_lock);
+	tr->tr_done++;
+	cv_broadcast(&tr->tr_cv);
+	mutex_exit(&tr->tr_lock);
+	thread_exit();
+}
+
+/*
+ * Dispatch taskq_bench_ntasks tasks into 'tq' from the first 'ndisp' CPUs of
+ * 'cpus' and return the number of tasks executed per second.
+ */
+static uint64_t
+taskq_bench_run(taskq_t *tq, processorid_t *cpus, int ndisp)
+{
+	tqb_run_t tr;
+	hrtime_t start, end;
+	int i;
+
+	bzero(&tr, sizeof (tr));
+	mutex_init(&tr.tr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&tr.tr_cv, NULL, CV_DEFAULT, NULL);
+	tr.tr_tq = tq;
+	tr.tr_ntasks = MAX(taskq_bench_ntasks / ndisp, 1);
+
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < ndisp; i++) {
+		kbench_thread_bind(taskq_bench_dispatcher, &tr, cpus[i],
+		    maxclsyspri);
+	}
+	mutex_exit(&cpu_lock);
+
+	mutex_enter(&tr.tr_lock);
+	while (tr.tr_ready != ndisp)
+		cv_wait(&tr.tr_cv, &tr.tr_lock);
+	start = gethrtime();
+	tr.tr_go = B_TRUE;
+	cv_broadcast(&tr.tr_cv);
+	while (tr.tr_done != ndisp)
+		cv_wait(&tr.tr_cv, &tr.tr_lock);
+	mutex_exit(&tr.tr_lock);
+
+	taskq_wait(tq);
+	end = gethrtime();
+
+	mutex_destroy(&tr.tr_lock);
+	cv_destroy(&tr.tr_cv);
+
+	return ((tr.tr_ntasks * ndisp * NANOSEC) / MAX(end - start, 1));
+}
+
+void
+kbench_taskq(kbench_run_t *kb)
+{
+	taskq_t *shared, *percpu;
+	processorid_t *cpus;
+	int steps[KBENCH_MAXSTEPS];
+	int nsteps, ncpus, i;
+	char name[KBENCH_NAMELEN];
+
+	cpus = kbench_cpus(&ncpus);
+	nsteps = kbench_steps(ncpus, steps);
+
+	shared = taskq_create("taskq_bench_shared",
+	    ncpus * taskq_bench_nthreads, minclsyspri, ncpus * TQB_MINALLOC,
+	    INT_MAX, TASKQ_PREPOPULATE);
+	percpu = taskq_create("taskq_bench_percpu", taskq_bench_nthreads,
+	    minclsyspri, ncpus * TQB_MINALLOC, INT_MAX,
+	    TASKQ_PREPOPULATE | TASKQ_PERCPU);
+
+	kbench_result(kb, "ncpus", ncpus);
+	kbench_result(kb, "ntasks", taskq_bench_ntasks);
+	for (i = 0; i < nsteps; i++) {
+		(void) snprintf(name, sizeof (name), "shared_%d", steps[i]);
+		kbench_result(kb, name,
+		    taskq_bench_run(shared, cpus, steps[i]));
+		(void) snprintf(name, sizeof (name), "percpu_%d", steps[i]);
+		kbench_result(kb, name,
+		    taskq_bench_run(percpu, cpus, steps[i]));
+	}
+
+	taskq_destroy(shared);
+	taskq_destroy(percpu);
+	kbench_cpus_free(cpus);
+}
@@ -0,0 +1,251 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Identifier and vmem churn benchmark.
+ *
+ * Creating and tearing down processes, contracts, sockets and the like
+ * allocates an identifier or a minor number from an ID space, and often a
+ * small piece of some vmem arena, and frees it again shortly afterwards.
+ * This replays that pattern from kernel threads bound to 1, 2, 4, ... up to
+ * all online CPUs: each does vmem_bench_nops allocations, keeping its last
+ * vmem_bench_held allocations and freeing the oldest one whenever it makes
+ * a new one.  It is run against
+ *
+ *   - an ID space kept in a vmem arena ("idvmem_<ncpus>") and one kept in
+ *     a bitmap ("idbitmap_<ncpus>"), with vmem_bench_nids identifiers;
+ *
+ *   - a vmem arena that can't have per-cpu magazines ("arena_<ncpus>"),
+ *     and one that has them ("pcpu_<ncpus>"), allocating one quantum at a
+ *     time.  The magazines are only handed out by vmem_update(), so the
+ *     benchmark waits up to twice vmem_update_interval for them to appear.
+ *
+ * The results are allocations per second:
+ *
+ *	# /opt/os-tests/tests/kbench/kbench vmem
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/vmem_impl.h>
+#include <sys/id_space.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/sysmacros.h>
+#include <sys/sunddi.h>
+
+#include "kbench.h"
+
+uint64_t vmem_bench_nops = 1 << 18;
+uint_t vmem_bench_held = 16;
+id_t vmem_bench_nids = 1 << 16;
+
+extern uint64_t vmem_pcpu_hot;
+
+#define	VMB_MAXHELD	1024
+#define	VMB_QUANTUM	64
+#define	VMB_WAIT	30	/* seconds to wait for the magazines */
+
+typedef enum {
+	VMB_IDVMEM,
+	VMB_IDBITMAP,
+	VMB_ARENA,
+	VMB_PCPU,
+	VMB_NTESTS
+} vmb_test_t;
+
+static const char *vmb_names[VMB_NTESTS] = {
+	"idvmem", "idbitmap", "arena", "pcpu"
+};
+
+typedef struct vmb_run {
+	kmutex_t	vr_lock;
+	kcondvar_t	vr_cv;
+	id_space_t	*vr_ids;	/* ID space, or */
+	vmem_t		*vr_arena;	/* arena to allocate from */
+	int		vr_ready;	/* # of threads waiting for vr_go */
+	int		vr_done;	/* # of threads done */
+	boolean_t	vr_go;
+} vmb_run_t;
+
+static void
+vmem_bench_worker(void *arg)
+{
+	vmb_run_t *vr = arg;
+	uint_t held = MAX(1, MIN(vmem_bench_held, VMB_MAXHELD));
+	uintptr_t *ring;
+	uint64_t i;
+	uint_t slot;
+
+	ring = kmem_zalloc(held * sizeof (uintptr_t), KM_SLEEP);
+
+	mutex_enter(&vr->vr_lock);
+	vr->vr_ready++;
+	cv_broadcast(&vr->vr_cv);
+	while (!vr->vr_go)
+		cv_wait(&vr->vr_cv, &vr->vr_lock);
+	mutex_exit(&vr->vr_lock);
+
+	for (i = 0; i < vmem_bench_nops + held; i++) {
+		slot = i % held;
+		if (i >= held) {
+			if (vr->vr_ids != NULL)
+				id_free(vr->vr_ids, (id_t)ring[slot]);
+			else
+				vmem_free(vr->vr_arena, (void *)ring[slot],
+				    VMB_QUANTUM);
+		}
+		if (i >= vmem_bench_nops)
+			continue;
+		if (vr->vr_ids != NULL)
+			ring[slot] = (uintptr_t)id_alloc(vr->vr_ids);
+		else
+			ring[slot] = (uintptr_t)vmem_alloc(vr->vr_arena,
+			    VMB_QUANTUM, VM_SLEEP);
+	}
+
+	kmem_free(ring, held * sizeof (uintptr_t));
+	thread_affinity_clear(curthread);
+
+	mutex_enter(&vr->vr_lock);
+	vr->vr_done++;
+	cv_broadcast(&vr->vr_cv);
+	mutex_exit(&vr->vr_lock);
+	thread_exit();
+}
+
+/*
+ * Churn 'ids' or 'arena' from the first 'nthr' CPUs of 'cpus' and return
+ * the number of allocations per second.
+ */
+static uint64_t
+vmem_bench_run(id_space_t *ids, vmem_t *arena, processorid_t *cpus,
+    int nthr)
+{
+	vmb_run_t vr;
+	hrtime_t start, end;
+	int i;
+
+	bzero(&vr, sizeof (vr));
+	mutex_init(&vr.vr_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vr.vr_cv, NULL, CV_DEFAULT, NULL);
+	vr.vr_ids = ids;
+	vr.vr_arena = arena;
+
+	mutex_enter(&cpu_lock);
+	for (i = 0; i < nthr; i++) {
+		kbench_thread_bind(vmem_bench_worker, &vr, cpus[i],
+		    maxclsyspri);
+	}
+	mutex_exit(&cpu_lock);
+
+	mutex_enter(&vr.vr_lock);
+	while (vr.vr_ready != nthr)
+		cv_wait(&vr.vr_cv, &vr.vr_lock);
+	start = gethrtime();
+	vr.vr_go = B_TRUE;
+	cv_broadcast(&vr.vr_cv);
+	while (vr.vr_done != nthr)
+		cv_wait(&vr.vr_cv, &vr.vr_lock);
+	end = gethrtime();
+	mutex_exit(&vr.vr_lock);
+
+	mutex_destroy(&vr.vr_lock);
+	cv_destroy(&vr.vr_cv);
+
+	return ((vmem_bench_nops * nthr * NANOSEC) / MAX(end - start, 1));
+}
+
+/*
+ * Make 'vmp' busy until vmem_update() gives it per-cpu magazines, or
+ * VMB_WAIT seconds have passed.
+ */
+static void
+vmem_bench_warm(vmem_t *vmp)
+{
+	hrtime_t until = gethrtime() + VMB_WAIT * NANOSEC;
+	uint64_t i;
+	void *vaddr;
+
+	while (vmp->vm_pcpu == NULL && gethrtime() < until) {
+		for (i = 0; i <= vmem_pcpu_hot; i++) {
+			vaddr = vmem_alloc(vmp, VMB_QUANTUM, VM_SLEEP);
+			vmem_free(vmp, vaddr, VMB_QUANTUM);
+		}
+		delay(hz);
+	}
+}
+
+void
+kbench_vmem(kbench_run_t *kb)
+{
+	processorid_t *cpus;
+	id_space_t *ids[2];
+	vmem_t *arenas[2];
+	size_t asize;
+	int steps[KBENCH_MAXSTEPS];
+	int nsteps, ncpus, n, i;
+	char name[KBENCH_NAMELEN];
+
+	cpus = kbench_cpus(&ncpus);
+	nsteps = kbench_steps(ncpus, steps);
+
+	/*
+	 * The ID spaces must have room for everything the threads hold, and
+	 * the arenas for that and the magazines.
+	 */
+	n = MAX(vmem_bench_nids, ncpus * (MIN(vmem_bench_held,
+	    VMB_MAXHELD) + 1));
+	ids[0] = id_space_xcreate("vmem_bench_vmem", 1, n + 1, ID_SPACE_VMEM);
+	ids[1] = id_space_xcreate("vmem_bench_bitmap", 1, n + 1,
+	    ID_SPACE_BITMAP);
+
+	asize = (size_t)max_ncpus * (VMB_MAXHELD + VMEM_PCPU_ROUNDS + 1) *
+	    VMB_QUANTUM;
+	arenas[0] = vmem_create("vmem_bench_arena", (void *)VMB_QUANTUM,
+	    asize, VMB_QUANTUM, NULL, NULL, NULL, 0,
+	    VM_SLEEP | VMC_NO_QCACHE);
+	arenas[1] = vmem_create("vmem_bench_pcpu", (void *)VMB_QUANTUM,
+	    asize, VMB_QUANTUM, NULL, NULL, NULL, 0, VM_SLEEP);
+	vmem_bench_warm(arenas[1]);
+
+	kbench_result(kb, "ncpus", ncpus);
+	kbench_result(kb, "nops", vmem_bench_nops);
+	kbench_result(kb, "held", vmem_bench_held);
+	for (i = 0; i < nsteps; i++) {
+		(void) snprintf(name, sizeof (name), "%s_%d",
+		    vmb_names[VMB_IDVMEM], steps[i]);
+		kbench_result(kb, name,
+		    vmem_bench_run(ids[0], NULL, cpus, steps[i]));
+		(void) snprintf(name, sizeof (name), "%s_%d",
+		    vmb_names[VMB_IDBITMAP], steps[i]);
+		kbench_result(kb, name,
+		    vmem_bench_run(ids[1], NULL, cpus, steps[i]));
+		(void) snprintf(name, sizeof (name), "%s_%d",
+		    vmb_names[VMB_ARENA], steps[i]);
+		kbench_result(kb, name,
+		    vmem_bench_run(NULL, arenas[0], cpus, steps[i]));
+		(void) snprintf(name, sizeof (name), "%s_%d",
+		    vmb_names[VMB_PCPU], steps[i]);
+		kbench_result(kb, name,
+		    vmem_bench_run(NULL, arenas[1], cpus, steps[i]));
+	}
+
+	id_space_destroy(ids[0]);
+	id_space_destroy(ids[1]);
+	vmem_destroy(arenas[0]);
+	vmem_destroy(arenas[1]);
+	kbench_cpus_free(cpus);
+}
@@ -117,6 +117,7 @@ static struct fem fem_guard_ops = {
 	.femop_vnevent		= fem_err,
 	.femop_reqzcbuf		= fem_err,
 	.femop_retzcbuf		= fem_err,
+	.femop_aio		= fem_err,
 };
 
 static struct fsem fsem_guard_ops = {
@@ -1554,6 +1555,34 @@ vhead_retzcbuf(vnode_t *vp, xuio_t *xuiop, cred_t *cr, caller_context_t *ct)
 	return ret;
 }
 
+int
+vhead_aio(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cr,
+    caller_context_t *ct)
+{
+	int (*func)(femarg_t *, struct aio_req *, int, cred_t *,
+		    caller_context_t *);
+	struct fem_list	*femsp;
+	femarg_t farg;
+	int ret;
+
+	if ((femsp = fem_get(vp->v_femhead)) == NULL) {
+		func = NULL;
+	} else {
+		farg.fa_vnode.vp = vp;
+		farg.fa_fnode = femsp->feml_nodes + femsp->feml_tos;
+		func = vsop_find(&farg, femop_aio);
+	}
+
+	if (func != NULL)
+		ret = func(&farg, aio, rw, cr, ct);
+	else
+		ret = fop_aio_dispatch(vp, aio, rw, cr, ct, false);
+
+	fem_release(femsp);
+
+	return ret;
+}
+
 int
 fshead_mount(vfs_t *vfsp, vnode_t *mvp, struct mounta *uap, cred_t *cr)
 {
@@ -2642,6 +2671,24 @@ vnext_retzcbuf(femarg_t *vf, xuio_t *xuiop, cred_t *cr, caller_context_t *ct)
 	return fop_retzcbuf_dispatch(vnode, xuiop, cr, ct, false);
 }
 
+int
+vnext_aio(femarg_t *vf, struct aio_req *aio, int rw, cred_t *cr,
+    caller_context_t *ct)
+{
+	int (*func)(femarg_t *, struct aio_req *, int, cred_t *,
+		    caller_context_t *);
+	struct vnode *vnode = vf->fa_vnode.vp;
+
+	ASSERT(vf != NULL);
+	vf->fa_fnode--;
+	func = vsop_find(vf, femop_aio);
+
+	if (func != NULL)
+		return func(vf, aio, rw, cr, ct);
+
+	return fop_aio_dispatch(vnode, aio, rw, cr, ct, false);
+}
+
 int
 vfsnext_mount(fsemarg_t *vf, vnode_t *mvp, struct mounta *uap, cred_t *cr)
 {
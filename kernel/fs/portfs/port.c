@@ -78,6 +78,8 @@
  *			   port_send(3c) or port_sendn(3c).
  * PORT_SOURCE_FILE	 : events submitted per file being watched for file
  *			   change events  (see port_create(3c).
+ * PORT_SOURCE_AIORING	 : events submitted when completions are posted to
+ *			   an asynchronous I/O ring (see aioring_setup(3C)).
  *
  * There is a user API implemented in the libc library as well as a
  * kernel API implemented in port_subr.c in genunix.
@@ -231,6 +233,8 @@
  * 	This type of event is not shareable between processes.
  *    PORT_SOURCE_FILE events
  * 	This type of event is not shareable between processes.
+ *    PORT_SOURCE_AIORING events
+ * 	This type of event is not shareable between processes.
  *
  * FORK BEHAVIOUR
  * On fork(2) the child process inherits all opened file descriptors from
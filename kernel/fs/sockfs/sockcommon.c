@@ -597,6 +597,7 @@ sonode_init(struct sonode *so, struct sockparams *sp, int family,
 	so->so_rcv_wakeup = B_FALSE;
 	so->so_snd_wakeup = B_FALSE;
 	so->so_flowctrld = B_FALSE;
+	so->so_rcv_cpu = PBIND_NONE;
 
 	so->so_pollev = 0;
 	bzero(&so->so_poll_list, sizeof (so->so_poll_list));
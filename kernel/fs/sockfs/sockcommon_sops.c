@@ -47,6 +47,7 @@
 #include <sys/strsun.h>
 #include <sys/ddi.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <inet/ip.h>
 
 #include "sockcommon.h"
@@ -291,6 +292,39 @@ done:
 	return (error);
 }
 
+/*
+ * Connect a TCP socket for sendmsg() with MSG_FASTOPEN.  If TCP has a Fast
+ * Open cookie for the peer, the connection completes at once, and the data
+ * that follows goes in the SYN; otherwise this is an ordinary connect.
+ */
+static int
+so_fastopen(struct sonode *so, struct msghdr *msg, int fflag, struct cred *cr)
+{
+	struct sockaddr *name = msg->msg_name;
+	socklen_t namelen = msg->msg_namelen;
+	sock_connid_t id;
+	int error, on = 1;
+
+	if (so->so_family != AF_INET && so->so_family != AF_INET6)
+		return (EOPNOTSUPP);
+
+	error = (*so->so_downcalls->sd_setsockopt)(so->so_proto_handle,
+	    IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &on, sizeof (on), cr);
+	if (error != 0)
+		return (error);
+
+	if (so->so_filter_active == 0 ||
+	    (error = sof_filter_connect(so, name, &namelen, cr)) < 0) {
+		error = (*so->so_downcalls->sd_connect)(so->so_proto_handle,
+		    name, namelen, &id, cr);
+
+		if (error == EINPROGRESS)
+			error = so_wait_connected(so,
+			    fflag & (FNONBLOCK|FNDELAY), id);
+	}
+	return (error);
+}
+
 /*ARGSUSED*/
 int
 so_accept(struct sonode *so, int fflag, struct cred *cr, struct sonode **nsop)
@@ -350,6 +384,16 @@ so_sendmsg(struct sonode *so, struct msghdr *msg, struct uio *uiop,
 		return (EMSGSIZE);
 	}
 
+	/* MSG_FASTOPEN only means something to stream sockets. */
+	if ((flags & MSG_FASTOPEN) && so->so_type == SOCK_STREAM &&
+	    msg->msg_name != NULL &&
+	    !(so->so_state & (SS_ISCONNECTED|SS_ISCONNECTING))) {
+		if ((error = so_fastopen(so, msg, uiop->uio_fmode, cr)) != 0) {
+			SO_UNBLOCK_FALLBACK(so);
+			return (error);
+		}
+	}
+
 	/*
 	 * For atomic sends we will only do one iteration.
 	 */
@@ -1579,6 +1623,17 @@ so_recvmsg(struct sonode *so, struct msghdr *msg, struct uio *uiop,
 		return (error);
 	}
 
+	/*
+	 * Let the protocol know when the application reads on another CPU,
+	 * so that it can process the socket's packets there.
+	 */
+	if (so->so_downcalls->sd_rcv_cpu != NULL &&
+	    so->so_rcv_cpu != CPU->cpu_id) {
+		so->so_rcv_cpu = CPU->cpu_id;
+		(*so->so_downcalls->sd_rcv_cpu)(so->so_proto_handle,
+		    so->so_rcv_cpu);
+	}
+
 	/*
 	 * Reading data from the socket buffer
 	 */
@@ -1109,6 +1109,95 @@ recvmsg(int sock, struct msghdr *msg, int flags)
 	return (rval);
 }
 
+/*
+ * sendmmsg(2) and recvmmsg(2) transfer up to vlen messages per call.  Each
+ * message goes through sendmsg() or recvmsg() as if it had been sent or
+ * received on its own; what the caller saves is a system call per datagram.
+ * An error after the first message ends the batch, and the number of
+ * messages transferred so far is returned instead of the error.
+ */
+#define	MMSG_MAX	1024
+
+/*
+ * Per-message errors are reported through set_errno(); clear the error
+ * when some messages made it.
+ */
+static int
+mmsg_done(uint_t cnt)
+{
+	klwp_t *lwp = ttolwp(curthread);
+
+	if (cnt == 0 && lwp->lwp_errno != 0)
+		return (-1);
+	lwp->lwp_errno = 0;
+	return ((int)cnt);
+}
+
+int
+recvmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags,
+    struct timespec *timeout)
+{
+	STRUCT_HANDLE(mmsghdr, umsg);
+	model_t		model;
+	timespec_t	ts;
+	hrtime_t	deadline = 0;
+	ssize_t		len;
+	uint32_t	ulen;
+	uint_t		i;
+
+	dprint(1, ("recvmmsg(%d, %p, %u, %d, %p)\n",
+	    sock, (void *)msgvec, vlen, flags, (void *)timeout));
+
+	model = get_udatamodel();
+	if (timeout != NULL) {
+		if (model == DATAMODEL_NATIVE) {
+			if (copyin(timeout, &ts, sizeof (ts)))
+				return (set_errno(EFAULT));
+		} else {
+			timespec32_t ts32;
+
+			if (copyin(timeout, &ts32, sizeof (ts32)))
+				return (set_errno(EFAULT));
+			TIMESPEC32_TO_TIMESPEC(&ts, &ts32)
+		}
+		if (itimerspecfix(&ts))
+			return (set_errno(EINVAL));
+		deadline = gethrtime() + ts2hrt(&ts);
+	}
+	if (vlen > MMSG_MAX)
+		vlen = MMSG_MAX;
+
+	STRUCT_SET_HANDLE(umsg, model, msgvec);
+	for (i = 0; i < vlen; i++) {
+		len = recvmsg(sock,
+		    (struct msghdr *)STRUCT_FADDR(umsg, msg_hdr),
+		    flags & ~MSG_WAITFORONE);
+		if (len < 0)
+			break;
+		ulen = (uint32_t)len;
+		if (copyout(&ulen, STRUCT_FADDR(umsg, msg_len),
+		    sizeof (ulen)) != 0) {
+			(void) set_errno(EFAULT);
+			break;
+		}
+		STRUCT_SET_HANDLE(umsg, model,
+		    (void *)((caddr_t)STRUCT_BUF(umsg) + STRUCT_SIZE(umsg)));
+
+		/* Don't wait for more than we have been asked to */
+		if (flags & MSG_WAITFORONE)
+			flags |= MSG_DONTWAIT;
+		/*
+		 * As elsewhere, the timeout is only looked at between
+		 * messages; it does not cut a blocking receive short.
+		 */
+		if (timeout != NULL && gethrtime() >= deadline) {
+			i++;
+			break;
+		}
+	}
+	return (mmsg_done(i));
+}
+
 /*
  * Common send function.
  */
@@ -1353,6 +1442,40 @@ sendmsg(int sock, struct msghdr *msg, int flags)
 	return (rval);
 }
 
+int
+sendmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags)
+{
+	STRUCT_HANDLE(mmsghdr, umsg);
+	model_t		model;
+	ssize_t		len;
+	uint32_t	ulen;
+	uint_t		i;
+
+	dprint(1, ("sendmmsg(%d, %p, %u, %d)\n",
+	    sock, (void *)msgvec, vlen, flags));
+
+	model = get_udatamodel();
+	if (vlen > MMSG_MAX)
+		vlen = MMSG_MAX;
+
+	STRUCT_SET_HANDLE(umsg, model, msgvec);
+	for (i = 0; i < vlen; i++) {
+		len = sendmsg(sock,
+		    (struct msghdr *)STRUCT_FADDR(umsg, msg_hdr), flags);
+		if (len < 0)
+			break;
+		ulen = (uint32_t)len;
+		if (copyout(&ulen, STRUCT_FADDR(umsg, msg_len),
+		    sizeof (ulen)) != 0) {
+			(void) set_errno(EFAULT);
+			break;
+		}
+		STRUCT_SET_HANDLE(umsg, model,
+		    (void *)((caddr_t)STRUCT_BUF(umsg) + STRUCT_SIZE(umsg)));
+	}
+	return (mmsg_done(i));
+}
+
 ssize_t
 sendto(int sock, void *buffer, size_t len, int flags,
     struct sockaddr *name, socklen_t namelen)
@@ -2364,6 +2487,174 @@ snf_smap_desbfree(snf_smap_desbinfo *snfi)
 	kmem_free(snfi, sizeof (*snfi));
 }
 
+/*
+ * Sending loaned file system buffers (see snf_loan()) can be turned off with
+ * snf_loan_enable; snf_loan_size is how much is loaned and sent down at once.
+ */
+boolean_t snf_loan_enable = B_TRUE;
+uint_t snf_loan_size = 1024 * 1024;
+
+typedef struct {
+	xuio_t		snfl_xuio;	/* must be first */
+	frtn_t		snfl_frtn;
+	unsigned int	snfl_ref;
+	vnode_t		*snfl_vp;
+} snf_loan_desbinfo;
+
+/*
+ * The callback function used for mblks built on loaned buffers, called when
+ * the last ref of an mblk is dropped.  The buffers go back to the file system
+ * once every mblk of the chain is gone.
+ */
+void
+snf_loan_desbfree(snf_loan_desbinfo *snfl)
+{
+	ASSERT(snfl->snfl_ref != 0);
+	if (atomic_dec_32_nv(&snfl->snfl_ref) == 0) {
+		(void) fop_retzcbuf(snfl->snfl_vp, &snfl->snfl_xuio, kcred,
+		    NULL);
+		VN_RELE(snfl->snfl_vp);
+		kmem_free(snfl, sizeof (snf_loan_desbinfo));
+	}
+}
+
+/*
+ * Send down buffers loaned by the file system through fop_reqzcbuf() instead
+ * of copying the file into network buffers.  For ZFS these are the ARC
+ * buffers themselves, which is what makes this worthwhile: ZFS files have no
+ * pages for snf_segmap() to map, and mapping them in would only cache the
+ * file a second time.  The mblks are esballoca'ed, so nobody writes into
+ * them, and carry no room for headers; the transport puts its headers in
+ * an mblk of their own, so LSO and checksum offload work as for any other
+ * data.  A loaned buffer is not changed by later writes to the file, so,
+ * unlike snf_segmap(), there is no need to wait for the data to be acked.
+ *
+ * Called and returns with fvp locked as a reader.  ENOTSUP means that the
+ * file system would not loan anything (it does not support it, or the file
+ * or the request is too small, or the file has pages cached) and the caller
+ * should use one of the other methods; otherwise *count is how much was sent,
+ * which can fall short of size if the file system stops loaning partway, in
+ * which case the caller should send the rest some other way.
+ */
+int
+snf_loan(file_t *fp, file_t *rfp, vnode_t *fvp, uoff_t fileoff, uoff_t size,
+    ssize_t *count)
+{
+	snf_loan_desbinfo *snfl;
+	vnode_t *vp;
+	uio_t *uiop;
+	iovec_t *iov;
+	mblk_t *mp, *nmp, **mpp;
+	ssize_t ksize, chain_size, len;
+	short fflag;
+	int ioflag;
+	int error = 0;
+	int i;
+	struct msghdr msg;
+
+	vp = fp->f_vnode;
+	fflag = fp->f_flag;
+	ksize = 0;
+	bzero(&msg, sizeof (msg));
+
+	ioflag = rfp->f_flag & (FSYNC|FDSYNC|FRSYNC);
+	if ((ioflag & FRSYNC) == 0)
+		ioflag &= ~(FSYNC|FDSYNC);
+
+	while (size > 0) {
+		if (ISSIG(curthread, JUSTLOOKING)) {
+			error = EINTR;
+			break;
+		}
+
+		len = MIN(size, snf_loan_size);
+		snfl = kmem_zalloc(sizeof (snf_loan_desbinfo), KM_SLEEP);
+		snfl->snfl_xuio.xu_type = UIOTYPE_ZEROCOPY;
+		uiop = &snfl->snfl_xuio.xu_uio;
+		uiop->uio_loffset = fileoff;
+		uiop->uio_resid = len;
+		uiop->uio_segflg = UIO_SYSSPACE;
+		uiop->uio_llimit = MAXOFFSET_T;
+		uiop->uio_fmode = rfp->f_flag;
+
+		if (fop_reqzcbuf(fvp, UIO_READ, &snfl->snfl_xuio, fp->f_cred,
+		    NULL) != 0) {
+			kmem_free(snfl, sizeof (snf_loan_desbinfo));
+			break;
+		}
+		VN_HOLD(fvp);
+		snfl->snfl_vp = fvp;
+		snfl->snfl_ref = 1;
+		snfl->snfl_frtn.free_func = snf_loan_desbfree;
+		snfl->snfl_frtn.free_arg = (caddr_t)snfl;
+
+		error = fop_read(fvp, uiop, ioflag, fp->f_cred, NULL);
+		chain_size = len - uiop->uio_resid;
+
+		/*
+		 * Build a chain with an mblk for each loaned buffer.  The
+		 * chain is ours alone until it is sent, so the ref count
+		 * needs no atomics yet; the ref we started with keeps the
+		 * buffers around should we have to give up halfway.
+		 */
+		mp = NULL;
+		mpp = &mp;
+		iov = uiop->uio_iov;
+		for (i = 0; error == 0 && i < uiop->uio_iovcnt; i++, iov++) {
+			if (iov->iov_len == 0)
+				continue;
+			nmp = esballoca((uchar_t *)iov->iov_base, iov->iov_len,
+			    BPRI_HI, &snfl->snfl_frtn);
+			if (nmp == NULL) {
+				error = ENOMEM;
+				break;
+			}
+			nmp->b_wptr += iov->iov_len;
+			snfl->snfl_ref++;
+			*mpp = nmp;
+			mpp = &nmp->b_cont;
+		}
+
+		/*
+		 * If pages of the file got cached after fop_reqzcbuf(), the
+		 * file system may have copied the data into the buffers
+		 * through the iovecs instead; then the iovecs no longer
+		 * describe the data, so drop it and let the caller copy.
+		 */
+		snf_loan_desbfree(snfl);
+		if (error != 0 || chain_size == 0 ||
+		    msgdsize(mp) != chain_size) {
+			freemsg(mp);
+			break;
+		}
+
+		error = socket_sendmblk(VTOSO(vp), &msg, fflag, CRED(), &mp);
+		if (error != 0) {
+			/*
+			 * mp contains the mblks that were not sent by
+			 * socket_sendmblk. Use its size to update ksize
+			 */
+			ksize += chain_size - msgdsize(mp);
+			if (mp != NULL)
+				freemsg(mp);
+			break;
+		}
+		ksize += chain_size;
+		fileoff += chain_size;
+		size -= chain_size;
+
+		/* Short read: we hit the end of the file. */
+		if (chain_size < len)
+			break;
+	}
+	*count = ksize;
+	if (ksize != 0)
+		sf_stats.ss_file_loaned++;
+	else if (error == 0 && size > 0)
+		error = ENOTSUP;
+	return (error);
+}
+
 /*
  * Use segmap or vpm instead of bcopy to send down a desballoca'ed, mblk.
  * When segmap is used, the mblk contains a segmap slot of no more
@@ -2773,6 +3064,7 @@ sosendfile64(file_t *fp, file_t *rfp, const struct ksendfilevec64 *sfv,
 	struct vattr va;
 	stdata_t *stp;
 	ssize_t count = 0;
+	ssize_t lcount = 0;
 	int error = 0;
 	boolean_t dozcopy = B_FALSE;
 	uint_t maxpsz;
@@ -2829,6 +3121,22 @@ sosendfile64(file_t *fp, file_t *rfp, const struct ksendfilevec64 *sfv,
 
 	vp = fp->f_vnode;
 	stp = vp->v_stream;
+	/*
+	 * Send what the file system will loan us without copying, and the
+	 * rest, if any, by one of the means below.
+	 */
+	if (snf_loan_enable && vp->v_type == VSOCK &&
+	    VTOSO(vp)->so_filter_active == 0) {
+		error = snf_loan(fp, rfp, fvp, sfv_off, (uoff_t)sfv_len,
+		    &lcount);
+		if (error != ENOTSUP && (error != 0 || lcount == sfv_len)) {
+			fop_rwunlock(fvp, V_WRITELOCK_FALSE, NULL);
+			goto out;
+		}
+		error = 0;
+		sfv_off += lcount;
+		sfv_len -= lcount;
+	}
 	/*
 	 * When the NOWAIT flag is not set, we enable zero-copy only if the
 	 * transfer size is large enough. This prevents performance loss
@@ -2874,7 +3182,7 @@ sosendfile64(file_t *fp, file_t *rfp, const struct ksendfilevec64 *sfv,
 	}
 out:
 	releasef(sfv->sfv_fd);
-	*count32 = (ssize32_t)count;
+	*count32 = (ssize32_t)(count + lcount);
 	return (error);
 }
 #endif
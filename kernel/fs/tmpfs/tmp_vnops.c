@@ -66,6 +66,7 @@
 #include <sys/debug.h>
 #include <sys/swap.h>
 #include <sys/buf.h>
+#include <sys/aio_req.h>
 #include <sys/vm.h>
 #include <sys/vtrace.h>
 #include <sys/policy.h>
@@ -2423,6 +2424,18 @@ tmp_pathconf(
 	return (error);
 }
 
+/*
+ * Asynchronous I/O.  tmpfs never waits for a device, so a request is
+ * simply carried out by the submitting thread and completed at once,
+ * rather than being handed to a libc worker thread.
+ */
+static int
+tmp_aio(struct vnode *vp, struct aio_req *aio, int rw, struct cred *cred,
+    caller_context_t *ct)
+{
+	return (aio_vnio_rw(vp, aio, rw, cred, ct));
+}
+
 
 const struct vnodeops tmp_vnodeops = {
 	.vnop_name = "tmpfs",
@@ -2458,4 +2471,5 @@ const struct vnodeops tmp_vnodeops = {
 	.vop_delmap = tmp_delmap,
 	.vop_pathconf = tmp_pathconf,
 	.vop_vnevent = fs_vnevent_support,
+	.vop_aio = tmp_aio,
 };
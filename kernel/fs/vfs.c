@@ -518,6 +518,9 @@ krwlock_t vfssw_lock;	/* lock accesses to vfssw */
  * Lock for accessing the vfs linked list.  Initialized in vfs_mountroot(),
  * but otherwise should be accessed only via vfs_list_lock() and
  * vfs_list_unlock().  Also used to protect the timestamp for mods to the list.
+ * Mount option and resource lookups and the searches by device read it on
+ * every CPU, while only mounts and unmounts write it, so it is an RW_PERCPU
+ * lock.
  */
 static krwlock_t vfslist;
 
@@ -717,7 +720,7 @@ vfs_mountroot(void)
 	proc_t		*p;
 
 	rw_init(&vfssw_lock, NULL, RW_DEFAULT, NULL);
-	rw_init(&vfslist, NULL, RW_DEFAULT, NULL);
+	rw_init(&vfslist, NULL, RW_PERCPU, NULL);
 
 	/*
 	 * Alloc the vfs hash bucket array and locks
@@ -389,6 +389,8 @@ create_vopstats_template()
 	kstat_named_init(&vsp->nreqzcbuf, "nreqzcbuf", KSTAT_DATA_UINT64);
 	/* fop_retzcbuf */
 	kstat_named_init(&vsp->nretzcbuf, "nretzcbuf", KSTAT_DATA_UINT64);
+	/* fop_aio */
+	kstat_named_init(&vsp->naio, "naio", KSTAT_DATA_UINT64);
 
 	return (vsp);
 }
@@ -4146,6 +4148,28 @@ fop_retzcbuf(vnode_t *vp, xuio_t *uiop, cred_t *cr, caller_context_t *ct)
 	return (err);
 }
 
+/*
+ * Start an asynchronous read (rw == FREAD) or write (FWRITE) of a regular
+ * file on behalf of kaio.  File systems that implement this complete the
+ * request with aio_vnio_done(); see <sys/aio_req.h>.  If an error is
+ * returned, the request was not started; ENOTSUP, for a request that can't
+ * be started without blocking, has libc carry it out in a thread of its own.
+ */
+int
+fop_aio(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cr,
+    caller_context_t *ct)
+{
+	int err;
+
+	if (vp->v_type != VREG)
+		return (ENOTSUP);
+
+	err = fop_aio_dispatch(vp, aio, rw, cr, ct, true);
+
+	VOPSTATS_UPDATE(vp, aio);
+	return (err);
+}
+
 /*
  * Default destructor
  *	Needed because NULL destructor means that the key is unused
@@ -4103,7 +4103,7 @@ arc_kmem_reap_soon(void)
 	kmem_cache_t		*prev_data_cache = NULL;
 	extern kmem_cache_t	*zio_buf_cache[];
 	extern kmem_cache_t	*zio_data_buf_cache[];
-	extern kmem_cache_t	*range_seg_cache;
+	extern kmem_cache_t	*zfs_btree_leaf_cache;
 	extern kmem_cache_t	*abd_chunk_cache;
 
 #ifdef _KERNEL
@@ -4136,7 +4136,7 @@ arc_kmem_reap_soon(void)
 	kmem_cache_reap_soon(buf_cache);
 	kmem_cache_reap_soon(hdr_full_cache);
 	kmem_cache_reap_soon(hdr_l2only_cache);
-	kmem_cache_reap_soon(range_seg_cache);
+	kmem_cache_reap_soon(zfs_btree_leaf_cache);
 
 	if (zio_arena != NULL) {
 		/*
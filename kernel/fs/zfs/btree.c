@@ -0,0 +1,774 @@
+/*
+ * CDDL HEADER START
+ *
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright (c) 2019 by Delphix. All rights reserved.
+ */
+
+#include	<sys/btree.h>
+#include	<sys/zfs_context.h>
+
+kmem_cache_t *zfs_btree_leaf_cache;
+
+/*
+ * Control the extent of the verification that occurs when zfs_btree_verify is
+ * called. Primarily used for debugging when extending the btree logic and
+ * functionality.
+ */
+#ifdef ZFS_DEBUG
+int zfs_btree_verify_intensity = 1;
+#else
+int zfs_btree_verify_intensity = 0;
+#endif
+
+#define	BTREE_CORE_SIZE(tree)	\
+	(offsetof(zfs_btree_core_t, btc_elems) + \
+	BTREE_CORE_ELEMS * (tree)->bt_elem_size)
+
+void
+zfs_btree_init(void)
+{
+	zfs_btree_leaf_cache = kmem_cache_create("zfs_btree_leaf_cache",
+	    BTREE_LEAF_SIZE, 0, NULL, NULL, NULL, NULL, NULL, 0);
+}
+
+void
+zfs_btree_fini(void)
+{
+	kmem_cache_destroy(zfs_btree_leaf_cache);
+}
+
+void
+zfs_btree_create(zfs_btree_t *tree, int (*compar) (const void *, const void *),
+    size_t size)
+{
+	ASSERT3U(size, <=, BTREE_MAX_ELEM_SIZE);
+
+	bzero(tree, sizeof (*tree));
+	tree->bt_compar = compar;
+	tree->bt_elem_size = size;
+	tree->bt_leaf_cap = (BTREE_LEAF_SIZE -
+	    offsetof(zfs_btree_leaf_t, btl_elems)) / size;
+	tree->bt_height = -1;
+}
+
+/*
+ * Return the address of the element at the given offset in a node.
+ */
+static inline uint8_t *
+zfs_btree_elem(zfs_btree_t *tree, zfs_btree_hdr_t *hdr, uint32_t idx)
+{
+	if (hdr->bth_core) {
+		return (((zfs_btree_core_t *)hdr)->btc_elems +
+		    idx * tree->bt_elem_size);
+	}
+	return (((zfs_btree_leaf_t *)hdr)->btl_elems +
+	    idx * tree->bt_elem_size);
+}
+
+static inline uint32_t
+zfs_btree_cap(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	return (hdr->bth_core ? BTREE_CORE_ELEMS : tree->bt_leaf_cap);
+}
+
+static zfs_btree_hdr_t *
+zfs_btree_node_alloc(zfs_btree_t *tree, boolean_t core)
+{
+	zfs_btree_hdr_t *hdr;
+
+	if (core) {
+		hdr = kmem_alloc(BTREE_CORE_SIZE(tree), KM_SLEEP);
+		tree->bt_num_cores++;
+	} else {
+		hdr = kmem_cache_alloc(zfs_btree_leaf_cache, KM_SLEEP);
+		tree->bt_num_leaves++;
+	}
+	hdr->bth_parent = NULL;
+	hdr->bth_core = core;
+	hdr->bth_count = 0;
+	return (hdr);
+}
+
+static void
+zfs_btree_node_free(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	if (hdr->bth_core) {
+		kmem_free(hdr, BTREE_CORE_SIZE(tree));
+		tree->bt_num_cores--;
+	} else {
+		kmem_cache_free(zfs_btree_leaf_cache, hdr);
+		tree->bt_num_leaves--;
+	}
+}
+
+/*
+ * Find the slot of a child in its parent's array of children.
+ */
+static uint32_t
+zfs_btree_child_idx(zfs_btree_hdr_t *hdr)
+{
+	zfs_btree_core_t *parent = hdr->bth_parent;
+	uint32_t i;
+
+	for (i = 0; i <= parent->btc_hdr.bth_count; i++) {
+		if (parent->btc_children[i] == hdr)
+			return (i);
+	}
+	panic("btree node %p not found in its parent %p", (void *)hdr,
+	    (void *)parent);
+	/* NOTREACHED */
+	return (0);
+}
+
+/*
+ * Binary search a node for the value. Returns the matching element, or NULL
+ * with *idx set to the slot (or child) the value would occupy.
+ */
+static void *
+zfs_btree_find_in_node(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    const void *value, uint32_t *idx)
+{
+	uint32_t min = 0, max = hdr->bth_count;
+
+	while (min < max) {
+		uint32_t mid = min + (max - min) / 2;
+		uint8_t *cur = zfs_btree_elem(tree, hdr, mid);
+		int comp = tree->bt_compar(cur, value);
+
+		if (comp < 0) {
+			min = mid + 1;
+		} else if (comp > 0) {
+			max = mid;
+		} else {
+			*idx = mid;
+			return (cur);
+		}
+	}
+	*idx = min;
+	return (NULL);
+}
+
+void *
+zfs_btree_find(zfs_btree_t *tree, const void *value, zfs_btree_index_t *where)
+{
+	zfs_btree_hdr_t *hdr = tree->bt_root;
+	uint32_t idx = 0;
+
+	if (hdr == NULL) {
+		if (where != NULL) {
+			where->bti_node = NULL;
+			where->bti_offset = 0;
+			where->bti_before = B_TRUE;
+		}
+		return (NULL);
+	}
+
+	for (;;) {
+		void *elem = zfs_btree_find_in_node(tree, hdr, value, &idx);
+
+		if (elem != NULL) {
+			if (where != NULL) {
+				where->bti_node = hdr;
+				where->bti_offset = idx;
+				where->bti_before = B_FALSE;
+			}
+			return (elem);
+		}
+		if (!hdr->bth_core)
+			break;
+		hdr = ((zfs_btree_core_t *)hdr)->btc_children[idx];
+	}
+
+	if (where != NULL) {
+		where->bti_node = hdr;
+		where->bti_offset = idx;
+		where->bti_before = B_TRUE;
+	}
+	return (NULL);
+}
+
+/*
+ * Make room for one element at idx in a node that isn't full. For core
+ * nodes the children after idx move along with the elements, leaving
+ * child slot idx + 1 free.
+ */
+static void
+zfs_btree_node_open(zfs_btree_t *tree, zfs_btree_hdr_t *hdr, uint32_t idx)
+{
+	size_t size = tree->bt_elem_size;
+
+	ASSERT3U(hdr->bth_count, <, zfs_btree_cap(tree, hdr));
+	memmove(zfs_btree_elem(tree, hdr, idx + 1),
+	    zfs_btree_elem(tree, hdr, idx), (hdr->bth_count - idx) * size);
+	if (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+		memmove(&core->btc_children[idx + 2],
+		    &core->btc_children[idx + 1],
+		    (hdr->bth_count - idx) * sizeof (zfs_btree_hdr_t *));
+	}
+	hdr->bth_count++;
+}
+
+/*
+ * Remove the element at idx from a node. For core nodes child slot idx + 1
+ * is removed with it.
+ */
+static void
+zfs_btree_node_close(zfs_btree_t *tree, zfs_btree_hdr_t *hdr, uint32_t idx)
+{
+	size_t size = tree->bt_elem_size;
+
+	ASSERT3U(idx, <, hdr->bth_count);
+	hdr->bth_count--;
+	memmove(zfs_btree_elem(tree, hdr, idx),
+	    zfs_btree_elem(tree, hdr, idx + 1), (hdr->bth_count - idx) * size);
+	if (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+		memmove(&core->btc_children[idx + 1],
+		    &core->btc_children[idx + 2],
+		    (hdr->bth_count - idx) * sizeof (zfs_btree_hdr_t *));
+	}
+}
+
+static void
+zfs_btree_set_child(zfs_btree_core_t *core, uint32_t idx,
+    zfs_btree_hdr_t *child)
+{
+	core->btc_children[idx] = child;
+	child->bth_parent = core;
+}
+
+/*
+ * Insert value at position idx of a node, and (for core nodes) the new child
+ * to its right. A full node is split in two around its median element, and
+ * the median and the new right half are then inserted into the parent.
+ */
+static void
+zfs_btree_insert_into_node(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    uint32_t idx, const void *value, zfs_btree_hdr_t *new_child)
+{
+	size_t size = tree->bt_elem_size;
+	uint32_t cap = zfs_btree_cap(tree, hdr);
+	zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+	zfs_btree_hdr_t *right;
+	uint8_t *median;
+	uint32_t mid, i;
+
+	ASSERT3U(idx, <=, hdr->bth_count);
+	ASSERT3U(hdr->bth_core, ==, (new_child != NULL));
+
+	if (hdr->bth_count < cap) {
+		zfs_btree_node_open(tree, hdr, idx);
+		bcopy(value, zfs_btree_elem(tree, hdr, idx), size);
+		if (new_child != NULL)
+			zfs_btree_set_child(core, idx + 1, new_child);
+		return;
+	}
+
+	/*
+	 * Split. Conceptually the node's cap elements plus the new one form
+	 * a sequence of cap + 1 elements (and cap + 2 children). The first
+	 * mid stay in this node, element mid moves up to the parent, and
+	 * the rest go into the new right sibling.
+	 */
+	mid = (cap + 1) / 2;
+	right = zfs_btree_node_alloc(tree, hdr->bth_core);
+	median = kmem_alloc(size, KM_SLEEP);
+
+#define	SEQ_ELEM(j)	((j) < idx ? zfs_btree_elem(tree, hdr, j) : \
+	(j) == idx ? (const uint8_t *)value : \
+	zfs_btree_elem(tree, hdr, (j) - 1))
+#define	SEQ_CHILD(j)	((j) <= idx ? core->btc_children[(j)] : \
+	(j) == idx + 1 ? new_child : core->btc_children[(j) - 1])
+
+	for (i = mid + 1; i <= cap; i++) {
+		bcopy(SEQ_ELEM(i), zfs_btree_elem(tree, right,
+		    right->bth_count), size);
+		right->bth_count++;
+	}
+	if (hdr->bth_core) {
+		zfs_btree_core_t *rcore = (zfs_btree_core_t *)right;
+		for (i = mid + 1; i <= cap + 1; i++)
+			zfs_btree_set_child(rcore, i - mid - 1, SEQ_CHILD(i));
+	}
+	bcopy(SEQ_ELEM(mid), median, size);
+
+#undef	SEQ_ELEM
+#undef	SEQ_CHILD
+
+	/*
+	 * Everything from the right half has been copied out, so the left
+	 * half can be rearranged in place.
+	 */
+	if (idx < mid) {
+		memmove(zfs_btree_elem(tree, hdr, idx + 1),
+		    zfs_btree_elem(tree, hdr, idx), (mid - idx - 1) * size);
+		bcopy(value, zfs_btree_elem(tree, hdr, idx), size);
+		if (hdr->bth_core) {
+			memmove(&core->btc_children[idx + 2],
+			    &core->btc_children[idx + 1],
+			    (mid - idx - 1) * sizeof (zfs_btree_hdr_t *));
+			zfs_btree_set_child(core, idx + 1, new_child);
+		}
+	}
+	hdr->bth_count = mid;
+
+	if (hdr->bth_parent == NULL) {
+		zfs_btree_core_t *root;
+
+		ASSERT3P(tree->bt_root, ==, hdr);
+		root = (zfs_btree_core_t *)zfs_btree_node_alloc(tree, B_TRUE);
+		bcopy(median, root->btc_elems, size);
+		root->btc_hdr.bth_count = 1;
+		zfs_btree_set_child(root, 0, hdr);
+		zfs_btree_set_child(root, 1, right);
+		tree->bt_root = &root->btc_hdr;
+		tree->bt_height++;
+	} else {
+		zfs_btree_insert_into_node(tree, &hdr->bth_parent->btc_hdr,
+		    zfs_btree_child_idx(hdr), median, right);
+	}
+	kmem_free(median, size);
+}
+
+void
+zfs_btree_add_idx(zfs_btree_t *tree, const void *value,
+    const zfs_btree_index_t *where)
+{
+	if (tree->bt_root == NULL) {
+		ASSERT3P(where->bti_node, ==, NULL);
+		tree->bt_root = zfs_btree_node_alloc(tree, B_FALSE);
+		tree->bt_height = 0;
+		bcopy(value, zfs_btree_elem(tree, tree->bt_root, 0),
+		    tree->bt_elem_size);
+		tree->bt_root->bth_count = 1;
+	} else {
+		ASSERT(where->bti_before);
+		ASSERT(!where->bti_node->bth_core);
+		zfs_btree_insert_into_node(tree, where->bti_node,
+		    where->bti_offset, value, NULL);
+	}
+	tree->bt_num_elems++;
+}
+
+void
+zfs_btree_add(zfs_btree_t *tree, const void *value)
+{
+	zfs_btree_index_t where;
+
+	VERIFY3P(zfs_btree_find(tree, value, &where), ==, NULL);
+	zfs_btree_add_idx(tree, value, &where);
+}
+
+/*
+ * Descend to the first or last element of the subtree rooted at hdr.
+ */
+static void *
+zfs_btree_subtree_first(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    zfs_btree_index_t *idx)
+{
+	while (hdr->bth_core)
+		hdr = ((zfs_btree_core_t *)hdr)->btc_children[0];
+
+	ASSERT3U(hdr->bth_count, >, 0);
+	if (idx != NULL) {
+		idx->bti_node = hdr;
+		idx->bti_offset = 0;
+		idx->bti_before = B_FALSE;
+	}
+	return (zfs_btree_elem(tree, hdr, 0));
+}
+
+static void *
+zfs_btree_subtree_last(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    zfs_btree_index_t *idx)
+{
+	while (hdr->bth_core) {
+		hdr = ((zfs_btree_core_t *)hdr)->btc_children[
+		    hdr->bth_count];
+	}
+
+	ASSERT3U(hdr->bth_count, >, 0);
+	if (idx != NULL) {
+		idx->bti_node = hdr;
+		idx->bti_offset = hdr->bth_count - 1;
+		idx->bti_before = B_FALSE;
+	}
+	return (zfs_btree_elem(tree, hdr, hdr->bth_count - 1));
+}
+
+void *
+zfs_btree_first(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	if (tree->bt_root == NULL)
+		return (NULL);
+	return (zfs_btree_subtree_first(tree, tree->bt_root, where));
+}
+
+void *
+zfs_btree_last(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	if (tree->bt_root == NULL)
+		return (NULL);
+	return (zfs_btree_subtree_last(tree, tree->bt_root, where));
+}
+
+void *
+zfs_btree_next(zfs_btree_t *tree, const zfs_btree_index_t *idx,
+    zfs_btree_index_t *out_idx)
+{
+	zfs_btree_hdr_t *hdr = idx->bti_node;
+	uint32_t offset = idx->bti_offset;
+
+	if (hdr == NULL)
+		return (NULL);
+
+	if (!idx->bti_before) {
+		if (hdr->bth_core) {
+			return (zfs_btree_subtree_first(tree,
+			    ((zfs_btree_core_t *)hdr)->btc_children[offset + 1],
+			    out_idx));
+		}
+		offset++;
+	}
+
+	/*
+	 * We're at a position in a leaf. If it's past the end of the leaf,
+	 * the next element is the separator to the right of the first
+	 * ancestor we aren't the last child of.
+	 */
+	ASSERT(!hdr->bth_core);
+	while (offset == hdr->bth_count) {
+		if (hdr->bth_parent == NULL)
+			return (NULL);
+		offset = zfs_btree_child_idx(hdr);
+		hdr = &hdr->bth_parent->btc_hdr;
+	}
+
+	out_idx->bti_node = hdr;
+	out_idx->bti_offset = offset;
+	out_idx->bti_before = B_FALSE;
+	return (zfs_btree_elem(tree, hdr, offset));
+}
+
+void *
+zfs_btree_prev(zfs_btree_t *tree, const zfs_btree_index_t *idx,
+    zfs_btree_index_t *out_idx)
+{
+	zfs_btree_hdr_t *hdr = idx->bti_node;
+	uint32_t offset = idx->bti_offset;
+
+	if (hdr == NULL)
+		return (NULL);
+
+	if (!idx->bti_before && hdr->bth_core) {
+		return (zfs_btree_subtree_last(tree,
+		    ((zfs_btree_core_t *)hdr)->btc_children[offset], out_idx));
+	}
+
+	/*
+	 * Both an element in a leaf and a position before it are preceded by
+	 * the element to the left in the leaf, or failing that the separator
+	 * to the left of the first ancestor we aren't the first child of.
+	 */
+	ASSERT(!hdr->bth_core);
+	while (offset == 0) {
+		if (hdr->bth_parent == NULL)
+			return (NULL);
+		offset = zfs_btree_child_idx(hdr);
+		hdr = &hdr->bth_parent->btc_hdr;
+	}
+
+	out_idx->bti_node = hdr;
+	out_idx->bti_offset = offset - 1;
+	out_idx->bti_before = B_FALSE;
+	return (zfs_btree_elem(tree, hdr, offset - 1));
+}
+
+void *
+zfs_btree_get(zfs_btree_t *tree, zfs_btree_index_t *idx)
+{
+	ASSERT(!idx->bti_before);
+	ASSERT3U(idx->bti_offset, <, idx->bti_node->bth_count);
+	return (zfs_btree_elem(tree, idx->bti_node, idx->bti_offset));
+}
+
+/*
+ * A node other than the root has dropped below half full. Take an element
+ * from a sibling that can spare one, or else merge with a sibling.
+ */
+static void
+zfs_btree_rebalance(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	size_t size = tree->bt_elem_size;
+	uint32_t min = zfs_btree_cap(tree, hdr) / 2;
+	zfs_btree_core_t *parent = hdr->bth_parent;
+	zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+	zfs_btree_hdr_t *left, *right;
+	uint32_t c;
+
+	if (parent == NULL) {
+		ASSERT3P(tree->bt_root, ==, hdr);
+		if (hdr->bth_count > 0)
+			return;
+		/*
+		 * The root has run out of elements. A core root is replaced
+		 * by its only child; an empty leaf root empties the tree.
+		 */
+		if (hdr->bth_core) {
+			tree->bt_root = core->btc_children[0];
+			tree->bt_root->bth_parent = NULL;
+		} else {
+			tree->bt_root = NULL;
+		}
+		tree->bt_height--;
+		zfs_btree_node_free(tree, hdr);
+		return;
+	}
+
+	if (hdr->bth_count >= min)
+		return;
+
+	c = zfs_btree_child_idx(hdr);
+	left = c > 0 ? parent->btc_children[c - 1] : NULL;
+	right = c < parent->btc_hdr.bth_count ?
+	    parent->btc_children[c + 1] : NULL;
+
+	if (left != NULL && left->bth_count > min) {
+		/*
+		 * Rotate right: the separator comes down to the front of
+		 * this node and the left sibling's last element replaces it.
+		 */
+		zfs_btree_core_t *lcore = (zfs_btree_core_t *)left;
+
+		memmove(zfs_btree_elem(tree, hdr, 1),
+		    zfs_btree_elem(tree, hdr, 0), hdr->bth_count * size);
+		bcopy(zfs_btree_elem(tree, &parent->btc_hdr, c - 1),
+		    zfs_btree_elem(tree, hdr, 0), size);
+		bcopy(zfs_btree_elem(tree, left, left->bth_count - 1),
+		    zfs_btree_elem(tree, &parent->btc_hdr, c - 1), size);
+		if (hdr->bth_core) {
+			memmove(&core->btc_children[1], &core->btc_children[0],
+			    (hdr->bth_count + 1) * sizeof (zfs_btree_hdr_t *));
+			zfs_btree_set_child(core, 0,
+			    lcore->btc_children[left->bth_count]);
+		}
+		hdr->bth_count++;
+		left->bth_count--;
+		return;
+	}
+
+	if (right != NULL && right->bth_count > min) {
+		/*
+		 * Rotate left: the separator comes down to the end of this
+		 * node and the right sibling's first element replaces it.
+		 */
+		zfs_btree_core_t *rcore = (zfs_btree_core_t *)right;
+
+		bcopy(zfs_btree_elem(tree, &parent->btc_hdr, c),
+		    zfs_btree_elem(tree, hdr, hdr->bth_count), size);
+		bcopy(zfs_btree_elem(tree, right, 0),
+		    zfs_btree_elem(tree, &parent->btc_hdr, c), size);
+		memmove(zfs_btree_elem(tree, right, 0),
+		    zfs_btree_elem(tree, right, 1),
+		    (right->bth_count - 1) * size);
+		if (hdr->bth_core) {
+			zfs_btree_set_child(core, hdr->bth_count + 1,
+			    rcore->btc_children[0]);
+			memmove(&rcore->btc_children[0],
+			    &rcore->btc_children[1],
+			    right->bth_count * sizeof (zfs_btree_hdr_t *));
+		}
+		hdr->bth_count++;
+		right->bth_count--;
+		return;
+	}
+
+	/*
+	 * Neither sibling can spare an element, so merge with one of them:
+	 * the separator and the right node's contents are appended to the
+	 * left node, and the right node is freed.
+	 */
+	if (left == NULL) {
+		left = hdr;
+	} else {
+		right = hdr;
+		c--;
+	}
+	ASSERT3P(right, !=, NULL);
+	ASSERT3U(left->bth_count + right->bth_count + 1, <=,
+	    zfs_btree_cap(tree, left));
+
+	bcopy(zfs_btree_elem(tree, &parent->btc_hdr, c),
+	    zfs_btree_elem(tree, left, left->bth_count), size);
+	bcopy(zfs_btree_elem(tree, right, 0),
+	    zfs_btree_elem(tree, left, left->bth_count + 1),
+	    right->bth_count * size);
+	if (left->bth_core) {
+		zfs_btree_core_t *lcore = (zfs_btree_core_t *)left;
+		zfs_btree_core_t *rcore = (zfs_btree_core_t *)right;
+		uint32_t i;
+
+		for (i = 0; i <= right->bth_count; i++) {
+			zfs_btree_set_child(lcore, left->bth_count + 1 + i,
+			    rcore->btc_children[i]);
+		}
+	}
+	left->bth_count += right->bth_count + 1;
+	zfs_btree_node_free(tree, right);
+
+	zfs_btree_node_close(tree, &parent->btc_hdr, c);
+	zfs_btree_rebalance(tree, &parent->btc_hdr);
+}
+
+void
+zfs_btree_remove_idx(zfs_btree_t *tree, zfs_btree_index_t *where)
+{
+	zfs_btree_hdr_t *hdr = where->bti_node;
+	uint32_t idx = where->bti_offset;
+
+	ASSERT(!where->bti_before);
+	ASSERT3U(idx, <, hdr->bth_count);
+
+	if (hdr->bth_core) {
+		/*
+		 * Replace the element with its predecessor, which is always
+		 * the last element of a leaf, and remove that instead.
+		 */
+		zfs_btree_index_t pred;
+		void *elem = zfs_btree_subtree_last(tree,
+		    ((zfs_btree_core_t *)hdr)->btc_children[idx], &pred);
+
+		bcopy(elem, zfs_btree_elem(tree, hdr, idx), tree->bt_elem_size);
+		hdr = pred.bti_node;
+		idx = pred.bti_offset;
+	}
+
+	zfs_btree_node_close(tree, hdr, idx);
+	tree->bt_num_elems--;
+	zfs_btree_rebalance(tree, hdr);
+}
+
+void
+zfs_btree_remove(zfs_btree_t *tree, const void *value)
+{
+	zfs_btree_index_t where;
+
+	VERIFY3P(zfs_btree_find(tree, value, &where), !=, NULL);
+	zfs_btree_remove_idx(tree, &where);
+}
+
+ulong_t
+zfs_btree_numnodes(zfs_btree_t *tree)
+{
+	return (tree->bt_num_elems);
+}
+
+size_t
+zfs_btree_memory(zfs_btree_t *tree)
+{
+	return (tree->bt_num_leaves * BTREE_LEAF_SIZE +
+	    tree->bt_num_cores * BTREE_CORE_SIZE(tree));
+}
+
+static void
+zfs_btree_clear_helper(zfs_btree_t *tree, zfs_btree_hdr_t *hdr)
+{
+	if (hdr->bth_core) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+		for (uint32_t i = 0; i <= hdr->bth_count; i++)
+			zfs_btree_clear_helper(tree, core->btc_children[i]);
+	}
+	zfs_btree_node_free(tree, hdr);
+}
+
+void
+zfs_btree_clear(zfs_btree_t *tree)
+{
+	if (tree->bt_root != NULL)
+		zfs_btree_clear_helper(tree, tree->bt_root);
+	ASSERT0(tree->bt_num_leaves);
+	ASSERT0(tree->bt_num_cores);
+	tree->bt_root = NULL;
+	tree->bt_height = -1;
+	tree->bt_num_elems = 0;
+}
+
+void
+zfs_btree_destroy(zfs_btree_t *tree)
+{
+	ASSERT0(tree->bt_num_elems);
+	ASSERT3P(tree->bt_root, ==, NULL);
+}
+
+/*
+ * Check the structure of a subtree: parent pointers, occupancy, uniform
+ * depth and ordering. Returns the number of elements in the subtree.
+ */
+static uint64_t
+zfs_btree_verify_helper(zfs_btree_t *tree, zfs_btree_hdr_t *hdr,
+    zfs_btree_core_t *parent, int64_t height, const void *lo, const void *hi)
+{
+	uint64_t count = hdr->bth_count;
+	uint32_t i;
+
+	VERIFY3P(hdr->bth_parent, ==, parent);
+	VERIFY3U(hdr->bth_count, <=, zfs_btree_cap(tree, hdr));
+	if (parent != NULL)
+		VERIFY3U(hdr->bth_count, >=, zfs_btree_cap(tree, hdr) / 2);
+	VERIFY3S(height == 0, ==, !hdr->bth_core);
+
+	for (i = 0; i < hdr->bth_count; i++) {
+		uint8_t *elem = zfs_btree_elem(tree, hdr, i);
+		const void *prev = i == 0 ? lo :
+		    zfs_btree_elem(tree, hdr, i - 1);
+
+		if (prev != NULL)
+			VERIFY3S(tree->bt_compar(prev, elem), <, 0);
+	}
+	if (hi != NULL && hdr->bth_count > 0) {
+		VERIFY3S(tree->bt_compar(zfs_btree_elem(tree, hdr,
+		    hdr->bth_count - 1), hi), <, 0);
+	}
+
+	if (hdr->bth_core && zfs_btree_verify_intensity > 0) {
+		zfs_btree_core_t *core = (zfs_btree_core_t *)hdr;
+
+		for (i = 0; i <= hdr->bth_count; i++) {
+			count += zfs_btree_verify_helper(tree,
+			    core->btc_children[i], core, height - 1,
+			    i == 0 ? lo : zfs_btree_elem(tree, hdr, i - 1),
+			    i == hdr->bth_count ? hi :
+			    zfs_btree_elem(tree, hdr, i));
+		}
+	}
+	return (count);
+}
+
+void
+zfs_btree_verify(zfs_btree_t *tree)
+{
+	uint64_t count;
+
+	if (tree->bt_root == NULL) {
+		VERIFY3S(tree->bt_height, ==, -1);
+		VERIFY0(tree->bt_num_elems);
+		return;
+	}
+	count = zfs_btree_verify_helper(tree, tree->bt_root, NULL,
+	    tree->bt_height, NULL, NULL);
+	if (zfs_btree_verify_intensity > 0 || tree->bt_height == 0)
+		VERIFY3U(count, ==, tree->bt_num_elems);
+}
@@ -60,6 +60,9 @@ typedef enum spa_feature {
 	SPA_FEATURE_OBSOLETE_COUNTS,
 	SPA_FEATURE_POOL_CHECKPOINT,
 	SPA_FEATURE_SPACEMAP_V2,
+	SPA_FEATURE_RAIDZ_EXPANSION,
+	SPA_FEATURE_DRAID,
+	SPA_FEATURE_DEVICE_REBUILD,
 	SPA_FEATURES
 } spa_feature_t;
 
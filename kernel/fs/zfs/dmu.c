@@ -971,6 +971,177 @@ dmu_read_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size, void *buf,
 	return (dmu_read_impl(dn, offset, size, buf, flags));
 }
 
+/*
+ * Asynchronous reads.  The dbufs are held and reads issued for the
+ * uncached ones, as dmu_buf_hold_array_by_dnode() does, but rather than
+ * waiting for them the root zio's done callback hands the rest of the work
+ * (waiting out any read of the same block by someone else, and copying the
+ * data out) to dmu_read_async_taskq, since that can't be done from zio
+ * interrupt context.  If everything was already cached, the read is
+ * finished by the caller.
+ */
+typedef struct dmu_read_async {
+	dmu_buf_t		**dra_dbp;
+	int			dra_numbufs;
+	uint64_t		dra_offset;
+	uint64_t		dra_size;
+	void			*dra_buf;
+	int			dra_err;
+	dmu_read_done_func_t	*dra_done;
+	void			*dra_arg;
+	taskq_ent_t		dra_tqent;
+} dmu_read_async_t;
+
+static taskq_t *dmu_read_async_taskq;
+
+static void
+dmu_read_async_finish(void *arg)
+{
+	dmu_read_async_t *dra = arg;
+	uint64_t offset = dra->dra_offset;
+	uint64_t size = dra->dra_size;
+	char *buf = dra->dra_buf;
+	int err = dra->dra_err;
+
+	for (int i = 0; err == 0 && i < dra->dra_numbufs; i++) {
+		dmu_buf_impl_t *db = (dmu_buf_impl_t *)dra->dra_dbp[i];
+
+		mutex_enter(&db->db_mtx);
+		while (db->db_state == DB_READ || db->db_state == DB_FILL)
+			cv_wait(&db->db_changed, &db->db_mtx);
+		if (db->db_state == DB_UNCACHED)
+			err = SET_ERROR(EIO);
+		mutex_exit(&db->db_mtx);
+	}
+
+	for (int i = 0; err == 0 && i < dra->dra_numbufs; i++) {
+		dmu_buf_t *db = dra->dra_dbp[i];
+		uint64_t bufoff, tocpy;
+
+		ASSERT(size > 0);
+
+		bufoff = offset - db->db_offset;
+		tocpy = MIN(db->db_size - bufoff, size);
+
+		bcopy((char *)db->db_data + bufoff, buf, tocpy);
+
+		offset += tocpy;
+		size -= tocpy;
+		buf += tocpy;
+	}
+
+	dmu_buf_rele_array(dra->dra_dbp, dra->dra_numbufs, dra);
+	dra->dra_done(dra->dra_arg, err);
+	kmem_free(dra, sizeof (*dra));
+}
+
+static void
+dmu_read_async_done(zio_t *zio)
+{
+	dmu_read_async_t *dra = zio->io_private;
+
+	if (dra->dra_err == 0)
+		dra->dra_err = zio->io_error;
+	taskq_dispatch_ent(dmu_read_async_taskq, dmu_read_async_finish, dra,
+	    0, &dra->dra_tqent);
+}
+
+/*
+ * Read size bytes at offset into buf, then call done(arg, error), either
+ * from a taskq thread or, if no I/O was needed, before returning.  The
+ * read must fit in one dmu_buf_hold_array_by_dnode() call.  If an error
+ * is returned, done will not be called.
+ */
+int
+dmu_read_async_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size,
+    void *buf, dmu_read_done_func_t *done, void *arg, uint32_t flags)
+{
+	dmu_read_async_t *dra;
+	uint64_t blkid, nblks;
+	uint32_t dbuf_flags;
+	zio_t *zio = NULL;
+
+	if (size > DMU_MAX_ACCESS / 2)
+		return (SET_ERROR(EINVAL));
+
+	/*
+	 * Deal with odd block sizes, as dmu_read_impl() does.
+	 */
+	if (dn->dn_maxblkid == 0) {
+		uint64_t newsz = offset > dn->dn_datablksz ? 0 :
+		    MIN(size, dn->dn_datablksz - offset);
+		bzero((char *)buf + newsz, size - newsz);
+		size = newsz;
+	}
+
+	dra = kmem_zalloc(sizeof (*dra), KM_SLEEP);
+	dra->dra_offset = offset;
+	dra->dra_size = size;
+	dra->dra_buf = buf;
+	dra->dra_done = done;
+	dra->dra_arg = arg;
+
+	if (size == 0) {
+		dmu_read_async_finish(dra);
+		return (0);
+	}
+
+	dbuf_flags = DB_RF_CANFAIL | DB_RF_NEVERWAIT | DB_RF_HAVESTRUCT |
+	    DB_RF_NOPREFETCH;
+
+	rw_enter(&dn->dn_struct_rwlock, RW_READER);
+	if (dn->dn_datablkshift) {
+		int blkshift = dn->dn_datablkshift;
+		nblks = (P2ROUNDUP(offset + size, 1ULL << blkshift) -
+		    P2ALIGN(offset, 1ULL << blkshift)) >> blkshift;
+	} else {
+		nblks = 1;
+	}
+	dra->dra_dbp = kmem_zalloc(sizeof (dmu_buf_t *) * nblks, KM_SLEEP);
+	dra->dra_numbufs = nblks;
+
+	blkid = dbuf_whichblock(dn, 0, offset);
+	for (uint64_t i = 0; i < nblks; i++) {
+		dmu_buf_impl_t *db = dbuf_hold(dn, blkid + i, dra);
+		boolean_t cached;
+
+		if (db == NULL) {
+			/*
+			 * Reported through done once any reads already
+			 * issued have finished.
+			 */
+			dra->dra_err = SET_ERROR(EIO);
+			break;
+		}
+		dra->dra_dbp[i] = &db->db;
+
+		mutex_enter(&db->db_mtx);
+		cached = (db->db_state == DB_CACHED);
+		mutex_exit(&db->db_mtx);
+		if (cached)
+			continue;
+
+		if (zio == NULL) {
+			zio = zio_root(dn->dn_objset->os_spa,
+			    dmu_read_async_done, dra, ZIO_FLAG_CANFAIL);
+		}
+		(void) dbuf_read(db, zio, dbuf_flags);
+	}
+
+	if ((flags & DMU_READ_NO_PREFETCH) == 0 &&
+	    DNODE_META_IS_CACHEABLE(dn) && size <= zfetch_array_rd_sz) {
+		dmu_zfetch(&dn->dn_zfetch, blkid, nblks,
+		    DNODE_IS_CACHEABLE(dn));
+	}
+	rw_exit(&dn->dn_struct_rwlock);
+
+	if (zio != NULL)
+		zio_nowait(zio);
+	else
+		dmu_read_async_finish(dra);
+	return (0);
+}
+
 static void
 dmu_write_impl(dmu_buf_t **dbp, int numbufs, uint64_t offset, uint64_t size,
     const void *buf, dmu_tx_t *tx)
@@ -2390,11 +2561,14 @@ dmu_init(void)
 	l2arc_init();
 	arc_init();
 	dbuf_init();
+	dmu_read_async_taskq = taskq_create("dmu_read_async", boot_ncpus,
+	    minclsyspri, boot_ncpus, INT_MAX, TASKQ_PREPOPULATE);
 }
 
 void
 dmu_fini(void)
 {
+	taskq_destroy(dmu_read_async_taskq);
 	arc_fini(); /* arc depends on l2arc, so arc must go first */
 	l2arc_fini();
 	zfetch_fini();
@@ -31,6 +31,7 @@
 #include <sys/space_map.h>
 #include <sys/metaslab_impl.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_draid.h>
 #include <sys/zio.h>
 #include <sys/spa_impl.h>
 #include <sys/zfeature.h>
@@ -1092,14 +1093,38 @@ metaslab_group_allocatable(metaslab_group_t *mg, metaslab_group_t *rotor,
  */
 
 /*
- * Comparison function for the private size-ordered tree. Tree is sorted
- * by size, larger sizes at the end of the tree.
+ * Comparison functions for the private size-ordered tree. Tree is sorted
+ * by size, larger sizes at the end of the tree. There is one for each
+ * range_seg_type_t; comparing the raw, possibly shifted, values gives the
+ * same order as comparing the offsets they stand for.
  */
 static int
-metaslab_rangesize_compare(const void *x1, const void *x2)
+metaslab_rangesize32_compare(const void *x1, const void *x2)
 {
-	const range_seg_t *r1 = x1;
-	const range_seg_t *r2 = x2;
+	const range_seg32_t *r1 = x1;
+	const range_seg32_t *r2 = x2;
+	uint64_t rs_size1 = r1->rs_end - r1->rs_start;
+	uint64_t rs_size2 = r2->rs_end - r2->rs_start;
+
+	if (rs_size1 < rs_size2)
+		return (-1);
+	if (rs_size1 > rs_size2)
+		return (1);
+
+	if (r1->rs_start < r2->rs_start)
+		return (-1);
+
+	if (r1->rs_start > r2->rs_start)
+		return (1);
+
+	return (0);
+}
+
+static int
+metaslab_rangesize64_compare(const void *x1, const void *x2)
+{
+	const range_seg64_t *r1 = x1;
+	const range_seg64_t *r2 = x2;
 	uint64_t rs_size1 = r1->rs_end - r1->rs_start;
 	uint64_t rs_size2 = r2->rs_end - r2->rs_start;
 
@@ -1129,8 +1154,13 @@ metaslab_rt_create(range_tree_t *rt, void *arg)
 	ASSERT3P(rt->rt_arg, ==, msp);
 	ASSERT(msp->ms_allocatable == NULL);
 
-	avl_create(&msp->ms_allocatable_by_size, metaslab_rangesize_compare,
-	    sizeof (range_seg_t), offsetof(range_seg_t, rs_pp_node));
+	if (rt->rt_type == RANGE_SEG32) {
+		zfs_btree_create(&msp->ms_allocatable_by_size,
+		    metaslab_rangesize32_compare, sizeof (range_seg32_t));
+	} else {
+		zfs_btree_create(&msp->ms_allocatable_by_size,
+		    metaslab_rangesize64_compare, sizeof (range_seg64_t));
+	}
 }
 
 /*
@@ -1143,9 +1173,9 @@ metaslab_rt_destroy(range_tree_t *rt, void *arg)
 
 	ASSERT3P(rt->rt_arg, ==, msp);
 	ASSERT3P(msp->ms_allocatable, ==, rt);
-	ASSERT0(avl_numnodes(&msp->ms_allocatable_by_size));
+	ASSERT0(zfs_btree_numnodes(&msp->ms_allocatable_by_size));
 
-	avl_destroy(&msp->ms_allocatable_by_size);
+	zfs_btree_destroy(&msp->ms_allocatable_by_size);
 }
 
 static void
@@ -1156,7 +1186,7 @@ metaslab_rt_add(range_tree_t *rt, range_seg_t *rs, void *arg)
 	ASSERT3P(rt->rt_arg, ==, msp);
 	ASSERT3P(msp->ms_allocatable, ==, rt);
 	VERIFY(!msp->ms_condensing);
-	avl_add(&msp->ms_allocatable_by_size, rs);
+	zfs_btree_add(&msp->ms_allocatable_by_size, rs);
 }
 
 static void
@@ -1167,7 +1197,7 @@ metaslab_rt_remove(range_tree_t *rt, range_seg_t *rs, void *arg)
 	ASSERT3P(rt->rt_arg, ==, msp);
 	ASSERT3P(msp->ms_allocatable, ==, rt);
 	VERIFY(!msp->ms_condensing);
-	avl_remove(&msp->ms_allocatable_by_size, rs);
+	zfs_btree_remove(&msp->ms_allocatable_by_size, rs);
 }
 
 static void
@@ -1178,14 +1208,7 @@ metaslab_rt_vacate(range_tree_t *rt, void *arg)
 	ASSERT3P(rt->rt_arg, ==, msp);
 	ASSERT3P(msp->ms_allocatable, ==, rt);
 
-	/*
-	 * Normally one would walk the tree freeing nodes along the way.
-	 * Since the nodes are shared with the range trees we can avoid
-	 * walking all nodes and just reinitialize the avl tree. The nodes
-	 * will be freed by the range tree, so we don't want to free them here.
-	 */
-	avl_create(&msp->ms_allocatable_by_size, metaslab_rangesize_compare,
-	    sizeof (range_seg_t), offsetof(range_seg_t, rs_pp_node));
+	zfs_btree_clear(&msp->ms_allocatable_by_size);
 }
 
 static range_tree_ops_t metaslab_rt_ops = {
@@ -1208,51 +1231,59 @@ static range_tree_ops_t metaslab_rt_ops = {
 uint64_t
 metaslab_block_maxsize(metaslab_t *msp)
 {
-	avl_tree_t *t = &msp->ms_allocatable_by_size;
+	zfs_btree_t *t = &msp->ms_allocatable_by_size;
 	range_seg_t *rs;
 
-	if (t == NULL || (rs = avl_last(t)) == NULL)
+	if (t == NULL || (rs = zfs_btree_last(t, NULL)) == NULL)
 		return (0ULL);
 
-	return (rs->rs_end - rs->rs_start);
+	return (rs_get_size(rs, msp->ms_allocatable));
 }
 
+/*
+ * Find the first segment at or after the given range in t, which is either
+ * the range tree rt or the size-ordered tree that mirrors it. Offsets
+ * before the start of the tree (such as a reset cursor) search from the
+ * beginning.
+ */
 static range_seg_t *
-metaslab_block_find(avl_tree_t *t, uint64_t start, uint64_t size)
+metaslab_block_find(zfs_btree_t *t, range_tree_t *rt, uint64_t start,
+    uint64_t size, zfs_btree_index_t *where)
 {
-	range_seg_t *rs, rsearch;
-	avl_index_t where;
+	range_seg_t *rs;
+	range_seg_max_t rsearch;
 
-	rsearch.rs_start = start;
-	rsearch.rs_end = start + size;
+	start = MAX(start, rt->rt_start);
+	rs_set_start(&rsearch, rt, start);
+	rs_set_end(&rsearch, rt, start + size);
 
-	rs = avl_find(t, &rsearch, &where);
-	if (rs == NULL) {
-		rs = avl_nearest(t, where, AVL_AFTER);
-	}
+	rs = zfs_btree_find(t, &rsearch, where);
+	if (rs == NULL)
+		rs = zfs_btree_next(t, where, where);
 
 	return (rs);
 }
 
 /*
  * This is a helper function that can be used by the allocator to find
- * a suitable block to allocate. This will search the specified AVL
- * tree looking for a block that matches the specified criteria.
+ * a suitable block to allocate. This will search the specified B-tree
+ * looking for a block that matches the specified criteria.
  */
 static uint64_t
-metaslab_block_picker(avl_tree_t *t, uint64_t *cursor, uint64_t size,
-    uint64_t align)
+metaslab_block_picker(range_tree_t *rt, zfs_btree_t *t, uint64_t *cursor,
+    uint64_t size, uint64_t align)
 {
-	range_seg_t *rs = metaslab_block_find(t, *cursor, size);
+	zfs_btree_index_t where;
+	range_seg_t *rs = metaslab_block_find(t, rt, *cursor, size, &where);
 
 	while (rs != NULL) {
-		uint64_t offset = P2ROUNDUP(rs->rs_start, align);
+		uint64_t offset = P2ROUNDUP(rs_get_start(rs, rt), align);
 
-		if (offset + size <= rs->rs_end) {
+		if (offset + size <= rs_get_end(rs, rt)) {
 			*cursor = offset + size;
 			return (offset);
 		}
-		rs = AVL_NEXT(t, rs);
+		rs = zfs_btree_next(t, &where, &where);
 	}
 
 	/*
@@ -1263,7 +1294,7 @@ metaslab_block_picker(avl_tree_t *t, uint64_t *cursor, uint64_t size,
 		return (-1ULL);
 
 	*cursor = 0;
-	return (metaslab_block_picker(t, cursor, size, align));
+	return (metaslab_block_picker(rt, t, cursor, size, align));
 }
 
 /*
@@ -1283,9 +1314,16 @@ metaslab_ff_alloc(metaslab_t *msp, uint64_t size)
 	 */
 	uint64_t align = size & -size;
 	uint64_t *cursor = &msp->ms_lbas[highbit64(align) - 1];
-	avl_tree_t *t = &msp->ms_allocatable->rt_root;
+	range_tree_t *rt = msp->ms_allocatable;
+
+	/*
+	 * dRAID blocks must start on a group-width boundary, which need not
+	 * be a power of 2; every free segment already does.
+	 */
+	if (msp->ms_group->mg_vd->vdev_ops == &vdev_draid_ops)
+		align = 1;
 
-	return (metaslab_block_picker(t, cursor, size, align));
+	return (metaslab_block_picker(rt, &rt->rt_root, cursor, size, align));
 }
 
 static metaslab_ops_t metaslab_ff_ops = {
@@ -1313,20 +1351,20 @@ metaslab_df_alloc(metaslab_t *msp, uint64_t size)
 	uint64_t align = size & -size;
 	uint64_t *cursor = &msp->ms_lbas[highbit64(align) - 1];
 	range_tree_t *rt = msp->ms_allocatable;
-	avl_tree_t *t = &rt->rt_root;
+	zfs_btree_t *t = &rt->rt_root;
 	uint64_t max_size = metaslab_block_maxsize(msp);
 	int free_pct = range_tree_space(rt) * 100 / msp->ms_size;
 
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
-	ASSERT3U(avl_numnodes(t), ==,
-	    avl_numnodes(&msp->ms_allocatable_by_size));
+	ASSERT3U(zfs_btree_numnodes(t), ==,
+	    zfs_btree_numnodes(&msp->ms_allocatable_by_size));
 
 	if (max_size < size)
 		return (-1ULL);
 
 	/*
 	 * If we're running low on space switch to using the size
-	 * sorted AVL tree (best-fit).
+	 * sorted B-tree (best-fit).
 	 */
 	if (max_size < metaslab_df_alloc_threshold ||
 	    free_pct < metaslab_df_free_pct) {
@@ -1334,7 +1372,7 @@ metaslab_df_alloc(metaslab_t *msp, uint64_t size)
 		*cursor = 0;
 	}
 
-	return (metaslab_block_picker(t, cursor, size, 1ULL));
+	return (metaslab_block_picker(rt, t, cursor, size, 1ULL));
 }
 
 static metaslab_ops_t metaslab_df_ops = {
@@ -1354,25 +1392,25 @@ static uint64_t
 metaslab_cf_alloc(metaslab_t *msp, uint64_t size)
 {
 	range_tree_t *rt = msp->ms_allocatable;
-	avl_tree_t *t = &msp->ms_allocatable_by_size;
+	zfs_btree_t *t = &msp->ms_allocatable_by_size;
 	uint64_t *cursor = &msp->ms_lbas[0];
 	uint64_t *cursor_end = &msp->ms_lbas[1];
 	uint64_t offset = 0;
 
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
-	ASSERT3U(avl_numnodes(t), ==, avl_numnodes(&rt->rt_root));
+	ASSERT3U(zfs_btree_numnodes(t), ==, zfs_btree_numnodes(&rt->rt_root));
 
 	ASSERT3U(*cursor_end, >=, *cursor);
 
 	if ((*cursor + size) > *cursor_end) {
 		range_seg_t *rs;
 
-		rs = avl_last(&msp->ms_allocatable_by_size);
-		if (rs == NULL || (rs->rs_end - rs->rs_start) < size)
+		rs = zfs_btree_last(t, NULL);
+		if (rs == NULL || rs_get_size(rs, rt) < size)
 			return (-1ULL);
 
-		*cursor = rs->rs_start;
-		*cursor_end = rs->rs_end;
+		*cursor = rs_get_start(rs, rt);
+		*cursor_end = rs_get_end(rs, rt);
 	}
 
 	offset = *cursor;
@@ -1403,39 +1441,42 @@ uint64_t metaslab_ndf_clump_shift = 4;
 static uint64_t
 metaslab_ndf_alloc(metaslab_t *msp, uint64_t size)
 {
-	avl_tree_t *t = &msp->ms_allocatable->rt_root;
-	avl_index_t where;
-	range_seg_t *rs, rsearch;
+	range_tree_t *rt = msp->ms_allocatable;
+	zfs_btree_t *t = &rt->rt_root;
+	zfs_btree_index_t where;
+	range_seg_t *rs;
+	range_seg_max_t rsearch;
 	uint64_t hbit = highbit64(size);
 	uint64_t *cursor = &msp->ms_lbas[hbit - 1];
+	uint64_t start = MAX(*cursor, rt->rt_start);
 	uint64_t max_size = metaslab_block_maxsize(msp);
 
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
-	ASSERT3U(avl_numnodes(t), ==,
-	    avl_numnodes(&msp->ms_allocatable_by_size));
+	ASSERT3U(zfs_btree_numnodes(t), ==,
+	    zfs_btree_numnodes(&msp->ms_allocatable_by_size));
 
 	if (max_size < size)
 		return (-1ULL);
 
-	rsearch.rs_start = *cursor;
-	rsearch.rs_end = *cursor + size;
+	rs_set_start(&rsearch, rt, start);
+	rs_set_end(&rsearch, rt, start + size);
 
-	rs = avl_find(t, &rsearch, &where);
-	if (rs == NULL || (rs->rs_end - rs->rs_start) < size) {
+	rs = zfs_btree_find(t, &rsearch, &where);
+	if (rs == NULL || rs_get_size(rs, rt) < size) {
 		t = &msp->ms_allocatable_by_size;
 
-		rsearch.rs_start = 0;
-		rsearch.rs_end = MIN(max_size,
-		    1ULL << (hbit + metaslab_ndf_clump_shift));
-		rs = avl_find(t, &rsearch, &where);
+		rs_set_start(&rsearch, rt, rt->rt_start);
+		rs_set_end(&rsearch, rt, rt->rt_start + MIN(max_size,
+		    1ULL << (hbit + metaslab_ndf_clump_shift)));
+		rs = zfs_btree_find(t, &rsearch, &where);
 		if (rs == NULL)
-			rs = avl_nearest(t, where, AVL_AFTER);
+			rs = zfs_btree_next(t, &where, &where);
 		ASSERT(rs != NULL);
 	}
 
-	if ((rs->rs_end - rs->rs_start) >= size) {
-		*cursor = rs->rs_start + size;
-		return (rs->rs_start);
+	if (rs_get_size(rs, rt) >= size) {
+		*cursor = rs_get_start(rs, rt) + size;
+		return (rs_get_start(rs, rt));
 	}
 	return (-1ULL);
 }
@@ -1532,6 +1573,29 @@ metaslab_unload(metaslab_t *msp)
 	msp->ms_max_size = 0;
 }
 
+/*
+ * Choose the segment format for a metaslab's range trees. On a concrete
+ * vdev every offset in a metaslab is a multiple of the vdev's sector size,
+ * so segments can be stored as 32-bit sector counts relative to the start
+ * of the metaslab. The allocators search for ranges that may end up to a
+ * metaslab's size past its end, so that has to fit as well.
+ */
+static range_seg_type_t
+metaslab_calculate_range_tree_type(vdev_t *vd, metaslab_t *msp,
+    uint64_t *start, uint64_t *shift)
+{
+	if (vdev_is_concrete(vd) &&
+	    (msp->ms_size >> vd->vdev_ashift) <= UINT32_MAX / 2) {
+		*start = msp->ms_start;
+		*shift = vd->vdev_ashift;
+		return (RANGE_SEG32);
+	}
+
+	*start = 0;
+	*shift = 0;
+	return (RANGE_SEG64);
+}
+
 int
 metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
     metaslab_t **msp)
@@ -1539,6 +1603,8 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
 	vdev_t *vd = mg->mg_vd;
 	objset_t *mos = vd->vdev_spa->spa_meta_objset;
 	metaslab_t *ms;
+	range_seg_type_t type;
+	uint64_t start, shift;
 	int error;
 
 	ms = kmem_zalloc(sizeof (metaslab_t), KM_SLEEP);
@@ -1549,6 +1615,8 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
 	ms->ms_id = id;
 	ms->ms_start = id << vd->vdev_ms_shift;
 	ms->ms_size = 1ULL << vd->vdev_ms_shift;
+	if (vd->vdev_ops == &vdev_draid_ops)
+		vdev_draid_metaslab_init(vd, &ms->ms_start, &ms->ms_size);
 	ms->ms_allocator = -1;
 	ms->ms_new = B_TRUE;
 
@@ -1575,7 +1643,9 @@ metaslab_init(metaslab_group_t *mg, uint64_t id, uint64_t object, uint64_t txg,
 	 * addition of new space; and for debugging, it ensures that we'd
 	 * data fault on any attempt to use this metaslab before it's ready.
 	 */
-	ms->ms_allocatable = range_tree_create(&metaslab_rt_ops, ms);
+	type = metaslab_calculate_range_tree_type(vd, ms, &start, &shift);
+	ms->ms_allocatable = range_tree_create_impl(&metaslab_rt_ops, type, ms,
+	    start, shift);
 	metaslab_group_add(mg, ms);
 
 	metaslab_set_fragmentation(ms);
@@ -2291,7 +2361,7 @@ metaslab_should_condense(metaslab_t *msp)
 	 * We always condense metaslabs that are empty and metaslabs for
 	 * which a condense request has been made.
 	 */
-	if (avl_is_empty(&msp->ms_allocatable_by_size) ||
+	if (zfs_btree_numnodes(&msp->ms_allocatable_by_size) == 0 ||
 	    msp->ms_condense_wanted)
 		return (B_TRUE);
 
@@ -2317,6 +2387,8 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 {
 	range_tree_t *condense_tree;
 	space_map_t *sm = msp->ms_sm;
+	range_seg_type_t type;
+	uint64_t start, shift;
 
 	ASSERT(MUTEX_HELD(&msp->ms_lock));
 	ASSERT(msp->ms_loaded);
@@ -2326,7 +2398,7 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 	    msp->ms_id, msp, msp->ms_group->mg_vd->vdev_id,
 	    msp->ms_group->mg_vd->vdev_spa->spa_name,
 	    space_map_length(msp->ms_sm),
-	    avl_numnodes(&msp->ms_allocatable->rt_root),
+	    range_tree_numsegs(msp->ms_allocatable),
 	    msp->ms_condense_wanted ? "TRUE" : "FALSE");
 
 	msp->ms_condense_wanted = B_FALSE;
@@ -2338,7 +2410,9 @@ metaslab_condense(metaslab_t *msp, uint64_t txg, dmu_tx_t *tx)
 	 * a relatively inexpensive operation since we expect these trees to
 	 * have a small number of nodes.
 	 */
-	condense_tree = range_tree_create(NULL, NULL);
+	type = metaslab_calculate_range_tree_type(msp->ms_group->mg_vd, msp,
+	    &start, &shift);
+	condense_tree = range_tree_create_impl(NULL, type, NULL, start, shift);
 	range_tree_add(condense_tree, msp->ms_start, msp->ms_size);
 
 	range_tree_walk(msp->ms_freeing, range_tree_remove, condense_tree);
@@ -2625,26 +2699,35 @@ metaslab_sync_done(metaslab_t *msp, uint64_t txg)
 	 * range trees and add its capacity to the vdev.
 	 */
 	if (msp->ms_freed == NULL) {
+		uint64_t start, shift;
+		range_seg_type_t type = metaslab_calculate_range_tree_type(vd,
+		    msp, &start, &shift);
+
 		for (int t = 0; t < TXG_SIZE; t++) {
 			ASSERT(msp->ms_allocating[t] == NULL);
 
-			msp->ms_allocating[t] = range_tree_create(NULL, NULL);
+			msp->ms_allocating[t] = range_tree_create_impl(NULL,
+			    type, NULL, start, shift);
 		}
 
 		ASSERT3P(msp->ms_freeing, ==, NULL);
-		msp->ms_freeing = range_tree_create(NULL, NULL);
+		msp->ms_freeing = range_tree_create_impl(NULL, type, NULL,
+		    start, shift);
 
 		ASSERT3P(msp->ms_freed, ==, NULL);
-		msp->ms_freed = range_tree_create(NULL, NULL);
+		msp->ms_freed = range_tree_create_impl(NULL, type, NULL,
+		    start, shift);
 
 		for (int t = 0; t < TXG_DEFER_SIZE; t++) {
 			ASSERT(msp->ms_defer[t] == NULL);
 
-			msp->ms_defer[t] = range_tree_create(NULL, NULL);
+			msp->ms_defer[t] = range_tree_create_impl(NULL, type,
+			    NULL, start, shift);
 		}
 
 		ASSERT3P(msp->ms_checkpointing, ==, NULL);
-		msp->ms_checkpointing = range_tree_create(NULL, NULL);
+		msp->ms_checkpointing = range_tree_create_impl(NULL, type,
+		    NULL, start, shift);
 
 		vdev_space_update(vd, 0, 0, msp->ms_size);
 	}
@@ -3463,7 +3546,7 @@ top:
 				distance = 0;
 		}
 
-		uint64_t asize = vdev_psize_to_asize(vd, psize);
+		uint64_t asize = vdev_psize_to_asize_txg(vd, psize, txg);
 		ASSERT(P2PHASE(asize, 1ULL << vd->vdev_ashift) == 0);
 
 		uint64_t offset = metaslab_group_alloc(mg, zal, asize, txg,
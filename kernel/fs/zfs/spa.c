@@ -55,6 +55,8 @@
 #include <sys/vdev_indirect_mapping.h>
 #include <sys/vdev_indirect_births.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_rebuild.h>
+#include <sys/vdev_draid.h>
 #include <sys/metaslab.h>
 #include <sys/metaslab_impl.h>
 #include <sys/uberblock_impl.h>
@@ -1323,6 +1325,7 @@ spa_unload(spa_t *spa)
 	if (spa->spa_root_vdev) {
 		vdev_initialize_stop_all(spa->spa_root_vdev,
 		    VDEV_INITIALIZE_ACTIVE);
+		vdev_rebuild_stop_all(spa);
 	}
 
 	/*
@@ -1361,6 +1364,8 @@ spa_unload(spa_t *spa)
 		spa->spa_vdev_removal = NULL;
 	}
 
+	spa_raidz_expand_destroy(spa);
+
 	if (spa->spa_condense_zthr != NULL) {
 		ASSERT(!zthr_isrunning(spa->spa_condense_zthr));
 		zthr_destroy(spa->spa_condense_zthr);
@@ -2878,6 +2883,13 @@ spa_ld_open_indirect_vdev_metadata(spa_t *spa)
 		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
 	}
 
+	error = spa_raidz_expand_init(spa);
+	if (error != 0) {
+		spa_load_failed(spa, "spa_raidz_expand_init failed "
+		    "[error=%d]", error);
+		return (spa_vdev_err(rvd, VDEV_AUX_CORRUPT_DATA, EIO));
+	}
+
 	/*
 	 * Retrieve information needed to condense indirect vdev mappings.
 	 */
@@ -3264,7 +3276,7 @@ spa_ld_load_vdev_metadata(spa_t *spa)
 	 * Propagate the leaf DTLs we just loaded all the way up the vdev tree.
 	 */
 	spa_config_enter(spa, SCL_ALL, FTAG, RW_WRITER);
-	vdev_dtl_reassess(rvd, 0, 0, B_FALSE);
+	vdev_dtl_reassess(rvd, 0, 0, B_FALSE, B_FALSE);
 	spa_config_exit(spa, SCL_ALL, FTAG);
 
 	return (0);
@@ -3863,6 +3875,7 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 		spa_history_log_version(spa, "open");
 
 		spa_restart_removal(spa);
+		spa_raidz_expand_restart(spa);
 		spa_spawn_aux_threads(spa);
 
 		/*
@@ -3884,6 +3897,7 @@ spa_load_impl(spa_t *spa, spa_import_type_t type, char **ereport)
 
 		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
 		vdev_initialize_restart(spa->spa_root_vdev);
+		vdev_rebuild_restart(spa);
 		spa_config_exit(spa, SCL_CONFIG, FTAG);
 	}
 
@@ -4581,8 +4595,8 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	uint64_t txg = TXG_INITIAL;
 	nvlist_t **spares, **l2cache;
 	uint_t nspares, nl2cache;
-	uint64_t version, obj;
-	boolean_t has_features;
+	uint64_t version, obj, ndraid = 0;
+	boolean_t has_features, has_draid;
 	char *poolname;
 	nvlist_t *nvl;
 
@@ -4624,10 +4638,15 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 		spa->spa_import_flags |= ZFS_IMPORT_TEMP_NAME;
 
 	has_features = B_FALSE;
+	has_draid = B_FALSE;
 	for (nvpair_t *elem = nvlist_next_nvpair(props, NULL);
 	    elem != NULL; elem = nvlist_next_nvpair(props, elem)) {
-		if (zpool_prop_feature(nvpair_name(elem)))
+		if (zpool_prop_feature(nvpair_name(elem))) {
 			has_features = B_TRUE;
+			if (strcmp(strchr(nvpair_name(elem), '@') + 1,
+			    spa_feature_table[SPA_FEATURE_DRAID].fi_uname) == 0)
+				has_draid = B_TRUE;
+		}
 	}
 
 	if (has_features || nvlist_lookup_uint64(props,
@@ -4669,10 +4688,22 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 	if (error == 0 && !zfs_allocatable_devs(nvroot))
 		error = SET_ERROR(EINVAL);
 
+	/*
+	 * The distributed spares of any dRAID vdevs are added to the spares
+	 * given in nvroot, so that they are validated and loaded with them.
+	 */
 	if (error == 0 &&
 	    (error = vdev_create(rvd, txg, B_FALSE)) == 0 &&
-	    (error = spa_validate_aux(spa, nvroot, txg,
-	    VDEV_ALLOC_ADD)) == 0) {
+	    (error = vdev_draid_spare_create(nvroot, rvd, NULL,
+	    &ndraid)) == 0) {
+		if (ndraid != 0 && !has_draid)
+			error = SET_ERROR(ENOTSUP);
+		else
+			error = spa_validate_aux(spa, nvroot, txg,
+			    VDEV_ALLOC_ADD);
+	}
+
+	if (error == 0) {
 		for (int c = 0; c < rvd->vdev_children; c++) {
 			vdev_metaslab_set_size(rvd->vdev_child[c]);
 			vdev_expand(rvd->vdev_child[c], txg);
@@ -4806,6 +4837,11 @@ spa_create(const char *pool, nvlist_t *nvroot, nvlist_t *props,
 		spa_sync_props(props, tx);
 	}
 
+	if (ndraid != 0) {
+		dsl_sync_task_nowait(dp, vdev_draid_add_sync,
+		    (void *)(uintptr_t)ndraid, 0, ZFS_SPACE_CHECK_NONE, tx);
+	}
+
 	dmu_tx_commit(tx);
 
 	spa->spa_sync_on = B_TRUE;
@@ -5417,14 +5453,15 @@ spa_export_common(char *pool, int new_state, nvlist_t **oldconfig,
 
 		/*
 		 * We're about to export or destroy this pool. Make sure
-		 * we stop all initializtion activity here before we
-		 * set the spa_final_txg. This will ensure that all
-		 * dirty data resulting from the initialization is
+		 * we stop all initializtion and rebuild activity here
+		 * before we set the spa_final_txg. This will ensure that
+		 * all dirty data resulting from the initialization is
 		 * committed to disk before we unload the pool.
 		 */
 		if (spa->spa_root_vdev != NULL) {
 			vdev_initialize_stop_all(spa->spa_root_vdev,
 			    VDEV_INITIALIZE_ACTIVE);
+			vdev_rebuild_stop_all(spa);
 		}
 
 		/*
@@ -5506,7 +5543,8 @@ spa_reset(char *pool)
 int
 spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 {
-	uint64_t txg, id;
+	uint64_t txg, id, next, ndraid;
+	uint64_t *ids;
 	int error;
 	vdev_t *rvd = spa->spa_root_vdev;
 	vdev_t *vd, *tvd;
@@ -5523,6 +5561,28 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 
 	spa->spa_pending_vdev = vd;	/* spa_vdev_exit() will clear this */
 
+	/*
+	 * The distributed spares of new dRAID vdevs are named after the id
+	 * each will have, which is the first hole (as assigned below) or
+	 * else the next id.
+	 */
+	ids = kmem_alloc(MAX(vd->vdev_children, 1) * sizeof (uint64_t),
+	    KM_SLEEP);
+	id = 0;
+	next = rvd->vdev_children;
+	for (int c = 0; c < vd->vdev_children; c++) {
+		while (id < rvd->vdev_children &&
+		    !rvd->vdev_child[id]->vdev_ishole)
+			id++;
+		ids[c] = (id < rvd->vdev_children) ? id++ : next++;
+	}
+	error = vdev_draid_spare_create(nvroot, vd, ids, &ndraid);
+	kmem_free(ids, MAX(vd->vdev_children, 1) * sizeof (uint64_t));
+	if (error != 0)
+		return (spa_vdev_exit(spa, vd, txg, error));
+
+	if (ndraid != 0 && !spa_feature_is_enabled(spa, SPA_FEATURE_DRAID))
+		return (spa_vdev_exit(spa, vd, txg, ENOTSUP));
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES, &spares,
 	    &nspares) != 0)
 		nspares = 0;
@@ -5559,8 +5619,9 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 			    tvd->vdev_ashift != spa->spa_max_ashift) {
 				return (spa_vdev_exit(spa, vd, txg, EINVAL));
 			}
-			/* Fail if top level vdev is raidz */
-			if (tvd->vdev_ops == &vdev_raidz_ops) {
+			/* Fail if top level vdev is raidz or dRAID */
+			if (tvd->vdev_ops == &vdev_raidz_ops ||
+			    tvd->vdev_ops == &vdev_draid_ops) {
 				return (spa_vdev_exit(spa, vd, txg, EINVAL));
 			}
 			/*
@@ -5612,6 +5673,13 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
 		spa->spa_l2cache.sav_sync = B_TRUE;
 	}
 
+	if (ndraid != 0) {
+		dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+		dsl_sync_task_nowait(spa->spa_dsl_pool, vdev_draid_add_sync,
+		    (void *)(uintptr_t)ndraid, 0, ZFS_SPACE_CHECK_NONE, tx);
+		dmu_tx_commit(tx);
+	}
+
 	/*
 	 * We have to be careful when adding new vdevs to an existing pool.
 	 * If other threads start allocating from these vdevs before we
@@ -5649,7 +5717,8 @@ spa_vdev_add(spa_t *spa, nvlist_t *nvroot)
  * is automatically detached.
  */
 int
-spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
+spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing,
+    int rebuild)
 {
 	uint64_t txg, dtl_max_txg;
 	vdev_t *rvd = spa->spa_root_vdev;
@@ -5658,6 +5727,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	char *oldvdpath, *newvdpath;
 	int newvd_isspare;
 	int error;
+	boolean_t raidz;
 
 	ASSERT(spa_writeable(spa));
 
@@ -5678,10 +5748,23 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (oldvd == NULL)
 		return (spa_vdev_exit(spa, NULL, txg, ENODEV));
 
-	if (!oldvd->vdev_ops->vdev_op_leaf)
-		return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
-
-	pvd = oldvd->vdev_parent;
+	/*
+	 * Attaching to a RAID-Z vdev itself (rather than one of its
+	 * children) expands it by one device.
+	 */
+	raidz = (oldvd->vdev_ops == &vdev_raidz_ops);
+	if (raidz) {
+		if (!spa_feature_is_enabled(spa, SPA_FEATURE_RAIDZ_EXPANSION) ||
+		    replacing)
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+		if ((error = vdev_raidz_attach_check(oldvd)) != 0)
+			return (spa_vdev_exit(spa, NULL, txg, error));
+		pvd = oldvd;
+	} else {
+		if (!oldvd->vdev_ops->vdev_op_leaf)
+			return (spa_vdev_exit(spa, NULL, txg, ENOTSUP));
+		pvd = oldvd->vdev_parent;
+	}
 
 	if ((error = spa_config_parse(spa, &newrootvd, nvroot, NULL, 0,
 	    VDEV_ALLOC_ATTACH)) != 0)
@@ -5704,7 +5787,34 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	if (oldvd->vdev_top->vdev_islog && newvd->vdev_isspare)
 		return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
 
-	if (!replacing) {
+	/*
+	 * A distributed spare can only replace a child of the dRAID vdev
+	 * which provides its space.
+	 */
+	if (newvd->vdev_ops == &vdev_draid_spare_ops) {
+		vdev_draid_spare_t *vds = newvd->vdev_tsd;
+
+		if (!replacing || oldvd->vdev_top->vdev_ops != &vdev_draid_ops ||
+		    oldvd->vdev_top->vdev_guid != vds->vds_top_guid)
+			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
+	}
+
+	/*
+	 * A sequential rebuild reconstructs the new device from the space
+	 * maps rather than the block pointers, so it is only possible when
+	 * every allocated segment of the top-level vdev can be copied as-is:
+	 * mirrors (or a single disk about to become one) and dRAID.
+	 */
+	if (rebuild) {
+		if (!spa_feature_is_enabled(spa, SPA_FEATURE_DEVICE_REBUILD))
+			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
+		if (raidz || oldvd->vdev_top->vdev_ops == &vdev_raidz_ops)
+			return (spa_vdev_exit(spa, newrootvd, txg, ENOTSUP));
+	}
+
+	if (raidz) {
+		pvops = &vdev_raidz_ops;
+	} else if (!replacing) {
 		/*
 		 * For attach, the only allowable parent is a mirror or the root
 		 * vdev.
@@ -5747,9 +5857,11 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	}
 
 	/*
-	 * Make sure the new device is big enough.
+	 * Make sure the new device is big enough.  A new RAID-Z child must
+	 * be able to hold its share of the vdev, like any existing child.
 	 */
-	if (newvd->vdev_asize < vdev_get_min_asize(oldvd))
+	if (newvd->vdev_asize < vdev_get_min_asize(raidz ?
+	    oldvd->vdev_child[0] : oldvd))
 		return (spa_vdev_exit(spa, newrootvd, txg, EOVERFLOW));
 
 	/*
@@ -5763,7 +5875,7 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 	 * If this is an in-place replacement, update oldvd's path and devid
 	 * to make it distinguishable from newvd, and unopenable from now on.
 	 */
-	if (strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
+	if (!raidz && strcmp(oldvd->vdev_path, newvd->vdev_path) == 0) {
 		spa_strfree(oldvd->vdev_path);
 		oldvd->vdev_path = kmem_alloc(strlen(newvd->vdev_path) + 5,
 		    KM_SLEEP);
@@ -5775,8 +5887,12 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 		}
 	}
 
-	/* mark the device being resilvered */
-	newvd->vdev_resilver_txg = txg;
+	/*
+	 * Mark the device being resilvered.  A device added to a RAID-Z
+	 * vdev holds no data yet, so it is filled by the reflow instead.
+	 */
+	if (!raidz)
+		newvd->vdev_resilver_txg = txg;
 
 	/*
 	 * If the parent is not a mirror, or if we're replacing, insert the new
@@ -5803,36 +5919,57 @@ spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot, int replacing)
 
 	vdev_config_dirty(tvd);
 
-	/*
-	 * Set newvd's DTL to [TXG_INITIAL, dtl_max_txg) so that we account
-	 * for any dmu_sync-ed blocks.  It will propagate upward when
-	 * spa_vdev_exit() calls vdev_dtl_reassess().
-	 */
-	dtl_max_txg = txg + TXG_CONCURRENT_STATES;
+	oldvdpath = raidz ? kmem_asprintf("%s%llu-%llu", VDEV_TYPE_RAIDZ,
+	    oldvd->vdev_nparity, oldvd->vdev_id) : spa_strdup(oldvd->vdev_path);
+	newvdpath = spa_strdup(newvd->vdev_path);
+	newvd_isspare = newvd->vdev_isspare;
 
-	vdev_dtl_dirty(newvd, DTL_MISSING, TXG_INITIAL,
-	    dtl_max_txg - TXG_INITIAL);
+	if (raidz) {
+		/*
+		 * The new child is not used for any existing data until the
+		 * reflow, started from syncing context, moves it over.
+		 */
+		tvd->vdev_rz_expanding = B_TRUE;
+		spa_raidz_expand_create(spa, tvd);
 
-	if (newvd->vdev_isspare) {
-		spa_spare_activate(newvd);
-		spa_event_notify(spa, newvd, NULL, ESC_ZFS_VDEV_SPARE);
-	}
+		dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+		dsl_sync_task_nowait(spa->spa_dsl_pool, vdev_raidz_attach_sync,
+		    (void *)(uintptr_t)tvd->vdev_id, 0, ZFS_SPACE_CHECK_NONE,
+		    tx);
+		dmu_tx_commit(tx);
 
-	oldvdpath = spa_strdup(oldvd->vdev_path);
-	newvdpath = spa_strdup(newvd->vdev_path);
-	newvd_isspare = newvd->vdev_isspare;
+		dtl_max_txg = txg;
+	} else {
+		/*
+		 * Set newvd's DTL to [TXG_INITIAL, dtl_max_txg) so that we
+		 * account for any dmu_sync-ed blocks.  It will propagate
+		 * upward when spa_vdev_exit() calls vdev_dtl_reassess().
+		 */
+		dtl_max_txg = txg + TXG_CONCURRENT_STATES;
 
-	/*
-	 * Mark newvd's DTL dirty in this txg.
-	 */
-	vdev_dirty(tvd, VDD_DTL, newvd, txg);
+		vdev_dtl_dirty(newvd, DTL_MISSING, TXG_INITIAL,
+		    dtl_max_txg - TXG_INITIAL);
 
-	/*
-	 * Schedule the resilver to restart in the future. We do this to
-	 * ensure that dmu_sync-ed blocks have been stitched into the
-	 * respective datasets.
-	 */
-	dsl_resilver_restart(spa->spa_dsl_pool, dtl_max_txg);
+		if (newvd->vdev_isspare) {
+			spa_spare_activate(newvd);
+			spa_event_notify(spa, newvd, NULL, ESC_ZFS_VDEV_SPARE);
+		}
+
+		/*
+		 * Mark newvd's DTL dirty in this txg.
+		 */
+		vdev_dirty(tvd, VDD_DTL, newvd, txg);
+
+		/*
+		 * Schedule the resilver (or rebuild) to restart in the future.
+		 * We do this to ensure that dmu_sync-ed blocks have been
+		 * stitched into the respective datasets.
+		 */
+		if (rebuild)
+			vdev_rebuild(tvd, txg);
+		else
+			dsl_resilver_restart(spa->spa_dsl_pool, dtl_max_txg);
+	}
 
 	if (spa->spa_bootfs)
 		spa_event_notify(spa, newvd, NULL, ESC_ZFS_BOOTFS_VDEV_ATTACH);
@@ -5949,6 +6086,14 @@ spa_vdev_detach(spa_t *spa, uint64_t guid, uint64_t pguid, int replace_done)
 	if (vdev_dtl_required(vd))
 		return (spa_vdev_exit(spa, NULL, txg, EBUSY));
 
+	/*
+	 * A top-level mirror which is being rebuilt can't be collapsed into
+	 * a single disk, as the rebuild thread refers to it.
+	 */
+	if (pvd == pvd->vdev_top && pvd->vdev_children == 2 &&
+	    pvd->vdev_rebuild_thread != NULL)
+		return (spa_vdev_exit(spa, NULL, txg, EBUSY));
+
 	ASSERT(pvd->vdev_children >= 2);
 
 	/*
@@ -6157,7 +6302,7 @@ spa_vdev_initialize(spa_t *spa, uint64_t guid, uint64_t cmd_type)
 	 */
 	if (cmd_type == POOL_INITIALIZE_DO &&
 	    (vd->vdev_initialize_thread != NULL ||
-	    vd->vdev_top->vdev_removing)) {
+	    vd->vdev_top->vdev_removing || vd->vdev_top->vdev_rz_expanding)) {
 		mutex_exit(&vd->vdev_initialize_lock);
 		mutex_exit(&spa_namespace_lock);
 		return (SET_ERROR(EBUSY));
@@ -6823,6 +6968,14 @@ spa_async_thread(void *arg)
 	spa->spa_async_tasks = 0;
 	mutex_exit(&spa->spa_async_lock);
 
+	/*
+	 * Make the space added by a finished RAID-Z expansion available.
+	 */
+	if (tasks & SPA_ASYNC_RAIDZ_EXPAND_DONE) {
+		spa_raidz_expand_done(spa);
+		tasks |= SPA_ASYNC_CONFIG_UPDATE;
+	}
+
 	/*
 	 * See if the config needs to be updated.
 	 */
@@ -6880,6 +7033,17 @@ spa_async_thread(void *arg)
 	if (tasks & SPA_ASYNC_RESILVER_DONE)
 		spa_vdev_resilver_done(spa);
 
+	/*
+	 * A sequential rebuild copies segments without verifying their
+	 * checksums, so once the replaced devices are detached, scrub the
+	 * pool to find and repair anything that was reconstructed from
+	 * damaged data.
+	 */
+	if ((tasks & SPA_ASYNC_REBUILD_DONE) && !spa_suspended(spa)) {
+		spa_vdev_resilver_done(spa);
+		(void) dsl_scan(spa->spa_dsl_pool, POOL_SCAN_SCRUB);
+	}
+
 	/*
 	 * Kick off a resilver.
 	 */
@@ -6914,6 +7078,7 @@ spa_async_suspend(spa_t *spa)
 	mutex_exit(&spa->spa_async_lock);
 
 	spa_vdev_remove_suspend(spa);
+	spa_raidz_expand_suspend(spa);
 
 	zthr_t *condense_thread = spa->spa_condense_zthr;
 	if (condense_thread != NULL && zthr_isrunning(condense_thread))
@@ -6932,6 +7097,7 @@ spa_async_resume(spa_t *spa)
 	spa->spa_async_suspended--;
 	mutex_exit(&spa->spa_async_lock);
 	spa_restart_removal(spa);
+	spa_raidz_expand_restart(spa);
 
 	zthr_t *condense_thread = spa->spa_condense_zthr;
 	if (condense_thread != NULL && !zthr_isrunning(condense_thread))
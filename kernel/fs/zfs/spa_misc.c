@@ -44,6 +44,7 @@
 #include <sys/uberblock_impl.h>
 #include <sys/txg.h>
 #include <sys/avl.h>
+#include <sys/btree.h>
 #include <sys/unique.h>
 #include <sys/dsl_pool.h>
 #include <sys/dsl_dir.h>
@@ -1161,7 +1162,7 @@ spa_vdev_config_exit(spa_t *spa, vdev_t *vd, uint64_t txg, int error, char *tag)
 	/*
 	 * Reassess the DTLs.
 	 */
-	vdev_dtl_reassess(spa->spa_root_vdev, 0, 0, B_FALSE);
+	vdev_dtl_reassess(spa->spa_root_vdev, 0, 0, B_FALSE, B_FALSE);
 
 	if (error == 0 && !list_is_empty(&spa->spa_config_dirty_list)) {
 		config_changed = B_TRUE;
@@ -1265,7 +1266,7 @@ spa_vdev_state_exit(spa_t *spa, vdev_t *vd, int error)
 
 	if (vd != NULL || error == 0)
 		vdev_dtl_reassess(vd ? vd->vdev_top : spa->spa_root_vdev,
-		    0, 0, B_FALSE);
+		    0, 0, B_FALSE, B_FALSE);
 
 	if (vd != NULL) {
 		vdev_state_dirty(vd->vdev_top);
@@ -1931,7 +1932,7 @@ spa_init(int mode)
 
 	refcount_init();
 	unique_init();
-	range_tree_init();
+	zfs_btree_init();
 	metaslab_alloc_trace_init();
 	zio_init();
 	dmu_init();
@@ -1956,7 +1957,7 @@ spa_fini(void)
 	dmu_fini();
 	zio_fini();
 	metaslab_alloc_trace_fini();
-	range_tree_fini();
+	zfs_btree_fini();
 	unique_fini();
 	refcount_fini();
 
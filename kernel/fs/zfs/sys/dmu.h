@@ -337,6 +337,7 @@ typedef struct dmu_buf {
 #define	DMU_POOL_OBSOLETE_BPOBJ		"com.delphix:obsolete_bpobj"
 #define	DMU_POOL_CONDENSING_INDIRECT	"com.delphix:condensing_indirect"
 #define	DMU_POOL_ZPOOL_CHECKPOINT	"com.delphix:zpool_checkpoint"
+#define	DMU_POOL_RAIDZ_EXPAND		"org.openzfs:raidz_expand"
 
 /*
  * Allocate an object from this objset.  The range of object numbers
@@ -750,6 +751,9 @@ int dmu_read(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	void *buf, uint32_t flags);
 int dmu_read_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size, void *buf,
     uint32_t flags);
+typedef void dmu_read_done_func_t(void *arg, int error);
+int dmu_read_async_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size,
+    void *buf, dmu_read_done_func_t *done, void *arg, uint32_t flags);
 void dmu_write(objset_t *os, uint64_t object, uint64_t offset, uint64_t size,
 	const void *buf, dmu_tx_t *tx);
 void dmu_write_by_dnode(dnode_t *dn, uint64_t offset, uint64_t size,
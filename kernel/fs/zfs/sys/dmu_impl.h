@@ -71,7 +71,7 @@ extern "C" {
  * os_obj_lock
  *   must be held before:
  *   	everything except dp_config_rwlock
- *   protects os_obj_next
+ *   protects os_obj_next_chunk
  *   held from:
  *   	dmu_object_alloc: dn_dbufs_mtx, db_mtx, hash_mutexes, dn_struct_rwlock
  *
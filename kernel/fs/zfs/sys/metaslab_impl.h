@@ -402,9 +402,10 @@ struct metaslab {
 	 * this functionality. The ms_allocatable_by_size should always
 	 * contain the same number of segments as the ms_allocatable. The
 	 * only difference is that the ms_allocatable_by_size is ordered by
-	 * segment sizes.
+	 * segment sizes. It holds copies of the segments, in the same format
+	 * as ms_allocatable.
 	 */
-	avl_tree_t	ms_allocatable_by_size;
+	zfs_btree_t	ms_allocatable_by_size;
 	uint64_t	ms_lbas[MAX_LBAS];
 
 	metaslab_group_t *ms_group;	/* metaslab group		*/
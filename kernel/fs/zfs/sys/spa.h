@@ -651,6 +651,8 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 #define	SPA_ASYNC_REMOVE_DONE	0x40
 #define	SPA_ASYNC_REMOVE_STOP	0x80
 #define	SPA_ASYNC_INITIALIZE_RESTART	0x100
+#define	SPA_ASYNC_RAIDZ_EXPAND_DONE	0x200
+#define	SPA_ASYNC_REBUILD_DONE	0x400
 
 /*
  * Controls the behavior of spa_vdev_remove().
@@ -661,7 +663,7 @@ extern int spa_scan_get_stats(spa_t *spa, pool_scan_stat_t *ps);
 /* device manipulation */
 extern int spa_vdev_add(spa_t *spa, nvlist_t *nvroot);
 extern int spa_vdev_attach(spa_t *spa, uint64_t guid, nvlist_t *nvroot,
-    int replacing);
+    int replacing, int rebuild);
 extern int spa_vdev_detach(spa_t *spa, uint64_t guid, uint64_t pguid,
     int replace_done);
 extern int spa_vdev_remove(spa_t *spa, uint64_t guid, boolean_t unspare);
@@ -83,6 +83,14 @@ struct uberblock {
 	 * the ZIL block is not allocated [see uses of spa_min_claim_txg()].
 	 */
 	uint64_t	ub_checkpoint_txg;
+
+	/*
+	 * While a RAID-Z vdev is being expanded, this is the byte offset
+	 * (in the vdev's logical address space) below which all data has
+	 * been reflowed to the new, wider layout and the copy has been
+	 * synced to disk.  On import, the reflow resumes from here.
+	 */
+	uint64_t	ub_raidz_reflow_info;
 };
 
 #ifdef	__cplusplus
@@ -0,0 +1,89 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_VDEV_DRAID_H
+#define	_SYS_VDEV_DRAID_H
+
+#include <sys/types.h>
+#include <sys/nvpair.h>
+#include <sys/spa.h>
+#include <sys/dmu_tx.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * These are part of the on-disk format: the layout of every dRAID vdev
+ * depends on them (see vdev_draid.c), so they can never change.
+ */
+#define	VDEV_DRAID_MAX_CHILDREN	255
+#define	VDEV_DRAID_ROWHEIGHT	SPA_MAXBLOCKSIZE
+#define	VDEV_DRAID_NPERMS	64
+
+/*
+ * Geometry of a dRAID vdev.  The children are divided into slices of
+ * vdc_rows rows (of VDEV_DRAID_ROWHEIGHT bytes) each, and every slice
+ * holds vdc_ngroups redundancy groups of vdc_groupwidth columns, laid out
+ * on the first vdc_ndisks children of the slice's permutation.  The
+ * remaining vdc_nspares children of the permutation are that slice's
+ * share of the distributed spares.
+ */
+typedef struct vdev_draid_config {
+	uint64_t	vdc_ndata;	/* data columns per group */
+	uint64_t	vdc_nparity;	/* parity columns per group */
+	uint64_t	vdc_nspares;	/* distributed spares */
+	uint64_t	vdc_children;	/* vdc_ndisks + vdc_nspares */
+	uint64_t	vdc_groupwidth;	/* vdc_ndata + vdc_nparity */
+	uint64_t	vdc_ndisks;	/* children holding data in a slice */
+	uint64_t	vdc_ngroups;	/* groups per slice */
+	uint64_t	vdc_rows;	/* rows per slice */
+	uint8_t		*vdc_perms;	/* VDEV_DRAID_NPERMS x vdc_children */
+} vdev_draid_config_t;
+
+/*
+ * Type-specific data of a distributed spare ("dspare") leaf vdev.
+ */
+typedef struct vdev_draid_spare {
+	uint64_t	vds_top_guid;	/* guid of the owning dRAID vdev */
+	uint64_t	vds_spare_id;	/* index among its distributed spares */
+	vdev_t		*vds_draid_vdev; /* set while open */
+} vdev_draid_spare_t;
+
+extern int vdev_draid_config_alloc(nvlist_t *, uint64_t,
+    vdev_draid_config_t **);
+extern int vdev_draid_spare_config_alloc(spa_t *, nvlist_t *,
+    vdev_draid_spare_t **);
+extern void vdev_draid_free(vdev_t *);
+extern void vdev_draid_config_generate(vdev_t *, nvlist_t *);
+extern nvlist_t *vdev_draid_read_config_spare(vdev_t *);
+extern int vdev_draid_spare_create(nvlist_t *, vdev_t *, const uint64_t *,
+    uint64_t *);
+extern void vdev_draid_metaslab_init(vdev_t *, uint64_t *, uint64_t *);
+extern uint64_t vdev_draid_min_asize(vdev_t *);
+extern uint64_t vdev_draid_rebuild_chunk(vdev_t *, uint64_t, uint64_t);
+extern void vdev_draid_add_sync(void *, dmu_tx_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_VDEV_DRAID_H */
@@ -38,6 +38,7 @@
 #include <sys/vdev_indirect_mapping.h>
 #include <sys/vdev_indirect_births.h>
 #include <sys/vdev_removal.h>
+#include <sys/vdev_rebuild.h>
 
 #ifdef	__cplusplus
 extern "C" {
@@ -68,7 +69,8 @@ extern uint32_t zfs_vdev_async_write_max_active;
 typedef int	vdev_open_func_t(vdev_t *vd, uint64_t *size, uint64_t *max_size,
     uint64_t *ashift);
 typedef void	vdev_close_func_t(vdev_t *vd);
-typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize);
+typedef uint64_t vdev_asize_func_t(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 typedef void	vdev_io_start_func_t(zio_t *zio);
 typedef void	vdev_io_done_func_t(zio_t *zio);
 typedef void	vdev_state_change_func_t(vdev_t *vd, int, int);
@@ -81,10 +83,11 @@ typedef void	vdev_remap_func_t(vdev_t *vd, uint64_t offset, uint64_t size,
     vdev_remap_cb_t callback, void *arg);
 /*
  * Given a target vdev, translates the logical range "in" to the physical
- * range "res"
+ * range "res".  A top-level vdev which can only translate the start of "in"
+ * in one piece sets "remain" to the rest of it; others leave "remain" alone.
  */
-typedef void vdev_xlation_func_t(vdev_t *cvd, const range_seg_t *in,
-    range_seg_t *res);
+typedef void vdev_xlation_func_t(vdev_t *cvd, const range_seg64_t *in,
+    range_seg64_t *res, range_seg64_t *remain);
 
 typedef struct vdev_ops {
 	vdev_open_func_t		*vdev_op_open;
@@ -242,6 +245,11 @@ struct vdev {
 
 	/* pool checkpoint related */
 	space_map_t	*vdev_checkpoint_sm;	/* contains reserved blocks */
+
+	/* raidz expansion related */
+	boolean_t	vdev_rz_expanding;	/* newest child being reflowed */
+	uint64_t	*vdev_rz_expand_txgs;	/* txgs of finished expansions */
+	uint_t		vdev_rz_expand_count;	/* entries in the above */
 	
 	boolean_t	vdev_initialize_exit_wanted;
 	vdev_initializing_state_t	vdev_initialize_state;
@@ -261,6 +269,20 @@ struct vdev {
 	kcondvar_t	vdev_initialize_io_cv;
 	uint64_t	vdev_initialize_inflight;
 
+	/* sequential rebuild related, for top-level vdevs */
+	boolean_t	vdev_rebuild_exit_wanted;
+	boolean_t	vdev_rebuild_reset_wanted;
+	kthread_t	*vdev_rebuild_thread;
+	/* Protects vdev_rebuild_thread and vdev_rebuild_config. */
+	kmutex_t	vdev_rebuild_lock;
+	kcondvar_t	vdev_rebuild_cv;
+	vdev_rebuild_t	vdev_rebuild_config;
+
+	/* for limiting outstanding rebuild I/Os */
+	kmutex_t	vdev_rebuild_io_lock;
+	kcondvar_t	vdev_rebuild_io_cv;
+	uint64_t	vdev_rebuild_inflight;
+
 	/*
 	 * Values stored in the config for an indirect or removing vdev.
 	 */
@@ -453,6 +475,8 @@ extern vdev_ops_t vdev_root_ops;
 extern vdev_ops_t vdev_mirror_ops;
 extern vdev_ops_t vdev_replacing_ops;
 extern vdev_ops_t vdev_raidz_ops;
+extern vdev_ops_t vdev_draid_ops;
+extern vdev_ops_t vdev_draid_spare_ops;
 extern vdev_ops_t vdev_disk_ops;
 extern vdev_ops_t vdev_file_ops;
 extern vdev_ops_t vdev_missing_ops;
@@ -463,9 +487,10 @@ extern vdev_ops_t vdev_indirect_ops;
 /*
  * Common size functions
  */
-extern void vdev_default_xlate(vdev_t *vd, const range_seg_t *in,
-    range_seg_t *out);
-extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize);
+extern void vdev_default_xlate(vdev_t *vd, const range_seg64_t *in,
+    range_seg64_t *out, range_seg64_t *remain);
+extern uint64_t vdev_default_asize(vdev_t *vd, uint64_t psize,
+    uint64_t txg);
 extern uint64_t vdev_get_min_asize(vdev_t *vd);
 extern void vdev_set_min_asize(vdev_t *vd);
 
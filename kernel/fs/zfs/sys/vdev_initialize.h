@@ -36,8 +36,16 @@ extern void vdev_initialize_stop(vdev_t *vd,
 extern void vdev_initialize_stop_all(vdev_t *vd,
     vdev_initializing_state_t tgt_state);
 extern void vdev_initialize_restart(vdev_t *vd);
-extern void vdev_xlate(vdev_t *vd, const range_seg_t *logical_rs,
-    range_seg_t *physical_rs);
+typedef void vdev_xlate_func_t(void *arg, range_seg64_t *physical_rs);
+
+extern boolean_t vdev_xlate_is_empty(range_seg64_t *rs);
+extern void vdev_xlate(vdev_t *vd, const range_seg64_t *logical_rs,
+    range_seg64_t *physical_rs, range_seg64_t *remain_rs);
+extern void vdev_xlate_walk(vdev_t *vd, const range_seg64_t *logical_rs,
+    vdev_xlate_func_t *func, void *arg);
+extern void vdev_initialize_ms_load(metaslab_t *msp);
+extern void vdev_initialize_ms_mark(metaslab_t *msp);
+extern void vdev_initialize_ms_unmark(metaslab_t *msp);
 
 #ifdef	__cplusplus
 }
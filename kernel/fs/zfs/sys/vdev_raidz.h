@@ -26,6 +26,8 @@
 #define	_SYS_VDEV_RAIDZ_H
 
 #include <sys/vdev.h>
+#include <sys/txg.h>
+#include <sys/zfs_rlock.h>
 #include <sys/semaphore.h>
 #ifdef _KERNEL
 #include <sys/ddi.h>
@@ -37,6 +39,59 @@
 extern "C" {
 #endif
 
+/*
+ * State of the most recent RAID-Z expansion, stored in the MOS directory
+ * under DMU_POOL_RAIDZ_EXPAND.  All members must be uint64_t, for
+ * byteswap purposes.
+ */
+typedef struct vdev_raidz_expand_phys {
+	uint64_t vrep_state;		/* dsl_scan_state_t */
+	uint64_t vrep_vdev;		/* top-level vdev being expanded */
+	uint64_t vrep_start_time;
+	uint64_t vrep_end_time;
+	uint64_t vrep_to_reflow;	/* bytes that need to be reflowed */
+	uint64_t vrep_reflowed;		/* bytes reflowed and synced */
+} vdev_raidz_expand_phys_t;
+
+/*
+ * In-core state of a RAID-Z expansion.  The vdev's logical address space
+ * below vre_offset is laid out across all children; above it, the newest
+ * child is not used yet.  The synced value of vre_offset is kept in the
+ * uberblock (ub_raidz_reflow_info).
+ */
+typedef struct vdev_raidz_expand {
+	uint64_t	vre_vdev_id;
+	kmutex_t	vre_lock;
+	kcondvar_t	vre_cv;
+	kthread_t	*vre_thread;
+	boolean_t	vre_thread_exit;
+
+	/*
+	 * Only changes while the range being reflowed is locked as writer
+	 * in vre_rangelock; every I/O to the expanding vdev holds its range
+	 * as reader, and so sees a stable value.
+	 */
+	uint64_t	vre_offset;
+	uint64_t	vre_offset_pertxg[TXG_SIZE];
+	rangelock_t	vre_rangelock;
+
+	/* Offset at which reflow stopped due to an I/O error, or -1. */
+	uint64_t	vre_failed_offset;
+} vdev_raidz_expand_t;
+
+extern uint64_t vdev_raidz_logical_width(vdev_t *, uint64_t);
+extern int vdev_raidz_attach_check(vdev_t *);
+extern void vdev_raidz_attach_sync(void *, dmu_tx_t *);
+extern void spa_raidz_expand_create(spa_t *, vdev_t *);
+extern int spa_raidz_expand_init(spa_t *);
+extern void spa_raidz_expand_restart(spa_t *);
+extern void spa_raidz_expand_suspend(spa_t *);
+extern void spa_raidz_expand_destroy(spa_t *);
+extern void spa_raidz_expand_done(spa_t *);
+extern int spa_raidz_expand_get_stats(spa_t *, pool_raidz_expand_stat_t *);
+
+extern uint64_t zfs_raidz_expand_max_copy_bytes;
+
 #ifdef _KERNEL
 extern int vdev_raidz_physio(vdev_t *,
     caddr_t, size_t, uint64_t, uint64_t, boolean_t, boolean_t);
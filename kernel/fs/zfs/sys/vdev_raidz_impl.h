@@ -0,0 +1,89 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_VDEV_RAIDZ_IMPL_H
+#define	_SYS_VDEV_RAIDZ_IMPL_H
+
+#include <sys/types.h>
+#include <sys/zio.h>
+#include <sys/abd.h>
+#include <sys/zfs_rlock.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * The RAID-Z map describes how a block is laid out across the columns of
+ * a RAID-Z stripe.  It is shared with the dRAID vdev, whose stripes are
+ * RAID-Z stripes placed on a permutation of its children (see
+ * vdev_draid.c).
+ */
+typedef struct raidz_col {
+	uint64_t rc_devidx;		/* child device index for I/O */
+	uint64_t rc_offset;		/* device offset */
+	uint64_t rc_size;		/* I/O size */
+	abd_t *rc_abd;			/* I/O data */
+	void *rc_gdata;			/* used to store the "good" version */
+	int rc_error;			/* I/O error for this device */
+	uint8_t rc_tried;		/* Did we attempt this I/O column? */
+	uint8_t rc_skipped;		/* Did we skip this I/O column? */
+	uint64_t rc_shadow_devidx;	/* old location during expansion */
+	uint64_t rc_shadow_offset;	/* or UINT64_MAX if none */
+} raidz_col_t;
+
+typedef struct raidz_map {
+	uint64_t rm_cols;		/* Regular column count */
+	uint64_t rm_scols;		/* Count including skipped columns */
+	uint64_t rm_bigcols;		/* Number of oversized columns */
+	uint64_t rm_asize;		/* Actual total I/O size */
+	uint64_t rm_missingdata;	/* Count of missing data devices */
+	uint64_t rm_missingparity;	/* Count of missing parity devices */
+	uint64_t rm_firstdatacol;	/* First data column/parity count */
+	uint64_t rm_nskip;		/* Skipped sectors for padding */
+	uint64_t rm_skipstart;		/* Column index of padding start */
+	abd_t *rm_abd_copy;		/* rm_asize-buffer of copied data */
+	uintptr_t rm_reports;		/* # of referencing checksum reports */
+	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
+	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
+	uint64_t rm_nrows;		/* Number of rows, if split */
+	struct raidz_map **rm_row;	/* Per-row maps, see below */
+	locked_range_t *rm_lr;		/* Held against reflow, or NULL */
+	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
+} raidz_map_t;
+
+extern const zio_vsd_ops_t vdev_raidz_vsd_ops;
+
+extern raidz_map_t *vdev_raidz_map_alloc(abd_t *, uint64_t, uint64_t,
+    uint64_t, uint64_t, uint64_t);
+extern void vdev_raidz_map_free(raidz_map_t *);
+extern void vdev_raidz_generate_parity(raidz_map_t *);
+extern void vdev_raidz_io_start_write(zio_t *, raidz_map_t *);
+extern void vdev_raidz_io_start_read(zio_t *, raidz_map_t *);
+extern void vdev_raidz_io_done(zio_t *);
+extern void vdev_raidz_child_done(zio_t *);
+extern void vdev_raidz_state_change(vdev_t *, int, int);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_VDEV_RAIDZ_IMPL_H */
@@ -0,0 +1,73 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#ifndef _SYS_VDEV_REBUILD_H
+#define	_SYS_VDEV_REBUILD_H
+
+#include <sys/spa.h>
+#include <sys/txg.h>
+#include <sys/range_tree.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * The on-disk state of a sequential rebuild, stored as an array of
+ * uint64_t's in the top-level vdev's ZAP under
+ * VDEV_TOP_ZAP_VDEV_REBUILD_PHYS.  New fields may only be appended.
+ */
+typedef struct vdev_rebuild_phys {
+	uint64_t	vrp_rebuild_state;	/* vdev_rebuild_state_t */
+	uint64_t	vrp_last_offset;	/* last rebuilt offset */
+	uint64_t	vrp_max_txg;		/* rebuild blocks born before */
+	uint64_t	vrp_start_time;		/* start time */
+	uint64_t	vrp_end_time;		/* end time */
+	uint64_t	vrp_bytes_scanned;	/* allocated bytes rebuilt */
+	uint64_t	vrp_bytes_est;		/* allocated bytes to rebuild */
+	uint64_t	vrp_errors;		/* read errors */
+} vdev_rebuild_phys_t;
+
+#define	REBUILD_PHYS_ENTRIES	\
+	(sizeof (vdev_rebuild_phys_t) / sizeof (uint64_t))
+
+/*
+ * The in-core state of a sequential rebuild of a top-level vdev.  The
+ * thread, locks and flags are in the vdev_t.
+ */
+typedef struct vdev_rebuild {
+	vdev_t		*vr_top_vdev;		/* top-level vdev */
+	range_tree_t	*vr_scan_tree;		/* valid while rebuilding */
+	uint64_t	vr_scan_offset[TXG_SIZE]; /* last offset per txg */
+	vdev_rebuild_phys_t vr_rebuild_phys;
+} vdev_rebuild_t;
+
+extern void vdev_rebuild(vdev_t *, uint64_t);
+extern boolean_t vdev_rebuild_active(vdev_t *);
+extern void vdev_rebuild_stop_all(spa_t *);
+extern void vdev_rebuild_restart(spa_t *);
+extern int vdev_rebuild_get_stats(vdev_t *, vdev_rebuild_stat_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* _SYS_VDEV_REBUILD_H */
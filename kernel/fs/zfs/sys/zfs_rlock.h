@@ -43,9 +43,23 @@ struct locked_range;
 
 typedef void (rangelock_cb_t)(struct locked_range *, void *);
 
+/*
+ * The range lock is split into shards.  The offset space is divided into
+ * stripes of (1 << rl_shift) bytes and stripe N is tracked by the shard
+ * (N % RANGELOCK_SHARDS), so that locks on disjoint regions of the same
+ * file rarely contend on the same mutex.
+ */
+#define	RANGELOCK_SHARDS	8
+#define	RANGELOCK_ALL_SHARDS	((1U << RANGELOCK_SHARDS) - 1)
+
+typedef struct rangelock_shard {
+	kmutex_t rls_lock;
+	avl_tree_t rls_tree;	/* contains locked_range_t */
+} rangelock_shard_t;
+
 typedef struct rangelock {
-	avl_tree_t rl_tree; /* contains locked_range_t */
-	kmutex_t rl_lock;
+	rangelock_shard_t rl_shard[RANGELOCK_SHARDS];
+	uint_t rl_shift;	/* log2 of the stripe size */
 	rangelock_cb_t *rl_cb;
 	void *rl_arg;
 } rangelock_t;
@@ -56,9 +70,11 @@ typedef struct locked_range {
 	uint64_t lr_offset;	/* file range offset */
 	uint64_t lr_length;	/* file range length */
 	uint_t lr_count;	/* range reference count in tree */
+	uint_t lr_shards;	/* bitmap of shards holding this range */
 	rangelock_type_t lr_type; /* range type */
 	kcondvar_t lr_write_cv;	/* cv for waiting writers */
 	kcondvar_t lr_read_cv;	/* cv for waiting readers */
+	struct locked_range *lr_sub; /* per-shard entries, if more than one */
 	uint8_t lr_proxy;	/* acting for original range */
 	uint8_t lr_write_wanted; /* writer wants to lock this range */
 	uint8_t lr_read_wanted;	/* reader wants to lock this range */
@@ -50,6 +50,9 @@
 #include <sys/dsl_scan.h>
 #include <sys/abd.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_raidz.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_rebuild.h>
 
 /*
  * Virtual device management.
@@ -58,6 +61,8 @@
 static vdev_ops_t *vdev_ops_table[] = {
 	&vdev_root_ops,
 	&vdev_raidz_ops,
+	&vdev_draid_ops,
+	&vdev_draid_spare_ops,
 	&vdev_mirror_ops,
 	&vdev_replacing_ops,
 	&vdev_spare_ops,
@@ -194,7 +199,8 @@ vdev_getops(const char *type)
 
 /* ARGSUSED */
 void
-vdev_default_xlate(vdev_t *vd, const range_seg_t *in, range_seg_t *res)
+vdev_default_xlate(vdev_t *vd, const range_seg64_t *in,
+    range_seg64_t *res, range_seg64_t *remain)
 {
 	res->rs_start = in->rs_start;
 	res->rs_end = in->rs_end;
@@ -205,13 +211,13 @@ vdev_default_xlate(vdev_t *vd, const range_seg_t *in, range_seg_t *res)
  * all children.  This is what's used by anything other than RAID-Z.
  */
 uint64_t
-vdev_default_asize(vdev_t *vd, uint64_t psize)
+vdev_default_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	uint64_t asize = P2ROUNDUP(psize, 1ULL << vd->vdev_top->vdev_ashift);
 	uint64_t csize;
 
 	for (int c = 0; c < vd->vdev_children; c++) {
-		csize = vdev_psize_to_asize(vd->vdev_child[c], psize);
+		csize = vdev_psize_to_asize_txg(vd->vdev_child[c], psize, txg);
 		asize = MAX(asize, csize);
 	}
 
@@ -247,9 +253,14 @@ vdev_get_min_asize(vdev_t *vd)
 	 * The allocatable space for a raidz vdev is N * sizeof(smallest child),
 	 * so each child must provide at least 1/Nth of its asize.
 	 */
-	if (pvd->vdev_ops == &vdev_raidz_ops)
-		return ((pvd->vdev_min_asize + pvd->vdev_children - 1) /
-		    pvd->vdev_children);
+	if (pvd->vdev_ops == &vdev_raidz_ops) {
+		uint64_t width = vdev_raidz_logical_width(pvd, UINT64_MAX);
+
+		return ((pvd->vdev_min_asize + width - 1) / width);
+	}
+
+	if (pvd->vdev_ops == &vdev_draid_ops)
+		return (vdev_draid_min_asize(pvd));
 
 	return (pvd->vdev_min_asize);
 }
@@ -474,6 +485,10 @@ vdev_alloc_common(spa_t *spa, uint_t id, uint64_t guid, vdev_ops_t *ops)
 	mutex_init(&vd->vdev_initialize_io_lock, NULL, MUTEX_DEFAULT, NULL);
 	cv_init(&vd->vdev_initialize_cv, NULL, CV_DEFAULT, NULL);
 	cv_init(&vd->vdev_initialize_io_cv, NULL, CV_DEFAULT, NULL);
+	mutex_init(&vd->vdev_rebuild_lock, NULL, MUTEX_DEFAULT, NULL);
+	mutex_init(&vd->vdev_rebuild_io_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&vd->vdev_rebuild_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&vd->vdev_rebuild_io_cv, NULL, CV_DEFAULT, NULL);
 
 	for (int t = 0; t < DTL_TYPES; t++) {
 		vd->vdev_dtl[t] = range_tree_create(NULL, NULL);
@@ -503,6 +518,8 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	uint64_t guid = 0, islog, nparity;
 	vdev_t *vd;
 	vdev_indirect_config_t *vic;
+	void *tsd = NULL;
+	int error;
 
 	ASSERT(spa_config_held(spa, SCL_ALL, RW_WRITER) == SCL_ALL);
 
@@ -554,10 +571,10 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 		return (SET_ERROR(ENOTSUP));
 
 	/*
-	 * Set the nparity property for RAID-Z vdevs.
+	 * Set the nparity property for RAID-Z and dRAID vdevs.
 	 */
 	nparity = -1ULL;
-	if (ops == &vdev_raidz_ops) {
+	if (ops == &vdev_raidz_ops || ops == &vdev_draid_ops) {
 		if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY,
 		    &nparity) == 0) {
 			if (nparity == 0 || nparity > VDEV_RAIDZ_MAXPARITY)
@@ -589,11 +606,52 @@ vdev_alloc(spa_t *spa, vdev_t **vdp, nvlist_t *nv, vdev_t *parent, uint_t id,
 	}
 	ASSERT(nparity != -1ULL);
 
+	/*
+	 * Set up the geometry of a dRAID vdev, or find the dRAID vdev a
+	 * distributed spare belongs to.
+	 */
+	if (ops == &vdev_draid_ops) {
+		error = vdev_draid_config_alloc(nv, nparity,
+		    (vdev_draid_config_t **)&tsd);
+		if (error != 0)
+			return (error);
+	} else if (ops == &vdev_draid_spare_ops) {
+		error = vdev_draid_spare_config_alloc(spa, nv,
+		    (vdev_draid_spare_t **)&tsd);
+		if (error != 0)
+			return (error);
+	}
+
 	vd = vdev_alloc_common(spa, id, guid, ops);
 	vic = &vd->vdev_indirect_config;
 
 	vd->vdev_islog = islog;
 	vd->vdev_nparity = nparity;
+	if (tsd != NULL)
+		vd->vdev_tsd = tsd;
+
+	/*
+	 * Retrieve the RAID-Z expansion history, which determines the
+	 * stripe width of each block on this vdev.
+	 */
+	if (ops == &vdev_raidz_ops) {
+		uint64_t expanding = 0;
+		uint64_t *txgs;
+		uint_t count;
+
+		(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_RAIDZ_EXPANDING,
+		    &expanding);
+		vd->vdev_rz_expanding = (expanding != 0);
+		if (nvlist_lookup_uint64_array(nv,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS, &txgs, &count) == 0 &&
+		    count != 0) {
+			vd->vdev_rz_expand_txgs =
+			    kmem_alloc(count * sizeof (uint64_t), KM_SLEEP);
+			bcopy(txgs, vd->vdev_rz_expand_txgs,
+			    count * sizeof (uint64_t));
+			vd->vdev_rz_expand_count = count;
+		}
+	}
 
 	if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &vd->vdev_path) == 0)
 		vd->vdev_path = spa_strdup(vd->vdev_path);
@@ -767,6 +825,7 @@ vdev_free(vdev_t *vd)
 	ASSERT(vd->vdev_child == NULL);
 	ASSERT(vd->vdev_guid_sum == vd->vdev_guid);
 	ASSERT(vd->vdev_initialize_thread == NULL);
+	ASSERT(vd->vdev_rebuild_thread == NULL);
 
 	/*
 	 * Discard allocation state.
@@ -801,6 +860,13 @@ vdev_free(vdev_t *vd)
 		spa_strfree(vd->vdev_physpath);
 	if (vd->vdev_fru)
 		spa_strfree(vd->vdev_fru);
+	if (vd->vdev_rz_expand_txgs != NULL) {
+		kmem_free(vd->vdev_rz_expand_txgs,
+		    vd->vdev_rz_expand_count * sizeof (uint64_t));
+	}
+	if (vd->vdev_ops == &vdev_draid_ops ||
+	    vd->vdev_ops == &vdev_draid_spare_ops)
+		vdev_draid_free(vd);
 
 	if (vd->vdev_isspare)
 		spa_spare_remove(vd);
@@ -843,6 +909,10 @@ vdev_free(vdev_t *vd)
 	mutex_destroy(&vd->vdev_initialize_io_lock);
 	cv_destroy(&vd->vdev_initialize_io_cv);
 	cv_destroy(&vd->vdev_initialize_cv);
+	mutex_destroy(&vd->vdev_rebuild_lock);
+	mutex_destroy(&vd->vdev_rebuild_io_lock);
+	cv_destroy(&vd->vdev_rebuild_cv);
+	cv_destroy(&vd->vdev_rebuild_io_cv);
 
 	if (vd == spa->spa_root_vdev)
 		spa->spa_root_vdev = NULL;
@@ -1362,6 +1432,8 @@ vdev_open_children(vdev_t *vd)
  * in 128k (1 << 17) because it is the "typical" blocksize.
  * Even though SPA_MAXBLOCKSIZE changed, this algorithm can not change,
  * otherwise it would inconsistently account for existing bp's.
+ * For the same reason an expanded RAID-Z vdev keeps the ratio of its
+ * original stripe width.
  */
 static void
 vdev_set_deflate_ratio(vdev_t *vd)
@@ -2215,14 +2287,11 @@ vdev_dtl_empty(vdev_t *vd, vdev_dtl_type_t t)
 static uint64_t
 vdev_dtl_min(vdev_t *vd)
 {
-	range_seg_t *rs;
-
 	ASSERT(MUTEX_HELD(&vd->vdev_dtl_lock));
 	ASSERT3U(range_tree_space(vd->vdev_dtl[DTL_MISSING]), !=, 0);
 	ASSERT0(vd->vdev_children);
 
-	rs = avl_first(&vd->vdev_dtl[DTL_MISSING]->rt_root);
-	return (rs->rs_start - 1);
+	return (range_tree_min(vd->vdev_dtl[DTL_MISSING]) - 1);
 }
 
 /*
@@ -2231,14 +2300,11 @@ vdev_dtl_min(vdev_t *vd)
 static uint64_t
 vdev_dtl_max(vdev_t *vd)
 {
-	range_seg_t *rs;
-
 	ASSERT(MUTEX_HELD(&vd->vdev_dtl_lock));
 	ASSERT3U(range_tree_space(vd->vdev_dtl[DTL_MISSING]), !=, 0);
 	ASSERT0(vd->vdev_children);
 
-	rs = avl_last(&vd->vdev_dtl[DTL_MISSING]->rt_root);
-	return (rs->rs_end);
+	return (range_tree_max(vd->vdev_dtl[DTL_MISSING]));
 }
 
 /*
@@ -2250,19 +2316,31 @@ vdev_dtl_max(vdev_t *vd)
  * excise the DTLs.
  */
 static boolean_t
-vdev_dtl_should_excise(vdev_t *vd)
+vdev_dtl_should_excise(vdev_t *vd, uint64_t scrub_txg, boolean_t rebuild_done)
 {
 	spa_t *spa = vd->vdev_spa;
 	dsl_scan_t *scn = spa->spa_dsl_pool->dp_scan;
 
-	ASSERT0(scn->scn_phys.scn_errors);
+	ASSERT(rebuild_done || scn->scn_phys.scn_errors == 0);
 	ASSERT0(vd->vdev_children);
 
 	if (vd->vdev_state < VDEV_STATE_DEGRADED)
 		return (B_FALSE);
 
-	if (vd->vdev_resilver_txg == 0 ||
-	    range_tree_is_empty(vd->vdev_dtl[DTL_MISSING]))
+	if (range_tree_is_empty(vd->vdev_dtl[DTL_MISSING]))
+		return (B_TRUE);
+
+	/*
+	 * A sequential rebuild repairs every block born before scrub_txg,
+	 * so it covers any device whose DTL starts at TXG_INITIAL, as it
+	 * does when the device is attached, and doesn't extend past that.
+	 */
+	if (rebuild_done) {
+		return (range_tree_contains(vd->vdev_dtl[DTL_MISSING],
+		    TXG_INITIAL, 1) && vdev_dtl_max(vd) <= scrub_txg);
+	}
+
+	if (vd->vdev_resilver_txg == 0)
 		return (B_TRUE);
 
 	/*
@@ -2282,10 +2360,12 @@ vdev_dtl_should_excise(vdev_t *vd)
 }
 
 /*
- * Reassess DTLs after a config change or scrub completion.
+ * Reassess DTLs after a config change, scrub completion, or sequential
+ * rebuild completion.
  */
 void
-vdev_dtl_reassess(vdev_t *vd, uint64_t txg, uint64_t scrub_txg, int scrub_done)
+vdev_dtl_reassess(vdev_t *vd, uint64_t txg, uint64_t scrub_txg,
+    int scrub_done, boolean_t rebuild_done)
 {
 	spa_t *spa = vd->vdev_spa;
 	avl_tree_t reftree;
@@ -2295,7 +2375,7 @@ vdev_dtl_reassess(vdev_t *vd, uint64_t txg, uint64_t scrub_txg, int scrub_done)
 
 	for (int c = 0; c < vd->vdev_children; c++)
 		vdev_dtl_reassess(vd->vdev_child[c], txg,
-		    scrub_txg, scrub_done);
+		    scrub_txg, scrub_done, rebuild_done);
 
 	if (vd == spa->spa_root_vdev || !vdev_is_concrete(vd) || vd->vdev_aux)
 		return;
@@ -2312,12 +2392,12 @@ vdev_dtl_reassess(vdev_t *vd, uint64_t txg, uint64_t scrub_txg, int scrub_done)
 		 * the entire duration of this scan.
 		 */
 		if (scrub_txg != 0 &&
-		    (spa->spa_scrub_started ||
+		    (rebuild_done || spa->spa_scrub_started ||
 		    (scn != NULL && scn->scn_phys.scn_errors == 0)) &&
-		    vdev_dtl_should_excise(vd)) {
+		    vdev_dtl_should_excise(vd, scrub_txg, rebuild_done)) {
 			/*
-			 * We completed a scrub up to scrub_txg.  If we
-			 * did it without rebooting, then the scrub dtl
+			 * We completed a scrub (or rebuild) up to scrub_txg.
+			 * If we did it without rebooting, then the scrub dtl
 			 * will be valid, so excise the old region and
 			 * fold in the scrub dtl.  Otherwise, leave the
 			 * dtl as-is if there was an error.
@@ -2580,10 +2660,10 @@ vdev_dtl_required(vdev_t *vd)
 	 * If not, we can safely offline/detach/remove the device.
 	 */
 	vd->vdev_cant_read = B_TRUE;
-	vdev_dtl_reassess(tvd, 0, 0, B_FALSE);
+	vdev_dtl_reassess(tvd, 0, 0, B_FALSE, B_FALSE);
 	required = !vdev_dtl_empty(tvd, DTL_OUTAGE);
 	vd->vdev_cant_read = cant_read;
-	vdev_dtl_reassess(tvd, 0, 0, B_FALSE);
+	vdev_dtl_reassess(tvd, 0, 0, B_FALSE, B_FALSE);
 
 	if (!required && zio_injection_enabled)
 		required = !!zio_handle_device_injection(vd, NULL, ECHILD);
@@ -2959,10 +3039,23 @@ vdev_sync(vdev_t *vd, uint64_t txg)
 	(void) txg_list_add(&spa->spa_vdev_txg_list, vd, TXG_CLEAN(txg));
 }
 
+/*
+ * Return the allocated size of a block of the given psize born in the
+ * given txg.  The answer only depends on the txg for RAID-Z vdevs that
+ * have been expanded, since blocks keep the stripe width they were
+ * written with.  A txg of 0 yields the size under the vdev's original
+ * layout.
+ */
+uint64_t
+vdev_psize_to_asize_txg(vdev_t *vd, uint64_t psize, uint64_t txg)
+{
+	return (vd->vdev_ops->vdev_op_asize(vd, psize, txg));
+}
+
 uint64_t
 vdev_psize_to_asize(vdev_t *vd, uint64_t psize)
 {
-	return (vd->vdev_ops->vdev_op_asize(vd, psize));
+	return (vdev_psize_to_asize_txg(vd, psize, 0));
 }
 
 /*
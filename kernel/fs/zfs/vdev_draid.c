@@ -0,0 +1,979 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_raidz_impl.h>
+#include <sys/vdev_draid.h>
+#include <sys/zio.h>
+#include <sys/abd.h>
+#include <sys/zfeature.h>
+#include <sys/dmu_tx.h>
+#include <sys/fs/zfs.h>
+
+/*
+ * Distributed RAID (dRAID)
+ *
+ * A dRAID vdev is a RAID-Z vdev whose redundancy groups are spread across
+ * a larger number of children, together with some spare capacity that is
+ * spread across all of them as well.  Each redundancy group is a RAID-Z
+ * stripe of vdc_groupwidth (ndata + nparity) columns, and each block is
+ * written to a single group, exactly as it would be to a RAID-Z vdev of
+ * that width.  The difference is in where the columns of a group live.
+ *
+ * The children are divided into rows of VDEV_DRAID_ROWHEIGHT bytes, and
+ * consecutive rows are grouped into slices.  Each slice has its own
+ * pseudo-random permutation of the children; the first vdc_ndisks
+ * children of the permutation hold the slice's groups, packed back to back
+ * (a group may wrap from the last of them onto the next row of the
+ * first), and the remaining vdc_nspares children hold nothing but are
+ * that slice's share of the distributed spares.  A slice holds exactly
+ * vdc_ngroups groups, which is the smallest number of groups that fill
+ * whole rows of all vdc_ndisks children.
+ *
+ * Logically, the vdev is laid out as a sequence of groups, each one row
+ * tall and vdc_groupwidth sectors wide: logical row L (of one sector
+ * per column) is in group L / (VDEV_DRAID_ROWHEIGHT >> ashift).  Since
+ * every block is allocated on a groupwidth-aligned offset and rounded up
+ * to whole logical rows (see vdev_draid_asize()), its columns start at
+ * column 0 of some logical row.  A block that crosses from one group to
+ * the next is accessed one logical row at a time, as RAID-Z does for
+ * blocks written before an expansion.
+ *
+ * When a child fails, each of its rows can be rebuilt onto the spare
+ * space of the same slice, which is spread over all of the surviving
+ * children rather than a single hot spare, so all of them share the work
+ * of the rebuild.  Each distributed spare is a leaf vdev of type "dspare"
+ * that forwards its I/O to the child which holds that spare in the slice
+ * being accessed.  Because the layout of every block is fixed by its
+ * offset alone, a dRAID vdev can be rebuilt sequentially, without
+ * traversing the block pointers (see vdev_rebuild.c).
+ *
+ * The permutations are generated from a fixed seed, so the layout of a
+ * dRAID vdev depends only on its number of children; it is part of the
+ * on-disk format and must never change.
+ */
+
+#define	VDEV_DRAID_SEED0	0x2d0b6e3c6e8a49d1ULL
+#define	VDEV_DRAID_SEED1	0x9a6d2ca5d4c1e6f3ULL
+
+static uint64_t
+vdev_draid_gcd(uint64_t a, uint64_t b)
+{
+	while (b != 0) {
+		uint64_t t = a % b;
+		a = b;
+		b = t;
+	}
+	return (a);
+}
+
+/*
+ * xorshift128+, used only to generate the permutations.
+ */
+static uint64_t
+vdev_draid_rand(uint64_t *s)
+{
+	uint64_t s1 = s[0];
+	const uint64_t s0 = s[1];
+	const uint64_t result = s0 + s1;
+
+	s[0] = s0;
+	s1 ^= s1 << 23;
+	s[1] = s1 ^ s0 ^ (s1 >> 18) ^ (s0 >> 5);
+
+	return (result);
+}
+
+static void
+vdev_draid_generate_perms(vdev_draid_config_t *vdc)
+{
+	uint64_t children = vdc->vdc_children;
+	uint64_t s[2];
+
+	s[0] = VDEV_DRAID_SEED0 ^ children;
+	s[1] = VDEV_DRAID_SEED1 ^ children;
+
+	for (uint64_t p = 0; p < VDEV_DRAID_NPERMS; p++) {
+		uint8_t *perm = &vdc->vdc_perms[p * children];
+
+		for (uint64_t i = 0; i < children; i++)
+			perm[i] = i;
+
+		for (uint64_t i = children - 1; i > 0; i--) {
+			uint64_t j = vdev_draid_rand(s) % (i + 1);
+			uint8_t t = perm[i];
+
+			perm[i] = perm[j];
+			perm[j] = t;
+		}
+	}
+}
+
+static const uint8_t *
+vdev_draid_perm(const vdev_draid_config_t *vdc, uint64_t slice)
+{
+	return (&vdc->vdc_perms[(slice % VDEV_DRAID_NPERMS) *
+	    vdc->vdc_children]);
+}
+
+/*
+ * Find the child and child offset holding the given column of the given
+ * logical row.
+ */
+static void
+vdev_draid_map_sector(const vdev_draid_config_t *vdc, uint64_t ashift,
+    uint64_t lrow, uint64_t col, uint64_t *devidx, uint64_t *offset)
+{
+	uint64_t rowsectors = VDEV_DRAID_ROWHEIGHT >> ashift;
+	uint64_t group = lrow / rowsectors;
+	uint64_t slice = group / vdc->vdc_ngroups;
+	uint64_t gidx = group % vdc->vdc_ngroups;
+	uint64_t pos = (gidx * vdc->vdc_groupwidth) % vdc->vdc_ndisks + col;
+	uint64_t row = slice * vdc->vdc_rows +
+	    (gidx * vdc->vdc_groupwidth) / vdc->vdc_ndisks;
+
+	ASSERT3U(col, <, vdc->vdc_groupwidth);
+
+	if (pos >= vdc->vdc_ndisks) {
+		pos -= vdc->vdc_ndisks;
+		row++;
+	}
+
+	*devidx = vdev_draid_perm(vdc, slice)[pos];
+	*offset = row * VDEV_DRAID_ROWHEIGHT +
+	    ((lrow % rowsectors) << ashift);
+}
+
+/*
+ * Find the child which holds the given distributed spare at the given
+ * offset.
+ */
+static uint64_t
+vdev_draid_spare_child(const vdev_draid_config_t *vdc, uint64_t spare_id,
+    uint64_t offset)
+{
+	uint64_t slice = (offset / VDEV_DRAID_ROWHEIGHT) / vdc->vdc_rows;
+
+	ASSERT3U(spare_id, <, vdc->vdc_nspares);
+	return (vdev_draid_perm(vdc, slice)[vdc->vdc_ndisks + spare_id]);
+}
+
+int
+vdev_draid_config_alloc(nvlist_t *nv, uint64_t nparity,
+    vdev_draid_config_t **vdcp)
+{
+	vdev_draid_config_t *vdc;
+	nvlist_t **child;
+	uint_t children;
+	uint64_t ndata, nspares = 0, ngroups;
+
+	if (nvlist_lookup_nvlist_array(nv, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) != 0 ||
+	    nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_NDATA, &ndata) != 0)
+		return (SET_ERROR(EINVAL));
+	(void) nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_NSPARES, &nspares);
+
+	if (children > VDEV_DRAID_MAX_CHILDREN || ndata == 0 ||
+	    nparity == 0 || nparity > VDEV_RAIDZ_MAXPARITY ||
+	    nspares >= children || ndata + nparity > children - nspares)
+		return (SET_ERROR(EINVAL));
+
+	vdc = kmem_zalloc(sizeof (*vdc), KM_SLEEP);
+	vdc->vdc_ndata = ndata;
+	vdc->vdc_nparity = nparity;
+	vdc->vdc_nspares = nspares;
+	vdc->vdc_children = children;
+	vdc->vdc_groupwidth = ndata + nparity;
+	vdc->vdc_ndisks = children - nspares;
+	vdc->vdc_ngroups = vdc->vdc_ndisks /
+	    vdev_draid_gcd(vdc->vdc_groupwidth, vdc->vdc_ndisks);
+	vdc->vdc_rows = vdc->vdc_ngroups * vdc->vdc_groupwidth /
+	    vdc->vdc_ndisks;
+
+	/*
+	 * The group count is derived from the rest of the geometry; if the
+	 * config has one, it must agree.
+	 */
+	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_NGROUPS,
+	    &ngroups) == 0 && ngroups != vdc->vdc_ngroups) {
+		kmem_free(vdc, sizeof (*vdc));
+		return (SET_ERROR(EINVAL));
+	}
+
+	vdc->vdc_perms = kmem_alloc(VDEV_DRAID_NPERMS * children, KM_SLEEP);
+	vdev_draid_generate_perms(vdc);
+
+	*vdcp = vdc;
+	return (0);
+}
+
+/*
+ * The owning dRAID vdev and spare index are normally in the config of a
+ * distributed spare.  When a spare is named as the new device of a
+ * "zpool replace", only its path is given, so find it among the pool's
+ * spares.
+ */
+int
+vdev_draid_spare_config_alloc(spa_t *spa, nvlist_t *nv,
+    vdev_draid_spare_t **vdsp)
+{
+	vdev_draid_spare_t *vds;
+	uint64_t top_guid, spare_id;
+	nvlist_t **spares;
+	uint_t nspares;
+	char *path, *spath;
+	uint_t i;
+
+	if (nvlist_lookup_uint64(nv, ZPOOL_CONFIG_TOP_GUID, &top_guid) != 0 ||
+	    nvlist_lookup_uint64(nv, ZPOOL_CONFIG_DRAID_SPARE_ID,
+	    &spare_id) != 0) {
+		if (nvlist_lookup_string(nv, ZPOOL_CONFIG_PATH, &path) != 0 ||
+		    spa->spa_spares.sav_config == NULL ||
+		    nvlist_lookup_nvlist_array(spa->spa_spares.sav_config,
+		    ZPOOL_CONFIG_SPARES, &spares, &nspares) != 0)
+			return (SET_ERROR(EINVAL));
+
+		for (i = 0; i < nspares; i++) {
+			if (nvlist_lookup_string(spares[i], ZPOOL_CONFIG_PATH,
+			    &spath) == 0 && strcmp(path, spath) == 0 &&
+			    nvlist_lookup_uint64(spares[i],
+			    ZPOOL_CONFIG_TOP_GUID, &top_guid) == 0 &&
+			    nvlist_lookup_uint64(spares[i],
+			    ZPOOL_CONFIG_DRAID_SPARE_ID, &spare_id) == 0)
+				break;
+		}
+		if (i == nspares)
+			return (SET_ERROR(EINVAL));
+	}
+
+	vds = kmem_zalloc(sizeof (*vds), KM_SLEEP);
+	vds->vds_top_guid = top_guid;
+	vds->vds_spare_id = spare_id;
+
+	*vdsp = vds;
+	return (0);
+}
+
+void
+vdev_draid_free(vdev_t *vd)
+{
+	if (vd->vdev_tsd == NULL)
+		return;
+
+	if (vd->vdev_ops == &vdev_draid_ops) {
+		vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+		kmem_free(vdc->vdc_perms,
+		    VDEV_DRAID_NPERMS * vdc->vdc_children);
+		kmem_free(vdc, sizeof (*vdc));
+	} else {
+		ASSERT3P(vd->vdev_ops, ==, &vdev_draid_spare_ops);
+		kmem_free(vd->vdev_tsd, sizeof (vdev_draid_spare_t));
+	}
+	vd->vdev_tsd = NULL;
+}
+
+void
+vdev_draid_config_generate(vdev_t *vd, nvlist_t *nv)
+{
+	if (vd->vdev_ops == &vdev_draid_ops) {
+		vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_NDATA,
+		    vdc->vdc_ndata);
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_NSPARES,
+		    vdc->vdc_nspares);
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_NGROUPS,
+		    vdc->vdc_ngroups);
+	} else {
+		vdev_draid_spare_t *vds = vd->vdev_tsd;
+
+		ASSERT3P(vd->vdev_ops, ==, &vdev_draid_spare_ops);
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_TOP_GUID,
+		    vds->vds_top_guid);
+		fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_SPARE_ID,
+		    vds->vds_spare_id);
+	}
+}
+
+/*
+ * Add the distributed spares of every dRAID child of 'vd' to the spares of
+ * 'nvroot'.  The spares are named after the id their dRAID vdev will have
+ * in the pool, which is given by 'ids' if the children have not been
+ * added to the pool yet.  The number of dRAID children is returned in
+ * 'ndraidp'.
+ */
+int
+vdev_draid_spare_create(nvlist_t *nvroot, vdev_t *vd, const uint64_t *ids,
+    uint64_t *ndraidp)
+{
+	nvlist_t **spares, **newspares;
+	uint_t nspares;
+	uint64_t ndraid = 0, nnew = 0;
+	uint64_t n = 0;
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+
+		if (cvd->vdev_ops != &vdev_draid_ops)
+			continue;
+		ndraid++;
+		nnew += ((vdev_draid_config_t *)cvd->vdev_tsd)->vdc_nspares;
+	}
+
+	*ndraidp = ndraid;
+	if (nnew == 0)
+		return (0);
+
+	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES,
+	    &spares, &nspares) != 0)
+		nspares = 0;
+
+	newspares = kmem_alloc((nspares + nnew) * sizeof (nvlist_t *),
+	    KM_SLEEP);
+	for (uint_t i = 0; i < nspares; i++)
+		newspares[n++] = fnvlist_dup(spares[i]);
+
+	for (uint64_t c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+		vdev_draid_config_t *vdc = cvd->vdev_tsd;
+		uint64_t id = (ids != NULL) ? ids[c] : cvd->vdev_id;
+
+		if (cvd->vdev_ops != &vdev_draid_ops)
+			continue;
+
+		for (uint64_t s = 0; s < vdc->vdc_nspares; s++) {
+			char path[64];
+			nvlist_t *nv = fnvlist_alloc();
+
+			(void) snprintf(path, sizeof (path), "%s%llu-%llu-%llu",
+			    VDEV_TYPE_DRAID, (u_longlong_t)vdc->vdc_nparity,
+			    (u_longlong_t)id, (u_longlong_t)s);
+			fnvlist_add_string(nv, ZPOOL_CONFIG_TYPE,
+			    VDEV_TYPE_DRAID_SPARE);
+			fnvlist_add_string(nv, ZPOOL_CONFIG_PATH, path);
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_TOP_GUID,
+			    cvd->vdev_guid);
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_DRAID_SPARE_ID, s);
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_IS_SPARE, 1);
+			newspares[n++] = nv;
+		}
+	}
+	ASSERT3U(n, ==, nspares + nnew);
+
+	(void) nvlist_remove_all(nvroot, ZPOOL_CONFIG_SPARES);
+	fnvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_SPARES, newspares, n);
+
+	for (uint64_t i = 0; i < n; i++)
+		nvlist_free(newspares[i]);
+	kmem_free(newspares, (nspares + nnew) * sizeof (nvlist_t *));
+
+	return (0);
+}
+
+/*
+ * Sync task to record the addition of dRAID vdevs; the argument is how
+ * many.  The feature is never decremented, as there is no way to remove a
+ * dRAID vdev from a pool.
+ */
+void
+vdev_draid_add_sync(void *arg, dmu_tx_t *tx)
+{
+	uint64_t ndraid = (uint64_t)(uintptr_t)arg;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+
+	for (uint64_t i = 0; i < ndraid; i++)
+		spa_feature_incr(spa, SPA_FEATURE_DRAID, tx);
+}
+
+/*
+ * Metaslabs must begin and end on a group-width boundary, so that every
+ * allocation starts at column 0 of a logical row.
+ */
+void
+vdev_draid_metaslab_init(vdev_t *vd, uint64_t *startp, uint64_t *sizep)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t width = vdc->vdc_groupwidth << vd->vdev_ashift;
+	uint64_t start = roundup(*startp, width);
+	uint64_t end = *startp + *sizep;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+
+	if (end < start)
+		end = start;
+	*startp = start;
+	*sizep = (end - start) - (end - start) % width;
+}
+
+/*
+ * The allocatable space of a dRAID vdev is a whole number of slices, so
+ * each child must provide as many slices.
+ */
+uint64_t
+vdev_draid_min_asize(vdev_t *pvd)
+{
+	vdev_draid_config_t *vdc = pvd->vdev_tsd;
+	uint64_t slicesize = vdc->vdc_ngroups * vdc->vdc_groupwidth *
+	    VDEV_DRAID_ROWHEIGHT;
+
+	ASSERT3P(pvd->vdev_ops, ==, &vdev_draid_ops);
+
+	return (howmany(pvd->vdev_min_asize, slicesize) * vdc->vdc_rows *
+	    VDEV_DRAID_ROWHEIGHT);
+}
+
+/*
+ * Return the size of the largest chunk, no larger than 'maxsize', that can
+ * be rebuilt as one block starting at 'offset': it must consist of whole
+ * logical rows and not cross into the next group.
+ */
+uint64_t
+vdev_draid_rebuild_chunk(vdev_t *vd, uint64_t offset, uint64_t maxsize)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t rowsize = vdc->vdc_groupwidth << vd->vdev_ashift;
+	uint64_t groupsize = vdc->vdc_groupwidth * VDEV_DRAID_ROWHEIGHT;
+	uint64_t size;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_ops);
+	ASSERT0(offset % rowsize);
+
+	size = MIN(maxsize, groupsize - offset % groupsize);
+	size -= size % rowsize;
+	if (size == 0)
+		size = rowsize;
+
+	return (size);
+}
+
+static int
+vdev_draid_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
+    uint64_t *ashift)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t slicesize;
+	int lasterror = 0;
+	int numerrors = 0;
+
+	if (vdc == NULL || vd->vdev_children != vdc->vdc_children ||
+	    vd->vdev_nparity != vdc->vdc_nparity) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_BAD_LABEL;
+		return (SET_ERROR(EINVAL));
+	}
+
+	vdev_open_children(vd);
+
+	for (int c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+
+		if (cvd->vdev_open_error != 0) {
+			lasterror = cvd->vdev_open_error;
+			numerrors++;
+			continue;
+		}
+
+		*asize = MIN(*asize - 1, cvd->vdev_asize - 1) + 1;
+		*max_asize = MIN(*max_asize - 1, cvd->vdev_max_asize - 1) + 1;
+		*ashift = MAX(*ashift, cvd->vdev_ashift);
+	}
+
+	if (numerrors > vdc->vdc_nparity) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
+		return (lasterror);
+	}
+
+	/*
+	 * Only whole slices are used.
+	 */
+	slicesize = vdc->vdc_rows * VDEV_DRAID_ROWHEIGHT;
+	*asize = (*asize / slicesize) * vdc->vdc_ngroups *
+	    vdc->vdc_groupwidth * VDEV_DRAID_ROWHEIGHT;
+	*max_asize = (*max_asize / slicesize) * vdc->vdc_ngroups *
+	    vdc->vdc_groupwidth * VDEV_DRAID_ROWHEIGHT;
+
+	if (*asize == 0) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_TOO_SMALL;
+		return (SET_ERROR(EOVERFLOW));
+	}
+
+	return (0);
+}
+
+static void
+vdev_draid_close(vdev_t *vd)
+{
+	for (int c = 0; c < vd->vdev_children; c++)
+		vdev_close(vd->vdev_child[c]);
+}
+
+/*
+ * Every block is rounded up to whole logical rows of the group.
+ */
+/* ARGSUSED */
+static uint64_t
+vdev_draid_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t sectors = ((psize - 1) >> ashift) + 1;
+	uint64_t rows = howmany(sectors, vdc->vdc_ndata);
+
+	return ((rows * vdc->vdc_groupwidth) << ashift);
+}
+
+/*
+ * Split the map of a block which crosses from one group to the next into
+ * one map per logical row, as vdev_raidz_map_split() does.
+ */
+static void
+vdev_draid_map_split(vdev_t *vd, raidz_map_t *rm, abd_t *abd, uint64_t lrow)
+{
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t off;
+
+	rm->rm_nrows = rm->rm_col[0].rc_size >> ashift;
+	rm->rm_row = kmem_alloc(rm->rm_nrows * sizeof (raidz_map_t *),
+	    KM_SLEEP);
+
+	for (uint64_t r = 0; r < rm->rm_nrows; r++) {
+		raidz_map_t *row = kmem_zalloc(offsetof(raidz_map_t,
+		    rm_col[rm->rm_cols]), KM_SLEEP);
+
+		row->rm_cols = rm->rm_cols;
+		row->rm_scols = rm->rm_cols;
+		row->rm_firstdatacol = rm->rm_firstdatacol;
+		row->rm_asize = rm->rm_cols << ashift;
+
+		off = 0;
+		for (int c = 0; c < rm->rm_cols; c++) {
+			raidz_col_t *pc = &rm->rm_col[c];
+			raidz_col_t *rc = &row->rm_col[c];
+
+			rc->rc_size = 1ULL << ashift;
+			rc->rc_shadow_devidx = UINT64_MAX;
+			rc->rc_shadow_offset = UINT64_MAX;
+
+			if ((r << ashift) >= pc->rc_size) {
+				/* Beyond the end of a short column. */
+				rc->rc_devidx = UINT64_MAX;
+				rc->rc_offset = UINT64_MAX;
+				rc->rc_abd = abd_alloc_linear(rc->rc_size,
+				    B_TRUE);
+				abd_zero(rc->rc_abd, rc->rc_size);
+				rc->rc_tried = 1;
+			} else {
+				vdev_draid_map_sector(vdc, ashift, lrow + r,
+				    pc->rc_devidx, &rc->rc_devidx,
+				    &rc->rc_offset);
+
+				if (c < rm->rm_firstdatacol) {
+					rc->rc_abd = abd_get_offset(pc->rc_abd,
+					    r << ashift);
+				} else {
+					rc->rc_abd = abd_get_offset(abd,
+					    off + (r << ashift));
+				}
+			}
+
+			if (c >= rm->rm_firstdatacol)
+				off += pc->rc_size;
+		}
+
+		rm->rm_row[r] = row;
+	}
+}
+
+static void
+vdev_draid_pad_done(zio_t *zio)
+{
+	abd_free(zio->io_private);
+}
+
+/*
+ * Start an I/O to a dRAID vdev.  The block is mapped as for a RAID-Z vdev
+ * of the group's width, then each column is moved to where the group
+ * lives.  When writing a block that ends in a partial logical row, the
+ * unused sectors of that row are zeroed, so that the parity of every row
+ * covers the whole row; this lets the rebuild treat any allocated range
+ * as a sequence of full-width blocks.  These writes are best-effort, as a
+ * failure to write them doesn't affect the block.
+ */
+static void
+vdev_draid_io_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t rowsectors = VDEV_DRAID_ROWHEIGHT >> ashift;
+	uint64_t width = vdc->vdc_groupwidth;
+	raidz_map_t *rm;
+	uint64_t lrow, nrows;
+
+	rm = vdev_raidz_map_alloc(zio->io_abd, zio->io_size, zio->io_offset,
+	    ashift, width, vdc->vdc_nparity);
+
+	zio->io_vsd = rm;
+	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
+
+	ASSERT0((zio->io_offset >> ashift) % width);
+	lrow = (zio->io_offset >> ashift) / width;
+	nrows = rm->rm_col[0].rc_size >> ashift;
+
+	if ((lrow % rowsectors) + nrows > rowsectors) {
+		vdev_draid_map_split(vd, rm, zio->io_abd, lrow);
+	} else {
+		for (int c = 0; c < rm->rm_cols; c++) {
+			raidz_col_t *rc = &rm->rm_col[c];
+
+			vdev_draid_map_sector(vdc, ashift, lrow, rc->rc_devidx,
+			    &rc->rc_devidx, &rc->rc_offset);
+		}
+	}
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		vdev_raidz_generate_parity(rm);
+
+		if (rm->rm_row != NULL) {
+			for (uint64_t r = 0; r < rm->rm_nrows; r++)
+				vdev_raidz_io_start_write(zio, rm->rm_row[r]);
+		} else {
+			vdev_raidz_io_start_write(zio, rm);
+		}
+
+		for (uint64_t c = rm->rm_bigcols;
+		    rm->rm_bigcols != 0 && c < width; c++) {
+			uint64_t devidx, offset;
+			abd_t *pad = abd_alloc_linear(1ULL << ashift, B_TRUE);
+
+			abd_zero(pad, 1ULL << ashift);
+			vdev_draid_map_sector(vdc, ashift, lrow + nrows - 1,
+			    c, &devidx, &offset);
+			zio_nowait(zio_vdev_child_io(zio, NULL,
+			    vd->vdev_child[devidx], offset, pad,
+			    1ULL << ashift, ZIO_TYPE_WRITE, zio->io_priority,
+			    0, vdev_draid_pad_done, pad));
+		}
+
+		zio_execute(zio);
+		return;
+	}
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ);
+
+	if (rm->rm_row != NULL) {
+		for (uint64_t r = 0; r < rm->rm_nrows; r++)
+			vdev_raidz_io_start_read(zio, rm->rm_row[r]);
+	} else {
+		vdev_raidz_io_start_read(zio, rm);
+	}
+
+	zio_execute(zio);
+}
+
+/*
+ * Translate a logical range to the range of the given child that holds
+ * part of it.  As the columns of the range can move from child to child
+ * at every group boundary, only the full logical rows within the first
+ * group of the range are translated, and the rest of the range is left in
+ * "remain" for the caller to translate next.
+ */
+static void
+vdev_draid_xlate(vdev_t *cvd, const range_seg64_t *in,
+    range_seg64_t *res, range_seg64_t *remain)
+{
+	vdev_t *vd = cvd->vdev_parent;
+	vdev_draid_config_t *vdc = vd->vdev_tsd;
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t rowsectors = VDEV_DRAID_ROWHEIGHT >> ashift;
+	uint64_t width = vdc->vdc_groupwidth;
+
+	ASSERT(vd->vdev_ops == &vdev_draid_ops);
+	ASSERT3P(vd, ==, vd->vdev_top);
+
+	/* make sure the offsets are block-aligned */
+	ASSERT0(in->rs_start % (1 << ashift));
+	ASSERT0(in->rs_end % (1 << ashift));
+	uint64_t lrow_start = roundup(in->rs_start >> ashift, width) / width;
+	uint64_t lrow_end = (in->rs_end >> ashift) / width;
+
+	res->rs_start = res->rs_end = 0;
+	remain->rs_start = remain->rs_end = in->rs_end;
+	if (lrow_start >= lrow_end)
+		return;
+
+	uint64_t lrow_group = (lrow_start / rowsectors + 1) * rowsectors;
+	if (lrow_end > lrow_group) {
+		lrow_end = lrow_group;
+		remain->rs_start = (lrow_group * width) << ashift;
+	}
+
+	for (uint64_t c = 0; c < width; c++) {
+		uint64_t devidx, offset;
+
+		vdev_draid_map_sector(vdc, ashift, lrow_start, c, &devidx,
+		    &offset);
+		if (devidx == cvd->vdev_id) {
+			res->rs_start = offset;
+			res->rs_end = offset +
+			    ((lrow_end - lrow_start) << ashift);
+			break;
+		}
+	}
+
+	ASSERT3U(res->rs_start, <=, in->rs_start);
+	ASSERT3U(res->rs_end - res->rs_start, <=, in->rs_end - in->rs_start);
+}
+
+vdev_ops_t vdev_draid_ops = {
+	vdev_draid_open,
+	vdev_draid_close,
+	vdev_draid_asize,
+	vdev_draid_io_start,
+	vdev_raidz_io_done,
+	vdev_raidz_state_change,
+	NULL,
+	NULL,
+	NULL,
+	vdev_draid_xlate,
+	VDEV_TYPE_DRAID,	/* name of this vdev type */
+	B_FALSE			/* not a leaf vdev */
+};
+
+/*
+ * Distributed spares
+ *
+ * A distributed spare looks like a leaf vdev the size of one child of its
+ * dRAID vdev, with room for labels at either end.  The labels don't exist:
+ * its config is synthesized (see vdev_draid_read_config_spare()) and
+ * label writes are dropped.  Everything else is forwarded to the child of
+ * the dRAID vdev which holds this spare in the slice being accessed.
+ */
+static vdev_t *
+vdev_draid_spare_get_top(vdev_t *vd)
+{
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+	spa_t *spa = vd->vdev_spa;
+	vdev_t *tvd;
+
+	/*
+	 * While a dRAID vdev is being added, it isn't part of the pool's
+	 * vdev tree yet.
+	 */
+	tvd = vdev_lookup_by_guid(spa->spa_root_vdev, vds->vds_top_guid);
+	if (tvd == NULL && spa->spa_pending_vdev != NULL) {
+		tvd = vdev_lookup_by_guid(spa->spa_pending_vdev,
+		    vds->vds_top_guid);
+	}
+
+	return (tvd);
+}
+
+static int
+vdev_draid_spare_open(vdev_t *vd, uint64_t *psize, uint64_t *max_psize,
+    uint64_t *ashift)
+{
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+	vdev_draid_config_t *vdc;
+	vdev_t *tvd;
+
+	if (vds == NULL) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_BAD_LABEL;
+		return (SET_ERROR(EINVAL));
+	}
+
+	tvd = vdev_draid_spare_get_top(vd);
+	if (tvd == NULL || tvd->vdev_ops != &vdev_draid_ops) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (SET_ERROR(ENODEV));
+	}
+
+	vdc = tvd->vdev_tsd;
+	if (vdc == NULL || vds->vds_spare_id >= vdc->vdc_nspares ||
+	    tvd->vdev_asize == 0) {
+		vd->vdev_stat.vs_aux = VDEV_AUX_OPEN_FAILED;
+		return (SET_ERROR(ENXIO));
+	}
+
+	/*
+	 * The size of the dRAID vdev, rather than of its children, is used
+	 * as it is known from the config even before the children are open.
+	 */
+	*psize = (tvd->vdev_asize / (vdc->vdc_ngroups * vdc->vdc_groupwidth *
+	    VDEV_DRAID_ROWHEIGHT)) * vdc->vdc_rows * VDEV_DRAID_ROWHEIGHT +
+	    VDEV_LABEL_START_SIZE + VDEV_LABEL_END_SIZE;
+	*max_psize = *psize;
+	*ashift = tvd->vdev_ashift;
+
+	vds->vds_draid_vdev = tvd;
+
+	return (0);
+}
+
+static void
+vdev_draid_spare_close(vdev_t *vd)
+{
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+
+	if (vds != NULL)
+		vds->vds_draid_vdev = NULL;
+}
+
+static void
+vdev_draid_spare_child_done(zio_t *zio)
+{
+	zio_t *pio = zio->io_private;
+
+	pio->io_error = zio->io_error;
+}
+
+static void
+vdev_draid_spare_io_start(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+	vdev_t *tvd = vds->vds_draid_vdev;
+	uint64_t offset = zio->io_offset;
+	vdev_t *cvd;
+
+	if (zio->io_type == ZIO_TYPE_IOCTL || tvd == NULL) {
+		zio->io_error = (tvd == NULL) ? SET_ERROR(ENXIO) : 0;
+		zio_execute(zio);
+		return;
+	}
+
+	if (offset < VDEV_LABEL_START_SIZE ||
+	    offset >= vd->vdev_psize - VDEV_LABEL_END_SIZE) {
+		if (zio->io_type == ZIO_TYPE_WRITE &&
+		    (zio->io_flags & (ZIO_FLAG_PROBE |
+		    ZIO_FLAG_CONFIG_WRITER))) {
+			zio->io_error = 0;
+		} else if (zio->io_type == ZIO_TYPE_READ &&
+		    (zio->io_flags & ZIO_FLAG_PROBE)) {
+			abd_zero(zio->io_abd, zio->io_size);
+			zio->io_error = 0;
+		} else {
+			zio->io_error = SET_ERROR(EIO);
+		}
+		zio_execute(zio);
+		return;
+	}
+
+	offset -= VDEV_LABEL_START_SIZE;
+	cvd = tvd->vdev_child[vdev_draid_spare_child(tvd->vdev_tsd,
+	    vds->vds_spare_id, offset)];
+
+	if ((zio->io_type == ZIO_TYPE_READ && !vdev_readable(cvd)) ||
+	    (zio->io_type == ZIO_TYPE_WRITE && !vdev_writeable(cvd))) {
+		zio->io_error = SET_ERROR(ENXIO);
+		zio_execute(zio);
+		return;
+	}
+
+	zio_nowait(zio_vdev_child_io(zio, NULL, cvd, offset, zio->io_abd,
+	    zio->io_size, zio->io_type, zio->io_priority, 0,
+	    vdev_draid_spare_child_done, zio));
+
+	zio_execute(zio);
+}
+
+/* ARGSUSED */
+static void
+vdev_draid_spare_io_done(zio_t *zio)
+{
+}
+
+/*
+ * Synthesize the label config of a distributed spare.  It is reported as
+ * active while it is in use, like the label of a hot spare would be.
+ */
+nvlist_t *
+vdev_draid_read_config_spare(vdev_t *vd)
+{
+	spa_t *spa = vd->vdev_spa;
+	spa_aux_vdev_t *sav = &spa->spa_spares;
+	vdev_draid_spare_t *vds = vd->vdev_tsd;
+	vdev_t *pvd = vd->vdev_parent;
+	uint64_t guid = vd->vdev_guid;
+	nvlist_t *config;
+
+	ASSERT3P(vd->vdev_ops, ==, &vdev_draid_spare_ops);
+
+	/*
+	 * An active spare is a different vdev_t than the one on the spare
+	 * list, but it must report the same guid.
+	 */
+	if (vd->vdev_aux == NULL && vd->vdev_path != NULL) {
+		for (int i = 0; i < sav->sav_count; i++) {
+			vdev_t *svd = sav->sav_vdevs[i];
+
+			if (svd != NULL &&
+			    svd->vdev_ops == &vdev_draid_spare_ops &&
+			    svd->vdev_path != NULL &&
+			    strcmp(svd->vdev_path, vd->vdev_path) == 0) {
+				guid = svd->vdev_guid;
+				break;
+			}
+		}
+	}
+
+	config = fnvlist_alloc();
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_IS_SPARE, 1);
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_CREATE_TXG, 1);
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_VERSION, spa_version(spa));
+	fnvlist_add_string(config, ZPOOL_CONFIG_POOL_NAME, spa_name(spa));
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_POOL_GUID, spa_guid(spa));
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_POOL_TXG,
+	    spa->spa_config_txg);
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_TOP_GUID, vds->vds_top_guid);
+	fnvlist_add_uint64(config, ZPOOL_CONFIG_GUID, guid);
+
+	if (pvd != NULL && (pvd->vdev_ops == &vdev_spare_ops ||
+	    pvd->vdev_ops == &vdev_replacing_ops ||
+	    pvd->vdev_ops == &vdev_draid_ops)) {
+		fnvlist_add_uint64(config, ZPOOL_CONFIG_POOL_STATE,
+		    POOL_STATE_ACTIVE);
+	} else {
+		fnvlist_add_uint64(config, ZPOOL_CONFIG_POOL_STATE,
+		    POOL_STATE_SPARE);
+	}
+
+	return (config);
+}
+
+vdev_ops_t vdev_draid_spare_ops = {
+	vdev_draid_spare_open,
+	vdev_draid_spare_close,
+	vdev_default_asize,
+	vdev_draid_spare_io_start,
+	vdev_draid_spare_io_done,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	vdev_default_xlate,
+	VDEV_TYPE_DRAID_SPARE,	/* name of this vdev type */
+	B_TRUE			/* leaf vdev */
+};
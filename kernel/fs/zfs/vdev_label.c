@@ -141,6 +141,9 @@
 #include <sys/zap.h>
 #include <sys/vdev.h>
 #include <sys/vdev_impl.h>
+#include <sys/vdev_raidz.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_rebuild.h>
 #include <sys/uberblock_impl.h>
 #include <sys/metaslab.h>
 #include <sys/metaslab_impl.h>
@@ -238,6 +241,13 @@ root_vdev_actions_getprogress(vdev_t *vd, nvlist_t *nvl)
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t *)&pcs,
 		    sizeof (pcs) / sizeof (uint64_t));
 	}
+
+	pool_raidz_expand_stat_t pres;
+	if (spa_raidz_expand_get_stats(spa, &pres) == 0) {
+		fnvlist_add_uint64_array(nvl,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t *)&pres,
+		    sizeof (pres) / sizeof (uint64_t));
+	}
 }
 
 /*
@@ -271,8 +281,8 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		fnvlist_add_string(nv, ZPOOL_CONFIG_FRU, vd->vdev_fru);
 
 	if (vd->vdev_nparity != 0) {
-		ASSERT(strcmp(vd->vdev_ops->vdev_op_type,
-		    VDEV_TYPE_RAIDZ) == 0);
+		ASSERT(vd->vdev_ops == &vdev_raidz_ops ||
+		    vd->vdev_ops == &vdev_draid_ops);
 
 		/*
 		 * Make sure someone hasn't managed to sneak a fancy new vdev
@@ -290,8 +300,21 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 		 * will just ignore it.
 		 */
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_NPARITY, vd->vdev_nparity);
+
+		if (vd->vdev_rz_expanding)
+			fnvlist_add_uint64(nv, ZPOOL_CONFIG_RAIDZ_EXPANDING, 1);
+		if (vd->vdev_rz_expand_count != 0) {
+			fnvlist_add_uint64_array(nv,
+			    ZPOOL_CONFIG_RAIDZ_EXPAND_TXGS,
+			    vd->vdev_rz_expand_txgs,
+			    vd->vdev_rz_expand_count);
+		}
 	}
 
+	if (vd->vdev_ops == &vdev_draid_ops ||
+	    vd->vdev_ops == &vdev_draid_spare_ops)
+		vdev_draid_config_generate(vd, nv);
+
 	if (vd->vdev_wholedisk != -1ULL)
 		fnvlist_add_uint64(nv, ZPOOL_CONFIG_WHOLE_DISK,
 		    vd->vdev_wholedisk);
@@ -364,6 +387,17 @@ vdev_config_generate(spa_t *spa, vdev_t *vd, boolean_t getstats,
 
 		root_vdev_actions_getprogress(vd, nv);
 
+		if (vd == vd->vdev_top) {
+			vdev_rebuild_stat_t vrs;
+
+			if (vdev_rebuild_get_stats(vd, &vrs) == 0) {
+				fnvlist_add_uint64_array(nv,
+				    ZPOOL_CONFIG_REBUILD_STATS,
+				    (uint64_t *)&vrs,
+				    sizeof (vrs) / sizeof (uint64_t));
+			}
+		}
+
 		/*
 		 * Note: this can be called from open context
 		 * (spa_get_stats()), so we need the rwlock to prevent
@@ -561,6 +595,12 @@ vdev_label_read_config(vdev_t *vd, uint64_t txg)
 	if (!vdev_readable(vd))
 		return (NULL);
 
+	/*
+	 * A distributed spare has no label of its own.
+	 */
+	if (vd->vdev_ops == &vdev_draid_spare_ops)
+		return (vdev_draid_read_config_spare(vd));
+
 	vp_abd = abd_alloc_linear(sizeof (vdev_phys_t), B_TRUE);
 	vp = abd_to_buf(vp_abd);
 
@@ -1046,7 +1086,8 @@ vdev_uberblock_load_impl(zio_t *zio, vdev_t *vd, int flags,
 	for (int c = 0; c < vd->vdev_children; c++)
 		vdev_uberblock_load_impl(zio, vd->vdev_child[c], flags, cbp);
 
-	if (vd->vdev_ops->vdev_op_leaf && vdev_readable(vd)) {
+	if (vd->vdev_ops->vdev_op_leaf && vdev_readable(vd) &&
+	    vd->vdev_ops != &vdev_draid_spare_ops) {
 		for (int l = 0; l < VDEV_LABELS; l++) {
 			for (int n = 0; n < VDEV_UBERBLOCK_COUNT(vd); n++) {
 				vdev_label_read(zio, vd, l,
@@ -1139,6 +1180,12 @@ vdev_uberblock_sync(zio_t *zio, uint64_t *good_writes,
 	if (!vd->vdev_ops->vdev_op_leaf)
 		return;
 
+	/*
+	 * Distributed spares have no labels.
+	 */
+	if (vd->vdev_ops == &vdev_draid_spare_ops)
+		return;
+
 	if (!vdev_writeable(vd))
 		return;
 
@@ -1247,6 +1294,12 @@ vdev_label_sync(zio_t *zio, uint64_t *good_writes,
 	if (!vd->vdev_ops->vdev_op_leaf)
 		return;
 
+	/*
+	 * Distributed spares have no labels.
+	 */
+	if (vd->vdev_ops == &vdev_draid_spare_ops)
+		return;
+
 	if (!vdev_writeable(vd))
 		return;
 
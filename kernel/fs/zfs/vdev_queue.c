@@ -538,6 +538,13 @@ vdev_queue_aggregate(vdev_queue_t *vq, zio_t *zio)
 	if (zio->io_flags & ZIO_FLAG_DONT_AGGREGATE)
 		return (NULL);
 
+	/*
+	 * Adjacent offsets of a distributed spare may be on different
+	 * children; the children's queues aggregate instead.
+	 */
+	if (zio->io_vd->vdev_ops == &vdev_draid_spare_ops)
+		return (NULL);
+
 	first = last = zio;
 
 	if (zio->io_type == ZIO_TYPE_READ)
@@ -28,15 +28,22 @@
 
 #include <sys/zfs_context.h>
 #include <sys/spa.h>
+#include <sys/spa_impl.h>
 #include <sys/vdev_impl.h>
 #include <sys/vdev_disk.h>
 #include <sys/vdev_file.h>
 #include <sys/vdev_raidz.h>
+#include <sys/vdev_raidz_impl.h>
 #include <sys/zio.h>
 #include <sys/zio_checksum.h>
 #include <sys/abd.h>
 #include <sys/fs/zfs.h>
 #include <sys/fm/fs/zfs.h>
+#include <sys/dmu_tx.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/zap.h>
+#include <sys/zfeature.h>
 
 #ifdef ZFS_DEBUG
 #include <sys/vdev_initialize.h>	/* vdev_xlate testing */
@@ -109,34 +116,6 @@
  * or in concert to recover missing data columns.
  */
 
-typedef struct raidz_col {
-	uint64_t rc_devidx;		/* child device index for I/O */
-	uint64_t rc_offset;		/* device offset */
-	uint64_t rc_size;		/* I/O size */
-	abd_t *rc_abd;			/* I/O data */
-	void *rc_gdata;			/* used to store the "good" version */
-	int rc_error;			/* I/O error for this device */
-	uint8_t rc_tried;		/* Did we attempt this I/O column? */
-	uint8_t rc_skipped;		/* Did we skip this I/O column? */
-} raidz_col_t;
-
-typedef struct raidz_map {
-	uint64_t rm_cols;		/* Regular column count */
-	uint64_t rm_scols;		/* Count including skipped columns */
-	uint64_t rm_bigcols;		/* Number of oversized columns */
-	uint64_t rm_asize;		/* Actual total I/O size */
-	uint64_t rm_missingdata;	/* Count of missing data devices */
-	uint64_t rm_missingparity;	/* Count of missing parity devices */
-	uint64_t rm_firstdatacol;	/* First data column/parity count */
-	uint64_t rm_nskip;		/* Skipped sectors for padding */
-	uint64_t rm_skipstart;		/* Column index of padding start */
-	abd_t *rm_abd_copy;		/* rm_asize-buffer of copied data */
-	uintptr_t rm_reports;		/* # of referencing checksum reports */
-	uint8_t	rm_freed;		/* map no longer has referencing ZIO */
-	uint8_t	rm_ecksuminjected;	/* checksum error was injected */
-	raidz_col_t rm_col[1];		/* Flexible array of I/O columns */
-} raidz_map_t;
-
 #define	VDEV_RAIDZ_P		0
 #define	VDEV_RAIDZ_Q		1
 #define	VDEV_RAIDZ_R		2
@@ -242,8 +221,6 @@ static const uint8_t vdev_raidz_log2[256] = {
 	0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf,
 };
 
-static void vdev_raidz_generate_parity(raidz_map_t *rm);
-
 /*
  * Multiply a given number by 2 raised to the given power.
  */
@@ -264,11 +241,34 @@ vdev_raidz_exp2(uint_t a, int exp)
 }
 
 static void
+vdev_raidz_row_free(raidz_map_t *row)
+{
+	for (int c = 0; c < row->rm_cols; c++) {
+		raidz_col_t *rc = &row->rm_col[c];
+
+		if (rc->rc_devidx == UINT64_MAX)
+			abd_free(rc->rc_abd);
+		else
+			abd_put(rc->rc_abd);
+	}
+
+	kmem_free(row, offsetof(raidz_map_t, rm_col[row->rm_scols]));
+}
+
+void
 vdev_raidz_map_free(raidz_map_t *rm)
 {
 	int c;
 	size_t size;
 
+	ASSERT3P(rm->rm_lr, ==, NULL);
+
+	if (rm->rm_row != NULL) {
+		for (uint64_t r = 0; r < rm->rm_nrows; r++)
+			vdev_raidz_row_free(rm->rm_row[r]);
+		kmem_free(rm->rm_row, rm->rm_nrows * sizeof (raidz_map_t *));
+	}
+
 	for (c = 0; c < rm->rm_firstdatacol; c++) {
 		abd_free(rm->rm_col[c].rc_abd);
 
@@ -297,6 +297,11 @@ vdev_raidz_map_free_vsd(zio_t *zio)
 	ASSERT0(rm->rm_freed);
 	rm->rm_freed = 1;
 
+	if (rm->rm_lr != NULL) {
+		rangelock_exit(rm->rm_lr);
+		rm->rm_lr = NULL;
+	}
+
 	if (rm->rm_reports == 0)
 		vdev_raidz_map_free(rm);
 }
@@ -454,7 +459,7 @@ vdev_raidz_cksum_report(zio_t *zio, zio_cksum_report_t *zcr, void *arg)
 	ASSERT3U(offset, ==, size);
 }
 
-static const zio_vsd_ops_t vdev_raidz_vsd_ops = {
+const zio_vsd_ops_t vdev_raidz_vsd_ops = {
 	vdev_raidz_map_free_vsd,
 	vdev_raidz_cksum_report
 };
@@ -463,7 +468,7 @@ static const zio_vsd_ops_t vdev_raidz_vsd_ops = {
  * Divides the IO evenly across all child vdevs; usually, dcols is
  * the number of children in the target vdev.
  */
-static raidz_map_t *
+raidz_map_t *
 vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
     uint64_t unit_shift, uint64_t dcols, uint64_t nparity)
 {
@@ -526,6 +531,9 @@ vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
 	rm->rm_reports = 0;
 	rm->rm_freed = 0;
 	rm->rm_ecksuminjected = 0;
+	rm->rm_nrows = 0;
+	rm->rm_row = NULL;
+	rm->rm_lr = NULL;
 
 	asize = 0;
 
@@ -543,6 +551,8 @@ vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
 		rm->rm_col[c].rc_error = 0;
 		rm->rm_col[c].rc_tried = 0;
 		rm->rm_col[c].rc_skipped = 0;
+		rm->rm_col[c].rc_shadow_devidx = UINT64_MAX;
+		rm->rm_col[c].rc_shadow_offset = UINT64_MAX;
 
 		if (c >= acols)
 			rm->rm_col[c].rc_size = 0;
@@ -610,6 +620,117 @@ vdev_raidz_map_alloc(abd_t *abd, uint64_t size, uint64_t offset,
 	return (rm);
 }
 
+/*
+ * Find the child vdev and child offset holding the given sector of a RAID-Z
+ * vdev.  While the vdev is being expanded, sectors below the reflow offset
+ * are laid out across all of the children and those above it across all
+ * but the newest one.
+ */
+static void
+vdev_raidz_sector_to_child(vdev_t *vd, uint64_t sector, uint64_t reflow,
+    uint64_t *devidx, uint64_t *offset)
+{
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t width = vd->vdev_children;
+
+	if (vd->vdev_rz_expanding && sector >= (reflow >> ashift))
+		width--;
+
+	*devidx = sector % width;
+	*offset = (sector / width) << ashift;
+}
+
+/*
+ * Split a map into one map per row, each holding one sector of every
+ * column, and place each sector where the vdev's current layout has it.
+ * This is needed for blocks that were written with fewer columns than the
+ * vdev now has (i.e. before an expansion completed), and for blocks which
+ * have been reflowed by an expansion in progress.
+ *
+ * The row of a partial final stripe keeps all of the columns, with the
+ * missing sectors zero-filled, so that the parity of each row is exactly
+ * the corresponding part of the parity of the whole map.
+ *
+ * Sectors which have been reflowed, but not yet in a synced txg, are also
+ * written to their old location so that they can be found there if we
+ * crash before the reflow progress is synced.
+ */
+static void
+vdev_raidz_map_split(vdev_t *vd, raidz_map_t *rm, abd_t *abd, uint64_t dcols,
+    uint64_t reflow, uint64_t durable)
+{
+	uint64_t ashift = vd->vdev_top->vdev_ashift;
+	uint64_t oldwidth = vd->vdev_children - 1;
+	uint64_t off;
+
+	rm->rm_nrows = rm->rm_col[0].rc_size >> ashift;
+	rm->rm_row = kmem_alloc(rm->rm_nrows * sizeof (raidz_map_t *),
+	    KM_SLEEP);
+
+	for (uint64_t r = 0; r < rm->rm_nrows; r++) {
+		raidz_map_t *row = kmem_zalloc(offsetof(raidz_map_t,
+		    rm_col[rm->rm_cols]), KM_SLEEP);
+
+		row->rm_cols = rm->rm_cols;
+		row->rm_scols = rm->rm_cols;
+		row->rm_firstdatacol = rm->rm_firstdatacol;
+		row->rm_asize = rm->rm_cols << ashift;
+
+		off = 0;
+		for (int c = 0; c < rm->rm_cols; c++) {
+			raidz_col_t *pc = &rm->rm_col[c];
+			raidz_col_t *rc = &row->rm_col[c];
+
+			rc->rc_size = 1ULL << ashift;
+			rc->rc_shadow_devidx = UINT64_MAX;
+			rc->rc_shadow_offset = UINT64_MAX;
+
+			if ((r << ashift) >= pc->rc_size) {
+				/* Beyond the end of a short column. */
+				rc->rc_devidx = UINT64_MAX;
+				rc->rc_offset = UINT64_MAX;
+				rc->rc_abd = abd_alloc_linear(rc->rc_size,
+				    B_TRUE);
+				abd_zero(rc->rc_abd, rc->rc_size);
+				rc->rc_tried = 1;
+			} else {
+				uint64_t sector = ((pc->rc_offset >> ashift) +
+				    r) * dcols + pc->rc_devidx;
+
+				vdev_raidz_sector_to_child(vd, sector, reflow,
+				    &rc->rc_devidx, &rc->rc_offset);
+
+				if (vd->vdev_rz_expanding &&
+				    sector >= (durable >> ashift) &&
+				    sector < (reflow >> ashift)) {
+					rc->rc_shadow_devidx =
+					    sector % oldwidth;
+					rc->rc_shadow_offset =
+					    (sector / oldwidth) << ashift;
+				}
+
+				/*
+				 * Refer to the zio's buffer directly, rather
+				 * than through the column, as the column's
+				 * buffer may be replaced by a checksum report.
+				 */
+				if (c < rm->rm_firstdatacol) {
+					rc->rc_abd = abd_get_offset(pc->rc_abd,
+					    r << ashift);
+				} else {
+					rc->rc_abd = abd_get_offset(abd,
+					    off + (r << ashift));
+				}
+			}
+
+			if (c >= rm->rm_firstdatacol)
+				off += pc->rc_size;
+		}
+
+		rm->rm_row[r] = row;
+	}
+}
+
 struct pqr_struct {
 	uint64_t *p;
 	uint64_t *q;
@@ -790,7 +911,7 @@ vdev_raidz_generate_parity_pqr(raidz_map_t *rm)
  * Generate RAID parity in the first virtual columns according to the number of
  * parity columns available.
  */
-static void
+void
 vdev_raidz_generate_parity(raidz_map_t *rm)
 {
 	switch (rm->rm_firstdatacol) {
@@ -1694,8 +1815,12 @@ vdev_raidz_open(vdev_t *vd, uint64_t *asize, uint64_t *max_asize,
 		*ashift = MAX(*ashift, cvd->vdev_ashift);
 	}
 
-	*asize *= vd->vdev_children;
-	*max_asize *= vd->vdev_children;
+	/*
+	 * The newest child of a vdev being expanded provides no space until
+	 * the reflow is done.
+	 */
+	*asize *= vdev_raidz_logical_width(vd, UINT64_MAX);
+	*max_asize *= vdev_raidz_logical_width(vd, UINT64_MAX);
 
 	if (numerrors > nparity) {
 		vd->vdev_stat.vs_aux = VDEV_AUX_NO_REPLICAS;
@@ -1792,6 +1917,13 @@ vdev_raidz_physio(vdev_t *vd, caddr_t data, size_t size,
 
 #ifdef	_KERNEL
 
+	/*
+	 * The dump layout assumes that every block spans all of the
+	 * children, which is not true once the vdev has been expanded.
+	 */
+	if (vd->vdev_rz_expanding || vd->vdev_rz_expand_count != 0)
+		return (SET_ERROR(ENOTSUP));
+
 	/*
 	 * Don't write past the end of the block
 	 */
@@ -1864,11 +1996,11 @@ vdev_raidz_physio(vdev_t *vd, caddr_t data, size_t size,
 }
 
 static uint64_t
-vdev_raidz_asize(vdev_t *vd, uint64_t psize)
+vdev_raidz_asize(vdev_t *vd, uint64_t psize, uint64_t txg)
 {
 	uint64_t asize;
 	uint64_t ashift = vd->vdev_top->vdev_ashift;
-	uint64_t cols = vd->vdev_children;
+	uint64_t cols = vdev_raidz_logical_width(vd, txg);
 	uint64_t nparity = vd->vdev_nparity;
 
 	asize = ((psize - 1) >> ashift) + 1;
@@ -1878,7 +2010,7 @@ vdev_raidz_asize(vdev_t *vd, uint64_t psize)
 	return (asize);
 }
 
-static void
+void
 vdev_raidz_child_done(zio_t *zio)
 {
 	raidz_col_t *rc = zio->io_private;
@@ -1888,6 +2020,17 @@ vdev_raidz_child_done(zio_t *zio)
 	rc->rc_skipped = 0;
 }
 
+/*
+ * The copy of a sector at its pre-expansion location is only needed if we
+ * crash before the reflow progress is synced, so failing to write it is not
+ * an error.
+ */
+/* ARGSUSED */
+static void
+vdev_raidz_shadow_done(zio_t *zio)
+{
+}
+
 static void
 vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 {
@@ -1895,15 +2038,15 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
 
-	range_seg_t logical_rs, physical_rs;
+	range_seg64_t logical_rs, physical_rs, remain_rs;
 	logical_rs.rs_start = zio->io_offset;
-	logical_rs.rs_end = logical_rs.rs_start +
-	    vdev_raidz_asize(zio->io_vd, zio->io_size);
+	logical_rs.rs_end = logical_rs.rs_start + rm->rm_asize;
 
 	raidz_col_t *rc = &rm->rm_col[col];
 	vdev_t *cvd = vd->vdev_child[rc->rc_devidx];
 
-	vdev_xlate(cvd, &logical_rs, &physical_rs);
+	vdev_xlate(cvd, &logical_rs, &physical_rs, &remain_rs);
+	ASSERT(vdev_xlate_is_empty(&remain_rs));
 	ASSERT3U(rc->rc_offset, ==, physical_rs.rs_start);
 	ASSERT3U(rc->rc_offset, <, physical_rs.rs_end);
 	/*
@@ -1921,6 +2064,93 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
 #endif
 }
 
+/*
+ * The txg in which the block being accessed was allocated.  This
+ * determines how many columns it was laid out with.
+ */
+static uint64_t
+vdev_raidz_block_txg(zio_t *zio)
+{
+	if (zio->io_bp != NULL && BP_PHYSICAL_BIRTH(zio->io_bp) != 0)
+		return (BP_PHYSICAL_BIRTH(zio->io_bp));
+	return (zio->io_txg);
+}
+
+void
+vdev_raidz_io_start_write(zio_t *zio, raidz_map_t *rm)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_col_t *rc;
+	int c;
+
+	for (c = 0; c < rm->rm_cols; c++) {
+		rc = &rm->rm_col[c];
+
+		if (rc->rc_devidx == UINT64_MAX)
+			continue;
+
+		zio_nowait(zio_vdev_child_io(zio, NULL,
+		    vd->vdev_child[rc->rc_devidx],
+		    rc->rc_offset, rc->rc_abd, rc->rc_size,
+		    zio->io_type, zio->io_priority, 0,
+		    vdev_raidz_child_done, rc));
+
+		if (rc->rc_shadow_devidx != UINT64_MAX) {
+			zio_nowait(zio_vdev_child_io(zio, NULL,
+			    vd->vdev_child[rc->rc_shadow_devidx],
+			    rc->rc_shadow_offset, rc->rc_abd, rc->rc_size,
+			    zio->io_type, zio->io_priority, 0,
+			    vdev_raidz_shadow_done, NULL));
+		}
+	}
+}
+
+void
+vdev_raidz_io_start_read(zio_t *zio, raidz_map_t *rm)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_t *cvd;
+	raidz_col_t *rc;
+	int c;
+
+	/*
+	 * Iterate over the columns in reverse order so that we hit the parity
+	 * last -- any errors along the way will force us to read the parity.
+	 */
+	for (c = rm->rm_cols - 1; c >= 0; c--) {
+		rc = &rm->rm_col[c];
+		if (rc->rc_devidx == UINT64_MAX)
+			continue;
+		cvd = vd->vdev_child[rc->rc_devidx];
+		if (!vdev_readable(cvd)) {
+			if (c >= rm->rm_firstdatacol)
+				rm->rm_missingdata++;
+			else
+				rm->rm_missingparity++;
+			rc->rc_error = SET_ERROR(ENXIO);
+			rc->rc_tried = 1;	/* don't even try */
+			rc->rc_skipped = 1;
+			continue;
+		}
+		if (vdev_dtl_contains(cvd, DTL_MISSING, zio->io_txg, 1)) {
+			if (c >= rm->rm_firstdatacol)
+				rm->rm_missingdata++;
+			else
+				rm->rm_missingparity++;
+			rc->rc_error = SET_ERROR(ESTALE);
+			rc->rc_skipped = 1;
+			continue;
+		}
+		if (c >= rm->rm_firstdatacol || rm->rm_missingdata > 0 ||
+		    (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER))) {
+			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
+			    rc->rc_offset, rc->rc_abd, rc->rc_size,
+			    zio->io_type, zio->io_priority, 0,
+			    vdev_raidz_child_done, rc));
+		}
+	}
+}
+
 /*
  * Start an IO operation on a RAIDZ VDev
  *
@@ -1937,43 +2167,78 @@ vdev_raidz_io_verify(zio_t *zio, raidz_map_t *rm, int col)
  *   2. If this is a scrub or resilver operation, or if any of the data
  *      vdevs have had errors, then create zio read operations to the parity
  *      columns' VDevs as well.
+ *
+ * Blocks which don't lie in the vdev's current layout (see
+ * vdev_raidz_map_split()) are accessed one row at a time.
  */
 static void
 vdev_raidz_io_start(zio_t *zio)
 {
 	vdev_t *vd = zio->io_vd;
 	vdev_t *tvd = vd->vdev_top;
+	spa_t *spa = zio->io_spa;
 	vdev_t *cvd;
 	raidz_map_t *rm;
 	raidz_col_t *rc;
+	uint64_t txg = vdev_raidz_block_txg(zio);
+	uint64_t dcols = vdev_raidz_logical_width(vd, txg);
+	uint64_t reflow = 0, durable = 0;
 	int c, i;
 
 	rm = vdev_raidz_map_alloc(zio->io_abd, zio->io_size, zio->io_offset,
-	    tvd->vdev_ashift, vd->vdev_children,
+	    tvd->vdev_ashift, dcols,
 	    vd->vdev_nparity);
 
 	zio->io_vsd = rm;
 	zio->io_vsd_ops = &vdev_raidz_vsd_ops;
 
-	ASSERT3U(rm->rm_asize, ==, vdev_psize_to_asize(vd, zio->io_size));
+	ASSERT3U(rm->rm_asize, ==,
+	    vdev_psize_to_asize_txg(vd, zio->io_size, txg));
+
+	if (vd->vdev_rz_expanding) {
+		vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+		/*
+		 * Hold the block's range against the reflow thread, so that
+		 * the reflow offset doesn't move across it until we're done.
+		 * Before the expansion state is loaded there's no reflow
+		 * thread, and the offset is the synced one.
+		 */
+		if (vre != NULL) {
+			ASSERT3U(vre->vre_vdev_id, ==, vd->vdev_id);
+			rm->rm_lr = rangelock_enter(&vre->vre_rangelock,
+			    zio->io_offset, rm->rm_asize, RL_READER);
+			reflow = vre->vre_offset;
+		} else {
+			reflow = spa->spa_ubsync.ub_raidz_reflow_info;
+		}
+		durable = MAX(spa->spa_ubsync.ub_raidz_reflow_info,
+		    (vd->vdev_children - 1) << tvd->vdev_ashift);
+	}
+
+	if (dcols != vdev_raidz_logical_width(vd, UINT64_MAX) ||
+	    (vd->vdev_rz_expanding && zio->io_offset < reflow)) {
+		vdev_raidz_map_split(vd, rm, zio->io_abd, dcols,
+		    reflow, durable);
+	}
 
 	if (zio->io_type == ZIO_TYPE_WRITE) {
 		vdev_raidz_generate_parity(rm);
 
-		for (c = 0; c < rm->rm_cols; c++) {
-			rc = &rm->rm_col[c];
-			cvd = vd->vdev_child[rc->rc_devidx];
+		if (rm->rm_row != NULL) {
+			for (uint64_t r = 0; r < rm->rm_nrows; r++)
+				vdev_raidz_io_start_write(zio, rm->rm_row[r]);
+			zio_execute(zio);
+			return;
+		}
 
-			/*
-			 * Verify physical to logical translation.
-			 */
+		/*
+		 * Verify physical to logical translation.
+		 */
+		for (c = 0; c < rm->rm_cols; c++)
 			vdev_raidz_io_verify(zio, rm, c);
 
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset, rc->rc_abd, rc->rc_size,
-			    zio->io_type, zio->io_priority, 0,
-			    vdev_raidz_child_done, rc));
-		}
+		vdev_raidz_io_start_write(zio, rm);
 
 		/*
 		 * Generate optional I/Os for any skipped sectors to improve
@@ -1998,39 +2263,11 @@ vdev_raidz_io_start(zio_t *zio)
 
 	ASSERT(zio->io_type == ZIO_TYPE_READ);
 
-	/*
-	 * Iterate over the columns in reverse order so that we hit the parity
-	 * last -- any errors along the way will force us to read the parity.
-	 */
-	for (c = rm->rm_cols - 1; c >= 0; c--) {
-		rc = &rm->rm_col[c];
-		cvd = vd->vdev_child[rc->rc_devidx];
-		if (!vdev_readable(cvd)) {
-			if (c >= rm->rm_firstdatacol)
-				rm->rm_missingdata++;
-			else
-				rm->rm_missingparity++;
-			rc->rc_error = SET_ERROR(ENXIO);
-			rc->rc_tried = 1;	/* don't even try */
-			rc->rc_skipped = 1;
-			continue;
-		}
-		if (vdev_dtl_contains(cvd, DTL_MISSING, zio->io_txg, 1)) {
-			if (c >= rm->rm_firstdatacol)
-				rm->rm_missingdata++;
-			else
-				rm->rm_missingparity++;
-			rc->rc_error = SET_ERROR(ESTALE);
-			rc->rc_skipped = 1;
-			continue;
-		}
-		if (c >= rm->rm_firstdatacol || rm->rm_missingdata > 0 ||
-		    (zio->io_flags & (ZIO_FLAG_SCRUB | ZIO_FLAG_RESILVER))) {
-			zio_nowait(zio_vdev_child_io(zio, NULL, cvd,
-			    rc->rc_offset, rc->rc_abd, rc->rc_size,
-			    zio->io_type, zio->io_priority, 0,
-			    vdev_raidz_child_done, rc));
-		}
+	if (rm->rm_row != NULL) {
+		for (uint64_t r = 0; r < rm->rm_nrows; r++)
+			vdev_raidz_io_start_read(zio, rm->rm_row[r]);
+	} else {
+		vdev_raidz_io_start_read(zio, rm);
 	}
 
 	zio_execute(zio);
@@ -2301,70 +2538,384 @@ done:
 	return (ret);
 }
 
+static boolean_t
+vdev_raidz_col_on_disks(raidz_col_t *rc, const uint64_t *disks, int ndisks)
+{
+	for (int d = 0; d < ndisks; d++) {
+		if (rc->rc_devidx == disks[d])
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
 /*
- * Complete an IO operation on a RAIDZ VDev
- *
- * Outline:
- * - For write operations:
- *   1. Check for errors on the child IOs.
- *   2. Return, setting an error code if too few child VDevs were written
- *      to reconstruct the data later.  Note that partial writes are
- *      considered successful if they can be reconstructed at all.
- * - For read operations:
- *   1. Check for errors on the child IOs.
- *   2. If data errors occurred:
- *      a. Try to reassemble the data from the parity available.
- *      b. If we haven't yet read the parity drives, read them now.
- *      c. If all parity drives have been read but the data still doesn't
- *         reassemble with a correct checksum, then try combinatorial
- *         reconstruction.
- *      d. If that doesn't work, return an error.
- *   3. If there were unexpected errors or this is a resilver operation,
- *      rewrite the vdevs that had errors.
+ * Attempt a reconstruction of a split map treating every sector on the
+ * given children as damaged, in addition to those that returned errors.
+ * On success the sectors found to be damaged are marked as such, and on
+ * failure the data is restored to its original state.
  */
-static void
-vdev_raidz_io_done(zio_t *zio)
+static boolean_t
+vdev_raidz_combrec_rows_try(zio_t *zio, const uint64_t *disks, int ndisks,
+    char *orig)
 {
-	vdev_t *vd = zio->io_vd;
-	vdev_t *cvd;
 	raidz_map_t *rm = zio->io_vsd;
+	uint64_t nparity = rm->rm_firstdatacol;
+	raidz_map_t *row;
 	raidz_col_t *rc;
-	int unexpected_errors = 0;
-	int parity_errors = 0;
-	int parity_untried = 0;
-	int data_errors = 0;
-	int total_errors = 0;
-	int n, c;
 	int tgts[VDEV_RAIDZ_MAXPARITY];
-	int code;
+	boolean_t newdata = B_FALSE;
+	uint64_t r, size;
+	int c, i, n;
 
-	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
+	/*
+	 * Make sure that every row can be reconstructed, and that we'll
+	 * be reconstructing data we haven't already tried.
+	 */
+	for (r = 0; r < rm->rm_nrows; r++) {
+		row = rm->rm_row[r];
+		n = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			rc = &row->rm_col[c];
+			if (rc->rc_error != 0) {
+				n++;
+			} else if (vdev_raidz_col_on_disks(rc, disks, ndisks)) {
+				n++;
+				if (c >= row->rm_firstdatacol)
+					newdata = B_TRUE;
+			}
+		}
+		if (n > nparity)
+			return (B_FALSE);
+	}
+	if (!newdata)
+		return (B_FALSE);
+
+	size = rm->rm_row[0]->rm_col[0].rc_size;
+	for (r = 0; r < rm->rm_nrows; r++) {
+		boolean_t data = B_FALSE;
+
+		row = rm->rm_row[r];
+		n = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			rc = &row->rm_col[c];
+			boolean_t found = vdev_raidz_col_on_disks(rc, disks,
+			    ndisks);
+			if (rc->rc_error == 0 && found) {
+				abd_copy_to_buf(orig + (r * nparity + n) * size,
+				    rc->rc_abd, size);
+				tgts[n++] = c;
+			}
+			if ((rc->rc_error != 0 || found) &&
+			    c >= row->rm_firstdatacol)
+				data = B_TRUE;
+		}
+		if (data)
+			(void) vdev_raidz_reconstruct(row, tgts, n);
+	}
 
-	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
-	ASSERT(rm->rm_missingdata <= rm->rm_cols - rm->rm_firstdatacol);
+	boolean_t good = (raidz_checksum_verify(zio) == 0);
 
-	for (c = 0; c < rm->rm_cols; c++) {
-		rc = &rm->rm_col[c];
+	for (r = 0; r < rm->rm_nrows; r++) {
+		row = rm->rm_row[r];
+		n = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			rc = &row->rm_col[c];
+			boolean_t found = vdev_raidz_col_on_disks(rc, disks,
+			    ndisks);
+			if (rc->rc_error != 0 || !found)
+				continue;
 
-		if (rc->rc_error) {
-			ASSERT(rc->rc_error != ECKSUM);	/* child has no bp */
+			i = r * nparity + n++;
+			if (!good) {
+				abd_copy_from_buf(rc->rc_abd, orig + i * size,
+				    size);
+			} else {
+				if (rc->rc_tried) {
+					raidz_checksum_error(zio, rc,
+					    orig + i * size);
+				}
+				rc->rc_error = SET_ERROR(ECKSUM);
+			}
+		}
+	}
 
-			if (c < rm->rm_firstdatacol)
-				parity_errors++;
-			else
-				data_errors++;
+	return (good);
+}
 
-			if (!rc->rc_skipped)
-				unexpected_errors++;
+/*
+ * Combinatorial reconstruction of a split map.  The sectors of a column
+ * may be on different children, so rather than iterating over sets of
+ * columns we iterate over sets of children.
+ */
+static boolean_t
+vdev_raidz_combrec_rows(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_map_t *rm = zio->io_vsd;
+	uint64_t nparity = rm->rm_firstdatacol;
+	uint64_t children = vd->vdev_children;
+	uint64_t disks[VDEV_RAIDZ_MAXPARITY];
+	size_t osize = rm->rm_nrows * nparity *
+	    rm->rm_row[0]->rm_col[0].rc_size;
+	char *orig = kmem_alloc(osize, KM_SLEEP);
+	boolean_t good = B_FALSE;
+	int i, n;
+
+	for (n = 1; n <= nparity && !good; n++) {
+		for (i = 0; i < n; i++)
+			disks[i] = i;
+
+		for (;;) {
+			if (vdev_raidz_combrec_rows_try(zio, disks, n, orig)) {
+				good = B_TRUE;
+				break;
+			}
 
-			total_errors++;
-		} else if (c < rm->rm_firstdatacol && !rc->rc_tried) {
-			parity_untried++;
+			/* Move on to the next set of n children. */
+			for (i = n - 1; i >= 0 &&
+			    disks[i] == children - n + i; i--)
+				continue;
+			if (i < 0)
+				break;
+			disks[i]++;
+			for (i++; i < n; i++)
+				disks[i] = disks[i - 1] + 1;
 		}
 	}
 
-	if (zio->io_type == ZIO_TYPE_WRITE) {
-		/*
+	kmem_free(orig, osize);
+	return (good);
+}
+
+/*
+ * Complete an I/O to a split map.  This follows the same phases as
+ * vdev_raidz_io_done(), applied to each row.
+ */
+static void
+vdev_raidz_io_done_rows(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	raidz_map_t *rm = zio->io_vsd;
+	uint64_t nparity = rm->rm_firstdatacol;
+	raidz_map_t *row;
+	raidz_col_t *rc;
+	boolean_t correctable = B_TRUE;
+	boolean_t redone = B_FALSE;
+	int unexpected_errors = 0;
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	uint64_t r;
+	int c, n;
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		for (r = 0; r < rm->rm_nrows; r++) {
+			row = rm->rm_row[r];
+			n = 0;
+			for (c = 0; c < row->rm_cols; c++) {
+				if (row->rm_col[c].rc_error != 0)
+					n++;
+			}
+			/* XXPOLICY, as in vdev_raidz_io_done() */
+			if (n > nparity) {
+				zio->io_error = zio_worst_error(zio->io_error,
+				    vdev_raidz_worst_error(row));
+			}
+		}
+		return;
+	}
+
+	ASSERT(zio->io_type == ZIO_TYPE_READ);
+
+	/*
+	 * Phase 1: reconstruct any row with no more errors than parity
+	 * read.
+	 */
+	for (r = 0; r < rm->rm_nrows; r++) {
+		int total_errors = 0, parity_untried = 0;
+
+		row = rm->rm_row[r];
+		n = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			rc = &row->rm_col[c];
+			if (rc->rc_error != 0) {
+				if (c >= nparity)
+					tgts[n++] = c;
+				if (!rc->rc_skipped)
+					unexpected_errors++;
+				total_errors++;
+			} else if (c < nparity && !rc->rc_tried) {
+				parity_untried++;
+			}
+		}
+
+		if (total_errors > nparity - parity_untried)
+			correctable = B_FALSE;
+		else if (n != 0)
+			(void) vdev_raidz_reconstruct(row, tgts, n);
+	}
+
+	if (correctable && raidz_checksum_verify(zio) == 0) {
+		/*
+		 * Verify any parity we read, and regenerate it when
+		 * resilvering so that it can be written out below.
+		 */
+		for (r = 0; r < rm->rm_nrows; r++) {
+			row = rm->rm_row[r];
+			if (row->rm_col[0].rc_tried ||
+			    (zio->io_flags & ZIO_FLAG_RESILVER))
+				unexpected_errors += raidz_parity_verify(zio,
+				    row);
+		}
+		goto done;
+	}
+
+	/*
+	 * Phase 2: read every sector we haven't yet.
+	 */
+	unexpected_errors = 1;
+
+	for (r = 0; r < rm->rm_nrows; r++) {
+		row = rm->rm_row[r];
+		row->rm_missingdata = 0;
+		row->rm_missingparity = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			rc = &row->rm_col[c];
+			if (rc->rc_tried)
+				continue;
+
+			if (!redone) {
+				zio_vdev_io_redone(zio);
+				redone = B_TRUE;
+			}
+			zio_nowait(zio_vdev_child_io(zio, NULL,
+			    vd->vdev_child[rc->rc_devidx],
+			    rc->rc_offset, rc->rc_abd, rc->rc_size,
+			    zio->io_type, zio->io_priority, 0,
+			    vdev_raidz_child_done, rc));
+		}
+	}
+	if (redone)
+		return;
+
+	/*
+	 * Phase 3: combinatorial reconstruction.
+	 */
+	for (r = 0; r < rm->rm_nrows; r++) {
+		row = rm->rm_row[r];
+		n = 0;
+		for (c = 0; c < row->rm_cols; c++) {
+			if (row->rm_col[c].rc_error != 0)
+				n++;
+		}
+		if (n > nparity) {
+			zio->io_error = vdev_raidz_worst_error(row);
+			goto done;
+		}
+	}
+
+	/*
+	 * Checksum ereports for the children are not generated here, as
+	 * vdev_raidz_cksum_report() works on whole columns; the error is
+	 * still reported against the logical I/O.
+	 */
+	if (!vdev_raidz_combrec_rows(zio))
+		zio->io_error = SET_ERROR(ECKSUM);
+
+done:
+	zio_checksum_verified(zio);
+
+	if (zio->io_error == 0 && spa_writeable(zio->io_spa) &&
+	    (unexpected_errors || (zio->io_flags & ZIO_FLAG_RESILVER))) {
+		/*
+		 * Use the good data we have in hand to repair damaged children.
+		 */
+		for (r = 0; r < rm->rm_nrows; r++) {
+			row = rm->rm_row[r];
+			for (c = 0; c < row->rm_cols; c++) {
+				rc = &row->rm_col[c];
+				if (rc->rc_error == 0)
+					continue;
+
+				ASSERT3U(rc->rc_devidx, !=, UINT64_MAX);
+				zio_nowait(zio_vdev_child_io(zio, NULL,
+				    vd->vdev_child[rc->rc_devidx],
+				    rc->rc_offset, rc->rc_abd, rc->rc_size,
+				    ZIO_TYPE_WRITE, ZIO_PRIORITY_ASYNC_WRITE,
+				    ZIO_FLAG_IO_REPAIR | (unexpected_errors ?
+				    ZIO_FLAG_SELF_HEAL : 0), NULL, NULL));
+			}
+		}
+	}
+}
+
+/*
+ * Complete an IO operation on a RAIDZ VDev
+ *
+ * Outline:
+ * - For write operations:
+ *   1. Check for errors on the child IOs.
+ *   2. Return, setting an error code if too few child VDevs were written
+ *      to reconstruct the data later.  Note that partial writes are
+ *      considered successful if they can be reconstructed at all.
+ * - For read operations:
+ *   1. Check for errors on the child IOs.
+ *   2. If data errors occurred:
+ *      a. Try to reassemble the data from the parity available.
+ *      b. If we haven't yet read the parity drives, read them now.
+ *      c. If all parity drives have been read but the data still doesn't
+ *         reassemble with a correct checksum, then try combinatorial
+ *         reconstruction.
+ *      d. If that doesn't work, return an error.
+ *   3. If there were unexpected errors or this is a resilver operation,
+ *      rewrite the vdevs that had errors.
+ */
+void
+vdev_raidz_io_done(zio_t *zio)
+{
+	vdev_t *vd = zio->io_vd;
+	vdev_t *cvd;
+	raidz_map_t *rm = zio->io_vsd;
+	raidz_col_t *rc;
+	int unexpected_errors = 0;
+	int parity_errors = 0;
+	int parity_untried = 0;
+	int data_errors = 0;
+	int total_errors = 0;
+	int n, c;
+	int tgts[VDEV_RAIDZ_MAXPARITY];
+	int code;
+
+	ASSERT(zio->io_bp != NULL);  /* XXX need to add code to enforce this */
+
+	if (rm->rm_row != NULL) {
+		vdev_raidz_io_done_rows(zio);
+		return;
+	}
+
+	ASSERT(rm->rm_missingparity <= rm->rm_firstdatacol);
+	ASSERT(rm->rm_missingdata <= rm->rm_cols - rm->rm_firstdatacol);
+
+	for (c = 0; c < rm->rm_cols; c++) {
+		rc = &rm->rm_col[c];
+
+		if (rc->rc_error) {
+			ASSERT(rc->rc_error != ECKSUM);	/* child has no bp */
+
+			if (c < rm->rm_firstdatacol)
+				parity_errors++;
+			else
+				data_errors++;
+
+			if (!rc->rc_skipped)
+				unexpected_errors++;
+
+			total_errors++;
+		} else if (c < rm->rm_firstdatacol && !rc->rc_tried) {
+			parity_untried++;
+		}
+	}
+
+	if (zio->io_type == ZIO_TYPE_WRITE) {
+		/*
 		 * XXX -- for now, treat partial writes as a success.
 		 * (If we couldn't write enough columns to reconstruct
 		 * the data, the I/O failed.  Otherwise, good enough.)
@@ -2586,7 +3137,7 @@ done:
 	}
 }
 
-static void
+void
 vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
 {
 	if (faulted > vd->vdev_nparity)
@@ -2598,16 +3149,27 @@ vdev_raidz_state_change(vdev_t *vd, int faulted, int degraded)
 		vdev_set_state(vd, B_FALSE, VDEV_STATE_HEALTHY, VDEV_AUX_NONE);
 }
 
+/* ARGSUSED */
 static void
-vdev_raidz_xlate(vdev_t *cvd, const range_seg_t *in, range_seg_t *res)
+vdev_raidz_xlate(vdev_t *cvd, const range_seg64_t *in,
+    range_seg64_t *res, range_seg64_t *remain)
 {
 	vdev_t *raidvd = cvd->vdev_parent;
 	ASSERT(raidvd->vdev_ops == &vdev_raidz_ops);
 
-	uint64_t width = raidvd->vdev_children;
+	uint64_t width = vdev_raidz_logical_width(raidvd, UINT64_MAX);
 	uint64_t tgt_col = cvd->vdev_id;
 	uint64_t ashift = raidvd->vdev_top->vdev_ashift;
 
+	/*
+	 * During an expansion this is only correct above the reflow offset,
+	 * and the new child holds nothing there.
+	 */
+	if (tgt_col >= width) {
+		res->rs_start = res->rs_end = 0;
+		return;
+	}
+
 	/* make sure the offsets are block-aligned */
 	ASSERT0(in->rs_start % (1 << ashift));
 	ASSERT0(in->rs_end % (1 << ashift));
@@ -2629,6 +3191,617 @@ vdev_raidz_xlate(vdev_t *cvd, const range_seg_t *in, range_seg_t *res)
 	ASSERT3U(res->rs_end - res->rs_start, <=, in->rs_end - in->rs_start);
 }
 
+/*
+ * RAID-Z expansion
+ *
+ * A RAID-Z vdev is expanded by attaching a new child to it.  Every sector
+ * of the vdev keeps its offset, but moves to where it belongs in a layout
+ * across all of the children: with n children, sector S moves from row
+ * S / (n - 1) of child S % (n - 1) to row S / n of child S % n.  The
+ * reflow thread copies the sectors in increasing order, and vre_offset
+ * separates those that have been copied from those that have not.
+ *
+ * The new location of a sector may hold the old location of a lower one,
+ * so a sector is only copied once all of the sectors it overwrites have
+ * been copied in a synced txg.  The synced progress is kept in the
+ * uberblock (ub_raidz_reflow_info), and after a crash everything from there
+ * on is copied again; this is why writes of sectors between the synced and
+ * the in-core progress go to both locations.  It also means that the
+ * amount that can be copied in a txg is small to begin with, growing by a
+ * factor of n / (n - 1) with each txg.
+ *
+ * Blocks keep the number of columns they were allocated with, which is
+ * recorded as the txgs at which each expansion completed
+ * (vdev_rz_expand_txgs; see vdev_raidz_logical_width()).  Blocks whose
+ * sectors are not all where their own layout would put them are accessed
+ * one row at a time (see vdev_raidz_map_split()).
+ */
+
+/*
+ * Maximum amount of data the reflow thread copies at once.
+ */
+uint64_t zfs_raidz_expand_max_copy_bytes = 16 * 1024 * 1024;
+
+typedef struct raidz_reflow_arg {
+	vdev_raidz_expand_t	*rra_vre;
+	locked_range_t		*rra_lr;
+	uint64_t		rra_offset;
+} raidz_reflow_arg_t;
+
+/*
+ * Return the number of columns that blocks allocated in the given txg are
+ * laid out across.  A txg of UINT64_MAX gives the width of new blocks.
+ */
+uint64_t
+vdev_raidz_logical_width(vdev_t *vd, uint64_t txg)
+{
+	uint64_t width = vd->vdev_children;
+
+	ASSERT(vd->vdev_ops == &vdev_raidz_ops);
+
+	if (vd->vdev_rz_expanding)
+		width--;
+
+	for (int i = vd->vdev_rz_expand_count - 1;
+	    i >= 0 && vd->vdev_rz_expand_txgs[i] > txg; i--)
+		width--;
+
+	return (width);
+}
+
+/*
+ * Check whether the given RAID-Z vdev can be expanded.  Every sector is
+ * copied as is, so all of the children must be present and up to date.
+ */
+int
+vdev_raidz_attach_check(vdev_t *vd)
+{
+	spa_t *spa = vd->vdev_spa;
+
+	ASSERT(vd->vdev_ops == &vdev_raidz_ops);
+
+	if (vd->vdev_rz_expanding ||
+	    spa->spa_raidz_expand_phys.vrep_state == DSS_SCANNING)
+		return (ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS);
+
+	for (int c = 0; c < vd->vdev_children; c++) {
+		vdev_t *cvd = vd->vdev_child[c];
+		boolean_t initializing;
+
+		if (!vdev_readable(cvd) || !vdev_writeable(cvd) ||
+		    cvd->vdev_state != VDEV_STATE_HEALTHY)
+			return (SET_ERROR(ENXIO));
+
+		if (!vdev_dtl_empty(cvd, DTL_MISSING))
+			return (SET_ERROR(EBUSY));
+
+		mutex_enter(&cvd->vdev_initialize_lock);
+		initializing = (cvd->vdev_initialize_thread != NULL);
+		mutex_exit(&cvd->vdev_initialize_lock);
+		if (initializing)
+			return (SET_ERROR(EBUSY));
+	}
+
+	return (0);
+}
+
+/*
+ * Set up the in-core state of an expansion of the given vdev.  The state
+ * is kept until the pool is unloaded, so that I/O which started during
+ * the expansion can always drop its range lock.
+ */
+void
+spa_raidz_expand_create(spa_t *spa, vdev_t *vd)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	ASSERT(vd->vdev_rz_expanding);
+
+	if (vre == NULL) {
+		vre = kmem_zalloc(sizeof (*vre), KM_SLEEP);
+		mutex_init(&vre->vre_lock, NULL, MUTEX_DEFAULT, NULL);
+		cv_init(&vre->vre_cv, NULL, CV_DEFAULT, NULL);
+		rangelock_init(&vre->vre_rangelock, NULL, NULL);
+		spa->spa_raidz_expand = vre;
+	}
+
+	ASSERT3P(vre->vre_thread, ==, NULL);
+	vre->vre_vdev_id = vd->vdev_id;
+	/* The first row is the same in both layouts. */
+	vre->vre_offset = (vd->vdev_children - 1) << vd->vdev_ashift;
+	bzero(vre->vre_offset_pertxg, sizeof (vre->vre_offset_pertxg));
+	vre->vre_failed_offset = UINT64_MAX;
+}
+
+void
+spa_raidz_expand_destroy(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL)
+		return;
+
+	ASSERT3P(vre->vre_thread, ==, NULL);
+	rangelock_fini(&vre->vre_rangelock);
+	cv_destroy(&vre->vre_cv);
+	mutex_destroy(&vre->vre_lock);
+	kmem_free(vre, sizeof (*vre));
+	spa->spa_raidz_expand = NULL;
+}
+
+static void
+raidz_reflow_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	int txgoff = dmu_tx_get_txg(tx) & TXG_MASK;
+	uint64_t offset;
+
+	mutex_enter(&vre->vre_lock);
+	offset = vre->vre_offset_pertxg[txgoff];
+	vre->vre_offset_pertxg[txgoff] = 0;
+	mutex_exit(&vre->vre_lock);
+
+	/*
+	 * The copies made in this txg are children of its spa_txg_zio, so
+	 * they are on disk before the uberblock recording them.
+	 */
+	spa->spa_uberblock.ub_raidz_reflow_info = offset;
+	spa->spa_raidz_expand_phys.vrep_reflowed = offset;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_RAIDZ_EXPAND,
+	    sizeof (uint64_t),
+	    sizeof (vdev_raidz_expand_phys_t) / sizeof (uint64_t),
+	    &spa->spa_raidz_expand_phys, tx));
+}
+
+static void
+raidz_reflow_read_done(zio_t *zio)
+{
+	int *errorp = zio->io_private;
+
+	*errorp = zio->io_error;
+}
+
+static void
+raidz_reflow_write_done(zio_t *zio)
+{
+	/*
+	 * As for a regular RAID-Z write, a failed child is tolerated: the
+	 * affected sectors can be reconstructed from parity.
+	 */
+	if (zio->io_error != 0) {
+		zfs_dbgmsg("reflow write to vdev %llu offset %llu failed: %d",
+		    (u_longlong_t)zio->io_vd->vdev_id,
+		    (u_longlong_t)zio->io_offset, zio->io_error);
+	}
+
+	abd_free(zio->io_abd);
+}
+
+/*
+ * All of a batch's writes are done; I/O to it can now proceed, with its
+ * sectors at their new location.
+ */
+static void
+raidz_reflow_batch_done(zio_t *zio)
+{
+	raidz_reflow_arg_t *rra = zio->io_private;
+	vdev_raidz_expand_t *vre = rra->rra_vre;
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_offset = rra->rra_offset;
+	mutex_exit(&vre->vre_lock);
+
+	rangelock_exit(rra->rra_lr);
+	kmem_free(rra, sizeof (*rra));
+	spa_config_exit(zio->io_spa, SCL_STATE, zio->io_spa);
+}
+
+/*
+ * Return the first row at or after the given sector in which the given
+ * child holds a sector, in a layout of the given width.
+ */
+static uint64_t
+raidz_reflow_row(uint64_t sector, uint64_t child, uint64_t width)
+{
+	if (sector <= child)
+		return (0);
+	return ((sector - child + width - 1) / width);
+}
+
+/*
+ * Copy the sectors [start, end) from their old location to their new one
+ * as part of the open txg.  Each child's share of the sectors is
+ * contiguous in both layouts, so this takes one read from each old child
+ * and one write to each new one.
+ */
+static int
+raidz_reflow_batch(spa_t *spa, vdev_t *vd, uint64_t start, uint64_t end)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	uint64_t ashift = vd->vdev_ashift;
+	uint64_t newwidth = vd->vdev_children;
+	uint64_t oldwidth = newwidth - 1;
+	abd_t **abds = kmem_zalloc(oldwidth * sizeof (abd_t *), KM_SLEEP);
+	uint64_t *rows = kmem_zalloc(oldwidth * sizeof (uint64_t), KM_SLEEP);
+	int *errors = kmem_zalloc(oldwidth * sizeof (int), KM_SLEEP);
+	uint64_t c, nrows, lstart;
+	int error = 0;
+
+	dmu_tx_t *tx = dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+	uint64_t txg = dmu_tx_get_txg(tx);
+
+	/*
+	 * Lock out I/O to the sectors being copied, and to those whose old
+	 * location they are copied over.
+	 */
+	lstart = (start / newwidth) * oldwidth;
+	locked_range_t *lr = rangelock_enter(&vre->vre_rangelock,
+	    lstart << ashift, (end - lstart) << ashift, RL_WRITER);
+
+	spa_config_enter(spa, SCL_STATE, spa, RW_READER);
+
+	zio_t *rio = zio_root(spa, NULL, NULL, ZIO_FLAG_CANFAIL);
+	for (c = 0; c < oldwidth; c++) {
+		rows[c] = raidz_reflow_row(start, c, oldwidth);
+		nrows = raidz_reflow_row(end, c, oldwidth) - rows[c];
+		if (nrows == 0)
+			continue;
+
+		abds[c] = abd_alloc_for_io(nrows << ashift, B_FALSE);
+		zio_nowait(zio_vdev_child_io(rio, NULL, vd->vdev_child[c],
+		    rows[c] << ashift, abds[c], nrows << ashift,
+		    ZIO_TYPE_READ, ZIO_PRIORITY_REMOVAL, ZIO_FLAG_CANFAIL,
+		    raidz_reflow_read_done, &errors[c]));
+	}
+	(void) zio_wait(rio);
+
+	for (c = 0; c < oldwidth; c++)
+		error = zio_worst_error(error, errors[c]);
+
+	if (error != 0) {
+		spa_config_exit(spa, SCL_STATE, spa);
+		rangelock_exit(lr);
+		dmu_tx_commit(tx);
+		goto out;
+	}
+
+	raidz_reflow_arg_t *rra = kmem_zalloc(sizeof (*rra), KM_SLEEP);
+	rra->rra_vre = vre;
+	rra->rra_lr = lr;
+	rra->rra_offset = end << ashift;
+
+	zio_t *pio = zio_null(spa->spa_txg_zio[txg & TXG_MASK], spa, NULL,
+	    raidz_reflow_batch_done, rra, 0);
+	for (c = 0; c < newwidth; c++) {
+		uint64_t first = raidz_reflow_row(start, c, newwidth);
+
+		nrows = raidz_reflow_row(end, c, newwidth) - first;
+		if (nrows == 0)
+			continue;
+
+		abd_t *abd = abd_alloc_for_io(nrows << ashift, B_FALSE);
+		for (uint64_t r = 0; r < nrows; r++) {
+			uint64_t sector = (first + r) * newwidth + c;
+			uint64_t oc = sector % oldwidth;
+
+			abd_copy_off(abd, abds[oc], r << ashift,
+			    (sector / oldwidth - rows[oc]) << ashift,
+			    1ULL << ashift);
+		}
+
+		zio_nowait(zio_vdev_child_io(pio, NULL, vd->vdev_child[c],
+		    first << ashift, abd, nrows << ashift,
+		    ZIO_TYPE_WRITE, ZIO_PRIORITY_REMOVAL, ZIO_FLAG_CANFAIL,
+		    raidz_reflow_write_done, NULL));
+	}
+	zio_nowait(pio);
+
+	mutex_enter(&vre->vre_lock);
+	if (vre->vre_offset_pertxg[txg & TXG_MASK] == 0) {
+		dsl_sync_task_nowait(spa_get_dsl(spa), raidz_reflow_sync,
+		    spa, 0, ZFS_SPACE_CHECK_NONE, tx);
+	}
+	vre->vre_offset_pertxg[txg & TXG_MASK] = end << ashift;
+	mutex_exit(&vre->vre_lock);
+
+	dmu_tx_commit(tx);
+
+out:
+	for (c = 0; c < oldwidth; c++) {
+		if (abds[c] != NULL)
+			abd_free(abds[c]);
+	}
+	kmem_free(abds, oldwidth * sizeof (abd_t *));
+	kmem_free(rows, oldwidth * sizeof (uint64_t));
+	kmem_free(errors, oldwidth * sizeof (int));
+
+	return (error);
+}
+
+static void
+raidz_reflow_thread(void *arg)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	dsl_pool_t *dp = spa_get_dsl(spa);
+	vdev_t *vd = vdev_lookup_top(spa, vre->vre_vdev_id);
+	uint64_t ashift = vd->vdev_ashift;
+	uint64_t newwidth = vd->vdev_children;
+	uint64_t oldwidth = newwidth - 1;
+	uint64_t end = (vd->vdev_ms_count << vd->vdev_ms_shift) >> ashift;
+	uint64_t next = vre->vre_offset >> ashift;
+
+	ASSERT(vd->vdev_rz_expanding);
+
+	/*
+	 * Make sure that the expansion itself is synced before we move
+	 * anything.
+	 */
+	txg_wait_synced(dp, 0);
+
+	while (!vre->vre_thread_exit && next < end) {
+		uint64_t synced = MAX(spa->spa_ubsync.ub_raidz_reflow_info >>
+		    ashift, oldwidth);
+		uint64_t last = synced - 1;
+		uint64_t limit, len;
+
+		/*
+		 * Find the first sector whose new location is still needed
+		 * as the old location of a sector that isn't synced yet.
+		 */
+		limit = (last / oldwidth) * newwidth + last % oldwidth + 1;
+		if (last % oldwidth == oldwidth - 1)
+			limit++;
+
+		if (limit <= next) {
+			txg_wait_synced(dp, 0);
+			continue;
+		}
+
+		len = MIN(limit, end) - next;
+		len = MIN(len, MAX(zfs_raidz_expand_max_copy_bytes >> ashift,
+		    1));
+
+		int error = raidz_reflow_batch(spa, vd, next, next + len);
+		if (error != 0) {
+			mutex_enter(&vre->vre_lock);
+			vre->vre_failed_offset = next << ashift;
+			mutex_exit(&vre->vre_lock);
+			zfs_dbgmsg("reflow of vdev %llu paused at offset %llu: "
+			    "read error %d", (u_longlong_t)vd->vdev_id,
+			    (u_longlong_t)(next << ashift), error);
+			break;
+		}
+		next += len;
+	}
+
+	if (next >= end) {
+		/*
+		 * Make sure that all of the copies are synced before the
+		 * expansion is marked complete.
+		 */
+		txg_wait_synced(dp, 0);
+		spa_async_request(spa, SPA_ASYNC_RAIDZ_EXPAND_DONE);
+	}
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_thread = NULL;
+	cv_broadcast(&vre->vre_cv);
+	mutex_exit(&vre->vre_lock);
+}
+
+/*
+ * Record the start of an expansion, for the vdev whose id is given, in the
+ * txg in which its new child was attached.
+ */
+void
+vdev_raidz_attach_sync(void *arg, dmu_tx_t *tx)
+{
+	uint64_t vdev_id = (uintptr_t)arg;
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	vdev_t *vd = vdev_lookup_top(spa, vdev_id);
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_raidz_expand_phys_t *vrep = &spa->spa_raidz_expand_phys;
+
+	ASSERT(vd->vdev_rz_expanding);
+	ASSERT3U(vre->vre_vdev_id, ==, vdev_id);
+
+	spa_feature_incr(spa, SPA_FEATURE_RAIDZ_EXPANSION, tx);
+
+	vrep->vrep_state = DSS_SCANNING;
+	vrep->vrep_vdev = vdev_id;
+	vrep->vrep_start_time = gethrestime_sec();
+	vrep->vrep_end_time = 0;
+	vrep->vrep_to_reflow = vd->vdev_ms_count << vd->vdev_ms_shift;
+	vrep->vrep_reflowed = vre->vre_offset;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_RAIDZ_EXPAND,
+	    sizeof (uint64_t), sizeof (*vrep) / sizeof (uint64_t), vrep, tx));
+
+	spa->spa_uberblock.ub_raidz_reflow_info = vre->vre_offset;
+
+	spa_history_log_internal(spa, "raidz vdev expansion started", tx,
+	    "%s vdev %llu new width %llu", spa_name(spa), vd->vdev_id,
+	    vd->vdev_children);
+
+	ASSERT3P(vre->vre_thread, ==, NULL);
+	vre->vre_thread = thread_create(NULL, 0, raidz_reflow_thread, spa,
+	    0, &p0, TS_RUN, minclsyspri);
+}
+
+static void
+raidz_expand_done_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = arg;
+	vdev_raidz_expand_phys_t *vrep = &spa->spa_raidz_expand_phys;
+
+	vrep->vrep_state = DSS_FINISHED;
+	vrep->vrep_end_time = gethrestime_sec();
+	vrep->vrep_reflowed = vrep->vrep_to_reflow;
+	VERIFY0(zap_update(spa->spa_meta_objset,
+	    DMU_POOL_DIRECTORY_OBJECT, DMU_POOL_RAIDZ_EXPAND,
+	    sizeof (uint64_t), sizeof (*vrep) / sizeof (uint64_t), vrep, tx));
+
+	spa->spa_uberblock.ub_raidz_reflow_info = 0;
+
+	spa_history_log_internal(spa, "raidz vdev expansion completed", tx,
+	    "%s vdev %llu", spa_name(spa), vrep->vrep_vdev);
+}
+
+/*
+ * Complete an expansion whose reflow is done and synced: blocks allocated
+ * from now on span all of the children, and the vdev grows accordingly.
+ * Called from the async thread.
+ */
+void
+spa_raidz_expand_done(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+	vdev_raidz_expand_phys_t *vrep = &spa->spa_raidz_expand_phys;
+	uint64_t txg = spa_vdev_enter(spa);
+	vdev_t *vd = vdev_lookup_top(spa, vrep->vrep_vdev);
+	uint64_t *txgs;
+	uint_t count;
+
+	if (vre == NULL || vd == NULL || !vd->vdev_rz_expanding ||
+	    vrep->vrep_state != DSS_SCANNING ||
+	    vre->vre_offset < vrep->vrep_to_reflow) {
+		(void) spa_vdev_exit(spa, NULL, txg, 0);
+		return;
+	}
+
+	/*
+	 * Blocks from any txg that may already have allocations keep the
+	 * old width.
+	 */
+	count = vd->vdev_rz_expand_count;
+	txgs = kmem_alloc((count + 1) * sizeof (uint64_t), KM_SLEEP);
+	if (count != 0) {
+		bcopy(vd->vdev_rz_expand_txgs, txgs, count * sizeof (uint64_t));
+		kmem_free(vd->vdev_rz_expand_txgs, count * sizeof (uint64_t));
+	}
+	txgs[count] = txg + TXG_CONCURRENT_STATES;
+	vd->vdev_rz_expand_txgs = txgs;
+	vd->vdev_rz_expand_count = count + 1;
+	vd->vdev_rz_expanding = B_FALSE;
+	vdev_config_dirty(vd);
+
+	vd->vdev_expanding = B_TRUE;
+	vdev_reopen(vd);
+	vd->vdev_expanding = B_FALSE;
+
+	dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+	dsl_sync_task_nowait(spa->spa_dsl_pool, raidz_expand_done_sync, spa,
+	    0, ZFS_SPACE_CHECK_NONE, tx);
+	dmu_tx_commit(tx);
+
+	(void) spa_vdev_exit(spa, NULL, txg, 0);
+}
+
+int
+spa_raidz_expand_init(spa_t *spa)
+{
+	vdev_raidz_expand_phys_t *vrep = &spa->spa_raidz_expand_phys;
+	vdev_raidz_expand_t *vre;
+	int error;
+
+	error = zap_lookup(spa->spa_meta_objset, DMU_POOL_DIRECTORY_OBJECT,
+	    DMU_POOL_RAIDZ_EXPAND, sizeof (uint64_t),
+	    sizeof (*vrep) / sizeof (uint64_t), vrep);
+
+	if (error == ENOENT) {
+		vrep->vrep_state = DSS_NONE;
+		vrep->vrep_vdev = -1;
+		return (0);
+	} else if (error != 0) {
+		return (error);
+	}
+
+	if (vrep->vrep_state != DSS_SCANNING)
+		return (0);
+
+	spa_config_enter(spa, SCL_STATE, FTAG, RW_READER);
+	vdev_t *vd = vdev_lookup_top(spa, vrep->vrep_vdev);
+	if (vd == NULL || vd->vdev_ops != &vdev_raidz_ops ||
+	    !vd->vdev_rz_expanding) {
+		spa_config_exit(spa, SCL_STATE, FTAG);
+		return (SET_ERROR(EINVAL));
+	}
+
+	spa_raidz_expand_create(spa, vd);
+	vre = spa->spa_raidz_expand;
+	vre->vre_offset = MAX(vre->vre_offset,
+	    spa->spa_uberblock.ub_raidz_reflow_info);
+	spa_config_exit(spa, SCL_STATE, FTAG);
+
+	return (0);
+}
+
+void
+spa_raidz_expand_restart(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL ||
+	    spa->spa_raidz_expand_phys.vrep_state != DSS_SCANNING)
+		return;
+
+	/* See the comment in spa_restart_removal(). */
+	if (vre->vre_thread != NULL)
+		return;
+
+	if (!spa_writeable(spa))
+		return;
+
+	zfs_dbgmsg("restarting expansion of vdev %llu at offset %llu",
+	    (u_longlong_t)vre->vre_vdev_id, (u_longlong_t)vre->vre_offset);
+	vre->vre_failed_offset = UINT64_MAX;
+	vre->vre_thread = thread_create(NULL, 0, raidz_reflow_thread, spa,
+	    0, &p0, TS_RUN, minclsyspri);
+}
+
+void
+spa_raidz_expand_suspend(spa_t *spa)
+{
+	vdev_raidz_expand_t *vre = spa->spa_raidz_expand;
+
+	if (vre == NULL)
+		return;
+
+	mutex_enter(&vre->vre_lock);
+	vre->vre_thread_exit = B_TRUE;
+	while (vre->vre_thread != NULL)
+		cv_wait(&vre->vre_cv, &vre->vre_lock);
+	vre->vre_thread_exit = B_FALSE;
+	mutex_exit(&vre->vre_lock);
+}
+
+int
+spa_raidz_expand_get_stats(spa_t *spa, pool_raidz_expand_stat_t *pres)
+{
+	vdev_raidz_expand_phys_t *vrep = &spa->spa_raidz_expand_phys;
+
+	pres->pres_state = vrep->vrep_state;
+
+	if (pres->pres_state == DSS_NONE)
+		return (SET_ERROR(ENOENT));
+
+	pres->pres_expanding_vdev = vrep->vrep_vdev;
+	pres->pres_start_time = vrep->vrep_start_time;
+	pres->pres_end_time = vrep->vrep_end_time;
+	pres->pres_to_reflow = vrep->vrep_to_reflow;
+	pres->pres_reflowed = vrep->vrep_reflowed;
+
+	if (pres->pres_state == DSS_SCANNING &&
+	    spa->spa_raidz_expand != NULL)
+		pres->pres_reflowed = spa->spa_raidz_expand->vre_offset;
+
+	return (0);
+}
+
 vdev_ops_t vdev_raidz_ops = {
 	vdev_raidz_open,
 	vdev_raidz_close,
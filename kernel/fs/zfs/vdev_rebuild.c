@@ -0,0 +1,643 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License (the "License").
+ * You may not use this file except in compliance with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+
+#include <sys/spa.h>
+#include <sys/spa_impl.h>
+#include <sys/txg.h>
+#include <sys/vdev_impl.h>
+#include <sys/vdev_draid.h>
+#include <sys/vdev_initialize.h>
+#include <sys/vdev_rebuild.h>
+#include <sys/metaslab_impl.h>
+#include <sys/dsl_pool.h>
+#include <sys/dsl_synctask.h>
+#include <sys/zfeature.h>
+#include <sys/zap.h>
+#include <sys/abd.h>
+#include <sys/dmu_tx.h>
+
+/*
+ * Sequential rebuild
+ *
+ * A resilver traverses the block pointers of the pool, so it can verify
+ * each block's checksum, but it visits the blocks in logical order and so
+ * issues mostly random I/O.  For mirror and dRAID vdevs the layout of a
+ * block depends only on its offset and size, so a device can instead be
+ * rebuilt by reading each allocated range of its top-level vdev in offset
+ * order, reconstructing whatever is missing, and writing it out.  This
+ * sequential I/O is much faster, and for dRAID is spread over all of the
+ * children.
+ *
+ * Each allocated range is read as a fabricated block with no checksum (the
+ * reconstructed data can't be verified), born in TXG_INITIAL so that every
+ * device with missing data since the pool was created is repaired.  For
+ * dRAID the ranges are cut at group boundaries, and consist of whole
+ * logical rows (see vdev_draid.c).
+ *
+ * When the rebuild completes without read errors, the DTLs of the rebuilt
+ * devices are excised as if they had been resilvered, any completed
+ * replacement is detached, and a scrub is started to verify the checksums
+ * of the rebuilt data.
+ *
+ * The progress is recorded in the top-level vdev's ZAP, and a rebuild
+ * resumes where it left off when the pool is imported.  Attaching another
+ * device to the same top-level vdev restarts it from the beginning.
+ */
+
+/* maximum number of I/Os outstanding per top-level vdev */
+int zfs_rebuild_queue_limit = 20;
+
+/* maximum size of a rebuild I/O; default 1MiB, see zfs_remove_max_segment */
+uint64_t zfs_rebuild_max_segment = 1024 * 1024;
+
+static void vdev_rebuild_thread(void *arg);
+
+static boolean_t
+vdev_rebuild_should_stop(vdev_t *vd)
+{
+	return (vd->vdev_rebuild_exit_wanted ||
+	    vd->vdev_rebuild_reset_wanted || !vdev_readable(vd) ||
+	    vd->vdev_removing);
+}
+
+/*
+ * Write the rebuild state to the top-level vdev's ZAP.
+ */
+static void
+vdev_rebuild_update_phys(vdev_t *vd, dmu_tx_t *tx)
+{
+	vdev_rebuild_phys_t *vrp = &vd->vdev_rebuild_config.vr_rebuild_phys;
+	vdev_rebuild_phys_t phys;
+
+	ASSERT(MUTEX_HELD(&vd->vdev_rebuild_lock));
+
+	if (vd->vdev_top_zap == 0)
+		return;
+
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	phys = *vrp;
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+
+	VERIFY0(zap_update(vd->vdev_spa->spa_meta_objset, vd->vdev_top_zap,
+	    VDEV_TOP_ZAP_VDEV_REBUILD_PHYS, sizeof (uint64_t),
+	    REBUILD_PHYS_ENTRIES, &phys, tx));
+}
+
+/*
+ * The vdev id is passed rather than the vdev_t, which is safe as a
+ * top-level vdev can't be removed while it is being rebuilt; it may have
+ * been replaced by a hole if its addition was rolled back.
+ */
+static vdev_t *
+vdev_rebuild_lookup(spa_t *spa, void *arg)
+{
+	uint64_t id = (uint64_t)(uintptr_t)arg;
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	if (id >= rvd->vdev_children ||
+	    !vdev_is_concrete(rvd->vdev_child[id]))
+		return (NULL);
+
+	return (rvd->vdev_child[id]);
+}
+
+static void
+vdev_rebuild_update_sync(void *arg, dmu_tx_t *tx)
+{
+	vdev_t *vd = vdev_rebuild_lookup(dmu_tx_pool(tx)->dp_spa, arg);
+	uint64_t txg = dmu_tx_get_txg(tx);
+
+	if (vd == NULL)
+		return;
+
+	vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+	if (vr->vr_scan_offset[txg & TXG_MASK] > 0) {
+		vr->vr_rebuild_phys.vrp_last_offset =
+		    vr->vr_scan_offset[txg & TXG_MASK];
+		vr->vr_scan_offset[txg & TXG_MASK] = 0;
+	}
+	if (vr->vr_rebuild_phys.vrp_rebuild_state == VDEV_REBUILD_ACTIVE)
+		vdev_rebuild_update_phys(vd, tx);
+	mutex_exit(&vd->vdev_rebuild_lock);
+}
+
+/*
+ * Start, or restart, the rebuild in syncing context.  All blocks born
+ * before the device was attached must be rebuilt; allowing for blocks
+ * written by dmu_sync() in the txgs that are still open, that's every
+ * block born before vrp_max_txg.
+ */
+static void
+vdev_rebuild_initiate_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	vdev_t *vd = vdev_rebuild_lookup(spa, arg);
+
+	if (vd == NULL)
+		return;
+
+	vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+	vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+
+	if (vrp->vrp_rebuild_state != VDEV_REBUILD_ACTIVE)
+		spa_feature_incr(spa, SPA_FEATURE_DEVICE_REBUILD, tx);
+
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	bzero(vrp, sizeof (*vrp));
+	vrp->vrp_rebuild_state = VDEV_REBUILD_ACTIVE;
+	vrp->vrp_max_txg = dmu_tx_get_txg(tx) + TXG_CONCURRENT_STATES;
+	vrp->vrp_start_time = gethrestime_sec();
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+	bzero(vr->vr_scan_offset, sizeof (vr->vr_scan_offset));
+
+	vdev_rebuild_update_phys(vd, tx);
+
+	spa_history_log_internal(spa, "rebuild", tx,
+	    "vdev_id=%llu vdev_guid=%llu started",
+	    (u_longlong_t)vd->vdev_id, (u_longlong_t)vd->vdev_guid);
+
+	if (vd->vdev_rebuild_thread != NULL) {
+		vd->vdev_rebuild_reset_wanted = B_TRUE;
+	} else {
+		vd->vdev_rebuild_thread = thread_create(NULL, 0,
+		    vdev_rebuild_thread, vd, 0, &p0, TS_RUN, maxclsyspri);
+	}
+
+	mutex_exit(&vd->vdev_rebuild_lock);
+}
+
+static void
+vdev_rebuild_complete_sync(void *arg, dmu_tx_t *tx)
+{
+	spa_t *spa = dmu_tx_pool(tx)->dp_spa;
+	vdev_t *vd = vdev_rebuild_lookup(spa, arg);
+
+	if (vd == NULL)
+		return;
+
+	vdev_rebuild_phys_t *vrp = &vd->vdev_rebuild_config.vr_rebuild_phys;
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+
+	/*
+	 * The rebuild was restarted after this was scheduled.
+	 */
+	if (vd->vdev_rebuild_reset_wanted ||
+	    vrp->vrp_rebuild_state != VDEV_REBUILD_ACTIVE) {
+		mutex_exit(&vd->vdev_rebuild_lock);
+		return;
+	}
+
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	vrp->vrp_rebuild_state = VDEV_REBUILD_COMPLETE;
+	vrp->vrp_end_time = gethrestime_sec();
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+	vdev_rebuild_update_phys(vd, tx);
+	spa_feature_decr(spa, SPA_FEATURE_DEVICE_REBUILD, tx);
+
+	spa_history_log_internal(spa, "rebuild", tx,
+	    "vdev_id=%llu vdev_guid=%llu errors=%llu complete",
+	    (u_longlong_t)vd->vdev_id, (u_longlong_t)vd->vdev_guid,
+	    (u_longlong_t)vrp->vrp_errors);
+
+	/*
+	 * Data which couldn't be read couldn't be rebuilt, so leave the
+	 * DTLs for the scrub to clear.
+	 */
+	if (vrp->vrp_errors == 0) {
+		vdev_dtl_reassess(vd, dmu_tx_get_txg(tx), vrp->vrp_max_txg,
+		    B_FALSE, B_TRUE);
+	}
+
+	mutex_exit(&vd->vdev_rebuild_lock);
+
+	spa_async_request(spa, SPA_ASYNC_REBUILD_DONE);
+}
+
+static void
+vdev_rebuild_cb(zio_t *zio)
+{
+	vdev_rebuild_t *vr = zio->io_private;
+	vdev_t *vd = vr->vr_top_vdev;
+	vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
+
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	if (zio->io_error == ENXIO && !vdev_readable(vd)) {
+		/*
+		 * The I/O failed because the vdev was unavailable; roll the
+		 * last offset back. (This works because spa_sync waits on
+		 * spa_txg_zio before it runs sync tasks.)
+		 */
+		uint64_t *off = &vr->vr_scan_offset[zio->io_txg & TXG_MASK];
+		*off = MIN(*off, DVA_GET_OFFSET(&zio->io_bp->blk_dva[0]));
+	} else {
+		if (zio->io_error != 0)
+			vrp->vrp_errors++;
+
+		vrp->vrp_bytes_scanned +=
+		    DVA_GET_ASIZE(&zio->io_bp->blk_dva[0]);
+	}
+	ASSERT3U(vd->vdev_rebuild_inflight, >, 0);
+	vd->vdev_rebuild_inflight--;
+	cv_broadcast(&vd->vdev_rebuild_io_cv);
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+
+	abd_free(zio->io_abd);
+
+	spa_config_exit(vd->vdev_spa, SCL_STATE_ALL, vd);
+}
+
+/*
+ * Rebuild one range, which lies within a single group of a dRAID vdev,
+ * and limit the number of concurrent ZIOs.
+ */
+static int
+vdev_rebuild_range(vdev_rebuild_t *vr, uint64_t start, uint64_t size)
+{
+	vdev_t *vd = vr->vr_top_vdev;
+	spa_t *spa = vd->vdev_spa;
+	uint64_t psize = size;
+	blkptr_t blk, *bp = &blk;
+
+	if (vd->vdev_ops == &vdev_draid_ops) {
+		vdev_draid_config_t *vdc = vd->vdev_tsd;
+
+		psize = size / vdc->vdc_groupwidth * vdc->vdc_ndata;
+	}
+
+	/* Limit inflight rebuild I/Os */
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	while (vd->vdev_rebuild_inflight >= zfs_rebuild_queue_limit)
+		cv_wait(&vd->vdev_rebuild_io_cv, &vd->vdev_rebuild_io_lock);
+	vd->vdev_rebuild_inflight++;
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+
+	dmu_tx_t *tx = dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+	VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+	uint64_t txg = dmu_tx_get_txg(tx);
+
+	spa_config_enter(spa, SCL_STATE_ALL, vd, RW_READER);
+	mutex_enter(&vd->vdev_rebuild_lock);
+
+	/*
+	 * We know the vdev struct will still be around since all
+	 * consumers of vdev_free must stop the rebuild first.
+	 */
+	if (vdev_rebuild_should_stop(vd)) {
+		mutex_enter(&vd->vdev_rebuild_io_lock);
+		ASSERT3U(vd->vdev_rebuild_inflight, >, 0);
+		vd->vdev_rebuild_inflight--;
+		mutex_exit(&vd->vdev_rebuild_io_lock);
+		spa_config_exit(spa, SCL_STATE_ALL, vd);
+		mutex_exit(&vd->vdev_rebuild_lock);
+		dmu_tx_commit(tx);
+		return (SET_ERROR(EINTR));
+	}
+
+	if (vr->vr_scan_offset[txg & TXG_MASK] == 0) {
+		/* This is the first I/O of this txg. */
+		dsl_sync_task_nowait(spa_get_dsl(spa),
+		    vdev_rebuild_update_sync, (void *)(uintptr_t)vd->vdev_id,
+		    2, ZFS_SPACE_CHECK_RESERVED, tx);
+	}
+	vr->vr_scan_offset[txg & TXG_MASK] = start + size;
+	mutex_exit(&vd->vdev_rebuild_lock);
+
+	BP_ZERO(bp);
+	DVA_SET_VDEV(&bp->blk_dva[0], vd->vdev_id);
+	DVA_SET_OFFSET(&bp->blk_dva[0], start);
+	DVA_SET_ASIZE(&bp->blk_dva[0], size);
+	BP_SET_BIRTH(bp, TXG_INITIAL, TXG_INITIAL);
+	BP_SET_LSIZE(bp, psize);
+	BP_SET_PSIZE(bp, psize);
+	BP_SET_COMPRESS(bp, ZIO_COMPRESS_OFF);
+	BP_SET_CHECKSUM(bp, ZIO_CHECKSUM_OFF);
+	BP_SET_TYPE(bp, DMU_OT_NONE);
+	BP_SET_LEVEL(bp, 0);
+	BP_SET_DEDUP(bp, 0);
+	BP_SET_BYTEORDER(bp, ZFS_HOST_BYTEORDER);
+
+	zio_nowait(zio_read(spa->spa_txg_zio[txg & TXG_MASK], spa, bp,
+	    abd_alloc(psize, B_FALSE), psize, vdev_rebuild_cb, vr,
+	    ZIO_PRIORITY_SCRUB, ZIO_FLAG_RAW | ZIO_FLAG_CANFAIL |
+	    ZIO_FLAG_RESILVER, NULL));
+	/* vdev_rebuild_cb releases SCL_STATE_ALL */
+
+	dmu_tx_commit(tx);
+
+	return (0);
+}
+
+static int
+vdev_rebuild_ranges(vdev_rebuild_t *vr)
+{
+	vdev_t *vd = vr->vr_top_vdev;
+	range_tree_t *rt = vr->vr_scan_tree;
+	zfs_btree_t *t = &rt->rt_root;
+	zfs_btree_index_t where;
+	uint64_t maxsize = MIN(zfs_rebuild_max_segment, SPA_MAXBLOCKSIZE);
+
+	for (range_seg_t *rs = zfs_btree_first(t, &where); rs != NULL;
+	    rs = zfs_btree_next(t, &where, &where)) {
+		uint64_t end = rs_get_end(rs, rt);
+		uint64_t size;
+
+		for (uint64_t off = rs_get_start(rs, rt); off < end;
+		    off += size) {
+			int error;
+
+			size = MIN(end - off, maxsize);
+			if (vd->vdev_ops == &vdev_draid_ops)
+				size = vdev_draid_rebuild_chunk(vd, off, size);
+
+			error = vdev_rebuild_range(vr, off, size);
+			if (error != 0)
+				return (error);
+		}
+	}
+	return (0);
+}
+
+/*
+ * Make one pass over the allocated space of the vdev, starting from the
+ * last offset rebuilt.
+ */
+static int
+vdev_rebuild_scan(vdev_rebuild_t *vr)
+{
+	vdev_t *vd = vr->vr_top_vdev;
+	spa_t *spa = vd->vdev_spa;
+	vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
+	uint64_t last_offset, bytes_est = 0;
+	int error = 0;
+
+	/*
+	 * Wait for every block which needs rebuilding to be on disk.
+	 */
+	txg_wait_synced(spa_get_dsl(spa), vrp->vrp_max_txg);
+
+	spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+	for (uint64_t i = 0; i < vd->vdev_ms_count; i++)
+		bytes_est += space_map_allocated(vd->vdev_ms[i]->ms_sm);
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+	last_offset = vrp->vrp_last_offset;
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	vrp->vrp_bytes_est = bytes_est;
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+	mutex_exit(&vd->vdev_rebuild_lock);
+
+	vr->vr_scan_tree = range_tree_create(NULL, NULL);
+
+	for (uint64_t i = 0; i < vd->vdev_ms_count; i++) {
+		metaslab_t *msp = vd->vdev_ms[i];
+
+		if (msp->ms_start + msp->ms_size <= last_offset)
+			continue;
+
+		/*
+		 * Prevent allocations from this metaslab, and wait for any
+		 * allocations in flight to be synced.
+		 */
+		vdev_initialize_ms_mark(msp);
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		txg_wait_synced(spa_get_dsl(spa), 0);
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+		mutex_enter(&msp->ms_lock);
+		vdev_initialize_ms_load(msp);
+
+		range_tree_add(vr->vr_scan_tree, msp->ms_start, msp->ms_size);
+		range_tree_walk(msp->ms_allocatable, range_tree_remove,
+		    vr->vr_scan_tree);
+		if (last_offset > msp->ms_start) {
+			range_tree_clear(vr->vr_scan_tree, msp->ms_start,
+			    last_offset - msp->ms_start);
+		}
+		mutex_exit(&msp->ms_lock);
+
+		spa_config_exit(spa, SCL_CONFIG, FTAG);
+		error = vdev_rebuild_ranges(vr);
+		vdev_initialize_ms_unmark(msp);
+		spa_config_enter(spa, SCL_CONFIG, FTAG, RW_READER);
+
+		range_tree_vacate(vr->vr_scan_tree, NULL, NULL);
+		if (error != 0)
+			break;
+	}
+
+	spa_config_exit(spa, SCL_CONFIG, FTAG);
+
+	mutex_enter(&vd->vdev_rebuild_io_lock);
+	while (vd->vdev_rebuild_inflight > 0)
+		cv_wait(&vd->vdev_rebuild_io_cv, &vd->vdev_rebuild_io_lock);
+	mutex_exit(&vd->vdev_rebuild_io_lock);
+
+	range_tree_destroy(vr->vr_scan_tree);
+	vr->vr_scan_tree = NULL;
+
+	return (error);
+}
+
+static void
+vdev_rebuild_thread(void *arg)
+{
+	vdev_t *vd = arg;
+	spa_t *spa = vd->vdev_spa;
+	vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+	int error;
+
+	ASSERT(vdev_is_concrete(vd));
+	ASSERT3P(vd, ==, vd->vdev_top);
+
+	mutex_enter(&vd->vdev_rebuild_lock);
+	vr->vr_top_vdev = vd;
+
+	for (;;) {
+		vd->vdev_rebuild_reset_wanted = B_FALSE;
+		mutex_exit(&vd->vdev_rebuild_lock);
+
+		error = vdev_rebuild_scan(vr);
+
+		mutex_enter(&vd->vdev_rebuild_lock);
+		if (vd->vdev_rebuild_reset_wanted)
+			continue;
+		if (vd->vdev_rebuild_exit_wanted || error != 0)
+			break;
+
+		/*
+		 * Drop the vdev_rebuild_lock while we sync out the txg, as
+		 * the sync tasks need it.  Another device may be attached
+		 * meanwhile, in which case we start over.
+		 */
+		mutex_exit(&vd->vdev_rebuild_lock);
+
+		dmu_tx_t *tx = dmu_tx_create_dd(spa_get_dsl(spa)->dp_mos_dir);
+		VERIFY0(dmu_tx_assign(tx, TXG_WAIT));
+		dsl_sync_task_nowait(spa_get_dsl(spa),
+		    vdev_rebuild_complete_sync, (void *)(uintptr_t)vd->vdev_id,
+		    0, ZFS_SPACE_CHECK_NONE, tx);
+		dmu_tx_commit(tx);
+		txg_wait_synced(spa_get_dsl(spa), 0);
+
+		mutex_enter(&vd->vdev_rebuild_lock);
+
+		if (!vd->vdev_rebuild_reset_wanted)
+			break;
+	}
+
+	vd->vdev_rebuild_thread = NULL;
+	cv_broadcast(&vd->vdev_rebuild_cv);
+	mutex_exit(&vd->vdev_rebuild_lock);
+}
+
+/*
+ * Start a sequential rebuild of the given top-level vdev, in the given
+ * txg.  Called with the config lock held as writer, so the rebuild is
+ * started from syncing context.
+ */
+void
+vdev_rebuild(vdev_t *tvd, uint64_t txg)
+{
+	spa_t *spa = tvd->vdev_spa;
+
+	ASSERT(spa_config_held(spa, SCL_CONFIG, RW_WRITER) == SCL_CONFIG);
+	ASSERT3P(tvd, ==, tvd->vdev_top);
+	ASSERT(tvd->vdev_ops == &vdev_mirror_ops ||
+	    tvd->vdev_ops == &vdev_draid_ops);
+
+	dmu_tx_t *tx = dmu_tx_create_assigned(spa->spa_dsl_pool, txg);
+	dsl_sync_task_nowait(spa->spa_dsl_pool, vdev_rebuild_initiate_sync,
+	    (void *)(uintptr_t)tvd->vdev_id, 0, ZFS_SPACE_CHECK_NONE, tx);
+	dmu_tx_commit(tx);
+}
+
+boolean_t
+vdev_rebuild_active(vdev_t *tvd)
+{
+	boolean_t active;
+
+	mutex_enter(&tvd->vdev_rebuild_lock);
+	active = (tvd->vdev_rebuild_config.vr_rebuild_phys.vrp_rebuild_state ==
+	    VDEV_REBUILD_ACTIVE);
+	mutex_exit(&tvd->vdev_rebuild_lock);
+
+	return (active);
+}
+
+/*
+ * Stop all rebuild threads, leaving their state active so that they are
+ * restarted when the pool is next loaded.  Caller must not be writing to
+ * the spa config, as the rebuild threads may try to enter the config as
+ * readers before exiting.
+ */
+void
+vdev_rebuild_stop_all(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	ASSERT(!spa_config_held(spa, SCL_CONFIG | SCL_STATE, RW_WRITER));
+
+	for (uint64_t i = 0; i < rvd->vdev_children; i++) {
+		vdev_t *vd = rvd->vdev_child[i];
+
+		mutex_enter(&vd->vdev_rebuild_lock);
+		vd->vdev_rebuild_exit_wanted = B_TRUE;
+		while (vd->vdev_rebuild_thread != NULL)
+			cv_wait(&vd->vdev_rebuild_cv, &vd->vdev_rebuild_lock);
+		vd->vdev_rebuild_exit_wanted = B_FALSE;
+		mutex_exit(&vd->vdev_rebuild_lock);
+	}
+
+	if (spa->spa_sync_on) {
+		/* Make sure that our state has been synced to disk */
+		txg_wait_synced(spa_get_dsl(spa), 0);
+	}
+}
+
+/*
+ * Load the rebuild state of each top-level vdev, and resume any rebuild
+ * that was in progress.
+ */
+void
+vdev_rebuild_restart(spa_t *spa)
+{
+	vdev_t *rvd = spa->spa_root_vdev;
+
+	ASSERT(MUTEX_HELD(&spa_namespace_lock));
+
+	for (uint64_t i = 0; i < rvd->vdev_children; i++) {
+		vdev_t *vd = rvd->vdev_child[i];
+		vdev_rebuild_t *vr = &vd->vdev_rebuild_config;
+		vdev_rebuild_phys_t *vrp = &vr->vr_rebuild_phys;
+
+		if (vd->vdev_top_zap == 0)
+			continue;
+
+		mutex_enter(&vd->vdev_rebuild_lock);
+		int err = zap_lookup(spa->spa_meta_objset, vd->vdev_top_zap,
+		    VDEV_TOP_ZAP_VDEV_REBUILD_PHYS, sizeof (uint64_t),
+		    REBUILD_PHYS_ENTRIES, vrp);
+		ASSERT(err == 0 || err == ENOENT);
+		if (err != 0)
+			bzero(vrp, sizeof (*vrp));
+
+		if (vrp->vrp_rebuild_state == VDEV_REBUILD_ACTIVE &&
+		    vd->vdev_rebuild_thread == NULL && spa_writeable(spa) &&
+		    vdev_readable(vd)) {
+			vd->vdev_rebuild_thread = thread_create(NULL, 0,
+			    vdev_rebuild_thread, vd, 0, &p0, TS_RUN,
+			    maxclsyspri);
+		}
+		mutex_exit(&vd->vdev_rebuild_lock);
+	}
+}
+
+int
+vdev_rebuild_get_stats(vdev_t *tvd, vdev_rebuild_stat_t *vrs)
+{
+	vdev_rebuild_phys_t *vrp = &tvd->vdev_rebuild_config.vr_rebuild_phys;
+
+	if (tvd != tvd->vdev_top)
+		return (SET_ERROR(EINVAL));
+
+	mutex_enter(&tvd->vdev_rebuild_io_lock);
+	if (vrp->vrp_rebuild_state == VDEV_REBUILD_NONE) {
+		mutex_exit(&tvd->vdev_rebuild_io_lock);
+		return (SET_ERROR(ENOENT));
+	}
+
+	bzero(vrs, sizeof (*vrs));
+	vrs->vrs_state = vrp->vrp_rebuild_state;
+	vrs->vrs_start_time = vrp->vrp_start_time;
+	vrs->vrs_end_time = vrp->vrp_end_time;
+	vrs->vrs_bytes_est = vrp->vrp_bytes_est;
+	vrs->vrs_bytes_scanned = vrp->vrp_bytes_scanned;
+	vrs->vrs_errors = vrp->vrp_errors;
+	mutex_exit(&tvd->vdev_rebuild_io_lock);
+
+	return (0);
+}
@@ -45,6 +45,7 @@
 #include <sys/vdev_indirect_mapping.h>
 #include <sys/abd.h>
 #include <sys/vdev_initialize.h>
+#include <sys/vdev_rebuild.h>
 
 /*
  * This file contains the necessary logic to remove vdevs from a
@@ -926,18 +927,15 @@ spa_vdev_copy_segment(vdev_t *vd, range_tree_t *segs,
 		 * the allocation at the end of a segment, thus avoiding
 		 * additional split blocks.
 		 */
-		range_seg_t search;
-		avl_index_t where;
-		search.rs_start = start + maxalloc;
-		search.rs_end = search.rs_start;
-		range_seg_t *rs = avl_find(&segs->rt_root, &search, &where);
-		if (rs == NULL) {
-			rs = avl_nearest(&segs->rt_root, where, AVL_BEFORE);
-		} else {
-			rs = AVL_PREV(&segs->rt_root, rs);
-		}
+		range_seg_max_t search;
+		zfs_btree_index_t where;
+		rs_set_start(&search, segs, start + maxalloc);
+		rs_set_end(&search, segs, start + maxalloc);
+		(void) zfs_btree_find(&segs->rt_root, &search, &where);
+		range_seg_t *rs = zfs_btree_prev(&segs->rt_root, &where,
+		    &where);
 		if (rs != NULL) {
-			size = rs->rs_end - start;
+			size = rs_get_end(rs, segs) - start;
 		} else {
 			/*
 			 * There are no segments that end before maxalloc.
@@ -968,18 +966,19 @@ spa_vdev_copy_segment(vdev_t *vd, range_tree_t *segs,
 	 */
 	range_tree_t *obsolete_segs = range_tree_create(NULL, NULL);
 
-	range_seg_t *rs = avl_first(&segs->rt_root);
-	ASSERT3U(rs->rs_start, ==, start);
-	uint64_t prev_seg_end = rs->rs_end;
-	while ((rs = AVL_NEXT(&segs->rt_root, rs)) != NULL) {
-		if (rs->rs_start >= start + size) {
+	zfs_btree_index_t where;
+	range_seg_t *rs = zfs_btree_first(&segs->rt_root, &where);
+	ASSERT3U(rs_get_start(rs, segs), ==, start);
+	uint64_t prev_seg_end = rs_get_end(rs, segs);
+	while ((rs = zfs_btree_next(&segs->rt_root, &where, &where)) != NULL) {
+		if (rs_get_start(rs, segs) >= start + size) {
 			break;
 		} else {
 			range_tree_add(obsolete_segs,
 			    prev_seg_end - start,
-			    rs->rs_start - prev_seg_end);
+			    rs_get_start(rs, segs) - prev_seg_end);
 		}
-		prev_seg_end = rs->rs_end;
+		prev_seg_end = rs_get_end(rs, segs);
 	}
 	/* We don't end in the middle of an obsolete range */
 	ASSERT3U(start + size, <=, prev_seg_end);
@@ -1224,25 +1223,27 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 	 */
 	range_tree_t *segs = range_tree_create(NULL, NULL);
 	for (;;) {
-		range_seg_t *rs = avl_first(&svr->svr_allocd_segs->rt_root);
+		range_tree_t *rt = svr->svr_allocd_segs;
+		range_seg_t *rs = zfs_btree_first(&rt->rt_root, NULL);
 		if (rs == NULL)
 			break;
 
 		uint64_t seg_length;
+		uint64_t rs_start = rs_get_start(rs, rt);
+		uint64_t rs_end = rs_get_end(rs, rt);
 
 		if (range_tree_is_empty(segs)) {
 			/* need to truncate the first seg based on max_alloc */
-			seg_length =
-			    MIN(rs->rs_end - rs->rs_start, *max_alloc);
+			seg_length = MIN(rs_end - rs_start, *max_alloc);
 		} else {
-			if (rs->rs_start - range_tree_max(segs) >
+			if (rs_start - range_tree_max(segs) >
 			    vdev_removal_max_span) {
 				/*
 				 * Including this segment would cause us to
 				 * copy a larger unneeded chunk than is allowed.
 				 */
 				break;
-			} else if (rs->rs_end - range_tree_min(segs) >
+			} else if (rs_end - range_tree_min(segs) >
 			    *max_alloc) {
 				/*
 				 * This additional segment would extend past
@@ -1251,13 +1252,12 @@ spa_vdev_copy_impl(vdev_t *vd, spa_vdev_removal_t *svr, vdev_copy_arg_t *vca,
 				 */
 				break;
 			} else {
-				seg_length = rs->rs_end - rs->rs_start;
+				seg_length = rs_end - rs_start;
 			}
 		}
 
-		range_tree_add(segs, rs->rs_start, seg_length);
-		range_tree_remove(svr->svr_allocd_segs,
-		    rs->rs_start, seg_length);
+		range_tree_add(segs, rs_start, seg_length);
+		range_tree_remove(svr->svr_allocd_segs, rs_start, seg_length);
 	}
 
 	if (range_tree_is_empty(segs)) {
@@ -1430,7 +1430,7 @@ spa_vdev_remove_thread(void *arg)
 
 		vca.vca_msp = msp;
 		zfs_dbgmsg("copying %llu segments for metaslab %llu",
-		    avl_numnodes(&svr->svr_allocd_segs->rt_root),
+		    range_tree_numsegs(svr->svr_allocd_segs),
 		    msp->ms_id);
 
 		while (!svr->svr_thread_exit &&
@@ -1890,7 +1890,8 @@ spa_vdev_remove_top_check(vdev_t *vd)
 	 * The device must have all its data.
 	 */
 	if (!vdev_dtl_empty(vd, DTL_MISSING) ||
-	    !vdev_dtl_empty(vd, DTL_OUTAGE))
+	    !vdev_dtl_empty(vd, DTL_OUTAGE) ||
+	    vdev_rebuild_active(vd))
 		return (SET_ERROR(EBUSY));
 
 	/*
@@ -1908,7 +1909,7 @@ spa_vdev_remove_top_check(vdev_t *vd)
 
 	/*
 	 * All vdevs in normal class must have the same ashift
-	 * and not be raidz.
+	 * and not be raidz or dRAID.
 	 */
 	vdev_t *rvd = spa->spa_root_vdev;
 	int num_indirect = 0;
@@ -1920,7 +1921,8 @@ spa_vdev_remove_top_check(vdev_t *vd)
 			num_indirect++;
 		if (!vdev_is_concrete(cvd))
 			continue;
-		if (cvd->vdev_ops == &vdev_raidz_ops)
+		if (cvd->vdev_ops == &vdev_raidz_ops ||
+		    cvd->vdev_ops == &vdev_draid_ops)
 			return (SET_ERROR(EINVAL));
 		/*
 		 * Need the mirror to be mirror of leaf vdevs only
@@ -2066,9 +2068,15 @@ spa_vdev_remove(spa_t *spa, uint64_t guid, boolean_t unspare)
 	    (nv = spa_nvlist_lookup_by_guid(spares, nspares, guid)) != NULL) {
 		/*
 		 * Only remove the hot spare if it's not currently in use
-		 * in this pool.
+		 * in this pool.  Distributed spares are part of their dRAID
+		 * vdev and can't be removed on their own.
 		 */
-		if (vd == NULL || unspare) {
+		char *type;
+
+		if (!unspare && nvlist_lookup_string(nv, ZPOOL_CONFIG_TYPE,
+		    &type) == 0 && strcmp(type, VDEV_TYPE_DRAID_SPARE) == 0) {
+			error = SET_ERROR(ENOTSUP);
+		} else if (vd == NULL || unspare) {
 			char *nvstr = fnvlist_lookup_string(nv,
 			    ZPOOL_CONFIG_PATH);
 			spa_history_log_internal(spa, "vdev remove", NULL,
@@ -44,12 +44,32 @@
  * that are locked for exclusive (writer) or shared (reader) use.
  * The starting range offset is used for searching and sorting the tree.
  *
+ * Shards
+ * ------
+ * A single mutex and tree per file serializes every reader and writer of
+ * that file, even when they touch disjoint regions.  Instead, the offset
+ * space is divided into stripes of (1 << rl_shift) bytes, and each stripe
+ * is assigned to one of RANGELOCK_SHARDS shards, each with its own mutex
+ * and tree.  A range is entered, unclipped, into the tree of every shard
+ * that covers one of its stripes.  Two ranges that overlap share at least
+ * one stripe and so are both present in that stripe's shard, which is
+ * where the conflict is detected; shards are otherwise independent.
+ *
+ * A range that lies within one stripe (or within stripes that all map to
+ * the same shard) only takes that shard's mutex, and the caller's
+ * locked_range_t is entered directly in that shard's tree.  A range that
+ * spans several shards takes all of their mutexes in ascending order,
+ * checks every one of them for conflicts, and only then enters a per-shard
+ * copy (lr_sub) into each tree.  No shard is held while waiting, so the
+ * ordering cannot deadlock.  Whole file locks (as taken to grow the block
+ * size) take this slow path.
+ *
  * Common case
  * -----------
  * The (hopefully) usual case is of no overlaps or contention for locks. On
- * entry to rangelock_enter(), a locked_range_t is allocated; the tree
- * searched that finds no overlap, and *this* locked_range_t is placed in the
- * tree.
+ * entry to rangelock_enter(), a locked_range_t is allocated; the shard's
+ * tree searched that finds no overlap, and *this* locked_range_t is placed
+ * in the tree.
  *
  * Overlaps/Reference counting/Proxy locks
  * ---------------------------------------
@@ -84,7 +104,10 @@
  * Append mode writes need to lock a range at the end of a file.
  * The offset of the end of the file is determined under the
  * range locking mutex, and the lock type converted from RL_APPEND to
- * RL_WRITER and the range locked.
+ * RL_WRITER and the range locked.  The callback is always run with the
+ * mutexes of the shards covering the range it returns held; if it moves
+ * the range onto shards that aren't held, they are taken and the callback
+ * is run again.
  *
  * Grow block handling
  * -------------------
@@ -99,6 +122,12 @@
 #include <sys/zfs_context.h>
 #include <sys/zfs_rlock.h>
 
+/*
+ * log2 of the size of the stripes that are distributed across the shards
+ * of a range lock.  This is sampled when the range lock is initialized.
+ */
+int rangelock_stripe_shift = 20;
+
 /*
  * AVL comparison function used to order range locks
  * Locks are ordered on the start offset of the range.
@@ -124,9 +153,14 @@ rangelock_compare(const void *arg1, const void *arg2)
 void
 rangelock_init(rangelock_t *rl, rangelock_cb_t *cb, void *arg)
 {
-	mutex_init(&rl->rl_lock, NULL, MUTEX_DEFAULT, NULL);
-	avl_create(&rl->rl_tree, rangelock_compare,
-	    sizeof (locked_range_t), offsetof(locked_range_t, lr_node));
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		rangelock_shard_t *rls = &rl->rl_shard[i];
+
+		mutex_init(&rls->rls_lock, NULL, MUTEX_DEFAULT, NULL);
+		avl_create(&rls->rls_tree, rangelock_compare,
+		    sizeof (locked_range_t), offsetof(locked_range_t, lr_node));
+	}
+	rl->rl_shift = rangelock_stripe_shift;
 	rl->rl_cb = cb;
 	rl->rl_arg = arg;
 }
@@ -134,8 +168,155 @@ rangelock_init(rangelock_t *rl, rangelock_cb_t *cb, void *arg)
 void
 rangelock_fini(rangelock_t *rl)
 {
-	mutex_destroy(&rl->rl_lock);
-	avl_destroy(&rl->rl_tree);
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		rangelock_shard_t *rls = &rl->rl_shard[i];
+
+		mutex_destroy(&rls->rls_lock);
+		avl_destroy(&rls->rls_tree);
+	}
+}
+
+/*
+ * Return the bitmap of shards covering the supplied range.
+ */
+static uint_t
+rangelock_shards(rangelock_t *rl, uint64_t off, uint64_t len)
+{
+	uint64_t first = off >> rl->rl_shift;
+	uint64_t last = first;
+	uint_t shards = 0;
+
+	if (len != 0)
+		last = (off + len - 1) >> rl->rl_shift;
+	if (last - first >= RANGELOCK_SHARDS - 1)
+		return (RANGELOCK_ALL_SHARDS);
+
+	for (uint64_t s = first; s <= last; s++)
+		shards |= 1U << (s % RANGELOCK_SHARDS);
+	return (shards);
+}
+
+static void
+rangelock_lock_shards(rangelock_t *rl, uint_t shards)
+{
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		if (shards & (1U << i))
+			mutex_enter(&rl->rl_shard[i].rls_lock);
+	}
+}
+
+static void
+rangelock_unlock_shards(rangelock_t *rl, uint_t shards)
+{
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		if (shards & (1U << i))
+			mutex_exit(&rl->rl_shard[i].rls_lock);
+	}
+}
+
+/*
+ * Wait for the range lock lr to be released or reduced.  Drops and
+ * reacquires the shard's mutex.
+ */
+static void
+rangelock_wait(rangelock_shard_t *rls, locked_range_t *lr, boolean_t writer)
+{
+	if (writer) {
+		if (!lr->lr_write_wanted) {
+			cv_init(&lr->lr_write_cv, NULL, CV_DEFAULT, NULL);
+			lr->lr_write_wanted = B_TRUE;
+		}
+		cv_wait(&lr->lr_write_cv, &rls->rls_lock);
+	} else {
+		if (!lr->lr_read_wanted) {
+			cv_init(&lr->lr_read_cv, NULL, CV_DEFAULT, NULL);
+			lr->lr_read_wanted = B_TRUE;
+		}
+		cv_wait(&lr->lr_read_cv, &rls->rls_lock);
+	}
+}
+
+/*
+ * Wake up any waiters on a range lock that has been removed from its tree.
+ */
+static void
+rangelock_wakeup(locked_range_t *lr)
+{
+	if (lr->lr_write_wanted) {
+		cv_broadcast(&lr->lr_write_cv);
+		cv_destroy(&lr->lr_write_cv);
+	}
+	if (lr->lr_read_wanted) {
+		cv_broadcast(&lr->lr_read_cv);
+		cv_destroy(&lr->lr_read_cv);
+	}
+}
+
+/*
+ * Set up the per-shard copies of a range lock that spans several shards.
+ * The copies are what's entered in the shards' trees; the caller's
+ * locked_range_t is not in any tree.
+ */
+static void
+rangelock_alloc_sub(locked_range_t *new, uint_t shards)
+{
+	new->lr_sub = kmem_zalloc(RANGELOCK_SHARDS * sizeof (locked_range_t),
+	    KM_SLEEP);
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		locked_range_t *sub = &new->lr_sub[i];
+
+		if ((shards & (1U << i)) == 0)
+			continue;
+		sub->lr_rangelock = new->lr_rangelock;
+		sub->lr_offset = new->lr_offset;
+		sub->lr_length = new->lr_length;
+		sub->lr_count = 1;
+		sub->lr_shards = 1U << i;
+		sub->lr_type = new->lr_type;
+		sub->lr_proxy = B_FALSE;
+		sub->lr_write_wanted = B_FALSE;
+		sub->lr_read_wanted = B_FALSE;
+	}
+	new->lr_shards = shards;
+}
+
+/*
+ * Look for a lock in the tree that overlaps the new writer lock.  Returns
+ * NULL if there isn't one, in which case *where is where new can be
+ * inserted.
+ */
+static locked_range_t *
+rangelock_writer_conflict(avl_tree_t *tree, locked_range_t *new,
+    avl_index_t *where)
+{
+	locked_range_t *lr;
+
+	/*
+	 * First check for the usual case of no locks
+	 */
+	if (avl_numnodes(tree) == 0) {
+		(void) avl_find(tree, new, where);
+		return (NULL);
+	}
+
+	/*
+	 * Look for any locks in the range.
+	 */
+	lr = avl_find(tree, new, where);
+	if (lr != NULL)
+		return (lr); /* already locked at same offset */
+
+	lr = (locked_range_t *)avl_nearest(tree, *where, AVL_AFTER);
+	if (lr != NULL &&
+	    lr->lr_offset < new->lr_offset + new->lr_length)
+		return (lr);
+
+	lr = (locked_range_t *)avl_nearest(tree, *where, AVL_BEFORE);
+	if (lr != NULL &&
+	    lr->lr_offset + lr->lr_length > new->lr_offset)
+		return (lr);
+
+	return (NULL);
 }
 
 /*
@@ -144,13 +325,16 @@ rangelock_fini(rangelock_t *rl)
 static void
 rangelock_enter_writer(rangelock_t *rl, locked_range_t *new)
 {
-	avl_tree_t *tree = &rl->rl_tree;
 	locked_range_t *lr;
 	avl_index_t where;
 	uint64_t orig_off = new->lr_offset;
 	uint64_t orig_len = new->lr_length;
 	rangelock_type_t orig_type = new->lr_type;
+	uint_t held, shards;
+	int i;
 
+	held = rangelock_shards(rl, orig_off, orig_len);
+	rangelock_lock_shards(rl, held);
 	for (;;) {
 		/*
 		 * Call callback which can modify new->r_off,len,type.
@@ -168,44 +352,60 @@ rangelock_enter_writer(rangelock_t *rl, locked_range_t *new)
 		ASSERT3U(new->lr_type, ==, RL_WRITER);
 
 		/*
-		 * First check for the usual case of no locks
+		 * If the callback moved the range onto shards we don't hold,
+		 * take those too and ask the callback again.
 		 */
-		if (avl_numnodes(tree) == 0) {
-			avl_add(tree, new);
-			return;
+		shards = rangelock_shards(rl, new->lr_offset, new->lr_length);
+		if ((shards & ~held) != 0) {
+			rangelock_unlock_shards(rl, held);
+			held |= shards;
+			rangelock_lock_shards(rl, held);
+			goto reset;
 		}
 
-		/*
-		 * Look for any locks in the range.
-		 */
-		lr = avl_find(tree, new, &where);
-		if (lr != NULL)
-			goto wait; /* already locked at same offset */
-
-		lr = (locked_range_t *)avl_nearest(tree, where, AVL_AFTER);
-		if (lr != NULL &&
-		    lr->lr_offset < new->lr_offset + new->lr_length)
-			goto wait;
-
-		lr = (locked_range_t *)avl_nearest(tree, where, AVL_BEFORE);
-		if (lr != NULL &&
-		    lr->lr_offset + lr->lr_length > new->lr_offset)
-			goto wait;
-
-		avl_insert(tree, new, where);
-		return;
-wait:
-		if (!lr->lr_write_wanted) {
-			cv_init(&lr->lr_write_cv, NULL, CV_DEFAULT, NULL);
-			lr->lr_write_wanted = B_TRUE;
+		lr = NULL;
+		for (i = 0; i < RANGELOCK_SHARDS; i++) {
+			if ((shards & (1U << i)) == 0)
+				continue;
+			lr = rangelock_writer_conflict(
+			    &rl->rl_shard[i].rls_tree, new, &where);
+			if (lr != NULL)
+				break;
 		}
-		cv_wait(&lr->lr_write_cv, &rl->rl_lock);
+		if (lr == NULL)
+			break;
 
+		/*
+		 * Only hold the mutex of the shard we're waiting in, and
+		 * start over with just the shards we need once woken.
+		 */
+		rangelock_unlock_shards(rl, held & ~(1U << i));
+		rangelock_wait(&rl->rl_shard[i], lr, B_TRUE);
+		mutex_exit(&rl->rl_shard[i].rls_lock);
+		held = shards;
+		rangelock_lock_shards(rl, held);
+reset:
 		/* reset to original */
 		new->lr_offset = orig_off;
 		new->lr_length = orig_len;
 		new->lr_type = orig_type;
 	}
+
+	if (ISP2(shards)) {
+		/* where is still valid for the only shard we looked in */
+		avl_insert(&rl->rl_shard[highbit64(shards) - 1].rls_tree,
+		    new, where);
+		new->lr_shards = shards;
+	} else {
+		rangelock_alloc_sub(new, shards);
+		for (i = 0; i < RANGELOCK_SHARDS; i++) {
+			if (shards & (1U << i)) {
+				avl_add(&rl->rl_shard[i].rls_tree,
+				    &new->lr_sub[i]);
+			}
+		}
+	}
+	rangelock_unlock_shards(rl, held);
 }
 
 /*
@@ -376,40 +576,35 @@ rangelock_add_reader(avl_tree_t *tree, locked_range_t *new,
 }
 
 /*
- * Check if a reader lock can be grabbed, or wait and recheck until available.
+ * Look for a writer lock (or a lock that a writer is waiting for) in the
+ * tree that overlaps the new reader lock.  Returns NULL if there isn't
+ * one, in which case *prevp and *where are set up for
+ * rangelock_add_reader().
  */
-static void
-rangelock_enter_reader(rangelock_t *rl, locked_range_t *new)
+static locked_range_t *
+rangelock_reader_conflict(avl_tree_t *tree, locked_range_t *new,
+    locked_range_t **prevp, avl_index_t *where)
 {
-	avl_tree_t *tree = &rl->rl_tree;
 	locked_range_t *prev, *next;
-	avl_index_t where;
 	uint64_t off = new->lr_offset;
 	uint64_t len = new->lr_length;
 
 	/*
 	 * Look for any writer locks in the range.
 	 */
-retry:
-	prev = avl_find(tree, new, &where);
+	prev = avl_find(tree, new, where);
 	if (prev == NULL)
-		prev = (locked_range_t *)avl_nearest(tree, where, AVL_BEFORE);
+		prev = (locked_range_t *)avl_nearest(tree, *where, AVL_BEFORE);
+	*prevp = prev;
 
 	/*
 	 * Check the previous range for a writer lock overlap.
 	 */
 	if (prev && (off < prev->lr_offset + prev->lr_length)) {
-		if ((prev->lr_type == RL_WRITER) || (prev->lr_write_wanted)) {
-			if (!prev->lr_read_wanted) {
-				cv_init(&prev->lr_read_cv,
-				    NULL, CV_DEFAULT, NULL);
-				prev->lr_read_wanted = B_TRUE;
-			}
-			cv_wait(&prev->lr_read_cv, &rl->rl_lock);
-			goto retry;
-		}
+		if ((prev->lr_type == RL_WRITER) || (prev->lr_write_wanted))
+			return (prev);
 		if (off + len < prev->lr_offset + prev->lr_length)
-			goto got_lock;
+			return (NULL);
 	}
 
 	/*
@@ -419,29 +614,88 @@ retry:
 	if (prev != NULL)
 		next = AVL_NEXT(tree, prev);
 	else
-		next = (locked_range_t *)avl_nearest(tree, where, AVL_AFTER);
+		next = (locked_range_t *)avl_nearest(tree, *where, AVL_AFTER);
 	for (; next != NULL; next = AVL_NEXT(tree, next)) {
 		if (off + len <= next->lr_offset)
-			goto got_lock;
-		if ((next->lr_type == RL_WRITER) || (next->lr_write_wanted)) {
-			if (!next->lr_read_wanted) {
-				cv_init(&next->lr_read_cv,
-				    NULL, CV_DEFAULT, NULL);
-				next->lr_read_wanted = B_TRUE;
-			}
-			cv_wait(&next->lr_read_cv, &rl->rl_lock);
-			goto retry;
-		}
+			return (NULL);
+		if ((next->lr_type == RL_WRITER) || (next->lr_write_wanted))
+			return (next);
 		if (off + len <= next->lr_offset + next->lr_length)
-			goto got_lock;
+			return (NULL);
+	}
+	return (NULL);
+}
+
+/*
+ * Check if a reader lock can be grabbed, or wait and recheck until available.
+ */
+static void
+rangelock_enter_reader(rangelock_t *rl, locked_range_t *new)
+{
+	locked_range_t *lr, *prev;
+	avl_index_t where;
+	uint_t shards;
+	int i;
+
+	shards = rangelock_shards(rl, new->lr_offset, new->lr_length);
+	if (ISP2(shards)) {
+		rangelock_shard_t *rls = &rl->rl_shard[highbit64(shards) - 1];
+		avl_tree_t *tree = &rls->rls_tree;
+
+		new->lr_shards = shards;
+		mutex_enter(&rls->rls_lock);
+		/*
+		 * First check for the usual case of no locks
+		 */
+		if (avl_numnodes(tree) == 0) {
+			avl_add(tree, new);
+		} else {
+			while ((lr = rangelock_reader_conflict(tree, new,
+			    &prev, &where)) != NULL)
+				rangelock_wait(rls, lr, B_FALSE);
+			/*
+			 * Add the read lock, which may involve splitting
+			 * existing locks and bumping ref counts (r_count).
+			 */
+			rangelock_add_reader(tree, new, prev, where);
+		}
+		mutex_exit(&rls->rls_lock);
+		return;
 	}
 
-got_lock:
 	/*
-	 * Add the read lock, which may involve splitting existing
-	 * locks and bumping ref counts (r_count).
+	 * The range spans several shards.  Make sure none of them has a
+	 * conflicting lock before adding ourselves to any of them.
 	 */
-	rangelock_add_reader(tree, new, prev, where);
+	for (;;) {
+		rangelock_lock_shards(rl, shards);
+		lr = NULL;
+		for (i = 0; i < RANGELOCK_SHARDS; i++) {
+			if ((shards & (1U << i)) == 0)
+				continue;
+			lr = rangelock_reader_conflict(
+			    &rl->rl_shard[i].rls_tree, new, &prev, &where);
+			if (lr != NULL)
+				break;
+		}
+		if (lr == NULL)
+			break;
+		rangelock_unlock_shards(rl, shards & ~(1U << i));
+		rangelock_wait(&rl->rl_shard[i], lr, B_FALSE);
+		mutex_exit(&rl->rl_shard[i].rls_lock);
+	}
+
+	rangelock_alloc_sub(new, shards);
+	for (i = 0; i < RANGELOCK_SHARDS; i++) {
+		avl_tree_t *tree = &rl->rl_shard[i].rls_tree;
+
+		if ((shards & (1U << i)) == 0)
+			continue;
+		VERIFY3P(rangelock_reader_conflict(tree, &new->lr_sub[i],
+		    &prev, &where), ==, NULL);
+		rangelock_add_reader(tree, &new->lr_sub[i], prev, where);
+	}
+	rangelock_unlock_shards(rl, shards);
 }
 
 /*
@@ -464,23 +718,17 @@ rangelock_enter(rangelock_t *rl, uint64_t off, uint64_t len,
 		len = UINT64_MAX - off;
 	new->lr_length = len;
 	new->lr_count = 1; /* assume it's going to be in the tree */
+	new->lr_shards = 0;
 	new->lr_type = type;
+	new->lr_sub = NULL;
 	new->lr_proxy = B_FALSE;
 	new->lr_write_wanted = B_FALSE;
 	new->lr_read_wanted = B_FALSE;
 
-	mutex_enter(&rl->rl_lock);
-	if (type == RL_READER) {
-		/*
-		 * First check for the usual case of no locks
-		 */
-		if (avl_numnodes(&rl->rl_tree) == 0)
-			avl_add(&rl->rl_tree, new);
-		else
-			rangelock_enter_reader(rl, new);
-	} else
+	if (type == RL_READER)
+		rangelock_enter_reader(rl, new);
+	else
 		rangelock_enter_writer(rl, new); /* RL_WRITER or RL_APPEND */
-	mutex_exit(&rl->rl_lock);
 	return (new);
 }
 
@@ -488,9 +736,9 @@ rangelock_enter(rangelock_t *rl, uint64_t off, uint64_t len,
  * Unlock a reader lock
  */
 static void
-rangelock_exit_reader(rangelock_t *rl, locked_range_t *remove)
+rangelock_exit_reader(rangelock_shard_t *rls, locked_range_t *remove)
 {
-	avl_tree_t *tree = &rl->rl_tree;
+	avl_tree_t *tree = &rls->rls_tree;
 	uint64_t len;
 
 	/*
@@ -502,14 +750,7 @@ rangelock_exit_reader(rangelock_t *rl, locked_range_t *remove)
 	 */
 	if (remove->lr_count == 1) {
 		avl_remove(tree, remove);
-		if (remove->lr_write_wanted) {
-			cv_broadcast(&remove->lr_write_cv);
-			cv_destroy(&remove->lr_write_cv);
-		}
-		if (remove->lr_read_wanted) {
-			cv_broadcast(&remove->lr_read_cv);
-			cv_destroy(&remove->lr_read_cv);
-		}
+		rangelock_wakeup(remove);
 	} else {
 		ASSERT0(remove->lr_count);
 		ASSERT0(remove->lr_write_wanted);
@@ -537,19 +778,33 @@ rangelock_exit_reader(rangelock_t *rl, locked_range_t *remove)
 			lr->lr_count--;
 			if (lr->lr_count == 0) {
 				avl_remove(tree, lr);
-				if (lr->lr_write_wanted) {
-					cv_broadcast(&lr->lr_write_cv);
-					cv_destroy(&lr->lr_write_cv);
-				}
-				if (lr->lr_read_wanted) {
-					cv_broadcast(&lr->lr_read_cv);
-					cv_destroy(&lr->lr_read_cv);
-				}
+				rangelock_wakeup(lr);
 				kmem_free(lr, sizeof (locked_range_t));
 			}
 		}
 	}
-	kmem_free(remove, sizeof (locked_range_t));
+}
+
+/*
+ * Remove a range lock (or one shard's copy of it) from a shard.
+ */
+static void
+rangelock_exit_shard(rangelock_shard_t *rls, locked_range_t *lr)
+{
+	mutex_enter(&rls->rls_lock);
+	if (lr->lr_type == RL_WRITER) {
+		/* writer locks can't be shared or split */
+		avl_remove(&rls->rls_tree, lr);
+		mutex_exit(&rls->rls_lock);
+		rangelock_wakeup(lr);
+	} else {
+		/*
+		 * lock may be shared, let rangelock_exit_reader()
+		 * release the lock
+		 */
+		rangelock_exit_reader(rls, lr);
+		mutex_exit(&rls->rls_lock);
+	}
 }
 
 /*
@@ -563,55 +818,84 @@ rangelock_exit(locked_range_t *lr)
 	ASSERT(lr->lr_type == RL_WRITER || lr->lr_type == RL_READER);
 	ASSERT(lr->lr_count == 1 || lr->lr_count == 0);
 	ASSERT(!lr->lr_proxy);
+	ASSERT(lr->lr_shards != 0);
 
-	mutex_enter(&rl->rl_lock);
-	if (lr->lr_type == RL_WRITER) {
-		/* writer locks can't be shared or split */
-		avl_remove(&rl->rl_tree, lr);
-		mutex_exit(&rl->rl_lock);
-		if (lr->lr_write_wanted) {
-			cv_broadcast(&lr->lr_write_cv);
-			cv_destroy(&lr->lr_write_cv);
-		}
-		if (lr->lr_read_wanted) {
-			cv_broadcast(&lr->lr_read_cv);
-			cv_destroy(&lr->lr_read_cv);
-		}
-		kmem_free(lr, sizeof (locked_range_t));
+	if (lr->lr_sub == NULL) {
+		rangelock_exit_shard(
+		    &rl->rl_shard[highbit64(lr->lr_shards) - 1], lr);
 	} else {
-		/*
-		 * lock may be shared, let rangelock_exit_reader()
-		 * release the lock and free the rl_t
-		 */
-		rangelock_exit_reader(rl, lr);
-		mutex_exit(&rl->rl_lock);
+		for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+			if (lr->lr_shards & (1U << i)) {
+				rangelock_exit_shard(&rl->rl_shard[i],
+				    &lr->lr_sub[i]);
+			}
+		}
+		kmem_free(lr->lr_sub,
+		    RANGELOCK_SHARDS * sizeof (locked_range_t));
 	}
+	kmem_free(lr, sizeof (locked_range_t));
 }
 
 /*
  * Reduce range locked as RL_WRITER from whole file to specified range.
  * Asserts the whole file is exclusively locked and so there's only one
- * entry in the tree.
+ * entry in each tree.  Shards that no longer cover the range are released.
  */
 void
 rangelock_reduce(locked_range_t *lr, uint64_t off, uint64_t len)
 {
 	rangelock_t *rl = lr->lr_rangelock;
+	uint_t shards = rangelock_shards(rl, off, len);
 
-	/* Ensure there are no other locks */
-	ASSERT3U(avl_numnodes(&rl->rl_tree), ==, 1);
 	ASSERT3U(lr->lr_offset, ==, 0);
 	ASSERT3U(lr->lr_type, ==, RL_WRITER);
 	ASSERT(!lr->lr_proxy);
 	ASSERT3U(lr->lr_length, ==, UINT64_MAX);
 	ASSERT3U(lr->lr_count, ==, 1);
+	ASSERT3U(lr->lr_shards, ==, RANGELOCK_ALL_SHARDS);
+
+	if (lr->lr_sub == NULL) {
+		/* only possible with a single shard */
+		rangelock_shard_t *rls =
+		    &rl->rl_shard[highbit64(lr->lr_shards) - 1];
+
+		/* Ensure there are no other locks */
+		ASSERT3U(avl_numnodes(&rls->rls_tree), ==, 1);
+
+		mutex_enter(&rls->rls_lock);
+		lr->lr_offset = off;
+		lr->lr_length = len;
+		mutex_exit(&rls->rls_lock);
+		if (lr->lr_write_wanted)
+			cv_broadcast(&lr->lr_write_cv);
+		if (lr->lr_read_wanted)
+			cv_broadcast(&lr->lr_read_cv);
+		return;
+	}
 
-	mutex_enter(&rl->rl_lock);
 	lr->lr_offset = off;
 	lr->lr_length = len;
-	mutex_exit(&rl->rl_lock);
-	if (lr->lr_write_wanted)
-		cv_broadcast(&lr->lr_write_cv);
-	if (lr->lr_read_wanted)
-		cv_broadcast(&lr->lr_read_cv);
+	for (int i = 0; i < RANGELOCK_SHARDS; i++) {
+		rangelock_shard_t *rls = &rl->rl_shard[i];
+		locked_range_t *sub = &lr->lr_sub[i];
+
+		/* Ensure there are no other locks */
+		ASSERT3U(avl_numnodes(&rls->rls_tree), ==, 1);
+
+		mutex_enter(&rls->rls_lock);
+		if ((shards & (1U << i)) == 0) {
+			avl_remove(&rls->rls_tree, sub);
+			mutex_exit(&rls->rls_lock);
+			rangelock_wakeup(sub);
+			continue;
+		}
+		sub->lr_offset = off;
+		sub->lr_length = len;
+		mutex_exit(&rls->rls_lock);
+		if (sub->lr_write_wanted)
+			cv_broadcast(&sub->lr_write_cv);
+		if (sub->lr_read_wanted)
+			cv_broadcast(&sub->lr_read_cv);
+	}
+	lr->lr_shards = shards;
 }
@@ -83,6 +83,7 @@
 #include <sys/cred.h>
 #include <sys/attr.h>
 #include <sys/zil.h>
+#include <sys/aio_req.h>
 
 /*
  * Programming rules.
@@ -629,6 +630,113 @@ out:
 	return (error);
 }
 
+typedef struct zfs_aio {
+	locked_range_t	*za_lr;
+	struct aio_req	*za_aio;
+	size_t		za_len;		/* length of the request */
+	size_t		za_resid;	/* part of it past end-of-file */
+} zfs_aio_t;
+
+static void
+zfs_aio_done(void *arg, int error)
+{
+	zfs_aio_t *za = arg;
+
+	/* convert checksum errors into IO errors */
+	if (error == ECKSUM)
+		error = SET_ERROR(EIO);
+
+	rangelock_exit(za->za_lr);
+	aio_vnio_done(za->za_aio, error != 0 ? za->za_len : za->za_resid,
+	    error);
+	kmem_free(za, sizeof (*za));
+}
+
+/*
+ * Start an asynchronous read or write of a file.
+ *
+ * Reads are issued to the DMU without waiting for them, and the request
+ * is completed, with the range lock dropped, once the data has been copied
+ * out.  Writes, which may have to wait for a txg or commit the ZIL, and
+ * reads that have to go through the page cache or be synced first, can't
+ * be started without blocking the submitting thread; they get ENOTSUP, so
+ * that libc carries them out in one of its own threads.
+ */
+/* ARGSUSED */
+static int
+zfs_aio(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cr,
+    caller_context_t *ct)
+{
+	znode_t		*zp = VTOZ(vp);
+	zfsvfs_t	*zfsvfs = zp->z_zfsvfs;
+	uio_t		*uio = aio->aio_uio;
+	size_t		len = uio->uio_iov->iov_len;
+	locked_range_t	*lr;
+	zfs_aio_t	*za;
+	caddr_t		kaddr;
+	dmu_buf_t	*db;
+	dnode_t		*dn;
+	uint64_t	n;
+	int		error;
+
+	if (rw == FWRITE)
+		return (SET_ERROR(ENOTSUP));
+
+	ZFS_ENTER(zfsvfs);
+	ZFS_VERIFY_ZP(zp);
+
+	if (zp->z_pflags & ZFS_AV_QUARANTINED) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EACCES));
+	}
+
+	if (uio->uio_loffset < 0) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(EINVAL));
+	}
+
+	if (MANDMODE(zp->z_mode) || (uio->uio_fmode & FRSYNC) ||
+	    zfsvfs->z_os->os_sync == ZFS_SYNC_ALWAYS ||
+	    vn_has_cached_data(vp) || len > zfs_read_chunk_size) {
+		ZFS_EXIT(zfsvfs);
+		return (SET_ERROR(ENOTSUP));
+	}
+
+	if ((error = aio_vnio_start(aio, FREAD, &kaddr)) != 0) {
+		ZFS_EXIT(zfsvfs);
+		return (error);
+	}
+
+	lr = rangelock_enter(&zp->z_rangelock, uio->uio_loffset, len,
+	    RL_READER);
+
+	if (uio->uio_loffset >= zp->z_size) {
+		rangelock_exit(lr);
+		aio_vnio_done(aio, len, 0);
+		goto out;
+	}
+
+	n = MIN(len, zp->z_size - uio->uio_loffset);
+	za = kmem_alloc(sizeof (*za), KM_SLEEP);
+	za->za_lr = lr;
+	za->za_aio = aio;
+	za->za_len = len;
+	za->za_resid = len - n;
+
+	db = sa_get_db(zp->z_sa_hdl);
+	DB_DNODE_ENTER((dmu_buf_impl_t *)db);
+	dn = DB_DNODE((dmu_buf_impl_t *)db);
+	error = dmu_read_async_by_dnode(dn, uio->uio_loffset, n, kaddr,
+	    zfs_aio_done, za, DMU_READ_PREFETCH);
+	DB_DNODE_EXIT((dmu_buf_impl_t *)db);
+	if (error != 0)
+		zfs_aio_done(za, error);
+out:
+	ZFS_ACCESSTIME_STAMP(zfsvfs, zp);
+	ZFS_EXIT(zfsvfs);
+	return (0);
+}
+
 /*
  * Write the bytes to a file.
  *
@@ -5305,6 +5413,7 @@ const struct vnodeops zfs_fvnodeops = {
 	.vop_vnevent = fs_vnevent_support,
 	.vop_reqzcbuf = zfs_reqzcbuf,
 	.vop_retzcbuf = zfs_retzcbuf,
+	.vop_aio = zfs_aio,
 };
 
 /*
@@ -113,7 +113,9 @@ znode_evict_error(dmu_buf_t *dbuf, void *user_ptr)
  * This callback is invoked when acquiring a RL_WRITER or RL_APPEND lock on
  * z_rangelock. It will modify the offset and length of the lock to reflect
  * znode-specific information, and convert RL_APPEND to RL_WRITER.  This is
- * called with the rangelock_t's rl_lock held, which avoids races.
+ * called with the mutexes of the rangelock_t's shards covering the range it
+ * returns held, which avoids races; it may be called more than once per
+ * lock, starting from the caller's original range each time.
  */
 static void
 zfs_rangelock_cb(locked_range_t *new, void *arg)
@@ -0,0 +1,316 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * CUBIC congestion control (RFC 8312).
+ *
+ * In congestion avoidance, CUBIC grows tcp_cwnd as a cubic function of the
+ * time t since the last congestion event, rather than by one MSS per round
+ * trip:
+ *
+ *	W_cubic(t) = C * (t - K)^3 + W_max
+ *
+ * where W_max is tcp_cwnd just before the congestion event, and K the time
+ * it takes to get back to it.  tcp_cwnd thus grows quickly far from W_max,
+ * and slowly around it; on paths with a large bandwidth-delay product it
+ * recovers from a loss in much less time than NewReno does.  When W_cubic
+ * is below what NewReno would have reached (W_est), as on short or slow
+ * paths, CUBIC follows NewReno instead.
+ *
+ * On congestion, tcp_cwnd_ssthresh becomes beta (0.7) times the data in
+ * flight, rather than half of it.  Slow start, fast recovery and the
+ * restart after idle are NewReno's.
+ *
+ * Time is kept in ms.  C is 0.4 and beta 0.7 with W in segments and t in
+ * seconds; the computations below are in bytes and ms.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/modctl.h>
+#include <sys/kmem.h>
+#include <sys/time.h>
+#include <sys/sysmacros.h>
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+#include <inet/cc.h>
+
+/*
+ * Fast convergence: when a flow loses before it gets back to its previous
+ * W_max, presumably because a new flow is taking its share of the path,
+ * lower W_max further to let the new flow grow.
+ */
+int cubic_fast_convergence = 1;
+
+#define	CUBIC_BETA_NUM		7	/* beta = 0.7 */
+#define	CUBIC_BETA_DEN		10
+#define	CUBIC_MAX_T		(1 << 20)	/* bounds t - K, in ms */
+
+typedef struct cubic {
+	int64_t		cu_epoch;	/* start of the epoch in ms, or 0 */
+	uint32_t	cu_wmax;	/* W_max */
+	uint32_t	cu_wlastmax;	/* W_max before fast convergence */
+	uint32_t	cu_origin;	/* W_max of the current epoch */
+	uint32_t	cu_cwnd_epoch;	/* tcp_cwnd at the start of the epoch */
+	uint32_t	cu_k;		/* K, in ms */
+	uint32_t	cu_acc;		/* increase not added to tcp_cwnd yet */
+} cubic_t;
+
+/*
+ * Integer cube root.
+ */
+static uint32_t
+cubic_cbrt(uint64_t x)
+{
+	uint64_t	y = 0, b;
+	int		s;
+
+	for (s = 63; s >= 0; s -= 3) {
+		y <<= 1;
+		b = 3 * y * (y + 1) + 1;
+		if ((x >> s) >= b) {
+			x -= b << s;
+			y++;
+		}
+	}
+	return ((uint32_t)y);
+}
+
+/*
+ * W_cubic(t), in bytes.
+ */
+static uint32_t
+cubic_window(cubic_t *cu, uint32_t mss, int64_t t)
+{
+	int64_t	d = t - cu->cu_k;
+	int64_t	w;
+
+	d = MAX(MIN(d, CUBIC_MAX_T), -CUBIC_MAX_T);
+
+	/* 0.4 * (d / 1000)^3 segments, without overflowing */
+	w = d * d * d / 1000000;
+	w = w * 4 * mss / 10000;
+	w += cu->cu_origin;
+	return ((uint32_t)MAX(MIN(w, UINT32_MAX), mss));
+}
+
+static void
+cubic_reset(cubic_t *cu)
+{
+	cu->cu_epoch = 0;
+	cu->cu_acc = 0;
+}
+
+static int
+cubic_cb_init(cc_var_t *ccv)
+{
+	ccv->ccv_data = kmem_zalloc(sizeof (cubic_t), KM_NOSLEEP);
+	if (ccv->ccv_data == NULL)
+		return (ENOMEM);
+	return (0);
+}
+
+static void
+cubic_cb_destroy(cc_var_t *ccv)
+{
+	kmem_free(ccv->ccv_data, sizeof (cubic_t));
+	ccv->ccv_data = NULL;
+}
+
+static void
+cubic_conn_init(cc_var_t *ccv)
+{
+	bzero(ccv->ccv_data, sizeof (cubic_t));
+}
+
+static void
+cubic_ack_received(cc_var_t *ccv, int type)
+{
+	tcp_t		*tcp = ccv->ccv_tcp;
+	cubic_t		*cu = ccv->ccv_data;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	srtt, target, west;
+	int64_t		now, t;
+	uint64_t	inc;
+
+	srtt = tcp->tcp_rtt_sa >> 3;
+	if (srtt == 0)
+		srtt = ccv->ccv_rtt;
+
+	if (type != CC_ACK || cwnd < tcp->tcp_cwnd_ssthresh || srtt == 0) {
+		newreno_ack_received(ccv, type);
+		return;
+	}
+
+	now = NSEC2MSEC(gethrtime());
+	if (cu->cu_epoch == 0) {
+		cu->cu_epoch = now;
+		cu->cu_cwnd_epoch = cwnd;
+		cu->cu_acc = 0;
+		if (cu->cu_wmax > cwnd) {
+			cu->cu_origin = cu->cu_wmax;
+			cu->cu_k = cubic_cbrt((uint64_t)(cu->cu_wmax - cwnd) *
+			    2500000000ULL / mss);
+		} else {
+			cu->cu_origin = cwnd;
+			cu->cu_k = 0;
+		}
+	}
+
+	/*
+	 * Aim at where the window should be one round trip from now, and
+	 * at least at where NewReno would be.
+	 */
+	t = now - cu->cu_epoch;
+	target = cubic_window(cu, mss, t + srtt);
+	west = (uint32_t)MIN((uint64_t)cu->cu_cwnd_epoch +
+	    (uint64_t)mss * 529 * t / (1000 * (uint64_t)srtt), UINT32_MAX);
+	target = MAX(target, west);
+
+	/*
+	 * Spread the increase over a window of ACKs: each ACK adds its share
+	 * of (target - cwnd), and at most half of tcp_cwnd over a round trip.
+	 * Around W_max, keep probing slowly.  As in NewReno, tcp_cwnd only
+	 * grows by whole MSSs, so that TCP doesn't send tinygrams.
+	 */
+	if (target > cwnd) {
+		target = MIN(target, cwnd + (cwnd >> 1));
+		inc = (uint64_t)(target - cwnd) * ccv->ccv_bytes_acked / cwnd;
+	} else {
+		inc = ccv->ccv_bytes_acked * (uint64_t)mss / (100 * cwnd);
+	}
+	inc += cu->cu_acc;
+	if (inc >= mss) {
+		tcp->tcp_cwnd = MIN(cwnd + (uint32_t)(inc - inc % mss),
+		    tcp->tcp_cwnd_max);
+		inc %= mss;
+	}
+	cu->cu_acc = (uint32_t)inc;
+}
+
+static void
+cubic_cong_signal(cc_var_t *ccv, int type)
+{
+	tcp_t		*tcp = ccv->ccv_tcp;
+	cubic_t		*cu = ccv->ccv_data;
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	flight;
+
+	if (type == CC_RTO && tcp->tcp_cwr && !tcp->tcp_rexmit) {
+		/* tcp_cwnd_ssthresh was already reduced for this window. */
+		tcp->tcp_cwnd = mss;
+		tcp->tcp_cwnd_cnt = 0;
+		cubic_reset(cu);
+		return;
+	}
+
+	/*
+	 * A repeated timeout says nothing new about W_max: tcp_cwnd is
+	 * already one MSS.
+	 */
+	if (type != CC_RTO || !tcp->tcp_timer_backoff) {
+		if (cubic_fast_convergence && cwnd < cu->cu_wlastmax) {
+			cu->cu_wmax = (uint32_t)((uint64_t)cwnd *
+			    (CUBIC_BETA_DEN + CUBIC_BETA_NUM) /
+			    (2 * CUBIC_BETA_DEN));
+		} else {
+			cu->cu_wmax = cwnd;
+		}
+		cu->cu_wlastmax = cwnd;
+	}
+	cubic_reset(cu);
+
+	flight = (type == CC_RTO && tcp->tcp_timer_backoff) ?
+	    tcp->tcp_cwnd_ssthresh : tcp->tcp_snxt - tcp->tcp_suna;
+	tcp->tcp_cwnd_ssthresh = MAX((uint32_t)((uint64_t)flight *
+	    CUBIC_BETA_NUM / CUBIC_BETA_DEN) / mss, 2) * mss;
+
+	switch (type) {
+	case CC_NDUPACK:
+		tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh +
+		    tcp->tcp_dupack_cnt * mss;
+		break;
+	case CC_ECN:
+		tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh;
+		break;
+	case CC_RTO:
+		tcp->tcp_cwnd = mss;
+		tcp->tcp_cwnd_cnt = 0;
+		break;
+	}
+}
+
+static void
+cubic_post_recovery(cc_var_t *ccv)
+{
+	newreno_post_recovery(ccv);
+	cubic_reset(ccv->ccv_data);
+}
+
+static void
+cubic_after_idle(cc_var_t *ccv)
+{
+	cubic_reset(ccv->ccv_data);
+}
+
+static cc_algo_t cc_cubic = {
+	.cc_name = "cubic",
+	.cc_cb_init = cubic_cb_init,
+	.cc_cb_destroy = cubic_cb_destroy,
+	.cc_conn_init = cubic_conn_init,
+	.cc_ack_received = cubic_ack_received,
+	.cc_cong_signal = cubic_cong_signal,
+	.cc_post_recovery = cubic_post_recovery,
+	.cc_after_idle = cubic_after_idle,
+};
+
+static struct modlmisc modlmisc = {
+	&mod_miscops, "CUBIC congestion control"
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1, &modlmisc, NULL
+};
+
+int
+_init(void)
+{
+	int error;
+
+	if ((error = cc_register(&cc_cubic)) != 0)
+		return (error);
+	if ((error = mod_install(&modlinkage)) != 0)
+		(void) cc_unregister(&cc_cubic);
+	return (error);
+}
+
+int
+_fini(void)
+{
+	int error;
+
+	if ((error = cc_unregister(&cc_cubic)) != 0)
+		return (error);
+	if ((error = mod_remove(&modlinkage)) != 0)
+		VERIFY0(cc_register(&cc_cubic));
+	return (error);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
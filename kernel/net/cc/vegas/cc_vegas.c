@@ -0,0 +1,236 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Vegas: delay-based congestion control.
+ *
+ * Loss-based algorithms only back off once the queue at the bottleneck has
+ * overflowed.  Vegas instead watches the round-trip time: the smallest one
+ * seen on the connection (base_rtt) is taken as the propagation delay, so
+ * that the data the connection has queued in the network is
+ *
+ *	diff = cwnd * (rtt - base_rtt) / rtt
+ *
+ * segments, rtt being the smallest sample of the last round trip.  Once per
+ * round trip, tcp_cwnd grows by one MSS while diff is below vegas_alpha,
+ * and shrinks by one MSS while it is above vegas_beta, keeping a few
+ * segments queued.  Slow start ends early when diff exceeds vegas_gamma.
+ *
+ * Losses are still handled as NewReno does.  Without RTT samples, e.g.
+ * while only retransmitted data is acknowledged, Vegas behaves as NewReno.
+ * RTT samples come from TCP at clock tick resolution, so Vegas works best
+ * on paths whose RTT spans several ticks.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/modctl.h>
+#include <sys/kmem.h>
+#include <sys/sysmacros.h>
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+#include <inet/cc.h>
+
+/* In segments */
+uint_t vegas_alpha = 2;
+uint_t vegas_beta = 4;
+uint_t vegas_gamma = 1;
+
+typedef struct vegas {
+	uint32_t	vg_base_rtt;	/* smallest RTT seen, in ms */
+	uint32_t	vg_min_rtt;	/* smallest RTT of this round trip */
+	uint32_t	vg_last_rtt;	/* last sample seen */
+	uint32_t	vg_nsamples;	/* # of samples this round trip */
+	uint32_t	vg_end_seq;	/* end of the round trip */
+} vegas_t;
+
+static void
+vegas_reset(vegas_t *vg, tcp_t *tcp)
+{
+	vg->vg_min_rtt = UINT32_MAX;
+	vg->vg_nsamples = 0;
+	vg->vg_end_seq = tcp->tcp_snxt;
+}
+
+static int
+vegas_cb_init(cc_var_t *ccv)
+{
+	vegas_t	*vg;
+
+	if ((vg = kmem_zalloc(sizeof (vegas_t), KM_NOSLEEP)) == NULL)
+		return (ENOMEM);
+	vg->vg_base_rtt = UINT32_MAX;
+	vg->vg_min_rtt = UINT32_MAX;
+	ccv->ccv_data = vg;
+	return (0);
+}
+
+static void
+vegas_cb_destroy(cc_var_t *ccv)
+{
+	kmem_free(ccv->ccv_data, sizeof (vegas_t));
+	ccv->ccv_data = NULL;
+}
+
+static void
+vegas_conn_init(cc_var_t *ccv)
+{
+	vegas_t	*vg = ccv->ccv_data;
+
+	vg->vg_base_rtt = UINT32_MAX;
+	vg->vg_last_rtt = ccv->ccv_rtt;
+	vegas_reset(vg, ccv->ccv_tcp);
+}
+
+static void
+vegas_ack_received(cc_var_t *ccv, int type)
+{
+	tcp_t		*tcp = ccv->ccv_tcp;
+	vegas_t		*vg = ccv->ccv_data;
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	rtt, diff;
+
+	if (type != CC_ACK) {
+		newreno_ack_received(ccv, type);
+		return;
+	}
+
+	/*
+	 * ccv_rtt only changes when TCP takes a new sample; a sample of 0 ms
+	 * (under one tick) tells us nothing about queueing.
+	 */
+	if (ccv->ccv_rtt != vg->vg_last_rtt || vg->vg_nsamples == 0) {
+		rtt = vg->vg_last_rtt = ccv->ccv_rtt;
+		if (rtt != 0) {
+			vg->vg_base_rtt = MIN(vg->vg_base_rtt, rtt);
+			vg->vg_min_rtt = MIN(vg->vg_min_rtt, rtt);
+			vg->vg_nsamples++;
+		}
+	}
+
+	if (SEQ_LT(tcp->tcp_suna, vg->vg_end_seq)) {
+		/* Between adjustments, slow start grows as usual. */
+		if (cwnd < tcp->tcp_cwnd_ssthresh)
+			newreno_ack_received(ccv, type);
+		return;
+	}
+
+	/* A round trip is over. */
+	if (vg->vg_nsamples == 0) {
+		newreno_ack_received(ccv, type);
+		vegas_reset(vg, tcp);
+		return;
+	}
+
+	rtt = vg->vg_min_rtt;
+	diff = (uint32_t)((uint64_t)(cwnd / mss) *
+	    (rtt - vg->vg_base_rtt) / rtt);
+
+	if (cwnd < tcp->tcp_cwnd_ssthresh) {
+		if (diff > vegas_gamma) {
+			/*
+			 * The queue is building up: leave slow start, and
+			 * back off to the window that fits the path.
+			 */
+			tcp->tcp_cwnd = MIN(cwnd, MAX((uint32_t)
+			    ((uint64_t)cwnd * vg->vg_base_rtt / rtt) + mss,
+			    2 * mss));
+			tcp->tcp_cwnd_ssthresh = MAX(tcp->tcp_cwnd - mss,
+			    2 * mss);
+			tcp->tcp_cwnd_cnt = 0;
+		} else {
+			newreno_ack_received(ccv, type);
+		}
+	} else if (diff < vegas_alpha) {
+		tcp->tcp_cwnd = MIN(cwnd + mss, tcp->tcp_cwnd_max);
+	} else if (diff > vegas_beta) {
+		tcp->tcp_cwnd = MAX(cwnd - mss, 2 * mss);
+		tcp->tcp_cwnd_ssthresh = MIN(tcp->tcp_cwnd_ssthresh,
+		    tcp->tcp_cwnd);
+	}
+	vegas_reset(vg, tcp);
+}
+
+static void
+vegas_cong_signal(cc_var_t *ccv, int type)
+{
+	newreno_cong_signal(ccv, type);
+	vegas_reset(ccv->ccv_data, ccv->ccv_tcp);
+}
+
+static void
+vegas_post_recovery(cc_var_t *ccv)
+{
+	newreno_post_recovery(ccv);
+	vegas_reset(ccv->ccv_data, ccv->ccv_tcp);
+}
+
+/*
+ * The route may have changed while we were idle; start over.
+ */
+static void
+vegas_after_idle(cc_var_t *ccv)
+{
+	vegas_conn_init(ccv);
+}
+
+static cc_algo_t cc_vegas = {
+	.cc_name = "vegas",
+	.cc_cb_init = vegas_cb_init,
+	.cc_cb_destroy = vegas_cb_destroy,
+	.cc_conn_init = vegas_conn_init,
+	.cc_ack_received = vegas_ack_received,
+	.cc_cong_signal = vegas_cong_signal,
+	.cc_post_recovery = vegas_post_recovery,
+	.cc_after_idle = vegas_after_idle,
+};
+
+static struct modlmisc modlmisc = {
+	&mod_miscops, "Vegas congestion control"
+};
+
+static struct modlinkage modlinkage = {
+	MODREV_1, &modlmisc, NULL
+};
+
+int
+_init(void)
+{
+	int error;
+
+	if ((error = cc_register(&cc_vegas)) != 0)
+		return (error);
+	if ((error = mod_install(&modlinkage)) != 0)
+		(void) cc_unregister(&cc_vegas);
+	return (error);
+}
+
+int
+_fini(void)
+{
+	int error;
+
+	if ((error = cc_unregister(&cc_vegas)) != 0)
+		return (error);
+	if ((error = mod_remove(&modlinkage)) != 0)
+		VERIFY0(cc_register(&cc_vegas));
+	return (error);
+}
+
+int
+_info(struct modinfo *modinfop)
+{
+	return (mod_info(&modlinkage, modinfop));
+}
@@ -42,6 +42,7 @@
 #include <sys/systm.h>
 #include <sys/param.h>
 #include <sys/kmem.h>
+#include <sys/cpuvar.h>
 #include <sys/sdt.h>
 #include <sys/socket.h>
 #include <sys/ethernet.h>
@@ -662,6 +663,13 @@ conn_opt_get(conn_opt_arg_t *coa, t_scalar_t level, t_scalar_t name,
 		case SO_EXCLBIND:
 			*i1 = connp->conn_exclbind ? SO_EXCLBIND : 0;
 			break;
+		case SO_REUSEPORT:
+			*i1 = connp->conn_reuseport ? SO_REUSEPORT : 0;
+			break;
+		case SO_INCOMING_CPU:
+			*i1 = connp->conn_incoming_cpu_set ?
+			    connp->conn_incoming_cpu : -1;
+			break;
 		case SO_PROTOTYPE:
 			*i1 = connp->conn_proto;
 			break;
@@ -1046,6 +1054,15 @@ conn_opt_set_socket(conn_opt_arg_t *coa, t_scalar_t name, uint_t inlen,
 		if (secpolicy_ip_config(cr, checkonly) != 0)
 			return (EACCES);
 		break;
+	case SO_INCOMING_CPU:
+		if (*i1 < -1 || *i1 >= max_ncpus)
+			return (EINVAL);
+		/* FALLTHRU */
+	case SO_REUSEPORT:
+		/* Only takes effect when entering the fanout */
+		if (IPCL_IS_BOUND(connp))
+			return (EINVAL);
+		break;
 	}
 	if (checkonly)
 		return (0);
@@ -1131,6 +1148,13 @@ conn_opt_set_socket(conn_opt_arg_t *coa, t_scalar_t name, uint_t inlen,
 	case SO_EXCLBIND:
 		connp->conn_exclbind = onoff;
 		break;
+	case SO_REUSEPORT:
+		connp->conn_reuseport = onoff;
+		break;
+	case SO_INCOMING_CPU:
+		connp->conn_incoming_cpu_set = (*i1 != -1);
+		connp->conn_incoming_cpu = *i1;
+		break;
 	}
 	mutex_exit(&connp->conn_lock);
 	return (0);
@@ -2747,7 +2771,7 @@ conn_inherit_parent(conn_t *lconnp, conn_t *econnp)
 	 * need to take care of are:
 	 * SO_DEBUG, SO_REUSEADDR, SO_KEEPALIVE, SO_DONTROUTE, SO_BROADCAST,
 	 * SO_USELOOPBACK, SO_OOBINLINE, SO_DGRAM_ERRIND, SO_LINGER,
-	 * SO_SNDBUF, SO_RCVBUF.
+	 * SO_SNDBUF, SO_RCVBUF, SO_REUSEPORT.
 	 *
 	 * SO_RCVBUF:	conn_rcvbuf is set.
 	 * SO_SNDBUF:	conn_sndbuf is set.
@@ -2769,5 +2793,6 @@ conn_inherit_parent(conn_t *lconnp, conn_t *econnp)
 	econnp->conn_broadcast = lconnp->conn_broadcast;
 	econnp->conn_useloopback = lconnp->conn_useloopback;
 	econnp->conn_reuseaddr = lconnp->conn_reuseaddr;
+	econnp->conn_reuseport = lconnp->conn_reuseport;
 	return (0);
 }
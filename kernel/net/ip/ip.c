@@ -234,6 +234,8 @@ typedef struct iproutedata_s {
  *   into an ill, changing the <ipsq-xop> mapping of an ill, changing the
  *   <ill-phyint> assoc of an ill will all have to hold the ill_g_lock as
  *   writer for the actual duration of the insertion/deletion/change.
+ *   Since every ill lookup in the data path reads it and writers are rare,
+ *   it is an RW_PERCPU lock.
  *
  * - ill_lock:  This is a per ill mutex.
  *   It protects some members of the ill_t struct; see ip.h for details.
@@ -582,6 +584,13 @@ typedef struct iproutedata_s {
  */
 boolean_t	ip_squeue_fanout = 0;
 
+/*
+ * Receive flow steering, see ip_squeue_steer().  The interval is how
+ * often, in milliseconds, a connection may try to move its flow.
+ */
+boolean_t	ip_squeue_rfs = B_TRUE;
+uint_t		ip_squeue_rfs_interval = 100;
+
 /*
  * Maximum dups allowed per packet.
  */
@@ -4480,7 +4489,7 @@ ip_stack_init(netstackid_t stackid, netstack_t *ns)
 	mutex_init(&ipst->ips_mld_slowtimeout_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&ipst->ips_ip_mi_lock, NULL, MUTEX_DEFAULT, NULL);
 	mutex_init(&ipst->ips_ip_addr_avail_lock, NULL, MUTEX_DEFAULT, NULL);
-	rw_init(&ipst->ips_ill_g_lock, NULL, RW_DEFAULT, NULL);
+	rw_init(&ipst->ips_ill_g_lock, NULL, RW_PERCPU, NULL);
 	rw_init(&ipst->ips_ill_g_usesrc_lock, NULL, RW_DEFAULT, NULL);
 
 	ipcl_init(ipst);
@@ -5082,7 +5091,7 @@ ip_fanout_udp_conn(conn_t *connp, mblk_t *mp, ipha_t *ipha, ip6_t *ip6h,
  * Fanout for UDP packets that are multicast or broadcast, and ICMP errors.
  * (Unicast fanout is handled in ip_input_v4.)
  *
- * If SO_REUSEADDR is set all multicast and broadcast packets
+ * If SO_REUSEADDR or SO_REUSEPORT is set all multicast and broadcast packets
  * will be delivered to all conns bound to the same port.
  *
  * If there is at least one matching AF_INET receiver, then we will
@@ -5119,7 +5128,7 @@ ip_fanout_udp_multi_v4(mblk_t *mp, ipha_t *ipha, uint16_t lport, uint16_t fport,
 	connp = connfp->connf_head;
 
 	/*
-	 * If SO_REUSEADDR has been set on the first we send the
+	 * If SO_REUSEADDR or SO_REUSEPORT has been set on the first we send the
 	 * packet to all clients that have joined the group and
 	 * match the port.
 	 */
@@ -5135,7 +5144,7 @@ ip_fanout_udp_multi_v4(mblk_t *mp, ipha_t *ipha, uint16_t lport, uint16_t fport,
 
 	CONN_INC_REF(connp);
 
-	if (connp->conn_reuseaddr) {
+	if (connp->conn_reuseaddr || connp->conn_reuseport) {
 		conn_t		*first_connp = connp;
 		conn_t		*next_connp;
 		mblk_t		*mp1;
@@ -5241,11 +5250,11 @@ notfound:
 	ASSERT(IPCL_IS_NONSTR(connp) || connp->conn_rq != NULL);
 
 	/*
-	 * If SO_REUSEADDR has been set on the first we send the
+	 * If SO_REUSEADDR or SO_REUSEPORT has been set on the first we send the
 	 * packet to all clients that have joined the group and
 	 * match the port.
 	 */
-	if (connp->conn_reuseaddr) {
+	if (connp->conn_reuseaddr || connp->conn_reuseport) {
 		conn_t		*first_connp = connp;
 		conn_t		*next_connp;
 		mblk_t		*mp1;
@@ -13371,6 +13380,9 @@ ip_kstat2_init(netstackid_t stackid, ip_stat_t *ip_statisticsp)
 		{ "conn_in_recvpktinfo",	KSTAT_DATA_UINT64 },
 		{ "conn_in_recvtclass",		KSTAT_DATA_UINT64 },
 		{ "conn_in_timestamp",		KSTAT_DATA_UINT64 },
+		{ "ip_rfs_misrouted",		KSTAT_DATA_UINT64 },
+		{ "ip_rfs_steered",		KSTAT_DATA_UINT64 },
+		{ "ip_rfs_nosteer",		KSTAT_DATA_UINT64 },
 	};
 
 	ksp = kstat_create_netstack("ip", 0, "ipstat", "net",
@@ -2365,14 +2365,14 @@ ip_fanout_send_icmp_v6(mblk_t *mp, uint_t icmp_type, uint8_t icmp_code,
  * Fanout for UDP packets that are multicast or ICMP errors.
  * (Unicast fanout is handled in ip_input_v6.)
  *
- * If SO_REUSEADDR is set all multicast packets
+ * If SO_REUSEADDR or SO_REUSEPORT is set all multicast packets
  * will be delivered to all conns bound to the same port.
  *
  * Fanout for UDP packets.
  * The caller puts <fport, lport> in the ports parameter.
  * ire_type must be IRE_BROADCAST for multicast and broadcast packets.
  *
- * If SO_REUSEADDR is set all multicast and broadcast packets
+ * If SO_REUSEADDR or SO_REUSEPORT is set all multicast and broadcast packets
  * will be delivered to all conns bound to the same port.
  *
  * Zones notes:
@@ -2413,7 +2413,7 @@ ip_fanout_udp_multi_v6(mblk_t *mp, ip6_t *ip6h, uint16_t lport, uint16_t fport,
 
 	CONN_INC_REF(connp);
 
-	if (connp->conn_reuseaddr) {
+	if (connp->conn_reuseaddr || connp->conn_reuseport) {
 		conn_t		*first_connp = connp;
 		conn_t		*next_connp;
 		mblk_t		*mp1;
@@ -199,6 +199,7 @@ ip_input_common_v6(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 	mblk_t 		*ahead = NULL;	/* Accepted head */
 	mblk_t		*atail = NULL;	/* Accepted tail */
 	uint_t		acnt = 0;	/* Accepted count */
+	udp_gro_t	gro;		/* UDP receive coalescing */
 
 	ASSERT(mp_chain != NULL);
 	ASSERT(ill != NULL);
@@ -247,6 +248,16 @@ ip_input_common_v6(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 	rtc.rtc_ire = NULL;
 	rtc.rtc_ip6addr = ipv6_all_zeros;
 
+	/*
+	 * UDP sockets with UDP_GRO set can merge the datagrams of a flow
+	 * that arrive in the same chain; see udp_gro_hold().
+	 */
+	if (mp_chain->b_next != NULL && target_sqp == NULL) {
+		udp_gro_init(&gro);
+		iras.ira_udp_gro = &gro;
+		chain_flags |= IRAF_UDP_GRO;
+	}
+
 	/* Loop over b_next */
 	for (mp = mp_chain; mp != NULL; mp = mp_chain) {
 		mp_chain = mp->b_next;
@@ -375,6 +386,10 @@ ip_input_common_v6(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 		/* mhip might point into 1st packet in the chain. */
 		iras.ira_mhip = NULL;
 	}
+	/* Deliver whatever UDP merged */
+	if (chain_flags & IRAF_UDP_GRO)
+		udp_gro_flush(&gro);
+
 	/* Any remaining references to the route cache? */
 	if (rtc.rtc_ire != NULL) {
 		ASSERT(!IN6_IS_ADDR_UNSPECIFIED(&rtc.rtc_ip6addr));
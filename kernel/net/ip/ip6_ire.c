@@ -49,6 +49,7 @@
 #include <inet/ip_ndp.h>
 #include <inet/ip_if.h>
 #include <inet/ip_ire.h>
+#include <inet/ip_ftable.h>
 #include <inet/ipclassifier.h>
 #include <inet/nd.h>
 #include <inet/tunables.h>
@@ -529,6 +530,7 @@ ire_delete_v6(ire_t *ire)
 	 * completed we can exit the lock immediately.
 	 */
 	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
+	ip_fib_changed_v6(ire, B_FALSE);
 	rw_exit(&ipst->ips_ip6_ire_head_lock);
 
 	ASSERT(ire->ire_refcnt >= 1);
@@ -603,6 +605,7 @@ ire_flush_cache_v6(ire_t *ire, int flag)
 	if (flag == IRE_FLUSH_ADD) {
 		ire_increment_generation(ipst->ips_ire_reject_v6);
 		ire_increment_generation(ipst->ips_ire_blackhole_v6);
+		ip_fib_changed_v6(ire, B_TRUE);
 	}
 
 	/* Adding a default can't otherwise provide a better route */
@@ -993,7 +996,7 @@ ire_ftable_lookup_impl_v6(const in6_addr_t *addr, const in6_addr_t *mask,
 {
 	irb_t *irb_ptr;
 	ire_t *ire = NULL;
-	int i;
+	int i, fibplen = IPV6_ABITS;
 
 	ASSERT(RW_LOCK_HELD(&ipst->ips_ip6_ire_head_lock));
 
@@ -1038,11 +1041,20 @@ ire_ftable_lookup_impl_v6(const in6_addr_t *addr, const in6_addr_t *mask,
 			masklen--;
 		} else {
 			masklen = IP6_MASK_TABLE_SIZE - 1;
+			fibplen = ip_fib_plen_v6(addr, ipst);
 		}
 
 		for (i = masklen; i >= 0; i--) {
 			in6_addr_t tmpmask;
 
+			/*
+			 * After the host routes, skip to the longest prefix
+			 * that the FIB trie knows covers addr.
+			 */
+			if (i > fibplen && i < IPV6_ABITS) {
+				i = fibplen + 1;
+				continue;
+			}
 			if ((ipst->ips_ip_forwarding_table_v6[i]) == NULL)
 				continue;
 			(void) ip_plen_to_mask_v6(i, &tmpmask);
@@ -492,7 +492,8 @@ ip_recv_attr_to_mblk(ip_recv_attr_t *ira)
 
 	bzero(irm, sizeof (*irm));
 	irm->irm_inbound = B_TRUE;
-	irm->irm_flags = ira->ira_flags;
+	/* ira_udp_gro lives on the stack of ip_input_common_v4/v6 */
+	irm->irm_flags = ira->ira_flags & ~IRAF_UDP_GRO;
 	if (ill != NULL) {
 		/* Internal to IP - preserve ip_stack_t, ill and rill */
 		irm->irm_stackid =
@@ -129,7 +129,8 @@ uint_t ip_dce_reclaim_threshold_hard = 2;
 
 /*
  * Reclaim a fraction of dce's in the dcb.
- * For now we have a higher probability to delete DCEs without DCE_PMTU.
+ * For now we have a higher probability to delete DCEs without DCE_PMTU
+ * or DCEF_TFO.
  */
 static void
 dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
@@ -161,7 +162,7 @@ dcb_reclaim(dcb_t *dcb, ip_stack_t *ipst, uint_t fraction)
 		if (max == 0 || retained < max) {
 			hash = RANDOM_HASH((uint64_t)((uintptr_t)dce | seed));
 
-			if (dce->dce_flags & DCEF_PMTU) {
+			if (dce->dce_flags & (DCEF_PMTU | DCEF_TFO)) {
 				if (hash % fraction_pmtu != 0) {
 					retained++;
 					continue;
@@ -751,6 +752,62 @@ dce_update_uinfo(const in6_addr_t *dst, uint_t ifindex, iulp_t *uinfo,
 	}
 }
 
+/*
+ * Remember the TCP Fast Open cookie dst gave us, and its MSS so that the
+ * data in our next SYN to it fits.  A zero len forgets the cookie.
+ */
+int
+dce_update_tfo(const in6_addr_t *dst, uint_t ifindex, const uint8_t *cookie,
+    uint_t len, uint_t mss, ip_stack_t *ipst)
+{
+	dce_t *dce;
+	ipaddr_t dst4;
+
+	ASSERT(len <= DCE_TFO_COOKIE_MAX);
+
+	if (IN6_IS_ADDR_V4MAPPED_ANY(dst)) {
+		IN6_V4MAPPED_TO_IPADDR(dst, dst4);
+		dce = dce_lookup_and_add_v4(dst4, ipst);
+	} else {
+		dce = dce_lookup_and_add_v6(dst, ifindex, ipst);
+	}
+	if (dce == NULL)
+		return (ENOMEM);
+
+	mutex_enter(&dce->dce_lock);
+	if (len == 0) {
+		dce->dce_flags &= ~DCEF_TFO;
+	} else {
+		bcopy(cookie, dce->dce_tfo_cookie, len);
+		dce->dce_tfo_cookie_len = len;
+		dce->dce_tfo_mss = MIN(mss, UINT16_MAX);
+		dce->dce_flags |= DCEF_TFO;
+	}
+	mutex_exit(&dce->dce_lock);
+	dce_refrele(dce);
+	return (0);
+}
+
+/*
+ * Copy out the TCP Fast Open cookie set by dce_update_tfo(), if any, into a
+ * buffer of DCE_TFO_COOKIE_MAX bytes.
+ */
+boolean_t
+dce_get_tfo(dce_t *dce, uint8_t *cookie, uint_t *lenp, uint_t *mssp)
+{
+	boolean_t found = B_FALSE;
+
+	mutex_enter(&dce->dce_lock);
+	if (dce->dce_flags & DCEF_TFO) {
+		bcopy(dce->dce_tfo_cookie, cookie, dce->dce_tfo_cookie_len);
+		*lenp = dce->dce_tfo_cookie_len;
+		*mssp = dce->dce_tfo_mss;
+		found = B_TRUE;
+	}
+	mutex_exit(&dce->dce_lock);
+	return (found);
+}
+
 static void
 dce_make_condemned(dce_t *dce)
 {
@@ -0,0 +1,433 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Compressed trie copies of the forwarding tables.
+ *
+ * The IPv4 forwarding table is a BSD radix tree, in which a lookup follows
+ * one pointer per bit that distinguishes the routes and then backtracks
+ * through the masks, and the IPv6 one is a hash table per prefix length,
+ * which are probed from /128 down.  With a full Internet table either costs
+ * many cache misses per packet.  Once a table has ip_fib_min_routes routes
+ * we therefore also build a poptrie (see common/net/poptrie/poptrie.c) from
+ * it, and use that for the longest match part of lookups:
+ *
+ *	- the IPv4 trie maps an address to the rt_entry that rn_match() would
+ *	  find, and ire_ftable_lookup_simple_v4() uses it in place of the
+ *	  radix tree;
+ *	- the IPv6 trie maps an address to the length of the longest prefix in
+ *	  the table that covers it, and ire_ftable_lookup_impl_v6() starts its
+ *	  scan of the hash tables there.  Host routes are left out and always
+ *	  probed, since IRE_IF_CLONEs come and go without telling us.
+ *
+ * A trie cannot be changed.  Every change to a table bumps its generation
+ * number, under the table's lock held as writer (the radix tree lock, or
+ * ips_ip6_ire_head_lock).  A change that could make the trie give a wrong
+ * answer also unpublishes and frees it there: for IPv4 that is any add or
+ * delete of an rt_entry, as the trie points at them, and for IPv6 only
+ * adds, as a trie that starts the scan at a prefix which is gone merely
+ * costs a few more probes.  Lookups fall back to the tables until the trie
+ * is rebuilt.
+ *
+ * Changes come in bursts, so rebuilding waits for ip_fib_rebuild_delay
+ * milliseconds, and is then done in the system taskq: the table is copied
+ * under its lock as reader, the trie is built with no locks held, and the
+ * new trie is published under the lock as writer if the generation has not
+ * moved in the meantime (otherwise we try again later).  Readers hold the
+ * lock as reader, so they see either no trie or a complete one, and the
+ * writer lock doubles as the grace period for freeing an old one.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/taskq.h>
+#include <sys/sdt.h>
+
+#include <net/radix.h>
+#include <net/poptrie.h>
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/ip6.h>
+#include <inet/ip_ire.h>
+#include <inet/ip_ftable.h>
+
+/* Tables with fewer routes than this are not worth a trie. */
+uint32_t ip_fib_min_routes = 1024;
+
+/* How long to wait after a change before rebuilding, in milliseconds. */
+uint_t ip_fib_rebuild_delay = 100;
+
+/* ips_fib_flags */
+#define	IP_FIB_DIRTY_V4		0x01	/* v4 trie needs a rebuild */
+#define	IP_FIB_DIRTY_V6		0x02	/* v6 trie needs a rebuild */
+#define	IP_FIB_DISPATCHED	0x04	/* ip_fib_rebuild() queued or running */
+#define	IP_FIB_QUIESCE		0x08	/* stack is going away */
+
+typedef struct ip_fib_snap {
+	poptrie_route_t	*fs_routes;
+	uint32_t	fs_n;
+	uint32_t	fs_max;
+} ip_fib_snap_t;
+
+static void	ip_fib_rebuild(void *);
+
+static void
+ip_fib_key_v6(const in6_addr_t *addr, uint64_t *key)
+{
+	key[0] = ((uint64_t)ntohl(addr->s6_addr32[0]) << 32) |
+	    ntohl(addr->s6_addr32[1]);
+	key[1] = ((uint64_t)ntohl(addr->s6_addr32[2]) << 32) |
+	    ntohl(addr->s6_addr32[3]);
+}
+
+static void
+ip_fib_timer(void *arg)
+{
+	ip_stack_t *ipst = arg;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_tid = 0;
+	if (!(ipst->ips_fib_flags & IP_FIB_QUIESCE)) {
+		if (taskq_dispatch(system_taskq, ip_fib_rebuild, ipst,
+		    TQ_NOSLEEP) != 0) {
+			ipst->ips_fib_flags |= IP_FIB_DISPATCHED;
+		} else {
+			ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+			    MSEC_TO_TICK(ip_fib_rebuild_delay));
+		}
+	}
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+/*
+ * Note that a trie needs rebuilding.  Called with the table lock held.
+ */
+static void
+ip_fib_schedule(ip_stack_t *ipst, uint_t flag)
+{
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_flags |= flag;
+	if (ipst->ips_fib_tid == 0 &&
+	    !(ipst->ips_fib_flags & (IP_FIB_DISPATCHED | IP_FIB_QUIESCE))) {
+		ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+		    MSEC_TO_TICK(ip_fib_rebuild_delay));
+	}
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+/*
+ * An rt_entry was added to or removed from the IPv4 radix tree.  The caller
+ * holds the radix tree lock as writer.
+ */
+void
+ip_fib_changed_v4(ip_stack_t *ipst)
+{
+	poptrie_t *pt = ipst->ips_fib_v4;
+
+	ASSERT(RW_WRITE_HELD(&ipst->ips_ip_ftable->rnh_lock));
+
+	ipst->ips_fib_gen_v4++;
+	ipst->ips_fib_v4 = NULL;
+	if (pt != NULL)
+		poptrie_free(pt);
+	ip_fib_schedule(ipst, IP_FIB_DIRTY_V4);
+}
+
+/*
+ * An IRE was added to (add) or is being deleted from the IPv6 forwarding
+ * table.  The caller holds ips_ip6_ire_head_lock as writer.
+ */
+void
+ip_fib_changed_v6(ire_t *ire, boolean_t add)
+{
+	ip_stack_t *ipst = ire->ire_ipst;
+	poptrie_t *pt = ipst->ips_fib_v6;
+
+	ASSERT(RW_WRITE_HELD(&ipst->ips_ip6_ire_head_lock));
+
+	/* The trie leaves out host routes. */
+	if (IN6_ARE_ADDR_EQUAL(&ire->ire_mask_v6, &ipv6_all_ones))
+		return;
+
+	ipst->ips_fib_gen_v6++;
+	if (add && pt != NULL) {
+		ipst->ips_fib_v6 = NULL;
+		poptrie_free(pt);
+	}
+	ip_fib_schedule(ipst, IP_FIB_DIRTY_V6);
+}
+
+/*
+ * Return the length of the longest non-host route that covers addr, or -1 if
+ * there is none, or IPV6_ABITS if there is no trie to tell.  The caller holds
+ * ips_ip6_ire_head_lock.
+ */
+int
+ip_fib_plen_v6(const in6_addr_t *addr, ip_stack_t *ipst)
+{
+	uint64_t key[2];
+
+	ASSERT(RW_LOCK_HELD(&ipst->ips_ip6_ire_head_lock));
+
+	if (ipst->ips_fib_v6 == NULL)
+		return (IPV6_ABITS);
+	ip_fib_key_v6(addr, key);
+	return ((int)poptrie_lookup(ipst->ips_fib_v6, key) - 1);
+}
+
+static poptrie_route_t *
+ip_fib_snap_add(ip_fib_snap_t *fs)
+{
+	poptrie_route_t *routes;
+	uint32_t max;
+
+	if (fs->fs_n == fs->fs_max) {
+		max = fs->fs_max == 0 ? 1024 : fs->fs_max * 2;
+		routes = kmem_alloc(max * sizeof (poptrie_route_t), KM_SLEEP);
+		if (fs->fs_routes != NULL) {
+			bcopy(fs->fs_routes, routes,
+			    fs->fs_n * sizeof (poptrie_route_t));
+			kmem_free(fs->fs_routes,
+			    fs->fs_max * sizeof (poptrie_route_t));
+		}
+		fs->fs_routes = routes;
+		fs->fs_max = max;
+	}
+	return (&fs->fs_routes[fs->fs_n++]);
+}
+
+static void
+ip_fib_snap_free(ip_fib_snap_t *fs)
+{
+	if (fs->fs_routes != NULL)
+		kmem_free(fs->fs_routes, fs->fs_max * sizeof (poptrie_route_t));
+}
+
+/*
+ * rn_walktree_mt() callback; the bucket of rn is held.
+ */
+static int
+ip_fib_walk_v4(struct radix_node *rn, void *arg)
+{
+	struct rt_entry *rt = (struct rt_entry *)rn;
+	struct rt_sockaddr *mask = (struct rt_sockaddr *)rn->rn_mask;
+	poptrie_route_t *pr = ip_fib_snap_add(arg);
+
+	pr->pr_key[0] = (uint64_t)ntohl(rt->rt_dst.rt_sin_addr.s_addr) << 32;
+	pr->pr_key[1] = 0;
+	pr->pr_plen = mask == NULL ? IP_ABITS :
+	    ip_mask_to_plen(mask->rt_sin_addr.s_addr);
+	pr->pr_value = (uintptr_t)rt;
+	return (0);
+}
+
+static boolean_t
+ip_fib_rebuild_v4(ip_stack_t *ipst)
+{
+	struct radix_node_head *rnh = ipst->ips_ip_ftable;
+	ip_fib_snap_t fs;
+	poptrie_t *pt = NULL, *old;
+	uint64_t gen;
+
+	RADIX_NODE_HEAD_RLOCK(rnh);
+	gen = ipst->ips_fib_gen_v4;
+	RADIX_NODE_HEAD_UNLOCK(rnh);
+
+	bzero(&fs, sizeof (fs));
+	(void) rnh->rnh_walktree_mt(rnh, ip_fib_walk_v4, &fs, irb_refhold_rn,
+	    irb_refrele_rn);
+	if (fs.fs_n >= ip_fib_min_routes)
+		pt = poptrie_build(fs.fs_routes, fs.fs_n, IP_ABITS);
+	ip_fib_snap_free(&fs);
+
+	/*
+	 * The trie points at rt_entries, which are only freed after a
+	 * generation change; if there was none, they are all still there.
+	 */
+	RADIX_NODE_HEAD_WLOCK(rnh);
+	if (ipst->ips_fib_gen_v4 != gen) {
+		RADIX_NODE_HEAD_UNLOCK(rnh);
+		if (pt != NULL)
+			poptrie_free(pt);
+		return (B_FALSE);
+	}
+	old = ipst->ips_fib_v4;
+	ipst->ips_fib_v4 = pt;
+	RADIX_NODE_HEAD_UNLOCK(rnh);
+
+	if (old != NULL)
+		poptrie_free(old);
+	DTRACE_PROBE2(ip__fib__rebuild__v4, ip_stack_t *, ipst,
+	    poptrie_t *, pt);
+	return (B_TRUE);
+}
+
+/*
+ * Copy the prefixes of the IPv6 forwarding table, other than host routes,
+ * with their length plus one as the value.  At most fs_max are copied;
+ * returns the number found.
+ */
+static uint32_t
+ip_fib_snap_v6(ip_stack_t *ipst, ip_fib_snap_t *fs)
+{
+	irb_t *irb;
+	ire_t *ire;
+	uint32_t n = 0;
+	uint_t i, j;
+
+	ASSERT(RW_LOCK_HELD(&ipst->ips_ip6_ire_head_lock));
+
+	for (i = 0; i < IPV6_ABITS; i++) {
+		if ((irb = ipst->ips_ip_forwarding_table_v6[i]) == NULL)
+			continue;
+		for (j = 0; j < ipst->ips_ip6_ftable_hash_size; j++) {
+			if (irb[j].irb_ire_cnt == 0)
+				continue;
+			rw_enter(&irb[j].irb_lock, RW_READER);
+			for (ire = irb[j].irb_ire; ire != NULL;
+			    ire = ire->ire_next) {
+				poptrie_route_t *pr;
+
+				if (n++ >= fs->fs_max)
+					continue;
+				pr = &fs->fs_routes[fs->fs_n++];
+				ip_fib_key_v6(&ire->ire_addr_v6, pr->pr_key);
+				pr->pr_plen = i;
+				pr->pr_value = i + 1;
+			}
+			rw_exit(&irb[j].irb_lock);
+		}
+	}
+	return (n);
+}
+
+static boolean_t
+ip_fib_rebuild_v6(ip_stack_t *ipst)
+{
+	ip_fib_snap_t fs;
+	poptrie_t *pt = NULL, *old;
+	uint32_t n;
+	uint64_t gen;
+
+	/* Count the routes first, so that we need not allocate as reader. */
+	bzero(&fs, sizeof (fs));
+	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
+	gen = ipst->ips_fib_gen_v6;
+	n = ip_fib_snap_v6(ipst, &fs);
+	rw_exit(&ipst->ips_ip6_ire_head_lock);
+
+	if (n >= ip_fib_min_routes) {
+		fs.fs_max = n;
+		fs.fs_routes = kmem_alloc(n * sizeof (poptrie_route_t),
+		    KM_SLEEP);
+		rw_enter(&ipst->ips_ip6_ire_head_lock, RW_READER);
+		if (ipst->ips_fib_gen_v6 == gen)
+			(void) ip_fib_snap_v6(ipst, &fs);
+		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		if (fs.fs_n != 0)
+			pt = poptrie_build(fs.fs_routes, fs.fs_n, IPV6_ABITS);
+		ip_fib_snap_free(&fs);
+	}
+
+	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
+	if (ipst->ips_fib_gen_v6 != gen) {
+		rw_exit(&ipst->ips_ip6_ire_head_lock);
+		if (pt != NULL)
+			poptrie_free(pt);
+		return (B_FALSE);
+	}
+	old = ipst->ips_fib_v6;
+	ipst->ips_fib_v6 = pt;
+	rw_exit(&ipst->ips_ip6_ire_head_lock);
+
+	if (old != NULL)
+		poptrie_free(old);
+	DTRACE_PROBE2(ip__fib__rebuild__v6, ip_stack_t *, ipst,
+	    poptrie_t *, pt);
+	return (B_TRUE);
+}
+
+static void
+ip_fib_rebuild(void *arg)
+{
+	ip_stack_t *ipst = arg;
+	uint_t dirty, redo = 0;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	dirty = ipst->ips_fib_flags & (IP_FIB_DIRTY_V4 | IP_FIB_DIRTY_V6);
+	ipst->ips_fib_flags &= ~dirty;
+	mutex_exit(&ipst->ips_fib_lock);
+
+	if ((dirty & IP_FIB_DIRTY_V4) && !ip_fib_rebuild_v4(ipst))
+		redo |= IP_FIB_DIRTY_V4;
+	if ((dirty & IP_FIB_DIRTY_V6) && !ip_fib_rebuild_v6(ipst))
+		redo |= IP_FIB_DIRTY_V6;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_flags &= ~IP_FIB_DISPATCHED;
+	ipst->ips_fib_flags |= redo;
+	if ((ipst->ips_fib_flags & (IP_FIB_DIRTY_V4 | IP_FIB_DIRTY_V6)) &&
+	    !(ipst->ips_fib_flags & IP_FIB_QUIESCE) && ipst->ips_fib_tid == 0) {
+		ipst->ips_fib_tid = timeout(ip_fib_timer, ipst,
+		    MSEC_TO_TICK(ip_fib_rebuild_delay));
+	}
+	cv_broadcast(&ipst->ips_fib_cv);
+	mutex_exit(&ipst->ips_fib_lock);
+}
+
+void
+ip_fib_init(ip_stack_t *ipst)
+{
+	mutex_init(&ipst->ips_fib_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&ipst->ips_fib_cv, NULL, CV_DEFAULT, NULL);
+}
+
+/*
+ * Stop rebuilding and free the tries.  Called once the forwarding tables
+ * have been emptied, but before they are freed.
+ */
+void
+ip_fib_fini(ip_stack_t *ipst)
+{
+	timeout_id_t tid;
+
+	mutex_enter(&ipst->ips_fib_lock);
+	ipst->ips_fib_flags |= IP_FIB_QUIESCE;
+	tid = ipst->ips_fib_tid;
+	ipst->ips_fib_tid = 0;
+	mutex_exit(&ipst->ips_fib_lock);
+	if (tid != 0)
+		(void) untimeout(tid);
+
+	mutex_enter(&ipst->ips_fib_lock);
+	while (ipst->ips_fib_flags & IP_FIB_DISPATCHED)
+		cv_wait(&ipst->ips_fib_cv, &ipst->ips_fib_lock);
+	mutex_exit(&ipst->ips_fib_lock);
+
+	RADIX_NODE_HEAD_WLOCK(ipst->ips_ip_ftable);
+	if (ipst->ips_fib_v4 != NULL) {
+		poptrie_free(ipst->ips_fib_v4);
+		ipst->ips_fib_v4 = NULL;
+	}
+	RADIX_NODE_HEAD_UNLOCK(ipst->ips_ip_ftable);
+
+	rw_enter(&ipst->ips_ip6_ire_head_lock, RW_WRITER);
+	if (ipst->ips_fib_v6 != NULL) {
+		poptrie_free(ipst->ips_fib_v6);
+		ipst->ips_fib_v6 = NULL;
+	}
+	rw_exit(&ipst->ips_ip6_ire_head_lock);
+
+	cv_destroy(&ipst->ips_fib_cv);
+	mutex_destroy(&ipst->ips_fib_lock);
+}
@@ -2676,6 +2676,7 @@ ill_forward_set_on_ill(ill_t *ill, boolean_t enable)
 		ill->ill_flags |= ILLF_ROUTER;
 	else
 		ill->ill_flags &= ~ILLF_ROUTER;
+	ip_squeue_gro(ill);
 	mutex_exit(&ill->ill_lock);
 	if (ill->ill_isv6)
 		ill_set_nce_router_flags(ill, enable);
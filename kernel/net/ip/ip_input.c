@@ -202,6 +202,7 @@ ip_input_common_v4(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 	mblk_t 		*ahead = NULL;	/* Accepted head */
 	mblk_t		*atail = NULL;	/* Accepted tail */
 	uint_t		acnt = 0;	/* Accepted count */
+	udp_gro_t	gro;		/* UDP receive coalescing */
 
 	ASSERT(mp_chain != NULL);
 	ASSERT(ill != NULL);
@@ -250,6 +251,16 @@ ip_input_common_v4(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 	rtc.rtc_ire = NULL;
 	rtc.rtc_ipaddr = INADDR_ANY;
 
+	/*
+	 * UDP sockets with UDP_GRO set can merge the datagrams of a flow
+	 * that arrive in the same chain; see udp_gro_hold().
+	 */
+	if (mp_chain->b_next != NULL && target_sqp == NULL) {
+		udp_gro_init(&gro);
+		iras.ira_udp_gro = &gro;
+		chain_flags |= IRAF_UDP_GRO;
+	}
+
 	/* Loop over b_next */
 	for (mp = mp_chain; mp != NULL; mp = mp_chain) {
 		mp_chain = mp->b_next;
@@ -393,6 +404,10 @@ ip_input_common_v4(ill_t *ill, ill_rx_ring_t *ip_ring, mblk_t *mp_chain,
 		/* mhip might point into 1st packet in the chain. */
 		iras.ira_mhip = NULL;
 	}
+	/* Deliver whatever UDP merged */
+	if (chain_flags & IRAF_UDP_GRO)
+		udp_gro_flush(&gro);
+
 	/* Any remaining references to the route cache? */
 	if (rtc.rtc_ire != NULL) {
 		ASSERT(rtc.rtc_ipaddr != INADDR_ANY);
@@ -2225,6 +2240,23 @@ ip_fanout_v4(mblk_t *mp, ipha_t *ipha, ip_recv_attr_t *ira)
 			tcp_xmit_listeners_reset(mp, ira, ipst, NULL);
 			return;
 		}
+		/*
+		 * Move the flow to the CPU the connection is used on if it
+		 * came in elsewhere, see ip_squeue_steer().  Not every caller
+		 * which sets ira_ring sets ira_sqp; without it, fall back to
+		 * any squeue, as ip_squeue_get() does.
+		 */
+		if (ip_squeue_rfs && ira->ira_ring != NULL &&
+		    IPCL_IS_TCP(connp) && connp->conn_rfs_cpu != PBIND_NONE) {
+			if (ira->ira_sqp == NULL) {
+				ira->ira_sqp =
+				    IP_SQUEUE_GET(CPU_PSEUDO_RANDOM());
+			}
+			if (ira->ira_sqp->sq_bind != connp->conn_rfs_cpu) {
+				ip_squeue_steer(connp, ipha, *(uint32_t *)
+				    ((uchar_t *)ipha + ip_hdr_length), ira);
+			}
+		}
 		if (CONN_INBOUND_POLICY_PRESENT(connp, ipss) ||
 		    (iraflags & IRAF_IPSEC_SECURE)) {
 			mp = ipsec_check_inbound_policy(mp, connp,
@@ -1424,6 +1424,7 @@ irb_inactive(irb_t *irb)
 		    ipst->ips_ip_ftable);
 		DTRACE_PROBE1(irb__free, rt_t *,  rt);
 		ASSERT((void *)rn == (void *)rt);
+		ip_fib_changed_v4(ipst);
 		Free(rt, rt_entry_cache);
 		/* irb_lock is freed */
 		RADIX_NODE_HEAD_UNLOCK(ipst->ips_ip_ftable);
@@ -2236,6 +2237,7 @@ ip_ire_init(ip_stack_t *ipst)
 	mutex_init(&ipst->ips_ire_ft_init_lock, NULL, MUTEX_DEFAULT, 0);
 
 	(void) rn_inithead((void **)&ipst->ips_ip_ftable, 32);
+	ip_fib_init(ipst);
 
 	/*
 	 * Make sure that the forwarding table size is a power of 2.
@@ -2321,6 +2323,7 @@ ip_ire_fini(ip_stack_t *ipst)
 	 */
 	ire_walk(ire_delete, NULL, ipst);
 
+	ip_fib_fini(ipst);
 	rn_freehead(ipst->ips_ip_ftable);
 	ipst->ips_ip_ftable = NULL;
 
@@ -78,6 +78,17 @@
  * not bound to a CPU, and we're currently servicing the interrupt which
  * generated the packet, then bind the squeue to CPU.
  *
+ * void ip_squeue_steer(conn_t *, ipha_t *, uint32_t, ip_recv_attr_t *)
+ *
+ * Called for a TCP packet which arrived on a ring whose squeue is bound to
+ * another CPU than the one the connection is used on. Asks the MAC layer
+ * to send the flow to a ring of the same ill bound to that CPU instead.
+ *
+ * void ip_squeue_gro(ill_t *)
+ *
+ * Lets the MAC layer merge the TCP segments arriving on the rings of an ill
+ * which does not forward IPv4, and stops it on those of one which does.
+ *
  *
  * DR Notes
  * ========
@@ -105,6 +116,10 @@
  * ip_squeue_worker_wait: global value for the sq_wait field for all squeues *
  * created. This is the time squeue code waits before waking up the worker
  * thread after queuing a request.
+ *
+ * ip_squeue_rfs: if set, TCP connections follow the CPU they are read and
+ * written on, see ip_squeue_steer(). ip_squeue_rfs_interval limits how often
+ * (in milliseconds) a connection asks for its flow to be moved.
  */
 
 #include <sys/types.h>
@@ -131,6 +146,7 @@
 #include <sys/zone.h>
 #include <sys/dld.h>
 #include <sys/atomic.h>
+#include <sys/sdt.h>
 
 /*
  * List of all created squeue sets. The list and its size are protected by
@@ -517,7 +533,13 @@ ip_squeue_add_ring(ill_t *ill, void *mrp)
 	rx_ring->rr_intr_disable =
 	    (ip_mac_intr_disable_t)mrfp->mrf_intr_disable;
 	rx_ring->rr_rx_handle = mrfp->mrf_rx_arg;
+	rx_ring->rr_steer = (ip_mac_steer_t)mrfp->mrf_steer;
+	rx_ring->rr_gro = (ip_mac_gro_t)mrfp->mrf_gro;
 	rx_ring->rr_ill = ill;
+	if (rx_ring->rr_gro != NULL) {
+		rx_ring->rr_gro(rx_ring->rr_rx_handle,
+		    !(ill->ill_flags & ILLF_ROUTER));
+	}
 
 	pri = mrfp->mrf_flow_priority;
 
@@ -691,6 +713,95 @@ ip_squeue_get(ill_rx_ring_t *ill_rx_ring)
 	return (sqp);
 }
 
+/*
+ * Receive flow steering, after Linux RFS. TCP records in conn_rfs_cpu the
+ * CPU a connection is read or written on. ip_input calls us, from the
+ * ring's receive path, for a packet of the connection which arrived on a
+ * ring whose squeue is bound to another CPU: the soft ring and the squeue
+ * then run on one CPU, and the application on another. Look for a ring of
+ * the ill whose squeue is bound to conn_rfs_cpu, and have the MAC layer
+ * send the flow there from now on. When the next packet arrives through
+ * that ring, tcp_input_data() moves the connection to the ring's squeue.
+ *
+ * The MAC layer can only move flows between the soft rings fed by one
+ * hardware ring, and only IPv4 TCP flows go to soft rings by their
+ * addresses and ports.
+ */
+void
+ip_squeue_steer(conn_t *connp, ipha_t *ipha, uint32_t ports,
+    ip_recv_attr_t *ira)
+{
+	ill_rx_ring_t	*rx_ring = ira->ira_ring;
+	ill_rx_ring_t	*ring;
+	ill_t		*ill = rx_ring->rr_ill;
+	ip_stack_t	*ipst = ill->ill_ipst;
+	processorid_t	cpuid = connp->conn_rfs_cpu;
+	clock_t		now;
+	int		idx;
+
+	IP_STAT(ipst, ip_rfs_misrouted);
+
+	now = ddi_get_lbolt();
+	if (now - connp->conn_rfs_lbolt <
+	    MSEC_TO_TICK(ip_squeue_rfs_interval))
+		return;
+	connp->conn_rfs_lbolt = now;
+
+	mutex_enter(&ill->ill_lock);
+	if (rx_ring->rr_ring_state != RR_SQUEUE_BOUND ||
+	    rx_ring->rr_steer == NULL || ill->ill_dld_capab == NULL) {
+		mutex_exit(&ill->ill_lock);
+		IP_STAT(ipst, ip_rfs_nosteer);
+		return;
+	}
+	for (idx = 0; idx < ILL_MAX_RINGS; idx++) {
+		ring = &ill->ill_dld_capab->idc_poll.idp_ring_tbl[idx];
+		if (ring == rx_ring || ring->rr_ring_state != RR_SQUEUE_BOUND ||
+		    ring->rr_sqp->sq_bind != cpuid)
+			continue;
+		/* The soft rings stay as long as the rings are bound */
+		if (rx_ring->rr_steer(rx_ring->rr_rx_handle,
+		    ring->rr_rx_handle, ipha->ipha_src, ipha->ipha_dst,
+		    ports)) {
+			mutex_exit(&ill->ill_lock);
+			IP_STAT(ipst, ip_rfs_steered);
+			DTRACE_PROBE3(ip__squeue__steer, conn_t *, connp,
+			    ill_rx_ring_t *, rx_ring, ill_rx_ring_t *, ring);
+			return;
+		}
+	}
+	mutex_exit(&ill->ill_lock);
+	IP_STAT(ipst, ip_rfs_nosteer);
+}
+
+/*
+ * The MAC layer merges runs of TCP segments received on a ring into one
+ * large segment, much as LRO hardware would (see mac_rx_gro()). That is
+ * only good for segments this host is to receive: merged ones would be
+ * dropped, or fragmented, on the way out again. Turn it on for the rings of
+ * an ill as long as the ill does not forward, and off when it starts to.
+ * Called with ill_lock held, whenever ILLF_ROUTER changes.
+ */
+void
+ip_squeue_gro(ill_t *ill)
+{
+	ill_rx_ring_t	*ring;
+	int		idx;
+
+	ASSERT(MUTEX_HELD(&ill->ill_lock));
+
+	if (ill->ill_isv6 || ill->ill_dld_capab == NULL)
+		return;
+	for (idx = 0; idx < ILL_MAX_RINGS; idx++) {
+		ring = &ill->ill_dld_capab->idc_poll.idp_ring_tbl[idx];
+		/* The soft ring stays until the ring is free again */
+		if (ring->rr_ring_state == RR_FREE || ring->rr_gro == NULL)
+			continue;
+		ring->rr_gro(ring->rr_rx_handle,
+		    !(ill->ill_flags & ILLF_ROUTER));
+	}
+}
+
 /*
  * Called when a CPU goes offline. It's squeue_set_t is destroyed, and all
  * squeues are unboudn and moved to the unbound set.
@@ -169,11 +169,34 @@
  * 	Arguements :
  * 		connp		conn_t to be inserted
  *
+ *	A TCP listener or an unconnected UDP endpoint with SO_REUSEPORT set
+ *	also joins the SO_REUSEPORT group of the endpoints of the same user
+ *	bound to the same address and port, see "SO_REUSEPORT" below.
+ *
  *
  * void ipcl_hash_remove(connp);
  *
  * 	Removes the 'connp' from the connection fanout table.
  *
+ * SO_REUSEPORT
+ * ------------
+ *
+ * Several TCP listeners or UDP endpoints can share a port if they all set
+ * SO_REUSEPORT and belong to the same user, typically one per worker
+ * process or thread, so that they don't all contend on the eager queue or
+ * receive queue of a single endpoint.  Once in the fanout, the members of
+ * such a group are kept in an ipcl_reuseport_t, protected by the connf_lock
+ * of the bucket; since the bind and UDP fanouts are hashed on the local
+ * port only, all members are in the same bucket.
+ *
+ * When ipcl_classify_v4/v6 find a group member, they pick one of the
+ * members by a hash of the remote address and ports, so that all the
+ * segments of a connection, and all the datagrams of a flow, go to the same
+ * member.  If a member has set SO_INCOMING_CPU to the CPU the packet is
+ * being received on, it gets the packet instead: a worker bound to that CPU
+ * then accepts the connection, which keeps being processed on the squeue of
+ * that CPU.
+ *
  * Connection Creation/Destruction
  * -------------------------------
  *
@@ -601,6 +624,7 @@ ipcl_conn_destroy(conn_t *connp)
 	ASSERT(!MUTEX_HELD(&connp->conn_lock));
 	ASSERT(connp->conn_ref == 0);
 	ASSERT(connp->conn_ioctlref == 0);
+	ASSERT(connp->conn_reuseport_grp == NULL);
 
 	DTRACE_PROBE1(conn__destroy, conn_t *, connp);
 
@@ -712,6 +736,137 @@ ipcl_conn_destroy(conn_t *connp)
 	}
 }
 
+/*
+ * Can connp join the SO_REUSEPORT group of rconnp?
+ */
+#define	IPCL_REUSEPORT_MATCH(rconnp, connp)				\
+	((rconnp)->conn_reuseport_grp != NULL &&			\
+	(rconnp)->conn_proto == (connp)->conn_proto &&			\
+	(rconnp)->conn_lport == (connp)->conn_lport &&			\
+	IN6_ARE_ADDR_EQUAL(&(rconnp)->conn_laddr_v6,			\
+	&(connp)->conn_laddr_v6) &&					\
+	(rconnp)->conn_family == (connp)->conn_family &&		\
+	(rconnp)->conn_ipversion == (connp)->conn_ipversion &&		\
+	(rconnp)->conn_ipv6_v6only == (connp)->conn_ipv6_v6only &&	\
+	(rconnp)->conn_zoneid == (connp)->conn_zoneid &&		\
+	(rconnp)->conn_allzones == (connp)->conn_allzones &&		\
+	(rconnp)->conn_incoming_ifindex == (connp)->conn_incoming_ifindex && \
+	crgetuid((rconnp)->conn_cred) == crgetuid((connp)->conn_cred))
+
+#define	IPCL_REUSEPORT_HASH(faddr, ports)				\
+	((((uint32_t)(faddr) ^ (uint32_t)(ports)) * 0x9e3779b1U) >> 16)
+
+/* Initial number of slots in an SO_REUSEPORT group */
+uint_t ipcl_reuseport_size = 8;
+
+/*
+ * Add a bound, unconnected endpoint with SO_REUSEPORT to the group of its
+ * peers in connfp, creating the group if connp is the first one.  If we
+ * can't allocate memory connp isn't made a member; it then gets the packets
+ * for its address and port only when it is found before the members.
+ */
+static void
+ipcl_reuseport_join(connf_t *connfp, conn_t *connp)
+{
+	ipcl_reuseport_t	*rp, *nrp;
+	conn_t			*rconnp;
+	uint_t			i;
+
+	ASSERT(connp->conn_reuseport_grp == NULL);
+	mutex_enter(&connfp->connf_lock);
+	if (connp->conn_fanout != connfp) {
+		/* Removed while we weren't holding the lock. */
+		mutex_exit(&connfp->connf_lock);
+		return;
+	}
+	for (rconnp = connfp->connf_head; rconnp != NULL;
+	    rconnp = rconnp->conn_next) {
+		if (IPCL_REUSEPORT_MATCH(rconnp, connp))
+			break;
+	}
+
+	if (rconnp != NULL) {
+		rp = rconnp->conn_reuseport_grp;
+	} else {
+		rp = kmem_zalloc(IPCL_REUSEPORT_SIZE(ipcl_reuseport_size),
+		    KM_NOSLEEP);
+		if (rp == NULL) {
+			mutex_exit(&connfp->connf_lock);
+			return;
+		}
+		rp->rp_size = ipcl_reuseport_size;
+	}
+
+	if (rp->rp_cnt == rp->rp_size) {
+		/* Full; double its size */
+		nrp = kmem_alloc(IPCL_REUSEPORT_SIZE(2 * rp->rp_size),
+		    KM_NOSLEEP);
+		if (nrp == NULL) {
+			mutex_exit(&connfp->connf_lock);
+			return;
+		}
+		bcopy(rp, nrp, IPCL_REUSEPORT_SIZE(rp->rp_cnt));
+		nrp->rp_size = 2 * rp->rp_size;
+		for (i = 0; i < nrp->rp_cnt; i++)
+			nrp->rp_conns[i]->conn_reuseport_grp = nrp;
+		kmem_free(rp, IPCL_REUSEPORT_SIZE(rp->rp_size));
+		rp = nrp;
+	}
+
+	rp->rp_conns[rp->rp_cnt++] = connp;
+	if (connp->conn_incoming_cpu_set)
+		rp->rp_naffine++;
+	connp->conn_reuseport_grp = rp;
+	mutex_exit(&connfp->connf_lock);
+}
+
+static void
+ipcl_reuseport_leave(conn_t *connp)
+{
+	ipcl_reuseport_t	*rp = connp->conn_reuseport_grp;
+	uint_t			i;
+
+	ASSERT(MUTEX_HELD(&connp->conn_fanout->connf_lock));
+
+	for (i = 0; rp->rp_conns[i] != connp; i++)
+		ASSERT(i < rp->rp_cnt);
+	rp->rp_conns[i] = rp->rp_conns[--rp->rp_cnt];
+	if (connp->conn_incoming_cpu_set)
+		rp->rp_naffine--;
+	if (rp->rp_cnt == 0)
+		kmem_free(rp, IPCL_REUSEPORT_SIZE(rp->rp_size));
+	connp->conn_reuseport_grp = NULL;
+}
+
+/*
+ * Pick the member of connp's SO_REUSEPORT group to pass a packet to.
+ * The hash is of the remote address and ports of the packet.
+ */
+static conn_t *
+ipcl_reuseport_select(conn_t *connp, uint32_t hash)
+{
+	ipcl_reuseport_t	*rp = connp->conn_reuseport_grp;
+	processorid_t		cpuid;
+	conn_t			*rconnp;
+	uint_t			i;
+
+	ASSERT(MUTEX_HELD(&connp->conn_fanout->connf_lock));
+
+	if (rp == NULL || rp->rp_cnt == 1)
+		return (connp);
+
+	if (rp->rp_naffine != 0) {
+		cpuid = CPU->cpu_id;
+		for (i = 0; i < rp->rp_cnt; i++) {
+			rconnp = rp->rp_conns[i];
+			if (rconnp->conn_incoming_cpu_set &&
+			    rconnp->conn_incoming_cpu == cpuid)
+				return (rconnp);
+		}
+	}
+	return (rp->rp_conns[hash % rp->rp_cnt]);
+}
+
 /*
  * We set the IPCL_REMOVED flag (instead of clearing the flag indicating
  * which table the conn belonged to). So for debugging we can see which hash
@@ -730,6 +885,8 @@ ipcl_conn_destroy(conn_t *connp)
 			    (connp)->conn_next;				\
 		else							\
 			connfp->connf_head = (connp)->conn_next;	\
+		if ((connp)->conn_reuseport_grp != NULL)		\
+			ipcl_reuseport_leave((connp));			\
 		(connp)->conn_fanout = NULL;				\
 		(connp)->conn_next = NULL;				\
 		(connp)->conn_prev = NULL;				\
@@ -765,6 +922,7 @@ ipcl_hash_remove_locked(conn_t *connp, connf_t	*connfp)
 {
 	ASSERT(MUTEX_HELD(&connfp->connf_lock));
 	ASSERT(MUTEX_HELD(&connp->conn_lock));
+	ASSERT(connp->conn_reuseport_grp == NULL);
 
 	if ((connp)->conn_next != NULL) {
 		(connp)->conn_next->conn_prev = (connp)->conn_prev;
@@ -1071,6 +1229,9 @@ ipcl_bind_insert_v4(conn_t *connp)
 		}
 		if (protocol == IPPROTO_RSVP)
 			ill_set_inputfn_all(ipst);
+		if (protocol == IPPROTO_UDP && connp->conn_reuseport &&
+		    connp->conn_faddr_v4 == INADDR_ANY)
+			ipcl_reuseport_join(connfp, connp);
 		break;
 
 	case IPPROTO_TCP:
@@ -1083,6 +1244,8 @@ ipcl_bind_insert_v4(conn_t *connp)
 		} else {
 			IPCL_HASH_INSERT_WILDCARD(connfp, connp);
 		}
+		if (connp->conn_reuseport)
+			ipcl_reuseport_join(connfp, connp);
 		break;
 
 	case IPPROTO_SCTP:
@@ -1123,6 +1286,9 @@ ipcl_bind_insert_v6(conn_t *connp)
 		} else {
 			IPCL_HASH_INSERT_WILDCARD(connfp, connp);
 		}
+		if (protocol == IPPROTO_UDP && connp->conn_reuseport &&
+		    IN6_IS_ADDR_UNSPECIFIED(&connp->conn_faddr_v6))
+			ipcl_reuseport_join(connfp, connp);
 		break;
 
 	case IPPROTO_TCP:
@@ -1135,6 +1301,8 @@ ipcl_bind_insert_v6(conn_t *connp)
 		} else {
 			IPCL_HASH_INSERT_WILDCARD(connfp, connp);
 		}
+		if (connp->conn_reuseport)
+			ipcl_reuseport_join(connfp, connp);
 		break;
 
 	case IPPROTO_SCTP:
@@ -1394,6 +1562,8 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 
 		if (connp != NULL) {
 			/* Have a listener at least */
+			connp = ipcl_reuseport_select(connp,
+			    IPCL_REUSEPORT_HASH(ipha->ipha_src, ports));
 			CONN_INC_REF(connp);
 			mutex_exit(&bind_connfp->connf_lock);
 			return (connp);
@@ -1417,6 +1587,9 @@ ipcl_classify_v4(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 		}
 
 		if (connp != NULL) {
+			connp = ipcl_reuseport_select(connp,
+			    IPCL_REUSEPORT_HASH(ipha->ipha_src,
+			    *(uint32_t *)up));
 			CONN_INC_REF(connp);
 			mutex_exit(&connfp->connf_lock);
 			return (connp);
@@ -1497,6 +1670,9 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 
 		if (connp != NULL) {
 			/* Have a listner at least */
+			connp = ipcl_reuseport_select(connp,
+			    IPCL_REUSEPORT_HASH(ip6h->ip6_src.s6_addr32[3],
+			    ports));
 			CONN_INC_REF(connp);
 			mutex_exit(&bind_connfp->connf_lock);
 			return (connp);
@@ -1521,6 +1697,9 @@ ipcl_classify_v6(mblk_t *mp, uint8_t protocol, uint_t hdr_len,
 		}
 
 		if (connp != NULL) {
+			connp = ipcl_reuseport_select(connp,
+			    IPCL_REUSEPORT_HASH(ip6h->ip6_src.s6_addr32[3],
+			    *(uint32_t *)up));
 			CONN_INC_REF(connp);
 			mutex_exit(&connfp->connf_lock);
 			return (connp);
@@ -1132,6 +1132,7 @@ ipmp_ill_join_illgrp(ill_t *ill, ipmp_illgrp_t *illg)
 		ill->ill_flags |= ILLF_ROUTER;
 	else
 		ill->ill_flags &= ~ILLF_ROUTER;
+	ip_squeue_gro(ill);
 	mutex_exit(&ill->ill_lock);
 
 	/*
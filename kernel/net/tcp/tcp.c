@@ -1281,6 +1281,7 @@ tcp_closei_local(tcp_t *tcp)
 
 	/* Stop all the timers */
 	tcp_timers_stop(tcp);
+	tcp_pace_cancel(tcp);
 
 	if (tcp->tcp_state == TCPS_LISTEN) {
 		if (tcp->tcp_ip_addr_cache) {
@@ -1377,6 +1378,8 @@ tcp_free(tcp_t *tcp)
 	TCP_NOTSACK_REMOVE_ALL(tcp->tcp_notsack_list, tcp);
 	bzero(&tcp->tcp_sack_info, sizeof (tcp_sack_info_t));
 
+	tcp_cc_fini(tcp);
+
 	if (tcp->tcp_hopopts != NULL) {
 		mi_free(tcp->tcp_hopopts);
 		tcp->tcp_hopopts = NULL;
@@ -1532,6 +1535,33 @@ tcp_get_conn(void *arg, tcp_stack_t *tcps)
 	return ((void *)connp);
 }
 
+/*
+ * Check the 4-tuple of a connection against the TIME_WAIT records, see
+ * tcp_time_wait_connect().  If the port was picked for a quick connect,
+ * TCP_TW_CONNECT_TRIES other ones are tried before giving up.
+ */
+#define	TCP_TW_CONNECT_TRIES	8
+
+static int
+tcp_connect_time_wait(tcp_t *tcp, boolean_t quick)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	in_port_t	lport;
+	int		tries, error;
+
+	for (tries = 0; (error = tcp_time_wait_connect(tcp)) != 0; tries++) {
+		if (!quick || tries == TCP_TW_CONNECT_TRIES)
+			return (error);
+		lport = tcp_update_next_port(ntohs(connp->conn_lport) + 1,
+		    tcp, B_TRUE);
+		lport = tcp_bindi(tcp, lport, &connp->conn_bound_addr_v6, 0,
+		    B_TRUE, B_FALSE, B_FALSE);
+		if (lport == 0)
+			return (-TNOADDR);
+	}
+	return (0);
+}
+
 /*
  * Handle connect to IPv4 destinations, including connections for AF_INET6
  * sockets connecting to IPv4 mapped IPv6 destinations.
@@ -1546,6 +1576,7 @@ tcp_connect_ipv4(tcp_t *tcp, ipaddr_t *dstaddrp, in_port_t dstport,
 	conn_t		*connp = tcp->tcp_connp;
 	tcp_stack_t	*tcps = tcp->tcp_tcps;
 	int		error;
+	boolean_t	quick = B_FALSE;
 
 	ASSERT(connp->conn_ipversion == IPV4_VERSION);
 
@@ -1600,6 +1631,7 @@ tcp_connect_ipv4(tcp_t *tcp, ipaddr_t *dstaddrp, in_port_t dstport,
 		    B_FALSE, B_FALSE);
 		if (lport == 0)
 			return (-TNOADDR);
+		quick = B_TRUE;
 	}
 
 	/*
@@ -1617,6 +1649,10 @@ tcp_connect_ipv4(tcp_t *tcp, ipaddr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	error = tcp_connect_time_wait(tcp, quick);
+	if (error != 0)
+		return (error);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v4(connp));
@@ -1634,6 +1670,7 @@ tcp_connect_ipv6(tcp_t *tcp, in6_addr_t *dstaddrp, in_port_t dstport,
 	conn_t		*connp = tcp->tcp_connp;
 	tcp_stack_t	*tcps = tcp->tcp_tcps;
 	int		error;
+	boolean_t	quick = B_FALSE;
 
 	ASSERT(connp->conn_family == AF_INET6);
 
@@ -1696,6 +1733,7 @@ tcp_connect_ipv6(tcp_t *tcp, in6_addr_t *dstaddrp, in_port_t dstport,
 		    B_FALSE, B_FALSE);
 		if (lport == 0)
 			return (-TNOADDR);
+		quick = B_TRUE;
 	}
 
 	/*
@@ -1713,6 +1751,10 @@ tcp_connect_ipv6(tcp_t *tcp, in6_addr_t *dstaddrp, in_port_t dstport,
 	    connp->conn_fport == connp->conn_lport)
 		return (-TBADADDR);
 
+	error = tcp_connect_time_wait(tcp, quick);
+	if (error != 0)
+		return (error);
+
 	tcp->tcp_state = TCPS_SYN_SENT;
 
 	return (ipcl_conn_insert_v6(connp));
@@ -1898,6 +1940,7 @@ tcp_reinit(tcp_t *tcp)
 
 	/* Cancel outstanding timers */
 	tcp_timers_stop(tcp);
+	tcp_pace_cancel(tcp);
 
 	/*
 	 * Reset everything in the state vector, after updating global
@@ -2161,6 +2204,7 @@ tcp_reinit_values(tcp_t *tcp)
 	DONTCARE(tcp->tcp_cwnd_ssthresh); /* Init in tcp_set_destination */
 	DONTCARE(tcp->tcp_cwnd_max);		/* Init in tcp_init_values */
 	tcp->tcp_csuna = 0;
+	tcp_cc_fini(tcp);		/* Init in tcp_init_values */
 
 	tcp->tcp_rto = 0;			/* Displayed in MIB */
 	DONTCARE(tcp->tcp_rtt_sa);		/* Init in tcp_init_values */
@@ -2285,6 +2329,27 @@ tcp_reinit_values(tcp_t *tcp)
 	tcp->tcp_cork = B_FALSE;
 	tcp->tcp_tconnind_started = B_FALSE;
 
+	/* Taken off the pacing wheel by tcp_reinit() */
+	ASSERT(tcp->tcp_pace_state != TCP_PACE_QUEUED);
+	PRESERVE(tcp->tcp_pace_max_rate);
+	tcp->tcp_pace_next = 0;
+	DONTCARE(tcp->tcp_pace_wnext);
+	DONTCARE(tcp->tcp_pace_wprev);
+	DONTCARE(tcp->tcp_pace_tick);
+	PRESERVE(tcp->tcp_pace_state);		/* may be TCP_PACE_RUNNING */
+	PRESERVE(tcp->tcp_pace_mp);
+
+	PRESERVE(tcp->tcp_fastopen_qlen);
+	PRESERVE(tcp->tcp_tfo_connect);
+	tcp->tcp_tfo_active = B_FALSE;
+	tcp->tcp_tfo_deferred = B_FALSE;
+	tcp->tcp_tfo_early = B_FALSE;
+	tcp->tcp_tfo_accepted = B_FALSE;
+	tcp->tcp_tfo_syn_len = 0;
+	tcp->tcp_tfo_mss = 0;
+	tcp->tcp_tfo_cookie_len = 0;
+	DONTCARE(tcp->tcp_tfo_cookie);
+
 	PRESERVE(tcp->tcp_squeue_bytes);
 
 	tcp->tcp_closemp_used = B_FALSE;
@@ -2374,6 +2439,7 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 		tcp->tcp_ka_rinterval = parent->tcp_ka_rinterval;
 
 		tcp->tcp_init_cwnd = parent->tcp_init_cwnd;
+		tcp->tcp_pace_max_rate = parent->tcp_pace_max_rate;
 	}
 
 	/*
@@ -2395,6 +2461,7 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 	tcp->tcp_last_recv_time = ddi_get_lbolt();
 	tcp->tcp_cwnd_max = tcps->tcps_cwnd_max_;
 	tcp->tcp_cwnd_ssthresh = TCP_MAX_LARGEWIN;
+	tcp_cc_init(tcp, parent);
 
 	tcp->tcp_maxpsz_multiplier = tcps->tcps_maxpsz_multiplier;
 
@@ -2416,6 +2483,11 @@ tcp_init_values(tcp_t *tcp, tcp_t *parent)
 	tcp->tcp_rwnd = connp->conn_rcvbuf;
 
 	tcp->tcp_cork = B_FALSE;
+
+	/* Not used by anyone yet, see ip_squeue_steer() */
+	connp->conn_rfs_cpu = PBIND_NONE;
+	connp->conn_rfs_lbolt = 0;
+
 	/*
 	 * Init the tcp_debug option if it wasn't already set.  This value
 	 * determines whether TCP
@@ -3527,6 +3599,9 @@ tcp_ddi_g_init(void)
 	tcp_notsack_blk_cache = kmem_cache_create("tcp_notsack_blk_cache",
 	    sizeof (notsack_blk_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
 
+	tcp_tw_cache = kmem_cache_create("tcp_tw_cache",
+	    sizeof (tcp_tw_t), 0, NULL, NULL, NULL, NULL, NULL, 0);
+
 	/* A single callback independently of how many netstacks we have */
 	ip_squeue_init(tcp_squeue_add);
 
@@ -3534,6 +3609,8 @@ tcp_ddi_g_init(void)
 
 	tcp_squeue_flag = tcp_squeue_switch(tcp_squeue_wput);
 
+	cc_init();
+
 	/*
 	 * We want to be informed each time a stack is created or
 	 * destroyed in the kernel, so we can maintain the
@@ -3605,9 +3682,16 @@ tcp_stack_init(netstackid_t stackid, netstack_t *ns)
 	MD5Init(&tcps->tcps_iss_key);
 	MD5Update(&tcps->tcps_iss_key, secret, sizeof(secret));
 
+	/* And the key of our TCP Fast Open cookies, see tcp_fastopen.c. */
+	random_get_pseudo_bytes(secret, sizeof(secret));
+	MD5Init(&tcps->tcps_tfo_key);
+	MD5Update(&tcps->tcps_tfo_key, secret, sizeof(secret));
+
 	tcps->tcps_kstat = tcp_kstat2_init(stackid);
 	tcps->tcps_mibkp = tcp_kstat_init(stackid);
 
+	tcp_time_wait_init(tcps);
+
 	major = mod_name_to_major(INET_NAME);
 	error = ldi_ident_from_major(major, &tcps->tcps_ldi_ident);
 	ASSERT(error == 0);
@@ -3647,6 +3731,9 @@ tcp_stack_init(netstackid_t stackid, netstack_t *ns)
 	list_create(&tcps->tcps_listener_conf, sizeof (tcp_listener_t),
 	    offsetof(tcp_listener_t, tl_link));
 
+	cc_hold(&cc_newreno);
+	tcp_cc_set_default(tcps, &cc_newreno);
+
 	return (tcps);
 }
 
@@ -3662,8 +3749,11 @@ tcp_ddi_g_destroy(void)
 
 	kmem_cache_destroy(tcp_timercache);
 	kmem_cache_destroy(tcp_notsack_blk_cache);
+	kmem_cache_destroy(tcp_tw_cache);
 
 	netstack_unregister(NS_TCP);
+
+	cc_fini();
 }
 
 /*
@@ -3675,6 +3765,8 @@ tcp_stack_fini(netstackid_t stackid, void *arg)
 	tcp_stack_t *tcps = (tcp_stack_t *)arg;
 	int i;
 
+	tcp_time_wait_fini(tcps);
+
 	freeb(tcps->tcps_ixa_cleanup_mp);
 	tcps->tcps_ixa_cleanup_mp = NULL;
 	cv_destroy(&tcps->tcps_ixa_cleanup_ready_cv);
@@ -3694,6 +3786,8 @@ tcp_stack_fini(netstackid_t stackid, void *arg)
 
 	tcp_listener_conf_cleanup(tcps);
 
+	tcp_cc_set_default(tcps, NULL);
+
 	for (i = 0; i < tcps->tcps_sc_cnt; i++)
 		kmem_free(tcps->tcps_sc[i], sizeof (tcp_stats_cpu_t));
 	kmem_free(tcps->tcps_sc, max_ncpus * sizeof (tcp_stats_cpu_t *));
@@ -4054,6 +4148,15 @@ tcp_do_connect(conn_t *connp, const struct sockaddr *sa, socklen_t len,
 	    connp->conn_ixa, void, NULL, tcp_t *, tcp, void, NULL,
 	    int32_t, TCPS_BOUND);
 
+	/*
+	 * With a TCP Fast Open cookie for the peer, the SYN waits for the
+	 * first data to carry it; see tcp_fastopen_send_syn().
+	 */
+	if (tcp->tcp_tfo_connect && tcp_fastopen_connect(tcp)) {
+		SOCK_CONNID_BUMP(tcp->tcp_connid);
+		goto done;
+	}
+
 	TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
 	syn_mp = tcp_xmit_mp(tcp, NULL, 0, NULL, NULL,
 	    tcp->tcp_iss, B_FALSE, NULL, B_FALSE);
@@ -4076,6 +4179,7 @@ tcp_do_connect(conn_t *connp, const struct sockaddr *sa, socklen_t len,
 		tcp_send_data(tcp, syn_mp);
 	}
 
+done:
 	if (tcp->tcp_conn.tcp_opts_conn_req != NULL)
 		tcp_close_mpp(&tcp->tcp_conn.tcp_opts_conn_req);
 	return (0);
@@ -680,6 +680,17 @@ tcp_bindi(tcp_t *tcp, in_port_t port, const in6_addr_t *laddr,
 				continue;
 			}
 
+			/*
+			 * Endpoints of the same user that all have
+			 * SO_REUSEPORT set can bind to the same port and
+			 * address; the classifier spreads the connections
+			 * among their listeners.
+			 */
+			if (connp->conn_reuseport && lconnp->conn_reuseport &&
+			    user_specified && crgetuid(lconnp->conn_cred) ==
+			    crgetuid(connp->conn_cred))
+				continue;
+
 			/*
 			 * Check ipversion to allow IPv4 and IPv6 sockets to
 			 * have disjoint port number spaces, if *_EXCLBIND
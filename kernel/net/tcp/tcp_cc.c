@@ -0,0 +1,429 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP congestion control algorithms.
+ *
+ * TCP itself decides when the network is congested -- fast retransmit,
+ * ECN-Echo, retransmission timeout -- and recovers the lost data; how
+ * tcp_cwnd and tcp_cwnd_ssthresh evolve in response to ACKs and to those
+ * congestion signals is up to the congestion control algorithm of the
+ * connection, a cc_algo_t (see <inet/cc.h>).
+ *
+ * NewReno, as TCP has always done it, is built in and is the default.
+ * Other algorithms are loadable modules, /kernel/cc/cc_<name>, which
+ * register themselves with cc_register() in their _init(), and
+ * unregister with cc_unregister() in their _fini(), which fails while any
+ * connection or stack still uses the algorithm.
+ *
+ * A new connection uses the algorithm of its listener, or else the default
+ * of its stack, which is set with
+ *
+ *	# ipadm set-prop -p congestion_control=cubic tcp
+ *
+ * and an application can switch a connection to another algorithm at any
+ * time with the TCP_CONGESTION socket option.  Either loads the module of
+ * the algorithm if it is not registered yet.
+ *
+ * Locking: the list of algorithms and the default algorithm of each stack
+ * are protected by cc_lock.  It is read for every connection that is not
+ * created by a listener, so it is a read-mostly RW_PERCPU lock.  Each
+ * connection and each stack holds a reference (cc_refcnt) on its
+ * algorithm; a connection that inherits its listener's algorithm takes its
+ * reference without the lock, as the listener's keeps the algorithm
+ * registered.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/modctl.h>
+#include <sys/kmem.h>
+#include <sys/list.h>
+#include <sys/rwlock.h>
+#include <sys/atomic.h>
+#include <sys/sysmacros.h>
+#include <sys/debug.h>
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+#include <inet/cc.h>
+
+static krwlock_t	cc_lock;
+static list_t		cc_list;
+
+/*
+ * NewReno: slow start, then increase tcp_cwnd by one MSS per window.  On
+ * congestion, set tcp_cwnd_ssthresh to half of the data in flight.
+ */
+void
+newreno_ack_received(cc_var_t *ccv, int type)
+{
+	tcp_t		*tcp = ccv->ccv_tcp;
+	uint32_t	cwnd = tcp->tcp_cwnd;
+	uint32_t	add = tcp->tcp_mss;
+
+	if (type == CC_DUPACK) {
+		/*
+		 * We know that one more packet has left the pipe thus we
+		 * can update cwnd.
+		 */
+		tcp->tcp_cwnd = MIN(cwnd + add, tcp->tcp_cwnd_max);
+		return;
+	}
+
+	if (cwnd >= tcp->tcp_cwnd_ssthresh) {
+		/*
+		 * This is to prevent an increase of less than 1 MSS of
+		 * tcp_cwnd.  With partial increase, tcp_wput_data()
+		 * may send out tinygrams in order to preserve mblk
+		 * boundaries.
+		 *
+		 * By initializing tcp_cwnd_cnt to new tcp_cwnd and
+		 * decrementing it by 1 MSS for every ACKs, tcp_cwnd is
+		 * increased by 1 MSS for every RTTs.
+		 */
+		if (tcp->tcp_cwnd_cnt <= 0) {
+			tcp->tcp_cwnd_cnt = cwnd + add;
+		} else {
+			tcp->tcp_cwnd_cnt -= add;
+			add = 0;
+		}
+	}
+	tcp->tcp_cwnd = MIN(cwnd + add, tcp->tcp_cwnd_max);
+}
+
+void
+newreno_cong_signal(cc_var_t *ccv, int type)
+{
+	tcp_t		*tcp = ccv->ccv_tcp;
+	uint32_t	mss = tcp->tcp_mss;
+	uint32_t	npkt;
+
+	switch (type) {
+	case CC_NDUPACK:
+		/*
+		 * Keep tcp_cwnd inflated by the segments that the duplicate
+		 * ACKs show to have left the network.
+		 */
+		npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		tcp->tcp_cwnd = (npkt + tcp->tcp_dupack_cnt) * mss;
+		break;
+	case CC_ECN:
+		/*
+		 * tcp_cwnd may become 0, in which case TCP uses its timer
+		 * to clock out new segments, as the ECN spec requires.
+		 */
+		npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
+		tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		tcp->tcp_cwnd = npkt * mss;
+		break;
+	case CC_RTO:
+		/*
+		 * After retransmission, we need to do slow start.  Set the
+		 * ssthresh to one half of current effective window and cwnd
+		 * to one MSS.  Also reset tcp_cwnd_cnt.
+		 *
+		 * Note that if tcp_ssthresh is reduced because of ECN, do
+		 * not reduce it again unless it is already one window of
+		 * data away (tcp_cwr should then be cleared) or this is a
+		 * timeout for a retransmitted segment.
+		 */
+		if (!tcp->tcp_cwr || tcp->tcp_rexmit) {
+			npkt = ((tcp->tcp_timer_backoff ?
+			    tcp->tcp_cwnd_ssthresh :
+			    tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
+			tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
+		}
+		tcp->tcp_cwnd = mss;
+		tcp->tcp_cwnd_cnt = 0;
+		break;
+	}
+}
+
+void
+newreno_post_recovery(cc_var_t *ccv)
+{
+	tcp_t	*tcp = ccv->ccv_tcp;
+
+	/*
+	 * Restore the orig tcp_cwnd_ssthresh after fast retransmit phase.
+	 */
+	if (tcp->tcp_cwnd > tcp->tcp_cwnd_ssthresh)
+		tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh;
+	tcp->tcp_cwnd_cnt = 0;
+}
+
+cc_algo_t cc_newreno = {
+	.cc_name = "newreno",
+	.cc_ack_received = newreno_ack_received,
+	.cc_cong_signal = newreno_cong_signal,
+	.cc_post_recovery = newreno_post_recovery,
+};
+
+void
+cc_hold(cc_algo_t *algo)
+{
+	atomic_inc_uint(&algo->cc_refcnt);
+}
+
+void
+cc_rele(cc_algo_t *algo)
+{
+	ASSERT(algo->cc_refcnt != 0);
+	atomic_dec_uint(&algo->cc_refcnt);
+}
+
+int
+cc_register(cc_algo_t *algo)
+{
+	cc_algo_t	*a;
+	size_t		len = strnlen(algo->cc_name, CC_ALGO_NAME_MAX);
+
+	if (len == 0 || len == CC_ALGO_NAME_MAX ||
+	    strchr(algo->cc_name, '/') != NULL)
+		return (EINVAL);
+
+	rw_enter(&cc_lock, RW_WRITER);
+	for (a = list_head(&cc_list); a != NULL; a = list_next(&cc_list, a)) {
+		if (strcmp(a->cc_name, algo->cc_name) == 0) {
+			rw_exit(&cc_lock);
+			return (EEXIST);
+		}
+	}
+	algo->cc_refcnt = 0;
+	list_insert_tail(&cc_list, algo);
+	rw_exit(&cc_lock);
+	return (0);
+}
+
+int
+cc_unregister(cc_algo_t *algo)
+{
+	rw_enter(&cc_lock, RW_WRITER);
+	if (algo->cc_refcnt != 0) {
+		rw_exit(&cc_lock);
+		return (EBUSY);
+	}
+	list_remove(&cc_list, algo);
+	rw_exit(&cc_lock);
+	return (0);
+}
+
+/*
+ * Find the algorithm called 'name' and return it held, or NULL.  If 'load'
+ * is set, the caller may block while we load its module.
+ */
+cc_algo_t *
+cc_lookup(const char *name, boolean_t load)
+{
+	char		modname[MODMAXNAMELEN];
+	cc_algo_t	*algo;
+
+	for (;;) {
+		rw_enter(&cc_lock, RW_READER);
+		for (algo = list_head(&cc_list); algo != NULL;
+		    algo = list_next(&cc_list, algo)) {
+			if (strcmp(algo->cc_name, name) == 0) {
+				cc_hold(algo);
+				break;
+			}
+		}
+		rw_exit(&cc_lock);
+
+		if (algo != NULL || !load)
+			return (algo);
+
+		if (*name == '\0' || strchr(name, '/') != NULL ||
+		    snprintf(modname, sizeof (modname), "cc_%s", name) >=
+		    sizeof (modname) || modload("cc", modname) == -1)
+			return (NULL);
+		load = B_FALSE;
+	}
+}
+
+/*
+ * Return the names of the registered algorithms, separated by commas.
+ */
+int
+cc_list_names(char *buf, size_t size)
+{
+	cc_algo_t	*algo;
+	size_t		len = 0;
+
+	ASSERT(size != 0);
+	buf[0] = '\0';
+	rw_enter(&cc_lock, RW_READER);
+	for (algo = list_head(&cc_list); algo != NULL;
+	    algo = list_next(&cc_list, algo)) {
+		len += snprintf(buf + len, size - len, "%s%s",
+		    len == 0 ? "" : ",", algo->cc_name);
+		if (len >= size) {
+			rw_exit(&cc_lock);
+			return (ENOBUFS);
+		}
+	}
+	rw_exit(&cc_lock);
+	return (0);
+}
+
+void
+cc_init(void)
+{
+	rw_init(&cc_lock, NULL, RW_PERCPU, NULL);
+	list_create(&cc_list, sizeof (cc_algo_t), offsetof(cc_algo_t, cc_link));
+	VERIFY0(cc_register(&cc_newreno));
+}
+
+void
+cc_fini(void)
+{
+	VERIFY0(cc_unregister(&cc_newreno));
+	list_destroy(&cc_list);
+	rw_destroy(&cc_lock);
+}
+
+static int
+tcp_cc_attach(tcp_t *tcp, cc_algo_t *algo)
+{
+	cc_var_t	*ccv = &tcp->tcp_ccv;
+	int		error;
+
+	bzero(ccv, sizeof (*ccv));
+	ccv->ccv_tcp = tcp;
+	if (algo->cc_cb_init != NULL && (error = algo->cc_cb_init(ccv)) != 0)
+		return (error);
+	tcp->tcp_cc_algo = algo;
+	return (0);
+}
+
+/*
+ * Give a new connection the algorithm of its listener, or the default one
+ * of its stack.  If the algorithm can't set the connection up, fall back
+ * on NewReno.
+ */
+void
+tcp_cc_init(tcp_t *tcp, tcp_t *parent)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	cc_algo_t	*algo;
+
+	ASSERT(tcp->tcp_cc_algo == NULL);
+
+	if (parent != NULL) {
+		algo = parent->tcp_cc_algo;
+		cc_hold(algo);
+	} else {
+		rw_enter(&cc_lock, RW_READER);
+		algo = tcps->tcps_cc_algo;
+		cc_hold(algo);
+		rw_exit(&cc_lock);
+	}
+
+	if (tcp_cc_attach(tcp, algo) != 0) {
+		cc_rele(algo);
+		cc_hold(&cc_newreno);
+		VERIFY0(tcp_cc_attach(tcp, &cc_newreno));
+	}
+}
+
+void
+tcp_cc_fini(tcp_t *tcp)
+{
+	cc_algo_t	*algo = tcp->tcp_cc_algo;
+
+	if (algo == NULL)
+		return;
+	if (algo->cc_cb_destroy != NULL)
+		algo->cc_cb_destroy(&tcp->tcp_ccv);
+	tcp->tcp_cc_algo = NULL;
+	cc_rele(algo);
+}
+
+/*
+ * Switch a connection to 'algo' (TCP_CONGESTION), which the caller holds.
+ * The new algorithm starts from the current tcp_cwnd and ssthresh.
+ */
+int
+tcp_cc_switch(tcp_t *tcp, cc_algo_t *algo)
+{
+	cc_algo_t	*old = tcp->tcp_cc_algo;
+	cc_var_t	ccv = tcp->tcp_ccv;
+	int		error;
+
+	if (algo == old)
+		return (0);
+
+	cc_hold(algo);
+	if ((error = tcp_cc_attach(tcp, algo)) != 0) {
+		cc_rele(algo);
+		tcp->tcp_ccv = ccv;
+		return (error);
+	}
+	tcp->tcp_ccv.ccv_rtt = ccv.ccv_rtt;
+
+	if (old->cc_cb_destroy != NULL)
+		old->cc_cb_destroy(&ccv);
+	cc_rele(old);
+
+	if (tcp->tcp_state >= TCPS_ESTABLISHED && algo->cc_conn_init != NULL)
+		algo->cc_conn_init(&tcp->tcp_ccv);
+	return (0);
+}
+
+/*
+ * Make 'algo', which the caller holds, the default of the stack; the hold
+ * now belongs to the stack.  A NULL 'algo' drops the default when the stack
+ * goes away.
+ */
+void
+tcp_cc_set_default(tcp_stack_t *tcps, cc_algo_t *algo)
+{
+	cc_algo_t	*old;
+
+	rw_enter(&cc_lock, RW_WRITER);
+	old = tcps->tcps_cc_algo;
+	tcps->tcps_cc_algo = algo;
+	rw_exit(&cc_lock);
+
+	if (old != NULL)
+		cc_rele(old);
+}
+
+/*
+ * Copy the name of the default algorithm of the stack into 'buf'.
+ */
+void
+tcp_cc_get_default(tcp_stack_t *tcps, char *buf, size_t size)
+{
+	rw_enter(&cc_lock, RW_READER);
+	(void) strlcpy(buf, tcps->tcps_cc_algo->cc_name, size);
+	rw_exit(&cc_lock);
+}
+
+/*
+ * Copy the name of the algorithm of a connection into 'buf', for
+ * tcp_snmp_get(), which doesn't run on the squeue of the connection.  The
+ * connection might switch algorithms meanwhile; cc_lock keeps the module of
+ * the algorithm we saw from being unloaded while we copy its name.
+ */
+void
+tcp_cc_get_name(tcp_t *tcp, char *buf, size_t size)
+{
+	cc_algo_t	*algo;
+
+	rw_enter(&cc_lock, RW_READER);
+	algo = tcp->tcp_cc_algo;
+	(void) strlcpy(buf, algo != NULL ? algo->cc_name : "", size);
+	rw_exit(&cc_lock);
+}
@@ -0,0 +1,407 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP Fast Open (RFC 7413).
+ *
+ * A client that has talked to a server before may put its first data in
+ * the SYN, and the server may hand that data to the application before the
+ * handshake completes, saving a round trip on short connections.  To keep
+ * this from being used to make a server act on SYNs with forged source
+ * addresses, the client has to present a cookie it got from the server in
+ * the TCP Fast Open option of an earlier SYN-ACK.
+ *
+ * Server side.  Our cookies are the first TCP_TFO_COOKIE_LEN bytes of an MD5
+ * MAC of the addresses of the connection, keyed with tcps_tfo_key: like the
+ * RFC 6528 ISS key, a secret of the netstack that is never sent anywhere.
+ * The TCP_FASTOPEN socket option of a listener sets the most connections
+ * that may be in SYN_RCVD when a new one gets its SYN data accepted; it is
+ * checked against tcp_conn_req_cnt_q0, which includes the connections that
+ * did not use TCP Fast Open.  tcp_input_listener() calls
+ * tcp_fastopen_listen() for every SYN with the option:
+ *
+ *	- a cookie request (or a bad cookie) gets our cookie in the SYN-ACK,
+ *	  and the connection proceeds as usual;
+ *	- a good cookie has the data of the SYN queued on the eager, and
+ *	  tcp_fastopen_accept() makes the eager ESTABLISHED as soon as it has
+ *	  sent the SYN-ACK: the application can accept it, read the data and
+ *	  reply before the final ACK of the handshake arrives.  Until that ACK
+ *	  our SYN is still TCP_ISS_VALID, and the SYN-ACK is retransmitted as
+ *	  in SYN_RCVD.
+ *
+ * Client side.  The TCP_FASTOPEN_CONNECT socket option (which is what
+ * sendto() with MSG_FASTOPEN sets before its implicit connect) asks for TCP
+ * Fast Open.  The cookies we got from servers are kept in the DCE of the
+ * server address (see dce_update_tfo()), with the MSS the server announced.
+ * If there is a cookie, tcp_fastopen_connect() holds back the SYN, and the
+ * connect completes at once; the first write then sends the SYN along with
+ * as much data as fits, see tcp_fastopen_send_syn().  Without a cookie, the
+ * SYN asks for one.  If the SYN-ACK does not cover our data, it is sent
+ * again as ordinary data (tcp_fastopen_fallback()); if the SYN times out,
+ * we also forget the cookie, as something on the path may drop SYNs with
+ * data.
+ *
+ * TCP Fast Open is only done on sockets (not on TPI streams), and not on
+ * loopback connections, which could be fused.  The tcp "_fastopen" property
+ * turns off the client or the server side.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/strsun.h>
+#include <sys/squeue_impl.h>
+#include <sys/squeue.h>
+#include <sys/md5.h>
+
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/ip6.h>
+#include <inet/ip_ndp.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+
+/* Our cookie for the addresses of connp. */
+static void
+tcp_fastopen_cookie(tcp_stack_t *tcps, conn_t *connp, uint8_t *cookie)
+{
+	MD5_CTX		context;
+	uint8_t		answer[16];
+	struct {
+		in6_addr_t src;
+		in6_addr_t dst;
+	} arg;
+
+	context = tcps->tcps_tfo_key;
+	arg.src = connp->conn_faddr_v6;
+	arg.dst = connp->conn_laddr_v6;
+	MD5Update(&context, (uchar_t *)&arg, sizeof (arg));
+	MD5Final(answer, &context);
+	bcopy(answer, cookie, TCP_TFO_COOKIE_LEN);
+}
+
+/* Remember the cookie of the server, or forget it if len is 0. */
+static void
+tcp_fastopen_cache(tcp_t *tcp, const uint8_t *cookie, uint_t len)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	ip_xmit_attr_t	*ixa = connp->conn_ixa;
+	uint_t		ifindex = 0;
+
+	if (IN6_IS_ADDR_LINKSCOPE(&connp->conn_faddr_v6)) {
+		if (ixa->ixa_nce == NULL)
+			return;
+		ifindex = ixa->ixa_nce->nce_common->ncec_ill->
+		    ill_phyint->phyint_ifindex;
+	}
+	(void) dce_update_tfo(&connp->conn_faddr_v6, ifindex, cookie, len,
+	    tcp->tcp_mss, tcp->tcp_tcps->tcps_netstack->netstack_ip);
+}
+
+/*
+ * Called by tcp_do_connect() for a TCP_FASTOPEN_CONNECT socket.  Returns
+ * B_TRUE if we have a cookie for the server, in which case the SYN waits for
+ * the first data; otherwise, the SYN goes now, asking for a cookie.
+ */
+boolean_t
+tcp_fastopen_connect(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	dce_t		*dce = connp->conn_ixa->ixa_dce;
+	uint_t		len, mss;
+
+	ASSERT(tcp->tcp_state == TCPS_SYN_SENT);
+
+	if (!(tcp->tcp_tcps->tcps_fastopen & TCP_FASTOPEN_CLIENT) ||
+	    !IPCL_IS_NONSTR(connp) || tcp->tcp_loopback)
+		return (B_FALSE);
+
+	tcp->tcp_tfo_active = B_TRUE;
+	if (dce == NULL || !dce_get_tfo(dce, tcp->tcp_tfo_cookie, &len, &mss))
+		return (B_FALSE);
+
+	tcp->tcp_tfo_cookie_len = len;
+	tcp->tcp_tfo_mss = mss;
+	tcp->tcp_tfo_deferred = B_TRUE;
+	tcp->tcp_tfo_early = B_TRUE;
+	return (B_TRUE);
+}
+
+/*
+ * Send the SYN that tcp_fastopen_connect() held back, with as much of the
+ * data queued for sending as fits.  Called from the squeue, by
+ * tcp_wput_data() or when the socket is shut down before any data.
+ */
+void
+tcp_fastopen_send_syn(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	mblk_t		*mp, *syn_mp, *end_mp;
+	int32_t		len, off = 0;
+	uint32_t	seg_len;
+
+	ASSERT(tcp->tcp_state == TCPS_SYN_SENT);
+	ASSERT(tcp->tcp_snxt == tcp->tcp_iss + 1);
+
+	tcp->tcp_tfo_deferred = B_FALSE;
+
+	/*
+	 * Keep the SYN within the path MTU, whatever options it carries,
+	 * and within the MSS the server announced last time.
+	 */
+	len = tcp->tcp_mss - connp->conn_ht_iphc_len -
+	    TCP_MAX_TCP_OPTIONS_LENGTH;
+	len = MIN(len, tcp->tcp_tfo_mss);
+	len = MIN(len, tcp->tcp_unsent);
+	len = MAX(len, 0);
+
+	TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
+	syn_mp = tcp_xmit_mp(tcp, tcp->tcp_xmit_head, len, &off, &end_mp,
+	    tcp->tcp_iss, B_TRUE, &seg_len, B_TRUE);
+	if (syn_mp == NULL)
+		return;
+
+	if (seg_len != 0) {
+		tcp->tcp_snxt += seg_len;
+		tcp->tcp_unsent -= seg_len;
+		tcp->tcp_tfo_syn_len = seg_len;
+		if (end_mp == NULL) {
+			tcp->tcp_xmit_tail = tcp->tcp_xmit_last;
+			tcp->tcp_xmit_tail_unsent = 0;
+		} else {
+			tcp->tcp_xmit_tail = end_mp;
+			tcp->tcp_xmit_tail_unsent = MBLKL(end_mp) - off;
+		}
+
+		/* For the RTT estimate, as tcp_send() would do. */
+		for (mp = tcp->tcp_xmit_head; mp != NULL && (mp != end_mp ||
+		    off != 0); mp = mp->b_cont) {
+			mp->b_prev = (mblk_t *)(uintptr_t)LBOLT_FASTPATH;
+			mp->b_next = (mblk_t *)(uintptr_t)(tcp->tcp_iss + 1);
+			if (mp == end_mp)
+				break;
+		}
+		TCP_STAT(tcps, tcp_fastopen_active);
+	}
+
+	DTRACE_TCP5(connect__request, mblk_t *, NULL,
+	    ip_xmit_attr_t *, connp->conn_ixa,
+	    void_ip_t *, syn_mp->b_rptr, tcp_t *, tcp,
+	    tcph_t *, &syn_mp->b_rptr[connp->conn_ixa->ixa_ip_hdr_length]);
+	tcp_send_data(tcp, syn_mp);
+}
+
+/*
+ * Write the TCP Fast Open option of a SYN or SYN-ACK at wptr, padded to a
+ * multiple of 4 bytes, if it fits in room.  Returns its length.
+ */
+uint_t
+tcp_fastopen_opt(tcp_t *tcp, int32_t state, uint8_t *wptr, uint_t room)
+{
+	uint_t	len = tcp->tcp_tfo_cookie_len;
+	uint_t	optlen, pad;
+
+	/* Our SYN always has it, as a cookie request if nothing else. */
+	if (len == 0 && state != TCPS_SYN_SENT)
+		return (0);
+
+	optlen = TCPOPT_HEADER_LEN + len;
+	pad = P2ROUNDUP(optlen, 4) - optlen;
+	if (optlen + pad > room)
+		return (0);
+
+	while (pad-- != 0)
+		*wptr++ = TCPOPT_NOP;
+	wptr[0] = TCPOPT_FASTOPEN;
+	wptr[1] = optlen;
+	bcopy(tcp->tcp_tfo_cookie, wptr + TCPOPT_HEADER_LEN, len);
+	return (P2ROUNDUP(optlen, 4));
+}
+
+/*
+ * Called by tcp_process_options() for the SYN-ACK of a connection whose SYN
+ * had the TCP Fast Open option: keep the cookie of the server, if any.
+ */
+void
+tcp_fastopen_synack(tcp_t *tcp, tcp_opt_t *tcpopt, int options)
+{
+	uint_t	len = tcpopt->tcp_opt_tfo_len;
+
+	if ((options & TCP_OPT_TFO_PRESENT) && len >= TCP_TFO_COOKIE_MIN &&
+	    len <= DCE_TFO_COOKIE_MAX)
+		tcp_fastopen_cache(tcp, tcpopt->tcp_opt_tfo_cookie, len);
+}
+
+/*
+ * The data in our SYN was not acknowledged: send it again as ordinary data.
+ * If the SYN timed out, forget the cookie too.
+ */
+void
+tcp_fastopen_fallback(tcp_t *tcp, boolean_t forget)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	mblk_t		*mp = tcp->tcp_xmit_head;
+
+	ASSERT(tcp->tcp_tfo_syn_len != 0 && mp != NULL);
+	ASSERT(tcp->tcp_snxt == tcp->tcp_iss + 1 + tcp->tcp_tfo_syn_len);
+
+	tcp->tcp_snxt = tcp->tcp_iss + 1;
+	tcp->tcp_rexmit_nxt = tcp->tcp_snxt;
+	tcp->tcp_csuna = tcp->tcp_snxt;
+	tcp->tcp_unsent += tcp->tcp_tfo_syn_len;
+	tcp->tcp_xmit_tail = mp;
+	tcp->tcp_xmit_tail_unsent = MBLKL(mp);
+	tcp->tcp_tfo_syn_len = 0;
+
+	/* Any retransmitted SYN goes without the option. */
+	tcp->tcp_tfo_active = B_FALSE;
+	tcp->tcp_tfo_cookie_len = 0;
+	TCP_STAT(tcps, tcp_fastopen_fallback);
+
+	if (forget)
+		tcp_fastopen_cache(tcp, NULL, 0);
+}
+
+/*
+ * Called by tcp_input_listener() for the SYN mp that created eager.  If the
+ * SYN has a good cookie and data, queue the data on the eager and return its
+ * length.  Otherwise return 0, and give the client a cookie if it asked for
+ * one or had a bad one.
+ */
+uint32_t
+tcp_fastopen_listen(tcp_t *listener, tcp_t *eager, mblk_t *mp,
+    ip_recv_attr_t *ira)
+{
+	tcp_stack_t	*tcps = listener->tcp_tcps;
+	uint_t		hdr_len = ira->ira_ip_hdr_length;
+	tcpha_t		*tcpha = (tcpha_t *)&mp->b_rptr[hdr_len];
+	uint8_t		cookie[TCP_TFO_COOKIE_LEN];
+	tcp_opt_t	tcpopt;
+	mblk_t		*data;
+	uint32_t	len;
+
+	if (!(tcp_parse_options(tcpha, &tcpopt) & TCP_OPT_TFO_PRESENT) ||
+	    !IPCL_IS_NONSTR(listener->tcp_connp) || eager->tcp_loopback)
+		return (0);
+
+	eager->tcp_tfo_active = B_TRUE;
+	tcp_fastopen_cookie(tcps, eager->tcp_connp, cookie);
+	if (tcpopt.tcp_opt_tfo_len != TCP_TFO_COOKIE_LEN ||
+	    bcmp(tcpopt.tcp_opt_tfo_cookie, cookie, TCP_TFO_COOKIE_LEN) != 0) {
+		if (tcpopt.tcp_opt_tfo_len != 0)
+			TCP_STAT(tcps, tcp_fastopen_failed);
+		bcopy(cookie, eager->tcp_tfo_cookie, TCP_TFO_COOKIE_LEN);
+		eager->tcp_tfo_cookie_len = TCP_TFO_COOKIE_LEN;
+		return (0);
+	}
+
+	hdr_len += TCP_HDR_LENGTH(tcpha);
+	len = msgdsize(mp) - hdr_len;
+	if (len == 0 || (tcpha->tha_flags & TH_URG) || len > eager->tcp_rwnd)
+		return (0);
+	if (listener->tcp_conn_req_cnt_q0 > listener->tcp_fastopen_qlen ||
+	    MBLKL(mp) < hdr_len) {
+		TCP_STAT(tcps, tcp_fastopen_failed);
+		return (0);
+	}
+
+	if ((data = dupmsg(mp)) == NULL)
+		return (0);
+	data->b_rptr += hdr_len;
+	if (MBLKL(data) == 0) {
+		mblk_t *next = data->b_cont;
+
+		freeb(data);
+		data = next;
+	}
+	tcp_rcv_enqueue(eager, data, len, ira->ira_cred);
+
+	eager->tcp_tfo_accepted = B_TRUE;
+	eager->tcp_max_swnd = ntohs(tcpha->tha_win);
+	TCP_STAT(tcps, tcp_fastopen_accepted);
+	return (len);
+}
+
+/*
+ * Send the SYN-ACK of an eager that took the data in the SYN, and make it
+ * ESTABLISHED so that the application gets the connection and its data
+ * right away.  Called from the squeue of the eager, with the reference
+ * tcp_input_listener() put on it for tcp_send_synack().
+ */
+/* ARGSUSED */
+void
+tcp_fastopen_accept(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
+{
+	conn_t		*connp = (conn_t *)arg;
+	tcp_t		*tcp = connp->conn_tcp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+
+	tcp_send_synack(arg, mp, arg2, ira);
+	if (tcp->tcp_state != TCPS_SYN_RCVD)
+		return;
+
+	/*
+	 * As in the SYN_RCVD case of tcp_input_data(): the eager keeps a
+	 * reference until it is accepted, and tcp_state is set first.
+	 */
+	tcp->tcp_state = TCPS_ESTABLISHED;
+	CONN_INC_REF(connp);
+	if (!tcp_newconn_notify(tcp, ira)) {
+		tcp->tcp_state = TCPS_SYN_RCVD;
+		CONN_DEC_REF(connp);
+		ASSERT(TCP_IS_DETACHED(tcp));
+		tcp_close_detached(tcp);
+		return;
+	}
+	TCPS_CONN_INC(tcps);
+
+	/* The window the client announced in its SYN. */
+	tcp->tcp_swnd = tcp->tcp_max_swnd;
+	tcp->tcp_swl1 = tcp->tcp_irs;
+	tcp->tcp_swl2 = tcp->tcp_iss;
+
+	DTRACE_TCP6(state__change, void, NULL, ip_xmit_attr_t *,
+	    connp->conn_ixa, void, NULL, tcp_t *, tcp, void, NULL,
+	    int32_t, TCPS_SYN_RCVD);
+
+	tcp_fastopen_deliver(tcp);
+}
+
+/*
+ * Pass the data of the SYN, which tcp_fastopen_listen() queued on the
+ * eager, up to the socket.
+ */
+void
+tcp_fastopen_deliver(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	mblk_t		*mp = tcp->tcp_rcv_list;
+	uint_t		len = tcp->tcp_rcv_cnt;
+	boolean_t	push = B_TRUE;
+	int		error;
+
+	ASSERT(IPCL_IS_NONSTR(connp));
+
+	if (mp == NULL)
+		return;
+	ASSERT(mp->b_next == NULL);
+
+	tcp->tcp_rcv_list = NULL;
+	tcp->tcp_rcv_last_head = NULL;
+	tcp->tcp_rcv_last_tail = NULL;
+	tcp->tcp_rcv_cnt = 0;
+	tcp->tcp_rwnd += len;
+
+	if ((*connp->conn_upcalls->su_recv)(connp->conn_upper_handle, mp,
+	    len, 0, &error, &push) <= 0 && error == ENOSPC)
+		tcp->tcp_rwnd -= len;
+}
@@ -60,11 +60,6 @@
 	(TCPOPT_NOP << 8) | TCPOPT_NOP)
 #endif
 
-/*
- *  PAWS needs a timer for 24 days.  This is the number of ticks in 24 days
- */
-#define	PAWS_TIMEOUT	((clock_t)(24*24*60*60*hz))
-
 /*
  * Since tcp_listener is not cleared atomically with tcp_detached
  * being cleared we need this extra bit to tell a detached connection
@@ -375,6 +370,19 @@ tcp_parse_options(tcpha_t *tcpha, tcp_opt_t *tcpopt)
 			up += TCPOPT_TSTAMP_LEN;
 			continue;
 
+		case TCPOPT_FASTOPEN:
+			if (len < TCPOPT_HEADER_LEN ||
+			    up[1] < TCPOPT_HEADER_LEN ||
+			    up[1] > TCPOPT_TFO_MAX_LEN || len < up[1])
+				break;
+
+			tcpopt->tcp_opt_tfo_cookie = up + TCPOPT_HEADER_LEN;
+			tcpopt->tcp_opt_tfo_len = up[1] - TCPOPT_HEADER_LEN;
+			found |= TCP_OPT_TFO_PRESENT;
+
+			up += up[1];
+			continue;
+
 		default:
 			if (len <= 1 || len < (int)up[1] || up[1] == 0)
 				break;
@@ -545,6 +553,11 @@ tcp_process_options(tcp_t *tcp, tcpha_t *tcpha)
 	 * updated properly.
 	 */
 	TCP_SET_INIT_CWND(tcp, tcp->tcp_mss, tcps->tcps_slow_start_initial);
+	TCP_CC_CALL(tcp, cc_conn_init);
+
+	/* Keep the cookie we asked for, now that the MSS is known. */
+	if (tcp->tcp_tfo_active && tcp->tcp_state == TCPS_SYN_SENT)
+		tcp_fastopen_synack(tcp, &tcpopt, options);
 }
 
 /*
@@ -1274,6 +1287,7 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	mblk_t		*tpi_mp;
 	uint_t		ifindex = ira->ira_ruifindex;
 	boolean_t	tlc_set = B_FALSE;
+	uint32_t	tfo_len = 0;
 
 	ip_hdr_len = ira->ira_ip_hdr_length;
 	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
@@ -1285,7 +1299,9 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 
 	if (!(flags & TH_SYN)) {
 		if ((flags & TH_RST) || (flags & TH_URG)) {
-			freemsg(mp);
+			if (!(flags & TH_RST) ||
+			    !tcp_time_wait_input(mp, ira, tcps, NULL))
+				freemsg(mp);
 			return;
 		}
 		if (flags & TH_ACK) {
@@ -1301,6 +1317,15 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	if (listener->tcp_state != TCPS_LISTEN)
 		goto error2;
 
+	/*
+	 * A SYN for a connection which is a TIME_WAIT record is answered from
+	 * the record, unless it can start a new incarnation of the connection.
+	 * Then the ISS to use is left in tcp_iss, as tcp_time_wait_processing()
+	 * does.
+	 */
+	if (tcp_time_wait_input(mp, ira, tcps, &listener->tcp_iss))
+		return;
+
 	ASSERT(IPCL_IS_BOUND(lconnp));
 
 	mutex_enter(&listener->tcp_eager_lock);
@@ -1650,6 +1675,11 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		}
 	}
 
+	/* Take the data in a TCP Fast Open SYN, see tcp_fastopen.c. */
+	if ((tcps->tcps_fastopen & TCP_FASTOPEN_SERVER) &&
+	    listener->tcp_fastopen_qlen != 0)
+		tfo_len = tcp_fastopen_listen(listener, eager, mp, ira);
+
 	/*
 	 * We need to insert the eager in its own perimeter but as soon
 	 * as we do that, we expose the eager to the classifier and
@@ -1661,7 +1691,7 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	seg_seq = ntohl(tcpha->tha_seq);
 	eager->tcp_irs = seg_seq;
 	eager->tcp_rack = seg_seq;
-	eager->tcp_rnxt = seg_seq + 1;
+	eager->tcp_rnxt = seg_seq + 1 + tfo_len;
 	eager->tcp_tcpha->tha_ack = htonl(eager->tcp_rnxt);
 	TCPS_BUMP_MIB(tcps, tcpPassiveOpens);
 	eager->tcp_state = TCPS_SYN_RCVD;
@@ -1721,9 +1751,13 @@ tcp_input_listener(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	freemsg(mp);
 	/*
 	 * Send the SYN-ACK. Use the right squeue so that conn_ixa is
-	 * only used by one thread at a time.
+	 * only used by one thread at a time.  If we took the data in the
+	 * SYN, the eager also goes to ESTABLISHED from there.
 	 */
-	if (econnp->conn_sqp == lconnp->conn_sqp) {
+	if (eager->tcp_tfo_accepted) {
+		SQUEUE_ENTER_ONE(econnp->conn_sqp, mp1, tcp_fastopen_accept,
+		    econnp, ira, SQ_PROCESS, SQTAG_TCP_FASTOPEN);
+	} else if (econnp->conn_sqp == lconnp->conn_sqp) {
 		DTRACE_TCP5(send, mblk_t *, NULL, ip_xmit_attr_t *,
 		    econnp->conn_ixa, __dtrace_tcp_void_ip_t *, mp1->b_rptr,
 		    tcp_t *, eager, __dtrace_tcp_tcph_t *,
@@ -2269,9 +2303,6 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	tcp_opt_t	tcpopt;
 	ip_pkt_t	ipp;
 	boolean_t	ofo_seg = B_FALSE; /* Out of order segment */
-	uint32_t	cwnd;
-	uint32_t	add;
-	int		npkt;
 	int		mss;
 	conn_t		*connp = (conn_t *)arg;
 	squeue_t	*sqp = (squeue_t *)arg2;
@@ -2358,6 +2389,37 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		tcp->tcp_last_recv_time = LBOLT_FASTPATH;
 	}
 
+	/*
+	 * The packet came in through a ring whose squeue is bound to the CPU
+	 * the connection is used on, which ip_squeue_steer() had the flow
+	 * moved to.  Move the connection to that squeue as well, unless it is
+	 * on the pacing wheel of this one.  Packets of the connection which
+	 * are still queued here follow it, see squeue_drain().
+	 *
+	 * We only switch while nothing is queued here, and look at sq_first
+	 * without sq_lock: we are processing sqp, so other CPUs can only
+	 * queue more packets.  Packets queued after we looked follow the
+	 * connection like any others, so the race is harmless, and a single
+	 * load is all we need.
+	 */
+	if (sqp != NULL && ira->ira_sqp != NULL && ira->ira_sqp != sqp &&
+	    ip_squeue_rfs && connp->conn_rfs_cpu != PBIND_NONE &&
+	    ira->ira_sqp->sq_bind == connp->conn_rfs_cpu &&
+	    tcp->tcp_state == TCPS_ESTABLISHED &&
+	    tcp->tcp_pace_state == TCP_PACE_IDLE &&
+	    ((volatile squeue_t *)sqp)->sq_first == NULL) {
+		TCP_STAT(tcps, tcp_rfs_switch);
+		DTRACE_PROBE2(conn__rfs__sqp__switch, conn_t *, connp,
+		    squeue_t *, ira->ira_sqp);
+		CONN_INC_REF(connp);
+		SQUEUE_SWITCH(connp, ira->ira_sqp);
+		/* No special MT issues for outbound ixa_sqp hint */
+		connp->conn_ixa->ixa_sqp = connp->conn_sqp;
+		SQUEUE_ENTER_ONE(connp->conn_sqp, mp, tcp_input_data, connp,
+		    ira, ip_squeue_flag, SQTAG_TCP_RFS);
+		return;
+	}
+
 	flags = (unsigned int)tcpha->tha_flags & 0xFF;
 
 	BUMP_LOCAL(tcp->tcp_ibsegs);
@@ -2429,7 +2491,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		if (flags & TH_ACK) {
 			/*
 			 * Note that our stack cannot send data before a
-			 * connection is established, therefore the
+			 * connection is established but in a TCP Fast Open
+			 * SYN, which tcp_snxt then covers, therefore the
 			 * following check is valid.  Otherwise, it has
 			 * to be changed.
 			 */
@@ -2442,7 +2505,8 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 				    tcp, seg_ack, 0, TH_RST);
 				return;
 			}
-			ASSERT(tcp->tcp_suna + 1 == seg_ack);
+			ASSERT(tcp->tcp_suna + 1 == seg_ack ||
+			    tcp->tcp_tfo_syn_len != 0);
 		}
 		if (flags & TH_RST) {
 			if (flags & TH_ACK) {
@@ -2530,6 +2594,17 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			tcp->tcp_suna = tcp->tcp_iss + 1;
 			tcp->tcp_valid_bits &= ~TCP_ISS_VALID;
 
+			/*
+			 * The peer may have left out the data in our TCP
+			 * Fast Open SYN; if so, send it again.  Whatever it
+			 * took is acked below.
+			 */
+			if (tcp->tcp_tfo_syn_len != 0) {
+				if (seg_ack == tcp->tcp_suna)
+					tcp_fastopen_fallback(tcp, B_FALSE);
+				tcp->tcp_tfo_syn_len = 0;
+			}
+
 			/*
 			 * If SYN was retransmitted, need to reset all
 			 * retransmission info.  This is because this
@@ -2657,12 +2732,15 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			 * yes, set the transmit flag.  Then check to see
 			 * if received data processing needs to be done.
 			 * If not, go straight to xmit_check.  This short
-			 * cut is OK as we don't support T/TCP.
+			 * cut is OK as we don't support T/TCP, and the
+			 * data of a TCP Fast Open SYN is only acked, which
+			 * needs process_ack.
 			 */
 			if (tcp->tcp_unsent)
 				flags |= TH_XMIT_NEEDED;
 
-			if (seg_len == 0 && !(flags & TH_URG)) {
+			if (seg_len == 0 && !(flags & TH_URG) &&
+			    seg_ack == tcp->tcp_suna) {
 				freemsg(mp);
 				goto xmit_check;
 			}
@@ -2671,6 +2749,9 @@ tcp_input_data(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			seg_seq++;
 			break;
 		}
+		/* Crossing SYNs; send any TCP Fast Open data again later */
+		if (tcp->tcp_tfo_syn_len != 0)
+			tcp_fastopen_fallback(tcp, B_FALSE);
 		tcp->tcp_state = TCPS_SYN_RCVD;
 		DTRACE_TCP6(state__change, void, NULL, ip_xmit_attr_t *,
 		    connp->conn_ixa, void_ip_t *, NULL, tcp_t *, tcp,
@@ -3679,6 +3760,9 @@ process_ack:
 			 */
 			if (connp->conn_upcalls != NULL)
 				sockupcalls = connp->conn_upcalls;
+			/* Hand up the data of a TCP Fast Open SYN. */
+			if (tcp->tcp_tfo_accepted)
+				tcp_fastopen_deliver(tcp);
 			/*
 			 * For passive open, trace receipt of final ACK as
 			 * tcp:::accept-established.
@@ -3795,6 +3879,21 @@ process_ack:
 		if (tcp->tcp_loopback && do_tcp_fusion)
 			tcp_fuse(tcp, iphdr, tcpha);
 
+	} else if ((tcp->tcp_valid_bits & TCP_ISS_VALID) &&
+	    tcp->tcp_tfo_accepted && bytes_acked > 0) {
+		/*
+		 * The ACK of our SYN, which tcp_fastopen_accept() went to
+		 * ESTABLISHED ahead of.
+		 */
+		tcp->tcp_suna = tcp->tcp_iss + 1;	/* One for the SYN */
+		bytes_acked--;
+		if (tcp->tcp_rexmit) {
+			tcp->tcp_rexmit = B_FALSE;
+			tcp->tcp_rexmit_nxt = tcp->tcp_snxt;
+			tcp->tcp_rexmit_max = tcp->tcp_snxt;
+			tcp->tcp_ms_we_have_waited = 0;
+		}
+		tcp->tcp_valid_bits &= ~TCP_ISS_VALID;
 	}
 	/* This code follows 4.4BSD-Lite2 mostly. */
 	if (bytes_acked < 0)
@@ -3809,14 +3908,12 @@ process_ack:
 		tcp->tcp_cwr = B_FALSE;
 	if (tcp->tcp_ecn_ok && (flags & TH_ECE)) {
 		if (!tcp->tcp_cwr) {
-			npkt = ((tcp->tcp_snxt - tcp->tcp_suna) >> 1) / mss;
-			tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) * mss;
-			tcp->tcp_cwnd = npkt * mss;
+			TCP_CC_CONG_SIGNAL(tcp, CC_ECN);
 			/*
 			 * If the cwnd is 0, use the timer to clock out
 			 * new segments.  This is required by the ECN spec.
 			 */
-			if (npkt == 0) {
+			if (tcp->tcp_cwnd == 0) {
 				TCP_TIMER_RESTART(tcp, tcp->tcp_rto);
 				/*
 				 * This makes sure that when the ACK comes
@@ -3900,14 +3997,8 @@ process_ack:
 				 * ack indicates that a packet was
 				 * dropped (due to congestion.)
 				 */
-				if (!tcp->tcp_cwr) {
-					npkt = ((tcp->tcp_snxt -
-					    tcp->tcp_suna) >> 1) / mss;
-					tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) *
-					    mss;
-					tcp->tcp_cwnd = (npkt +
-					    tcp->tcp_dupack_cnt) * mss;
-				}
+				if (!tcp->tcp_cwr)
+					TCP_CC_CONG_SIGNAL(tcp, CC_NDUPACK);
 				if (tcp->tcp_ecn_ok) {
 					tcp->tcp_cwr = B_TRUE;
 					tcp->tcp_cwr_snd_max = tcp->tcp_snxt;
@@ -3986,10 +4077,8 @@ process_ack:
 					 * left the pipe thus we can update
 					 * cwnd.
 					 */
-					cwnd = tcp->tcp_cwnd + mss;
-					if (cwnd > tcp->tcp_cwnd_max)
-						cwnd = tcp->tcp_cwnd_max;
-					tcp->tcp_cwnd = cwnd;
+					TCP_CC_ACK_RECEIVED(tcp, CC_DUPACK,
+					    0);
 					if (tcp->tcp_unsent > 0)
 						flags |= TH_XMIT_NEEDED;
 					}
@@ -4122,14 +4211,11 @@ process_ack:
 		if (SEQ_GEQ(seg_ack, tcp->tcp_rexmit_max)) {
 			tcp->tcp_dupack_cnt = 0;
 			/*
-			 * Restore the orig tcp_cwnd_ssthresh after
-			 * fast retransmit phase.
+			 * Let the congestion control algorithm bring
+			 * tcp_cwnd back down after fast retransmit phase.
 			 */
-			if (tcp->tcp_cwnd > tcp->tcp_cwnd_ssthresh) {
-				tcp->tcp_cwnd = tcp->tcp_cwnd_ssthresh;
-			}
+			TCP_CC_CALL(tcp, cc_post_recovery);
 			tcp->tcp_rexmit_max = seg_ack;
-			tcp->tcp_cwnd_cnt = 0;
 
 			/*
 			 * Remove all notsack info to avoid confusion with
@@ -4219,30 +4305,8 @@ process_ack:
 	 * congestion experience bit is not set, increase the tcp_cwnd as
 	 * usual.
 	 */
-	if (!tcp->tcp_ecn_ok || !(flags & TH_ECE)) {
-		cwnd = tcp->tcp_cwnd;
-		add = mss;
-
-		if (cwnd >= tcp->tcp_cwnd_ssthresh) {
-			/*
-			 * This is to prevent an increase of less than 1 MSS of
-			 * tcp_cwnd.  With partial increase, tcp_wput_data()
-			 * may send out tinygrams in order to preserve mblk
-			 * boundaries.
-			 *
-			 * By initializing tcp_cwnd_cnt to new tcp_cwnd and
-			 * decrementing it by 1 MSS for every ACKs, tcp_cwnd is
-			 * increased by 1 MSS for every RTTs.
-			 */
-			if (tcp->tcp_cwnd_cnt <= 0) {
-				tcp->tcp_cwnd_cnt = cwnd + add;
-			} else {
-				tcp->tcp_cwnd_cnt -= add;
-				add = 0;
-			}
-		}
-		tcp->tcp_cwnd = MIN(cwnd + add, tcp->tcp_cwnd_max);
-	}
+	if (!tcp->tcp_ecn_ok || !(flags & TH_ECE))
+		TCP_CC_ACK_RECEIVED(tcp, CC_ACK, bytes_acked);
 
 	/* See if the latest urgent data has been acknowledged */
 	if ((tcp->tcp_valid_bits & TCP_URG_VALID) &&
@@ -4590,6 +4654,13 @@ update_ack:
 		} else if (TCP_IS_DETACHED(tcp)) {
 			/* We don't have an ACK timer for detached TCP. */
 			flags |= TH_ACK_NEEDED;
+		} else if (seg_len > mss) {
+			/*
+			 * Several segments merged on receive (LRO, or GRO in
+			 * the MAC soft rings); each of them would have counted
+			 * towards an ACK, so don't hold the sender up.
+			 */
+			flags |= TH_ACK_NEEDED;
 		} else if (seg_len < mss) {
 			/*
 			 * If we get a segment that is less than an mss, and we
@@ -5165,6 +5236,7 @@ tcp_set_rto(tcp_t *tcp, clock_t rtt)
 
 	TCPS_BUMP_MIB(tcps, tcpRttUpdate);
 	tcp->tcp_rtt_update++;
+	tcp->tcp_ccv.ccv_rtt = (uint32_t)m;
 
 	/* tcp_rtt_sa is not 0 means this is a new sample. */
 	if (sa != 0) {
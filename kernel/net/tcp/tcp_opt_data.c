@@ -77,6 +77,10 @@ opdes_t	tcp_opt_arr[] = {
 { SO_ALLZONES, SOL_SOCKET, OA_R, OA_RW, OP_CONFIG, 0, sizeof (int),
 	0 },
 { SO_EXCLBIND, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_REUSEPORT, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_INCOMING_CPU, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_MAX_PACING_RATE, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (uint_t),
+	0 },
 
 { SO_DOMAIN,	SOL_SOCKET, OA_R, OA_R, OP_NP, 0, sizeof (int), 0 },
 
@@ -133,6 +137,14 @@ opdes_t	tcp_opt_arr[] = {
 
 { TCP_LINGER2, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 
+{ TCP_CONGESTION, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, OP_VARLEN,
+	TCP_CA_NAME_MAX, 0 },
+
+{ TCP_FASTOPEN, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+
+{ TCP_FASTOPEN_CONNECT, IPPROTO_TCP, OA_RW, OA_RW, OP_NP, 0, sizeof (int),
+	0 },
+
 { IP_OPTIONS,	IPPROTO_IP, OA_RW, OA_RW, OP_NP,
 	(OP_VARLEN|OP_NODEFAULT),
 	IP_MAX_OPT_LENGTH + IP_ADDR_LEN, -1 /* not initialized */ },
@@ -375,6 +387,9 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case SO_ACCEPTCONN:
 			*i1 = (tcp->tcp_state == TCPS_LISTEN);
 			return (sizeof (int));
+		case SO_MAX_PACING_RATE:
+			*(uint_t *)ptr = (uint_t)tcp->tcp_pace_max_rate;
+			return (sizeof (uint_t));
 		}
 		break;
 	case IPPROTO_TCP:
@@ -440,6 +455,16 @@ tcp_opt_get(conn_t *connp, int level, int name, uchar_t *ptr)
 		case TCP_LINGER2:
 			*i1 = tcp->tcp_fin_wait_2_flush_interval / SECONDS;
 			return (sizeof (int));
+		case TCP_CONGESTION:
+			(void) strlcpy((char *)ptr, tcp->tcp_cc_algo->cc_name,
+			    TCP_CA_NAME_MAX);
+			return (strlen((char *)ptr) + 1);
+		case TCP_FASTOPEN:
+			*i1 = tcp->tcp_fastopen_qlen;
+			return (sizeof (int));
+		case TCP_FASTOPEN_CONNECT:
+			*i1 = tcp->tcp_tfo_connect;
+			return (sizeof (int));
 		}
 		break;
 	case IPPROTO_IP:
@@ -647,6 +672,14 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 			}
 			*outlenp = inlen;
 			return (0);
+		case SO_MAX_PACING_RATE:
+			/* In bytes per second; 0 or UINT_MAX means no limit. */
+			if (!checkonly) {
+				tcp->tcp_pace_max_rate =
+				    (val == UINT_MAX) ? 0 : val;
+			}
+			*outlenp = inlen;
+			return (0);
 		}
 		break;
 	case IPPROTO_TCP:
@@ -965,6 +998,50 @@ tcp_opt_set(conn_t *connp, uint_t optset_context, int level, int name,
 			}
 			tcp->tcp_fin_wait_2_flush_interval = *i1 * SECONDS;
 			break;
+		case TCP_CONGESTION: {
+			char		name[TCP_CA_NAME_MAX];
+			cc_algo_t	*algo;
+			int		error = 0;
+
+			/*
+			 * The value is the name of a registered algorithm;
+			 * tcp_setsockopt() has loaded its module if need be.
+			 */
+			if (inlen == 0 || inlen > TCP_CA_NAME_MAX) {
+				*outlenp = 0;
+				return (EINVAL);
+			}
+			bcopy(invalp, name, inlen);
+			name[MIN(inlen, TCP_CA_NAME_MAX - 1)] = '\0';
+			if ((algo = cc_lookup(name, B_FALSE)) == NULL) {
+				*outlenp = 0;
+				return (ENOENT);
+			}
+			if (!checkonly)
+				error = tcp_cc_switch(tcp, algo);
+			cc_rele(algo);
+			if (error != 0) {
+				*outlenp = 0;
+				return (error);
+			}
+			break;
+		}
+		case TCP_FASTOPEN:
+			/*
+			 * The most TCP Fast Open connections the listener
+			 * keeps in SYN_RCVD; 0 turns TFO off on it.
+			 */
+			if (*i1 < 0) {
+				*outlenp = 0;
+				return (EINVAL);
+			}
+			if (!checkonly)
+				tcp->tcp_fastopen_qlen = *i1;
+			break;
+		case TCP_FASTOPEN_CONNECT:
+			if (!checkonly)
+				tcp->tcp_tfo_connect = onoff;
+			break;
 		default:
 			break;
 		}
@@ -220,6 +220,9 @@ tcp_wput_data(tcp_t *tcp, mblk_t *mp, boolean_t urgent)
 	tcp_stack_t	*tcps = tcp->tcp_tcps;
 	conn_t		*connp = tcp->tcp_connp;
 	clock_t		now = LBOLT_FASTPATH;
+	uint64_t	rate = 0;
+	hrtime_t	pace_now = 0;
+	boolean_t	pace_more = B_FALSE;
 
 	tcpstate = tcp->tcp_state;
 	if (mp == NULL) {
@@ -373,6 +376,7 @@ data_null:
 	if ((tcp->tcp_suna == snxt) && !tcp->tcp_localnet &&
 	    (TICK_TO_MSEC(now - tcp->tcp_last_recv_time) >= tcp->tcp_rto)) {
 		TCP_SET_INIT_CWND(tcp, mss, tcps->tcps_slow_start_after_idle);
+		TCP_CC_CALL(tcp, cc_after_idle);
 	}
 	if (tcpstate == TCPS_SYN_RCVD) {
 		/*
@@ -398,6 +402,9 @@ data_null:
 			 */
 			ASSERT(tcp->tcp_ecn_ok ||
 			    tcp->tcp_state < TCPS_ESTABLISHED);
+			/* The data goes in a TCP Fast Open SYN */
+			if (tcp->tcp_tfo_deferred)
+				tcp_fastopen_send_syn(tcp);
 			return;
 		}
 
@@ -453,6 +460,26 @@ data_null:
 		}
 	}
 
+	/*
+	 * Pace the connection: send nothing before tcp_pace_next, and then
+	 * no more than the allowance.  See tcp_pace.c.
+	 */
+	if (!(tcp->tcp_valid_bits & TCP_URG_VALID) &&
+	    !tcp->tcp_zero_win_probe && (rate = tcp_pace_rate(tcp)) != 0) {
+		int	allow;
+
+		pace_now = gethrtime();
+		if (pace_now < tcp->tcp_pace_next) {
+			tcp_pace_schedule(tcp, tcp->tcp_pace_next);
+			goto done;
+		}
+		allow = tcp_pace_allowance(tcp, mss, rate, pace_now);
+		if (usable > allow) {
+			usable = allow;
+			pace_more = B_TRUE;
+		}
+	}
+
 	local_time = (mblk_t *)now;
 
 	/*
@@ -551,6 +578,12 @@ done:;
 	}
 	/* Note that len is the amount we just sent but with a negative sign */
 	tcp->tcp_unsent += len;
+	if (len != 0) {
+		if (rate != 0)
+			tcp_pace_sent(tcp, -len, rate, pace_now, pace_more);
+		else
+			TCP_STAT_UPDATE(tcps, tcp_out_burst_bytes, -len);
+	}
 	mutex_enter(&tcp->tcp_non_sq_lock);
 	if (tcp->tcp_flow_stopped) {
 		if (TCP_UNSENT_BYTES(tcp) <= connp->conn_sndlowat) {
@@ -1145,9 +1178,11 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	 *   4. data in mblk
 	 *   5. len <= mss
 	 *   6. no tcp_valid bits
+	 *   7. not paced
 	 */
 	if ((tcp->tcp_unsent != 0) ||
 	    (tcp->tcp_cork) ||
+	    TCP_PACED(tcp) ||
 	    (mp->b_cont != NULL) ||
 	    (tcp->tcp_state != TCPS_ESTABLISHED) ||
 	    (len == 0) ||
@@ -1193,6 +1228,7 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	if ((tcp->tcp_suna == snxt) && !tcp->tcp_localnet &&
 	    (TICK_TO_MSEC(now - tcp->tcp_last_recv_time) >= tcp->tcp_rto)) {
 		TCP_SET_INIT_CWND(tcp, mss, tcps->tcps_slow_start_after_idle);
+		TCP_CC_CALL(tcp, cc_after_idle);
 	}
 
 	usable = tcp->tcp_swnd;		/* tcp window size */
@@ -1270,6 +1306,7 @@ tcp_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 
 	TCPS_BUMP_MIB(tcps, tcpOutDataSegs);
 	TCPS_UPDATE_MIB(tcps, tcpOutDataBytes, len);
+	TCP_STAT_UPDATE(tcps, tcp_out_burst_bytes, len);
 	BUMP_LOCAL(tcp->tcp_obsegs);
 
 	/* Update the latest receive window size in TCP header. */
@@ -1690,6 +1727,10 @@ tcp_shutdown_output(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
 	if (tcp->tcp_fused)
 		tcp_unfuse(tcp);
 
+	/* A TCP Fast Open SYN still waiting for data can't wait any more */
+	if (tcp->tcp_tfo_deferred)
+		tcp_fastopen_send_syn(tcp);
+
 	if (tcp_xmit_end(tcp) != 0) {
 		/*
 		 * We were crossing FINs and got a reset from
@@ -2443,6 +2484,28 @@ tcp_xmit_ctl(char *str, tcp_t *tcp, uint32_t seq, uint32_t ack, int ctl)
 static void
 tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
     ip_recv_attr_t *ira, ip_stack_t *ipst, conn_t *connp)
+{
+	tcp_stack_t	*tcps = ipst->ips_netstack->netstack_tcp;
+
+	if (!tcp_send_rst_chk(tcps)) {
+		TCP_STAT(tcps, tcp_rst_unsent);
+		freemsg(mp);
+		return;
+	}
+	tcp_xmit_reply(str, mp, seq, ack, ctl, 0, NULL, ira, ipst, connp);
+}
+
+/*
+ * Reply to an inbound packet with a segment with no data, with the given
+ * sequence numbers, flags and window.  If tsecr is not NULL, the segment
+ * carries a timestamp option echoing it.  This is what tcp_xmit_early_reset()
+ * sends, and what a connection which is only a TIME_WAIT record (see
+ * tcp_time_wait.c) uses to answer segments.  The IPsec note above applies.
+ */
+void
+tcp_xmit_reply(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
+    uint16_t win, const uint32_t *tsecr, ip_recv_attr_t *ira,
+    ip_stack_t *ipst, conn_t *connp)
 {
 	ipha_t		*ipha = NULL;
 	ip6_t		*ip6h = NULL;
@@ -2458,12 +2521,6 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 	boolean_t	need_refrele = B_FALSE;		/* ixa_refrele(ixa) */
 	ushort_t	port;
 
-	if (!tcp_send_rst_chk(tcps)) {
-		TCP_STAT(tcps, tcp_rst_unsent);
-		freemsg(mp);
-		return;
-	}
-
 	/*
 	 * If connp != NULL we use conn_ixa to keep IP_NEXTHOP and other
 	 * options from the listener. In that case the caller must ensure that
@@ -2500,7 +2557,7 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 
 	if (str && tcps->tcps_dbg) {
 		(void) strlog(TCP_MOD_ID, 0, 1, SL_TRACE,
-		    "tcp_xmit_early_reset: '%s', seq 0x%x, ack 0x%x, "
+		    "tcp_xmit_reply: '%s', seq 0x%x, ack 0x%x, "
 		    "flags 0x%x",
 		    str, seq, ack, ctl);
 	}
@@ -2568,6 +2625,19 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 	}
 	tcpha->tha_offset_and_reserved = (5 << 4);
 	len = ip_hdr_len + sizeof (tcpha_t);
+	if (tsecr != NULL &&
+	    DB_LIM(mp) - mp->b_rptr >= len + TCPOPT_REAL_TS_LEN) {
+		uint8_t *wptr = &mp->b_rptr[len];
+
+		wptr[0] = TCPOPT_NOP;
+		wptr[1] = TCPOPT_NOP;
+		wptr[2] = TCPOPT_TSTAMP;
+		wptr[3] = TCPOPT_TSTAMP_LEN;
+		U32_TO_BE32((uint32_t)LBOLT_FASTPATH, wptr + 4);
+		U32_TO_BE32(*tsecr, wptr + 8);
+		tcpha->tha_offset_and_reserved += (3 << 4);
+		len += TCPOPT_REAL_TS_LEN;
+	}
 	mp->b_wptr = &mp->b_rptr[len];
 	if (IPH_HDR_VERSION(mp->b_rptr) == IPV4_VERSION) {
 		ipha->ipha_length = htons(len);
@@ -2603,8 +2673,8 @@ tcp_xmit_early_reset(char *str, mblk_t *mp, uint32_t seq, uint32_t ack, int ctl,
 
 	tcpha->tha_ack = htonl(ack);
 	tcpha->tha_seq = htonl(seq);
-	tcpha->tha_win = 0;
-	tcpha->tha_sum = htons(sizeof (tcpha_t));
+	tcpha->tha_win = htons(win);
+	tcpha->tha_sum = htons(len - ip_hdr_len);
 	tcpha->tha_flags = (uint8_t)ctl;
 	if (ctl & TH_RST) {
 		if (ctl & TH_ACK) {
@@ -2688,8 +2758,6 @@ tcp_xmit_listeners_reset(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst,
 	ipsec_stack_t	*ipss = tcps->tcps_netstack->netstack_ipsec;
 	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
 
-	TCP_STAT(tcps, tcp_no_listener);
-
 	/*
 	 * DTrace this "unknown" segment as a tcp:::receive, as we did
 	 * just receive something that was TCP.
@@ -2718,8 +2786,13 @@ tcp_xmit_listeners_reset(mblk_t *mp, ip_recv_attr_t *ira, ip_stack_t *ipst,
 		if (mp == NULL)
 			return;
 	}
-	rptr = mp->b_rptr;
 
+	/* It may be for a connection which is only a TIME_WAIT record. */
+	if (tcp_time_wait_input(mp, ira, tcps, NULL))
+		return;
+	TCP_STAT(tcps, tcp_no_listener);
+
+	rptr = mp->b_rptr;
 	tcpha = (tcpha_t *)&rptr[ip_hdr_len];
 	seg_seq = ntohl(tcpha->tha_seq);
 	seg_ack = ntohl(tcpha->tha_ack);
@@ -2764,17 +2837,24 @@ tcp_xmit_mp_aux_iss(tcp_t *tcp, conn_t *connp, tcpha_t *tcpha, mblk_t *mp,
 	uint8_t	*wptr = mp->b_wptr;
 	tcp_stack_t *tcps = tcp->tcp_tcps;
 	boolean_t add_sack = B_FALSE;
+	int32_t state = tcp->tcp_state;
 
 	/*
 	 * If TCP_ISS_VALID and the seq number is tcp_iss,
 	 * TCP can only be in SYN-SENT, SYN-RCVD or
 	 * FIN-WAIT-1 state.  It can be FIN-WAIT-1 if
 	 * our SYN is not ack'ed but the app closes this
-	 * TCP connection.
+	 * TCP connection.  An eager that took the data
+	 * in a TCP Fast Open SYN is ESTABLISHED before
+	 * its SYN-ACK is acked, and sends it as if it
+	 * were still in SYN-RCVD.
 	 */
 	ASSERT(tcp->tcp_state == TCPS_SYN_SENT ||
 	    tcp->tcp_state == TCPS_SYN_RCVD ||
-	    tcp->tcp_state == TCPS_FIN_WAIT_1);
+	    tcp->tcp_state == TCPS_FIN_WAIT_1 ||
+	    tcp->tcp_tfo_accepted);
+	if (tcp->tcp_tfo_accepted)
+		state = TCPS_SYN_RCVD;
 
 	/*
 	 * Tack on the MSS option.  It is always needed
@@ -2806,7 +2886,7 @@ tcp_xmit_mp_aux_iss(tcp_t *tcp, conn_t *connp, tcpha_t *tcpha, mblk_t *mp,
 	/* Update the offset to cover the additional word */
 	tcpha->tha_offset_and_reserved += (1 << 4);
 
-	switch (tcp->tcp_state) {
+	switch (state) {
 	case TCPS_SYN_SENT:
 		*flags = TH_SYN;
 
@@ -2930,6 +3010,13 @@ tcp_xmit_mp_aux_iss(tcp_t *tcp, conn_t *connp, tcpha_t *tcpha, mblk_t *mp,
 		tcpha->tha_offset_and_reserved += (1 << 4);
 	}
 
+	if (tcp->tcp_tfo_active) {
+		u1 = tcp_fastopen_opt(tcp, state, wptr,
+		    TCP_MAX_HDR_LENGTH - (wptr - (uint8_t *)tcpha));
+		wptr += u1;
+		tcpha->tha_offset_and_reserved += (u1 >> 2) << 4;
+	}
+
 	mp->b_wptr = wptr;
 	u1 = (int)(mp->b_wptr - mp->b_rptr);
 	/*
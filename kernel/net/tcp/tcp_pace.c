@@ -0,0 +1,364 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP pacing.
+ *
+ * Left alone, tcp_wput_data() sends all the data the windows allow as soon
+ * as an ACK opens them, in LSO chains of up to tcp_lso_max bytes each.  On
+ * a path to a slower link, such bursts have to be absorbed by the buffers
+ * of the switch in front of that link, and get dropped when they don't
+ * fit.  A paced connection spreads its output over time instead: after
+ * sending n bytes at rate r, it sends nothing more until n / r later, and
+ * it sends at most one quantum (about a millisecond of data at rate r) at
+ * a time.
+ *
+ * The rate is the one that sends tcp_cwnd over one smoothed RTT, scaled by
+ * tcp_pace_ss_ratio in slow start (so that tcp_cwnd can still double every
+ * round trip) and by tcp_pace_ca_ratio afterwards.  It is capped by the
+ * SO_MAX_PACING_RATE socket option, which also turns pacing on for the
+ * connection when the TCP "_pacing" property is off.  Until the connection
+ * has an RTT sample, only the SO_MAX_PACING_RATE cap applies.  RTT samples
+ * have clock tick resolution: on paths whose RTT is below a tick, the rate
+ * is high enough that only the quantum limits the bursts.
+ *
+ * Retransmissions, window probes and urgent data are not paced.
+ *
+ * A connection that has to wait is put on the pacing wheel of its squeue,
+ * rather than getting a callout of its own: like the TIME_WAIT collector,
+ * each squeue has a single callout, armed for the earliest slot of the
+ * wheel that has connections in it.  When the callout fires, the connections
+ * due are sent back to their squeue (through tcp_pace_mp), where
+ * tcp_pace_resume() calls tcp_wput_data() again.
+ *
+ * The wheel has TCP_PACE_SLOTS slots of 2^TCP_PACE_SHIFT ns.  A connection
+ * due at tick t (gethrtime() >> TCP_PACE_SHIFT) is kept in slot t modulo
+ * TCP_PACE_SLOTS.  Deadlines further away than the wheel spans are pulled
+ * in; the connection just checks again when woken up.  tcp_pace_last is
+ * the first tick the collector has not gone through yet: a connection is
+ * never put in a slot the collector has already passed.
+ *
+ * A connection on the wheel (TCP_PACE_QUEUED) holds a reference on its
+ * conn_t, which is passed on to the squeue when the collector sends it there
+ * (TCP_PACE_RUNNING), or dropped by tcp_pace_cancel().  tcp_pace_lock
+ * protects the wheel, and the tcp_pace_state and wheel linkage of the
+ * connections; everything else is protected by the squeue.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/time.h>
+#include <sys/strsun.h>
+#include <sys/squeue_impl.h>
+#include <sys/squeue.h>
+#include <sys/callo.h>
+
+#include <inet/common.h>
+#include <inet/ip.h>
+#include <inet/tcp.h>
+#include <inet/tcp_impl.h>
+
+/* In percent of tcp_cwnd per smoothed RTT */
+uint_t tcp_pace_ss_ratio = 200;
+uint_t tcp_pace_ca_ratio = 120;
+
+/* Time worth of data sent at once, in us, and its limit in bytes. */
+uint_t tcp_pace_quantum_us = 1000;
+uint_t tcp_pace_quantum_max = 128 * 1024;
+
+#define	TCP_PACE_TICK(t)	((t) >> TCP_PACE_SHIFT)
+#define	TCP_PACE_TICK_TO_NSEC(t) ((hrtime_t)(t) << TCP_PACE_SHIFT)
+#define	TCP_PACE_SLOT(t)	((t) & (TCP_PACE_SLOTS - 1))
+
+#define	TCP_PACE_TSP(sqp)						\
+	(*((tcp_squeue_priv_t **)squeue_getprivate((sqp), SQPRIVATE_TCP)))
+
+/*
+ * Arm the callout of the wheel for tick.  Returns the callout it replaces,
+ * for the caller to cancel after dropping tcp_pace_lock.
+ */
+static callout_id_t
+tcp_pace_arm(squeue_t *sqp, tcp_squeue_priv_t *tsp, int64_t tick)
+{
+	callout_id_t	old_tid = tsp->tcp_pace_tid;
+
+	ASSERT(MUTEX_HELD(&tsp->tcp_pace_lock));
+
+	tsp->tcp_pace_schedule = tick;
+	tsp->tcp_pace_tid = timeout_generic(CALLOUT_NORMAL,
+	    tcp_pace_collector, sqp, TCP_PACE_TICK_TO_NSEC(tick),
+	    TCP_PACE_TICK_TO_NSEC(1),
+	    CALLOUT_FLAG_ABSOLUTE | CALLOUT_FLAG_ROUNDUP);
+	return (old_tid);
+}
+
+static void
+tcp_pace_remove(tcp_squeue_priv_t *tsp, tcp_t *tcp)
+{
+	ASSERT(MUTEX_HELD(&tsp->tcp_pace_lock));
+	ASSERT(tcp->tcp_pace_state == TCP_PACE_QUEUED);
+
+	if (tcp->tcp_pace_wprev != NULL) {
+		tcp->tcp_pace_wprev->tcp_pace_wnext = tcp->tcp_pace_wnext;
+	} else {
+		ASSERT(tsp->tcp_pace_wheel[TCP_PACE_SLOT(
+		    tcp->tcp_pace_tick)] == tcp);
+		tsp->tcp_pace_wheel[TCP_PACE_SLOT(tcp->tcp_pace_tick)] =
+		    tcp->tcp_pace_wnext;
+	}
+	if (tcp->tcp_pace_wnext != NULL)
+		tcp->tcp_pace_wnext->tcp_pace_wprev = tcp->tcp_pace_wprev;
+	tcp->tcp_pace_wnext = NULL;
+	tcp->tcp_pace_wprev = NULL;
+	tcp->tcp_pace_state = TCP_PACE_IDLE;
+	tsp->tcp_pace_cnt--;
+}
+
+/*
+ * The pacing rate of the connection in bytes per second, or 0 if it is not
+ * paced.
+ */
+uint64_t
+tcp_pace_rate(tcp_t *tcp)
+{
+	uint64_t	rate, max = tcp->tcp_pace_max_rate;
+	uint_t		ratio;
+
+	if (!TCP_PACED(tcp))
+		return (0);
+
+	if (tcp->tcp_rtt_update == 0 || tcp->tcp_rtt_sa == 0)
+		return (max);
+
+	ratio = (tcp->tcp_cwnd < tcp->tcp_cwnd_ssthresh) ?
+	    tcp_pace_ss_ratio : tcp_pace_ca_ratio;
+
+	/* tcp_rtt_sa is 8 times the smoothed RTT in ms. */
+	rate = (uint64_t)tcp->tcp_cwnd * 8 * MILLISEC * ratio / 100 /
+	    tcp->tcp_rtt_sa;
+	if (max != 0)
+		rate = MIN(rate, max);
+	return (MAX(rate, 1));
+}
+
+/*
+ * How much tcp_wput_data() may send now, tcp_pace_next being past: one
+ * quantum, plus what the rate allowed since tcp_pace_next if we are late,
+ * in whole segments.
+ */
+int
+tcp_pace_allowance(tcp_t *tcp, int32_t mss, uint64_t rate, hrtime_t now)
+{
+	uint64_t	late, allow;
+
+	ASSERT(now >= tcp->tcp_pace_next);
+
+	late = MIN(NSEC2USEC(now - tcp->tcp_pace_next), tcp_pace_quantum_us);
+	allow = rate * (tcp_pace_quantum_us + late) / MICROSEC;
+	allow = MIN(allow, tcp_pace_quantum_max);
+	return ((int)MAX(allow / mss, 1) * mss);
+}
+
+/*
+ * tcp_wput_data() sent bytes of new data at rate: push tcp_pace_next back
+ * accordingly, and if there is more to send, come back then.
+ */
+void
+tcp_pace_sent(tcp_t *tcp, uint32_t bytes, uint64_t rate, hrtime_t now,
+    boolean_t more)
+{
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	hrtime_t	since;
+
+	/* Don't let an idle connection save up the time for a burst. */
+	since = MAX(tcp->tcp_pace_next,
+	    now - USEC2NSEC((hrtime_t)tcp_pace_quantum_us));
+	tcp->tcp_pace_next = since + (hrtime_t)(bytes * NANOSEC / rate);
+	TCP_STAT_UPDATE(tcps, tcp_out_paced_bytes, bytes);
+
+	if (more)
+		tcp_pace_schedule(tcp, tcp->tcp_pace_next);
+}
+
+/*
+ * Put the connection on the pacing wheel of its squeue, to call
+ * tcp_wput_data() again at time when.  Called from the squeue.
+ */
+void
+tcp_pace_schedule(tcp_t *tcp, hrtime_t when)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	squeue_t	*sqp = connp->conn_sqp;
+	tcp_squeue_priv_t *tsp = TCP_PACE_TSP(sqp);
+	callout_id_t	old_tid;
+	int64_t		now, tick;
+	tcp_t		**slotp;
+
+	mutex_enter(&tsp->tcp_pace_lock);
+
+	/*
+	 * If the connection is on the wheel already, it is due at the
+	 * previous tcp_pace_next at the latest.  Either way, it will call
+	 * tcp_wput_data() again, which puts it back on the wheel as needed.
+	 */
+	if (tcp->tcp_pace_state != TCP_PACE_IDLE) {
+		mutex_exit(&tsp->tcp_pace_lock);
+		return;
+	}
+
+	now = TCP_PACE_TICK(gethrtime());
+	if (tsp->tcp_pace_cnt == 0 && tsp->tcp_pace_last <= now)
+		tsp->tcp_pace_last = now;
+
+	/* Round up, so as not to wake up before when. */
+	tick = TCP_PACE_TICK(when + TCP_PACE_TICK_TO_NSEC(1) - 1);
+	tick = MIN(tick, now + TCP_PACE_SLOTS - 1);
+	tick = MAX(tick, tsp->tcp_pace_last);
+
+	slotp = &tsp->tcp_pace_wheel[TCP_PACE_SLOT(tick)];
+	tcp->tcp_pace_tick = tick;
+	tcp->tcp_pace_wprev = NULL;
+	tcp->tcp_pace_wnext = *slotp;
+	if (*slotp != NULL)
+		(*slotp)->tcp_pace_wprev = tcp;
+	*slotp = tcp;
+	tcp->tcp_pace_state = TCP_PACE_QUEUED;
+	tsp->tcp_pace_cnt++;
+	CONN_INC_REF(connp);
+	TCP_STAT(tcp->tcp_tcps, tcp_pace_delayed);
+
+	if (tsp->tcp_pace_schedule == 0 || tick < tsp->tcp_pace_schedule) {
+		old_tid = tcp_pace_arm(sqp, tsp, tick);
+		mutex_exit(&tsp->tcp_pace_lock);
+		/*
+		 * The old callout may fire before it is cancelled; the
+		 * collector copes with callouts that are no longer current.
+		 */
+		if (old_tid != 0)
+			(void) untimeout_default(old_tid, 0);
+		return;
+	}
+	mutex_exit(&tsp->tcp_pace_lock);
+}
+
+/*
+ * Take the connection off the pacing wheel, when it is closed or reused.
+ * Called from the squeue.
+ */
+void
+tcp_pace_cancel(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_squeue_priv_t *tsp = TCP_PACE_TSP(connp->conn_sqp);
+
+	mutex_enter(&tsp->tcp_pace_lock);
+	if (tcp->tcp_pace_state != TCP_PACE_QUEUED) {
+		mutex_exit(&tsp->tcp_pace_lock);
+		return;
+	}
+	tcp_pace_remove(tsp, tcp);
+	mutex_exit(&tsp->tcp_pace_lock);
+	CONN_DEC_REF(connp);
+}
+
+/*
+ * Squeue callback: the connection is due to send again.
+ */
+/* ARGSUSED */
+static void
+tcp_pace_resume(void *arg, mblk_t *mp, void *arg2, ip_recv_attr_t *dummy)
+{
+	conn_t		*connp = (conn_t *)arg;
+	tcp_t		*tcp = connp->conn_tcp;
+	tcp_squeue_priv_t *tsp = TCP_PACE_TSP((squeue_t *)arg2);
+
+	ASSERT(mp == &tcp->tcp_pace_mp);
+
+	mutex_enter(&tsp->tcp_pace_lock);
+	ASSERT(tcp->tcp_pace_state == TCP_PACE_RUNNING);
+	tcp->tcp_pace_state = TCP_PACE_IDLE;
+	mutex_exit(&tsp->tcp_pace_lock);
+
+	/* The connection may have been closed or reused in the meantime. */
+	if (tcp->tcp_state < TCPS_ESTABLISHED || tcp->tcp_fused ||
+	    tcp->tcp_unsent == 0)
+		return;
+
+	TCP_STAT(tcp->tcp_tcps, tcp_pace_wakeups);
+	tcp_wput_data(tcp, NULL, B_FALSE);
+}
+
+/*
+ * Callout of the pacing wheel of an squeue: send the connections that are
+ * due back to the squeue, and re-arm for the next ones.
+ */
+void
+tcp_pace_collector(void *arg)
+{
+	squeue_t	*sqp = (squeue_t *)arg;
+	tcp_squeue_priv_t *tsp = TCP_PACE_TSP(sqp);
+	tcp_t		*tcp;
+	int64_t		now, tick, end;
+	uint_t		slot;
+
+	mutex_enter(&tsp->tcp_pace_lock);
+	now = TCP_PACE_TICK(gethrtime());
+
+	/*
+	 * Go through the ticks from tcp_pace_last to now, or through the
+	 * whole wheel once if we are that late.  Connections put on the wheel
+	 * while tcp_pace_lock is dropped below go to later ticks.
+	 */
+	tick = tsp->tcp_pace_last;
+	end = MIN(now, tick + TCP_PACE_SLOTS - 1);
+	if (tsp->tcp_pace_last <= now)
+		tsp->tcp_pace_last = now + 1;
+
+	for (; tick <= end && tsp->tcp_pace_cnt != 0; tick++) {
+		slot = TCP_PACE_SLOT(tick);
+again:
+		for (tcp = tsp->tcp_pace_wheel[slot]; tcp != NULL;
+		    tcp = tcp->tcp_pace_wnext) {
+			if (tcp->tcp_pace_tick <= now)
+				break;
+		}
+		if (tcp == NULL)
+			continue;
+
+		tcp_pace_remove(tsp, tcp);
+		tcp->tcp_pace_state = TCP_PACE_RUNNING;
+		mutex_exit(&tsp->tcp_pace_lock);
+
+		/* The squeue takes over the reference of the wheel. */
+		SQUEUE_ENTER_ONE(sqp, &tcp->tcp_pace_mp, tcp_pace_resume,
+		    tcp->tcp_connp, NULL, SQ_FILL, SQTAG_TCP_PACE);
+		mutex_enter(&tsp->tcp_pace_lock);
+		goto again;
+	}
+
+	/*
+	 * Re-arm, unless tcp_pace_schedule() already armed a callout for a
+	 * later tick meanwhile.
+	 */
+	if (tsp->tcp_pace_schedule <= now) {
+		tsp->tcp_pace_schedule = 0;
+		tsp->tcp_pace_tid = 0;
+		if (tsp->tcp_pace_cnt != 0) {
+			for (tick = now + 1;
+			    tsp->tcp_pace_wheel[TCP_PACE_SLOT(tick)] == NULL;
+			    tick++)
+				;
+			(void) tcp_pace_arm(sqp, tsp, tick);
+		}
+	}
+	mutex_exit(&tsp->tcp_pace_lock);
+}
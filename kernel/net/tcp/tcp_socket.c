@@ -69,6 +69,7 @@ static void	tcp_clr_flowctrl(sock_lower_handle_t);
 static int	tcp_ioctl(sock_lower_handle_t, int, intptr_t, int, int32_t *,
 		    cred_t *);
 static int	tcp_close(sock_lower_handle_t, int, cred_t *);
+static void	tcp_rcv_cpu(sock_lower_handle_t, processorid_t);
 
 sock_downcalls_t sock_tcp_downcalls = {
 	tcp_activate,
@@ -88,6 +89,7 @@ sock_downcalls_t sock_tcp_downcalls = {
 	tcp_clr_flowctrl,
 	tcp_ioctl,
 	tcp_close,
+	tcp_rcv_cpu,
 };
 
 /* ARGSUSED */
@@ -301,6 +303,14 @@ tcp_connect(sock_lower_handle_t proto_handle, const struct sockaddr *sa,
 	error = tcp_do_connect(connp, sa, len, cr, curproc->p_pid);
 	if (error == 0) {
 		*id = connp->conn_tcp->tcp_connid;
+		/*
+		 * A TCP Fast Open connect is done once the SYN is ready to
+		 * go with the first data, see tcp_fastopen_connect().
+		 */
+		if (connp->conn_tcp->tcp_tfo_early) {
+			(*connp->conn_upcalls->su_connected)(
+			    connp->conn_upper_handle, *id, NULL, -1);
+		}
 	} else if (error < 0) {
 		if (error == -TOUTSTATE) {
 			switch (connp->conn_tcp->tcp_state) {
@@ -425,6 +435,8 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
     const void *optvalp, socklen_t optlen, cred_t *cr)
 {
 	conn_t		*connp = (conn_t *)proto_handle;
+	cc_algo_t	*algo = NULL;
+	char		name[TCP_CA_NAME_MAX];
 	int		error;
 
 	ASSERT(connp->conn_upper_handle != NULL);
@@ -443,6 +455,19 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
 			    connp->conn_tcp->tcp_mss;
 			mutex_exit(&connp->conn_tcp->tcp_non_sq_lock);
 			return (0);
+		case TCP_CONGESTION:
+			/*
+			 * Loading the module of the algorithm may block, so
+			 * do it before entering the squeue, and keep the
+			 * algorithm held until tcp_opt_set() is done.
+			 */
+			if (optlen == 0 || optlen > TCP_CA_NAME_MAX)
+				return (EINVAL);
+			bcopy(optvalp, name, optlen);
+			name[MIN(optlen, TCP_CA_NAME_MAX - 1)] = '\0';
+			if ((algo = cc_lookup(name, B_TRUE)) == NULL)
+				return (ENOENT);
+			break;
 		default:
 			break;
 		}
@@ -450,6 +475,8 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
 
 	error = squeue_synch_enter(connp, NULL);
 	if (error == ENOMEM) {
+		if (algo != NULL)
+			cc_rele(algo);
 		return (ENOMEM);
 	}
 
@@ -463,6 +490,8 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
 			error = proto_tlitosyserr(-error);
 		}
 		squeue_synch_exit(connp);
+		if (algo != NULL)
+			cc_rele(algo);
 		return (error);
 	}
 
@@ -470,6 +499,8 @@ tcp_setsockopt(sock_lower_handle_t proto_handle, int level, int option_name,
 	    optlen, (uchar_t *)optvalp, (uint_t *)&optlen, (uchar_t *)optvalp,
 	    NULL, cr);
 	squeue_synch_exit(connp);
+	if (algo != NULL)
+		cc_rele(algo);
 
 	ASSERT(error >= 0);
 
@@ -503,7 +534,8 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct msghdr *msg,
 		ASSERT(tcp != NULL);
 
 		tcpstate = tcp->tcp_state;
-		if (tcpstate < TCPS_ESTABLISHED) {
+		if (tcpstate < TCPS_ESTABLISHED &&
+		    !(tcpstate == TCPS_SYN_SENT && tcp->tcp_tfo_early)) {
 			freemsg(mp);
 			/*
 			 * We return ENOTCONN if the endpoint is trying to
@@ -541,6 +573,10 @@ tcp_sendmsg(sock_lower_handle_t proto_handle, mblk_t *mp, struct msghdr *msg,
 		 */
 		CONN_INC_REF(connp);
 
+		/* Where the application runs, see ip_squeue_steer() */
+		if (connp->conn_rfs_cpu != CPU->cpu_id)
+			connp->conn_rfs_cpu = CPU->cpu_id;
+
 		if (msg->msg_flags & MSG_OOB) {
 			SQUEUE_ENTER_ONE(connp->conn_sqp, mp, tcp_output_urgent,
 			    connp, NULL, tcp_squeue_flag, SQTAG_TCP_OUTPUT);
@@ -648,6 +684,18 @@ tcp_clr_flowctrl(sock_lower_handle_t proto_handle)
 	squeue_synch_exit(connp);
 }
 
+/*
+ * sockfs tells us the CPU the application reads the socket on, which the
+ * connection's packets are steered to, see ip_squeue_steer().
+ */
+static void
+tcp_rcv_cpu(sock_lower_handle_t proto_handle, processorid_t cpuid)
+{
+	conn_t	*connp = (conn_t *)proto_handle;
+
+	connp->conn_rfs_cpu = cpuid;
+}
+
 /* ARGSUSED */
 static int
 tcp_ioctl(sock_lower_handle_t proto_handle, int cmd, intptr_t arg,
@@ -230,6 +230,14 @@ tcp_snmp_get(queue_t *q, mblk_t *mpctl, boolean_t legacy_req)
 			    connp->conn_cpid;
 			tce6.tcp6ConnCreationTime = connp->conn_open_time;
 
+			tce6.tcp6ConnCcInfo.cc_cwnd = tcp->tcp_cwnd;
+			tce6.tcp6ConnCcInfo.cc_ssthresh =
+			    tcp->tcp_cwnd_ssthresh;
+			tce6.tcp6ConnCcInfo.cc_srtt = tcp->tcp_rtt_sa >> 3;
+			tce6.tcp6ConnCcInfo.cc_rttvar = tcp->tcp_rtt_sd >> 2;
+			tcp_cc_get_name(tcp, tce6.tcp6ConnCcInfo.cc_algo,
+			    sizeof (tce6.tcp6ConnCcInfo.cc_algo));
+
 			(void) snmp_append_data2(mp6_conn_ctl->b_cont,
 			    &mp6_conn_tail, (char *)&tce6, tce6_size);
 
@@ -293,6 +301,17 @@ tcp_snmp_get(queue_t *q, mblk_t *mpctl, boolean_t legacy_req)
 				    connp->conn_cpid;
 				tce.tcpConnCreationTime = connp->conn_open_time;
 
+				tce.tcpConnCcInfo.cc_cwnd = tcp->tcp_cwnd;
+				tce.tcpConnCcInfo.cc_ssthresh =
+				    tcp->tcp_cwnd_ssthresh;
+				tce.tcpConnCcInfo.cc_srtt =
+				    tcp->tcp_rtt_sa >> 3;
+				tce.tcpConnCcInfo.cc_rttvar =
+				    tcp->tcp_rtt_sd >> 2;
+				tcp_cc_get_name(tcp,
+				    tce.tcpConnCcInfo.cc_algo,
+				    sizeof (tce.tcpConnCcInfo.cc_algo));
+
 				(void) snmp_append_data2(mp_conn_ctl->b_cont,
 				    &mp_conn_tail, (char *)&tce, tce_size);
 			}
@@ -648,6 +667,17 @@ tcp_kstat2_init(netstackid_t stackid)
 		{ "tcp_rst_unsent",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reclaim_cnt",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_reass_timeout",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_out_paced_bytes",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_out_burst_bytes",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_pace_delayed",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_pace_wakeups",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_active",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_accepted",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_failed",		KSTAT_DATA_UINT64, 0 },
+		{ "tcp_fastopen_fallback",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_time_wait_compact",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_time_wait_reuse",	KSTAT_DATA_UINT64, 0 },
+		{ "tcp_rfs_switch",		KSTAT_DATA_UINT64, 0 },
 #ifdef TCP_DEBUG_COUNTER
 		{ "tcp_time_wait",		KSTAT_DATA_UINT64, 0 },
 		{ "tcp_rput_time_wait",		KSTAT_DATA_UINT64, 0 },
@@ -855,6 +885,17 @@ tcp_clr_stats(tcp_stat_t *stats)
 	stats->tcp_rst_unsent.value.ui64 = 0;
 	stats->tcp_reclaim_cnt.value.ui64 = 0;
 	stats->tcp_reass_timeout.value.ui64 = 0;
+	stats->tcp_out_paced_bytes.value.ui64 = 0;
+	stats->tcp_out_burst_bytes.value.ui64 = 0;
+	stats->tcp_pace_delayed.value.ui64 = 0;
+	stats->tcp_pace_wakeups.value.ui64 = 0;
+	stats->tcp_fastopen_active.value.ui64 = 0;
+	stats->tcp_fastopen_accepted.value.ui64 = 0;
+	stats->tcp_fastopen_failed.value.ui64 = 0;
+	stats->tcp_fastopen_fallback.value.ui64 = 0;
+	stats->tcp_time_wait_compact.value.ui64 = 0;
+	stats->tcp_time_wait_reuse.value.ui64 = 0;
+	stats->tcp_rfs_switch.value.ui64 = 0;
 
 #ifdef TCP_DEBUG_COUNTER
 	stats->tcp_time_wait.value.ui64 = 0;
@@ -951,6 +992,28 @@ tcp_add_stats(tcp_stat_counter_t *from, tcp_stat_t *to)
 	    from->tcp_reclaim_cnt;
 	to->tcp_reass_timeout.value.ui64 +=
 	    from->tcp_reass_timeout;
+	to->tcp_out_paced_bytes.value.ui64 +=
+	    from->tcp_out_paced_bytes;
+	to->tcp_out_burst_bytes.value.ui64 +=
+	    from->tcp_out_burst_bytes;
+	to->tcp_pace_delayed.value.ui64 +=
+	    from->tcp_pace_delayed;
+	to->tcp_pace_wakeups.value.ui64 +=
+	    from->tcp_pace_wakeups;
+	to->tcp_fastopen_active.value.ui64 +=
+	    from->tcp_fastopen_active;
+	to->tcp_fastopen_accepted.value.ui64 +=
+	    from->tcp_fastopen_accepted;
+	to->tcp_fastopen_failed.value.ui64 +=
+	    from->tcp_fastopen_failed;
+	to->tcp_fastopen_fallback.value.ui64 +=
+	    from->tcp_fastopen_fallback;
+	to->tcp_time_wait_compact.value.ui64 +=
+	    from->tcp_time_wait_compact;
+	to->tcp_time_wait_reuse.value.ui64 +=
+	    from->tcp_time_wait_reuse;
+	to->tcp_rfs_switch.value.ui64 +=
+	    from->tcp_rfs_switch;
 
 #ifdef TCP_DEBUG_COUNTER
 	to->tcp_time_wait.value.ui64 +=
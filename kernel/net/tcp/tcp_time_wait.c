@@ -42,6 +42,15 @@
 #include <inet/tcp_impl.h>
 
 static void tcp_time_wait_purge(tcp_t *, tcp_squeue_priv_t *);
+static void tcp_time_wait_reap(void *);
+
+/*
+ * Compact TIME_WAIT records, see the comment above tcp_tw_t in tcp_impl.h.
+ * The size of the hash table of each stack can only be changed before the
+ * stack is created, e.g. in /etc/system.
+ */
+kmem_cache_t	*tcp_tw_cache;
+uint_t		tcp_time_wait_fanout_size = 16384;
 
 #define	TW_BUCKET(t)					\
 	(((t) / MSEC_TO_TICK(TCP_TIME_WAIT_DELAY)) % TCP_TIME_WAIT_BUCKETS)
@@ -121,6 +130,125 @@ tcp_time_wait_remove(tcp_t *tcp, tcp_squeue_priv_t *tsp)
 	IN6_IS_ADDR_LOOPBACK(&(x)->tcp_connp->conn_laddr_v6)))
 
 
+/*
+ * Find the record of a 4-tuple.  The lock of its hash bucket, returned in
+ * twfp, is held on return whether there is a record or not.
+ */
+static tcp_tw_t *
+tcp_tw_lookup(tcp_stack_t *tcps, const in6_addr_t *laddr,
+    const in6_addr_t *faddr, uint32_t ports, tcp_tw_fanout_t **twfp)
+{
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+
+	twf = &tcps->tcps_tw_fanout[TCP_TW_HASH(faddr, ports,
+	    tcps->tcps_tw_fanout_size)];
+	mutex_enter(&twf->twf_lock);
+	for (tw = twf->twf_head; tw != NULL; tw = tw->tw_hash_next) {
+		if (TCP_TW_MATCH(tw, laddr, faddr, ports))
+			break;
+	}
+	*twfp = twf;
+	return (tw);
+}
+
+static void
+tcp_tw_unhash(tcp_tw_fanout_t *twf, tcp_tw_t *tw)
+{
+	ASSERT(MUTEX_HELD(&twf->twf_lock));
+	ASSERT(tw->tw_ptphn != NULL);
+
+	if (tw->tw_hash_next != NULL)
+		tw->tw_hash_next->tw_ptphn = tw->tw_ptphn;
+	*tw->tw_ptphn = tw->tw_hash_next;
+	tw->tw_hash_next = NULL;
+	tw->tw_ptphn = NULL;
+}
+
+/*
+ * Put a record at the tail of the list of the stack, and make sure that the
+ * collector is going to run.  Since the record expires last, a callout which
+ * is already there is early enough.
+ */
+static void
+tcp_tw_enqueue(tcp_stack_t *tcps, tcp_tw_t *tw)
+{
+	ASSERT(MUTEX_HELD(&tcps->tcps_tw_lock));
+
+	tw->tw_next = NULL;
+	if (tcps->tcps_tw_tail != NULL)
+		tcps->tcps_tw_tail->tw_next = tw;
+	else
+		tcps->tcps_tw_head = tw;
+	tcps->tcps_tw_tail = tw;
+
+	if (tcps->tcps_tw_tid == 0) {
+		clock_t delay = tw->tw_expire - ddi_get_lbolt64();
+
+		/* Round up so that the collector takes a few at a time. */
+		delay += MSEC_TO_TICK(TCP_TIME_WAIT_DELAY) - 1;
+		delay -= delay % MSEC_TO_TICK(TCP_TIME_WAIT_DELAY);
+		tcps->tcps_tw_tid = timeout(tcp_time_wait_reap, tcps,
+		    MAX(delay, 1));
+	}
+}
+
+/*
+ * Turn a detached TIME_WAIT connection into a record.  Returns B_FALSE if it
+ * has to stay a connection, which the caller then puts on the squeue lists.
+ *
+ * Connections with a per-socket IPsec policy are not made records since the
+ * segments we send from a record only follow the global policy.
+ */
+static boolean_t
+tcp_time_wait_compact(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+	int64_t		now;
+
+	if (!tcps->tcps_time_wait_compact || connp->conn_policy != NULL)
+		return (B_FALSE);
+	if ((tw = kmem_cache_alloc(tcp_tw_cache, KM_NOSLEEP)) == NULL)
+		return (B_FALSE);
+
+	now = ddi_get_lbolt64();
+	tw->tw_created = now;
+	tw->tw_expire = now + MSEC_TO_TICK(tcps->tcps_time_wait_interval);
+	tw->tw_laddr = connp->conn_laddr_v6;
+	tw->tw_faddr = connp->conn_faddr_v6;
+	tw->tw_ports = connp->conn_ports;
+	tw->tw_ipversion = connp->conn_ipversion;
+	tw->tw_snxt = tcp->tcp_snxt;
+	tw->tw_rnxt = tcp->tcp_rnxt;
+	tw->tw_rwnd = tcp->tcp_rwnd;
+	tw->tw_win = MIN(tcp->tcp_rwnd >> tcp->tcp_rcv_ws, TCP_MAXWIN);
+	tw->tw_ts_recent = tcp->tcp_ts_recent;
+	tw->tw_last_rcv_lbolt = tcp->tcp_last_rcv_lbolt;
+	tw->tw_ts_ok = tcp->tcp_snd_ts_ok;
+	tw->tw_restart = 0;
+	tw->tw_pad = 0;
+
+	mutex_enter(&tcps->tcps_tw_lock);
+	twf = &tcps->tcps_tw_fanout[TCP_TW_HASH(&tw->tw_faddr, tw->tw_ports,
+	    tcps->tcps_tw_fanout_size)];
+	mutex_enter(&twf->twf_lock);
+	tw->tw_hash_next = twf->twf_head;
+	if (tw->tw_hash_next != NULL)
+		tw->tw_hash_next->tw_ptphn = &tw->tw_hash_next;
+	tw->tw_ptphn = &twf->twf_head;
+	twf->twf_head = tw;
+	mutex_exit(&twf->twf_lock);
+	tcp_tw_enqueue(tcps, tw);
+	tcps->tcps_tw_cnt++;
+	mutex_exit(&tcps->tcps_tw_lock);
+
+	TCP_STAT(tcps, tcp_time_wait_compact);
+	return (B_TRUE);
+}
+
 /*
  * Add a connection to the list of detached TIME_WAIT connections
  * and set its time to expire.
@@ -162,8 +290,11 @@ tcp_time_wait_append(tcp_t *tcp)
 	 *
 	 * This typically bypasses the tcp_free_list fast path due to squeue
 	 * re-entry for the loopback close operation.
+	 *
+	 * Other connections are normally freed in the same way, leaving only
+	 * a compact record of them behind.
 	 */
-	if (tcp->tcp_loopback) {
+	if (tcp->tcp_loopback || tcp_time_wait_compact(tcp)) {
 		tcp_time_wait_purge(tcp, tsp);
 		mutex_exit(&tsp->tcp_time_wait_lock);
 		return;
@@ -783,3 +914,385 @@ process_ack:
 done:
 	freemsg(mp);
 }
+
+/*
+ * Free the records of a stack which have expired, or put them back on the
+ * list if a duplicate FIN restarted their TIME_WAIT.
+ */
+static void
+tcp_time_wait_reap(void *arg)
+{
+	tcp_stack_t	*tcps = arg;
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+	int64_t		now = ddi_get_lbolt64();
+
+	mutex_enter(&tcps->tcps_tw_lock);
+	tcps->tcps_tw_tid = 0;
+	while ((tw = tcps->tcps_tw_head) != NULL && tw->tw_expire <= now) {
+		tcps->tcps_tw_head = tw->tw_next;
+		if (tcps->tcps_tw_head == NULL)
+			tcps->tcps_tw_tail = NULL;
+
+		twf = &tcps->tcps_tw_fanout[TCP_TW_HASH(&tw->tw_faddr,
+		    tw->tw_ports, tcps->tcps_tw_fanout_size)];
+		mutex_enter(&twf->twf_lock);
+		if (tw->tw_ptphn != NULL && tw->tw_restart) {
+			tw->tw_restart = 0;
+			mutex_exit(&twf->twf_lock);
+			tw->tw_expire = now +
+			    MSEC_TO_TICK(tcps->tcps_time_wait_interval);
+			tcp_tw_enqueue(tcps, tw);
+			continue;
+		}
+		if (tw->tw_ptphn != NULL)
+			tcp_tw_unhash(twf, tw);
+		mutex_exit(&twf->twf_lock);
+
+		kmem_cache_free(tcp_tw_cache, tw);
+		tcps->tcps_tw_cnt--;
+	}
+
+	/* tcp_tw_enqueue() above may have set the callout already. */
+	if (tw != NULL && tcps->tcps_tw_tid == 0) {
+		clock_t delay = tw->tw_expire - now;
+
+		delay += MSEC_TO_TICK(TCP_TIME_WAIT_DELAY) - 1;
+		delay -= delay % MSEC_TO_TICK(TCP_TIME_WAIT_DELAY);
+		tcps->tcps_tw_tid = timeout(tcp_time_wait_reap, tcps,
+		    MAX(delay, 1));
+	}
+	mutex_exit(&tcps->tcps_tw_lock);
+}
+
+/*
+ * Handle a segment which no connection took, in case it is for a connection
+ * which is a TIME_WAIT record.  This is tcp_time_wait_processing() with the
+ * record in place of the tcp_t.  Returns B_TRUE if it was, and mp has been
+ * consumed.
+ *
+ * A SYN which may start a new incarnation of the connection removes the
+ * record and B_FALSE is returned, for the caller to go on as if there had
+ * been none.  issp, if not NULL, is then set to the ISS the new connection
+ * should use.  Following RFC 6191, with timestamps a SYN is acceptable if it
+ * has a newer timestamp than the last segment of the old connection, even if
+ * its sequence number is not beyond the old window.
+ */
+boolean_t
+tcp_time_wait_input(mblk_t *mp, ip_recv_attr_t *ira, tcp_stack_t *tcps,
+    uint32_t *issp)
+{
+	ip_stack_t	*ipst = tcps->tcps_netstack->netstack_ip;
+	uint_t		ip_hdr_len = ira->ira_ip_hdr_length;
+	in6_addr_t	laddr, faddr;
+	tcpha_t		*tcpha;
+	tcp_opt_t	tcpopt;
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+	uint32_t	ports, seg_seq, seg_ack, snxt, rnxt, tsecr;
+	int32_t		gap, rgap;
+	int		seg_len, options = 0;
+	uint_t		flags;
+	uint16_t	win;
+	boolean_t	ts_ok, keepalive;
+
+	if (tcps->tcps_tw_cnt == 0)
+		return (B_FALSE);
+
+	if (IPH_HDR_VERSION(mp->b_rptr) == IPV4_VERSION) {
+		ipha_t *ipha = (ipha_t *)mp->b_rptr;
+
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_dst, &laddr);
+		IN6_IPADDR_TO_V4MAPPED(ipha->ipha_src, &faddr);
+	} else {
+		ip6_t *ip6h = (ip6_t *)mp->b_rptr;
+
+		laddr = ip6h->ip6_dst;
+		faddr = ip6h->ip6_src;
+	}
+	tcpha = (tcpha_t *)&mp->b_rptr[ip_hdr_len];
+	ports = *(uint32_t *)tcpha;
+
+	tw = tcp_tw_lookup(tcps, &laddr, &faddr, ports, &twf);
+	if (tw == NULL) {
+		mutex_exit(&twf->twf_lock);
+		return (B_FALSE);
+	}
+
+	flags = (unsigned int)tcpha->tha_flags & 0xFF;
+	seg_seq = ntohl(tcpha->tha_seq);
+	seg_ack = ntohl(tcpha->tha_ack);
+	seg_len = msgdsize(mp) - (TCP_HDR_LENGTH(tcpha) + ip_hdr_len);
+	if (!(flags & TH_RST)) {
+		tcpopt.tcp = NULL;
+		options = tcp_parse_options(tcpha, &tcpopt);
+	}
+
+	keepalive = (flags == TH_ACK) && (seg_len == 0 || seg_len == 1) &&
+	    (seg_seq + 1 == tw->tw_rnxt);
+	if (tw->tw_ts_ok && !(flags & TH_RST) && !keepalive) {
+		if (!(options & TCP_OPT_TSTAMP_PRESENT))
+			goto drop;
+		if (TSTMP_LT(tcpopt.tcp_opt_ts_val, tw->tw_ts_recent)) {
+			if (LBOLT_FASTPATH64 <
+			    tw->tw_last_rcv_lbolt + PAWS_TIMEOUT)
+				goto ack;
+			tw->tw_ts_recent = tcpopt.tcp_opt_ts_val;
+		}
+	}
+
+	gap = seg_seq - tw->tw_rnxt;
+	rgap = tw->tw_rwnd - (gap + seg_len);
+	if ((flags & TH_SYN) && ((gap > 0 && rgap < 0) ||
+	    (tw->tw_ts_ok && (options & TCP_OPT_TSTAMP_PRESENT) &&
+	    TSTMP_LT(tw->tw_ts_recent, tcpopt.tcp_opt_ts_val)))) {
+		/*
+		 * Make sure that when we accept the connection, the new ISS
+		 * is greater than tw_snxt by at least 32768, but clear the MSB
+		 * so that SEQ_LT(tw_snxt, iss).
+		 */
+		snxt = tw->tw_snxt;
+		tcp_tw_unhash(twf, tw);
+		mutex_exit(&twf->twf_lock);
+		if (issp != NULL) {
+			uint32_t new_iss;
+
+			random_get_pseudo_bytes((uint8_t *)&new_iss,
+			    sizeof (new_iss));
+			new_iss &= 0x7fffffff;
+			new_iss |= 0x8000;
+			*issp = new_iss + snxt;
+		}
+		TCP_STAT(tcps, tcp_time_wait_syn_success);
+		return (B_FALSE);
+	}
+
+	if (gap < 0) {
+		TCPS_BUMP_MIB(tcps, tcpInDataDupSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataDupBytes,
+		    (seg_len > -gap ? -gap : seg_len));
+		seg_len += gap;
+		if (seg_len < 0 || (seg_len == 0 && !(flags & TH_FIN))) {
+			if (flags & TH_RST)
+				goto drop;
+			if ((flags & TH_FIN) && seg_len == -1) {
+				/*
+				 * A duplicate FIN restarts the 2 MSL timer,
+				 * see tcp_time_wait_reap().
+				 */
+				tw->tw_restart = 1;
+			}
+			goto ack;
+		}
+		seg_seq = tw->tw_rnxt;
+	}
+
+	if (rgap < 0) {
+		TCPS_BUMP_MIB(tcps, tcpInDataPastWinSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataPastWinBytes, -rgap);
+		seg_len += rgap;
+		if (seg_len <= 0) {
+			if (flags & TH_RST)
+				goto drop;
+			goto ack;
+		}
+	}
+
+	if (tw->tw_ts_ok && (options & TCP_OPT_TSTAMP_PRESENT) &&
+	    TSTMP_GEQ(tcpopt.tcp_opt_ts_val, tw->tw_ts_recent) &&
+	    SEQ_LEQ(seg_seq, tw->tw_rnxt)) {
+		tw->tw_ts_recent = tcpopt.tcp_opt_ts_val;
+		tw->tw_last_rcv_lbolt = LBOLT_FASTPATH64;
+	}
+
+	if (seg_seq != tw->tw_rnxt && seg_len > 0) {
+		/* Always ack out of order packets */
+		goto ack;
+	} else if (seg_len > 0) {
+		TCPS_BUMP_MIB(tcps, tcpInClosed);
+		TCPS_BUMP_MIB(tcps, tcpInDataInorderSegs);
+		TCPS_UPDATE_MIB(tcps, tcpInDataInorderBytes, seg_len);
+	}
+	if (flags & TH_RST) {
+		tcp_tw_unhash(twf, tw);
+		goto drop;
+	}
+	if (flags & TH_SYN) {
+		/* See RFC 1122, 4.2.2.13. */
+		mutex_exit(&twf->twf_lock);
+		tcp_xmit_reply("TH_SYN", mp, seg_ack, seg_seq + 1,
+		    TH_RST | TH_ACK, 0, NULL, ira, ipst, NULL);
+		return (B_TRUE);
+	}
+	/* Acks something not sent */
+	if ((flags & TH_ACK) && (int)(seg_ack - tw->tw_snxt) > 0)
+		goto ack;
+drop:
+	mutex_exit(&twf->twf_lock);
+	freemsg(mp);
+	return (B_TRUE);
+
+ack:
+	snxt = tw->tw_snxt;
+	rnxt = tw->tw_rnxt;
+	win = tw->tw_win;
+	tsecr = tw->tw_ts_recent;
+	ts_ok = tw->tw_ts_ok;
+	mutex_exit(&twf->twf_lock);
+
+	TCPS_BUMP_MIB(tcps, tcpOutAck);
+	tcp_xmit_reply(NULL, mp, snxt, rnxt, TH_ACK, win,
+	    ts_ok ? &tsecr : NULL, ira, ipst, NULL);
+	return (B_TRUE);
+}
+
+/*
+ * Check that an outgoing connection does not clash with a TIME_WAIT record.
+ * Like Linux does with tcp_tw_reuse, the record is given up to the connection
+ * if it is at least a second old and had timestamps: the timestamps of the
+ * new connection are then newer than any segment of the old one, and its
+ * ISS is chosen beyond the old sequence space.  Returns 0 or EADDRINUSE.
+ */
+int
+tcp_time_wait_connect(tcp_t *tcp)
+{
+	conn_t		*connp = tcp->tcp_connp;
+	tcp_stack_t	*tcps = tcp->tcp_tcps;
+	tcp_tw_fanout_t	*twf;
+	tcp_tw_t	*tw;
+	int		error = 0;
+
+	if (tcps->tcps_tw_cnt == 0)
+		return (0);
+
+	tw = tcp_tw_lookup(tcps, &connp->conn_laddr_v6, &connp->conn_faddr_v6,
+	    connp->conn_ports, &twf);
+	if (tw != NULL) {
+		if (tcps->tcps_time_wait_reuse && tw->tw_ts_ok &&
+		    ddi_get_lbolt64() - tw->tw_created >= SEC_TO_TICK(1)) {
+			tcp->tcp_iss = tw->tw_snxt + TCP_MAXWIN + 2;
+			tcp_tw_unhash(twf, tw);
+			TCP_STAT(tcps, tcp_time_wait_reuse);
+		} else {
+			error = EADDRINUSE;
+		}
+	}
+	mutex_exit(&twf->twf_lock);
+	return (error);
+}
+
+typedef struct tcp_tw_kstat_s {
+	kstat_named_t	tk_records;
+	kstat_named_t	tk_record_bytes;
+	kstat_named_t	tk_hash_bytes;
+} tcp_tw_kstat_t;
+
+static int
+tcp_time_wait_kstat_update(kstat_t *ksp, int rw)
+{
+	tcp_tw_kstat_t	*tk = ksp->ks_data;
+	netstackid_t	stackid = (netstackid_t)(uintptr_t)ksp->ks_private;
+	netstack_t	*ns;
+	tcp_stack_t	*tcps;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	ns = netstack_find_by_stackid(stackid);
+	if (ns == NULL)
+		return (-1);
+	tcps = ns->netstack_tcp;
+	if (tcps == NULL) {
+		netstack_rele(ns);
+		return (-1);
+	}
+
+	tk->tk_records.value.ui64 = tcps->tcps_tw_cnt;
+	tk->tk_record_bytes.value.ui64 =
+	    (uint64_t)tcps->tcps_tw_cnt * sizeof (tcp_tw_t);
+	tk->tk_hash_bytes.value.ui64 =
+	    (uint64_t)tcps->tcps_tw_fanout_size * sizeof (tcp_tw_fanout_t);
+
+	netstack_rele(ns);
+	return (0);
+}
+
+/*
+ * Set up the TIME_WAIT records of a stack, and the "time_wait" kstat which
+ * tells how much memory they use.
+ */
+void
+tcp_time_wait_init(tcp_stack_t *tcps)
+{
+	netstackid_t	stackid = tcps->tcps_netstack->netstack_stackid;
+	tcp_tw_kstat_t	template = {
+		{ "records",		KSTAT_DATA_UINT64, 0 },
+		{ "record_bytes",	KSTAT_DATA_UINT64, 0 },
+		{ "hash_bytes",		KSTAT_DATA_UINT64, 0 },
+	};
+	kstat_t		*ksp;
+	uint_t		i;
+
+	tcps->tcps_tw_fanout_size = MAX(tcp_time_wait_fanout_size, 1);
+	tcps->tcps_tw_fanout = kmem_zalloc(tcps->tcps_tw_fanout_size *
+	    sizeof (tcp_tw_fanout_t), KM_SLEEP);
+	for (i = 0; i < tcps->tcps_tw_fanout_size; i++) {
+		mutex_init(&tcps->tcps_tw_fanout[i].twf_lock, NULL,
+		    MUTEX_DEFAULT, NULL);
+	}
+	mutex_init(&tcps->tcps_tw_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	ksp = kstat_create_netstack(TCP_MOD_NAME, stackid, "time_wait", "net",
+	    KSTAT_TYPE_NAMED, sizeof (template) / sizeof (kstat_named_t), 0,
+	    stackid);
+	if (ksp == NULL)
+		return;
+
+	bcopy(&template, ksp->ks_data, sizeof (template));
+	ksp->ks_private = (void *)(uintptr_t)stackid;
+	ksp->ks_update = tcp_time_wait_kstat_update;
+	if (stackid != GLOBAL_NETSTACKID)
+		kstat_zone_add(ksp, GLOBAL_ZONEID);
+	kstat_install(ksp);
+	tcps->tcps_tw_kstat = ksp;
+}
+
+void
+tcp_time_wait_fini(tcp_stack_t *tcps)
+{
+	netstackid_t	stackid = tcps->tcps_netstack->netstack_stackid;
+	timeout_id_t	tid;
+	tcp_tw_t	*tw;
+	uint_t		i;
+
+	if (tcps->tcps_tw_kstat != NULL) {
+		kstat_delete_netstack(tcps->tcps_tw_kstat, stackid);
+		tcps->tcps_tw_kstat = NULL;
+	}
+
+	/* The collector may set a new callout while we wait for it. */
+	for (;;) {
+		mutex_enter(&tcps->tcps_tw_lock);
+		tid = tcps->tcps_tw_tid;
+		tcps->tcps_tw_tid = 0;
+		mutex_exit(&tcps->tcps_tw_lock);
+		if (tid == 0)
+			break;
+		(void) untimeout(tid);
+	}
+
+	while ((tw = tcps->tcps_tw_head) != NULL) {
+		tcps->tcps_tw_head = tw->tw_next;
+		kmem_cache_free(tcp_tw_cache, tw);
+		tcps->tcps_tw_cnt--;
+	}
+	tcps->tcps_tw_tail = NULL;
+	ASSERT(tcps->tcps_tw_cnt == 0);
+
+	for (i = 0; i < tcps->tcps_tw_fanout_size; i++)
+		mutex_destroy(&tcps->tcps_tw_fanout[i].twf_lock);
+	kmem_free(tcps->tcps_tw_fanout, tcps->tcps_tw_fanout_size *
+	    sizeof (tcp_tw_fanout_t));
+	tcps->tcps_tw_fanout = NULL;
+	mutex_destroy(&tcps->tcps_tw_lock);
+}
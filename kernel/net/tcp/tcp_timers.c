@@ -717,6 +717,12 @@ tcp_timer(void *arg)
 	}
 		/* FALLTHRU */
 	case TCPS_SYN_SENT:
+		/*
+		 * The data in a TCP Fast Open SYN may be what gets it
+		 * dropped, so retry without and send it after the handshake.
+		 */
+		if (tcp->tcp_tfo_syn_len != 0)
+			tcp_fastopen_fallback(tcp, B_TRUE);
 		first_threshold =  tcp->tcp_first_ctimer_threshold;
 		second_threshold = tcp->tcp_second_ctimer_threshold;
 
@@ -787,29 +793,10 @@ tcp_timer(void *arg)
 			} else {
 				/*
 				 * After retransmission, we need to do
-				 * slow start.  Set the ssthresh to one
-				 * half of current effective window and
-				 * cwnd to one MSS.  Also reset
-				 * tcp_cwnd_cnt.
-				 *
-				 * Note that if tcp_ssthresh is reduced because
-				 * of ECN, do not reduce it again unless it is
-				 * already one window of data away (tcp_cwr
-				 * should then be cleared) or this is a
-				 * timeout for a retransmitted segment.
+				 * slow start: the congestion control
+				 * algorithm sets cwnd to one MSS.
 				 */
-				uint32_t npkt;
-
-				if (!tcp->tcp_cwr || tcp->tcp_rexmit) {
-					npkt = ((tcp->tcp_timer_backoff ?
-					    tcp->tcp_cwnd_ssthresh :
-					    tcp->tcp_snxt -
-					    tcp->tcp_suna) >> 1) / tcp->tcp_mss;
-					tcp->tcp_cwnd_ssthresh = MAX(npkt, 2) *
-					    tcp->tcp_mss;
-				}
-				tcp->tcp_cwnd = tcp->tcp_mss;
-				tcp->tcp_cwnd_cnt = 0;
+				TCP_CC_CONG_SIGNAL(tcp, CC_RTO);
 				if (tcp->tcp_ecn_ok) {
 					tcp->tcp_cwr = B_TRUE;
 					tcp->tcp_cwr_snd_max = tcp->tcp_snxt;
@@ -1054,6 +1041,9 @@ timer_rexmit:
 	 */
 	tcp->tcp_set_timer = 1;
 	mss = tcp->tcp_snxt - tcp->tcp_suna;
+	/* The SYN takes a sequence number but isn't data */
+	if (tcp->tcp_valid_bits & TCP_ISS_VALID)
+		mss--;
 	if (mss > tcp->tcp_mss)
 		mss = tcp->tcp_mss;
 	if (mss > tcp->tcp_swnd && tcp->tcp_swnd != 0)
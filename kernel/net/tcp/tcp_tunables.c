@@ -220,6 +220,51 @@ tcp_largest_anon_set(netstack_t *stack, cred_t *cr, mod_prop_info_t *pinfo,
 	return (0);
 }
 
+/*
+ * The default congestion control algorithm of the stack.  Setting it loads
+ * the module of the algorithm if need be; the possible values are those of
+ * the algorithms currently registered.
+ */
+/* ARGSUSED */
+static int
+tcp_set_cc_algo(netstack_t *stack, cred_t *cr, mod_prop_info_t *pinfo,
+    const char *ifname, const void *pval, uint_t flags)
+{
+	cc_algo_t	*algo;
+
+	if (flags & MOD_PROP_DEFAULT) {
+		algo = &cc_newreno;
+		cc_hold(algo);
+	} else if ((algo = cc_lookup(pval, B_TRUE)) == NULL) {
+		return (EINVAL);
+	}
+	tcp_cc_set_default(stack->netstack_tcp, algo);
+	return (0);
+}
+
+/* ARGSUSED */
+static int
+tcp_get_cc_algo(netstack_t *stack, mod_prop_info_t *pinfo, const char *ifname,
+    void *pval, uint_t psize, uint_t flags)
+{
+	size_t	nbytes;
+
+	bzero(pval, psize);
+	if (flags & MOD_PROP_PERM) {
+		nbytes = snprintf(pval, psize, "%u", MOD_PROP_PERM_RW);
+	} else if (flags & MOD_PROP_POSSIBLE) {
+		return (cc_list_names(pval, psize));
+	} else if (flags & MOD_PROP_DEFAULT) {
+		nbytes = strlcpy(pval, cc_newreno.cc_name, psize);
+	} else {
+		tcp_cc_get_default(stack->netstack_tcp, pval, psize);
+		nbytes = strlen(pval);
+	}
+	if (nbytes >= psize)
+		return (ENOBUFS);
+	return (0);
+}
+
 /*
  * All of these are alterable, within the min/max values given, at run time.
  *
@@ -483,6 +528,34 @@ mod_prop_info_t tcp_propinfo_tbl[] = {
 	    {0, UINT32_MAX, 100*SECONDS}, {100*SECONDS} },
 
 	/* tunable - 60 */
+	{ "_pacing", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_FALSE}, {B_FALSE} },
+
+	/*
+	 * TCP Fast Open: 1 lets clients send data in the SYN, 2 lets
+	 * listeners accept it.  Either still has to be asked for on the
+	 * socket.
+	 */
+	{ "_fastopen", MOD_PROTO_TCP,
+	    mod_set_uint32, mod_get_uint32,
+	    {0, TCP_FASTOPEN_CLIENT | TCP_FASTOPEN_SERVER,
+	    TCP_FASTOPEN_CLIENT | TCP_FASTOPEN_SERVER},
+	    {TCP_FASTOPEN_CLIENT | TCP_FASTOPEN_SERVER} },
+
+	/*
+	 * Keep detached TIME_WAIT connections as compact records, and let
+	 * outgoing connections reuse the 4-tuple of a record with
+	 * timestamps.  See tcp_time_wait.c.
+	 */
+	{ "_time_wait_compact", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_TRUE}, {B_TRUE} },
+
+	{ "_time_wait_reuse", MOD_PROTO_TCP,
+	    mod_set_boolean, mod_get_boolean,
+	    {B_TRUE}, {B_TRUE} },
+
 	{ "extra_priv_ports", MOD_PROTO_TCP,
 	    mod_set_extra_privports, mod_get_extra_privports,
 	    {1, ULP_MAX_PORT, 0}, {0} },
@@ -496,6 +569,9 @@ mod_prop_info_t tcp_propinfo_tbl[] = {
 	{ "_listener_limit_conf_del", MOD_PROTO_TCP,
 	    tcp_listener_conf_del, NULL, {0}, {0} },
 
+	{ "congestion_control", MOD_PROTO_TCP,
+	    tcp_set_cc_algo, tcp_get_cc_algo, {0}, {0} },
+
 	{ "?", MOD_PROTO_TCP, NULL, mod_get_allprop, {0}, {0} },
 
 	{ NULL, 0, NULL, NULL, {0}, {0} }
@@ -1519,6 +1519,16 @@ udp_opt_get(conn_t *connp, t_scalar_t level, t_scalar_t name,
 			*i1 = udp->udp_rcvhdr ? 1 : 0;
 			mutex_exit(&connp->conn_lock);
 			return (sizeof (int));
+		case UDP_SEGMENT:
+			mutex_enter(&connp->conn_lock);
+			*i1 = udp->udp_segsize;
+			mutex_exit(&connp->conn_lock);
+			return (sizeof (int));
+		case UDP_GRO:
+			mutex_enter(&connp->conn_lock);
+			*i1 = udp->udp_gro ? 1 : 0;
+			mutex_exit(&connp->conn_lock);
+			return (sizeof (int));
 		}
 	}
 	mutex_enter(&connp->conn_lock);
@@ -1610,6 +1620,22 @@ udp_do_opt_set(conn_opt_arg_t *coa, int level, int name,
 			udp->udp_rcvhdr = onoff;
 			mutex_exit(&connp->conn_lock);
 			return (0);
+		case UDP_SEGMENT:
+			if (*i1 < 0 || *i1 > UDP_MAXPACKET_IPV6)
+				return (EINVAL);
+			if (!checkonly) {
+				mutex_enter(&connp->conn_lock);
+				udp->udp_segsize = *i1;
+				mutex_exit(&connp->conn_lock);
+			}
+			return (0);
+		case UDP_GRO:
+			if (!checkonly) {
+				mutex_enter(&connp->conn_lock);
+				udp->udp_gro = onoff;
+				mutex_exit(&connp->conn_lock);
+			}
+			return (0);
 		}
 		break;
 	}
@@ -2060,6 +2086,177 @@ udp_ulp_recv(conn_t *connp, mblk_t *mp, uint_t len, ip_recv_attr_t *ira)
 		putnext(connp->conn_rq, mp);
 }
 
+/*
+ * UDP_GRO: merge the datagrams of a flow that IP hands us in one chain.
+ *
+ * ip_input_common_v4/v6 pass a udp_gro_t along with the packets of a chain.
+ * The first datagram that a UDP_GRO socket gets from the chain is held back
+ * in a slot, T_UNITDATA_IND and all.  The payloads of the datagrams that
+ * follow from the same source are appended to it as long as they are no
+ * larger than the first one; a shorter one ends the run.  At the end of the
+ * chain, or when a datagram for the conn can not be merged, the held message
+ * is delivered as a single datagram with a UDP_GRO control message carrying
+ * the size of the first payload, which lets the application split it again.
+ *
+ * Datagrams that come with ancillary data, IP options or UDP_RCVHDR headers
+ * are never merged, and neither are multicast and broadcast ones.
+ */
+#define	UDP_GRO_OPTSIZE	(sizeof (struct T_opthdr) + sizeof (int))
+#define	UDP_GRO_MAX	IP_MAXPACKET
+
+void
+udp_gro_init(udp_gro_t *gro)
+{
+	bzero(gro, sizeof (*gro));
+}
+
+static void
+udp_gro_src(const uchar_t *rptr, const ip_recv_attr_t *ira, in6_addr_t *src)
+{
+	if (ira->ira_flags & IRAF_IS_IPV4)
+		IN6_IPADDR_TO_V4MAPPED(((ipha_t *)rptr)->ipha_src, src);
+	else
+		*src = ((ip6_t *)rptr)->ip6_src;
+}
+
+static udp_gro_slot_t *
+udp_gro_lookup(udp_gro_t *gro, const conn_t *connp)
+{
+	int	i;
+
+	for (i = 0; i < UDP_GRO_SLOTS; i++) {
+		if (gro->ug_slot[i].ugs_connp == connp)
+			return (&gro->ug_slot[i]);
+	}
+	return (NULL);
+}
+
+/*
+ * Send the held message up, adding the UDP_GRO option if anything was
+ * merged into it.  udp_input left room for the option after the address.
+ */
+static void
+udp_gro_deliver(udp_gro_slot_t *ugs)
+{
+	conn_t			*connp = ugs->ugs_connp;
+	mblk_t			*mp = ugs->ugs_mp;
+	struct T_unitdata_ind	*tudi;
+	struct T_opthdr		*toh;
+
+	if (ugs->ugs_nsegs > 1) {
+		tudi = (struct T_unitdata_ind *)mp->b_rptr;
+		ASSERT(tudi->OPT_length == 0);
+		ASSERT(DB_LIM(mp) - mp->b_wptr >= UDP_GRO_OPTSIZE);
+
+		toh = (struct T_opthdr *)mp->b_wptr;
+		toh->level = IPPROTO_UDP;
+		toh->name = UDP_GRO;
+		toh->len = UDP_GRO_OPTSIZE;
+		toh->status = 0;
+		*(int *)&toh[1] = ugs->ugs_segsize;
+		tudi->OPT_length = UDP_GRO_OPTSIZE;
+		mp->b_wptr += UDP_GRO_OPTSIZE;
+	}
+	ugs->ugs_connp = NULL;
+	ugs->ugs_mp = ugs->ugs_tail = NULL;
+
+	udp_ulp_recv(connp, mp, ugs->ugs_len, NULL);
+	CONN_DEC_REF(connp);
+}
+
+void
+udp_gro_flush(udp_gro_t *gro)
+{
+	int	i;
+
+	for (i = 0; i < UDP_GRO_SLOTS; i++) {
+		if (gro->ug_slot[i].ugs_connp != NULL)
+			udp_gro_deliver(&gro->ug_slot[i]);
+	}
+}
+
+/*
+ * Deliver what is held for connp, to keep it ahead of a datagram that
+ * can not be merged.
+ */
+static void
+udp_gro_flush_conn(udp_gro_t *gro, const conn_t *connp)
+{
+	udp_gro_slot_t	*ugs;
+
+	if ((ugs = udp_gro_lookup(gro, connp)) != NULL)
+		udp_gro_deliver(ugs);
+}
+
+/*
+ * Try to append the payload of mp to the message held for connp.
+ * Returns B_TRUE if mp was consumed.
+ */
+static boolean_t
+udp_gro_merge(udp_gro_t *gro, conn_t *connp, mblk_t *mp, uint_t hdr_length,
+    uint_t len, const ip_recv_attr_t *ira)
+{
+	udp_gro_slot_t	*ugs;
+	udpha_t		*udpha;
+	in6_addr_t	src;
+	mblk_t		*tail;
+
+	if ((ugs = udp_gro_lookup(gro, connp)) == NULL)
+		return (B_FALSE);
+
+	udp_gro_src(mp->b_rptr, ira, &src);
+	udpha = (udpha_t *)(mp->b_rptr + hdr_length - UDPH_SIZE);
+	if (ugs->ugs_closed || len == 0 || len > ugs->ugs_segsize ||
+	    ugs->ugs_len + len > UDP_GRO_MAX ||
+	    udpha->uha_src_port != ugs->ugs_sport ||
+	    !IN6_ARE_ADDR_EQUAL(&src, &ugs->ugs_src)) {
+		udp_gro_deliver(ugs);
+		return (B_FALSE);
+	}
+
+	mp->b_rptr += hdr_length;
+	for (tail = mp; tail->b_cont != NULL; tail = tail->b_cont)
+		;
+	ugs->ugs_tail->b_cont = mp;
+	ugs->ugs_tail = tail;
+	ugs->ugs_len += len;
+	ugs->ugs_nsegs++;
+	if (len < ugs->ugs_segsize)
+		ugs->ugs_closed = B_TRUE;
+	return (B_TRUE);
+}
+
+/*
+ * Hold a T_UNITDATA_IND with a payload of len bytes so that the datagrams
+ * that follow can be merged into it.  Returns B_FALSE if there is no free
+ * slot, in which case the caller delivers it.
+ */
+static boolean_t
+udp_gro_hold(udp_gro_t *gro, conn_t *connp, mblk_t *mp, uint_t len,
+    const in6_addr_t *src, in_port_t sport)
+{
+	udp_gro_slot_t	*ugs;
+	mblk_t		*tail;
+
+	ASSERT(udp_gro_lookup(gro, connp) == NULL);
+	if (len == 0 || (ugs = udp_gro_lookup(gro, NULL)) == NULL)
+		return (B_FALSE);
+
+	for (tail = mp; tail->b_cont != NULL; tail = tail->b_cont)
+		;
+	CONN_INC_REF(connp);
+	ugs->ugs_connp = connp;
+	ugs->ugs_mp = mp;
+	ugs->ugs_tail = tail;
+	ugs->ugs_src = *src;
+	ugs->ugs_sport = sport;
+	ugs->ugs_closed = B_FALSE;
+	ugs->ugs_segsize = len;
+	ugs->ugs_len = len;
+	ugs->ugs_nsegs = 1;
+	return (B_TRUE);
+}
+
 /*
  * This is the inbound data path.
  * IP has already pulled up the IP plus UDP headers and verified alignment
@@ -2082,6 +2279,8 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	mblk_t			*mp1;
 	uint32_t		udp_ipv4_options_len;
 	crb_t			recv_ancillary;
+	boolean_t		gro;
+	uint_t			gro_size;
 	udp_stack_t		*us;
 
 	ASSERT(connp->conn_flags & IPCL_UDPCONN);
@@ -2103,6 +2302,7 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	mutex_enter(&connp->conn_lock);
 	udp_ipv4_options_len = udp->udp_recv_ipp.ipp_ipv4_options_len;
 	recv_ancillary = connp->conn_recv_ancillary;
+	gro = udp->udp_gro;
 	mutex_exit(&connp->conn_lock);
 
 	hdr_length = ira->ira_ip_hdr_length;
@@ -2121,6 +2321,28 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	hdr_length += UDPH_SIZE;
 	ASSERT(MBLKL(mp) >= hdr_length);	/* IP did a pullup */
 
+	/* Can this datagram take part in UDP_GRO? */
+	if (ira->ira_flags & IRAF_UDP_GRO) {
+		gro = gro && recv_ancillary.crb_all == 0 &&
+		    udp_ipv4_options_len == 0 && !udp->udp_rcvhdr &&
+		    !(ira->ira_flags & (IRAF_IPV4_OPTIONS |
+		    IRAF_MULTIBROADCAST));
+		if (!gro) {
+			udp_gro_flush_conn(ira->ira_udp_gro, connp);
+		} else if (udp_gro_merge(ira->ira_udp_gro, connp, mp,
+		    hdr_length, pkt_len - hdr_length, ira)) {
+			DTRACE_UDP5(receive, mblk_t *, NULL, ip_xmit_attr_t *,
+			    connp->conn_ixa, void_ip_t *, rptr, udp_t *, udp,
+			    udpha_t *, udpha);
+			UDPS_BUMP_MIB(us, udpHCInDatagrams);
+			return;
+		}
+	} else {
+		gro = B_FALSE;
+	}
+	/* Room for the UDP_GRO option, should more datagrams be merged */
+	gro_size = gro ? UDP_GRO_OPTSIZE : 0;
+
 	/* Initialize regardless of IP version */
 	ipps.ipp_fields = 0;
 
@@ -2201,7 +2423,7 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 		}
 
 		/* Allocate a message block for the T_UNITDATA_IND structure. */
-		mp1 = allocb(udi_size, BPRI_MED);
+		mp1 = allocb(udi_size + gro_size, BPRI_MED);
 		if (mp1 == NULL) {
 			freemsg(mp);
 			UDPS_BUMP_MIB(us, udpInErrors);
@@ -2250,7 +2472,7 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 			    recv_ancillary, ira, mp, &ipps);
 		}
 
-		mp1 = allocb(udi_size, BPRI_MED);
+		mp1 = allocb(udi_size + gro_size, BPRI_MED);
 		if (mp1 == NULL) {
 			freemsg(mp);
 			UDPS_BUMP_MIB(us, udpInErrors);
@@ -2317,6 +2539,14 @@ udp_input(void *arg1, mblk_t *mp, void *arg2, ip_recv_attr_t *ira)
 	}
 
 	UDPS_BUMP_MIB(us, udpHCInDatagrams);
+	if (gro) {
+		in6_addr_t	src;
+
+		udp_gro_src(rptr, ira, &src);
+		if (udp_gro_hold(ira->ira_udp_gro, connp, mp1, pkt_len, &src,
+		    udpha->uha_src_port))
+			return;
+	}
 	udp_ulp_recv(connp, mp1, pkt_len, ira);
 	return;
 
@@ -4842,6 +5072,18 @@ udp_do_bind(conn_t *connp, struct sockaddr *sa, socklen_t len, cred_t *cr,
 					continue;
 			}
 
+			/*
+			 * Endpoints of the same user that all have
+			 * SO_REUSEPORT set can bind to the same port and
+			 * address; the classifier spreads the datagrams
+			 * among them.
+			 */
+			if (connp->conn_reuseport && connp1->conn_reuseport &&
+			    requested_port != 0 &&
+			    crgetuid(connp1->conn_cred) ==
+			    crgetuid(connp->conn_cred))
+				continue;
+
 			/*
 			 * No difference depending on SO_REUSEADDR.
 			 *
@@ -5500,9 +5742,9 @@ done:
 	return (error);
 }
 
-int
-udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct msghdr *msg,
-    cred_t *cr)
+static int
+udp_send_dgram(sock_lower_handle_t proto_handle, mblk_t *mp,
+    struct msghdr *msg, cred_t *cr)
 {
 	sin6_t		*sin6;
 	sin_t		*sin = NULL;
@@ -5733,6 +5975,77 @@ udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct msghdr *msg,
 	}
 }
 
+/*
+ * UDP_SEGMENT: cut the payload into datagrams of segsize bytes, the last one
+ * possibly shorter.  The datagrams share the data blocks of mp, and are
+ * returned linked through b_next.  Consumes mp.
+ */
+static mblk_t *
+udp_segment(mblk_t *mp, uint_t segsize)
+{
+	mblk_t	*head = NULL, **nextp = &head, **contp = NULL;
+	mblk_t	*bp, *nbp;
+	uchar_t	*rptr;
+	uint_t	left = segsize;
+	uint_t	len;
+
+	for (bp = mp; bp != NULL; bp = bp->b_cont) {
+		for (rptr = bp->b_rptr; rptr < bp->b_wptr; rptr += len) {
+			len = MIN(left, (uint_t)(bp->b_wptr - rptr));
+			if ((nbp = dupb(bp)) == NULL) {
+				freemsgchain(head);
+				freemsg(mp);
+				return (NULL);
+			}
+			nbp->b_rptr = rptr;
+			nbp->b_wptr = rptr + len;
+			if (left == segsize) {
+				*nextp = nbp;
+				nextp = &nbp->b_next;
+			} else {
+				*contp = nbp;
+			}
+			contp = &nbp->b_cont;
+			if ((left -= len) == 0)
+				left = segsize;
+		}
+	}
+	freemsg(mp);
+	return (head);
+}
+
+int
+udp_send(sock_lower_handle_t proto_handle, mblk_t *mp, struct msghdr *msg,
+    cred_t *cr)
+{
+	conn_t		*connp = (conn_t *)proto_handle;
+	udp_t		*udp = connp->conn_udp;
+	uint_t		segsize = udp->udp_segsize;
+	mblk_t		*segs;
+	int		error = 0;
+
+	if (segsize == 0 || msgdsize(mp) <= segsize)
+		return (udp_send_dgram(proto_handle, mp, msg, cr));
+
+	/*
+	 * Send each segment as a datagram of its own, with the same address
+	 * and ancillary data.  Stop at the first error.
+	 */
+	if ((segs = udp_segment(mp, segsize)) == NULL) {
+		UDPS_BUMP_MIB(udp->udp_us, udpOutErrors);
+		return (ENOMEM);
+	}
+	while ((mp = segs) != NULL) {
+		segs = mp->b_next;
+		mp->b_next = NULL;
+		if ((error = udp_send_dgram(proto_handle, mp, msg, cr)) != 0) {
+			freemsgchain(segs);
+			break;
+		}
+	}
+	return (error);
+}
+
 int
 udp_fallback(sock_lower_handle_t proto_handle, queue_t *q,
     boolean_t issocket, so_proto_quiesced_cb_t quiesced_cb,
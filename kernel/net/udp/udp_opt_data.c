@@ -87,6 +87,8 @@ opdes_t	udp_opt_arr[] = {
 { SCM_UCRED, SOL_SOCKET, OA_W, OA_W, OP_NP, OP_VARLEN|OP_NODEFAULT,
     384 + NGROUPS_UMAX * sizeof (gid_t), 0 },
 { SO_EXCLBIND, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_REUSEPORT, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ SO_INCOMING_CPU, SOL_SOCKET, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 { SO_DOMAIN,	SOL_SOCKET, OA_R, OA_R, OP_NP, 0, sizeof (int), 0 },
 { SO_PROTOTYPE,	SOL_SOCKET, OA_R, OA_R, OP_NP, 0, sizeof (int), 0 },
 
@@ -286,6 +288,8 @@ opdes_t	udp_opt_arr[] = {
 	},
 { UDP_NAT_T_ENDPOINT, IPPROTO_UDP, OA_RW, OA_RW, OP_PRIVPORT, 0, sizeof (int),
 	0 },
+{ UDP_SEGMENT, IPPROTO_UDP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
+{ UDP_GRO, IPPROTO_UDP, OA_RW, OA_RW, OP_NP, 0, sizeof (int), 0 },
 };
 
 /*
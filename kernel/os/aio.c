@@ -45,6 +45,7 @@
 #include <sys/ddi_impldefs.h>
 #include <sys/sunddi.h>
 #include <sys/aio_impl.h>
+#include <sys/aio_ring.h>
 #include <sys/debug.h>
 #include <sys/param.h>
 #include <sys/systm.h>
@@ -109,6 +110,8 @@ static int aio_req_setupLF(aio_req_t **, aio_t *, aiocb64_32_t *,
 static int alio32(int, void *, int, void *);
 static int driver_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
 static int driver_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
+static int file_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
+static int file_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p);
 
 #ifdef  _SYSCALL32_IMPL
 static void aiocb_LFton(aiocb64_32_t *, aiocb_t *);
@@ -276,6 +279,20 @@ kaioc(
 	case AIOCANCEL:
 		error = aio_cancel((int)a1, (void *)a2, &rval, AIO_64);
 		break;
+	case AIORING_SETUP:
+		if ((error = aioinit()) == 0)
+			error = aio_ring_setup((aioring_params_t *)a1, &rval);
+		break;
+	case AIORING_ENTER:
+		error = aio_ring_enter((int)a1, (uint_t)a2, (uint_t)a3,
+		    (uint_t)a4, (timespec_t *)a5, &rval);
+		break;
+	case AIORING_WORK:
+		error = aio_ring_work((int)a1);
+		break;
+	case AIORING_DESTROY:
+		error = aio_ring_destroy((int)a1);
+		break;
 
 	/*
 	 * The large file related stuff is valid only for
@@ -380,6 +397,21 @@ kaio(
 		error = (aio_cancel((int)uap[1], (void *)uap[2],
 		    &rval, AIO_LARGEFILE));
 		break;
+	case AIORING_SETUP:
+		if ((error = aioinit()) == 0) {
+			error = aio_ring_setup((aioring_params_t *)uap[1],
+			    &rval);
+		}
+		break;
+	case AIORING_ENTER:
+		error = aio_ring_enter((int)uap[1], (uint_t)uap[2],
+		    (uint_t)uap[3], (uint_t)uap[4], (timespec_t *)uap[5],
+		    &rval);
+		break;
+	case AIORING_WORK:
+		return (aio_ring_work((int)uap[1]));
+	case AIORING_DESTROY:
+		return (aio_ring_destroy((int)uap[1]));
 	default:
 		return (EINVAL);
 	}
@@ -2481,6 +2513,7 @@ aio_aiop_alloc(void)
 		mutex_init(&aiop->aio_cleanupq_mutex, NULL, MUTEX_DEFAULT,
 		    NULL);
 		mutex_init(&aiop->aio_portq_mutex, NULL, MUTEX_DEFAULT, NULL);
+		mutex_init(&aiop->aio_ring_mutex, NULL, MUTEX_DEFAULT, NULL);
 	}
 	return (aiop);
 }
@@ -2775,11 +2808,21 @@ static int
 	major_t		major;
 	int		(*aio_func)();
 
+	/*
+	 * Regular files are handed to the file system, if it supports
+	 * asynchronous I/O.
+	 */
+	if (vp->v_type == VREG) {
+		if (vp->v_op->vop_aio == NULL)
+			return (NULL);
+		return ((mode & FREAD) ? file_aio_read : file_aio_write);
+	}
+
 	dev = vp->v_rdev;
 	major = getmajor(dev);
 
 	/*
-	 * return NULL for requests to files and STREAMs so
+	 * return NULL for requests to other files and STREAMs so
 	 * that libaio takes care of them.
 	 */
 	if (vp->v_type == VCHR) {
@@ -2872,6 +2915,38 @@ driver_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
 	return ((*cb->cb_aread)(dev, aio, cred_p));
 }
 
+/*
+ * The regular file counterparts of driver_aio_write() and driver_aio_read().
+ * The file system sees the open mode of the file in uio_fmode, so that it
+ * can honour FAPPEND and the synchronous I/O flags.
+ */
+static int
+file_aio(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cred_p)
+{
+	aio_req_t *reqp = (aio_req_t *)aio->aio_private;
+	file_t *fp;
+
+	ASSERT(vp->v_type == VREG);
+	if ((fp = getf(reqp->aio_req_fd)) == NULL)
+		return (EBADF);
+	aio->aio_uio->uio_fmode = fp->f_flag;
+	releasef(reqp->aio_req_fd);
+
+	return (fop_aio(vp, aio, rw, cred_p, NULL));
+}
+
+static int
+file_aio_write(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
+{
+	return (file_aio(vp, aio, FWRITE, cred_p));
+}
+
+static int
+file_aio_read(vnode_t *vp, struct aio_req *aio, cred_t *cred_p)
+{
+	return (file_aio(vp, aio, FREAD, cred_p));
+}
+
 /*
  * This routine is called when a largefile call is made by a 32bit
  * process on a ILP32 or LP64 kernel. All 64bit processes are large
@@ -0,0 +1,909 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Asynchronous I/O rings (see <sys/aio_ring.h>).
+ *
+ * A ring is a few pages of anonymous memory that are locked down and
+ * mapped both into the kernel (through segkp) and into the process
+ * (through segvn), the same way schedctl shares its pages.  The pages count
+ * against the project.max-locked-memory and zone.max-locked-memory of the
+ * process's project, as mlock()ed ones would.  The kernel
+ * only ever reads requests out of, and writes completions into, its own
+ * mapping, so no request processing can fault; every index the process
+ * controls is validated against the kernel's private copy before use.
+ *
+ * Requests are executed by "worker" threads: threads of the owning process
+ * that libc parks in the kernel in aio_ring_work(), much as it parks its
+ * kaio cleanup thread in aio_cleanup_thread().  Because the workers run in
+ * the context of the process, a request is carried out by simply calling
+ * the implementation of the equivalent system call (pread(), pollsys(),
+ * accept(), ...) with the process's own file descriptors and buffers, so
+ * it works on any file and has exactly that call's semantics.  A worker
+ * keeps taking requests until the SQ is empty, so a batch of submissions
+ * costs one aioring_enter() no matter how many requests it holds, and with
+ * AIORING_SETUP_SQPOLL idle workers poll the SQ for a while before going
+ * to sleep, so a busy process needn't make any system calls at all.
+ *
+ * A worker only takes a request from the SQ when there is room in the CQ
+ * for its completion, counting all requests already in flight, so the CQ
+ * can never overflow.  A request interrupted by a signal or by the process
+ * being held (for fork(), /proc, ...) before doing any work is put on a
+ * retry list rather than completed with EINTR, and the worker returns to
+ * the process to let the interruption be handled; libc restarts it.
+ *
+ * A ring may be associated with an event port, to which a single
+ * PORT_SOURCE_AIORING event is sent whenever completions are posted to an
+ * otherwise idle ring; the event's portev_events field holds the number of
+ * completions posted since the last event was retrieved.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/errno.h>
+#include <sys/proc.h>
+#include <sys/thread.h>
+#include <sys/klwp.h>
+#include <sys/cpu.h>
+#include <sys/kmem.h>
+#include <sys/debug.h>
+#include <sys/sysmacros.h>
+#include <sys/time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/poll.h>
+#include <sys/socket.h>
+#include <sys/model.h>
+#include <sys/vmsystm.h>
+#include <sys/task.h>
+#include <sys/project.h>
+#include <sys/rctl.h>
+#include <sys/aio_impl.h>
+#include <sys/aio_ring.h>
+#include <sys/port_impl.h>
+#include <sys/port_kernel.h>
+#include <vm/as.h>
+#include <vm/anon.h>
+#include <vm/seg_kp.h>
+#include <vm/seg_vn.h>
+
+/*
+ * The system calls requests are handed to.
+ */
+extern ssize_t	read(int, void *, size_t);
+extern ssize_t	write(int, void *, size_t);
+extern ssize_t	pread(int, void *, size_t, off_t);
+extern ssize_t	pwrite(int, void *, size_t, off_t);
+extern int	fdsync(int, int);
+extern int	pollsys(pollfd_t *, nfds_t, timespec_t *, sigset_t *);
+extern int	accept(int, struct sockaddr *, socklen_t *, int);
+
+/*
+ * Maximum number of rings per process.  Rings are locked in memory.
+ */
+uint_t aio_ring_max = 16;
+
+/*
+ * How long an idle worker of an AIORING_SETUP_SQPOLL ring polls the SQ
+ * before going to sleep.
+ */
+hrtime_t aio_ring_sqpoll_nsec = 50 * (NANOSEC / MICROSEC);
+
+static void aio_ring_close_port(void *, int, pid_t, int);
+static int aio_ring_port_callback(void *, int *, pid_t, int, void *);
+
+static aio_ring_t *
+aio_ring_hold(int id)
+{
+	aio_t *aiop = curproc->p_aio;
+	aio_ring_t *ar;
+
+	if (aiop == NULL)
+		return (NULL);
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	for (ar = aiop->aio_rings; ar != NULL; ar = ar->ar_next) {
+		if (ar->ar_id == id) {
+			mutex_enter(&ar->ar_lock);
+			if (ar->ar_flags & AR_SETUP) {
+				mutex_exit(&ar->ar_lock);
+				ar = NULL;
+				break;
+			}
+			ar->ar_refcnt++;
+			mutex_exit(&ar->ar_lock);
+			break;
+		}
+	}
+	mutex_exit(&aiop->aio_ring_mutex);
+	return (ar);
+}
+
+/*
+ * Free a ring that has no remaining references.  The process's mapping of
+ * the ring has already been removed, or is going away with its address
+ * space.
+ */
+static void
+aio_ring_free(aio_ring_t *ar)
+{
+	struct anon_map *amp = ar->ar_amp;
+	aio_ring_retry_t *arr;
+	port_kevent_t *pev;
+
+	ASSERT0(ar->ar_refcnt);
+	ASSERT0(ar->ar_workers);
+
+	mutex_enter(&ar->ar_lock);
+	pev = ar->ar_portev;
+	ar->ar_portev = NULL;
+	mutex_exit(&ar->ar_lock);
+	if (pev != NULL) {
+		(void) port_dissociate_ksource(ar->ar_port,
+		    PORT_SOURCE_AIORING, (port_source_t *)ar->ar_portsrc);
+		(void) port_remove_done_event(pev);
+		port_free_event(pev);
+	}
+
+	while ((arr = ar->ar_retry) != NULL) {
+		ar->ar_retry = arr->arr_next;
+		kmem_free(arr, sizeof (*arr));
+	}
+
+	/*
+	 * Release the lock on the pages and remove the kernel mapping, as
+	 * schedctl_freepage() does.
+	 */
+	ANON_LOCK_ENTER(&amp->a_rwlock, RW_WRITER);
+	segkp_release(segkp, (caddr_t)ar->ar_hdr);
+	if (--amp->refcnt == 0) {
+		anonmap_purge(amp);
+		anon_free(amp->ahp, 0, ar->ar_size);
+		ANON_LOCK_EXIT(&amp->a_rwlock);
+		anonmap_free(amp);
+	} else {
+		ANON_LOCK_EXIT(&amp->a_rwlock);
+	}
+	rctl_decr_locked_mem(NULL, ar->ar_proj, ar->ar_size, 0);
+	project_rele(ar->ar_proj);
+
+	cv_destroy(&ar->ar_workcv);
+	cv_destroy(&ar->ar_cqcv);
+	mutex_destroy(&ar->ar_lock);
+	kmem_free(ar, sizeof (*ar));
+}
+
+static void
+aio_ring_rele(aio_ring_t *ar)
+{
+	mutex_enter(&ar->ar_lock);
+	ASSERT(ar->ar_refcnt > 0);
+	if (--ar->ar_refcnt > 0) {
+		mutex_exit(&ar->ar_lock);
+		return;
+	}
+	mutex_exit(&ar->ar_lock);
+	aio_ring_free(ar);
+}
+
+/*
+ * Remove the process's mapping of the ring, if it is still there.
+ */
+static void
+aio_ring_unmap(aio_ring_t *ar)
+{
+	struct as *as = curproc->p_as;
+	struct seg *seg;
+	boolean_t mapped = B_FALSE;
+
+	AS_LOCK_ENTER(as, RW_READER);
+	seg = as_segat(as, ar->ar_uaddr);
+	if (seg != NULL && seg->s_base == ar->ar_uaddr &&
+	    seg->s_size == ar->ar_size && seg->s_ops == &segvn_ops &&
+	    SEGVN_DATA(seg)->amp == ar->ar_amp)
+		mapped = B_TRUE;
+	AS_LOCK_EXIT(as);
+
+	if (mapped)
+		(void) as_unmap(as, ar->ar_uaddr, ar->ar_size);
+}
+
+/*
+ * Take a ring off the process's list and drop the list's reference.  Idle
+ * workers return to the process, busy ones once their request completes.
+ */
+static void
+aio_ring_close(aio_ring_t *ar)
+{
+	mutex_enter(&ar->ar_lock);
+	ar->ar_flags |= AR_CLOSING;
+	cv_broadcast(&ar->ar_workcv);
+	cv_broadcast(&ar->ar_cqcv);
+	mutex_exit(&ar->ar_lock);
+
+	aio_ring_unmap(ar);
+	aio_ring_rele(ar);
+}
+
+/*
+ * Allocate the ring's pages and map them into the kernel and the process.
+ * The pages are charged to the process's project, which is remembered so
+ * that the charge goes back to it even if the process moves on.
+ */
+static int
+aio_ring_map(aio_ring_t *ar)
+{
+	proc_t *p = curproc;
+	struct as *as = p->p_as;
+	struct segvn_crargs vn_a;
+	struct anon_map *amp;
+	kproject_t *proj;
+	caddr_t kaddr, addr = NULL;
+	int error;
+
+	mutex_enter(&p->p_lock);
+	proj = p->p_task->tk_proj;
+	if (rctl_incr_locked_mem(p, proj, ar->ar_size, 0) != 0) {
+		mutex_exit(&p->p_lock);
+		return (EAGAIN);
+	}
+	(void) project_hold(proj);
+	mutex_exit(&p->p_lock);
+
+	/*
+	 * No swap reservation is needed since the pages are locked.
+	 */
+	amp = anonmap_alloc(ar->ar_size, 0, ANON_SLEEP);
+	kaddr = segkp_get_withanonmap(segkp, ar->ar_size,
+	    KPD_NO_ANON | KPD_LOCKED | KPD_ZERO, amp);
+	if (kaddr == NULL) {
+		amp->refcnt--;
+		anonmap_free(amp);
+		rctl_decr_locked_mem(NULL, proj, ar->ar_size, 0);
+		project_rele(proj);
+		return (ENOMEM);
+	}
+
+	as_rangelock(as);
+	/* pass address of kernel mapping as offset to avoid VAC conflicts */
+	map_addr(&addr, ar->ar_size, (offset_t)(uintptr_t)kaddr, 1, 0);
+	if (addr == NULL) {
+		as_rangeunlock(as);
+		error = ENOMEM;
+		goto out;
+	}
+
+	vn_a.vp = NULL;
+	vn_a.offset = 0;
+	vn_a.cred = NULL;
+	vn_a.type = MAP_SHARED;
+	vn_a.prot = vn_a.maxprot = PROT_READ | PROT_WRITE | PROT_USER;
+	vn_a.flags = 0;
+	vn_a.amp = amp;
+	vn_a.szc = 0;
+	vn_a.lgrp_mem_policy_flags = 0;
+	error = as_map(as, addr, ar->ar_size, segvn_create, &vn_a);
+	as_rangeunlock(as);
+
+out:
+	if (error != 0) {
+		ANON_LOCK_ENTER(&amp->a_rwlock, RW_WRITER);
+		segkp_release(segkp, kaddr);
+		amp->refcnt--;
+		anonmap_purge(amp);
+		anon_free(amp->ahp, 0, ar->ar_size);
+		ANON_LOCK_EXIT(&amp->a_rwlock);
+		anonmap_free(amp);
+		rctl_decr_locked_mem(NULL, proj, ar->ar_size, 0);
+		project_rele(proj);
+		return (error);
+	}
+
+	ar->ar_amp = amp;
+	ar->ar_proj = proj;
+	ar->ar_uaddr = addr;
+	ar->ar_hdr = (aioring_hdr_t *)kaddr;
+	return (0);
+}
+
+/*
+ * Arrange for completion notices to be sent to an event port.
+ */
+static int
+aio_ring_assoc_port(aio_ring_t *ar, int port, uint64_t user)
+{
+	port_kevent_t *pkevp;
+	int error;
+
+	error = port_associate_ksource(port, PORT_SOURCE_AIORING,
+	    (port_source_t **)&ar->ar_portsrc, aio_ring_close_port, NULL,
+	    NULL);
+	if (error != 0)
+		return (error);
+
+	error = port_alloc_event(port, PORT_ALLOC_SCACHED,
+	    PORT_SOURCE_AIORING, &pkevp);
+	if (error != 0) {
+		(void) port_dissociate_ksource(port, PORT_SOURCE_AIORING,
+		    (port_source_t *)ar->ar_portsrc);
+		return (error);
+	}
+
+	port_init_event(pkevp, (uintptr_t)ar->ar_id,
+	    (void *)(uintptr_t)user, aio_ring_port_callback, ar);
+	ar->ar_portev = pkevp;
+	ar->ar_port = port;
+	return (0);
+}
+
+/*
+ * Take a ring that failed to set up off the process's list.
+ */
+static void
+aio_ring_unlink(aio_t *aiop, aio_ring_t *ar)
+{
+	aio_ring_t **arp;
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	for (arp = &aiop->aio_rings; *arp != ar; arp = &(*arp)->ar_next)
+		ASSERT(*arp != NULL);
+	*arp = ar->ar_next;
+	mutex_exit(&aiop->aio_ring_mutex);
+}
+
+int
+aio_ring_setup(aioring_params_t *uparams, long *rvalp)
+{
+	aio_t *aiop = curproc->p_aio;
+	aioring_params_t params;
+	aio_ring_t *ar, *tar;
+	uint_t entries, nrings;
+	size_t sqoff, cqoff;
+	int error;
+
+	ASSERT(aiop != NULL);
+
+	if (copyin(uparams, &params, sizeof (params)) != 0)
+		return (EFAULT);
+	if (params.arp_entries == 0 ||
+	    params.arp_entries > AIORING_MAX_ENTRIES ||
+	    (params.arp_flags & ~AIORING_SETUP_SQPOLL) != 0)
+		return (EINVAL);
+
+	entries = 1U << highbit(params.arp_entries - 1);
+	sqoff = sizeof (aioring_hdr_t);
+	cqoff = P2ROUNDUP(sqoff + entries * sizeof (aioring_sqe_t), 64);
+
+	ar = kmem_zalloc(sizeof (*ar), KM_SLEEP);
+	mutex_init(&ar->ar_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&ar->ar_workcv, NULL, CV_DEFAULT, NULL);
+	cv_init(&ar->ar_cqcv, NULL, CV_DEFAULT, NULL);
+	ar->ar_flags = params.arp_flags | AR_SETUP;
+	ar->ar_refcnt = 1;
+	ar->ar_sq_entries = entries;
+	ar->ar_cq_entries = 2 * entries;
+	ar->ar_size = P2ROUNDUP(cqoff + ar->ar_cq_entries *
+	    sizeof (aioring_cqe_t), PAGESIZE);
+
+	/*
+	 * Pick the lowest free ring identifier, and claim it by putting the
+	 * ring on the list; AR_SETUP keeps it out of reach until it is ready.
+	 */
+	mutex_enter(&aiop->aio_ring_mutex);
+	nrings = 0;
+	for (tar = aiop->aio_rings; tar != NULL; tar = tar->ar_next) {
+		nrings++;
+		if (tar->ar_id >= ar->ar_id)
+			ar->ar_id = tar->ar_id + 1;
+	}
+	if (nrings >= aio_ring_max) {
+		mutex_exit(&aiop->aio_ring_mutex);
+		error = EAGAIN;
+		goto err;
+	}
+	if (ar->ar_id > nrings) {
+		for (ar->ar_id = 0; ; ar->ar_id++) {
+			for (tar = aiop->aio_rings; tar != NULL;
+			    tar = tar->ar_next) {
+				if (tar->ar_id == ar->ar_id)
+					break;
+			}
+			if (tar == NULL)
+				break;
+		}
+	}
+	ar->ar_next = aiop->aio_rings;
+	aiop->aio_rings = ar;
+	mutex_exit(&aiop->aio_ring_mutex);
+
+	if ((error = aio_ring_map(ar)) != 0) {
+		aio_ring_unlink(aiop, ar);
+		goto err;
+	}
+	ar->ar_sq = (aioring_sqe_t *)((caddr_t)ar->ar_hdr + sqoff);
+	ar->ar_cq = (aioring_cqe_t *)((caddr_t)ar->ar_hdr + cqoff);
+
+	if (params.arp_port != -1 && (error = aio_ring_assoc_port(ar,
+	    params.arp_port, params.arp_portuser)) != 0) {
+		aio_ring_unlink(aiop, ar);
+		aio_ring_close(ar);
+		return (error);
+	}
+
+	params.arp_entries = ar->ar_sq_entries;
+	params.arp_cq_entries = ar->ar_cq_entries;
+	params.arp_addr = (uint64_t)(uintptr_t)ar->ar_uaddr;
+	params.arp_size = ar->ar_size;
+	params.arp_sq_off = sqoff;
+	params.arp_cq_off = cqoff;
+	if (copyout(&params, uparams, sizeof (params)) != 0) {
+		aio_ring_unlink(aiop, ar);
+		aio_ring_close(ar);
+		return (EFAULT);
+	}
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	mutex_enter(&ar->ar_lock);
+	ar->ar_flags &= ~AR_SETUP;
+	mutex_exit(&ar->ar_lock);
+	mutex_exit(&aiop->aio_ring_mutex);
+
+	*rvalp = ar->ar_id;
+	return (0);
+
+err:
+	cv_destroy(&ar->ar_workcv);
+	cv_destroy(&ar->ar_cqcv);
+	mutex_destroy(&ar->ar_lock);
+	kmem_free(ar, sizeof (*ar));
+	return (error);
+}
+
+/*
+ * Take the next request, if there is one and there is room in the CQ for
+ * its completion.
+ */
+static boolean_t
+aio_ring_take(aio_ring_t *ar, aioring_sqe_t *sqe)
+{
+	aioring_hdr_t *hdr = ar->ar_hdr;
+	aio_ring_retry_t *arr;
+	uint32_t tail;
+
+	ASSERT(MUTEX_HELD(&ar->ar_lock));
+
+	if ((arr = ar->ar_retry) != NULL) {
+		ar->ar_retry = arr->arr_next;
+		*sqe = arr->arr_sqe;
+		kmem_free(arr, sizeof (*arr));
+		ar->ar_inflight++;
+		return (B_TRUE);
+	}
+
+	tail = hdr->arh_sq_tail;
+	if (tail == ar->ar_sq_head ||
+	    tail - ar->ar_sq_head > ar->ar_sq_entries)
+		return (B_FALSE);
+	if (ar->ar_cq_tail - hdr->arh_cq_head + ar->ar_inflight >=
+	    ar->ar_cq_entries)
+		return (B_FALSE);
+
+	membar_consumer();
+	*sqe = ar->ar_sq[ar->ar_sq_head & (ar->ar_sq_entries - 1)];
+	ar->ar_sq_head++;
+	hdr->arh_sq_head = ar->ar_sq_head;
+	ar->ar_inflight++;
+	return (B_TRUE);
+}
+
+/*
+ * Carry out a request by calling the equivalent system call.
+ */
+static void
+aio_ring_exec(const aioring_sqe_t *sqe, aioring_cqe_t *cqe)
+{
+	klwp_t *lwp = ttolwp(curthread);
+	void *addr = (void *)(uintptr_t)sqe->sqe_addr;
+	int64_t res = 0;
+	int error = 0;
+
+	lwp->lwp_errno = 0;
+	switch (sqe->sqe_opcode) {
+	case AIORING_OP_NOP:
+		break;
+	case AIORING_OP_READ:
+		if (sqe->sqe_off == AIORING_OFF_CUR)
+			res = read(sqe->sqe_fd, addr, sqe->sqe_len);
+		else
+			res = pread(sqe->sqe_fd, addr, sqe->sqe_len,
+			    (off_t)sqe->sqe_off);
+		break;
+	case AIORING_OP_WRITE:
+		if (sqe->sqe_off == AIORING_OFF_CUR)
+			res = write(sqe->sqe_fd, addr, sqe->sqe_len);
+		else
+			res = pwrite(sqe->sqe_fd, addr, sqe->sqe_len,
+			    (off_t)sqe->sqe_off);
+		break;
+	case AIORING_OP_FSYNC:
+		res = fdsync(sqe->sqe_fd,
+		    (sqe->sqe_flags & AIORING_SQE_DSYNC) ? FDSYNC : FSYNC);
+		break;
+	case AIORING_OP_POLL:
+		res = pollsys(addr, sqe->sqe_len, NULL, NULL);
+		break;
+	case AIORING_OP_ACCEPT:
+		res = accept(sqe->sqe_fd, addr,
+		    (socklen_t *)(uintptr_t)sqe->sqe_addr2, sqe->sqe_aflags);
+		break;
+	default:
+		error = EINVAL;
+		res = -1;
+		break;
+	}
+
+	/*
+	 * The system calls report errors through set_errno(); don't let that
+	 * leak into the return of the call the worker is in.
+	 */
+	if (lwp->lwp_errno != 0) {
+		error = lwp->lwp_errno;
+		lwp->lwp_errno = 0;
+		res = -1;
+	}
+
+	cqe->cqe_user = sqe->sqe_user;
+	cqe->cqe_res = res;
+	cqe->cqe_error = error;
+	cqe->cqe_pad = 0;
+}
+
+/*
+ * Post a completion for a request taken by aio_ring_take().
+ */
+static void
+aio_ring_post(aio_ring_t *ar, const aioring_cqe_t *cqe)
+{
+	aioring_hdr_t *hdr = ar->ar_hdr;
+
+	ASSERT(MUTEX_HELD(&ar->ar_lock));
+	ASSERT(ar->ar_inflight > 0);
+
+	ar->ar_cq[ar->ar_cq_tail & (ar->ar_cq_entries - 1)] = *cqe;
+	membar_producer();
+	hdr->arh_cq_tail = ++ar->ar_cq_tail;
+	ar->ar_inflight--;
+
+	if (ar->ar_cqwaiters > 0)
+		cv_broadcast(&ar->ar_cqcv);
+	if (ar->ar_portev != NULL && ar->ar_portpend++ == 0)
+		port_send_event(ar->ar_portev);
+}
+
+/*
+ * Run a request taken from the ring, with ar_lock held on entry and
+ * return.  Returns EINTR if the request was interrupted and has been
+ * queued to be retried.
+ */
+static int
+aio_ring_run(aio_ring_t *ar, const aioring_sqe_t *sqe)
+{
+	aioring_cqe_t cqe;
+	aio_ring_retry_t *arr;
+
+	mutex_exit(&ar->ar_lock);
+	aio_ring_exec(sqe, &cqe);
+	mutex_enter(&ar->ar_lock);
+
+	if (cqe.cqe_error == EINTR && !(ar->ar_flags & AR_CLOSING) &&
+	    !(curproc->p_flag & (SEXITLWPS | SKILLED))) {
+		arr = kmem_alloc(sizeof (*arr), KM_SLEEP);
+		arr->arr_sqe = *sqe;
+		arr->arr_next = ar->ar_retry;
+		ar->ar_retry = arr;
+		ar->ar_inflight--;
+		return (EINTR);
+	}
+	aio_ring_post(ar, &cqe);
+	return (0);
+}
+
+/*
+ * A worker thread: take and run requests until the ring is destroyed.
+ * Returns EINTR when the thread needs to return to the process to be
+ * signalled, held or killed; libc calls us again if it survives.
+ */
+int
+aio_ring_work(int id)
+{
+	aio_ring_t *ar;
+	aioring_sqe_t sqe;
+	hrtime_t spin;
+	int error = 0;
+
+	if ((ar = aio_ring_hold(id)) == NULL)
+		return (EINVAL);
+
+	mutex_enter(&ar->ar_lock);
+	ar->ar_workers++;
+	while (!(ar->ar_flags & AR_CLOSING)) {
+		if (aio_ring_take(ar, &sqe)) {
+			if ((error = aio_ring_run(ar, &sqe)) != 0)
+				break;
+			continue;
+		}
+
+		if (ar->ar_flags & AIORING_SETUP_SQPOLL) {
+			spin = gethrtime() + aio_ring_sqpoll_nsec;
+			mutex_exit(&ar->ar_lock);
+			while (ar->ar_hdr->arh_sq_tail == ar->ar_sq_head &&
+			    gethrtime() < spin)
+				SMT_PAUSE();
+			mutex_enter(&ar->ar_lock);
+			if (aio_ring_take(ar, &sqe)) {
+				if ((error = aio_ring_run(ar, &sqe)) != 0)
+					break;
+				continue;
+			}
+			atomic_or_32(&ar->ar_hdr->arh_flags,
+			    AIORING_HDR_NEED_WAKEUP);
+			membar_enter();
+			if (aio_ring_take(ar, &sqe)) {
+				atomic_and_32(&ar->ar_hdr->arh_flags,
+				    ~AIORING_HDR_NEED_WAKEUP);
+				if ((error = aio_ring_run(ar, &sqe)) != 0)
+					break;
+				continue;
+			}
+		}
+
+		ar->ar_idle++;
+		if (cv_wait_sig(&ar->ar_workcv, &ar->ar_lock) == 0)
+			error = EINTR;
+		ar->ar_idle--;
+		if (ar->ar_flags & AIORING_SETUP_SQPOLL) {
+			atomic_and_32(&ar->ar_hdr->arh_flags,
+			    ~AIORING_HDR_NEED_WAKEUP);
+		}
+		if (error != 0)
+			break;
+	}
+
+	/*
+	 * Another worker might be needed to pick up where we left off.
+	 */
+	if (error != 0 && ar->ar_idle > 0)
+		cv_signal(&ar->ar_workcv);
+	ar->ar_workers--;
+	mutex_exit(&ar->ar_lock);
+	aio_ring_rele(ar);
+	return (error);
+}
+
+int
+aio_ring_enter(int id, uint_t to_submit, uint_t min_complete, uint_t flags,
+    timespec_t *timeout, long *rvalp)
+{
+	aio_ring_t *ar;
+	aioring_sqe_t sqe;
+	timespec_t ts, *rqtp = NULL;
+	uint32_t avail;
+	uint_t submitted = 0;
+	int timecheck = 0;
+	int error = 0;
+	int rv;
+
+	if ((flags & ~AIORING_ENTER_GETEVENTS) != 0)
+		return (EINVAL);
+
+	if ((flags & AIORING_ENTER_GETEVENTS) && timeout != NULL) {
+		if (get_udatamodel() == DATAMODEL_NATIVE) {
+			if (copyin(timeout, &ts, sizeof (ts)) != 0)
+				return (EFAULT);
+		}
+#ifdef	_SYSCALL32_IMPL
+		else {
+			timespec32_t ts32;
+
+			if (copyin(timeout, &ts32, sizeof (ts32)) != 0)
+				return (EFAULT);
+			TIMESPEC32_TO_TIMESPEC(&ts, &ts32);
+		}
+#endif	/* _SYSCALL32_IMPL */
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 || ts.tv_nsec >= NANOSEC)
+			return (EINVAL);
+		rqtp = &ts;
+	}
+
+	if ((ar = aio_ring_hold(id)) == NULL)
+		return (EINVAL);
+
+	mutex_enter(&ar->ar_lock);
+	if (min_complete > ar->ar_cq_entries) {
+		error = EINVAL;
+		goto out;
+	}
+
+	avail = ar->ar_hdr->arh_sq_tail - ar->ar_sq_head;
+	if (avail > ar->ar_sq_entries) {
+		error = EINVAL;
+		goto out;
+	}
+	submitted = MIN(to_submit, avail);
+
+	if (ar->ar_workers == 0) {
+		/*
+		 * With nobody to hand them to, run the requests here.
+		 */
+		uint_t n;
+
+		for (n = 0; n < submitted; n++) {
+			if (!aio_ring_take(ar, &sqe))
+				break;
+			if (aio_ring_run(ar, &sqe) != 0) {
+				n++;
+				break;
+			}
+		}
+		submitted = n;
+	} else if (submitted >= ar->ar_idle) {
+		cv_broadcast(&ar->ar_workcv);
+	} else {
+		uint_t n;
+
+		for (n = 0; n < submitted; n++)
+			cv_signal(&ar->ar_workcv);
+	}
+
+	if (!(flags & AIORING_ENTER_GETEVENTS))
+		goto out;
+
+	/*
+	 * Establish the absolute future time for the timeout.
+	 */
+	if (rqtp != NULL) {
+		timestruc_t now;
+
+		timecheck = timechanged;
+		gethrestime(&now);
+		timespecadd(rqtp, &now);
+	}
+
+	ar->ar_cqwaiters++;
+	while (ar->ar_cq_tail - ar->ar_hdr->arh_cq_head < min_complete) {
+		if (ar->ar_flags & AR_CLOSING) {
+			error = EINVAL;
+			break;
+		}
+		rv = cv_waituntil_sig(&ar->ar_cqcv, &ar->ar_lock, rqtp,
+		    timecheck);
+		if (rv == 0) {
+			error = EINTR;
+			break;
+		}
+		if (rv < 0) {
+			error = ETIME;
+			break;
+		}
+	}
+	ar->ar_cqwaiters--;
+
+out:
+	mutex_exit(&ar->ar_lock);
+	aio_ring_rele(ar);
+	*rvalp = submitted;
+	return (error);
+}
+
+int
+aio_ring_destroy(int id)
+{
+	aio_t *aiop = curproc->p_aio;
+	aio_ring_t *ar, **arp;
+
+	if (aiop == NULL)
+		return (EINVAL);
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	for (arp = &aiop->aio_rings; (ar = *arp) != NULL;
+	    arp = &ar->ar_next) {
+		if (ar->ar_id == id) {
+			/* Leave a ring that is being set up to its creator */
+			if (ar->ar_flags & AR_SETUP)
+				ar = NULL;
+			else
+				*arp = ar->ar_next;
+			break;
+		}
+	}
+	mutex_exit(&aiop->aio_ring_mutex);
+
+	if (ar == NULL)
+		return (EINVAL);
+	aio_ring_close(ar);
+	return (0);
+}
+
+/*
+ * Destroy all of the process's rings.  Called on exec() and exit(), once
+ * the process is single-threaded.
+ */
+void
+aio_ring_exit(void)
+{
+	aio_t *aiop = curproc->p_aio;
+	aio_ring_t *ar;
+
+	ASSERT(curproc->p_lwpcnt == 1);
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	while ((ar = aiop->aio_rings) != NULL) {
+		aiop->aio_rings = ar->ar_next;
+		mutex_exit(&aiop->aio_ring_mutex);
+		aio_ring_close(ar);
+		mutex_enter(&aiop->aio_ring_mutex);
+	}
+	mutex_exit(&aiop->aio_ring_mutex);
+}
+
+/*
+ * Called just before a completion notice is retrieved from the port; fill
+ * in the number of completions posted since it was sent and allow it to
+ * be sent again.
+ */
+/* ARGSUSED */
+static int
+aio_ring_port_callback(void *arg, int *events, pid_t pid, int flag, void *evp)
+{
+	aio_ring_t *ar = arg;
+
+	if (pid != curproc->p_pid)
+		return (EACCES);
+
+	mutex_enter(&ar->ar_lock);
+	*events = ar->ar_portpend;
+	ar->ar_portpend = 0;
+	mutex_exit(&ar->ar_lock);
+	return (0);
+}
+
+/*
+ * The port is being closed; free the completion notice events of all of
+ * the process's rings that use it.
+ */
+/* ARGSUSED */
+static void
+aio_ring_close_port(void *arg, int port, pid_t pid, int lastclose)
+{
+	aio_t *aiop = curproc->p_aio;
+	aio_ring_t *ar;
+	port_kevent_t *pev;
+
+	if (aiop == NULL)
+		return;
+
+	mutex_enter(&aiop->aio_ring_mutex);
+	for (ar = aiop->aio_rings; ar != NULL; ar = ar->ar_next) {
+		mutex_enter(&ar->ar_lock);
+		if (ar->ar_portev == NULL || ar->ar_port != port) {
+			mutex_exit(&ar->ar_lock);
+			continue;
+		}
+		pev = ar->ar_portev;
+		ar->ar_portev = NULL;
+		ar->ar_portpend = 0;
+		mutex_exit(&ar->ar_lock);
+		(void) port_remove_done_event(pev);
+		port_free_event(pev);
+	}
+	mutex_exit(&aiop->aio_ring_mutex);
+}
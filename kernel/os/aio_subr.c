@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #include <sys/proc.h>
 #include <sys/file.h>
+#include <sys/vnode.h>
 #include <sys/errno.h>
 #include <sys/param.h>
 #include <sys/sysmacros.h>
@@ -38,6 +39,7 @@
 #include <sys/kmem.h>
 #include <sys/debug.h>
 #include <sys/aio_impl.h>
+#include <sys/aio_ring.h>
 #include <sys/epm.h>
 #include <sys/fs/snode.h>
 #include <sys/siginfo.h>
@@ -413,6 +415,130 @@ aio_done(struct buf *bp)
 		port_send_event(lio_pkevp);
 }
 
+/*
+ * Prepare an async read or write of a file for a file system's fop_aio():
+ * lock down the user's buffer and map it into the kernel, so that the file
+ * system can move the data and complete the request with aio_vnio_done()
+ * from any context.  The kernel address of the buffer is returned in
+ * *kaddrp.  Once this succeeds, the file system must complete the request
+ * with aio_vnio_done(), even if it fails, and return 0 from fop_aio().
+ */
+int
+aio_vnio_start(struct aio_req *aio, int rw, caddr_t *kaddrp)
+{
+	aio_req_t *reqp = (aio_req_t *)aio->aio_private;
+	struct buf *bp = &reqp->aio_req_buf;
+	struct iovec *iov = aio->aio_uio->uio_iov;
+	struct page **pplist;
+	int error;
+
+	if (aio->aio_uio->uio_loffset < 0)
+		return (EINVAL);
+
+	sema_init(&bp->b_sem, 0, NULL, SEMA_DEFAULT, NULL);
+	sema_init(&bp->b_io, 0, NULL, SEMA_DEFAULT, NULL);
+
+	bp->b_error = 0;
+	bp->b_flags = B_BUSY | B_PHYS | B_ASYNC |
+	    (rw == FREAD ? B_READ : B_WRITE);
+	bp->b_offset = aio->aio_uio->uio_loffset;
+	bp->b_iodone = (int (*)()) aio_done;
+	/* b_forw points at an aio_req_t structure */
+	bp->b_forw = (struct buf *)reqp;
+	bp->b_proc = curproc;
+	bp->b_un.b_addr = iov->iov_base;
+	bp->b_bcount = iov->iov_len;
+
+	error = as_pagelock(curproc->p_as, &pplist, iov->iov_base,
+	    iov->iov_len, rw == FREAD ? S_WRITE : S_READ);
+	if (error != 0) {
+		bp->b_flags &= ~(B_BUSY|B_PHYS);
+		return (error);
+	}
+	reqp->aio_req_flags |= AIO_PAGELOCKDONE;
+	bp->b_shadow = pplist;
+	if (pplist != NULL)
+		bp->b_flags |= B_SHADOW;
+
+	bp_mapin(bp);
+	*kaddrp = bp->b_un.b_addr;
+	return (0);
+}
+
+/*
+ * Complete a request started by aio_vnio_start() or aio_vnio_rw(); resid
+ * is the number of bytes not transferred.  May be called from interrupt
+ * context.
+ */
+void
+aio_vnio_done(struct aio_req *aio, size_t resid, int error)
+{
+	aio_req_t *reqp = (aio_req_t *)aio->aio_private;
+	struct buf *bp = &reqp->aio_req_buf;
+
+	bp->b_resid = resid;
+	if (error != 0) {
+		bp->b_error = error;
+		bp->b_flags |= B_ERROR;
+	}
+	biodone(bp);
+}
+
+/*
+ * Carry out an async read or write of a file synchronously, in the calling
+ * thread, and complete it.  For file systems whose reads and writes don't
+ * wait for devices (tmpfs), this is as asynchronous as it gets.  Others
+ * must not use it: a request they can't start without blocking should get
+ * ENOTSUP from fop_aio(), so that libc carries it out in its own thread.
+ */
+int
+aio_vnio_rw(vnode_t *vp, struct aio_req *aio, int rw, cred_t *cr,
+    caller_context_t *ct)
+{
+	aio_req_t *reqp = (aio_req_t *)aio->aio_private;
+	struct buf *bp = &reqp->aio_req_buf;
+	struct iovec iov = *aio->aio_uio->uio_iov;
+	struct uio uio;
+	int rwflag, ioflag, error;
+
+	if (aio->aio_uio->uio_loffset < 0)
+		return (EINVAL);
+
+	bzero(&uio, sizeof (uio));
+	uio.uio_iov = &iov;
+	uio.uio_iovcnt = 1;
+	uio.uio_loffset = aio->aio_uio->uio_loffset;
+	uio.uio_resid = iov.iov_len;
+	uio.uio_segflg = UIO_USERSPACE;
+	uio.uio_fmode = aio->aio_uio->uio_fmode;
+	uio.uio_extflg = UIO_COPY_DEFAULT;
+	ioflag = uio.uio_fmode & (FAPPEND|FSYNC|FDSYNC|FRSYNC);
+
+	rwflag = (rw == FWRITE) ? V_WRITELOCK_TRUE : V_WRITELOCK_FALSE;
+	(void) fop_rwlock(vp, rwflag, ct);
+	if (rw == FWRITE) {
+		uio.uio_llimit = curproc->p_fsz_ctl;
+		error = fop_write(vp, &uio, ioflag, cr, ct);
+	} else {
+		uio.uio_llimit = MAXOFFSET_T;
+		error = fop_read(vp, &uio, ioflag, cr, ct);
+	}
+	fop_rwunlock(vp, rwflag, ct);
+
+	bp->b_flags = B_BUSY | B_ASYNC | (rw == FREAD ? B_READ : B_WRITE);
+	bp->b_iodone = (int (*)()) aio_done;
+	bp->b_forw = (struct buf *)reqp;
+	bp->b_proc = curproc;
+
+	/*
+	 * As with write(2), a partial transfer isn't an error.
+	 */
+	if (error != 0 && uio.uio_resid != iov.iov_len)
+		error = 0;
+	aio_vnio_done(aio, uio.uio_resid, error);
+	return (0);
+}
+
 /*
  * send a queued signal to the specified process when
  * the event signal is non-NULL. A return value of 1
@@ -1018,6 +1144,8 @@ aio_cleanup_exit(void)
 	 * is now single-threaded; no other kaio requests can
 	 * happen once aio_pending is zero.
 	 */
+	aio_ring_exit();
+
 	mutex_enter(&aiop->aio_mutex);
 	aiop->aio_flags |= AIO_CLEANUP;
 	while ((aiop->aio_pending != 0) || (aiop->aio_flags & AIO_DONE_ACTIVE))
@@ -1068,6 +1196,7 @@ aio_cleanup_exit(void)
 	mutex_destroy(&aiop->aio_mutex);
 	mutex_destroy(&aiop->aio_portq_mutex);
 	mutex_destroy(&aiop->aio_cleanupq_mutex);
+	mutex_destroy(&aiop->aio_ring_mutex);
 	p->p_aio = NULL;
 	mutex_exit(&p->p_lock);
 	kmem_free(aiop, sizeof (struct aio));
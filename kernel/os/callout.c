@@ -36,6 +36,7 @@
 #include <sys/vtrace.h>
 #include <sys/sysmacros.h>
 #include <sys/sdt.h>
+#include <sys/bitmap.h>
 
 int callout_init_done;				/* useful during boot */
 
@@ -47,6 +48,9 @@ static hrtime_t callout_debug_hrtime;		/* debugger entry time */
 static int callout_chunk;			/* callout heap chunk size */
 static int callout_min_reap;			/* callout minimum reap count */
 static int callout_tolerance;			/* callout hires tolerance */
+static int callout_slack_shift;			/* callout lowres slack */
+static int callout_wheel_disable;		/* use the heap for all */
+static hrtime_t callout_wheel_res;		/* callout wheel tick */
 static callout_table_t *callout_boot_ct;	/* Boot CPU's callout tables */
 static clock_t callout_max_ticks;		/* max interval */
 static hrtime_t callout_longterm;		/* longterm nanoseconds */
@@ -75,6 +79,11 @@ static char *callout_kstat_names[] = {
 	"callout_expirations",
 	"callout_allocations",
 	"callout_cleanups",
+	"callout_wheel_timeouts",
+	"callout_wheel_untimeouts",
+	"callout_wheel_batches",
+	"callout_wheel_cascades",
+	"callout_wheel_coalesced",
 };
 
 static hrtime_t	callout_heap_process(callout_table_t *, hrtime_t, int);
@@ -173,6 +182,12 @@ static hrtime_t	callout_heap_process(callout_table_t *, hrtime_t, int);
 #define	CALLOUT_LIST_DELETE(hash, cl)				\
 	CALLOUT_HASH_DELETE(hash, cl, cl_next, cl_prev)
 
+#define	CALLOUT_WHEEL_APPEND(hash, cl)				\
+	CALLOUT_HASH_APPEND(hash, cl, cl_wnext, cl_wprev)
+
+#define	CALLOUT_WHEEL_DELETE(hash, cl)				\
+	CALLOUT_HASH_DELETE(hash, cl, cl_wnext, cl_wprev)
+
 #define	CALLOUT_LIST_BEFORE(cl, nextcl)			\
 {							\
 	(cl)->cl_prev = (nextcl)->cl_prev;		\
@@ -508,6 +523,352 @@ callout_queue_process(callout_table_t *ct, hrtime_t delta, int timechange)
 	return (cl->cl_expiration);
 }
 
+/*
+ * Low-resolution callout lists are kept in the callout table's timing wheel
+ * (see callo.h) rather than in its heap. The wheel works in ticks of
+ * callout_wheel_res nanoseconds: a callout list is processed in the first
+ * tick that starts at or after its expiration. The wheel has its own
+ * cyclic, which is programmed for the next tick that has work to do,
+ * either a level 0 slot to expire or a higher level slot to cascade, so an
+ * idle wheel costs nothing.
+ */
+static uint64_t
+callout_wheel_tick(hrtime_t expiration)
+{
+	uint64_t tick;
+
+	tick = expiration / callout_wheel_res;
+	if (expiration % callout_wheel_res != 0)
+		tick++;
+
+	return (tick);
+}
+
+/*
+ * Find the next tick at which there is something to do in the wheel, or
+ * UINT64_MAX if the wheel is empty.
+ */
+static uint64_t
+callout_wheel_next(callout_wheel_t *cw)
+{
+	uint64_t next, base, bits;
+	int level, shift, slot;
+
+	next = UINT64_MAX;
+	for (level = 0; level < CALLOUT_WHEEL_LEVELS; level++) {
+		if ((bits = cw->cw_bitmap[level]) == 0)
+			continue;
+
+		/*
+		 * Find the first period of this level that starts at or
+		 * after cw_now, and the first non-empty slot from there on.
+		 */
+		shift = CALLOUT_WHEEL_SHIFT(level);
+		base = P2ROUNDUP(cw->cw_now, 1ULL << shift) >> shift;
+		slot = base & CALLOUT_WHEEL_MASK;
+		if (slot != 0)
+			bits = (bits >> slot) | (bits << (64 - slot));
+		base += lowbit(bits) - 1;
+
+		next = MIN(next, base << shift);
+	}
+
+	return (next);
+}
+
+/*
+ * Add a callout list to a callout table's wheel. Returns the tick at which
+ * the wheel has to process the slot it went into.
+ */
+static uint64_t
+callout_wheel_add(callout_table_t *ct, callout_list_t *cl)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	uint64_t tick, delta;
+	int level, shift, slot;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	tick = callout_wheel_tick(cl->cl_expiration);
+	if (tick < cw->cw_now)
+		tick = cw->cw_now;
+	delta = tick - cw->cw_now;
+	if (delta >= CALLOUT_WHEEL_SPAN) {
+		/*
+		 * Too far out for the wheel. Park it in the top level; it
+		 * will be put back where it belongs when that slot is
+		 * cascaded.
+		 */
+		delta = CALLOUT_WHEEL_SPAN - 1;
+		tick = cw->cw_now + delta;
+	}
+
+	for (level = 0; level < CALLOUT_WHEEL_LEVELS - 1; level++) {
+		if (delta < (1ULL << CALLOUT_WHEEL_SHIFT(level + 1)))
+			break;
+	}
+	shift = CALLOUT_WHEEL_SHIFT(level);
+	slot = (tick >> shift) & CALLOUT_WHEEL_MASK;
+
+	cl->cl_slot = &cw->cw_slots[level][slot];
+	CALLOUT_WHEEL_APPEND(*cl->cl_slot, cl);
+	cl->cl_flags |= CALLOUT_LIST_FLAG_WHEELED;
+	cw->cw_bitmap[level] |= 1ULL << slot;
+	cw->cw_num++;
+
+	return ((tick >> shift) << shift);
+}
+
+/*
+ * Remove a callout list from a callout table's wheel.
+ */
+static void
+callout_wheel_remove(callout_table_t *ct, callout_list_t *cl)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_hash_t *slot = cl->cl_slot;
+	int ndx;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+	ASSERT(cl->cl_flags & CALLOUT_LIST_FLAG_WHEELED);
+
+	CALLOUT_WHEEL_DELETE(*slot, cl);
+	if (slot->ch_head == NULL) {
+		ndx = slot - &cw->cw_slots[0][0];
+		cw->cw_bitmap[ndx >> CALLOUT_WHEEL_BITS] &=
+		    ~(1ULL << (ndx & CALLOUT_WHEEL_MASK));
+	}
+	cl->cl_flags &= ~CALLOUT_LIST_FLAG_WHEELED;
+	cl->cl_slot = NULL;
+	cw->cw_num--;
+}
+
+/*
+ * Insert a callout list into a callout table's wheel and reprogram the
+ * wheel cyclic if needed.
+ */
+static void
+callout_wheel_insert(callout_table_t *ct, callout_list_t *cl)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	hrtime_t expiration;
+
+	expiration = callout_wheel_add(ct, cl) * callout_wheel_res;
+
+	/*
+	 * As with the heap and the queue, do not reprogram the cyclic
+	 * during the CPR suspend phase.
+	 */
+	if ((expiration < cw->cw_next) && (ct->ct_suspend == 0)) {
+		cw->cw_next = expiration;
+		(void) cyclic_reprogram(ct->ct_wcyclic, expiration);
+	}
+}
+
+/*
+ * Move every callout list in a slot of the wheel down to where it now
+ * belongs.
+ */
+static void
+callout_wheel_cascade(callout_table_t *ct, int level, int slot)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_hash_t temp;
+	callout_list_t *cl;
+
+	temp = cw->cw_slots[level][slot];
+	cw->cw_slots[level][slot].ch_head = NULL;
+	cw->cw_slots[level][slot].ch_tail = NULL;
+	cw->cw_bitmap[level] &= ~(1ULL << slot);
+
+	while ((cl = temp.ch_head) != NULL) {
+		CALLOUT_WHEEL_DELETE(temp, cl);
+		cw->cw_num--;
+		(void) callout_wheel_add(ct, cl);
+		ct->ct_wheel_cascades++;
+	}
+}
+
+/*
+ * Move every callout list in a level 0 slot of the wheel to the list of
+ * expired callout lists.
+ */
+static void
+callout_wheel_expire(callout_table_t *ct, int slot)
+{
+	callout_hash_t *slotp = &ct->ct_wheel->cw_slots[0][slot];
+	callout_list_t *cl;
+	int hash;
+
+	while ((cl = slotp->ch_head) != NULL) {
+		callout_wheel_remove(ct, cl);
+		hash = CALLOUT_CLHASH(cl->cl_expiration);
+		CALLOUT_LIST_DELETE(ct->ct_clhash[hash], cl);
+		CALLOUT_LIST_APPEND(ct->ct_expired, cl);
+		ct->ct_wheel_batches++;
+	}
+}
+
+/*
+ * Delete and handle all past expirations in a callout table's wheel.
+ */
+static hrtime_t
+callout_wheel_delete(callout_table_t *ct)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	uint64_t now, tick;
+	hrtime_t expiration;
+	int level, shift;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	now = gethrtime() / callout_wheel_res;
+	while ((tick = callout_wheel_next(cw)) <= now) {
+		/*
+		 * Cascade the slots whose periods start at this tick, from
+		 * the top down, so that lists can fall more than one level.
+		 * Then expire the level 0 slot for the tick.
+		 */
+		cw->cw_now = tick;
+		for (level = CALLOUT_WHEEL_LEVELS - 1; level > 0; level--) {
+			shift = CALLOUT_WHEEL_SHIFT(level);
+			if (P2PHASE(tick, 1ULL << shift) == 0) {
+				callout_wheel_cascade(ct, level,
+				    (tick >> shift) & CALLOUT_WHEEL_MASK);
+			}
+		}
+		callout_wheel_expire(ct, tick & CALLOUT_WHEEL_MASK);
+		cw->cw_now = tick + 1;
+	}
+
+	/*
+	 * Nothing else is due before now; skip the empty ticks.
+	 */
+	if (cw->cw_now <= now)
+		cw->cw_now = now + 1;
+
+	/*
+	 * If the wheel is empty or callouts have been suspended, just
+	 * return. The cyclic has already been programmed to infinity by the
+	 * cyclic subsystem.
+	 */
+	if ((cw->cw_num == 0) || (ct->ct_suspend > 0)) {
+		cw->cw_next = CY_INFINITY;
+		return (CY_INFINITY);
+	}
+
+	expiration = callout_wheel_next(cw) * callout_wheel_res;
+	cw->cw_next = expiration;
+	(void) cyclic_reprogram(ct->ct_wcyclic, expiration);
+
+	return (expiration);
+}
+
+/*
+ * Rebuild a callout table's wheel, after a suspend or when system time
+ * changes; this is the wheel's counterpart of callout_heap_process().
+ */
+static hrtime_t
+callout_wheel_process(callout_table_t *ct, hrtime_t delta, int timechange)
+{
+	callout_wheel_t *cw = ct->ct_wheel;
+	callout_list_t *cl;
+	callout_hash_t temp;
+	hrtime_t expiration, now;
+	int level, slot, hash, clflags;
+
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+
+	/*
+	 * Empty the wheel, then either expire each callout list or apply
+	 * any adjustments needed to it and put it back.
+	 */
+	temp.ch_head = NULL;
+	temp.ch_tail = NULL;
+	for (level = 0; level < CALLOUT_WHEEL_LEVELS; level++) {
+		for (slot = 0; slot < CALLOUT_WHEEL_SLOTS; slot++) {
+			while ((cl = cw->cw_slots[level][slot].ch_head) !=
+			    NULL) {
+				callout_wheel_remove(ct, cl);
+				CALLOUT_WHEEL_APPEND(temp, cl);
+			}
+		}
+	}
+	ASSERT(cw->cw_num == 0);
+
+	clflags = (CALLOUT_LIST_FLAG_HRESTIME | CALLOUT_LIST_FLAG_ABSOLUTE);
+	now = gethrtime();
+	cw->cw_now = now / callout_wheel_res + 1;
+	while ((cl = temp.ch_head) != NULL) {
+		CALLOUT_WHEEL_DELETE(temp, cl);
+		hash = CALLOUT_CLHASH(cl->cl_expiration);
+
+		if ((cl->cl_expiration <= now) ||
+		    (timechange && ((cl->cl_flags & clflags) == clflags))) {
+			CALLOUT_LIST_DELETE(ct->ct_clhash[hash], cl);
+			CALLOUT_LIST_APPEND(ct->ct_expired, cl);
+			continue;
+		}
+
+		if (delta && !(cl->cl_flags & CALLOUT_LIST_FLAG_ABSOLUTE)) {
+			CALLOUT_LIST_DELETE(ct->ct_clhash[hash], cl);
+			expiration = cl->cl_expiration + delta;
+			if (expiration <= 0)
+				expiration = CY_INFINITY;
+			cl->cl_expiration = expiration;
+			hash = CALLOUT_CLHASH(cl->cl_expiration);
+			CALLOUT_LIST_INSERT(ct->ct_clhash[hash], cl);
+		}
+
+		(void) callout_wheel_add(ct, cl);
+	}
+
+	if (ct->ct_expired.ch_head != NULL)
+		expiration = gethrtime();
+	else if (cw->cw_num == 0)
+		expiration = CY_INFINITY;
+	else
+		expiration = callout_wheel_next(cw) * callout_wheel_res;
+	cw->cw_next = expiration;
+
+	return (expiration);
+}
+
+/*
+ * Defer the expiration of a low-resolution callout by up to its slack, to
+ * the tick in that window with the most trailing zero bits. Callouts that
+ * are armed at around the same time for around the same interval then end
+ * up with the same expiration, and so in the same callout list, which is
+ * expired as one batch.
+ */
+static hrtime_t
+callout_wheel_slack(hrtime_t expiration, hrtime_t interval)
+{
+	uint64_t tick, limit, mask;
+	hrtime_t slack;
+
+	if ((callout_slack_shift == 0) || (interval <= 0))
+		return (expiration);
+
+	/*
+	 * An expiration within the slack of CY_INFINITY (including
+	 * CY_INFINITY itself) would overflow and fire at once; leave it be.
+	 */
+	slack = interval >> callout_slack_shift;
+	if (expiration >= CY_INFINITY - slack)
+		return (expiration);
+
+	tick = callout_wheel_tick(expiration);
+	limit = (expiration + slack) / callout_wheel_res;
+	if (limit <= tick)
+		return (expiration);
+
+	mask = (1ULL << (highbit64(tick ^ limit) - 1)) - 1;
+	tick = limit & ~mask;
+
+	return (tick * callout_wheel_res);
+}
+
 /*
  * Initialize a callout table's heap, if necessary. Preallocate some free
  * entries so we don't have to check for NULL elsewhere.
@@ -986,7 +1347,7 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 	callout_id_t id;
 	callout_list_t *cl;
 	hrtime_t now, interval;
-	int hash, clflags;
+	int hash, clflags, wheel;
 
 	ASSERT(resolution > 0);
 	ASSERT(func != NULL);
@@ -1099,6 +1460,22 @@ timeout_generic(int type, void (*func)(void *), void *arg,
 		clflags |= CALLOUT_LIST_FLAG_HRESTIME;
 	if (resolution == 1)
 		clflags |= CALLOUT_LIST_FLAG_NANO;
+
+	/*
+	 * Callouts of a tick or more in resolution go into the wheel, unless
+	 * they are hrestime ones, which have to be found in a hurry when
+	 * system time changes. Let these share an expiration if they can.
+	 */
+	wheel = (resolution >= callout_wheel_res) &&
+	    !(clflags & CALLOUT_LIST_FLAG_HRESTIME) && !callout_wheel_disable;
+	if (wheel) {
+		hrtime_t slack = callout_wheel_slack(expiration, interval);
+
+		if (slack != expiration) {
+			expiration = slack;
+			ct->ct_wheel_coalesced++;
+		}
+	}
 	hash = CALLOUT_CLHASH(expiration);
 
 again:
@@ -1128,6 +1505,12 @@ again:
 		cl->cl_expiration = expiration;
 		cl->cl_flags = clflags;
 
+		if (wheel) {
+			CALLOUT_LIST_INSERT(ct->ct_clhash[hash], cl);
+			callout_wheel_insert(ct, cl);
+			goto out;
+		}
+
 		/*
 		 * Check if we have enough space in the heap to insert one
 		 * expiration. If not, expand the heap.
@@ -1179,6 +1562,8 @@ out:
 
 	ct->ct_timeouts++;
 	ct->ct_timeouts_pending++;
+	if (cl->cl_flags & CALLOUT_LIST_FLAG_WHEELED)
+		ct->ct_wheel_timeouts++;
 
 	mutex_exit(&ct->ct_mutex);
 
@@ -1308,12 +1693,13 @@ untimeout_generic(callout_id_t id, int nowait)
 
 			/*
 			 * Delete the callout. If the callout list becomes
-			 * NULL, we don't remove it from the table. This is
-			 * so it can be reused. If the empty callout list
-			 * corresponds to the top of the the callout heap, we
-			 * don't reprogram the table cyclic here. This is in
-			 * order to avoid lots of X-calls to the CPU associated
-			 * with the callout table.
+			 * NULL and is in the heap, we don't remove it from
+			 * the table. This is so it can be reused. If the
+			 * empty callout list corresponds to the top of the
+			 * the callout heap, we don't reprogram the table
+			 * cyclic here. This is in order to avoid lots of
+			 * X-calls to the CPU associated with the callout
+			 * table. The same goes for the wheel cyclic.
 			 */
 			cl = cp->c_list;
 			expiration = cl->cl_expiration;
@@ -1321,12 +1707,16 @@ untimeout_generic(callout_id_t id, int nowait)
 			CALLOUT_FREE(ct, cp);
 			ct->ct_untimeouts_unexpired++;
 			ct->ct_timeouts_pending--;
+			if (cl->cl_flags & CALLOUT_LIST_FLAG_WHEELED)
+				ct->ct_wheel_untimeouts++;
 
 			/*
-			 * If the callout list has become empty, there are 3
+			 * If the callout list has become empty, there are 4
 			 * possibilities. If it is present:
 			 *	- in the heap, it needs to be cleaned along
 			 *	  with its heap entry. Increment a reap count.
+			 *	- in the wheel, take it out (which is cheap)
+			 *	  and free it.
 			 *	- in the callout queue, free it.
 			 *	- in the expired list, free it.
 			 */
@@ -1334,6 +1724,11 @@ untimeout_generic(callout_id_t id, int nowait)
 				flags = cl->cl_flags;
 				if (flags & CALLOUT_LIST_FLAG_HEAPED) {
 					ct->ct_nreap++;
+				} else if (flags & CALLOUT_LIST_FLAG_WHEELED) {
+					callout_wheel_remove(ct, cl);
+					CALLOUT_LIST_DELETE(ct->ct_clhash[
+					    CALLOUT_CLHASH(expiration)], cl);
+					CALLOUT_LIST_FREE(ct, cl);
 				} else if (flags & CALLOUT_LIST_FLAG_QUEUED) {
 					CALLOUT_LIST_DELETE(ct->ct_queue, cl);
 					CALLOUT_LIST_FREE(ct, cl);
@@ -1573,6 +1968,15 @@ callout_queue_realtime(callout_table_t *ct)
 	mutex_exit(&ct->ct_mutex);
 }
 
+void
+callout_wheel_realtime(callout_table_t *ct)
+{
+	mutex_enter(&ct->ct_mutex);
+	(void) callout_wheel_delete(ct);
+	callout_expire(ct);
+	mutex_exit(&ct->ct_mutex);
+}
+
 void
 callout_execute(callout_table_t *ct)
 {
@@ -1620,6 +2024,24 @@ callout_queue_normal(callout_table_t *ct)
 	}
 }
 
+void
+callout_wheel_normal(callout_table_t *ct)
+{
+	int i, exec;
+	hrtime_t exp;
+
+	mutex_enter(&ct->ct_mutex);
+	exp = callout_wheel_delete(ct);
+	CALLOUT_EXEC_COMPUTE(ct, exp, exec);
+	mutex_exit(&ct->ct_mutex);
+
+	for (i = 0; i < exec; i++) {
+		ASSERT(ct->ct_taskq != NULL);
+		(void) taskq_dispatch(ct->ct_taskq,
+		    (task_func_t *)callout_execute, ct, TQ_NOSLEEP);
+	}
+}
+
 /*
  * Suspend callout processing.
  */
@@ -1652,6 +2074,9 @@ callout_suspend(void)
 				    CY_INFINITY);
 				(void) cyclic_reprogram(ct->ct_qcyclic,
 				    CY_INFINITY);
+				(void) cyclic_reprogram(ct->ct_wcyclic,
+				    CY_INFINITY);
+				ct->ct_wheel->cw_next = CY_INFINITY;
 			}
 			mutex_exit(&ct->ct_mutex);
 		}
@@ -1664,7 +2089,7 @@ callout_suspend(void)
 static void
 callout_resume(hrtime_t delta, int timechange)
 {
-	hrtime_t hexp, qexp;
+	hrtime_t hexp, qexp, wexp;
 	int t, f;
 	callout_table_t *ct;
 
@@ -1693,11 +2118,13 @@ callout_resume(hrtime_t delta, int timechange)
 			 */
 			hexp = callout_heap_process(ct, delta, timechange);
 			qexp = callout_queue_process(ct, delta, timechange);
+			wexp = callout_wheel_process(ct, delta, timechange);
 
 			ct->ct_suspend--;
 			if (ct->ct_suspend == 0) {
 				(void) cyclic_reprogram(ct->ct_cyclic, hexp);
 				(void) cyclic_reprogram(ct->ct_qcyclic, qexp);
+				(void) cyclic_reprogram(ct->ct_wcyclic, wexp);
 			}
 
 			mutex_exit(&ct->ct_mutex);
@@ -1768,6 +2195,7 @@ callout_hrestime_one(callout_table_t *ct)
 
 	/*
 	 * Walk the heap and process all the absolute hrestime entries.
+	 * There are none in the wheel.
 	 */
 	hexp = callout_heap_process(ct, 0, 1);
 	qexp = callout_queue_process(ct, 0, 1);
@@ -1807,6 +2235,20 @@ callout_hrestime(void)
 	}
 }
 
+/*
+ * Create the timing wheel for this callout table.
+ */
+static void
+callout_wheel_init(callout_table_t *ct)
+{
+	ASSERT(MUTEX_HELD(&ct->ct_mutex));
+	ASSERT(ct->ct_wheel == NULL);
+
+	ct->ct_wheel = kmem_zalloc(sizeof (callout_wheel_t), KM_SLEEP);
+	ct->ct_wheel->cw_now = gethrtime() / callout_wheel_res + 1;
+	ct->ct_wheel->cw_next = CY_INFINITY;
+}
+
 /*
  * Create the hash tables for this callout table.
  */
@@ -1860,7 +2302,7 @@ callout_cyclic_init(callout_table_t *ct)
 	cyc_time_t when;
 	processorid_t seqid;
 	int t;
-	cyclic_id_t cyclic, qcyclic;
+	cyclic_id_t cyclic, qcyclic, wcyclic;
 
 	ASSERT(MUTEX_HELD(&ct->ct_mutex));
 
@@ -1941,9 +2383,17 @@ callout_cyclic_init(callout_table_t *ct)
 
 	qcyclic = cyclic_add(&hdlr, &when);
 
+	if (t == CALLOUT_REALTIME)
+		hdlr.cyh_func = (cyc_func_t)callout_wheel_realtime;
+	else
+		hdlr.cyh_func = (cyc_func_t)callout_wheel_normal;
+
+	wcyclic = cyclic_add(&hdlr, &when);
+
 	mutex_enter(&ct->ct_mutex);
 	ct->ct_cyclic = cyclic;
 	ct->ct_qcyclic = qcyclic;
+	ct->ct_wcyclic = wcyclic;
 }
 
 void
@@ -2007,6 +2457,7 @@ callout_cpu_online(cpu_t *cp)
 		 */
 		if (ct->ct_heap == NULL) {
 			callout_heap_init(ct);
+			callout_wheel_init(ct);
 			callout_hash_init(ct);
 			callout_kstat_init(ct);
 			callout_cyclic_init(ct);
@@ -2019,6 +2470,7 @@ callout_cpu_online(cpu_t *cp)
 		 */
 		cyclic_bind(ct->ct_cyclic, cp, NULL);
 		cyclic_bind(ct->ct_qcyclic, cp, NULL);
+		cyclic_bind(ct->ct_wcyclic, cp, NULL);
 	}
 }
 
@@ -2042,6 +2494,7 @@ callout_cpu_offline(cpu_t *cp)
 		 */
 		cyclic_bind(ct->ct_cyclic, NULL, NULL);
 		cyclic_bind(ct->ct_qcyclic, NULL, NULL);
+		cyclic_bind(ct->ct_wcyclic, NULL, NULL);
 	}
 }
 
@@ -2109,6 +2562,11 @@ callout_init(void)
 
 	if (callout_tolerance <= 0)
 		callout_tolerance = CALLOUT_TOLERANCE;
+	if (callout_slack_shift == 0)
+		callout_slack_shift = CALLOUT_SLACK_SHIFT;
+	else if (callout_slack_shift < 0)
+		callout_slack_shift = 0;	/* no slack */
+	callout_wheel_res = TICK_TO_NSEC(1);
 	if (callout_threads <= 0)
 		callout_threads = CALLOUT_THREADS;
 	if (callout_chunk <= 0)
@@ -2169,6 +2627,7 @@ callout_init(void)
 			 */
 			ct->ct_cyclic = CYCLIC_NONE;
 			ct->ct_qcyclic = CYCLIC_NONE;
+			ct->ct_wcyclic = CYCLIC_NONE;
 			ct->ct_kstat_data = kmem_zalloc(size, KM_SLEEP);
 		}
 	}
@@ -0,0 +1,423 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Epoch-based deferred reclamation.
+ *
+ * Many lookup structures take a lock on their read path only so that the
+ * object being looked at cannot be freed underneath the reader.  With this
+ * facility a reader instead brackets its lookup with epoch_enter() and
+ * epoch_exit(), which only disable kernel preemption, while writers still
+ * serialize among themselves, publish new objects with membar_producer(),
+ * and pass the objects they unlink to call_epoch() instead of freeing them.
+ * The callback runs once every reader that could have seen the object has
+ * left its epoch section:
+ *
+ *	reader:				writer:
+ *	epoch_enter();			mutex_enter(&lock);
+ *	for (o = head; o != NULL;	unlink o;
+ *	    o = o->o_next)		mutex_exit(&lock);
+ *		...;			call_epoch(&o->o_epoch, o_free);
+ *	epoch_exit();
+ *
+ * Grace periods
+ * -------------
+ *
+ * Since an epoch section cannot be preempted and must not block, a CPU that
+ * has context switched has left any epoch section it was in before the
+ * switch.  The dispatcher counts these quiescent states in cpu_epoch_qs (an
+ * interrupt thread blocking does not count: it resumes the thread it
+ * interrupted, which may be in an epoch section).  A grace period is over
+ * once every CPU that was running when it started has bumped its count, or
+ * has been seen running its idle thread.  A CPU that takes more than
+ * epoch_force_ticks to do either -- typically because it runs a single
+ * compute-bound thread -- is forced to switch by binding the epoch thread
+ * to it.
+ *
+ * Callbacks
+ * ---------
+ *
+ * call_epoch() queues its callback on a per-CPU list.  A single epoch thread
+ * takes all the lists at once, waits for a grace period, runs the callbacks
+ * in the order in which they were queued on each CPU, and waits epoch_delay
+ * ticks for more callbacks to batch up before the next grace period.  When
+ * nothing is queued it sleeps until call_epoch() wakes it.  Callbacks run in
+ * thread context and may block, but not on anything that waits for an epoch.
+ *
+ * Callbacks queued before epoch_init() wait on a boot list, which is handed
+ * to the epoch thread once it exists.
+ *
+ * epoch_synchronize() waits until a grace period has elapsed since it was
+ * called, and until every callback queued before the call has run.  Code
+ * whose callbacks live in a loadable module must call it before the module
+ * is unloaded.  Before epoch_init() (when only the boot CPU runs, and epoch
+ * sections cannot be preempted) it returns at once.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/epoch.h>
+#include <sys/kmem.h>
+#include <sys/mutex.h>
+#include <sys/condvar.h>
+#include <sys/thread.h>
+#include <sys/proc.h>
+#include <sys/disp.h>
+#include <sys/cpuvar.h>
+#include <sys/callb.h>
+#include <sys/kstat.h>
+#include <sys/atomic.h>
+#include <sys/sysmacros.h>
+#include <sys/ddi.h>
+
+typedef struct epoch_cpu {
+	kmutex_t	epc_lock;		/* protects the list */
+	epoch_cb_t	*epc_head;		/* queued callbacks */
+	epoch_cb_t	*epc_tail;
+	uint64_t	epc_queued;		/* # of callbacks queued */
+	char		epc_pad[64 - sizeof (kmutex_t) -
+			    2 * sizeof (epoch_cb_t *) - sizeof (uint64_t)];
+} epoch_cpu_t;
+
+typedef struct epoch_snap {
+	ulong_t		es_qs;		/* cpu_epoch_qs at grace period start */
+	boolean_t	es_wait;	/* CPU not quiescent yet */
+} epoch_snap_t;
+
+static epoch_cpu_t	*epoch_cpus;	/* [max_ncpus], per-CPU lists */
+static epoch_cpu_t	epoch_boot;	/* callbacks queued during boot */
+static epoch_snap_t	*epoch_snap;	/* [max_ncpus], epoch thread only */
+
+static kmutex_t		epoch_lock;	/* protects the following */
+static kcondvar_t	epoch_cv;	/* wakes up the epoch thread */
+static kcondvar_t	epoch_done_cv;	/* a batch has completed */
+static uint64_t		epoch_gen;	/* # of completed batches */
+static uint_t		epoch_waiters;	/* threads in epoch_synchronize() */
+static boolean_t	epoch_busy;	/* epoch thread working on a batch */
+static volatile uint_t	epoch_idle;	/* epoch thread waiting for work */
+static kthread_t	*epoch_thr;
+
+/*
+ * Ticks to wait for more callbacks after a batch, and ticks a CPU is given
+ * to switch before it is forced to (0 uses the default of 10ms for both).
+ */
+clock_t epoch_delay = 0;
+clock_t epoch_force_ticks = 0;
+
+static struct epoch_kstat {
+	kstat_named_t	ek_grace;
+	kstat_named_t	ek_forced;
+	kstat_named_t	ek_callbacks;
+	kstat_named_t	ek_synchronize;
+} epoch_kstat = {
+	{ "grace_periods",	KSTAT_DATA_UINT64 },
+	{ "forced_switches",	KSTAT_DATA_UINT64 },
+	{ "callbacks",		KSTAT_DATA_UINT64 },
+	{ "synchronize",	KSTAT_DATA_UINT64 },
+};
+
+static void
+epoch_enqueue(epoch_cpu_t *epc, epoch_cb_t *ec)
+{
+	ASSERT(MUTEX_HELD(&epc->epc_lock));
+
+	if (epc->epc_head == NULL)
+		epc->epc_head = ec;
+	else
+		epc->epc_tail->ec_next = ec;
+	epc->epc_tail = ec;
+	epc->epc_queued++;
+}
+
+/*
+ * Queue 'ec' to have 'func' called once no epoch section that is active now
+ * can still be looking at the object it is embedded in.
+ */
+void
+call_epoch(epoch_cb_t *ec, void (*func)(epoch_cb_t *))
+{
+	epoch_cpu_t *epc;
+	boolean_t first;
+
+	ec->ec_next = NULL;
+	ec->ec_func = func;
+
+	if (epoch_cpus == NULL) {
+		mutex_enter(&epoch_boot.epc_lock);
+		if (epoch_cpus == NULL) {
+			epoch_enqueue(&epoch_boot, ec);
+			mutex_exit(&epoch_boot.epc_lock);
+			return;
+		}
+		mutex_exit(&epoch_boot.epc_lock);
+	}
+
+	/*
+	 * Migrating after picking the list is harmless: any list will do.
+	 */
+	epc = &epoch_cpus[CPU->cpu_seqid];
+	mutex_enter(&epc->epc_lock);
+	first = (epc->epc_head == NULL);
+	epoch_enqueue(epc, ec);
+	mutex_exit(&epc->epc_lock);
+
+	if (first) {
+		membar_enter();
+		if (epoch_idle) {
+			mutex_enter(&epoch_lock);
+			cv_signal(&epoch_cv);
+			mutex_exit(&epoch_lock);
+		}
+	}
+}
+
+/*
+ * Take the callbacks queued on all CPUs.
+ */
+static epoch_cb_t *
+epoch_gather(void)
+{
+	epoch_cb_t *head = NULL, *tail = NULL;
+	epoch_cpu_t *epc;
+	int i;
+
+	for (i = 0; i < max_ncpus; i++) {
+		epc = &epoch_cpus[i];
+		if (epc->epc_head == NULL)
+			continue;
+		mutex_enter(&epc->epc_lock);
+		if (epc->epc_head != NULL) {
+			if (head == NULL)
+				head = epc->epc_head;
+			else
+				tail->ec_next = epc->epc_head;
+			tail = epc->epc_tail;
+			epc->epc_head = epc->epc_tail = NULL;
+		}
+		mutex_exit(&epc->epc_lock);
+	}
+	return (head);
+}
+
+static boolean_t
+epoch_pending(void)
+{
+	int i;
+
+	for (i = 0; i < max_ncpus; i++) {
+		if (epoch_cpus[i].epc_head != NULL)
+			return (B_TRUE);
+	}
+	return (B_FALSE);
+}
+
+/*
+ * Wait for a grace period: for every CPU that runs now to pass through a
+ * quiescent state.
+ */
+static void
+epoch_grace(void)
+{
+	epoch_snap_t *es;
+	cpu_t *cp;
+	clock_t waited = 0;
+	boolean_t done;
+
+	/*
+	 * Order the writers' unlinks, which precede their call_epoch(),
+	 * before the snapshot.  The CPU we run on is quiescent: we are not in
+	 * an epoch section, and nothing else can be running on it.
+	 */
+	membar_enter();
+	mutex_enter(&cpu_lock);
+	kpreempt_disable();
+	cp = cpu_list;
+	do {
+		es = &epoch_snap[cp->cpu_seqid];
+		es->es_qs = cp->cpu_epoch_qs;
+		es->es_wait = (cp != CPU);
+	} while ((cp = cp->cpu_next) != cpu_list);
+	kpreempt_enable();
+	mutex_exit(&cpu_lock);
+
+	for (;;) {
+		done = B_TRUE;
+		mutex_enter(&cpu_lock);
+		cp = cpu_list;
+		do {
+			es = &epoch_snap[cp->cpu_seqid];
+			if (!es->es_wait)
+				continue;
+			if (cp->cpu_epoch_qs != es->es_qs ||
+			    cp->cpu_thread == cp->cpu_idle_thread) {
+				es->es_wait = B_FALSE;
+			} else if (waited >= epoch_force_ticks &&
+			    cpu_is_online(cp)) {
+				/*
+				 * Running on the CPU proves that it has
+				 * switched.
+				 */
+				thread_affinity_set(curthread, cp->cpu_id);
+				thread_affinity_clear(curthread);
+				es->es_wait = B_FALSE;
+				epoch_kstat.ek_forced.value.ui64++;
+			} else {
+				done = B_FALSE;
+			}
+		} while ((cp = cp->cpu_next) != cpu_list);
+		mutex_exit(&cpu_lock);
+
+		if (done)
+			break;
+		delay(1);
+		waited++;
+	}
+
+	membar_enter();
+	epoch_kstat.ek_grace.value.ui64++;
+}
+
+static void
+epoch_thread(void)
+{
+	callb_cpr_t cprinfo;
+	epoch_cb_t *ec, *next;
+	boolean_t work;
+
+	CALLB_CPR_INIT(&cprinfo, &epoch_lock, callb_generic_cpr, "epoch");
+
+	mutex_enter(&epoch_lock);
+	for (;;) {
+		epoch_busy = B_TRUE;
+		mutex_exit(&epoch_lock);
+
+		ec = epoch_gather();
+		work = (ec != NULL || epoch_waiters != 0);
+		if (work) {
+			epoch_grace();
+			for (; ec != NULL; ec = next) {
+				next = ec->ec_next;
+				ec->ec_func(ec);
+				epoch_kstat.ek_callbacks.value.ui64++;
+			}
+		}
+
+		mutex_enter(&epoch_lock);
+		epoch_busy = B_FALSE;
+		if (work) {
+			epoch_gen++;
+			cv_broadcast(&epoch_done_cv);
+		}
+		if (epoch_waiters != 0)
+			continue;
+
+		if (work) {
+			/*
+			 * Let more callbacks batch up.
+			 */
+			CALLB_CPR_SAFE_BEGIN(&cprinfo);
+			(void) cv_reltimedwait(&epoch_cv, &epoch_lock,
+			    epoch_delay, TR_CLOCK_TICK);
+			CALLB_CPR_SAFE_END(&cprinfo, &epoch_lock);
+			continue;
+		}
+
+		/*
+		 * Nothing to do: wait for call_epoch() or epoch_synchronize(),
+		 * after checking for callbacks queued by a call_epoch() that
+		 * did not see epoch_idle set.
+		 */
+		epoch_idle = 1;
+		membar_enter();
+		if (!epoch_pending()) {
+			CALLB_CPR_SAFE_BEGIN(&cprinfo);
+			cv_wait(&epoch_cv, &epoch_lock);
+			CALLB_CPR_SAFE_END(&cprinfo, &epoch_lock);
+		}
+		epoch_idle = 0;
+	}
+}
+
+/*
+ * Wait for a grace period to elapse, and for every callback queued so far to
+ * have run.
+ */
+void
+epoch_synchronize(void)
+{
+	uint64_t gen;
+
+	ASSERT(curthread != epoch_thr);
+	ASSERT(!EPOCH_HELD());
+
+	if (epoch_thr == NULL)
+		return;
+
+	mutex_enter(&epoch_lock);
+	epoch_kstat.ek_synchronize.value.ui64++;
+
+	/*
+	 * A batch in progress may have gathered its callbacks and started its
+	 * grace period before we were called; wait for the next one too.
+	 */
+	gen = epoch_gen + (epoch_busy ? 2 : 1);
+	epoch_waiters++;
+	cv_signal(&epoch_cv);
+	while (epoch_gen < gen)
+		cv_wait(&epoch_done_cv, &epoch_lock);
+	epoch_waiters--;
+	mutex_exit(&epoch_lock);
+}
+
+void
+epoch_init(void)
+{
+	epoch_cpu_t *cpus;
+	kstat_t *ksp;
+	int i;
+
+	if (epoch_delay == 0)
+		epoch_delay = MAX(drv_usectohz(10000), 1);
+	if (epoch_force_ticks == 0)
+		epoch_force_ticks = MAX(drv_usectohz(10000), 1);
+
+	mutex_init(&epoch_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&epoch_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&epoch_done_cv, NULL, CV_DEFAULT, NULL);
+
+	cpus = kmem_zalloc(sizeof (epoch_cpu_t) * max_ncpus, KM_SLEEP);
+	for (i = 0; i < max_ncpus; i++)
+		mutex_init(&cpus[i].epc_lock, NULL, MUTEX_DEFAULT, NULL);
+	epoch_snap = kmem_zalloc(sizeof (epoch_snap_t) * max_ncpus, KM_SLEEP);
+
+	/*
+	 * Hand the callbacks queued during boot over to the boot CPU's list.
+	 */
+	mutex_enter(&epoch_boot.epc_lock);
+	cpus[CPU->cpu_seqid].epc_head = epoch_boot.epc_head;
+	cpus[CPU->cpu_seqid].epc_tail = epoch_boot.epc_tail;
+	cpus[CPU->cpu_seqid].epc_queued = epoch_boot.epc_queued;
+	epoch_boot.epc_head = epoch_boot.epc_tail = NULL;
+	membar_producer();
+	epoch_cpus = cpus;
+	mutex_exit(&epoch_boot.epc_lock);
+
+	if ((ksp = kstat_create("unix", 0, "epoch", "misc", KSTAT_TYPE_NAMED,
+	    sizeof (epoch_kstat) / sizeof (kstat_named_t),
+	    KSTAT_FLAG_VIRTUAL)) != NULL) {
+		ksp->ks_data = &epoch_kstat;
+		kstat_install(ksp);
+	}
+
+	epoch_thr = thread_create(NULL, 0, epoch_thread, NULL, 0, &p0,
+	    TS_RUN, maxclsyspri);
+}
@@ -58,6 +58,8 @@
 #include <sys/modctl.h>
 #include <sys/vmparam.h>
 #include <sys/door.h>
+#include <sys/aio_impl.h>
+#include <sys/aio_ring.h>
 #include <sys/schedctl.h>
 #include <sys/utrap.h>
 #include <sys/systeminfo.h>
@@ -1994,6 +1996,12 @@ exec_args(execa_t *uap, uarg_t *args, intpdata_t *intp, void **auxvpp)
 	if (p->p_pagep)
 		schedctl_proc_cleanup();
 
+	/*
+	 * Destroy any aio rings; they are mapped into the old address space.
+	 */
+	if (p->p_aio != NULL)
+		aio_ring_exit();
+
 	/*
 	 * Clean up any DTrace helpers for the process.
 	 */
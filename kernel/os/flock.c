@@ -168,6 +168,7 @@ static int flk_relation(lock_descriptor_t *, lock_descriptor_t *);
 static void flk_insert_active_lock(lock_descriptor_t *);
 static void flk_delete_active_lock(lock_descriptor_t *, int);
 static void flk_insert_sleeping_lock(lock_descriptor_t *);
+static void flk_remove_sleeping_lock(lock_descriptor_t *);
 static void flk_graph_uncolor(graph_t *);
 static void flk_wakeup(lock_descriptor_t *, int);
 static void flk_free_edge(edge_t *);
@@ -183,6 +184,21 @@ static void wait_for_lock(lock_descriptor_t *);
 static void unlock_lockmgr_granted(struct flock_globals *);
 static void wakeup_sleeping_lockmgr_locks(struct flock_globals *);
 
+/* Interval trees of active and sleeping locks */
+static void flk_itree_insert(lock_descriptor_t **, lock_descriptor_t *);
+static void flk_itree_remove(lock_descriptor_t **, lock_descriptor_t *);
+static lock_descriptor_t *flk_itree_next(lock_descriptor_t *,
+			lock_descriptor_t *);
+static lock_descriptor_t *flk_itree_prev(lock_descriptor_t *,
+			lock_descriptor_t *);
+static lock_descriptor_t *flk_itree_find(lock_descriptor_t *, vnode_t *,
+			uoff_t, uoff_t, uoff_t,
+			int (*)(lock_descriptor_t *, void *), void *);
+static int flk_match_blocks(lock_descriptor_t *, void *);
+static int flk_match_granted_blocks(lock_descriptor_t *, void *);
+static int flk_match_blocks_or_covers(lock_descriptor_t *, void *);
+static int flk_match_owner(lock_descriptor_t *, void *);
+
 #ifdef DEBUG
 static int check_lock_transition(int, int);
 static void check_sleeping_locks(graph_t *);
@@ -1043,31 +1059,24 @@ flk_process_request(lock_descriptor_t *request)
 	request_will_wait = IS_WILLING_TO_SLEEP(request);
 
 	/*
-	 * check active locks
+	 * check active locks; only those overlapping the request can block
+	 * it, and the interval tree finds them without looking at the rest.
 	 */
 
-	SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
-
+	lock = flk_itree_find(gp->active_tree, vp, 0, request->l_start,
+	    request->l_end, flk_match_blocks_or_covers, request);
 
-	if (lock) {
-		do {
-			if (BLOCKS(lock, request)) {
-				if (!request_will_wait)
-					return (EAGAIN);
-				request_blocked_by_active = 1;
-				break;
-			}
-			/*
-			 * Grant lock if it is for the same owner holding active
-			 * lock that covers the request.
-			 */
-
-			if (SAME_OWNER(lock, request) &&
-			    COVERS(lock, request) &&
-			    (request->l_type == F_RDLCK))
-				return (flk_execute_request(request));
-			lock = lock->l_next;
-		} while (lock->l_vnode == vp);
+	if (lock != NULL) {
+		/*
+		 * Grant lock if it is for the same owner holding active
+		 * lock that covers the request.  No other owner's lock can
+		 * then block it.
+		 */
+		if (!BLOCKS(lock, request))
+			return (flk_execute_request(request));
+		if (!request_will_wait)
+			return (EAGAIN);
+		request_blocked_by_active = 1;
 	}
 
 	if (!request_blocked_by_active) {
@@ -1079,22 +1088,13 @@ flk_process_request(lock_descriptor_t *request)
 		 * in sleep queue. Those threads are woken up and so locks
 		 * are almost active.
 		 */
-		SET_LOCK_TO_FIRST_SLEEP_VP(gp, lock, vp);
-		if (lock) {
-			do {
-				if (BLOCKS(lock, request)) {
-					if (IS_GRANTED(lock)) {
-						request_blocked_by_granted = 1;
-					} else {
-						request_blocked_by_sleeping = 1;
-					}
-				}
-
-				lock = lock->l_next;
-			} while ((lock->l_vnode == vp));
-			first_glock = lock->l_prev;
-			ASSERT(first_glock->l_vnode == vp);
-		}
+		if (flk_itree_find(gp->sleeping_tree, vp, 0, request->l_start,
+		    request->l_end, flk_match_granted_blocks, request) != NULL)
+			request_blocked_by_granted = 1;
+		else if (flk_itree_find(gp->sleeping_tree, vp, 0,
+		    request->l_start, request->l_end, flk_match_blocks,
+		    request) != NULL)
+			request_blocked_by_sleeping = 1;
 
 		if (request_blocked_by_granted)
 			goto block;
@@ -1116,6 +1116,16 @@ flk_process_request(lock_descriptor_t *request)
 			goto block;
 		}
 
+		/*
+		 * A write request which only a sleeping lock blocks; find
+		 * the last sleeping lock of the vnode, to walk the granted
+		 * ones below.
+		 */
+		SET_LOCK_TO_FIRST_SLEEP_VP(gp, first_glock, vp);
+		ASSERT(first_glock != NULL);
+		while (first_glock->l_next->l_vnode == vp)
+			first_glock = first_glock->l_next;
+
 		lk[0] = request;
 		request->l_state |= RECOMPUTE_LOCK;
 		SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
@@ -1251,7 +1261,8 @@ flk_execute_request(lock_descriptor_t *request)
 {
 	graph_t	*gp = request->l_graph;
 	vnode_t	*vp = request->l_vnode;
-	lock_descriptor_t	*lock, *lock1;
+	lock_descriptor_t	*lock;
+	uoff_t	lo, hi, next;
 	int done_searching = 0;
 
 	CHECK_SLEEPING_LOCKS(gp);
@@ -1268,7 +1279,19 @@ flk_execute_request(lock_descriptor_t *request)
 	if (IS_IO_LOCK(request))
 		return (0);
 
-	SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
+	/*
+	 * Only locks of the same owner which overlap or adjoin the request
+	 * can be affected by it: the owner's locks never overlap each other,
+	 * and adjoining ones of the same type are always coalesced.  Visit
+	 * them in order of their start offsets; flk_relation() may replace
+	 * the lock it is given by pieces of it, which can be skipped.
+	 */
+	lo = (request->l_start > 0) ? request->l_start - 1 : 0;
+	hi = (request->l_end < MAX_U_OFFSET_T) ? request->l_end + 1 :
+	    MAX_U_OFFSET_T;
+
+	lock = flk_itree_find(gp->active_tree, vp, 0, lo, hi,
+	    flk_match_owner, request);
 
 	if (lock == NULL && request->l_type == F_UNLCK)
 		return (0);
@@ -1278,12 +1301,13 @@ flk_execute_request(lock_descriptor_t *request)
 	}
 
 	do {
-		lock1 = lock->l_next;
-		if (SAME_OWNER(request, lock)) {
-			done_searching = flk_relation(lock, request);
-		}
-		lock = lock1;
-	} while (lock->l_vnode == vp && !done_searching);
+		next = lock->l_start + 1;
+		done_searching = flk_relation(lock, request);
+		if (done_searching || next == 0)
+			break;
+		lock = flk_itree_find(gp->active_tree, vp, next, lo, hi,
+		    flk_match_owner, request);
+	} while (lock != NULL);
 
 	/*
 	 * insert in active queue
@@ -1400,7 +1424,7 @@ flk_wait_execute_request(lock_descriptor_t *request)
 	}
 
 	request->l_state &= ~GRANTED_LOCK;
-	REMOVE_SLEEP_QUEUE(request);
+	flk_remove_sleeping_lock(request);
 	return (flk_execute_request(request));
 }
 
@@ -1770,6 +1794,235 @@ recompute:
 	return (0);
 }
 
+/*
+ * Interval trees.
+ *
+ * The active and sleeping locks of a graph are indexed by a treap ordered
+ * by (vnode, start offset, address), in which each lock also records the
+ * highest end offset found in its subtree (l_imax).  A lookup of the locks
+ * of a vnode overlapping a range then skips every subtree which ends before
+ * the range, or lies wholly before or after the vnode's part of the tree,
+ * and so costs O(log n) plus the number of overlapping locks, where walking
+ * the lists would have cost the number of locks held on the vnode.
+ *
+ * The priorities of the treap are derived from the addresses of the locks,
+ * which keeps it balanced without storing anything more.  A lock's key must
+ * not change while it is in a tree.
+ */
+
+#define	FLK_ITREE_PRI(lock)	\
+	((uint_t)(((uintptr_t)(lock) >> 4) * 2654435761U))
+
+static int
+flk_itree_cmp(const lock_descriptor_t *l1, const lock_descriptor_t *l2)
+{
+	if (l1->l_vnode != l2->l_vnode)
+		return ((uintptr_t)l1->l_vnode < (uintptr_t)l2->l_vnode ?
+		    -1 : 1);
+	if (l1->l_start != l2->l_start)
+		return (l1->l_start < l2->l_start ? -1 : 1);
+	if (l1 != l2)
+		return ((uintptr_t)l1 < (uintptr_t)l2 ? -1 : 1);
+	return (0);
+}
+
+static void
+flk_itree_update(lock_descriptor_t *lock)
+{
+	uoff_t max = lock->l_end;
+
+	if (lock->l_ileft != NULL && lock->l_ileft->l_imax > max)
+		max = lock->l_ileft->l_imax;
+	if (lock->l_iright != NULL && lock->l_iright->l_imax > max)
+		max = lock->l_iright->l_imax;
+	lock->l_imax = max;
+}
+
+static lock_descriptor_t *
+flk_itree_rotate_right(lock_descriptor_t *lock)
+{
+	lock_descriptor_t *left = lock->l_ileft;
+
+	lock->l_ileft = left->l_iright;
+	left->l_iright = lock;
+	flk_itree_update(lock);
+	flk_itree_update(left);
+	return (left);
+}
+
+static lock_descriptor_t *
+flk_itree_rotate_left(lock_descriptor_t *lock)
+{
+	lock_descriptor_t *right = lock->l_iright;
+
+	lock->l_iright = right->l_ileft;
+	right->l_ileft = lock;
+	flk_itree_update(lock);
+	flk_itree_update(right);
+	return (right);
+}
+
+static lock_descriptor_t *
+flk_itree_insert_subtree(lock_descriptor_t *root, lock_descriptor_t *lock)
+{
+	if (root == NULL) {
+		lock->l_ileft = lock->l_iright = NULL;
+		lock->l_imax = lock->l_end;
+		return (lock);
+	}
+
+	if (flk_itree_cmp(lock, root) < 0) {
+		root->l_ileft = flk_itree_insert_subtree(root->l_ileft, lock);
+		if (FLK_ITREE_PRI(root->l_ileft) > FLK_ITREE_PRI(root))
+			return (flk_itree_rotate_right(root));
+	} else {
+		root->l_iright = flk_itree_insert_subtree(root->l_iright, lock);
+		if (FLK_ITREE_PRI(root->l_iright) > FLK_ITREE_PRI(root))
+			return (flk_itree_rotate_left(root));
+	}
+	flk_itree_update(root);
+	return (root);
+}
+
+static lock_descriptor_t *
+flk_itree_remove_subtree(lock_descriptor_t *root, lock_descriptor_t *lock)
+{
+	int cmp;
+
+	ASSERT(root != NULL);
+
+	if ((cmp = flk_itree_cmp(lock, root)) < 0) {
+		root->l_ileft = flk_itree_remove_subtree(root->l_ileft, lock);
+	} else if (cmp > 0) {
+		root->l_iright = flk_itree_remove_subtree(root->l_iright, lock);
+	} else if (root->l_ileft == NULL) {
+		root = root->l_iright;
+		lock->l_iright = NULL;
+		return (root);
+	} else if (root->l_iright == NULL) {
+		root = root->l_ileft;
+		lock->l_ileft = NULL;
+		return (root);
+	} else if (FLK_ITREE_PRI(root->l_ileft) >
+	    FLK_ITREE_PRI(root->l_iright)) {
+		/* rotate the lock down until it has at most one child */
+		root = flk_itree_rotate_right(root);
+		root->l_iright = flk_itree_remove_subtree(root->l_iright, lock);
+	} else {
+		root = flk_itree_rotate_left(root);
+		root->l_ileft = flk_itree_remove_subtree(root->l_ileft, lock);
+	}
+	flk_itree_update(root);
+	return (root);
+}
+
+static void
+flk_itree_insert(lock_descriptor_t **rootp, lock_descriptor_t *lock)
+{
+	*rootp = flk_itree_insert_subtree(*rootp, lock);
+}
+
+static void
+flk_itree_remove(lock_descriptor_t **rootp, lock_descriptor_t *lock)
+{
+	*rootp = flk_itree_remove_subtree(*rootp, lock);
+	ASSERT(lock->l_ileft == NULL && lock->l_iright == NULL);
+}
+
+/*
+ * Return the lock following (preceding) 'lock' in the tree, or NULL.
+ */
+static lock_descriptor_t *
+flk_itree_next(lock_descriptor_t *root, lock_descriptor_t *lock)
+{
+	lock_descriptor_t *next = NULL;
+
+	while (root != NULL) {
+		if (flk_itree_cmp(lock, root) < 0) {
+			next = root;
+			root = root->l_ileft;
+		} else {
+			root = root->l_iright;
+		}
+	}
+	return (next);
+}
+
+static lock_descriptor_t *
+flk_itree_prev(lock_descriptor_t *root, lock_descriptor_t *lock)
+{
+	lock_descriptor_t *prev = NULL;
+
+	while (root != NULL) {
+		if (flk_itree_cmp(lock, root) > 0) {
+			prev = root;
+			root = root->l_iright;
+		} else {
+			root = root->l_ileft;
+		}
+	}
+	return (prev);
+}
+
+/*
+ * Return the first lock, in the order of the tree, on 'vp' which starts at
+ * or after 'from', overlaps the range from 'start' to 'end', and for which
+ * match(lock, arg) returns non-zero; or NULL if there is none.
+ */
+static lock_descriptor_t *
+flk_itree_find(lock_descriptor_t *root, vnode_t *vp, uoff_t from,
+    uoff_t start, uoff_t end, int (*match)(lock_descriptor_t *, void *),
+    void *arg)
+{
+	lock_descriptor_t *lock;
+
+	for (; root != NULL && root->l_imax >= start; root = root->l_iright) {
+		if ((uintptr_t)root->l_vnode > (uintptr_t)vp ||
+		    (root->l_vnode == vp && root->l_start >= from)) {
+			lock = flk_itree_find(root->l_ileft, vp, from, start,
+			    end, match, arg);
+			if (lock != NULL)
+				return (lock);
+			if (root->l_vnode == vp && root->l_start <= end &&
+			    root->l_end >= start && match(root, arg))
+				return (root);
+		}
+		if ((uintptr_t)root->l_vnode > (uintptr_t)vp ||
+		    (root->l_vnode == vp && root->l_start > end))
+			break;
+	}
+	return (NULL);
+}
+
+static int
+flk_match_blocks(lock_descriptor_t *lock, void *request)
+{
+	return (BLOCKS(lock, (lock_descriptor_t *)request));
+}
+
+static int
+flk_match_granted_blocks(lock_descriptor_t *lock, void *request)
+{
+	return (IS_GRANTED(lock) && BLOCKS(lock, (lock_descriptor_t *)request));
+}
+
+static int
+flk_match_blocks_or_covers(lock_descriptor_t *lock, void *arg)
+{
+	lock_descriptor_t *request = arg;
+
+	if (BLOCKS(lock, request))
+		return (1);
+	return (SAME_OWNER(lock, request) && COVERS(lock, request) &&
+	    request->l_type == F_RDLCK);
+}
+
+static int
+flk_match_owner(lock_descriptor_t *lock, void *request)
+{
+	return (SAME_OWNER(lock, (lock_descriptor_t *)request));
+}
+
 /*
  * Insert a lock into the active queue.
  */
@@ -1779,29 +2032,30 @@ flk_insert_active_lock(lock_descriptor_t *new_lock)
 {
 	graph_t	*gp = new_lock->l_graph;
 	vnode_t	*vp = new_lock->l_vnode;
-	lock_descriptor_t *first_lock, *lock;
+	lock_descriptor_t *prev, *lock;
 
 	ASSERT(MUTEX_HELD(&gp->gp_mutex));
 
-	SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
-	first_lock = lock;
-
-	if (first_lock != NULL) {
-		for (; (lock->l_vnode == vp &&
-		    lock->l_start < new_lock->l_start); lock = lock->l_next)
-			;
-	} else {
-		lock = ACTIVE_HEAD(gp);
-	}
+	/*
+	 * The vnode's locks are kept on the list in the order of the tree;
+	 * insert the new lock before its successor in the tree, or after
+	 * its predecessor if it is the last one of the vnode.
+	 */
+	flk_itree_insert(&gp->active_tree, new_lock);
+	prev = flk_itree_prev(gp->active_tree, new_lock);
+	if (prev != NULL && prev->l_vnode != vp)
+		prev = NULL;
+	lock = flk_itree_next(gp->active_tree, new_lock);
+	if (lock == NULL || lock->l_vnode != vp)
+		lock = (prev != NULL) ? prev->l_next : ACTIVE_HEAD(gp);
 
 	lock->l_prev->l_next = new_lock;
 	new_lock->l_next = lock;
 	new_lock->l_prev = lock->l_prev;
 	lock->l_prev = new_lock;
 
-	if (first_lock == NULL || (new_lock->l_start <= first_lock->l_start)) {
+	if (prev == NULL)
 		vp->v_filocks = (struct filock *)new_lock;
-	}
 	flk_set_state(new_lock, FLK_ACTIVE_STATE);
 	new_lock->l_state |= ACTIVE_LOCK;
 
@@ -1834,6 +2088,7 @@ flk_delete_active_lock(lock_descriptor_t *lock, int free_lock)
 		    ((lock->l_next->l_vnode == vp) ? lock->l_next :
 		    NULL);
 	}
+	flk_itree_remove(&gp->active_tree, lock);
 	lock->l_next->l_prev = lock->l_prev;
 	lock->l_prev->l_next = lock->l_next;
 	lock->l_next = lock->l_prev = NULL;
@@ -1868,10 +2123,24 @@ flk_insert_sleeping_lock(lock_descriptor_t *request)
 	request->l_prev = lock->l_prev;
 	lock->l_prev = request;
 	request->l_next = lock;
+	flk_itree_insert(&gp->sleeping_tree, request);
 	flk_set_state(request, FLK_SLEEPING_STATE);
 	request->l_state |= SLEEPING_LOCK;
 }
 
+/*
+ * Remove from the sleep queue.
+ */
+
+static void
+flk_remove_sleeping_lock(lock_descriptor_t *request)
+{
+	ASSERT(MUTEX_HELD(&request->l_graph->gp_mutex));
+
+	flk_itree_remove(&request->l_graph->sleeping_tree, request);
+	REMOVE_SLEEP_QUEUE(request);
+}
+
 /*
  * Cancelling a sleeping lock implies removing a vertex from the
  * dependency graph and therefore we should recompute the dependencies
@@ -1968,7 +2237,7 @@ flk_cancel_sleeping_lock(lock_descriptor_t *request, int remove_from_queue)
 
 
 	if (remove_from_queue)
-		REMOVE_SLEEP_QUEUE(request);
+		flk_remove_sleeping_lock(request);
 
 	/* we are ready to recompute */
 
@@ -2322,39 +2591,22 @@ flk_get_first_blocking_lock(lock_descriptor_t *request)
 {
 	graph_t	*gp = request->l_graph;
 	vnode_t *vp = request->l_vnode;
-	lock_descriptor_t *lock, *blocker;
+	lock_descriptor_t *blocker;
 
 	ASSERT(MUTEX_HELD(&gp->gp_mutex));
-	blocker = NULL;
-	SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
-
-	if (lock) {
-		do {
-			if (BLOCKS(lock, request)) {
-				blocker = lock;
-				break;
-			}
-			lock = lock->l_next;
-		} while (lock->l_vnode == vp);
-	}
+	blocker = flk_itree_find(gp->active_tree, vp, 0, request->l_start,
+	    request->l_end, flk_match_blocks, request);
 
 	if (blocker == NULL && request->l_flock.l_type == F_RDLCK) {
 		/*
 		 * No active lock is blocking this request, but if a read
 		 * lock is requested, it may also get blocked by a waiting
-		 * writer. So search all sleeping locks and see if there is
+		 * writer. So search the sleeping locks and see if there is
 		 * a writer waiting.
 		 */
-		SET_LOCK_TO_FIRST_SLEEP_VP(gp, lock, vp);
-		if (lock) {
-			do {
-				if (BLOCKS(lock, request)) {
-					blocker = lock;
-					break;
-				}
-				lock = lock->l_next;
-			} while (lock->l_vnode == vp);
-		}
+		blocker = flk_itree_find(gp->sleeping_tree, vp, 0,
+		    request->l_start, request->l_end, flk_match_blocks,
+		    request);
 	}
 
 	if (blocker) {
@@ -3692,6 +3944,27 @@ report_blocker(lock_descriptor_t *blocker, lock_descriptor_t *request)
 	}
 }
 
+typedef struct nbl_io {
+	nbl_op_t	ni_op;
+	uoff_t		ni_offset;
+	ssize_t		ni_length;
+	int		ni_svmand;
+	pid_t		ni_pid;
+	int		ni_sysid;
+} nbl_io_t;
+
+static int
+nbl_match_io(lock_descriptor_t *lock, void *arg)
+{
+	nbl_io_t *nip = arg;
+
+	return ((nip->ni_svmand || (lock->l_state & NBMAND_LOCK)) &&
+	    (lock->l_flock.l_sysid != nip->ni_sysid ||
+	    lock->l_flock.l_pid != nip->ni_pid) &&
+	    lock_blocks_io(nip->ni_op, nip->ni_offset, nip->ni_length,
+	    lock->l_type, lock->l_start, lock->l_end));
+}
+
 /*
  * Return non-zero if the given I/O request conflicts with an active NBMAND
  * lock.
@@ -3705,18 +3978,25 @@ nbl_lock_conflict(vnode_t *vp, nbl_op_t op, uoff_t offset,
 {
 	int conflict = 0;
 	graph_t			*gp;
-	lock_descriptor_t	*lock;
-	pid_t pid;
-	int sysid;
+	nbl_io_t		ni;
+	uoff_t			end;
 
+	ni.ni_op = op;
+	ni.ni_offset = offset;
+	ni.ni_length = length;
+	ni.ni_svmand = svmand;
 	if (ct == NULL) {
-		pid = curproc->p_pid;
-		sysid = 0;
+		ni.ni_pid = curproc->p_pid;
+		ni.ni_sysid = 0;
 	} else {
-		pid = ct->cc_pid;
-		sysid = ct->cc_sysid;
+		ni.ni_pid = ct->cc_pid;
+		ni.ni_sysid = ct->cc_sysid;
 	}
 
+	/* the locks lock_blocks_io() can match all overlap this range */
+	end = (length > 0 && offset + length - 1 >= offset) ?
+	    offset + length - 1 : offset;
+
 	mutex_enter(&flock_lock);
 	gp = lock_graph[HASH_INDEX(vp)];
 	mutex_exit(&flock_lock);
@@ -3724,18 +4004,9 @@ nbl_lock_conflict(vnode_t *vp, nbl_op_t op, uoff_t offset,
 		return (0);
 
 	mutex_enter(&gp->gp_mutex);
-	SET_LOCK_TO_FIRST_ACTIVE_VP(gp, lock, vp);
-
-	for (; lock && lock->l_vnode == vp; lock = lock->l_next) {
-		if ((svmand || (lock->l_state & NBMAND_LOCK)) &&
-		    (lock->l_flock.l_sysid != sysid ||
-		    lock->l_flock.l_pid != pid) &&
-		    lock_blocks_io(op, offset, length,
-		    lock->l_type, lock->l_start, lock->l_end)) {
-			conflict = 1;
-			break;
-		}
-	}
+	if (flk_itree_find(gp->active_tree, vp, 0, offset, end,
+	    nbl_match_io, &ni) != NULL)
+		conflict = 1;
 	mutex_exit(&gp->gp_mutex);
 
 	return (conflict);
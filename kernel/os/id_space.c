@@ -24,7 +24,14 @@
 
 #include <sys/types.h>
 #include <sys/id_space.h>
+#include <sys/vmem_impl.h>
 #include <sys/debug.h>
+#include <sys/kmem.h>
+#include <sys/bitmap.h>
+#include <sys/condvar.h>
+#include <sys/cmn_err.h>
+#include <sys/systm.h>
+#include <sys/sysmacros.h>
 
 /*
  * ID Spaces
@@ -49,27 +56,332 @@
  *   return the first available id, and should be used when there is benefit
  *   to having a compact allocated range.
  *
+ *   ID spaces whose range is no larger than id_space_bitmap_max are dense
+ *   enough to be kept in a bitmap instead, with one bit per identifier and
+ *   a second bitmap with one bit per word of the first, set when that word
+ *   is full.  Allocating and freeing an identifier then costs a couple of
+ *   word operations under the ID space's lock, and never allocates memory,
+ *   rather than a vmem segment and a trip through the arena's freelists and
+ *   hash table.  The allocation order is the same in both representations.
+ *   Identifiers in a gap left by id_space_extend() are kept allocated.  An
+ *   ID space which id_space_extend() grows past id_space_bitmap_max is moved
+ *   to a vmem arena, so that a large range never costs a large bitmap;
+ *   id_space_xcreate() can force either representation instead.
+ *
  *   (Presently, the id_space_t abstraction supports only direct allocations; ID
  *   reservation, in which an ID is allocated but placed in a internal
  *   dictionary for later use, should be added when a consuming subsystem
  *   arrives.)
  */
 
+struct id_space {
+	vmem_t		*is_vmem;	/* arena, if not a bitmap */
+	kmutex_t	is_lock;	/* protects the rest */
+	kcondvar_t	is_cv;		/* for id_alloc() and id_allocff() */
+	id_t		is_low;		/* identifier of bit 0 */
+	size_t		is_nbits;	/* # of identifiers in the bitmap */
+	size_t		is_next;	/* next-fit rotor, as a bit index */
+	ulong_t		*is_map;	/* set if identifier is allocated */
+	ulong_t		*is_full;	/* set if is_map word is all ones */
+	size_t		is_nalloc;	/* # of identifiers allocated */
+	uint_t		is_nwait;	/* # of threads in cv_wait() */
+	int		is_flags;	/* ID_SPACE_* from id_space_xcreate() */
+	char		is_name[VMEM_NAMELEN];	/* for the leak warning */
+};
+
+/*
+ * Largest range, in identifiers, kept in a bitmap (128K of bitmap).
+ */
+size_t id_space_bitmap_max = 1 << 20;
+
 #define	ID_TO_ADDR(id) ((void *)(uintptr_t)(id + 1))
 #define	ADDR_TO_ID(addr) ((id_t)((uintptr_t)addr - 1))
 
+#define	ID_NWORDS(nbits)	BT_BITOUL(nbits)
+#define	ID_NFULL(nbits)		BT_BITOUL(ID_NWORDS(nbits))
+
+static void
+id_bit_set(id_space_t *isp, size_t bit)
+{
+	size_t w = bit >> BT_ULSHIFT;
+
+	ASSERT(!BT_TEST(isp->is_map, bit));
+	BT_SET(isp->is_map, bit);
+	if (isp->is_map[w] == BT_ULMAXMASK)
+		BT_SET(isp->is_full, w);
+}
+
+static void
+id_bit_clear(id_space_t *isp, size_t bit)
+{
+	ASSERT(BT_TEST(isp->is_map, bit));
+	BT_CLEAR(isp->is_full, bit >> BT_ULSHIFT);
+	BT_CLEAR(isp->is_map, bit);
+}
+
+/*
+ * Enter the lock of a bitmap ID space and return B_TRUE, or return B_FALSE
+ * if the ID space is kept in a vmem arena.  A bitmap ID space only ever
+ * moves to a vmem arena with its lock held, so is_vmem needs to be checked
+ * again once the lock is held; it never moves back.
+ */
+static boolean_t
+id_bitmap_enter(id_space_t *isp)
+{
+	if (isp->is_vmem != NULL)
+		return (B_FALSE);
+	mutex_enter(&isp->is_lock);
+	if (isp->is_vmem != NULL) {
+		mutex_exit(&isp->is_lock);
+		return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Return the index of the first clear bit at or after 'from', or -1.  The
+ * bits past is_nbits in the last word are always set.
+ */
+static ssize_t
+id_bit_find(id_space_t *isp, size_t from)
+{
+	size_t nwords = ID_NWORDS(isp->is_nbits);
+	size_t w = from >> BT_ULSHIFT;
+	ulong_t bits;
+
+	ASSERT(MUTEX_HELD(&isp->is_lock));
+
+	if (from >= isp->is_nbits)
+		return (-1);
+	bits = ~isp->is_map[w] & (BT_ULMAXMASK << (from & BT_ULMASK));
+	if (bits != 0)
+		return ((w << BT_ULSHIFT) + lowbit(bits) - 1);
+
+	/*
+	 * Skip the full words using the summary bitmap.
+	 */
+	for (w++; w < nwords; w = P2ROUNDUP(w + 1, BT_NBIPUL)) {
+		bits = ~isp->is_full[w >> BT_ULSHIFT] &
+		    (BT_ULMAXMASK << (w & BT_ULMASK));
+		if (bits == 0)
+			continue;
+		w = P2ALIGN(w, BT_NBIPUL) + lowbit(bits) - 1;
+		if (w >= nwords)
+			break;
+		ASSERT(isp->is_map[w] != BT_ULMAXMASK);
+		return ((w << BT_ULSHIFT) + lowbit(~isp->is_map[w]) - 1);
+	}
+	return (-1);
+}
+
+/*
+ * Allocate from an ID space, next-fit or first-fit.
+ */
+static id_t
+id_space_alloc(id_space_t *isp, boolean_t nextfit, boolean_t sleep)
+{
+	ssize_t bit;
+
+	if (!id_bitmap_enter(isp)) {
+		return (ADDR_TO_ID(vmem_alloc(isp->is_vmem, 1,
+		    (sleep ? VM_SLEEP : VM_NOSLEEP) |
+		    (nextfit ? VM_NEXTFIT : VM_FIRSTFIT))));
+	}
+	for (;;) {
+		bit = id_bit_find(isp, nextfit ? isp->is_next : 0);
+		if (bit == -1 && nextfit && isp->is_next != 0)
+			bit = id_bit_find(isp, 0);
+		if (bit != -1 || !sleep)
+			break;
+		isp->is_nwait++;
+		cv_wait(&isp->is_cv, &isp->is_lock);
+		isp->is_nwait--;
+		if (isp->is_vmem != NULL) {
+			mutex_exit(&isp->is_lock);
+			return (id_space_alloc(isp, nextfit, sleep));
+		}
+	}
+	if (bit != -1) {
+		id_bit_set(isp, bit);
+		isp->is_nalloc++;
+		if (nextfit)
+			isp->is_next = bit + 1;
+	}
+	mutex_exit(&isp->is_lock);
+
+	return (bit == -1 ? -1 : isp->is_low + (id_t)bit);
+}
+
+/*
+ * Move a bitmap ID space to a vmem arena covering its current range as well
+ * as [low, high); every identifier set in the bitmap, including those of gaps,
+ * stays allocated.  Called with is_lock held, which is dropped.
+ */
+static void
+id_bitmap_to_vmem(id_space_t *isp, id_t low, id_t high)
+{
+	vmem_t *vmp;
+	void *addr;
+	size_t w, i;
+
+	ASSERT(MUTEX_HELD(&isp->is_lock));
+
+	vmp = vmem_create(isp->is_name, ID_TO_ADDR(isp->is_low),
+	    isp->is_nbits, 1, NULL, NULL, NULL, 0, VM_SLEEP | VMC_IDENTIFIER);
+	(void) vmem_add(vmp, ID_TO_ADDR(low), high - low, VM_SLEEP);
+
+	for (w = 0; w < ID_NWORDS(isp->is_nbits); w++) {
+		if (isp->is_map[w] == 0)
+			continue;
+		for (i = w << BT_ULSHIFT; i < MIN((w + 1) << BT_ULSHIFT,
+		    isp->is_nbits); i++) {
+			if (!BT_TEST(isp->is_map, i))
+				continue;
+			addr = ID_TO_ADDR(isp->is_low + (id_t)i);
+			VERIFY3P(vmem_xalloc(vmp, 1, 1, 0, 0, addr,
+			    (void *)((uintptr_t)addr + 1), VM_SLEEP), ==, addr);
+		}
+	}
+
+	kmem_free(isp->is_map, ID_NWORDS(isp->is_nbits) * sizeof (ulong_t));
+	kmem_free(isp->is_full, ID_NFULL(isp->is_nbits) * sizeof (ulong_t));
+	isp->is_map = NULL;
+	isp->is_full = NULL;
+	isp->is_nbits = 0;
+	isp->is_vmem = vmp;
+	if (isp->is_nwait != 0)
+		cv_broadcast(&isp->is_cv);
+	mutex_exit(&isp->is_lock);
+}
+
+/*
+ * Replace the bitmaps of isp with ones covering [low, high) as well as the
+ * current range.  Everything in between the two is marked allocated.  If
+ * the bitmaps would then cover more than id_space_bitmap_max identifiers,
+ * the ID space is moved to a vmem arena instead.  Called with is_lock held,
+ * which is dropped.
+ */
+static void
+id_bitmap_extend(id_space_t *isp, id_t low, id_t high)
+{
+	ulong_t *map, *full;
+	id_t nlow, nhigh;
+	size_t nbits, off, i;
+
+	ASSERT(MUTEX_HELD(&isp->is_lock));
+
+	for (;;) {
+		nlow = MIN(low, isp->is_low);
+		nhigh = MAX(high, isp->is_low + (id_t)isp->is_nbits);
+		nbits = nhigh - nlow;
+		if (nbits > id_space_bitmap_max &&
+		    !(isp->is_flags & ID_SPACE_BITMAP)) {
+			id_bitmap_to_vmem(isp, low, high);
+			return;
+		}
+		mutex_exit(&isp->is_lock);
+
+		map = kmem_alloc(ID_NWORDS(nbits) * sizeof (ulong_t), KM_SLEEP);
+		full = kmem_zalloc(ID_NFULL(nbits) * sizeof (ulong_t),
+		    KM_SLEEP);
+
+		mutex_enter(&isp->is_lock);
+		if (isp->is_vmem == NULL &&
+		    nlow == MIN(low, isp->is_low) &&
+		    nhigh == MAX(high, isp->is_low + (id_t)isp->is_nbits))
+			break;
+		kmem_free(map, ID_NWORDS(nbits) * sizeof (ulong_t));
+		kmem_free(full, ID_NFULL(nbits) * sizeof (ulong_t));
+		if (isp->is_vmem != NULL) {
+			/* moved to vmem by a concurrent id_space_extend() */
+			mutex_exit(&isp->is_lock);
+			(void) vmem_add(isp->is_vmem, ID_TO_ADDR(low),
+			    high - low, VM_SLEEP);
+			return;
+		}
+	}
+
+	/*
+	 * Start with everything allocated, copy the old bitmap over and
+	 * then free the new range.
+	 */
+	off = isp->is_low - nlow;
+	for (i = 0; i < ID_NWORDS(nbits); i++)
+		map[i] = BT_ULMAXMASK;
+	for (i = 0; i < isp->is_nbits; i++) {
+		if (!BT_TEST(isp->is_map, i))
+			BT_CLEAR(map, off + i);
+	}
+	for (i = low - nlow; i < high - nlow; i++) {
+		ASSERT(BT_TEST(map, i));
+		BT_CLEAR(map, i);
+	}
+	for (i = 0; i < ID_NWORDS(nbits); i++) {
+		if (map[i] == BT_ULMAXMASK)
+			BT_SET(full, i);
+	}
+
+	kmem_free(isp->is_map, ID_NWORDS(isp->is_nbits) * sizeof (ulong_t));
+	kmem_free(isp->is_full, ID_NFULL(isp->is_nbits) * sizeof (ulong_t));
+	isp->is_map = map;
+	isp->is_full = full;
+	isp->is_next += off;
+	isp->is_low = nlow;
+	isp->is_nbits = nbits;
+	if (isp->is_nwait != 0)
+		cv_broadcast(&isp->is_cv);
+	mutex_exit(&isp->is_lock);
+}
+
 /*
- * Create an arena to represent the range [low, high).
+ * Create an ID space to represent the range [low, high), kept in a vmem
+ * arena if 'flags' has ID_SPACE_VMEM, or in a bitmap however large it is
+ * and grows if it has ID_SPACE_BITMAP.
  * Caller must be in a context in which VM_SLEEP is legal.
  */
 id_space_t *
-id_space_create(const char *name, id_t low, id_t high)
+id_space_xcreate(const char *name, id_t low, id_t high, int flags)
 {
+	id_space_t *isp;
+
 	ASSERT(low >= 0);
 	ASSERT(low < high);
+	ASSERT((flags & (ID_SPACE_VMEM | ID_SPACE_BITMAP)) !=
+	    (ID_SPACE_VMEM | ID_SPACE_BITMAP));
 
-	return (vmem_create(name, ID_TO_ADDR(low), high - low, 1,
-	    NULL, NULL, NULL, 0, VM_SLEEP | VMC_IDENTIFIER));
+	isp = kmem_zalloc(sizeof (id_space_t), KM_SLEEP);
+	(void) strncpy(isp->is_name, name, VMEM_NAMELEN - 1);
+	isp->is_flags = flags;
+
+	if ((flags & ID_SPACE_VMEM) || (high - low > id_space_bitmap_max &&
+	    !(flags & ID_SPACE_BITMAP))) {
+		isp->is_vmem = vmem_create(name, ID_TO_ADDR(low), high - low,
+		    1, NULL, NULL, NULL, 0, VM_SLEEP | VMC_IDENTIFIER);
+		return (isp);
+	}
+
+	mutex_init(&isp->is_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&isp->is_cv, NULL, CV_DEFAULT, NULL);
+	isp->is_low = low;
+	isp->is_map = kmem_alloc(sizeof (ulong_t), KM_SLEEP);
+	isp->is_full = kmem_alloc(sizeof (ulong_t), KM_SLEEP);
+	isp->is_map[0] = BT_ULMAXMASK;
+	isp->is_full[0] = 1;
+	isp->is_nbits = 1;
+	mutex_enter(&isp->is_lock);
+	id_bitmap_extend(isp, low, high);
+
+	return (isp);
+}
+
+/*
+ * Create an ID space to represent the range [low, high).
+ * Caller must be in a context in which VM_SLEEP is legal.
+ */
+id_space_t *
+id_space_create(const char *name, id_t low, id_t high)
+{
+	return (id_space_xcreate(name, low, high, 0));
 }
 
 /*
@@ -79,13 +391,35 @@ id_space_create(const char *name, id_t low, id_t high)
 void
 id_space_destroy(id_space_t *isp)
 {
-	vmem_destroy(isp);
+	if (isp->is_vmem != NULL) {
+		vmem_destroy(isp->is_vmem);
+	} else {
+		if (isp->is_nalloc != 0)
+			cmn_err(CE_WARN, "id_space_destroy('%s'): leaked %lu "
+			    "identifiers", isp->is_name, isp->is_nalloc);
+		kmem_free(isp->is_map,
+		    ID_NWORDS(isp->is_nbits) * sizeof (ulong_t));
+		kmem_free(isp->is_full,
+		    ID_NFULL(isp->is_nbits) * sizeof (ulong_t));
+	}
+
+	/*
+	 * The lock of an ID space created in a vmem arena is never used, and
+	 * is still zeroed.
+	 */
+	mutex_destroy(&isp->is_lock);
+	cv_destroy(&isp->is_cv);
+	kmem_free(isp, sizeof (id_space_t));
 }
 
 void
 id_space_extend(id_space_t *isp, id_t low, id_t high)
 {
-	(void) vmem_add(isp, ID_TO_ADDR(low), high - low, VM_SLEEP);
+	if (id_bitmap_enter(isp))
+		id_bitmap_extend(isp, low, high);
+	else
+		(void) vmem_add(isp->is_vmem, ID_TO_ADDR(low), high - low,
+		    VM_SLEEP);
 }
 
 /*
@@ -95,7 +429,7 @@ id_space_extend(id_space_t *isp, id_t low, id_t high)
 id_t
 id_alloc(id_space_t *isp)
 {
-	return (ADDR_TO_ID(vmem_alloc(isp, 1, VM_SLEEP | VM_NEXTFIT)));
+	return (id_space_alloc(isp, B_TRUE, B_TRUE));
 }
 
 /*
@@ -106,7 +440,7 @@ id_alloc(id_space_t *isp)
 id_t
 id_alloc_nosleep(id_space_t *isp)
 {
-	return (ADDR_TO_ID(vmem_alloc(isp, 1, VM_NOSLEEP | VM_NEXTFIT)));
+	return (id_space_alloc(isp, B_TRUE, B_FALSE));
 }
 
 /*
@@ -116,7 +450,7 @@ id_alloc_nosleep(id_space_t *isp)
 id_t
 id_allocff(id_space_t *isp)
 {
-	return (ADDR_TO_ID(vmem_alloc(isp, 1, VM_SLEEP | VM_FIRSTFIT)));
+	return (id_space_alloc(isp, B_FALSE, B_TRUE));
 }
 
 /*
@@ -127,7 +461,7 @@ id_allocff(id_space_t *isp)
 id_t
 id_allocff_nosleep(id_space_t *isp)
 {
-	return (ADDR_TO_ID(vmem_alloc(isp, 1, VM_NOSLEEP | VM_FIRSTFIT)));
+	return (id_space_alloc(isp, B_FALSE, B_FALSE));
 }
 
 /*
@@ -139,13 +473,27 @@ id_alloc_specific_nosleep(id_space_t *isp, id_t id)
 {
 	void *minaddr = ID_TO_ADDR(id);
 	void *maxaddr = ID_TO_ADDR(id + 1);
+	size_t bit;
 
-	/*
-	 * Note that even though we're vmem_free()ing this later, it
-	 * should be OK, since there's no quantum cache.
-	 */
-	return (ADDR_TO_ID(vmem_xalloc(isp, 1, 1, 0, 0,
-	    minaddr, maxaddr, VM_NOSLEEP)));
+	if (!id_bitmap_enter(isp)) {
+		/*
+		 * Note that even though we're vmem_free()ing this later, it
+		 * should be OK, since there's no quantum cache.
+		 */
+		return (ADDR_TO_ID(vmem_xalloc(isp->is_vmem, 1, 1, 0, 0,
+		    minaddr, maxaddr, VM_NOSLEEP)));
+	}
+
+	bit = id - isp->is_low;
+	if (id < isp->is_low || bit >= isp->is_nbits ||
+	    BT_TEST(isp->is_map, bit)) {
+		mutex_exit(&isp->is_lock);
+		return (-1);
+	}
+	id_bit_set(isp, bit);
+	isp->is_nalloc++;
+	mutex_exit(&isp->is_lock);
+	return (id);
 }
 
 /*
@@ -155,5 +503,20 @@ id_alloc_specific_nosleep(id_space_t *isp, id_t id)
 void
 id_free(id_space_t *isp, id_t id)
 {
-	vmem_free(isp, ID_TO_ADDR(id), 1);
+	size_t bit;
+
+	if (!id_bitmap_enter(isp)) {
+		vmem_free(isp->is_vmem, ID_TO_ADDR(id), 1);
+		return;
+	}
+
+	bit = id - isp->is_low;
+	if (id < isp->is_low || bit >= isp->is_nbits ||
+	    !BT_TEST(isp->is_map, bit))
+		panic("id_free(%p, %d): bad free", (void *)isp, id);
+	id_bit_clear(isp, bit);
+	isp->is_nalloc--;
+	if (isp->is_nwait != 0)
+		cv_broadcast(&isp->is_cv);
+	mutex_exit(&isp->is_lock);
 }
@@ -838,6 +838,7 @@
 #include <sys/modctl.h>
 #include <sys/reboot.h>
 #include <sys/id32.h>
+#include <sys/lgrp.h>
 #include <sys/zone.h>
 #include <sys/netstack.h>
 #ifdef	DEBUG
@@ -876,6 +877,8 @@ struct kmem_cache_kstat {
 	kstat_named_t	kmc_full_magazines;
 	kstat_named_t	kmc_empty_magazines;
 	kstat_named_t	kmc_magazine_size;
+	kstat_named_t	kmc_depot_remote_alloc;
+	kstat_named_t	kmc_depot_remote_free;
 	kstat_named_t	kmc_reap; /* number of kmem_cache_reap() calls */
 	kstat_named_t	kmc_defrag; /* attempts to defrag all partial slabs */
 	kstat_named_t	kmc_scan; /* attempts to defrag one partial slab */
@@ -915,6 +918,8 @@ struct kmem_cache_kstat {
 	{ "full_magazines",	KSTAT_DATA_UINT64 },
 	{ "empty_magazines",	KSTAT_DATA_UINT64 },
 	{ "magazine_size",	KSTAT_DATA_UINT64 },
+	{ "depot_remote_alloc",	KSTAT_DATA_UINT64 },
+	{ "depot_remote_free",	KSTAT_DATA_UINT64 },
 	{ "reap",		KSTAT_DATA_UINT64 },
 	{ "defrag",		KSTAT_DATA_UINT64 },
 	{ "scan",		KSTAT_DATA_UINT64 },
@@ -1003,6 +1008,7 @@ static uint32_t kmem_reaping_idspace;
  */
 clock_t kmem_reap_interval;	/* cache reaping rate [15 * HZ ticks] */
 int kmem_depot_contention = 3;	/* max failed tryenters per real interval */
+int kmem_depot_remote = 1;	/* take remote full magazines before slabs */
 pgcnt_t kmem_reapahead = 0;	/* start reaping N pages before pageout */
 int kmem_panic = 1;		/* whether to panic on error */
 int kmem_logging = 1;		/* kmem_log_enter() override */
@@ -1476,6 +1482,27 @@ kmem_log_event(kmem_log_header_t *lp, kmem_cache_t *cp,
 	KMEM_AUDIT(lp, cp, &bca);
 }
 
+/*
+ * The lgroup whose full magazine list the current CPU uses; see the
+ * comment above kmem_depot_home().
+ */
+#define	KMEM_DEPOT_NFULL(cp)	\
+	((cp)->cache_lgrp_full == NULL ? 1 : nlgrpsmax)
+
+#define	KMEM_DEPOT_FULL(cp, id)		\
+	((id) == LGRP_ROOTID ? &(cp)->cache_full : &(cp)->cache_lgrp_full[id])
+
+static lgrp_id_t
+kmem_lgrp_local(kmem_cache_t *cp)
+{
+	lpl_t *lpl = CPU->cpu_lpl;
+
+	if (cp->cache_lgrp_full == NULL || lpl == NULL)
+		return (LGRP_ROOTID);
+	ASSERT(lpl->lpl_lgrpid >= 0 && lpl->lpl_lgrpid < nlgrpsmax);
+	return (lpl->lpl_lgrpid);
+}
+
 /*
  * Create a new slab for cache cp.
  */
@@ -1532,6 +1559,7 @@ kmem_slab_create(kmem_cache_t *cp, int kmflag)
 	sp->slab_stuck_offset = (uint32_t)-1;
 	sp->slab_later_count = 0;
 	sp->slab_flags = 0;
+	sp->slab_lgrp = kmem_lgrp_local(cp);
 
 	ASSERT(chunks > 0);
 	while (chunks-- != 0) {
@@ -2104,15 +2132,85 @@ kmem_depot_free(kmem_cache_t *cp, kmem_maglist_t *mlp, kmem_magazine_t *mp)
 	mutex_exit(&cp->cache_depot_lock);
 }
 
+/*
+ * On machines with more than one lgroup, the depot keeps full magazines on
+ * one list per lgroup, so that objects get reused close to the memory they
+ * live in: a full magazine goes to the list of the lgroup its objects came
+ * from, which is recorded in each slab, and kmem_cache_alloc() takes full
+ * magazines from its own lgroup's list first.  Only if that is empty does
+ * it take one from another lgroup (unless kmem_depot_remote is zero), which
+ * counts as remote allocations.  cache_full is the list of the root lgroup,
+ * and the only one on machines with a single lgroup.  Empty magazines,
+ * like the depot lock, are shared.
+ *
+ * kmem_depot_home() returns the list for a full magazine.  The home of a
+ * magazine is that of its first object, and the objects of a cache with
+ * KMF_HASH are assumed to be local, since finding their slab is too
+ * expensive.
+ */
+static kmem_maglist_t *
+kmem_depot_home(kmem_cache_t *cp, kmem_magazine_t *mp)
+{
+	lgrp_id_t local, home;
+
+	if (cp->cache_lgrp_full == NULL)
+		return (&cp->cache_full);
+
+	local = kmem_lgrp_local(cp);
+	if (cp->cache_flags & KMF_HASH)
+		return (KMEM_DEPOT_FULL(cp, local));
+
+	home = KMEM_SLAB(cp, mp->mag_round[0])->slab_lgrp;
+	ASSERT(home >= 0 && home < nlgrpsmax);
+	if (home != local)
+		atomic_inc_64(&cp->cache_remote_free);
+	return (KMEM_DEPOT_FULL(cp, home));
+}
+
+/*
+ * Allocate a full magazine from the depot, preferably one from the local
+ * lgroup.
+ */
+static kmem_magazine_t *
+kmem_depot_alloc_full(kmem_cache_t *cp)
+{
+	kmem_maglist_t *mlp;
+	kmem_magazine_t *mp;
+	lgrp_id_t local, id;
+
+	local = kmem_lgrp_local(cp);
+	if ((mp = kmem_depot_alloc(cp, KMEM_DEPOT_FULL(cp, local))) != NULL ||
+	    cp->cache_lgrp_full == NULL || !kmem_depot_remote)
+		return (mp);
+
+	for (id = 0; id < nlgrpsmax; id++) {
+		mlp = KMEM_DEPOT_FULL(cp, id);
+		if (id == local || mlp->ml_list == NULL)
+			continue;
+		if ((mp = kmem_depot_alloc(cp, mlp)) != NULL) {
+			atomic_add_64(&cp->cache_remote_alloc,
+			    cp->cache_magtype->mt_magsize);
+			break;
+		}
+	}
+	return (mp);
+}
+
 /*
  * Update the working set statistics for cp's depot.
  */
 static void
 kmem_depot_ws_update(kmem_cache_t *cp)
 {
+	kmem_maglist_t *mlp;
+	lgrp_id_t id;
+
 	mutex_enter(&cp->cache_depot_lock);
-	cp->cache_full.ml_reaplimit = cp->cache_full.ml_min;
-	cp->cache_full.ml_min = cp->cache_full.ml_total;
+	for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++) {
+		mlp = KMEM_DEPOT_FULL(cp, id);
+		mlp->ml_reaplimit = mlp->ml_min;
+		mlp->ml_min = mlp->ml_total;
+	}
 	cp->cache_empty.ml_reaplimit = cp->cache_empty.ml_min;
 	cp->cache_empty.ml_min = cp->cache_empty.ml_total;
 	mutex_exit(&cp->cache_depot_lock);
@@ -2125,14 +2223,45 @@ kmem_depot_ws_update(kmem_cache_t *cp)
 static void
 kmem_depot_ws_zero(kmem_cache_t *cp)
 {
+	kmem_maglist_t *mlp;
+	lgrp_id_t id;
+
 	mutex_enter(&cp->cache_depot_lock);
-	cp->cache_full.ml_reaplimit = cp->cache_full.ml_total;
-	cp->cache_full.ml_min = cp->cache_full.ml_total;
+	for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++) {
+		mlp = KMEM_DEPOT_FULL(cp, id);
+		mlp->ml_reaplimit = mlp->ml_total;
+		mlp->ml_min = mlp->ml_total;
+	}
 	cp->cache_empty.ml_reaplimit = cp->cache_empty.ml_total;
 	cp->cache_empty.ml_min = cp->cache_empty.ml_total;
 	mutex_exit(&cp->cache_depot_lock);
 }
 
+/*
+ * Return the number of full magazines in cp's depot, and optionally how
+ * many of them have fallen out of the working set.  The caller holds the
+ * depot lock.
+ */
+static long
+kmem_depot_full_total(kmem_cache_t *cp, long *reapp)
+{
+	kmem_maglist_t *mlp;
+	long total = 0, reap = 0;
+	lgrp_id_t id;
+
+	ASSERT(MUTEX_HELD(&cp->cache_depot_lock));
+
+	for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++) {
+		mlp = KMEM_DEPOT_FULL(cp, id);
+		total += mlp->ml_total;
+		reap += MIN(MIN(mlp->ml_reaplimit, mlp->ml_min),
+		    mlp->ml_total);
+	}
+	if (reapp != NULL)
+		*reapp = reap;
+	return (total);
+}
+
 /*
  * The number of bytes to reap before we call kpreempt(). The default (1MB)
  * causes us to preempt reaping up to hundreds of times per second. Using a
@@ -2149,18 +2278,24 @@ kmem_depot_ws_reap(kmem_cache_t *cp)
 	size_t bytes = 0;
 	long reap;
 	kmem_magazine_t *mp;
+	kmem_maglist_t *mlp;
+	lgrp_id_t id;
 
 	ASSERT(!list_link_active(&cp->cache_link) ||
 	    taskq_member(kmem_taskq, curthread));
 
-	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-	while (reap-- &&
-	    (mp = kmem_depot_alloc(cp, &cp->cache_full)) != NULL) {
-		kmem_magazine_destroy(cp, mp, cp->cache_magtype->mt_magsize);
-		bytes += cp->cache_magtype->mt_magsize * cp->cache_bufsize;
-		if (bytes > kmem_reap_preempt_bytes) {
-			kpreempt(KPREEMPT_SYNC);
-			bytes = 0;
+	for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++) {
+		mlp = KMEM_DEPOT_FULL(cp, id);
+		reap = MIN(mlp->ml_reaplimit, mlp->ml_min);
+		while (reap-- && (mp = kmem_depot_alloc(cp, mlp)) != NULL) {
+			kmem_magazine_destroy(cp, mp,
+			    cp->cache_magtype->mt_magsize);
+			bytes += cp->cache_magtype->mt_magsize *
+			    cp->cache_bufsize;
+			if (bytes > kmem_reap_preempt_bytes) {
+				kpreempt(KPREEMPT_SYNC);
+				bytes = 0;
+			}
 		}
 	}
 
@@ -2481,7 +2616,7 @@ kmem_cache_alloc(kmem_cache_t *cp, int kmflag)
 		/*
 		 * Try to get a full magazine from the depot.
 		 */
-		fmp = kmem_depot_alloc(cp, &cp->cache_full);
+		fmp = kmem_depot_alloc_full(cp);
 		if (fmp != NULL) {
 			if (ccp->cc_ploaded != NULL)
 				kmem_depot_free(cp, &cp->cache_empty,
@@ -2595,8 +2730,8 @@ kmem_cpucache_magazine_alloc(kmem_cpu_cache_t *ccp, kmem_cache_t *cp)
 	emp = kmem_depot_alloc(cp, &cp->cache_empty);
 	if (emp != NULL) {
 		if (ccp->cc_ploaded != NULL)
-			kmem_depot_free(cp, &cp->cache_full,
-			    ccp->cc_ploaded);
+			kmem_depot_free(cp, kmem_depot_home(cp,
+			    ccp->cc_ploaded), ccp->cc_ploaded);
 		kmem_cpu_reload(ccp, emp, 0);
 		return (1);
 	}
@@ -3004,21 +3139,27 @@ kmem_cache_reap(kmem_cache_t *cp)
 	 * callback is just an advisory plea for help.
 	 */
 	if (cp->cache_reclaim != NULL) {
+		long total[NLGRPS_MAX];
+		kmem_maglist_t *mlp;
 		long delta;
+		lgrp_id_t id;
 
 		/*
 		 * Reclaimed memory should be reapable (not included in the
 		 * depot's working set).
 		 */
-		delta = cp->cache_full.ml_total;
+		for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++)
+			total[id] = KMEM_DEPOT_FULL(cp, id)->ml_total;
 		cp->cache_reclaim(cp->cache_private);
-		delta = cp->cache_full.ml_total - delta;
-		if (delta > 0) {
-			mutex_enter(&cp->cache_depot_lock);
-			cp->cache_full.ml_reaplimit += delta;
-			cp->cache_full.ml_min += delta;
-			mutex_exit(&cp->cache_depot_lock);
+		mutex_enter(&cp->cache_depot_lock);
+		for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++) {
+			mlp = KMEM_DEPOT_FULL(cp, id);
+			if ((delta = mlp->ml_total - total[id]) > 0) {
+				mlp->ml_reaplimit += delta;
+				mlp->ml_min += delta;
+			}
 		}
+		mutex_exit(&cp->cache_depot_lock);
 	}
 
 	kmem_depot_ws_reap(cp);
@@ -3055,6 +3196,10 @@ kmem_reap_start(void *flag)
 
 	if (flag == &kmem_reaping) {
 		kmem_cache_applyall(kmem_cache_reap, kmem_taskq, TQ_NOSLEEP);
+		/*
+		 * Give back what's sitting in the vmem per-cpu magazines.
+		 */
+		vmem_reap();
 		/*
 		 * if we have segkp under heap, reap segkp cache.
 		 */
@@ -3375,8 +3520,10 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 	kmem_cache_t *cp = ksp->ks_private;
 	uint64_t cpu_buf_avail;
 	uint64_t buf_avail = 0;
+	uint64_t depot_alloc = 0;
 	int cpu_seqid;
-	long reap;
+	long full, reap;
+	lgrp_id_t id;
 
 	ASSERT(MUTEX_HELD(&kmem_cache_kstat_lock));
 
@@ -3411,21 +3558,24 @@ kmem_cache_kstat_update(kstat_t *ksp, int rw)
 
 	mutex_enter(&cp->cache_depot_lock);
 
-	kmcp->kmc_depot_alloc.value.ui64	= cp->cache_full.ml_alloc;
+	full = kmem_depot_full_total(cp, &reap);
+	for (id = 0; id < KMEM_DEPOT_NFULL(cp); id++)
+		depot_alloc += KMEM_DEPOT_FULL(cp, id)->ml_alloc;
+
+	kmcp->kmc_depot_alloc.value.ui64	= depot_alloc;
 	kmcp->kmc_depot_free.value.ui64		= cp->cache_empty.ml_alloc;
 	kmcp->kmc_depot_contention.value.ui64	= cp->cache_depot_contention;
-	kmcp->kmc_full_magazines.value.ui64	= cp->cache_full.ml_total;
+	kmcp->kmc_full_magazines.value.ui64	= full;
 	kmcp->kmc_empty_magazines.value.ui64	= cp->cache_empty.ml_total;
 	kmcp->kmc_magazine_size.value.ui64	=
 	    (cp->cache_flags & KMF_NOMAGAZINE) ?
 	    0 : cp->cache_magtype->mt_magsize;
+	kmcp->kmc_depot_remote_alloc.value.ui64	= cp->cache_remote_alloc;
+	kmcp->kmc_depot_remote_free.value.ui64	= cp->cache_remote_free;
 
-	kmcp->kmc_alloc.value.ui64		+= cp->cache_full.ml_alloc;
+	kmcp->kmc_alloc.value.ui64		+= depot_alloc;
 	kmcp->kmc_free.value.ui64		+= cp->cache_empty.ml_alloc;
-	buf_avail += cp->cache_full.ml_total * cp->cache_magtype->mt_magsize;
-
-	reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-	reap = MIN(reap, cp->cache_full.ml_total);
+	buf_avail += full * cp->cache_magtype->mt_magsize;
 
 	mutex_exit(&cp->cache_depot_lock);
 
@@ -3887,6 +4037,11 @@ kmem_cache_create(
 	 * Initialize the depot.
 	 */
 	mutex_init(&cp->cache_depot_lock, NULL, MUTEX_DEFAULT, NULL);
+	if (nlgrpsmax > 1) {
+		cp->cache_lgrp_full = vmem_alloc(kmem_cache_arena,
+		    nlgrpsmax * sizeof (kmem_maglist_t), VM_SLEEP);
+		bzero(cp->cache_lgrp_full, nlgrpsmax * sizeof (kmem_maglist_t));
+	}
 
 	for (mtp = kmem_magtype; chunksize <= mtp->mt_minbuf; mtp++)
 		continue;
@@ -4076,6 +4231,9 @@ kmem_cache_destroy(kmem_cache_t *cp)
 	for (cpu_seqid = 0; cpu_seqid < max_ncpus; cpu_seqid++)
 		mutex_destroy(&cp->cache_cpu[cpu_seqid].cc_lock);
 
+	if (cp->cache_lgrp_full != NULL)
+		vmem_free(kmem_cache_arena, cp->cache_lgrp_full,
+		    nlgrpsmax * sizeof (kmem_maglist_t));
 	mutex_destroy(&cp->cache_depot_lock);
 	mutex_destroy(&cp->cache_lock);
 
@@ -5259,8 +5417,7 @@ kmem_cache_is_fragmented(kmem_cache_t *cp, boolean_t *doreap)
 		long reap;
 
 		mutex_enter(&cp->cache_depot_lock);
-		reap = MIN(cp->cache_full.ml_reaplimit, cp->cache_full.ml_min);
-		reap = MIN(reap, cp->cache_full.ml_total);
+		(void) kmem_depot_full_total(cp, &reap);
 		mutex_exit(&cp->cache_depot_lock);
 
 		nfree += ((uint64_t)reap * cp->cache_magtype->mt_magsize);
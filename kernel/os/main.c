@@ -47,6 +47,7 @@
 #include <sys/procset.h>
 #include <sys/disp.h>
 #include <sys/callo.h>
+#include <sys/epoch.h>
 #include <sys/callb.h>
 #include <sys/debug.h>
 #include <sys/conf.h>
@@ -426,6 +427,7 @@ main(void)
 	callout_init();	/* callout table MUST be init'd after cyclics */
 	clock_tick_init_pre();
 	clock_init();
+	epoch_init();
 
 #if defined(__x86)
 	/*
@@ -116,6 +116,7 @@
  *
  *   mod_hash_find(hash, key, val):
  *	find a value in the hash table corresponding to the given key.
+ *	Lookups take no lock; see "Lock-free lookups" below.
  *
  *   mod_hash_find_cb(hash, key, val, found_callback)
  *	find a value in the hash table corresponding to the given key.
@@ -135,12 +136,31 @@
  *   mod_hash_clear(hash):
  *	clears the given hash table of entries, calling the key and value
  *	destructors for every element in the hash.
+ *
+ * Lock-free lookups:
+ *
+ *   mod_hash_find() walks the hash chain in an epoch section (see epoch.c)
+ *   rather than holding mh_contents as reader, so lookups on all CPUs no
+ *   longer share the lock's cache line.  Everything else still takes
+ *   mh_contents.  For this to work, entries are published with
+ *   membar_producer() once they are fully initialized, and the entries
+ *   unlinked by a remove or clear are freed -- and their keys destroyed --
+ *   through call_epoch(), once no lookup can still be looking at them.
+ *   Values are still destroyed right away: as before, a value returned by
+ *   mod_hash_find() is only safe to use for as long as the caller otherwise
+ *   keeps it from being removed.  The hash algorithm and key comparator are
+ *   called in the epoch section, and must not block.  Since key destructors
+ *   may run after the remove returns, mod_hash_destroy_hash() waits for all
+ *   deferred frees before it returns, so that a module can destroy its
+ *   hashes and be unloaded.
  */
 
 #include <sys/bitmap.h>
 #include <sys/debug.h>
 #include <sys/kmem.h>
+#include <sys/stddef.h>
 #include <sys/sunddi.h>
+#include <sys/epoch.h>
 
 #include <sys/modhash_impl.h>
 
@@ -500,9 +520,11 @@ mod_hash_destroy_hash(mod_hash_t *hash)
 	mutex_exit(&mh_head_lock);
 
 	/*
-	 * Clean out keys and values.
+	 * Clean out keys and values, and wait for the deferred key
+	 * destructors, which may belong to a module about to be unloaded.
 	 */
 	mod_hash_clear(hash);
+	epoch_synchronize();
 
 	rw_destroy(&hash->mh_contents);
 
@@ -569,6 +591,7 @@ i_mod_hash_insert_nosync(mod_hash_t *hash, mod_hash_key_t key,
 	entry->mhe_val = val;
 	entry->mhe_next = hash->mh_entries[hashidx];
 
+	membar_producer();	/* for mod_hash_find() */
 	hash->mh_entries[hashidx] = entry;
 	hash->mh_stat.mhs_nelems++;
 
@@ -661,6 +684,29 @@ mod_hash_cancel(mod_hash_t *hash, mod_hash_hndl_t *handlep)
 	*handlep = (mod_hash_hndl_t)0;
 }
 
+/*
+ * i_mod_hash_entry_free()
+ * i_mod_hash_entry_defer()
+ * 	Destroy the key of an unlinked entry and free it, once mod_hash_find()
+ * 	can no longer be looking at it.
+ */
+static void
+i_mod_hash_entry_free(epoch_cb_t *ec)
+{
+	struct mod_hash_entry *e = (struct mod_hash_entry *)((uintptr_t)ec -
+	    offsetof(struct mod_hash_entry, mhe_epoch));
+
+	e->mhe_kdtor(e->mhe_key);
+	kmem_cache_free(mh_e_cache, e);
+}
+
+static void
+i_mod_hash_entry_defer(mod_hash_t *hash, struct mod_hash_entry *e)
+{
+	e->mhe_kdtor = hash->mh_kdtor;
+	call_epoch(&e->mhe_epoch, i_mod_hash_entry_free);
+}
+
 /*
  * i_mod_hash_remove_nosync()
  * mod_hash_remove()
@@ -692,12 +738,10 @@ i_mod_hash_remove_nosync(mod_hash_t *hash, mod_hash_key_t key,
 		ep->mhe_next = e->mhe_next;
 
 	/*
-	 * Clean up resources used by the node's key.
+	 * Clean up resources used by the node's key, and the node.
 	 */
-	MH_KEY_DESTROY(hash, e->mhe_key);
-
 	*val = e->mhe_val;
-	kmem_cache_free(mh_e_cache, e);
+	i_mod_hash_entry_defer(hash, e);
 	hash->mh_stat.mhs_nelems--;
 
 	return (0);
@@ -795,9 +839,9 @@ mod_hash_find(mod_hash_t *hash, mod_hash_key_t key, mod_hash_val_t *val)
 {
 	int res;
 
-	rw_enter(&hash->mh_contents, RW_READER);
+	epoch_enter();
 	res = i_mod_hash_find_nosync(hash, key, val);
-	rw_exit(&hash->mh_contents);
+	epoch_exit();
 
 	return (res);
 }
@@ -886,14 +930,13 @@ i_mod_hash_clear_nosync(mod_hash_t *hash)
 
 	for (i = 0; i < hash->mh_nchains; i++) {
 		e = hash->mh_entries[i];
+		hash->mh_entries[i] = NULL;
 		while (e != NULL) {
-			MH_KEY_DESTROY(hash, e->mhe_key);
 			MH_VAL_DESTROY(hash, e->mhe_val);
 			old_e = e;
 			e = e->mhe_next;
-			kmem_cache_free(mh_e_cache, old_e);
+			i_mod_hash_entry_defer(hash, old_e);
 		}
-		hash->mh_entries[i] = NULL;
 	}
 	hash->mh_stat.mhs_nelems = 0;
 }
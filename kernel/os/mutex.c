@@ -177,6 +177,32 @@
  * Only direct handoff can prevent the thundering herd problem, but as
  * mentioned earlier, that would tend to defeat the adaptive spin logic.
  * In practice, option (3) works well because the blocking case is rare.
+ *
+ * Queued spinning.  The exponential backoff below keeps spinners off the
+ * lock word most of the time, but every retry still pulls the cache line
+ * over, and when the owner drops a lock with many spinners they all pounce
+ * on it at once.  On large, multi-socket machines this cross-socket traffic
+ * dominates the cost of a hot lock.  So once a spinner has seen the lock
+ * change hands mutex_qspin_threshold times without getting it, it joins a
+ * FIFO queue of spinners for that lock, in the manner of an MCS lock: only
+ * the thread at the head of the queue keeps polling the lock word, while
+ * the others spin on a flag in their own queue node (on their stack) until
+ * their predecessors are gone.
+ *
+ * The mutex itself has no room for a queue, so queues live in a small hash
+ * table of slots, mutex_qslots[], indexed by lock address.  A slot only ever
+ * holds spinners for one mutex at a time; a spinner whose slot is in use
+ * for a colliding mutex just keeps spinning the old way.  Nobody waits in a
+ * queue for anything but the lock itself, so queueing can't introduce new
+ * deadlocks.  Queue manipulation is protected by a spin lock in the slot,
+ * which each spinner takes only to join and leave the queue, plus once in a
+ * while to check that waiting is still worthwhile: the queue must be left
+ * if the lock owner stops running (so that we block as usual), or if the
+ * thread at the head of the queue is off its CPU, whether it was preempted
+ * or pinned by an interrupt.  The slot lock is taken at DISP_LEVEL, and
+ * interrupt threads never queue, since they could wait behind the thread
+ * they pinned.  Time spent queued is reported by the adaptive-qspin
+ * lockstat probe.
  */
 
 /*
@@ -208,6 +234,7 @@
 #include <sys/time.h>
 #include <sys/cpuvar.h>
 #include <sys/thread.h>
+#include <sys/disp.h>
 #include <sys/debug.h>
 #include <sys/cmn_err.h>
 #include <sys/sobject.h>
@@ -335,6 +362,156 @@ uint_t (*mutex_lock_backoff)(uint_t) = default_lock_backoff;
 void (*mutex_lock_delay)(uint_t) = default_lock_delay;
 void (*mutex_delay)(void) = mutex_delay_default;
 
+/*
+ * Queued spinning; see the Big Theory Statement.
+ *
+ * mutex_qspin_threshold is the number of times a spinner sees the lock
+ * change hands before it queues up (0 disables queued spinning), and
+ * mutex_qspin_check is the number of delay loops between the checks of a
+ * queued spinner.
+ */
+uint_t mutex_qspin_threshold = 4;
+uint_t mutex_qspin_check = 1000;
+
+typedef struct mutex_qnode {
+	struct mutex_qnode *qn_next;
+	struct mutex_qnode *qn_prev;
+	kthread_t	*qn_thread;
+	volatile uint_t	qn_wait;	/* spin until cleared */
+} mutex_qnode_t;
+
+typedef struct mutex_qslot {
+	lock_t		qs_lock;	/* protects the queue */
+	mutex_impl_t	*qs_mutex;	/* mutex being waited for */
+	mutex_qnode_t	*qs_head;
+	mutex_qnode_t	*qs_tail;
+	uchar_t		qs_pad[64 - 4 * sizeof (void *)];
+} mutex_qslot_t;
+
+#define	MUTEX_QSLOTS		128	/* must be power of 2 */
+#define	MUTEX_QSLOT(lp)		(&mutex_qslots[((((ulong_t)(lp) >> 3) + \
+	((ulong_t)(lp) >> 9)) & (MUTEX_QSLOTS - 1))])
+
+#pragma align 64(mutex_qslots)
+static mutex_qslot_t mutex_qslots[MUTEX_QSLOTS];
+
+/*
+ * Remove 'qn' from the queue in 'qs', and let the next spinner go if 'qn'
+ * was at the head.
+ */
+static void
+mutex_qspin_unlink(mutex_qslot_t *qs, mutex_qnode_t *qn)
+{
+	ASSERT(LOCK_HELD(&qs->qs_lock));
+
+	if (qn->qn_prev != NULL)
+		qn->qn_prev->qn_next = qn->qn_next;
+	else
+		qs->qs_head = qn->qn_next;
+	if (qn->qn_next != NULL)
+		qn->qn_next->qn_prev = qn->qn_prev;
+	else
+		qs->qs_tail = qn->qn_prev;
+
+	if (qs->qs_head == NULL)
+		qs->qs_mutex = NULL;
+	else
+		qs->qs_head->qn_wait = 0;
+}
+
+/*
+ * Is 't', a thread queued on 'qs', running on its CPU?  As in
+ * mutex_owner_running(), a thread pinned by an interrupt thread isn't.
+ */
+static boolean_t
+mutex_qspin_oncpu(mutex_qslot_t *qs, kthread_t *t)
+{
+	ASSERT(LOCK_HELD(&qs->qs_lock));
+
+	return (t->t_cpu->cpu_thread == t);
+}
+
+/*
+ * Join the queue of spinners for 'lp' and wait until we reach its head.
+ * Returns B_TRUE if we're at the head of the queue, B_FALSE if we couldn't
+ * join or had to leave the queue.
+ *
+ * The slot's lock is taken at DISP_LEVEL, so that an interrupt can't pin
+ * its holder, and interrupt threads never queue: one queued behind the
+ * thread it pinned would wait for it forever.
+ */
+static boolean_t
+mutex_qspin_enter(mutex_impl_t *lp, mutex_qnode_t *qn)
+{
+	mutex_qslot_t *qs = MUTEX_QSLOT(lp);
+	volatile mutex_impl_t *vlp = (volatile mutex_impl_t *)lp;
+	uint_t spins = 0;
+	ushort_t s;
+	boolean_t bail;
+
+	if (servicing_interrupt())
+		return (B_FALSE);
+
+	lock_set_spl(&qs->qs_lock, ipltospl(DISP_LEVEL), &s);
+	if (qs->qs_mutex != NULL && qs->qs_mutex != lp) {
+		lock_clear_splx(&qs->qs_lock, s);
+		return (B_FALSE);
+	}
+	qs->qs_mutex = lp;
+	qn->qn_thread = curthread;
+	qn->qn_next = NULL;
+	qn->qn_prev = qs->qs_tail;
+	if (qs->qs_tail != NULL) {
+		qs->qs_tail->qn_next = qn;
+		qn->qn_wait = 1;
+	} else {
+		qs->qs_head = qn;
+		qn->qn_wait = 0;
+	}
+	qs->qs_tail = qn;
+	lock_clear_splx(&qs->qs_lock, s);
+
+	while (qn->qn_wait) {
+		MUTEX_DELAY();
+		if (++spins < mutex_qspin_check && !panicstr)
+			continue;
+		spins = 0;
+
+		/*
+		 * Stop waiting if the head of the queue isn't running, since
+		 * it won't take the lock soon, or if the lock's owner isn't,
+		 * since the head will block.
+		 */
+		lock_set_spl(&qs->qs_lock, ipltospl(DISP_LEVEL), &s);
+		bail = qn->qn_wait && (panicstr ||
+		    !mutex_qspin_oncpu(qs, qs->qs_head->qn_thread) ||
+		    (MUTEX_OWNER(vlp) != NULL &&
+		    mutex_owner_running(lp) == NULL));
+		if (bail)
+			mutex_qspin_unlink(qs, qn);
+		lock_clear_splx(&qs->qs_lock, s);
+
+		if (bail)
+			return (B_FALSE);
+	}
+	return (B_TRUE);
+}
+
+/*
+ * Leave the queue of spinners for 'lp', which we head.
+ */
+static void
+mutex_qspin_exit(mutex_impl_t *lp, mutex_qnode_t *qn)
+{
+	mutex_qslot_t *qs = MUTEX_QSLOT(lp);
+	ushort_t s;
+
+	lock_set_spl(&qs->qs_lock, ipltospl(DISP_LEVEL), &s);
+	ASSERT(qs->qs_mutex == lp && qs->qs_head == qn);
+	mutex_qspin_unlink(qs, qn);
+	lock_clear_splx(&qs->qs_lock, s);
+}
+
 /*
  * mutex_vector_enter() is called from the assembly mutex_enter() routine
  * if the lock is held or is not of type MUTEX_ADAPTIVE.
@@ -351,6 +528,10 @@ mutex_vector_enter(mutex_impl_t *lp)
 	volatile mutex_impl_t *vlp = (volatile mutex_impl_t *)lp;
 	uint_t		backoff = 0;	/* current backoff */
 	int		changecnt = 0;	/* count of owner changes */
+	uint_t		contention = 0;	/* owner changes since queueing */
+	mutex_qnode_t	qn;		/* our node in a spinner queue */
+	boolean_t	queued = B_FALSE;	/* at the head of a queue */
+	hrtime_t	qspin_time = 0;	/* how long we spun queued */
 
 	ASSERT_STACK_ALIGNED();
 
@@ -386,8 +567,11 @@ mutex_vector_enter(mutex_impl_t *lp)
 	for (;;) {
 		mutex_lock_delay(backoff); /* backoff delay */
 
-		if (panicstr)
+		if (panicstr) {
+			if (queued)
+				mutex_qspin_exit(lp, &qn);
 			return;
+		}
 
 		if ((owner = MUTEX_OWNER(vlp)) == NULL) {
 			if (mutex_adaptive_tryenter(lp)) {
@@ -396,11 +580,13 @@ mutex_vector_enter(mutex_impl_t *lp)
 			/* increase backoff only on failed attempt. */
 			backoff = mutex_lock_backoff(backoff);
 			changecnt++;
+			contention++;
 			continue;
 		} else if (lastowner != owner) {
 			lastowner = owner;
 			backoff = mutex_lock_backoff(backoff);
 			changecnt++;
+			contention++;
 		}
 
 		if (changecnt >= ncpus_online) {
@@ -419,9 +605,37 @@ mutex_vector_enter(mutex_impl_t *lp)
 			continue;
 
 		if (mutex_owner_running(lp) != NULL)  {
+			/*
+			 * If the lock is contended, wait our turn in the
+			 * queue of spinners.  The head of the queue goes on
+			 * spinning here.
+			 */
+			if (!queued && mutex_qspin_threshold != 0 &&
+			    contention >= mutex_qspin_threshold) {
+				contention = 0;
+				qspin_time =
+				    LOCKSTAT_START_TIME(LS_MUTEX_ENTER_QSPIN);
+				queued = mutex_qspin_enter(lp, &qn);
+				if (!queued && qspin_time != 0) {
+					LOCKSTAT_RECORD_TIME(
+					    LS_MUTEX_ENTER_QSPIN, lp,
+					    qspin_time);
+				}
+				backoff = mutex_lock_backoff(0);
+			}
 			continue;
 		}
 
+		/*
+		 * Don't hold up other spinners while we block.
+		 */
+		if (queued) {
+			mutex_qspin_exit(lp, &qn);
+			queued = B_FALSE;
+			LOCKSTAT_RECORD_TIME(LS_MUTEX_ENTER_QSPIN, lp,
+			    qspin_time);
+		}
+
 		/*
 		 * The owner appears not to be running, so block.
 		 * See the Big Theory Statement for memory ordering issues.
@@ -457,6 +671,11 @@ mutex_vector_enter(mutex_impl_t *lp)
 
 	ASSERT(MUTEX_OWNER(lp) == curthread);
 
+	if (queued) {
+		mutex_qspin_exit(lp, &qn);
+		LOCKSTAT_RECORD_TIME(LS_MUTEX_ENTER_QSPIN, lp, qspin_time);
+	}
+
 	if (sleep_time != 0) {
 		/*
 		 * Note, sleep time is the sum of all the sleeping we
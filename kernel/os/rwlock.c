@@ -38,6 +38,8 @@
 #include <sys/rwlock_impl.h>
 #include <sys/atomic.h>
 #include <sys/lockstat.h>
+#include <sys/kmem.h>
+#include <sys/sysmacros.h>
 
 /*
  * Big Theory Statement for readers/writer locking primitives.
@@ -194,6 +196,9 @@
  *
  * (3) Waiters receive the lock by direct handoff from the previous
  *     owner.  Therefore, waiters *always* wake up holding the lock.
+ *
+ * None of the above applies to RW_PERCPU locks, which are described with
+ * their implementation below.
  */
 
 /*
@@ -224,11 +229,308 @@ rw_panic(char *msg, rwlock_impl_t *lp)
 	    msg, (void *)lp, panic_rwlock.rw_wwwh, (void *)curthread);
 }
 
+/*
+ * RW_PERCPU locks.
+ *
+ * Every rw_enter(RW_READER) of an ordinary rwlock modifies the lock word, so
+ * a lock that is read on all CPUs at once and hardly ever written (the vfs
+ * list, a netstack's ill_g_lock) spends most of its time moving that cache
+ * line between CPUs.  An rwlock initialized as RW_PERCPU trades writer cost
+ * for reader scalability: readers only update a counter in their own CPU's
+ * cache line, and a writer has to look at the counters of all CPUs.
+ *
+ * The lock word of an RW_PERCPU lock points to an rwlock_percpu_t, tagged so
+ * that the assembly fast paths always fail over to rw_enter_sleep() and
+ * rw_exit_wakeup() (see RW_PERCPU_TAG), where we divert to the code below.
+ * Its state is:
+ *
+ *	rwp_cpu[]	Per-CPU reader counts.  A reader increments the count of
+ *			the CPU it enters on and decrements the count of the CPU
+ *			it exits on; only the sum over all CPUs is meaningful.
+ *	rwp_writer	Set by a writer to claim the lock.
+ *	rwp_owner	The writer, once all the readers have left.
+ *
+ * A reader increments its count and then checks rwp_writer.  A writer sets
+ * rwp_writer and then sums the counts.  Both are separated by a membar, so
+ * either the reader sees the writer and backs off (decrementing the count it
+ * incremented, so that a concurrent summation never sees a decrement without
+ * its increment), or the writer sees the reader and waits on rwp_drain_cv
+ * for it to leave.  A reader leaving a claimed lock wakes the writer; readers
+ * backing off wait on rwp_cv until the writer is done.  Writers serialize on
+ * rwp_lock and rwp_writer.
+ *
+ * Like an ordinary rwlock, an RW_PERCPU lock blocks new readers as soon as a
+ * writer wants it, so a writer cannot be starved by readers.  This means that
+ * RW_READER_STARVEWRITER has no special meaning here; it is treated as
+ * RW_READER.  Unlike an ordinary rwlock, blocked threads wait on condition
+ * variables rather than a turnstile, so there is no priority inheritance:
+ * they do not lend their priority to the writer, and readers give up kpri
+ * while they wait.  Also, rw_read_held() tells whether any thread at all
+ * may hold the lock as reader (as it does for an ordinary rwlock, but also
+ * during the brief window in which a reader backs off), and the DTrace
+ * rwlock subroutines do not know about RW_PERCPU locks.
+ *
+ * Each RW_PERCPU lock costs a cache line per possible CPU, and it can only be
+ * initialized once the kernel memory allocator is up and in a context that
+ * can sleep: it should only be used for a few, long-lived, read-mostly locks.
+ * Setting rw_percpu_disable turns any RW_PERCPU lock initialized afterwards
+ * into an ordinary one.
+ */
+int rw_percpu_disable = 0;
+
+static ulong_t
+rw_percpu_readers(rwlock_percpu_t *rwp)
+{
+	ulong_t readers = 0;
+	int i;
+
+	for (i = 0; i < max_ncpus; i++)
+		readers += rwp->rwp_cpu[i].rpc_readers;
+	return (readers);
+}
+
+/*
+ * Drop a reader count on the CPU we run on, or on 'rpc' when backing off.
+ * Migrating after picking the CPU is harmless: any count will do.
+ */
+static void
+rw_percpu_read_exit(rwlock_percpu_t *rwp, rwlock_percpu_cpu_t *rpc)
+{
+	if (rpc == NULL)
+		rpc = &rwp->rwp_cpu[CPU->cpu_seqid];
+	atomic_dec_ulong(&rpc->rpc_readers);
+	membar_enter();
+	if (rwp->rwp_writer != 0) {
+		mutex_enter(&rwp->rwp_lock);
+		cv_broadcast(&rwp->rwp_drain_cv);
+		mutex_exit(&rwp->rwp_lock);
+	}
+}
+
+static int
+rw_percpu_read_tryenter(rwlock_percpu_t *rwp)
+{
+	rwlock_percpu_cpu_t *rpc = &rwp->rwp_cpu[CPU->cpu_seqid];
+
+	atomic_inc_ulong(&rpc->rpc_readers);
+	membar_enter();
+	if (rwp->rwp_writer == 0)
+		return (1);
+	rw_percpu_read_exit(rwp, rpc);
+	return (0);
+}
+
+/*
+ * Claim the lock for the calling writer, with rwp_lock held.  If 'wait' is
+ * set, wait for other writers and for the readers; otherwise fail if there
+ * are more than 'readers' readers.
+ */
+static int
+rw_percpu_write_claim(rwlock_impl_t *lp, boolean_t wait, ulong_t readers)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+	hrtime_t sleep_time = 0;
+
+	ASSERT(MUTEX_HELD(&rwp->rwp_lock));
+
+	if (rwp->rwp_owner == curthread) {
+		rw_panic("recursive rw_enter", lp);
+		return (0);
+	}
+
+	while (rwp->rwp_writer != 0) {
+		if (!wait || panicstr)
+			return (0);
+		if (sleep_time == 0)
+			sleep_time = gethrtime();
+		cv_wait(&rwp->rwp_cv, &rwp->rwp_lock);
+	}
+	rwp->rwp_writer = 1;
+	membar_enter();
+
+	while (rw_percpu_readers(rwp) > readers) {
+		if (!wait) {
+			rwp->rwp_writer = 0;
+			cv_broadcast(&rwp->rwp_cv);
+			return (0);
+		}
+		if (panicstr)
+			break;
+		if (sleep_time == 0)
+			sleep_time = gethrtime();
+		cv_wait(&rwp->rwp_drain_cv, &rwp->rwp_lock);
+	}
+	rwp->rwp_owner = curthread;
+
+	if (sleep_time != 0) {
+		CPU_STATS_ADDQ(CPU, sys, rw_wrfails, 1);
+		LOCKSTAT_RECORD4(LS_RW_ENTER_BLOCK, lp,
+		    gethrtime() - sleep_time, RW_WRITER, 0, 0);
+	}
+	return (1);
+}
+
+static void
+rw_percpu_enter(rwlock_impl_t *lp, krw_t rw)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+	hrtime_t sleep_time = 0;
+
+	if (rw == RW_WRITER) {
+		mutex_enter(&rwp->rwp_lock);
+		(void) rw_percpu_write_claim(lp, B_TRUE, 0);
+		mutex_exit(&rwp->rwp_lock);
+		membar_enter();
+		LOCKSTAT_RECORD(LS_RW_ENTER_ACQUIRE, lp, rw);
+		return;
+	}
+
+	while (!rw_percpu_read_tryenter(rwp)) {
+		if (panicstr)
+			return;
+		if (sleep_time == 0)
+			sleep_time = gethrtime();
+		/*
+		 * Drop kpri while we block, as rw_enter_sleep() does, and
+		 * take it back before we try again.
+		 */
+		mutex_enter(&rwp->rwp_lock);
+		if (rwp->rwp_writer != 0) {
+			THREAD_KPRI_RELEASE();
+			while (rwp->rwp_writer != 0)
+				cv_wait(&rwp->rwp_cv, &rwp->rwp_lock);
+			THREAD_KPRI_REQUEST();
+		}
+		mutex_exit(&rwp->rwp_lock);
+	}
+
+	if (sleep_time != 0) {
+		CPU_STATS_ADDQ(CPU, sys, rw_rdfails, 1);
+		LOCKSTAT_RECORD4(LS_RW_ENTER_BLOCK, lp,
+		    gethrtime() - sleep_time, rw, 1, 0);
+	}
+	LOCKSTAT_RECORD(LS_RW_ENTER_ACQUIRE, lp, rw);
+}
+
+static void
+rw_percpu_exit(rwlock_impl_t *lp)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+	membar_exit();
+
+	if (rwp->rwp_owner != curthread) {
+		rw_percpu_read_exit(rwp, NULL);
+		THREAD_KPRI_RELEASE();
+		LOCKSTAT_RECORD(LS_RW_EXIT_RELEASE, lp, RW_READER);
+		return;
+	}
+
+	mutex_enter(&rwp->rwp_lock);
+	rwp->rwp_owner = NULL;
+	rwp->rwp_writer = 0;
+	cv_broadcast(&rwp->rwp_cv);
+	mutex_exit(&rwp->rwp_lock);
+	LOCKSTAT_RECORD(LS_RW_EXIT_RELEASE, lp, RW_WRITER);
+}
+
+static int
+rw_percpu_tryenter(rwlock_impl_t *lp, krw_t rw)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+	if (rw != RW_WRITER) {
+		THREAD_KPRI_REQUEST();
+		if (!rw_percpu_read_tryenter(rwp)) {
+			THREAD_KPRI_RELEASE();
+			return (0);
+		}
+	} else {
+		mutex_enter(&rwp->rwp_lock);
+		if (!rw_percpu_write_claim(lp, B_FALSE, 0)) {
+			mutex_exit(&rwp->rwp_lock);
+			return (0);
+		}
+		mutex_exit(&rwp->rwp_lock);
+	}
+	membar_enter();
+	LOCKSTAT_RECORD(LS_RW_TRYENTER_ACQUIRE, lp, rw);
+	return (1);
+}
+
+static void
+rw_percpu_downgrade(rwlock_impl_t *lp)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+	membar_exit();
+
+	if (rwp->rwp_owner != curthread) {
+		rw_panic("rw_downgrade: not owner", lp);
+		return;
+	}
+
+	THREAD_KPRI_REQUEST();
+	atomic_inc_ulong(&rwp->rwp_cpu[CPU->cpu_seqid].rpc_readers);
+	mutex_enter(&rwp->rwp_lock);
+	rwp->rwp_owner = NULL;
+	rwp->rwp_writer = 0;
+	cv_broadcast(&rwp->rwp_cv);
+	mutex_exit(&rwp->rwp_lock);
+	LOCKSTAT_RECORD0(LS_RW_DOWNGRADE_DOWNGRADE, lp);
+}
+
+/*
+ * As for an ordinary rwlock, the upgrade only succeeds if we are the only
+ * reader and no writer wants the lock.
+ */
+static int
+rw_percpu_tryupgrade(rwlock_impl_t *lp)
+{
+	rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+	mutex_enter(&rwp->rwp_lock);
+	if (!rw_percpu_write_claim(lp, B_FALSE, 1)) {
+		mutex_exit(&rwp->rwp_lock);
+		return (0);
+	}
+	atomic_dec_ulong(&rwp->rwp_cpu[CPU->cpu_seqid].rpc_readers);
+	mutex_exit(&rwp->rwp_lock);
+
+	membar_enter();
+	THREAD_KPRI_RELEASE();
+	LOCKSTAT_RECORD0(LS_RW_TRYUPGRADE_UPGRADE, lp);
+	return (1);
+}
+
 /* ARGSUSED */
 void
 rw_init(krwlock_t *rwlp, char *name, krw_type_t type, void *arg)
 {
-	((rwlock_impl_t *)rwlp)->rw_wwwh = 0;
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
+	rwlock_percpu_t *rwp;
+	size_t size;
+
+	if (type != RW_PERCPU || rw_percpu_disable) {
+		lp->rw_wwwh = 0;
+		return;
+	}
+
+	/*
+	 * Leave room to align the per-CPU counts on their own cache lines.
+	 */
+	size = sizeof (rwlock_percpu_t) +
+	    (max_ncpus + 1) * sizeof (rwlock_percpu_cpu_t);
+	rwp = kmem_zalloc(size, KM_SLEEP);
+	rwp->rwp_size = size;
+	rwp->rwp_cpu = (rwlock_percpu_cpu_t *)P2ROUNDUP((uintptr_t)(rwp + 1),
+	    sizeof (rwlock_percpu_cpu_t));
+	mutex_init(&rwp->rwp_lock, NULL, MUTEX_DEFAULT, NULL);
+	cv_init(&rwp->rwp_cv, NULL, CV_DEFAULT, NULL);
+	cv_init(&rwp->rwp_drain_cv, NULL, CV_DEFAULT, NULL);
+
+	lp->rw_wwwh = (uintptr_t)rwp | RW_PERCPU_TAG;
+	ASSERT(RW_ISPERCPU(lp));
 }
 
 void
@@ -236,6 +538,21 @@ rw_destroy(krwlock_t *rwlp)
 {
 	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
 
+	if (RW_ISPERCPU(lp)) {
+		rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+		if (rwp->rwp_writer != 0 || rw_percpu_readers(rwp) != 0) {
+			rw_panic("rw_destroy: lock still active", lp);
+			return;
+		}
+		mutex_destroy(&rwp->rwp_lock);
+		cv_destroy(&rwp->rwp_cv);
+		cv_destroy(&rwp->rwp_drain_cv);
+		kmem_free(rwp, rwp->rwp_size);
+		lp->rw_wwwh = RW_DOUBLE_LOCK;
+		return;
+	}
+
 	if (lp->rw_wwwh != 0) {
 		if ((lp->rw_wwwh & RW_DOUBLE_LOCK) == RW_DOUBLE_LOCK)
 			rw_panic("rw_destroy: lock already destroyed", lp);
@@ -282,6 +599,11 @@ rw_enter_sleep(rwlock_impl_t *lp, krw_t rw)
 	uint_t  backoff = 0;
 	int loop_count = 0;
 
+	if (RW_ISPERCPU(lp)) {
+		rw_percpu_enter(lp, rw);
+		return;
+	}
+
 	if (rw == RW_READER) {
 		lock_value = RW_READ_LOCK;
 		lock_busy = RW_WRITE_CLAIMED;
@@ -417,6 +739,11 @@ rw_exit_wakeup(rwlock_impl_t *lp)
 	uint_t  backoff = 0;
 	int loop_count = 0;
 
+	if (RW_ISPERCPU(lp)) {
+		rw_percpu_exit(lp);
+		return;
+	}
+
 	membar_exit();
 
 	old = lp->rw_wwwh;
@@ -536,6 +863,9 @@ rw_tryenter(krwlock_t *rwlp, krw_t rw)
 	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
 	uintptr_t old;
 
+	if (RW_ISPERCPU(lp))
+		return (rw_percpu_tryenter(lp, rw));
+
 	if (rw != RW_WRITER) {
 		uint_t backoff = 0;
 		int loop_count = 0;
@@ -573,6 +903,11 @@ rw_downgrade(krwlock_t *rwlp)
 {
 	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
 
+	if (RW_ISPERCPU(lp)) {
+		rw_percpu_downgrade(lp);
+		return;
+	}
+
 	THREAD_KPRI_REQUEST();
 	membar_exit();
 
@@ -603,6 +938,9 @@ rw_tryupgrade(krwlock_t *rwlp)
 	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
 	uintptr_t old, new;
 
+	if (RW_ISPERCPU(lp))
+		return (rw_percpu_tryupgrade(lp));
+
 	ASSERT(rw_locked(lp, RW_READER));
 
 	do {
@@ -621,20 +959,37 @@ rw_tryupgrade(krwlock_t *rwlp)
 int
 rw_read_held(krwlock_t *rwlp)
 {
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
 	uintptr_t tmp;
 
+	if (RW_ISPERCPU(lp)) {
+		rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+		return (rwp->rwp_owner == NULL && rw_percpu_readers(rwp) != 0);
+	}
 	return (_RW_READ_HELD(rwlp, tmp));
 }
 
 int
 rw_write_held(krwlock_t *rwlp)
 {
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
+
+	if (RW_ISPERCPU(lp))
+		return (RW_PERCPU_STATE(lp)->rwp_owner == curthread);
 	return (_RW_WRITE_HELD(rwlp));
 }
 
 int
 rw_lock_held(krwlock_t *rwlp)
 {
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
+
+	if (RW_ISPERCPU(lp)) {
+		rwlock_percpu_t *rwp = RW_PERCPU_STATE(lp);
+
+		return (rwp->rwp_owner != NULL || rw_percpu_readers(rwp) != 0);
+	}
 	return (_RW_LOCK_HELD(rwlp));
 }
 
@@ -646,6 +1001,11 @@ rw_read_locked(krwlock_t *rwlp)
 {
 	uintptr_t old = ((rwlock_impl_t *)rwlp)->rw_wwwh;
 
+	if (RW_ISPERCPU((rwlock_impl_t *)rwlp)) {
+		ASSERT(rw_lock_held(rwlp));
+		return (rw_read_held(rwlp));
+	}
+
 	ASSERT(old & RW_LOCKED);
 	return ((old & RW_LOCKED) && !(old & RW_WRITE_LOCKED));
 }
@@ -656,13 +1016,20 @@ rw_read_locked(krwlock_t *rwlp)
 int
 rw_iswriter(krwlock_t *rwlp)
 {
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
+
+	if (RW_ISPERCPU(lp))
+		return (RW_PERCPU_STATE(lp)->rwp_writer != 0);
 	return (_RW_ISWRITER(rwlp));
 }
 
 kthread_t *
 rw_owner(krwlock_t *rwlp)
 {
-	uintptr_t old = ((rwlock_impl_t *)rwlp)->rw_wwwh;
+	rwlock_impl_t *lp = (rwlock_impl_t *)rwlp;
+	uintptr_t old = lp->rw_wwwh;
 
+	if (RW_ISPERCPU(lp))
+		return (RW_PERCPU_STATE(lp)->rwp_owner);
 	return ((old & RW_WRITE_LOCKED) ? (kthread_t *)(old & RW_OWNER) : NULL);
 }
@@ -283,8 +283,10 @@ int	shutdown(int, int, int);
 ssize_t	recv(int, void *, size_t, int);
 ssize_t	recvfrom(int, void *, size_t, int, struct sockaddr *, socklen_t *);
 ssize_t	recvmsg(int, struct msghdr *, int);
+int	recvmmsg(int, struct mmsghdr *, uint_t, int, struct timespec *);
 ssize_t	send(int, void *, size_t, int);
 ssize_t	sendmsg(int, struct msghdr *, int);
+int	sendmmsg(int, struct mmsghdr *, uint_t, int);
 ssize_t	sendto(int, void *, size_t, int, struct sockaddr *, socklen_t);
 int	getpeername(int, struct sockaddr *, socklen_t *, int);
 int	getsockname(int, struct sockaddr *, socklen_t *, int);
@@ -539,11 +541,11 @@ struct sysent sysent[NSYSCALL] =
 	/* 140 */ SYSENT_LOADABLE(),		/* sharefs */
 	/* 141 */ SYSENT_CI("seteuid",		seteuid,	1),
 	/* 142 */ SYSENT_2CI("forksys",		forksys,	2),
-	/* 143 */ SYSENT_LOADABLE(),			/* (was fork1) */
+	/* 143 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 144 */ SYSENT_CI("sigtimedwait",	sigtimedwait,	3),
 	/* 145 */ SYSENT_CI("lwp_info",		lwp_info,	1),
 	/* 146 */ SYSENT_CI("yield",		yield,		0),
-	/* 147 */ SYSENT_LOADABLE(),		    /* (was lwp_sema_wait) */
+	/* 147 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
 	/* 148 */ SYSENT_CI("lwp_sema_post",	lwp_sema_post,	1),
 	/* 149 */ SYSENT_CI("lwp_sema_trywait",	lwp_sema_trywait, 1),
 	/* 150 */ SYSENT_CI("lwp_detach",	lwp_detach,	1),
@@ -849,11 +851,11 @@ struct sysent sysent32[NSYSCALL] =
 	/* 140 */ SYSENT_LOADABLE32(),		/* sharefs */
 	/* 141 */ SYSENT_CI("seteuid",		seteuid,	1),
 	/* 142 */ SYSENT_2CI("forksys",		forksys,	2),
-	/* 143 */ SYSENT_LOADABLE32(),			/* (was fork1) */
+	/* 143 */ SYSENT_CI("sendmmsg",		sendmmsg,	4),
 	/* 144 */ SYSENT_CI("sigtimedwait",	sigtimedwait,	3),
 	/* 145 */ SYSENT_CI("lwp_info",		lwp_info,	1),
 	/* 146 */ SYSENT_CI("yield",		yield,		0),
-	/* 147 */ SYSENT_LOADABLE32(),		    /* (was lwp_sema_wait) */
+	/* 147 */ SYSENT_CI("recvmmsg",		recvmmsg,	5),
 	/* 148 */ SYSENT_CI("lwp_sema_post",	lwp_sema_post,	1),
 	/* 149 */ SYSENT_CI("lwp_sema_trywait",	lwp_sema_trywait, 1),
 	/* 150 */ SYSENT_CI("lwp_detach",	lwp_detach,	1),
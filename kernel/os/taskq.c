@@ -126,6 +126,16 @@
  *		supported for DYNAMIC task queues.  This flag is not compatible
  *		with TASKQ_THREADS_CPU_PCT.
  *
+ *	  TASKQ_PERCPU: Create a separate queue for each CPU, serviced by its
+ *		own set of 'nthreads' worker threads.  Tasks are queued on the
+ *		queue of the dispatching CPU, and idle workers steal tasks from
+ *		the queues of other CPUs in the same lgroup.  'minalloc' task
+ *		structures are cached, spread over the queues; 'maxalloc' is
+ *		ignored.  Task execution order is not predictable.
+ *
+ *		This flag is not compatible with TASKQ_DYNAMIC,
+ *		TASKQ_THREADS_CPU_PCT, TASKQ_CPR_SAFE or taskq_create_sysdc().
+ *
  *	The 'pri' field specifies the default priority for the threads that
  *	service all scheduled tasks.
  *
@@ -405,6 +415,35 @@
  *	 memory. One solution may be allocation of buckets when they are first
  *	 touched, but it is not clear how useful it is.
  *
+ * Per-CPU Task Queues Implementation ------------------------------------------
+ *
+ * A single tq_task list and tq_lock become the bottleneck when many CPUs
+ * dispatch into the same queue.  TASKQ_PERCPU task queues instead have an
+ * array of taskq_cpu_t queues, one per CPU present at boot, each with its own
+ * lock, task list, entry cache and worker threads:
+ *
+ *   tq_cpus[]
+ *   +---------+     +--------------+
+ *   | [0]     |---->| tqc_lock     |     taskq_percpu_dispatch()
+ *   +---------+     | tqc_task     |<--- (CPU->cpu_seqid % tq_ncpuqs)
+ *   | [1]     |--+  | tqc_freelist |
+ *   +---------+  |  | ...          |<--- taskq_percpu_thread() x nthreads
+ *   | ...     |  |  +--------------+
+ *                +->  ...
+ *
+ * taskq_percpu_dispatch() only ever takes the lock of the dispatching CPU's
+ * queue.  If that queue has no idle worker the dispatcher wakes an idle
+ * worker of a sibling queue in the same lgroup, which then steals the task.
+ * A worker first drains its own queue, then scans the sibling queues of its
+ * lgroup for pending tasks whose own workers are all busy
+ * (taskq_percpu_steal_ent()), and sleeps only when it finds none.  At most one
+ * queue lock is held at any time.
+ *
+ * The queue a task was dispatched to keeps track of it until completion
+ * (tqc_active), so taskq_wait() and taskq_empty() just check every queue.
+ * The time spent in the queue and whether the task was run locally or stolen
+ * are exported through the "taskq_p" kstat.
+ *
  * SUSPEND/RESUME implementation -----------------------------------------------
  *
  *	Before executing a task taskq_thread() (executing non-dynamic task
@@ -428,7 +467,7 @@
  *
  * LOCKS and LOCK Hierarchy ----------------------------------------------------
  *
- *   There are three locks used in task queues:
+ *   There are four locks used in task queues:
  *
  *   1) The taskq_t's tq_lock, protecting global task queue state.
  *
@@ -437,6 +476,9 @@
  *   3) The global taskq_cpupct_lock, which protects the list of
  *      TASKQ_THREADS_CPU_PCT taskqs.
  *
+ *   4) Each per-CPU queue of a TASKQ_PERCPU taskq has a lock protecting the
+ *      queue.  Queue locks are never held together with any other lock.
+ *
  *   If both (1) and (2) are needed, tq_lock should be taken *after* the bucket
  *   lock.
  *
@@ -481,6 +523,15 @@
  *				  for static task queues.
  *				  Default value: UINT_MAX (no induced failures)
  *
+ *	taskq_percpu_steal	- Allow idle TASKQ_PERCPU workers to steal tasks
+ *				  from sibling queues.
+ *				  Default value: 1
+ *
+ *	taskq_percpu_kick_depth	- Maximum # of sibling queues searched for an
+ *				  idle worker when a TASKQ_PERCPU dispatch
+ *				  finds no idle local worker.
+ *				  Default value: 4
+ *
  * CONDITIONAL compilation -----------------------------------------------------
  *
  *    TASKQ_STATISTIC	- If set will enable bucket statistic (default).
@@ -501,6 +552,7 @@
 #include <sys/sysmacros.h>
 #include <sys/cpuvar.h>
 #include <sys/cpupart.h>
+#include <sys/lgrp.h>
 #include <sys/sdt.h>
 #include <sys/sysdc.h>
 #include <sys/note.h>
@@ -559,6 +611,16 @@ int taskq_maxbuckets = TASKQ_MAXBUCKETS;
 #define	TASKQ_SEARCH_DEPTH 4
 int taskq_search_depth = TASKQ_SEARCH_DEPTH;
 
+/*
+ * Idle TASKQ_PERCPU workers steal tasks from the other queues in their lgroup
+ * unless taskq_percpu_steal is cleared.  A dispatch which finds no idle worker
+ * on the local queue searches up to taskq_percpu_kick_depth sibling queues for
+ * an idle worker to wake up.
+ */
+int taskq_percpu_steal = 1;
+#define	TASKQ_PERCPU_KICK_DEPTH 4
+int taskq_percpu_kick_depth = TASKQ_PERCPU_KICK_DEPTH;
+
 /*
  * Hashing function: mix various bits of x. May be pretty much anything.
  */
@@ -588,6 +650,11 @@ static void taskq_ent_free(taskq_t *, taskq_ent_t *);
 static int taskq_ent_exists(taskq_t *, task_func_t, void *);
 static taskq_ent_t *taskq_bucket_dispatch(taskq_bucket_t *, task_func_t,
     void *);
+static taskq_ent_t *taskq_percpu_dispatch(taskq_t *, task_func_t, void *,
+    uint_t, taskq_ent_t *);
+static void taskq_percpu_thread(void *);
+static void taskq_percpu_create(taskq_t *, int, int);
+static void taskq_percpu_destroy(taskq_t *);
 
 /*
  * Task queues kstats.
@@ -656,10 +723,42 @@ struct taskq_d_kstat {
 	{ "nfree",		KSTAT_DATA_UINT64 },
 };
 
+struct taskq_p_kstat {
+	kstat_named_t	tqp_pid;
+	kstat_named_t	tqp_tasks;
+	kstat_named_t	tqp_executed;
+	kstat_named_t	tqp_totaltime;
+	kstat_named_t	tqp_nactive;
+	kstat_named_t	tqp_pri;
+	kstat_named_t	tqp_nthreads;
+	kstat_named_t	tqp_nqueues;
+	kstat_named_t	tqp_nomem;
+	kstat_named_t	tqp_local;
+	kstat_named_t	tqp_steals;
+	kstat_named_t	tqp_queuetime;
+	kstat_named_t	tqp_maxqueuetime;
+} taskq_p_kstat = {
+	{ "pid",		KSTAT_DATA_UINT64 },
+	{ "tasks",		KSTAT_DATA_UINT64 },
+	{ "executed",		KSTAT_DATA_UINT64 },
+	{ "totaltime",		KSTAT_DATA_UINT64 },
+	{ "nactive",		KSTAT_DATA_UINT64 },
+	{ "priority",		KSTAT_DATA_UINT64 },
+	{ "threads",		KSTAT_DATA_UINT64 },
+	{ "queues",		KSTAT_DATA_UINT64 },
+	{ "nomem",		KSTAT_DATA_UINT64 },
+	{ "local",		KSTAT_DATA_UINT64 },
+	{ "steals",		KSTAT_DATA_UINT64 },
+	{ "queuetime",		KSTAT_DATA_UINT64 },
+	{ "maxqueuetime",	KSTAT_DATA_UINT64 },
+};
+
 static kmutex_t taskq_kstat_lock;
 static kmutex_t taskq_d_kstat_lock;
+static kmutex_t taskq_p_kstat_lock;
 static int taskq_kstat_update(kstat_t *, int);
 static int taskq_d_kstat_update(kstat_t *, int);
+static int taskq_p_kstat_update(kstat_t *, int);
 
 /*
  * List of all TASKQ_THREADS_CPU_PCT taskqs.
@@ -803,6 +902,7 @@ taskq_destructor(void *buf, void *cdrarg)
 
 	ASSERT(tq->tq_nthreads == 0);
 	ASSERT(tq->tq_buckets == NULL);
+	ASSERT(tq->tq_cpus == NULL);
 	ASSERT(tq->tq_tcreates == 0);
 	ASSERT(tq->tq_tdeaths == 0);
 
@@ -1152,6 +1252,12 @@ taskq_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags)
 	ASSERT(tq != NULL);
 	ASSERT(func != NULL);
 
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		ASSERT(!(flags & TQ_NOQUEUE));
+		return ((taskqid_t)taskq_percpu_dispatch(tq, func, arg, flags,
+		    NULL));
+	}
+
 	if (!(tq->tq_flags & TASKQ_DYNAMIC)) {
 		/*
 		 * TQ_NOQUEUE flag can't be used with non-dynamic task queues.
@@ -1311,6 +1417,12 @@ taskq_dispatch_ent(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
 	 * to ensure that we don't free it later.
 	 */
 	tqe->tqent_un.tqent_flags |= TQENT_FLAG_PREALLOC;
+
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		(void) taskq_percpu_dispatch(tq, func, arg, flags, tqe);
+		return;
+	}
+
 	/*
 	 * Enqueue the task to the underlying queue.
 	 */
@@ -1337,6 +1449,18 @@ taskq_empty(taskq_t *tq)
 	rv = (tq->tq_task.tqent_next == &tq->tq_task) && (tq->tq_active == 0);
 	mutex_exit(&tq->tq_lock);
 
+	if (rv && (tq->tq_flags & TASKQ_PERCPU)) {
+		taskq_cpu_t *tqc;
+		uint_t qid;
+
+		for (qid = 0; rv && qid < tq->tq_ncpuqs; qid++) {
+			tqc = tq->tq_cpus[qid];
+			mutex_enter(&tqc->tqc_lock);
+			rv = (tqc->tqc_active == 0);
+			mutex_exit(&tqc->tqc_lock);
+		}
+	}
+
 	return (rv);
 }
 
@@ -1364,6 +1488,19 @@ taskq_wait(taskq_t *tq)
 			mutex_exit(&b->tqbucket_lock);
 		}
 	}
+
+	if (tq->tq_flags & TASKQ_PERCPU) {
+		taskq_cpu_t *tqc;
+		uint_t qid;
+
+		for (qid = 0; qid < tq->tq_ncpuqs; qid++) {
+			tqc = tq->tq_cpus[qid];
+			mutex_enter(&tqc->tqc_lock);
+			while (tqc->tqc_active > 0)
+				cv_wait(&tqc->tqc_wait_cv, &tqc->tqc_lock);
+			mutex_exit(&tqc->tqc_lock);
+		}
+	}
 }
 
 /*
@@ -1819,6 +1956,393 @@ taskq_d_thread(taskq_ent_t *tqe)
 	}
 }
 
+/*
+ * Per-CPU task queues.
+ */
+
+#define	TQCPU_LGRP_MATCH(a, b)						\
+	((a)->tqc_lgrpid == (b)->tqc_lgrpid ||				\
+	(a)->tqc_lgrpid == LGRP_NONE || (b)->tqc_lgrpid == LGRP_NONE)
+
+/*
+ * Unlink 'tqe' from the doubly-linked list it is on.
+ */
+#define	TQ_REMOVE(tqe) {						\
+	tqe->tqent_prev->tqent_next = tqe->tqent_next;			\
+	tqe->tqent_next->tqent_prev = tqe->tqent_prev;			\
+}
+
+/*
+ * Wake up an idle worker of a sibling of queue 'tqc' so that it steals the
+ * task just queued on 'tqc', whose own workers are all busy.
+ *
+ * Assumes: no queue locks are held.
+ */
+static void
+taskq_percpu_kick(taskq_t *tq, taskq_cpu_t *tqc)
+{
+	taskq_cpu_t *sib;
+	uint_t nq = tq->tq_ncpuqs;
+	uint_t i, depth;
+
+	if (!taskq_percpu_steal)
+		return;
+
+	depth = MIN(taskq_percpu_kick_depth, nq - 1);
+	for (i = 1; i < nq && depth > 0; i++) {
+		sib = tq->tq_cpus[(tqc->tqc_id + i) % nq];
+		if (!TQCPU_LGRP_MATCH(sib, tqc))
+			continue;
+		depth--;
+
+		/*
+		 * Do a quick check before grabbing the lock.
+		 */
+		if (sib->tqc_nidle == 0)
+			continue;
+
+		mutex_enter(&sib->tqc_lock);
+		if (sib->tqc_nidle != 0) {
+			cv_signal(&sib->tqc_dispatch_cv);
+			mutex_exit(&sib->tqc_lock);
+			return;
+		}
+		mutex_exit(&sib->tqc_lock);
+	}
+}
+
+/*
+ * Dispatch a task "func(arg)" to the queue of the current CPU, using the
+ * preallocated entry 'tqe' if it is not NULL.
+ *
+ * Returns: the entry used to schedule the task, NULL if dispatch failed.
+ */
+static taskq_ent_t *
+taskq_percpu_dispatch(taskq_t *tq, task_func_t func, void *arg, uint_t flags,
+    taskq_ent_t *tqe)
+{
+	int kmflags = (flags & TQ_NOSLEEP) ? KM_NOSLEEP : KM_SLEEP;
+	taskq_cpu_t *tqc;
+	boolean_t idle;
+
+	ASSERT(tq->tq_flags & TASKQ_PERCPU);
+
+	/*
+	 * We may migrate after looking at CPU, which only costs us locality.
+	 */
+	tqc = tq->tq_cpus[CPU->cpu_seqid % tq->tq_ncpuqs];
+
+	mutex_enter(&tqc->tqc_lock);
+	if (tqe == NULL) {
+		if ((tqe = tqc->tqc_freelist) != NULL) {
+			tqc->tqc_freelist = tqe->tqent_next;
+			tqc->tqc_nfree--;
+		} else {
+			if (flags & TQ_NOALLOC) {
+				tqc->tqc_nomem++;
+				mutex_exit(&tqc->tqc_lock);
+				return (NULL);
+			}
+			mutex_exit(&tqc->tqc_lock);
+			tqe = kmem_cache_alloc(taskq_ent_cache, kmflags);
+			mutex_enter(&tqc->tqc_lock);
+			if (tqe == NULL) {
+				tqc->tqc_nomem++;
+				mutex_exit(&tqc->tqc_lock);
+				return (NULL);
+			}
+		}
+		/* Make sure we start without any flags */
+		tqe->tqent_un.tqent_flags = 0;
+	}
+
+	if (flags & TQ_FRONT) {
+		TQ_PREPEND(tqc->tqc_task, tqe);
+	} else {
+		TQ_APPEND(tqc->tqc_task, tqe);
+	}
+	tqe->tqent_func = func;
+	tqe->tqent_arg = arg;
+	tqe->tqent_time = gethrtime();
+	tqc->tqc_tasks++;
+	tqc->tqc_active++;
+	DTRACE_PROBE2(taskq__enqueue, taskq_t *, tq, taskq_ent_t *, tqe);
+
+	if ((idle = (tqc->tqc_nidle != 0)))
+		cv_signal(&tqc->tqc_dispatch_cv);
+	mutex_exit(&tqc->tqc_lock);
+
+	if (!idle)
+		taskq_percpu_kick(tq, tqc);
+
+	return (tqe);
+}
+
+/*
+ * Take a pending task from a sibling of queue 'tqc' in the same lgroup whose
+ * own workers are all busy.  The queue the task was taken from is returned in
+ * 'srcp'.
+ *
+ * Assumes: no queue locks are held.
+ */
+static taskq_ent_t *
+taskq_percpu_steal_ent(taskq_cpu_t *tqc, taskq_cpu_t **srcp)
+{
+	taskq_t *tq = tqc->tqc_taskq;
+	taskq_cpu_t *victim;
+	taskq_ent_t *tqe;
+	uint_t nq = tq->tq_ncpuqs;
+	uint_t i;
+
+	if (!taskq_percpu_steal)
+		return (NULL);
+
+	for (i = 1; i < nq; i++) {
+		victim = tq->tq_cpus[(tqc->tqc_id + i) % nq];
+		if (!TQCPU_LGRP_MATCH(victim, tqc))
+			continue;
+
+		/*
+		 * Do a quick check before grabbing the lock: leave the task
+		 * alone if the queue is empty or one of its own workers is
+		 * about to pick it up.
+		 */
+		if (IS_EMPTY(victim->tqc_task) || victim->tqc_nidle != 0)
+			continue;
+
+		mutex_enter(&victim->tqc_lock);
+		if ((tqe = victim->tqc_task.tqent_next) != &victim->tqc_task) {
+			TQ_REMOVE(tqe);
+			mutex_exit(&victim->tqc_lock);
+			*srcp = victim;
+			return (tqe);
+		}
+		mutex_exit(&victim->tqc_lock);
+	}
+	return (NULL);
+}
+
+/*
+ * Worker thread for a per-CPU queue.
+ */
+static void
+taskq_percpu_thread(void *arg)
+{
+	taskq_cpu_t *tqc = arg;
+	taskq_t *tq = tqc->tqc_taskq;
+	taskq_cpu_t *src;
+	taskq_ent_t *tqe;
+	callb_cpr_t cprinfo;
+	hrtime_t start, end, qtime;
+	boolean_t freeit;
+
+	curthread->t_taskq = tq;	/* mark ourselves for taskq_member() */
+
+	CALLB_CPR_INIT(&cprinfo, &tqc->tqc_lock, callb_generic_cpr,
+	    tq->tq_name);
+
+	mutex_enter(&tqc->tqc_lock);
+	for (;;) {
+		if ((tqe = tqc->tqc_task.tqent_next) != &tqc->tqc_task) {
+			TQ_REMOVE(tqe);
+			mutex_exit(&tqc->tqc_lock);
+			src = tqc;
+		} else if (tqc->tqc_flags & TQCPU_CLOSE) {
+			break;
+		} else {
+			mutex_exit(&tqc->tqc_lock);
+			if ((tqe = taskq_percpu_steal_ent(tqc, &src)) == NULL) {
+				mutex_enter(&tqc->tqc_lock);
+				if (IS_EMPTY(tqc->tqc_task) &&
+				    !(tqc->tqc_flags & TQCPU_CLOSE)) {
+					tqc->tqc_nidle++;
+					(void) taskq_thread_wait(tq,
+					    &tqc->tqc_lock,
+					    &tqc->tqc_dispatch_cv, &cprinfo,
+					    -1);
+					tqc->tqc_nidle--;
+				}
+				continue;
+			}
+		}
+
+		/*
+		 * Once the function is called we can't touch a prealloc'd
+		 * tqent any longer, see taskq_thread().
+		 */
+		if (tqe->tqent_un.tqent_flags & TQENT_FLAG_PREALLOC) {
+			tqe->tqent_next = tqe->tqent_prev = NULL;
+			freeit = B_FALSE;
+		} else {
+			freeit = B_TRUE;
+		}
+
+		rw_enter(&tq->tq_threadlock, RW_READER);
+		start = gethrtime();
+		qtime = start - tqe->tqent_time;
+		DTRACE_PROBE2(taskq__exec__start, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		tqe->tqent_func(tqe->tqent_arg);
+		DTRACE_PROBE2(taskq__exec__end, taskq_t *, tq,
+		    taskq_ent_t *, tqe);
+		end = gethrtime();
+		rw_exit(&tq->tq_threadlock);
+
+		/*
+		 * Account for the task on the queue it was dispatched to, and
+		 * return the entry to that queue's cache.
+		 */
+		mutex_enter(&src->tqc_lock);
+		src->tqc_totaltime += end - start;
+		src->tqc_queuetime += qtime;
+		if (qtime > src->tqc_maxqueuetime)
+			src->tqc_maxqueuetime = qtime;
+		src->tqc_executed++;
+		if (src == tqc)
+			src->tqc_local++;
+		else
+			src->tqc_steals++;
+
+		if (freeit && src->tqc_nfree < src->tqc_maxfree) {
+			tqe->tqent_next = src->tqc_freelist;
+			src->tqc_freelist = tqe;
+			src->tqc_nfree++;
+			freeit = B_FALSE;
+		}
+
+		ASSERT(src->tqc_active > 0);
+		if (--src->tqc_active == 0)
+			cv_broadcast(&src->tqc_wait_cv);
+
+		if (src != tqc || freeit) {
+			mutex_exit(&src->tqc_lock);
+			if (freeit)
+				kmem_cache_free(taskq_ent_cache, tqe);
+			mutex_enter(&tqc->tqc_lock);
+		}
+	}
+
+	ASSERT(tqc->tqc_nthreads > 0);
+	tqc->tqc_nthreads--;
+	cv_broadcast(&tqc->tqc_wait_cv);
+
+	CALLB_CPR_EXIT(&cprinfo);		/* drops tqc->tqc_lock */
+	thread_exit();
+}
+
+/*
+ * Set up the per-CPU queues of a TASKQ_PERCPU task queue and start
+ * 'nthreads' workers on each of them.
+ */
+static void
+taskq_percpu_create(taskq_t *tq, int nthreads, int minalloc)
+{
+	uint_t nq = MAX(boot_ncpus, 1);
+	taskq_cpu_t *tqc;
+	taskq_ent_t *tqe;
+	cpu_t *cp;
+	uint_t qid;
+	int i;
+
+	ASSERT(tq->tq_flags & TASKQ_PERCPU);
+	ASSERT3S(nthreads, >=, 1);
+
+	tq->tq_ncpuqs = nq;
+	tq->tq_cpus = kmem_zalloc(sizeof (taskq_cpu_t *) * nq, KM_SLEEP);
+
+	for (qid = 0; qid < nq; qid++) {
+		tqc = kmem_zalloc(sizeof (taskq_cpu_t), KM_SLEEP);
+		mutex_init(&tqc->tqc_lock, NULL, MUTEX_DEFAULT, NULL);
+		cv_init(&tqc->tqc_dispatch_cv, NULL, CV_DEFAULT, NULL);
+		cv_init(&tqc->tqc_wait_cv, NULL, CV_DEFAULT, NULL);
+		tqc->tqc_taskq = tq;
+		tqc->tqc_id = qid;
+		tqc->tqc_task.tqent_next = tqc->tqc_task.tqent_prev =
+		    &tqc->tqc_task;
+		tqc->tqc_maxfree = MAX(howmany(minalloc, nq), 1);
+
+		/*
+		 * CPUs which are not yet configured may end up in any lgroup.
+		 */
+		if ((cp = cpu_seq[qid]) != NULL && cp->cpu_lpl != NULL)
+			tqc->tqc_lgrpid = cp->cpu_lpl->lpl_lgrpid;
+		else
+			tqc->tqc_lgrpid = LGRP_NONE;
+
+		if (tq->tq_flags & TASKQ_PREPOPULATE) {
+			for (i = 0; i < tqc->tqc_maxfree; i++) {
+				tqe = kmem_cache_alloc(taskq_ent_cache,
+				    KM_SLEEP);
+				tqe->tqent_next = tqc->tqc_freelist;
+				tqc->tqc_freelist = tqe;
+				tqc->tqc_nfree++;
+			}
+		}
+		tq->tq_cpus[qid] = tqc;
+	}
+
+	for (qid = 0; qid < nq; qid++) {
+		tqc = tq->tq_cpus[qid];
+		for (i = 0; i < nthreads; i++) {
+			mutex_enter(&tqc->tqc_lock);
+			tqc->tqc_nthreads++;
+			mutex_exit(&tqc->tqc_lock);
+			(void) thread_create(NULL, 0, taskq_percpu_thread, tqc,
+			    0, tq->tq_proc, TS_RUN, tq->tq_pri);
+		}
+	}
+}
+
+/*
+ * Stop the workers of all per-CPU queues and free the queues.
+ *
+ * Assumes: all queues are empty.
+ */
+static void
+taskq_percpu_destroy(taskq_t *tq)
+{
+	taskq_cpu_t *tqc;
+	taskq_ent_t *tqe;
+	uint_t qid;
+
+	/*
+	 * Workers may still look at other queues while stealing, so all of
+	 * them must be gone before any queue is freed.
+	 */
+	for (qid = 0; qid < tq->tq_ncpuqs; qid++) {
+		tqc = tq->tq_cpus[qid];
+		mutex_enter(&tqc->tqc_lock);
+		ASSERT(IS_EMPTY(tqc->tqc_task) && tqc->tqc_active == 0);
+		tqc->tqc_flags |= TQCPU_CLOSE;
+		cv_broadcast(&tqc->tqc_dispatch_cv);
+		mutex_exit(&tqc->tqc_lock);
+	}
+
+	for (qid = 0; qid < tq->tq_ncpuqs; qid++) {
+		tqc = tq->tq_cpus[qid];
+		mutex_enter(&tqc->tqc_lock);
+		while (tqc->tqc_nthreads != 0)
+			cv_wait(&tqc->tqc_wait_cv, &tqc->tqc_lock);
+		mutex_exit(&tqc->tqc_lock);
+	}
+
+	for (qid = 0; qid < tq->tq_ncpuqs; qid++) {
+		tqc = tq->tq_cpus[qid];
+		while ((tqe = tqc->tqc_freelist) != NULL) {
+			tqc->tqc_freelist = tqe->tqent_next;
+			kmem_cache_free(taskq_ent_cache, tqe);
+		}
+		mutex_destroy(&tqc->tqc_lock);
+		cv_destroy(&tqc->tqc_dispatch_cv);
+		cv_destroy(&tqc->tqc_wait_cv);
+		kmem_free(tqc, sizeof (taskq_cpu_t));
+	}
+
+	kmem_free(tq->tq_cpus, sizeof (taskq_cpu_t *) * tq->tq_ncpuqs);
+	tq->tq_cpus = NULL;
+	tq->tq_ncpuqs = 0;
+}
+
 
 /*
  * Taskq creation. May sleep for memory.
@@ -1890,6 +2414,7 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	uint_t ncpus = ((boot_max_ncpus == -1) ? max_ncpus : boot_max_ncpus);
 	uint_t bsize;	/* # of buckets - always power of 2 */
 	int max_nthreads;
+	int percpu_nthreads = 0;
 
 	/*
 	 * TASKQ_DYNAMIC, TASKQ_CPR_SAFE and TASKQ_THREADS_CPU_PCT are all
@@ -1902,6 +2427,10 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	/* Cannot have DYNAMIC with DUTY_CYCLE */
 	IMPLY((flags & TASKQ_DYNAMIC), !(flags & TASKQ_DUTY_CYCLE));
 
+	/* PERCPU manages its own threads, and does not mix with the above */
+	IMPLY((flags & TASKQ_PERCPU), !(flags & (TASKQ_DYNAMIC |
+	    TASKQ_CPR_SAFE | TASKQ_THREADS_CPU_PCT | TASKQ_DUTY_CYCLE)));
+
 	/* Cannot have DUTY_CYCLE with a p0 kernel process */
 	IMPLY((flags & TASKQ_DUTY_CYCLE), proc != &p0);
 
@@ -1941,6 +2470,14 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 		nthreads = 1;		/* corrected in taskq_thread_create() */
 		max_nthreads = TASKQ_THREADS_PCT(max_ncpus, pct);
 
+	} else if (flags & TASKQ_PERCPU) {
+		ASSERT3S(nthreads, >=, 1);
+		percpu_nthreads = nthreads;
+
+		/* All threads are attached to the per-CPU queues */
+		nthreads = 0;
+		max_nthreads = 1;
+
 	} else {
 		ASSERT3S(nthreads, >=, 1);
 		max_nthreads = nthreads;
@@ -1956,7 +2493,9 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	(void) strncpy(tq->tq_name, name, TASKQ_NAMELEN + 1);
 	strident_canon(tq->tq_name, TASKQ_NAMELEN + 1);
 
-	tq->tq_flags = flags | TASKQ_CHANGING;
+	tq->tq_flags = flags;
+	if (!(flags & TASKQ_PERCPU))
+		tq->tq_flags |= TASKQ_CHANGING;
 	tq->tq_active = 0;
 	tq->tq_instance = instance;
 	tq->tq_nthreads_target = nthreads;
@@ -1974,7 +2513,7 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 		    sizeof (kthread_t *) * max_nthreads, KM_SLEEP);
 
 	mutex_enter(&tq->tq_lock);
-	if (flags & TASKQ_PREPOPULATE) {
+	if ((flags & TASKQ_PREPOPULATE) && !(flags & TASKQ_PERCPU)) {
 		while (minalloc-- > 0)
 			taskq_ent_free(tq, taskq_ent_alloc(tq, TQ_SLEEP));
 	}
@@ -1987,13 +2526,18 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 	 */
 	zone_hold(tq->tq_proc->p_zone);
 
-	/*
-	 * Create the first thread, which will create any other threads
-	 * necessary.  taskq_thread_create will not return until we have
-	 * enough threads to be able to process requests.
-	 */
-	taskq_thread_create(tq);
-	mutex_exit(&tq->tq_lock);
+	if (flags & TASKQ_PERCPU) {
+		mutex_exit(&tq->tq_lock);
+		taskq_percpu_create(tq, percpu_nthreads, minalloc);
+	} else {
+		/*
+		 * Create the first thread, which will create any other threads
+		 * necessary.  taskq_thread_create will not return until we
+		 * have enough threads to be able to process requests.
+		 */
+		taskq_thread_create(tq);
+		mutex_exit(&tq->tq_lock);
+	}
 
 	if (flags & TASKQ_DYNAMIC) {
 		taskq_bucket_t *bucket = kmem_zalloc(sizeof (taskq_bucket_t) *
@@ -2040,6 +2584,17 @@ taskq_create_common(const char *name, int instance, int nthreads, pri_t pri,
 			tq->tq_kstat->ks_private = tq;
 			kstat_install(tq->tq_kstat);
 		}
+	} else if (flags & TASKQ_PERCPU) {
+		if ((tq->tq_kstat = kstat_create("unix", instance,
+		    tq->tq_name, "taskq_p", KSTAT_TYPE_NAMED,
+		    sizeof (taskq_p_kstat) / sizeof (kstat_named_t),
+		    KSTAT_FLAG_VIRTUAL)) != NULL) {
+			tq->tq_kstat->ks_lock = &taskq_p_kstat_lock;
+			tq->tq_kstat->ks_data = &taskq_p_kstat;
+			tq->tq_kstat->ks_update = taskq_p_kstat_update;
+			tq->tq_kstat->ks_private = tq;
+			kstat_install(tq->tq_kstat);
+		}
 	} else {
 		if ((tq->tq_kstat = kstat_create("unix", instance, tq->tq_name,
 		    "taskq", KSTAT_TYPE_NAMED,
@@ -2123,6 +2678,11 @@ taskq_destroy(taskq_t *tq)
 
 	mutex_exit(&tq->tq_lock);
 
+	if (tq->tq_cpus != NULL) {
+		ASSERT(tq->tq_flags & TASKQ_PERCPU);
+		taskq_percpu_destroy(tq);
+	}
+
 	/*
 	 * Mark each bucket as closing and wakeup all sleeping threads.
 	 */
@@ -2334,3 +2894,49 @@ taskq_d_kstat_update(kstat_t *ksp, int rw)
 	}
 	return (0);
 }
+
+static int
+taskq_p_kstat_update(kstat_t *ksp, int rw)
+{
+	struct taskq_p_kstat *tqsp = &taskq_p_kstat;
+	taskq_t *tq = ksp->ks_private;
+	taskq_cpu_t *tqc;
+	uint64_t nthreads = 0, nactive = 0;
+	uint_t qid;
+
+	if (rw == KSTAT_WRITE)
+		return (EACCES);
+
+	ASSERT(tq->tq_flags & TASKQ_PERCPU);
+
+	tqsp->tqp_pid.value.ui64 = tq->tq_proc->p_pid;
+	tqsp->tqp_pri.value.ui64 = tq->tq_pri;
+	tqsp->tqp_nqueues.value.ui64 = tq->tq_ncpuqs;
+
+	tqsp->tqp_tasks.value.ui64 = 0;
+	tqsp->tqp_executed.value.ui64 = 0;
+	tqsp->tqp_totaltime.value.ui64 = 0;
+	tqsp->tqp_nomem.value.ui64 = 0;
+	tqsp->tqp_local.value.ui64 = 0;
+	tqsp->tqp_steals.value.ui64 = 0;
+	tqsp->tqp_queuetime.value.ui64 = 0;
+	tqsp->tqp_maxqueuetime.value.ui64 = 0;
+
+	for (qid = 0; qid < tq->tq_ncpuqs; qid++) {
+		tqc = tq->tq_cpus[qid];
+		tqsp->tqp_tasks.value.ui64 += tqc->tqc_tasks;
+		tqsp->tqp_executed.value.ui64 += tqc->tqc_executed;
+		tqsp->tqp_totaltime.value.ui64 += tqc->tqc_totaltime;
+		tqsp->tqp_nomem.value.ui64 += tqc->tqc_nomem;
+		tqsp->tqp_local.value.ui64 += tqc->tqc_local;
+		tqsp->tqp_steals.value.ui64 += tqc->tqc_steals;
+		tqsp->tqp_queuetime.value.ui64 += tqc->tqc_queuetime;
+		tqsp->tqp_maxqueuetime.value.ui64 = MAX(
+		    tqsp->tqp_maxqueuetime.value.ui64, tqc->tqc_maxqueuetime);
+		nthreads += tqc->tqc_nthreads;
+		nactive += tqc->tqc_active;
+	}
+	tqsp->tqp_nthreads.value.ui64 = nthreads;
+	tqsp->tqp_nactive.value.ui64 = nactive;
+	return (0);
+}
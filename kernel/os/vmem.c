@@ -133,6 +133,15 @@
  * which provides low-latency per-cpu caching.  The qcache_max argument to
  * vmem_create() specifies the largest allocation size to cache.
  *
+ * Arenas that have no quantum caches get a lighter form of per-cpu caching
+ * once vmem_update() sees that they are busy: a small magazine per CPU of
+ * freed single-quantum segments, which vmem_alloc() hands out again without
+ * taking the arena lock.  Segments in a magazine are still allocated as far
+ * as the arena is concerned; the magazines are emptied back into the arena
+ * when an allocation would otherwise fail, on every kmem_reap(), and when
+ * the arena is destroyed.  Identifier arenas are never cached this way,
+ * since their consumers expect freed identifiers to be handed out in order.
+ *
  * 1.9 Relationship to Kernel Memory Allocator
  * -------------------------------------------
  * Every kmem cache has a vmem arena as its slab supplier.  The kernel memory
@@ -190,7 +199,9 @@
  * 2.4 Vmem Locking
  * ----------------
  * For simplicity, all arena state is protected by a per-arena lock.
- * For very hot arenas, use quantum caching for scalability.
+ * For very hot arenas, use quantum caching for scalability.  Each per-cpu
+ * magazine has its own lock, which is never held across a call into the
+ * arena.
  *
  * 2.5 Vmem Population
  * -------------------
@@ -214,6 +225,7 @@
 
 #include <sys/vmem_impl.h>
 #include <sys/kmem.h>
+#include <sys/cpuvar.h>
 #include <sys/kstat.h>
 #include <sys/param.h>
 #include <sys/systm.h>
@@ -332,6 +344,16 @@ static long vmem_update_interval = 15;	/* vmem_update() every 15 seconds */
 uint32_t vmem_mtbf;		/* mean time between failures [default: off] */
 size_t vmem_seg_size = sizeof (vmem_seg_t);
 
+/*
+ * Arenas without quantum caches get per-cpu magazines once they have done
+ * vmem_pcpu_hot allocations between two runs of vmem_update().
+ */
+int vmem_pcpu_enable = 1;
+uint64_t vmem_pcpu_hot = 1000;
+
+#define	VMEM_PCPU_NOFLAGS	\
+	(VM_NEXTFIT | VM_BESTFIT | VM_FIRSTFIT | VM_ENDALLOC)
+
 static vmem_kstat_t vmem_kstat_template = {
 	{ "mem_inuse",		KSTAT_DATA_UINT64 },
 	{ "mem_import",		KSTAT_DATA_UINT64 },
@@ -931,6 +953,97 @@ vmem_canalloc(vmem_t *vmp, size_t size)
 	return (flist);
 }
 
+/*
+ * Per-cpu magazines.  A magazine holds up to VMEM_PCPU_ROUNDS segments of
+ * exactly one quantum that have been freed to the arena but not given back
+ * to it yet, and is protected by its own lock so that the fast paths below
+ * never touch vm_lock.  vm_pcpu is set once, by vmem_pcpu_create(), and
+ * stays until the arena is destroyed.
+ */
+static void *
+vmem_pcpu_alloc(vmem_t *vmp)
+{
+	vmem_pcpu_t *vp = &vmp->vm_pcpu[CPU->cpu_seqid];
+	void *vaddr = NULL;
+
+	mutex_enter(&vp->vp_lock);
+	if (vp->vp_rounds > 0)
+		vaddr = vp->vp_round[--vp->vp_rounds];
+	mutex_exit(&vp->vp_lock);
+	return (vaddr);
+}
+
+static boolean_t
+vmem_pcpu_free(vmem_t *vmp, void *vaddr)
+{
+	vmem_pcpu_t *vp = &vmp->vm_pcpu[CPU->cpu_seqid];
+	boolean_t stashed = B_FALSE;
+
+	mutex_enter(&vp->vp_lock);
+	if (vp->vp_rounds < VMEM_PCPU_ROUNDS) {
+		vp->vp_round[vp->vp_rounds++] = vaddr;
+		stashed = B_TRUE;
+	}
+	mutex_exit(&vp->vp_lock);
+	return (stashed);
+}
+
+/*
+ * Give the contents of every magazine of vmp back to the arena.
+ */
+static void
+vmem_pcpu_purge(vmem_t *vmp)
+{
+	void *round[VMEM_PCPU_ROUNDS];
+	vmem_pcpu_t *vp;
+	int i, n;
+
+	ASSERT(MUTEX_NOT_HELD(&vmp->vm_lock));
+
+	for (i = 0; i < max_ncpus; i++) {
+		vp = &vmp->vm_pcpu[i];
+		mutex_enter(&vp->vp_lock);
+		n = vp->vp_rounds;
+		bcopy(vp->vp_round, round, n * sizeof (void *));
+		vp->vp_rounds = 0;
+		mutex_exit(&vp->vp_lock);
+
+		while (n > 0)
+			vmem_xfree(vmp, round[--n], vmp->vm_quantum);
+	}
+}
+
+/*
+ * Called from vmem_update(): give vmp per-cpu magazines if it can use them
+ * and has been busy since the last update.
+ */
+static void
+vmem_pcpu_create(vmem_t *vmp)
+{
+	vmem_pcpu_t *pcpu;
+	uint64_t nalloc = vmp->vm_kstat.vk_alloc.value.ui64;
+	uint64_t last = vmp->vm_pcpu_alloc;
+	int i;
+
+	ASSERT(MUTEX_HELD(&vmem_list_lock));
+
+	vmp->vm_pcpu_alloc = nalloc;
+	if (vmp->vm_pcpu != NULL || !vmem_pcpu_enable ||
+	    nalloc - last < vmem_pcpu_hot || vmp->vm_qcache_max != 0 ||
+	    (vmp->vm_cflags & (VMC_IDENTIFIER | VMC_POPULATOR |
+	    VMC_NO_QCACHE)) || vmem_seg_size != sizeof (vmem_seg_t))
+		return;
+
+	pcpu = kmem_zalloc(max_ncpus * sizeof (vmem_pcpu_t), KM_NOSLEEP);
+	if (pcpu == NULL)
+		return;
+	for (i = 0; i < max_ncpus; i++)
+		mutex_init(&pcpu[i].vp_lock, NULL, MUTEX_DEFAULT, NULL);
+
+	membar_producer();
+	vmp->vm_pcpu = pcpu;
+}
+
 /*
  * Allocate size bytes at offset phase from an align boundary such that the
  * resulting segment [addr, addr + size) is a subset of [minaddr, maxaddr)
@@ -948,6 +1061,7 @@ vmem_xalloc(vmem_t *vmp, size_t size, size_t align_arg, size_t phase,
 	size_t xsize;
 	int hb, flist, resv;
 	uint32_t mtbf;
+	boolean_t purged = B_FALSE;
 
 	if ((align | phase | nocross) & (vmp->vm_quantum - 1))
 		panic("vmem_xalloc(%p, %lu, %lu, %lu, %lu, %p, %p, %x): "
@@ -1153,6 +1267,18 @@ do_alloc:
 			}
 		}
 
+		/*
+		 * Segments sitting in the per-cpu magazines may be all that
+		 * stands between us and success; empty them and try again.
+		 */
+		if (vmp->vm_pcpu != NULL && !purged) {
+			mutex_exit(&vmp->vm_lock);
+			vmem_pcpu_purge(vmp);
+			mutex_enter(&vmp->vm_lock);
+			purged = B_TRUE;
+			continue;
+		}
+
 		/*
 		 * If the requestor chooses to fail the allocation attempt
 		 * rather than reap wait and retry - get out of the loop.
@@ -1270,6 +1396,7 @@ vmem_alloc(vmem_t *vmp, size_t size, int vmflag)
 	int hb;
 	int flist = 0;
 	uint32_t mtbf;
+	void *vaddr;
 
 	if (size - 1 < vmp->vm_qcache_max)
 		return (kmem_cache_alloc(vmp->vm_qcache[(size - 1) >>
@@ -1279,6 +1406,11 @@ vmem_alloc(vmem_t *vmp, size_t size, int vmflag)
 	    (vmflag & (VM_NOSLEEP | VM_PANIC)) == VM_NOSLEEP)
 		return (NULL);
 
+	if (size == vmp->vm_quantum && vmp->vm_pcpu != NULL &&
+	    !(vmflag & VMEM_PCPU_NOFLAGS) &&
+	    (vaddr = vmem_pcpu_alloc(vmp)) != NULL)
+		return (vaddr);
+
 	if (vmflag & VM_NEXTFIT)
 		return (vmem_nextfit_alloc(vmp, size, vmflag));
 
@@ -1324,7 +1456,8 @@ vmem_free(vmem_t *vmp, void *vaddr, size_t size)
 	if (size - 1 < vmp->vm_qcache_max)
 		kmem_cache_free(vmp->vm_qcache[(size - 1) >> vmp->vm_qshift],
 		    vaddr);
-	else
+	else if (size != vmp->vm_quantum || vmp->vm_pcpu == NULL ||
+	    !vmem_pcpu_free(vmp, vaddr))
 		vmem_xfree(vmp, vaddr, size);
 }
 
@@ -1619,6 +1752,13 @@ vmem_destroy(vmem_t *vmp)
 		if (vmp->vm_qcache[i])
 			kmem_cache_destroy(vmp->vm_qcache[i]);
 
+	if (vmp->vm_pcpu != NULL) {
+		vmem_pcpu_purge(vmp);
+		for (i = 0; i < max_ncpus; i++)
+			mutex_destroy(&vmp->vm_pcpu[i].vp_lock);
+		kmem_free(vmp->vm_pcpu, max_ncpus * sizeof (vmem_pcpu_t));
+	}
+
 	leaked = vmem_size(vmp, VMEM_ALLOC);
 	if (leaked != 0)
 		cmn_err(CE_WARN, "vmem_destroy('%s'): leaked %lu %s",
@@ -1729,12 +1869,32 @@ vmem_update(void *dummy)
 		 * Rescale the hash table to keep the hash chains short.
 		 */
 		vmem_hash_rescale(vmp);
+
+		/*
+		 * Give busy arenas per-cpu magazines.
+		 */
+		vmem_pcpu_create(vmp);
 	}
 	mutex_exit(&vmem_list_lock);
 
 	(void) timeout(vmem_update, dummy, vmem_update_interval * hz);
 }
 
+/*
+ * Empty the per-cpu magazines of every arena, on behalf of kmem_reap().
+ */
+void
+vmem_reap(void)
+{
+	vmem_t *vmp;
+
+	mutex_enter(&vmem_list_lock);
+	for (vmp = vmem_list; vmp != NULL; vmp = vmp->vm_next)
+		if (vmp->vm_pcpu != NULL)
+			vmem_pcpu_purge(vmp);
+	mutex_exit(&vmem_list_lock);
+}
+
 void
 vmem_qcache_reap(vmem_t *vmp)
 {
@@ -70,6 +70,9 @@ extern int sosendfile64(file_t *, file_t *, const struct ksendfilevec64 *,
 		ssize32_t *);
 extern int snf_segmap(file_t *, vnode_t *, uoff_t, uoff_t, ssize_t *,
 		boolean_t);
+extern int snf_loan(file_t *, file_t *, vnode_t *, uoff_t, uoff_t,
+		ssize_t *);
+extern boolean_t snf_loan_enable;
 extern sotpi_info_t *sotpi_sototpi(struct sonode *);
 
 #define	SEND_MAX_CHUNK	16
@@ -955,6 +958,55 @@ sendvec_chunk(file_t *fp, uoff_t *fileoff, struct sendfilevec *sfv,
 				}
 			}
 
+			/*
+			 * Send what the file system will loan us (ARC buffers
+			 * for ZFS) without copying, and the rest as below.
+			 */
+			if (vp->v_type == VSOCK && snf_loan_enable &&
+			    so->so_filter_active == 0) {
+				struct vattr va;
+
+				/*
+				 * The segmap path sends only up to the end of
+				 * the file and goes on to the next vector;
+				 * stop the loan there too.
+				 */
+				if (segmapit) {
+					va.va_mask = VATTR_SIZE;
+					error = fop_getattr(readvp, &va, 0,
+					    kcred, NULL);
+					if (error != 0 ||
+					    sfv_off >= va.va_size) {
+						fop_rwunlock(readvp,
+						    V_WRITELOCK_FALSE, NULL);
+						releasef(sfv->sfv_fd);
+						return (error);
+					}
+					if (sfv_off + sfv_len > va.va_size)
+						sfv_len = va.va_size - sfv_off;
+				}
+				error = snf_loan(fp, ffp, readvp, sfv_off,
+				    (uoff_t)sfv_len, (ssize_t *)&cnt);
+				if (error != ENOTSUP) {
+					ttolwp(curthread)->lwp_ru.ioch +=
+					    (ulong_t)cnt;
+					*count += cnt;
+					sfv_off += cnt;
+					sfv_len -= cnt;
+				}
+				if ((error != 0 && error != ENOTSUP) ||
+				    sfv_len == 0) {
+					fop_rwunlock(readvp, V_WRITELOCK_FALSE,
+					    NULL);
+					releasef(sfv->sfv_fd);
+					if (error != 0)
+						return (error);
+					sfv++;
+					continue;
+				}
+				error = 0;
+			}
+
 			if (segmapit) {
 				struct vattr va;
 				boolean_t nowait;
@@ -247,17 +247,26 @@ replace_with_spare(fmd_hdl_t *hdl, zpool_handle_t *zhp, nvlist_t *vdev)
 	 * replace it.
 	 */
 	for (s = 0; s < nspares; s++) {
-		char *spare_name;
+		char *spare_name, *type;
+		boolean_t rebuild;
 
 		if (nvlist_lookup_string(spares[s], ZPOOL_CONFIG_PATH,
 		    &spare_name) != 0)
 			continue;
 
+		/*
+		 * Distributed spares are rebuilt sequentially, and can only
+		 * replace devices of their own dRAID vdev; the attach fails
+		 * for any other.
+		 */
+		rebuild = (nvlist_lookup_string(spares[s], ZPOOL_CONFIG_TYPE,
+		    &type) == 0 && strcmp(type, VDEV_TYPE_DRAID_SPARE) == 0);
+
 		(void) nvlist_add_nvlist_array(replacement,
 		    ZPOOL_CONFIG_CHILDREN, &spares[s], 1);
 
 		if (zpool_vdev_attach(zhp, dev_name, spare_name,
-		    replacement, B_TRUE) == 0)
+		    replacement, B_TRUE, rebuild) == 0)
 			break;
 	}
 
@@ -145,7 +145,8 @@ static ls_event_info_t g_event_info[LS_MAX_EVENTS] = {
 	    "lockstat:::rw-block", "arg2 != 0 && arg3 == 1" },
 	{ 'C',	"Lock",	"R/W reader blocked by write wanted",	"nsec",
 	    "lockstat:::rw-block", "arg2 != 0 && arg3 == 0 && arg4" },
-	{ 'C',	"Lock",	"Unknown event (type 8)",		"units"	},
+	{ 'C',	"Lock",	"Adaptive mutex queued spin",		"nsec",
+	    "lockstat:::adaptive-qspin" },
 	{ 'C',	"Lock",	"Unknown event (type 9)",		"units"	},
 	{ 'C',	"Lock",	"Unknown event (type 10)",		"units"	},
 	{ 'C',	"Lock",	"Unknown event (type 11)",		"units"	},
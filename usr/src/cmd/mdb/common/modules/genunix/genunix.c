@@ -2115,7 +2115,8 @@ kmastat_cache(uintptr_t addr, const kmem_cache_t *cp, kmastat_args_t *kap)
 	kmastat_vmem_t **kvpp = kap->ka_kvpp;
 	kmastat_vmem_t *kv;
 	datafmt_t *dfp = kmemfmt;
-	int magsize;
+	int magsize, id;
+	kmem_maglist_t ml;
 
 	int avail, alloc, total;
 	size_t meminuse = (cp->cache_slab_create - cp->cache_slab_destroy) *
@@ -2127,8 +2128,12 @@ kmastat_cache(uintptr_t addr, const kmem_cache_t *cp, kmastat_args_t *kap)
 
 	magsize = kmem_get_magsize(cp);
 
-	alloc = cp->cache_slab_alloc + cp->cache_full.ml_alloc;
-	avail = cp->cache_full.ml_total * magsize;
+	alloc = cp->cache_slab_alloc;
+	avail = 0;
+	for (id = 0; kmem_read_depot_full(cp, id, &ml) == 0; id++) {
+		alloc += ml.ml_alloc;
+		avail += ml.ml_total * magsize;
+	}
 	total = cp->cache_buftotal;
 
 	(void) mdb_pwalk("kmem_cpu_cache", cpu_alloc, &alloc, addr);
@@ -936,6 +936,32 @@ kmem_estimate_slab(uintptr_t addr, const kmem_slab_t *sp, size_t *est)
 	return (WALK_NEXT);
 }
 
+/*
+ * Read cache cp's depot list of full magazines for lgroup 'id' into *mlp.
+ * The root lgroup's is cache_full, which is the only one on machines with
+ * a single lgroup.  Returns -1 when there are no more lists.
+ */
+int
+kmem_read_depot_full(const kmem_cache_t *cp, int id, kmem_maglist_t *mlp)
+{
+	int nlgrps;
+
+	if (id == 0) {
+		*mlp = cp->cache_full;
+		return (0);
+	}
+	if (cp->cache_lgrp_full == NULL ||
+	    mdb_readvar(&nlgrps, "nlgrpsmax") == -1 || id >= nlgrps)
+		return (-1);
+	if (mdb_vread(mlp, sizeof (kmem_maglist_t),
+	    (uintptr_t)&cp->cache_lgrp_full[id]) == -1) {
+		mdb_warn("couldn't read lgroup %d's full magazine list at %p",
+		    id, &cp->cache_lgrp_full[id]);
+		return (-1);
+	}
+	return (0);
+}
+
 /*
  * Returns an upper bound on the number of allocated buffers in a given
  * cache.
@@ -943,8 +969,9 @@ kmem_estimate_slab(uintptr_t addr, const kmem_slab_t *sp, size_t *est)
 size_t
 kmem_estimate_allocated(uintptr_t addr, const kmem_cache_t *cp)
 {
-	int magsize;
+	int magsize, id;
 	size_t cache_est;
+	kmem_maglist_t ml;
 
 	cache_est = cp->cache_buftotal;
 
@@ -952,7 +979,10 @@ kmem_estimate_allocated(uintptr_t addr, const kmem_cache_t *cp)
 	    (mdb_walk_cb_t)kmem_estimate_slab, &cache_est, addr);
 
 	if ((magsize = kmem_get_magsize(cp)) != 0) {
-		size_t mag_est = cp->cache_full.ml_total * magsize;
+		size_t mag_est = 0;
+
+		for (id = 0; kmem_read_depot_full(cp, id, &ml) == 0; id++)
+			mag_est += ml.ml_total * magsize;
 
 		if (cache_est >= mag_est) {
 			cache_est -= mag_est;
@@ -984,10 +1014,12 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
     void ***maglistp, size_t *magcntp, size_t *magmaxp, int alloc_flags)
 {
 	kmem_magazine_t *kmp, *mp;
+	kmem_maglist_t ml;
 	void **maglist = NULL;
-	int i, cpu;
+	int i, cpu, id;
 	size_t magsize, magmax, magbsize;
 	size_t magcnt = 0;
+	long full = 0;
 
 	/*
 	 * Read the magtype out of the cache, after verifying the pointer's
@@ -1007,13 +1039,15 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 	 * and the full magazine list in the depot.
 	 *
 	 * For an upper bound on the number of buffers in the magazine
-	 * layer, we have the number of magazines on the cache_full
-	 * list plus at most two magazines per CPU (the loaded and the
+	 * layer, we have the number of magazines on the full lists
+	 * plus at most two magazines per CPU (the loaded and the
 	 * spare).  Toss in 100 magazines as a fudge factor in case this
 	 * is live (the number "100" comes from the same fudge factor in
 	 * crash(8)).
 	 */
-	magmax = (cp->cache_full.ml_total + 2 * ncpus + 100) * magsize;
+	for (id = 0; kmem_read_depot_full(cp, id, &ml) == 0; id++)
+		full += ml.ml_total;
+	magmax = (full + 2 * ncpus + 100) * magsize;
 	magbsize = offsetof(kmem_magazine_t, mag_round[magsize]);
 
 	if (magbsize >= PAGESIZE / 2) {
@@ -1028,17 +1062,19 @@ kmem_read_magazines(kmem_cache_t *cp, uintptr_t addr, int ncpus,
 		goto fail;
 
 	/*
-	 * First up: the magazines in the depot (i.e. on the cache_full list).
+	 * First up: the magazines in the depot (i.e. on the full lists).
 	 */
-	for (kmp = cp->cache_full.ml_list; kmp != NULL; ) {
-		READMAG_ROUNDS(magsize);
-		kmp = mp->mag_next;
+	for (id = 0; kmem_read_depot_full(cp, id, &ml) == 0; id++) {
+		for (kmp = ml.ml_list; kmp != NULL; ) {
+			READMAG_ROUNDS(magsize);
+			kmp = mp->mag_next;
 
-		if (kmp == cp->cache_full.ml_list)
-			break; /* cache_full list loop detected */
+			if (kmp == ml.ml_list)
+				break; /* full list loop detected */
+		}
 	}
 
-	dprintf(("cache_full list done\n"));
+	dprintf(("full lists done\n"));
 
 	/*
 	 * Now whip through the CPUs, snagging the loaded magazines
@@ -112,6 +112,7 @@ extern int whatthread(uintptr_t, uint_t, int, const mdb_arg_t *);
 extern void kmem_init(void);
 extern void kmem_statechange(void);
 extern int kmem_get_magsize(const kmem_cache_t *);
+extern int kmem_read_depot_full(const kmem_cache_t *, int, kmem_maglist_t *);
 extern size_t kmem_estimate_allocated(uintptr_t, const kmem_cache_t *);
 
 #ifdef	__cplusplus
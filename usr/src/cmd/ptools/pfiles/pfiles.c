@@ -630,7 +630,9 @@ show_sockopts(struct ps_prochandle *Pr, int fd)
 	    { SOL_SOCKET, SO_ALLZONES,		"SO_ALLZONES,"	},
 	    { SOL_SOCKET, SO_EXCLBIND,		"SO_EXCLBIND," },
 	    { SOL_SOCKET, SO_VRRP,		"SO_VRRP," },
+	    { SOL_SOCKET, SO_REUSEPORT,		"SO_REUSEPORT," },
 	    { IPPROTO_UDP, UDP_NAT_T_ENDPOINT,	"UDP_NAT_T_ENDPOINT," },
+	    { IPPROTO_UDP, UDP_GRO,		"UDP_GRO," },
 	};
 	struct linger l;
 
@@ -264,7 +264,8 @@ zfs_process_add(zpool_handle_t *zhp, nvlist_t *vdev, boolean_t isdisk)
 
 	nvlist_free(newvd);
 
-	(void) zpool_vdev_attach(zhp, fullpath, path, nvroot, B_TRUE);
+	(void) zpool_vdev_attach(zhp, fullpath, path, nvroot, B_TRUE,
+	    B_FALSE);
 
 	nvlist_free(nvroot);
 
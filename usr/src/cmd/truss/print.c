@@ -1861,6 +1861,9 @@ sol_optname(private_t *pri, long val)
 		case SO_VRRP:		return ("SO_VRRP");
 		case SO_EXCLBIND:	return ("SO_EXCLBIND");
 		case SO_DOMAIN:		return ("SO_DOMAIN");
+		case SO_MAX_PACING_RATE: return ("SO_MAX_PACING_RATE");
+		case SO_REUSEPORT:	return ("SO_REUSEPORT");
+		case SO_INCOMING_CPU:	return ("SO_INCOMING_CPU");
 
 		default:		(void) snprintf(pri->code_buf, CBSIZE,
 					    "0x%lx", val);
@@ -1945,6 +1948,8 @@ tcp_optname(private_t *pri, long val)
 	case TCP_KEEPIDLE:		return ("TCP_KEEPIDLE");
 	case TCP_KEEPCNT:		return ("TCP_KEEPCNT");
 	case TCP_KEEPINTVL:		return ("TCP_KEEPINTVL");
+	case TCP_FASTOPEN:		return ("TCP_FASTOPEN");
+	case TCP_FASTOPEN_CONNECT:	return ("TCP_FASTOPEN_CONNECT");
 
 	default:			(void) snprintf(pri->code_buf,
 					    sizeof (pri->code_buf),
@@ -1997,6 +2002,8 @@ udp_optname(private_t *pri, long val)
 	case UDP_EXCLBIND:		return ("UDP_EXCLBIND");
 	case UDP_RCVHDR:		return ("UDP_RCVHDR");
 	case UDP_NAT_T_ENDPOINT:	return ("UDP_NAT_T_ENDPOINT");
+	case UDP_SEGMENT:		return ("UDP_SEGMENT");
+	case UDP_GRO:			return ("UDP_GRO");
 
 	default:			(void) snprintf(pri->code_buf,
 					    sizeof (pri->code_buf), "0x%lx",
@@ -362,11 +362,11 @@ const struct systable systable[] = {
 {"sharefs",	3, DEC, NOV, DEC, HEX, DEC},			/* 140 */
 {"seteuid",	1, DEC, NOV, UNS},				/* 141 */
 {"forksys",	2, DEC, NOV, DEC, HHX},				/* 142 */
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
+{"sendmmsg",	4, DEC, NOV, DEC, HEX, UNS, DEC},		/* 143 */
 {"sigtimedwait", 3, DEC, NOV, HEX, HEX, HEX},			/* 144 */
 {"lwp_info",	1, DEC, NOV, HEX},				/* 145 */
 {"yield",	0, DEC, NOV},					/* 146 */
-{ NULL,		8, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX, HEX},
+{"recvmmsg",	5, DEC, NOV, DEC, HEX, UNS, DEC, HEX},		/* 147 */
 {"lwp_sema_post", 1, DEC, NOV, HEX},				/* 148 */
 {"lwp_sema_trywait", 1, DEC, NOV, HEX},				/* 149 */
 {"lwp_detach",	1, DEC, NOV, DEC},				/* 150 */
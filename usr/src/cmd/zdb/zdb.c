@@ -853,22 +853,35 @@ dump_spacemap(objset_t *os, space_map_t *sm)
 	}
 }
 
+/*
+ * load_time is how long metaslab_load() took, or 0 if the metaslab was
+ * already loaded.
+ */
 static void
-dump_metaslab_stats(metaslab_t *msp)
+dump_metaslab_stats(metaslab_t *msp, hrtime_t load_time)
 {
-	char maxbuf[32];
+	char maxbuf[32], membuf[32];
 	range_tree_t *rt = msp->ms_allocatable;
-	avl_tree_t *t = &msp->ms_allocatable_by_size;
+	zfs_btree_t *t = &msp->ms_allocatable_by_size;
 	int free_pct = range_tree_space(rt) * 100 / msp->ms_size;
 
 	/* max sure nicenum has enough space */
 	CTASSERT(sizeof (maxbuf) >= NN_NUMBUF_SZ);
+	CTASSERT(sizeof (membuf) >= NN_NUMBUF_SZ);
 
 	zdb_nicenum(metaslab_block_maxsize(msp), maxbuf, sizeof (maxbuf));
+	zdb_nicenum(zfs_btree_memory(&rt->rt_root) + zfs_btree_memory(t),
+	    membuf, sizeof (membuf));
 
 	(void) printf("\t %25s %10lu   %7s  %6s   %4s %4d%%\n",
-	    "segments", avl_numnodes(t), "maxsize", maxbuf,
+	    "segments", zfs_btree_numnodes(t), "maxsize", maxbuf,
 	    "freepct", free_pct);
+	if (load_time != 0) {
+		(void) printf("\t %25s %10s   %7s  %.3fms\n",
+		    "in-core", membuf, "loaded", (double)load_time / MICROSEC);
+	} else {
+		(void) printf("\t %25s %10s\n", "in-core", membuf);
+	}
 	(void) printf("\tIn-memory histogram:\n");
 	dump_histogram(rt->rt_histogram, RANGE_TREE_HISTOGRAM_SIZE, 0);
 }
@@ -890,13 +903,17 @@ dump_metaslab(metaslab_t *msp)
 	    (u_longlong_t)space_map_object(sm), freebuf);
 
 	if (dump_opt['m'] > 2 && !dump_opt['L']) {
+		hrtime_t load_time = 0;
+
 		mutex_enter(&msp->ms_lock);
 		metaslab_load_wait(msp);
 		if (!msp->ms_loaded) {
+			load_time = gethrtime();
 			VERIFY0(metaslab_load(msp));
+			load_time = gethrtime() - load_time;
 			range_tree_stat_verify(msp->ms_allocatable);
 		}
-		dump_metaslab_stats(msp);
+		dump_metaslab_stats(msp, load_time);
 		metaslab_unload(msp);
 		mutex_exit(&msp->ms_lock);
 	}
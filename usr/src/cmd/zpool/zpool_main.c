@@ -213,7 +213,7 @@ get_usage(zpool_help_t idx)
 	case HELP_ADD:
 		return (gettext("\tadd [-fn] <pool> <vdev> ...\n"));
 	case HELP_ATTACH:
-		return (gettext("\tattach [-f] <pool> <device> "
+		return (gettext("\tattach [-fs] <pool> <device> "
 		    "<new-device>\n"));
 	case HELP_CLEAR:
 		return (gettext("\tclear [-nF] <pool> [device]\n"));
@@ -255,7 +255,7 @@ get_usage(zpool_help_t idx)
 	case HELP_ONLINE:
 		return (gettext("\tonline <pool> <device> ...\n"));
 	case HELP_REPLACE:
-		return (gettext("\treplace [-f] <pool> <device> "
+		return (gettext("\treplace [-fs] <pool> <device> "
 		    "[new-device]\n"));
 	case HELP_REMOVE:
 		return (gettext("\tremove [-nps] <pool> <device> ...\n"));
@@ -3510,6 +3510,7 @@ static int
 zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 {
 	boolean_t force = B_FALSE;
+	boolean_t rebuild = B_FALSE;
 	int c;
 	nvlist_t *nvroot;
 	char *poolname, *old_disk, *new_disk;
@@ -3519,11 +3520,14 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 	int ret;
 
 	/* check options */
-	while ((c = getopt(argc, argv, "f")) != -1) {
+	while ((c = getopt(argc, argv, "fs")) != -1) {
 		switch (c) {
 		case 'f':
 			force = B_TRUE;
 			break;
+		case 's':
+			rebuild = B_TRUE;
+			break;
 		case '?':
 			(void) fprintf(stderr, gettext("invalid option '%c'\n"),
 			    optopt);
@@ -3593,7 +3597,8 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 		return (1);
 	}
 
-	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing);
+	ret = zpool_vdev_attach(zhp, old_disk, new_disk, nvroot, replacing,
+	    rebuild);
 
 	nvlist_free(nvroot);
 	zpool_close(zhp);
@@ -3602,9 +3607,10 @@ zpool_do_attach_or_replace(int argc, char **argv, int replacing)
 }
 
 /*
- * zpool replace [-f] <pool> <device> <new_device>
+ * zpool replace [-fs] <pool> <device> <new_device>
  *
  *	-f	Force attach, even if <new_device> appears to be in use.
+ *	-s	Use sequential rebuild instead of resilver.
  *
  * Replace <device> with <new_device>.
  */
@@ -3616,9 +3622,10 @@ zpool_do_replace(int argc, char **argv)
 }
 
 /*
- * zpool attach [-f] <pool> <device> <new_device>
+ * zpool attach [-fs] <pool> <device> <new_device>
  *
  *	-f	Force attach, even if <new_device> appears to be in use.
+ *	-s	Use sequential rebuild instead of resilver.
  *
  * Attach <new_device> to the mirror containing <device>.  If <device> is not
  * part of a mirror, then <device> will be transformed into a mirror of
@@ -4638,6 +4645,162 @@ print_removal_status(zpool_handle_t *zhp, pool_removal_stat_t *prs)
 	}
 }
 
+/*
+ * Print out detailed raidz expansion status.
+ */
+static void
+print_raidz_expand_status(zpool_handle_t *zhp,
+    pool_raidz_expand_stat_t *pres)
+{
+	char copied_buf[7], total_buf[7], rate_buf[7];
+	time_t start, end;
+	nvlist_t *config, *nvroot;
+	nvlist_t **child;
+	uint_t children;
+	char *vdev_name;
+
+	if (pres == NULL || pres->pres_state == DSS_NONE)
+		return;
+
+	/*
+	 * Determine name of vdev.
+	 */
+	config = zpool_get_config(zhp, NULL);
+	nvroot = fnvlist_lookup_nvlist(config,
+	    ZPOOL_CONFIG_VDEV_TREE);
+	verify(nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) == 0);
+	assert(pres->pres_expanding_vdev < children);
+	vdev_name = zpool_vdev_name(g_zfs, zhp,
+	    child[pres->pres_expanding_vdev], B_FALSE);
+
+	(void) printf(gettext("expand: "));
+
+	start = pres->pres_start_time;
+	end = pres->pres_end_time;
+	zfs_nicenum(pres->pres_reflowed, copied_buf, sizeof (copied_buf));
+
+	/*
+	 * Expansion is finished.
+	 */
+	if (pres->pres_state == DSS_FINISHED) {
+		uint64_t minutes_taken = (end - start) / 60;
+
+		(void) printf(gettext("Expansion of vdev %s copied %s "
+		    "in %lluh%um, completed on %s"),
+		    vdev_name, copied_buf,
+		    (u_longlong_t)(minutes_taken / 60),
+		    (uint_t)(minutes_taken % 60),
+		    ctime((time_t *)&end));
+	} else {
+		uint64_t copied, total, elapsed, mins_left, hours_left;
+		double fraction_done;
+		uint_t rate;
+
+		assert(pres->pres_state == DSS_SCANNING);
+
+		/*
+		 * Expansion is in progress.
+		 */
+		(void) printf(gettext(
+		    "Expansion of %s in progress since %s"),
+		    vdev_name, ctime(&start));
+
+		copied = pres->pres_reflowed > 0 ? pres->pres_reflowed : 1;
+		total = pres->pres_to_reflow;
+		fraction_done = (double)copied / total;
+
+		/* elapsed time for this pass */
+		elapsed = time(NULL) - pres->pres_start_time;
+		elapsed = elapsed > 0 ? elapsed : 1;
+		rate = copied / elapsed;
+		rate = rate > 0 ? rate : 1;
+		mins_left = ((total - copied) / rate) / 60;
+		hours_left = mins_left / 60;
+
+		zfs_nicenum(copied, copied_buf, sizeof (copied_buf));
+		zfs_nicenum(total, total_buf, sizeof (total_buf));
+		zfs_nicenum(rate, rate_buf, sizeof (rate_buf));
+
+		/*
+		 * do not print estimated time if hours_left is more than
+		 * 30 days
+		 */
+		(void) printf(gettext("    %s copied out of %s at %s/s, "
+		    "%.2f%% done"),
+		    copied_buf, total_buf, rate_buf, 100 * fraction_done);
+		if (hours_left < (30 * 24)) {
+			(void) printf(gettext(", %lluh%um to go\n"),
+			    (u_longlong_t)hours_left, (uint_t)(mins_left % 60));
+		} else {
+			(void) printf(gettext(
+			    ", (copy is slow, no estimated time)\n"));
+		}
+	}
+	free(vdev_name);
+}
+
+/*
+ * Print out the sequential rebuild status of each top-level vdev.
+ */
+static void
+print_rebuild_status(zpool_handle_t *zhp, nvlist_t *nvroot)
+{
+	nvlist_t **child;
+	uint_t children, c, i;
+
+	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &child, &children) != 0)
+		return;
+
+	for (c = 0; c < children; c++) {
+		vdev_rebuild_stat_t *vrs;
+		char scanned_buf[7], total_buf[7];
+		char *vdev_name;
+		time_t start, end;
+
+		if (nvlist_lookup_uint64_array(child[c],
+		    ZPOOL_CONFIG_REBUILD_STATS, (uint64_t **)&vrs, &i) != 0 ||
+		    vrs->vrs_state == VDEV_REBUILD_NONE)
+			continue;
+
+		vdev_name = zpool_vdev_name(g_zfs, zhp, child[c], B_FALSE);
+		start = vrs->vrs_start_time;
+		end = vrs->vrs_end_time;
+		zfs_nicenum(vrs->vrs_bytes_scanned, scanned_buf,
+		    sizeof (scanned_buf));
+		zfs_nicenum(vrs->vrs_bytes_est, total_buf, sizeof (total_buf));
+
+		(void) printf(gettext("rebuild: "));
+
+		if (vrs->vrs_state == VDEV_REBUILD_ACTIVE) {
+			double fraction_done = (vrs->vrs_bytes_est == 0) ?
+			    0 : (double)vrs->vrs_bytes_scanned /
+			    vrs->vrs_bytes_est;
+
+			(void) printf(gettext("Rebuild of %s in progress "
+			    "since %s"), vdev_name, ctime(&start));
+			(void) printf(gettext("    %s rebuilt out of %s, "
+			    "%.2f%% done\n"), scanned_buf, total_buf,
+			    100 * fraction_done);
+		} else if (vrs->vrs_state == VDEV_REBUILD_COMPLETE) {
+			uint64_t minutes_taken = (end - start) / 60;
+
+			(void) printf(gettext("Rebuild of %s rebuilt %s in "
+			    "%lluh%um with %llu errors on %s"), vdev_name,
+			    scanned_buf, (u_longlong_t)(minutes_taken / 60),
+			    (uint_t)(minutes_taken % 60),
+			    (u_longlong_t)vrs->vrs_errors, ctime(&end));
+		} else {
+			assert(vrs->vrs_state == VDEV_REBUILD_CANCELED);
+			(void) printf(gettext("Rebuild of %s canceled on %s"),
+			    vdev_name, ctime(&end));
+		}
+
+		free(vdev_name);
+	}
+}
+
 static void
 print_checkpoint_status(pool_checkpoint_stat_t *pcs)
 {
@@ -5045,6 +5208,7 @@ status_callback(zpool_handle_t *zhp, void *data)
 		pool_checkpoint_stat_t *pcs = NULL;
 		pool_scan_stat_t *ps = NULL;
 		pool_removal_stat_t *prs = NULL;
+		pool_raidz_expand_stat_t *pres = NULL;
 
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_CHECKPOINT_STATS, (uint64_t **)&pcs, &c);
@@ -5052,10 +5216,14 @@ status_callback(zpool_handle_t *zhp, void *data)
 		    ZPOOL_CONFIG_SCAN_STATS, (uint64_t **)&ps, &c);
 		(void) nvlist_lookup_uint64_array(nvroot,
 		    ZPOOL_CONFIG_REMOVAL_STATS, (uint64_t **)&prs, &c);
+		(void) nvlist_lookup_uint64_array(nvroot,
+		    ZPOOL_CONFIG_RAIDZ_EXPAND_STATS, (uint64_t **)&pres, &c);
 
 		print_scan_status(ps);
 		print_checkpoint_scan_warning(ps, pcs);
 		print_removal_status(zhp, prs);
+		print_raidz_expand_status(zhp, pres);
+		print_rebuild_status(zhp, nvroot);
 		print_checkpoint_status(pcs);
 
 		namewidth = max_width(zhp, nvroot, 0, 0);
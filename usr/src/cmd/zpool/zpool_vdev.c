@@ -35,6 +35,7 @@
  *
  * 	Group vdevs
  * 		raidz[1|2]=(...)
+ * 		draid[1|2|3][:<ndata>d][:<nspares>s]=(...)
  * 		mirror=(...)
  *
  * 	Hot spares
@@ -378,6 +379,19 @@ is_whole_disk(const char *arg)
 	return (B_TRUE);
 }
 
+/*
+ * Distributed spares are named "draid<parity>-<top-level id>-<spare id>".
+ */
+static boolean_t
+is_draid_spare(const char *arg)
+{
+	unsigned long long parity, id, spare;
+	int n = 0;
+
+	return (sscanf(arg, VDEV_TYPE_DRAID "%llu-%llu-%llu%n", &parity, &id,
+	    &spare, &n) == 3 && arg[n] == '\0');
+}
+
 /*
  * Create a leaf vdev.  Determine if this is a file or a device.  If it's a
  * device, fill in the device id to make a complete nvlist.  Valid forms for a
@@ -386,6 +400,7 @@ is_whole_disk(const char *arg)
  * 	/dev/dsk/xxx	Complete disk path
  * 	/xxx		Full path to file
  * 	xxx		Shorthand for /dev/dsk/xxx
+ * 	draidP-N-S	Distributed spare S of dRAID vdev N
  */
 static nvlist_t *
 make_leaf_vdev(const char *arg, uint64_t is_log)
@@ -396,6 +411,20 @@ make_leaf_vdev(const char *arg, uint64_t is_log)
 	char *type = NULL;
 	boolean_t wholedisk = B_FALSE;
 
+	/*
+	 * A distributed spare has no device; the kernel finds it by name
+	 * among the pool's spares.
+	 */
+	if (is_draid_spare(arg)) {
+		verify(nvlist_alloc(&vdev, NV_UNIQUE_NAME, 0) == 0);
+		verify(nvlist_add_string(vdev, ZPOOL_CONFIG_PATH, arg) == 0);
+		verify(nvlist_add_string(vdev, ZPOOL_CONFIG_TYPE,
+		    VDEV_TYPE_DRAID_SPARE) == 0);
+		verify(nvlist_add_uint64(vdev, ZPOOL_CONFIG_IS_LOG,
+		    is_log) == 0);
+		return (vdev);
+	}
+
 	/*
 	 * Determine what type of vdev this is, and put the full path into
 	 * 'path'.  We detect whether this is a device of file afterwards by
@@ -597,7 +626,8 @@ get_replication(nvlist_t *nvroot, boolean_t fatal)
 			rep.zprl_type = type;
 			rep.zprl_children = 0;
 
-			if (strcmp(type, VDEV_TYPE_RAIDZ) == 0) {
+			if (strcmp(type, VDEV_TYPE_RAIDZ) == 0 ||
+			    strcmp(type, VDEV_TYPE_DRAID) == 0) {
 				verify(nvlist_lookup_uint64(nv,
 				    ZPOOL_CONFIG_NPARITY,
 				    &rep.zprl_parity) == 0);
@@ -1124,9 +1154,74 @@ is_device_in_use(nvlist_t *config, nvlist_t *nv, boolean_t force,
 	return (anyinuse);
 }
 
+/*
+ * Parse a dRAID vdev name, "draid[<parity>][:<ndata>d][:<nspares>s]".  An
+ * unspecified number of data devices is returned as 0, to be filled in
+ * once the number of children is known.
+ */
+static boolean_t
+parse_draid(const char *type, uint64_t *nparityp, uint64_t *ndatap,
+    uint64_t *nsparesp)
+{
+	const char *p = type + strlen(VDEV_TYPE_DRAID);
+	char *end;
+	uint64_t nparity = 1, ndata = 0, nspares = 0;
+
+	if (strncmp(type, VDEV_TYPE_DRAID, strlen(VDEV_TYPE_DRAID)) != 0)
+		return (B_FALSE);
+
+	if (*p >= '1' && *p <= '9') {
+		errno = 0;
+		nparity = strtoull(p, &end, 10);
+		if (errno != 0 || nparity > 3)
+			return (B_FALSE);
+		p = end;
+	}
+
+	while (*p == ':') {
+		uint64_t val;
+
+		p++;
+		if (*p < '0' || *p > '9')
+			return (B_FALSE);
+		errno = 0;
+		val = strtoull(p, &end, 10);
+		if (errno != 0)
+			return (B_FALSE);
+		if (*end == 'd' && ndata == 0 && val != 0)
+			ndata = val;
+		else if (*end == 's' && nspares == 0)
+			nspares = val;
+		else
+			return (B_FALSE);
+		p = end + 1;
+	}
+
+	if (*p != '\0')
+		return (B_FALSE);
+
+	if (nparityp != NULL)
+		*nparityp = nparity;
+	if (ndatap != NULL)
+		*ndatap = ndata;
+	if (nsparesp != NULL)
+		*nsparesp = nspares;
+	return (B_TRUE);
+}
+
 static const char *
 is_grouping(const char *type, int *mindev, int *maxdev)
 {
+	uint64_t nparity, ndata, nspares;
+
+	if (parse_draid(type, &nparity, &ndata, &nspares)) {
+		if (mindev != NULL)
+			*mindev = nparity + (ndata == 0 ? 1 : ndata) + nspares;
+		if (maxdev != NULL)
+			*maxdev = 255;
+		return (VDEV_TYPE_DRAID);
+	}
+
 	if (strncmp(type, "raidz", 5) == 0) {
 		const char *p = type + 5;
 		char *end;
@@ -1215,6 +1310,7 @@ construct_spec(int argc, char **argv)
 		 */
 		if ((type = is_grouping(argv[0], &mindev, &maxdev)) != NULL) {
 			nvlist_t **child = NULL;
+			const char *name = argv[0];
 			int c, children = 0;
 
 			if (strcmp(type, VDEV_TYPE_SPARE) == 0) {
@@ -1320,6 +1416,31 @@ construct_spec(int argc, char **argv)
 					    ZPOOL_CONFIG_NPARITY,
 					    mindev - 1) == 0);
 				}
+				if (strcmp(type, VDEV_TYPE_DRAID) == 0) {
+					uint64_t nparity, ndata, nspares;
+
+					verify(parse_draid(name, &nparity,
+					    &ndata, &nspares));
+					/*
+					 * By default, use groups of up to 8
+					 * data devices.
+					 */
+					if (ndata == 0) {
+						ndata = children - nspares -
+						    nparity;
+						if (ndata > 8)
+							ndata = 8;
+					}
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_NPARITY,
+					    nparity) == 0);
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_DRAID_NDATA,
+					    ndata) == 0);
+					verify(nvlist_add_uint64(nv,
+					    ZPOOL_CONFIG_DRAID_NSPARES,
+					    nspares) == 0);
+				}
 				verify(nvlist_add_nvlist_array(nv,
 				    ZPOOL_CONFIG_CHILDREN, child,
 				    children) == 0);
@@ -0,0 +1,456 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Multibit compressed trie ("Poptrie", Asai and Ohara, SIGCOMM 2015).
+ *
+ * The top POPTRIE_DIR_BITS of a key index a flat array, pt_dir, whose entries
+ * are either a leaf or a node.  Every node resolves the next POPTRIE_STRIDE
+ * bits of the key into one of 64 slots.  Instead of 64 pointers a node holds
+ * two bitmaps: pn_vec has a bit set for each slot that has a child node, and
+ * pn_leafvec has a bit set for each slot (among those without a child) whose
+ * leaf differs from that of the previous such slot.  A node's children are
+ * allocated contiguously from pn_base1, and its distinct leaves contiguously
+ * from pn_base0, so that the child or leaf for slot 'v' is found by counting
+ * the bits set at or below 'v' in the relevant bitmap.  Runs of slots with
+ * the same route, which prefix expansion produces a lot of, thus cost a
+ * single leaf, and a full IPv4 table fits in a few megabytes, most of which
+ * is the top array; lookups touch pt_dir and one node per level, typically
+ * two or three cache lines in all.
+ *
+ * A trie cannot be updated: callers build a new one from a snapshot of their
+ * routing table, publish it and free the old one once no reader can be using
+ * it.  The same code is compiled into the kernel and into userland tests.
+ */
+
+#include <sys/types.h>
+#include <sys/sysmacros.h>
+#ifdef	_KERNEL
+#include <sys/systm.h>
+#include <sys/kmem.h>
+#include <sys/debug.h>
+#include <util/qsort.h>
+#else
+#include <assert.h>
+#define	ASSERT assert
+#include <stdlib.h>
+#include <strings.h>
+#endif	/* _KERNEL */
+#include <net/poptrie.h>
+
+#ifdef	_KERNEL
+#define	PT_ZALLOC(sz)	kmem_zalloc(sz, KM_SLEEP)
+#define	PT_FREE(p, sz)	kmem_free(p, sz)
+#else
+#define	PT_ZALLOC(sz)	calloc(1, sz)
+#define	PT_FREE(p, sz)	free(p)
+#endif	/* _KERNEL */
+
+#define	POPTRIE_SLOTS		(1 << POPTRIE_STRIDE)
+#define	POPTRIE_DIR_SIZE	(1 << POPTRIE_DIR_BITS)
+#define	POPTRIE_DIR_INDEX(key)	((key)[0] >> (64 - POPTRIE_DIR_BITS))
+#define	POPTRIE_MAXDEPTH	\
+	((128 - POPTRIE_DIR_BITS + POPTRIE_STRIDE - 1) / POPTRIE_STRIDE)
+
+/*
+ * Scratch state for poptrie_build().  The per-node arrays are kept here
+ * rather than on the stack since an IPv6 trie can be nineteen levels deep.
+ */
+typedef struct poptrie_bld {
+	poptrie_t	*pb_pt;
+	poptrie_route_t	*pb_routes;
+	uint32_t	pb_maxnodes;
+	uint32_t	pb_maxleaves;
+	boolean_t	pb_failed;
+	uintptr_t	pb_vals[POPTRIE_MAXDEPTH][POPTRIE_SLOTS];
+	uint8_t		pb_lens[POPTRIE_MAXDEPTH][POPTRIE_SLOTS];
+	uint32_t	pb_lo[POPTRIE_MAXDEPTH][POPTRIE_SLOTS];
+	uint32_t	pb_hi[POPTRIE_MAXDEPTH][POPTRIE_SLOTS];
+} poptrie_bld_t;
+
+/*
+ * Return the POPTRIE_STRIDE bits of the key starting at bit 'off', counting
+ * from the most significant bit.  Bits past the end of the key read as zero.
+ */
+static inline uint_t
+poptrie_bits(const uint64_t *key, uint_t off)
+{
+	uint64_t v;
+
+	if (off >= 64)
+		v = key[1] << (off - 64);
+	else if (off == 0)
+		v = key[0];
+	else
+		v = (key[0] << off) | (key[1] >> (64 - off));
+	return ((uint_t)(v >> (64 - POPTRIE_STRIDE)));
+}
+
+static int
+poptrie_route_cmp(const void *a, const void *b)
+{
+	const poptrie_route_t *ra = a;
+	const poptrie_route_t *rb = b;
+
+	if (ra->pr_key[0] != rb->pr_key[0])
+		return (ra->pr_key[0] < rb->pr_key[0] ? -1 : 1);
+	if (ra->pr_key[1] != rb->pr_key[1])
+		return (ra->pr_key[1] < rb->pr_key[1] ? -1 : 1);
+	if (ra->pr_plen != rb->pr_plen)
+		return (ra->pr_plen < rb->pr_plen ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Make room for 'n' more entries in one of the trie arrays, doubling it as
+ * needed.  Indices have to stay clear of POPTRIE_DIR_LEAF.
+ */
+static boolean_t
+poptrie_grow(poptrie_bld_t *pb, void **arrp, uint32_t *maxp, uint32_t cnt,
+    uint32_t n, size_t esz)
+{
+	uint32_t max = *maxp;
+	void *narr;
+
+	if (cnt + n <= max)
+		return (B_TRUE);
+	while (cnt + n > max) {
+		if (max >= POPTRIE_DIR_LEAF / 2) {
+			pb->pb_failed = B_TRUE;
+			return (B_FALSE);
+		}
+		max *= 2;
+	}
+	if ((narr = PT_ZALLOC(max * esz)) == NULL) {
+		pb->pb_failed = B_TRUE;
+		return (B_FALSE);
+	}
+	bcopy(*arrp, narr, cnt * esz);
+	PT_FREE(*arrp, *maxp * esz);
+	*arrp = narr;
+	*maxp = max;
+	return (B_TRUE);
+}
+
+static uint32_t
+poptrie_alloc_nodes(poptrie_bld_t *pb, uint32_t n)
+{
+	poptrie_t *pt = pb->pb_pt;
+	uint32_t idx = pt->pt_nnodes;
+
+	if (!poptrie_grow(pb, (void **)&pt->pt_nodes, &pb->pb_maxnodes,
+	    pt->pt_nnodes, n, sizeof (poptrie_node_t)))
+		return (0);
+	pt->pt_nnodes += n;
+	return (idx);
+}
+
+static uint32_t
+poptrie_add_leaf(poptrie_bld_t *pb, uintptr_t val)
+{
+	poptrie_t *pt = pb->pb_pt;
+
+	if (!poptrie_grow(pb, (void **)&pt->pt_leaves, &pb->pb_maxleaves,
+	    pt->pt_nleaves, 1, sizeof (uintptr_t)))
+		return (0);
+	pt->pt_leaves[pt->pt_nleaves] = val;
+	return (pt->pt_nleaves++);
+}
+
+/*
+ * Fill in node 'ni', which resolves key bits [off, off + POPTRIE_STRIDE), from
+ * the routes in [lo, hi).  Those routes all share the node's first 'off' bits;
+ * any that are no longer than 'off' were dealt with by an ancestor, which
+ * passes the longest of them down as 'dflt'.
+ */
+static void
+poptrie_build_node(poptrie_bld_t *pb, uint32_t ni, uint32_t lo, uint32_t hi,
+    uint_t off, uint_t depth, uintptr_t dflt)
+{
+	poptrie_route_t *routes = pb->pb_routes;
+	uintptr_t *vals = pb->pb_vals[depth];
+	uint8_t *lens = pb->pb_lens[depth];
+	uint32_t *clo = pb->pb_lo[depth];
+	uint32_t *chi = pb->pb_hi[depth];
+	uint_t end = off + POPTRIE_STRIDE;
+	uint64_t vec = 0, leafvec = 0;
+	uint32_t base0, base1, i;
+	uintptr_t prev = 0;
+	uint_t s, span, nchild;
+
+	ASSERT(depth < POPTRIE_MAXDEPTH);
+
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		vals[s] = dflt;
+		lens[s] = 0;
+	}
+
+	/*
+	 * Expand the prefixes that end within this node into its slots, and
+	 * note which routes each child gets.
+	 */
+	for (i = lo; i < hi; i++) {
+		poptrie_route_t *pr = &routes[i];
+
+		if (pr->pr_plen <= off)
+			continue;
+		s = poptrie_bits(pr->pr_key, off);
+		if (pr->pr_plen > end) {
+			if (!(vec & (1ULL << s)))
+				clo[s] = i;
+			chi[s] = i + 1;
+			vec |= 1ULL << s;
+			continue;
+		}
+		for (span = 1U << (end - pr->pr_plen); span > 0; span--, s++) {
+			if (pr->pr_plen >= lens[s]) {
+				vals[s] = pr->pr_value;
+				lens[s] = pr->pr_plen;
+			}
+		}
+	}
+
+	base0 = pb->pb_pt->pt_nleaves;
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		if (vec & (1ULL << s))
+			continue;
+		if (leafvec == 0 || vals[s] != prev) {
+			(void) poptrie_add_leaf(pb, vals[s]);
+			leafvec |= 1ULL << s;
+			prev = vals[s];
+		}
+	}
+
+	nchild = poptrie_popcnt(vec);
+	base1 = nchild != 0 ? poptrie_alloc_nodes(pb, nchild) : 0;
+	if (pb->pb_failed)
+		return;
+
+	pb->pb_pt->pt_nodes[ni].pn_vec = vec;
+	pb->pb_pt->pt_nodes[ni].pn_leafvec = leafvec;
+	pb->pb_pt->pt_nodes[ni].pn_base0 = base0;
+	pb->pb_pt->pt_nodes[ni].pn_base1 = base1;
+
+	for (s = 0; s < POPTRIE_SLOTS && !pb->pb_failed; s++) {
+		if (!(vec & (1ULL << s)))
+			continue;
+		poptrie_build_node(pb, base1++, clo[s], chi[s], end, depth + 1,
+		    vals[s]);
+	}
+}
+
+/*
+ * Replace one of the trie arrays by an exactly sized copy once the build is
+ * done, so that poptrie_free() knows its size.
+ */
+static void *
+poptrie_shrink(poptrie_bld_t *pb, void *arr, uint32_t max, uint32_t cnt,
+    size_t esz)
+{
+	void *narr;
+
+	if (cnt == 0)
+		cnt = 1;
+	if ((narr = PT_ZALLOC(cnt * esz)) == NULL) {
+		pb->pb_failed = B_TRUE;
+		return (arr);
+	}
+	bcopy(arr, narr, cnt * esz);
+	PT_FREE(arr, max * esz);
+	return (narr);
+}
+
+/*
+ * Build a trie from 'nroutes' routes with keys of 'keybits' bits.  The routes
+ * array is sorted, and its keys masked to their prefix length, in place.
+ * Where the same prefix appears more than once, the last one sorted wins.
+ * Returns NULL if memory could not be allocated (userland only) or if the
+ * table is too large for the trie's 31-bit indices.
+ */
+poptrie_t *
+poptrie_build(poptrie_route_t *routes, uint32_t nroutes, uint_t keybits)
+{
+	poptrie_bld_t *pb;
+	poptrie_t *pt;
+	uintptr_t *dirval = NULL;
+	uint8_t *dirlen = NULL;
+	uintptr_t prev = 0;
+	uint32_t i, j, prevleaf = 0, ni;
+	boolean_t haveleaf = B_FALSE;
+	uint_t s, span;
+
+	ASSERT(keybits == 32 || keybits == 128);
+
+	for (i = 0; i < nroutes; i++) {
+		poptrie_route_t *pr = &routes[i];
+		uint_t plen = pr->pr_plen;
+
+		ASSERT(plen <= keybits && pr->pr_value != 0);
+		if (plen == 0) {
+			pr->pr_key[0] = pr->pr_key[1] = 0;
+		} else if (plen <= 64) {
+			pr->pr_key[0] &= ~0ULL << (64 - plen);
+			pr->pr_key[1] = 0;
+		} else if (plen < 128) {
+			pr->pr_key[1] &= ~0ULL << (128 - plen);
+		}
+	}
+	qsort(routes, nroutes, sizeof (poptrie_route_t), poptrie_route_cmp);
+
+	if ((pb = PT_ZALLOC(sizeof (*pb))) == NULL)
+		return (NULL);
+	if ((pt = PT_ZALLOC(sizeof (*pt))) == NULL) {
+		PT_FREE(pb, sizeof (*pb));
+		return (NULL);
+	}
+	pt->pt_keybits = keybits;
+	pt->pt_nroutes = nroutes;
+	pb->pb_pt = pt;
+	pb->pb_routes = routes;
+	pb->pb_maxnodes = 1024;
+	pb->pb_maxleaves = 1024;
+	pt->pt_dir = PT_ZALLOC(POPTRIE_DIR_SIZE * sizeof (uint32_t));
+	pt->pt_nodes = PT_ZALLOC(pb->pb_maxnodes * sizeof (poptrie_node_t));
+	pt->pt_leaves = PT_ZALLOC(pb->pb_maxleaves * sizeof (uintptr_t));
+	dirval = PT_ZALLOC(POPTRIE_DIR_SIZE * sizeof (uintptr_t));
+	dirlen = PT_ZALLOC(POPTRIE_DIR_SIZE * sizeof (uint8_t));
+	if (pt->pt_dir == NULL || pt->pt_nodes == NULL ||
+	    pt->pt_leaves == NULL || dirval == NULL || dirlen == NULL) {
+		pb->pb_failed = B_TRUE;
+		goto done;
+	}
+
+	/* Expand the short prefixes into the top array... */
+	for (i = 0; i < nroutes; i++) {
+		poptrie_route_t *pr = &routes[i];
+
+		if (pr->pr_plen > POPTRIE_DIR_BITS)
+			continue;
+		s = POPTRIE_DIR_INDEX(pr->pr_key);
+		span = 1U << (POPTRIE_DIR_BITS - pr->pr_plen);
+		for (; span > 0; span--, s++) {
+			if (pr->pr_plen >= dirlen[s]) {
+				dirval[s] = pr->pr_value;
+				dirlen[s] = pr->pr_plen;
+			}
+		}
+	}
+
+	/*
+	 * ... and hang a node off each entry that has longer ones.  Routes are
+	 * sorted by key, so each entry's routes are contiguous.
+	 */
+	for (s = 0, i = 0; s < POPTRIE_DIR_SIZE && !pb->pb_failed; s++) {
+		boolean_t child = B_FALSE;
+
+		for (j = i; j < nroutes &&
+		    POPTRIE_DIR_INDEX(routes[j].pr_key) == s; j++) {
+			if (routes[j].pr_plen > POPTRIE_DIR_BITS)
+				child = B_TRUE;
+		}
+		if (child) {
+			ni = poptrie_alloc_nodes(pb, 1);
+			if (pb->pb_failed)
+				break;
+			pt->pt_dir[s] = ni;
+			poptrie_build_node(pb, ni, i, j, POPTRIE_DIR_BITS, 0,
+			    dirval[s]);
+		} else {
+			if (!haveleaf || dirval[s] != prev) {
+				prevleaf = poptrie_add_leaf(pb, dirval[s]);
+				prev = dirval[s];
+				haveleaf = B_TRUE;
+			}
+			pt->pt_dir[s] = prevleaf | POPTRIE_DIR_LEAF;
+		}
+		i = j;
+	}
+
+	if (!pb->pb_failed) {
+		pt->pt_nodes = poptrie_shrink(pb, pt->pt_nodes,
+		    pb->pb_maxnodes, pt->pt_nnodes, sizeof (poptrie_node_t));
+		pb->pb_maxnodes = MAX(pt->pt_nnodes, 1);
+	}
+	if (!pb->pb_failed) {
+		pt->pt_leaves = poptrie_shrink(pb, pt->pt_leaves,
+		    pb->pb_maxleaves, pt->pt_nleaves, sizeof (uintptr_t));
+		pb->pb_maxleaves = MAX(pt->pt_nleaves, 1);
+	}
+
+done:
+	if (dirval != NULL)
+		PT_FREE(dirval, POPTRIE_DIR_SIZE * sizeof (uintptr_t));
+	if (dirlen != NULL)
+		PT_FREE(dirlen, POPTRIE_DIR_SIZE * sizeof (uint8_t));
+	if (pb->pb_failed) {
+		if (pt->pt_dir != NULL)
+			PT_FREE(pt->pt_dir, POPTRIE_DIR_SIZE *
+			    sizeof (uint32_t));
+		if (pt->pt_nodes != NULL)
+			PT_FREE(pt->pt_nodes, pb->pb_maxnodes *
+			    sizeof (poptrie_node_t));
+		if (pt->pt_leaves != NULL)
+			PT_FREE(pt->pt_leaves, pb->pb_maxleaves *
+			    sizeof (uintptr_t));
+		PT_FREE(pt, sizeof (*pt));
+		pt = NULL;
+	}
+	PT_FREE(pb, sizeof (*pb));
+	return (pt);
+}
+
+void
+poptrie_free(poptrie_t *pt)
+{
+	PT_FREE(pt->pt_dir, POPTRIE_DIR_SIZE * sizeof (uint32_t));
+	PT_FREE(pt->pt_nodes, MAX(pt->pt_nnodes, 1) * sizeof (poptrie_node_t));
+	PT_FREE(pt->pt_leaves, MAX(pt->pt_nleaves, 1) * sizeof (uintptr_t));
+	PT_FREE(pt, sizeof (*pt));
+}
+
+/*
+ * Bytes of memory used by the trie.
+ */
+size_t
+poptrie_size(const poptrie_t *pt)
+{
+	return (sizeof (*pt) + POPTRIE_DIR_SIZE * sizeof (uint32_t) +
+	    MAX(pt->pt_nnodes, 1) * sizeof (poptrie_node_t) +
+	    MAX(pt->pt_nleaves, 1) * sizeof (uintptr_t));
+}
+
+/*
+ * Longest prefix match on a key laid out as in poptrie_route_t.  Returns the
+ * value of the matching route, or 0 if there is none.
+ */
+uintptr_t
+poptrie_lookup(const poptrie_t *pt, const uint64_t *key)
+{
+	const poptrie_node_t *pn;
+	uint64_t bit;
+	uint32_t idx;
+	uint_t off;
+
+	idx = pt->pt_dir[POPTRIE_DIR_INDEX(key)];
+	if (idx & POPTRIE_DIR_LEAF)
+		return (pt->pt_leaves[idx & ~POPTRIE_DIR_LEAF]);
+
+	pn = &pt->pt_nodes[idx];
+	for (off = POPTRIE_DIR_BITS; ; off += POPTRIE_STRIDE) {
+		bit = 1ULL << poptrie_bits(key, off);
+		if (!(pn->pn_vec & bit))
+			break;
+		pn = &pt->pt_nodes[pn->pn_base1 +
+		    poptrie_popcnt(pn->pn_vec & ((bit << 1) - 1)) - 1];
+	}
+	return (pt->pt_leaves[pn->pn_base0 +
+	    poptrie_popcnt(pn->pn_leafvec & ((bit << 1) - 1)) - 1]);
+}
@@ -0,0 +1,22 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+	.file	"_so_sendmmsg.s"
+
+/* C library -- __so_sendmmsg						*/
+/* int __so_sendmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen,	*/
+/*	int flags)							*/
+
+#include "SYS.h"
+
+	SYSCALL2_RESTART_RVAL1(__so_sendmmsg,sendmmsg)
+	RET
+	SET_SIZE(__so_sendmmsg)
@@ -0,0 +1,77 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Asynchronous I/O rings; see <sys/aio_ring.h>.
+ */
+
+#include "lint.h"
+#include "thr_uberdata.h"
+#include "asyncio.h"
+#include <sys/aio_ring.h>
+
+/*
+ * A ring's worker threads live in the kernel, running requests, until the
+ * ring is destroyed.  They come back out only to have a signal or a hold
+ * of the process handled, and then go straight back in.
+ */
+static void *
+_aioring_worker(void *arg)
+{
+	int id = (int)(uintptr_t)arg;
+
+	while (_kaio(AIORING_WORK, id) == -1 && errno == EINTR)
+		continue;
+	return (NULL);
+}
+
+int
+aioring_setup(aioring_params_t *params)
+{
+	sigset_t oset;
+	uint_t i;
+	int id;
+
+	if ((id = (int)_kaio(AIORING_SETUP, params)) == -1)
+		return (-1);
+
+	/*
+	 * The workers must not take signals meant for the application.
+	 */
+	(void) pthread_sigmask(SIG_SETMASK, &maskset, &oset);
+	for (i = 0; i < params->arp_workers; i++) {
+		int error = thr_create(NULL, AIOSTKSIZE, _aioring_worker,
+		    (void *)(uintptr_t)id, THR_DAEMON, NULL);
+		if (error != 0) {
+			(void) pthread_sigmask(SIG_SETMASK, &oset, NULL);
+			(void) _kaio(AIORING_DESTROY, id);
+			errno = error;
+			return (-1);
+		}
+	}
+	(void) pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+	return (id);
+}
+
+int
+aioring_enter(int id, uint_t to_submit, uint_t min_complete, uint_t flags,
+    const timespec_t *timeout)
+{
+	return ((int)_kaio(AIORING_ENTER, id, to_submit, min_complete, flags,
+	    timeout));
+}
+
+int
+aioring_destroy(int id)
+{
+	return ((int)_kaio(AIORING_DESTROY, id));
+}
@@ -56,8 +56,10 @@ extern int _so_connect();
 extern int _so_shutdown();
 extern int _so_recv();
 extern int _so_recvfrom();
+extern int _so_recvmmsg();
 extern int _so_recvmsg();
 extern int _so_send();
+extern int _so_sendmmsg();
 extern int _so_sendmsg();
 extern int _so_sendto();
 extern int _so_getpeername();
@@ -114,6 +116,13 @@ recvfrom(int sock, void *buf, size_t len, int flags,
 	return (_so_recvfrom(sock, buf, len, flags, addr, addrlen));
 }
 
+int
+recvmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags,
+    struct timespec *timeout)
+{
+	return (_so_recvmmsg(sock, msgvec, vlen, flags, timeout));
+}
+
 ssize_t
 recvmsg(int sock, struct msghdr *msg, int flags)
 {
@@ -126,6 +135,12 @@ send(int sock, const void *buf, size_t len, int flags)
 	return (_so_send(sock, buf, len, flags));
 }
 
+int
+sendmmsg(int sock, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+	return (_so_sendmmsg(sock, msgvec, vlen, flags));
+}
+
 ssize_t
 sendmsg(int sock, const struct msghdr *msg, int flags)
 {
@@ -964,6 +964,17 @@ _so_recvfrom(int sock, void *buf, size_t len, int flags,
 	PERFORM(__so_recvfrom(sock, buf, len, flags, addr, addrlen))
 }
 
+int
+_so_recvmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags,
+    struct timespec *timeout)
+{
+	extern int __so_recvmmsg(int, struct mmsghdr *, uint_t, int,
+	    struct timespec *);
+	int rv;
+
+	PERFORM(__so_recvmmsg(sock, msgvec, vlen, flags, timeout))
+}
+
 int
 _so_recvmsg(int sock, struct msghdr *msg, int flags)
 {
@@ -982,6 +993,15 @@ _so_send(int sock, const void *buf, size_t len, int flags)
 	PERFORM(__so_send(sock, buf, len, flags))
 }
 
+int
+_so_sendmmsg(int sock, struct mmsghdr *msgvec, uint_t vlen, int flags)
+{
+	extern int __so_sendmmsg(int, struct mmsghdr *, uint_t, int);
+	int rv;
+
+	PERFORM(__so_sendmmsg(sock, msgvec, vlen, flags))
+}
+
 int
 _so_sendmsg(int sock, const struct msghdr *msg, int flags)
 {
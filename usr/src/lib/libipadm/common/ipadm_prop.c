@@ -153,6 +153,9 @@ static const char *ecn_sack_vals[] = {"never", "passive", "active", NULL};
 
 /* Supported TCP protocol properties */
 static ipadm_prop_desc_t ipadm_tcp_prop_table[] = {
+	{ "congestion_control", NULL, IPADMPROP_CLASS_MODULE, MOD_PROTO_TCP,
+	    0, i_ipadm_set_prop, i_ipadm_get_prop, i_ipadm_get_prop },
+
 	{ "dupack_fast_retrans", "dupack_fast_retransmit",
 		IPADMPROP_CLASS_MODULE, MOD_PROTO_TCP, 0, i_ipadm_set_prop,
 		i_ipadm_get_prop, i_ipadm_get_prop },
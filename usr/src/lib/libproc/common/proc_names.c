@@ -254,11 +254,11 @@ static const char *const systable[] = {
 	"sharefs",		/* 140 */
 	"seteuid",		/* 141 */
 	"forksys",		/* 142 */
-	NULL,			/* 143 */
+	"sendmmsg",		/* 143 */
 	"sigtimedwait",		/* 144 */
 	"lwp_info",		/* 145 */
 	"yield",		/* 146 */
-	NULL,			/* 147 */
+	"recvmmsg",		/* 147 */
 	"lwp_sema_post",	/* 148 */
 	"lwp_sema_trywait",	/* 149 */
 	"lwp_detatch",		/* 150 */
@@ -2341,6 +2341,7 @@ static boolean_t
 zpool_vdev_is_interior(const char *name)
 {
 	if (strncmp(name, VDEV_TYPE_RAIDZ, strlen(VDEV_TYPE_RAIDZ)) == 0 ||
+	    strncmp(name, VDEV_TYPE_DRAID, strlen(VDEV_TYPE_DRAID)) == 0 ||
 	    strncmp(name, VDEV_TYPE_SPARE, strlen(VDEV_TYPE_SPARE)) == 0 ||
 	    strncmp(name,
 	    VDEV_TYPE_REPLACING, strlen(VDEV_TYPE_REPLACING)) == 0 ||
@@ -2349,6 +2350,21 @@ zpool_vdev_is_interior(const char *name)
 	return (B_FALSE);
 }
 
+/*
+ * Distributed spares are named "draid<parity>-<top-level id>-<spare id>".
+ */
+static boolean_t
+zpool_vdev_is_draid_spare(const char *name)
+{
+	unsigned long long parity, id, spare;
+	int n = 0;
+
+	if (sscanf(name, VDEV_TYPE_DRAID "%llu-%llu-%llu%n", &parity, &id,
+	    &spare, &n) == 3 && name[n] == '\0')
+		return (B_TRUE);
+	return (B_FALSE);
+}
+
 nvlist_t *
 zpool_find_vdev(zpool_handle_t *zhp, const char *path, boolean_t *avail_spare,
     boolean_t *l2cache, boolean_t *log)
@@ -2363,6 +2379,8 @@ zpool_find_vdev(zpool_handle_t *zhp, const char *path, boolean_t *avail_spare,
 	guid = strtoull(path, &end, 10);
 	if (guid != 0 && *end == '\0') {
 		verify(nvlist_add_uint64(search, ZPOOL_CONFIG_GUID, guid) == 0);
+	} else if (zpool_vdev_is_draid_spare(path)) {
+		verify(nvlist_add_string(search, ZPOOL_CONFIG_PATH, path) == 0);
 	} else if (zpool_vdev_is_interior(path)) {
 		verify(nvlist_add_string(search, ZPOOL_CONFIG_TYPE, path) == 0);
 	} else if (path[0] != '/') {
@@ -2786,10 +2804,12 @@ is_replacing_spare(nvlist_t *search, nvlist_t *tgt, int which)
 /*
  * Attach new_disk (fully described by nvroot) to old_disk.
  * If 'replacing' is specified, the new disk will replace the old one.
+ * If 'rebuild' is specified, the new disk is filled by a sequential
+ * rebuild rather than a resilver.
  */
 int
-zpool_vdev_attach(zpool_handle_t *zhp,
-    const char *old_disk, const char *new_disk, nvlist_t *nvroot, int replacing)
+zpool_vdev_attach(zpool_handle_t *zhp, const char *old_disk,
+    const char *new_disk, nvlist_t *nvroot, int replacing, boolean_t rebuild)
 {
 	zfs_cmd_t zc = { 0 };
 	char msg[1024];
@@ -2824,6 +2844,7 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 
 	verify(nvlist_lookup_uint64(tgt, ZPOOL_CONFIG_GUID, &zc.zc_guid) == 0);
 	zc.zc_cookie = replacing;
+	zc.zc_simple = rebuild;
 
 	if (nvlist_lookup_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
 	    &child, &children) != 0 || children != 1) {
@@ -2880,7 +2901,11 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 		/*
 		 * Can't attach to or replace this type of vdev.
 		 */
-		if (replacing) {
+		if (rebuild) {
+			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+			    "sequential rebuild requires the device_rebuild "
+			    "feature and a mirror or dRAID vdev"));
+		} else if (replacing) {
 			uint64_t version = zpool_get_prop_int(zhp,
 			    ZPOOL_PROP_VERSION, NULL);
 
@@ -2896,8 +2921,9 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 				    "cannot replace a replacing device"));
 		} else {
 			zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
-			    "can only attach to mirrors and top-level "
-			    "disks"));
+			    "can only attach to mirrors, raidz vdevs "
+			    "with the raidz_expansion feature enabled, "
+			    "and top-level disks"));
 		}
 		(void) zfs_error(hdl, EZFS_BADTARGET, msg);
 		break;
@@ -2943,6 +2969,12 @@ zpool_vdev_attach(zpool_handle_t *zhp,
 		(void) zfs_error(hdl, EZFS_DEVOVERFLOW, msg);
 		break;
 
+	case ZFS_ERR_RAIDZ_EXPAND_IN_PROGRESS:
+		zfs_error_aux(hdl, dgettext(TEXT_DOMAIN,
+		    "raidz expansion is already in progress"));
+		(void) zfs_error(hdl, EZFS_RAIDZ_EXPAND_IN_PROGRESS, msg);
+		break;
+
 	default:
 		(void) zpool_standard_error(hdl, errno, msg);
 	}
@@ -3685,9 +3717,11 @@ zpool_vdev_name(libzfs_handle_t *hdl, zpool_handle_t *zhp, nvlist_t *nv,
 		verify(nvlist_lookup_string(nv, ZPOOL_CONFIG_TYPE, &path) == 0);
 
 		/*
-		 * If it's a raidz device, we need to stick in the parity level.
+		 * If it's a raidz or dRAID device, we need to stick in the
+		 * parity level.
 		 */
-		if (strcmp(path, VDEV_TYPE_RAIDZ) == 0) {
+		if (strcmp(path, VDEV_TYPE_RAIDZ) == 0 ||
+		    strcmp(path, VDEV_TYPE_DRAID) == 0) {
 			verify(nvlist_lookup_uint64(nv, ZPOOL_CONFIG_NPARITY,
 			    &value) == 0);
 			(void) snprintf(buf, sizeof (buf), "%s%llu", path,
@@ -0,0 +1,119 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Run the in-kernel micro-benchmarks of the kbench test driver, and print
+ * their results as name/value pairs.  With no arguments every benchmark is
+ * run in turn; otherwise only the named ones are.  The test fails if any
+ * benchmark reports a nonzero "errors" result.
+ *
+ * Usage: kbench [taskq | rwlock | epoch | flock | vmem] ...
+ *
+ * The parameters of each benchmark are tunables of the kbench module, and
+ * are described in the driver's sources.
+ */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <kbench.h>
+
+#define	KBENCH_DEV	"/devices/pseudo/kbench@0:kbench"
+
+static const char *kbench_names[KBENCH_NBENCH] = {
+	"taskq", "rwlock", "epoch", "flock", "vmem"
+};
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "usage: kbench [taskq | rwlock | epoch | "
+	    "flock | vmem] ...\n");
+	exit(2);
+}
+
+/*
+ * Run benchmark 'bench' and print its results.  Return 0 if it ran and
+ * reported no errors, 1 otherwise.
+ */
+static int
+kbench_run(int fd, kbench_t bench)
+{
+	kbench_run_t *kb;
+	uint32_t i;
+	int ret = 0;
+
+	if ((kb = calloc(1, sizeof (kbench_run_t))) == NULL) {
+		(void) fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	kb->kb_bench = bench;
+
+	if (ioctl(fd, KBENCH_IOC_RUN, kb) != 0) {
+		(void) fprintf(stderr, "%s: %s\n", kbench_names[bench],
+		    strerror(errno));
+		free(kb);
+		return (1);
+	}
+
+	for (i = 0; i < kb->kb_nres && i < KBENCH_MAXRES; i++) {
+		kbench_res_t *kr = &kb->kb_res[i];
+
+		kr->kr_name[KBENCH_NAMELEN - 1] = '\0';
+		(void) printf("%s:%s\t%" PRIu64 "\n", kbench_names[bench],
+		    kr->kr_name, kr->kr_value);
+		if (strcmp(kr->kr_name, "errors") == 0 && kr->kr_value != 0)
+			ret = 1;
+	}
+
+	free(kb);
+	return (ret);
+}
+
+int
+main(int argc, char *argv[])
+{
+	int fd, i, b;
+	int ret = 0;
+
+	if ((fd = open(KBENCH_DEV, O_RDWR)) < 0) {
+		(void) fprintf(stderr, "%s: %s\n", KBENCH_DEV,
+		    strerror(errno));
+		return (1);
+	}
+
+	if (argc == 1) {
+		for (b = 0; b < KBENCH_NBENCH; b++)
+			ret |= kbench_run(fd, b);
+	}
+
+	for (i = 1; i < argc; i++) {
+		for (b = 0; b < KBENCH_NBENCH; b++) {
+			if (strcmp(argv[i], kbench_names[b]) == 0)
+				break;
+		}
+		if (b == KBENCH_NBENCH)
+			usage();
+		ret |= kbench_run(fd, b);
+	}
+
+	(void) close(fd);
+
+	if (ret == 0)
+		(void) printf("TEST PASSED\n");
+	return (ret);
+}
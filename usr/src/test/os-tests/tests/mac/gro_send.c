@@ -0,0 +1,340 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Helper for the simnet_gro test: play the sending end of a TCP connection
+ * on a link that IP isn't plumbed on, so that bursts of segments arrive at
+ * the peer link exactly as we build them.  A listening socket on the peer's
+ * address takes the connection; every burst must come out of it intact and
+ * in order, however the MAC layer merged it on the way.
+ *
+ * Usage: gro_send -l link -m peer-mac -s src-addr -d dst-addr
+ *		[-n segments] [-r rounds] [-z size]
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ethernet.h>
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <libdlpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define	GS_MAXSIZE	1400
+#define	GS_MAXSEGS	40
+#define	GS_WINDOW	65535
+#define	GS_MSS		1460
+
+static uint_t gs_nsegs = 32;
+static uint_t gs_rounds = 50;
+static uint_t gs_size = 1200;
+
+static dlpi_handle_t gs_dh;
+static uchar_t gs_peer[ETHERADDRL];
+static struct in_addr gs_src, gs_dst;
+static in_port_t gs_sport, gs_dport;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "Usage: gro_send -l link -m peer-mac "
+	    "-s src-addr -d dst-addr\n"
+	    "\t[-n segments] [-r rounds] [-z size]\n");
+	exit(2);
+}
+
+static void
+fatal(char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	va_start(args, message);
+	(void) fprintf(stderr, "gro_send: ");
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (save_errno != 0)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(1);
+}
+
+static uint32_t
+gs_sum(const void *buf, size_t len, uint32_t sum)
+{
+	const uint8_t *p = buf;
+
+	for (; len > 1; len -= 2, p += 2)
+		sum += (p[0] << 8) | p[1];
+	if (len != 0)
+		sum += p[0] << 8;
+	return (sum);
+}
+
+/* The checksum to store for a sum */
+static uint16_t
+gs_cksum(uint32_t sum)
+{
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return (htons(~sum & 0xffff));
+}
+
+/*
+ * Build and send a segment from gs_src:gs_sport to gs_dst:gs_dport, with an
+ * MSS option if it's a SYN.
+ */
+static void
+gs_send(uint32_t seq, uint32_t ack, uint8_t flags, const uint8_t *data,
+    size_t len)
+{
+	uint8_t pkt[sizeof (struct ip) + sizeof (struct tcphdr) + 4 +
+	    GS_MAXSIZE];
+	uint8_t pseudo[12];
+	struct ip *ip = (struct ip *)pkt;
+	struct tcphdr *tcp = (struct tcphdr *)(ip + 1);
+	size_t thlen = sizeof (*tcp);
+	uint16_t tcplen;
+	int ret;
+
+	bzero(pkt, sizeof (*ip) + sizeof (*tcp) + 4);
+	if (flags & TH_SYN) {
+		uint8_t *opt = (uint8_t *)(tcp + 1);
+
+		opt[0] = TCPOPT_MAXSEG;
+		opt[1] = 4;
+		opt[2] = GS_MSS >> 8;
+		opt[3] = GS_MSS & 0xff;
+		thlen += 4;
+	}
+	bcopy(data, pkt + sizeof (*ip) + thlen, len);
+
+	tcp->th_sport = gs_sport;
+	tcp->th_dport = gs_dport;
+	tcp->th_seq = htonl(seq);
+	tcp->th_ack = htonl(ack);
+	tcp->th_off = thlen >> 2;
+	tcp->th_flags = flags;
+	tcp->th_win = htons(GS_WINDOW);
+
+	tcplen = thlen + len;
+	bcopy(&gs_src, pseudo, 4);
+	bcopy(&gs_dst, pseudo + 4, 4);
+	pseudo[8] = 0;
+	pseudo[9] = IPPROTO_TCP;
+	pseudo[10] = tcplen >> 8;
+	pseudo[11] = tcplen & 0xff;
+	tcp->th_sum = gs_cksum(gs_sum(tcp, tcplen,
+	    gs_sum(pseudo, sizeof (pseudo), 0)));
+
+	ip->ip_v = IPVERSION;
+	ip->ip_hl = sizeof (*ip) >> 2;
+	ip->ip_len = htons(sizeof (*ip) + tcplen);
+	ip->ip_off = htons(IP_DF);
+	ip->ip_ttl = 64;
+	ip->ip_p = IPPROTO_TCP;
+	ip->ip_src = gs_src;
+	ip->ip_dst = gs_dst;
+	ip->ip_sum = gs_cksum(gs_sum(ip, sizeof (*ip), 0));
+
+	if ((ret = dlpi_send(gs_dh, gs_peer, ETHERADDRL, pkt,
+	    sizeof (*ip) + tcplen, NULL)) != DLPI_SUCCESS)
+		fatal("dlpi_send: %s", dlpi_strerror(ret));
+}
+
+/*
+ * Wait for the SYN-ACK of the peer and return its initial sequence number.
+ */
+static boolean_t
+gs_synack(uint32_t *irsp)
+{
+	uint8_t buf[2048];
+	struct ip *ip = (struct ip *)buf;
+	struct tcphdr *tcp;
+	size_t len;
+
+	for (;;) {
+		len = sizeof (buf);
+		if (dlpi_recv(gs_dh, NULL, NULL, buf, &len, 1000,
+		    NULL) != DLPI_SUCCESS)
+			return (B_FALSE);
+		if (len < sizeof (*ip) + sizeof (*tcp) ||
+		    ip->ip_p != IPPROTO_TCP ||
+		    ip->ip_src.s_addr != gs_dst.s_addr ||
+		    len < (ip->ip_hl << 2) + sizeof (*tcp))
+			continue;
+		tcp = (struct tcphdr *)(buf + (ip->ip_hl << 2));
+		if (tcp->th_sport == gs_dport && tcp->th_dport == gs_sport &&
+		    (tcp->th_flags & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK)) {
+			*irsp = ntohl(tcp->th_seq);
+			return (B_TRUE);
+		}
+	}
+}
+
+/* Throw away what the peer sent us, mostly ACKs */
+static void
+gs_drain(void)
+{
+	uint8_t buf[2048];
+	size_t len;
+
+	do {
+		len = sizeof (buf);
+	} while (dlpi_recv(gs_dh, NULL, NULL, buf, &len, 0, NULL) ==
+	    DLPI_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static uint8_t data[GS_MAXSEGS * GS_MAXSIZE];
+	static uint8_t rbuf[GS_MAXSEGS * GS_MAXSIZE];
+	struct sockaddr_in sin;
+	struct timeval tv = { 2, 0 };
+	struct ether_addr *ea;
+	socklen_t slen = sizeof (sin);
+	char *link = NULL, *mac = NULL, *src = NULL, *dst = NULL;
+	uint32_t iss = 0x1000000, irs, seq;
+	uint_t i, r, tries;
+	size_t burst, got;
+	ssize_t n;
+	int c, ls, s, ret;
+
+	while ((c = getopt(argc, argv, "l:m:s:d:n:r:z:")) != -1) {
+		switch (c) {
+		case 'l':
+			link = optarg;
+			break;
+		case 'm':
+			mac = optarg;
+			break;
+		case 's':
+			src = optarg;
+			break;
+		case 'd':
+			dst = optarg;
+			break;
+		case 'n':
+			gs_nsegs = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			gs_rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			gs_size = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (link == NULL || mac == NULL || src == NULL || dst == NULL ||
+	    gs_nsegs == 0 || gs_nsegs > GS_MAXSEGS || gs_size == 0 ||
+	    gs_size > GS_MAXSIZE || gs_nsegs * gs_size > GS_WINDOW)
+		usage();
+	if ((ea = ether_aton(mac)) == NULL)
+		fatal("bad MAC address %s", mac);
+	bcopy(ea, gs_peer, ETHERADDRL);
+	if (inet_pton(AF_INET, src, &gs_src) != 1 ||
+	    inet_pton(AF_INET, dst, &gs_dst) != 1)
+		usage();
+
+	/* The receiving end */
+	if ((ls = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		fatal("socket");
+	bzero(&sin, sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr = gs_dst;
+	if (bind(ls, (struct sockaddr *)&sin, sizeof (sin)) == -1 ||
+	    listen(ls, 1) == -1 ||
+	    getsockname(ls, (struct sockaddr *)&sin, &slen) == -1)
+		fatal("listen");
+	gs_dport = sin.sin_port;
+	gs_sport = htons(40000 + (getpid() % 20000));
+
+	/* The sending end */
+	if ((ret = dlpi_open(link, &gs_dh, 0)) != DLPI_SUCCESS)
+		fatal("dlpi_open %s: %s", link, dlpi_strerror(ret));
+	if ((ret = dlpi_bind(gs_dh, ETHERTYPE_IP, NULL)) != DLPI_SUCCESS)
+		fatal("dlpi_bind: %s", dlpi_strerror(ret));
+
+	for (tries = 0; ; tries++) {
+		if (tries == 5) {
+			errno = 0;
+			fatal("no SYN-ACK from %s", dst);
+		}
+		gs_send(iss, 0, TH_SYN, NULL, 0);
+		if (gs_synack(&irs))
+			break;
+	}
+	gs_send(iss + 1, irs + 1, TH_ACK, NULL, 0);
+	(void) alarm(60);
+	if ((s = accept(ls, NULL, NULL)) == -1)
+		fatal("accept");
+	if (setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof (tv)) == -1)
+		fatal("setsockopt(SO_RCVTIMEO)");
+
+	burst = gs_nsegs * gs_size;
+	seq = iss + 1;
+	for (r = 0; r < gs_rounds; r++) {
+		for (i = 0; i < burst; i++)
+			data[i] = (seq + i) % 251;
+
+		/*
+		 * Send the burst back to back, and again should any of it go
+		 * missing; TCP drops what it has already.
+		 */
+		for (tries = 0, got = 0; got < burst; ) {
+			if (tries++ == 5) {
+				errno = 0;
+				fatal("round %u: got %zu bytes of %zu", r,
+				    got, burst);
+			}
+			for (i = 0; i < gs_nsegs; i++) {
+				gs_send(seq + i * gs_size, irs + 1,
+				    TH_ACK | (i == gs_nsegs - 1 ? TH_PUSH : 0),
+				    data + i * gs_size, gs_size);
+			}
+			while (got < burst) {
+				n = recv(s, rbuf + got, burst - got, 0);
+				if (n == -1 && errno == EAGAIN)
+					break;
+				if (n <= 0)
+					fatal("recv");
+				got += n;
+			}
+		}
+		if (bcmp(data, rbuf, burst) != 0) {
+			errno = 0;
+			fatal("round %u: data came out wrong", r);
+		}
+		seq += burst;
+		gs_drain();
+	}
+
+	gs_send(seq, irs + 1, TH_RST | TH_ACK, NULL, 0);
+	(void) close(s);
+	(void) close(ls);
+	dlpi_close(gs_dh);
+
+	(void) printf("%u rounds of %u segments of %u bytes\n", gs_rounds,
+	    gs_nsegs, gs_size);
+	return (0);
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/ksh
+
+#
+# This file and its contents are supplied under the terms of the
+# Common Development and Distribution License ("CDDL"), version 1.0.
+# You may only use this file in accordance with the terms of version
+# 1.0 of the CDDL.
+#
+# A full copy of the text of the CDDL should have accompanied this
+# source.  A copy of the CDDL is also available via the Internet at
+# http://www.illumos.org/license/CDDL.
+#
+
+#
+# Check receive coalescing on the MAC TCP soft rings: gro_send plays a TCP
+# sender on one end of a pair of simnets and sends bursts of segments to a
+# socket on the other, which must get every byte in order, while the fanout
+# kstats of the receiving link must show that segments were merged, and
+# that none are once the link forwards IPv4.
+#
+
+if [ `id -u` -ne 0 ]; then
+	echo "Need to be root or have effective UID of root."
+	exit 255
+fi
+
+GRO_SEND=/opt/os-tests/tests/mac/gro_send
+
+SEND_LINK=grosend0
+RECV_LINK=grorecv0
+SEND_ADDR=10.253.77.1
+RECV_ADDR=10.253.77.2
+
+function cleanup
+{
+	arp -d $SEND_ADDR >/dev/null 2>&1
+	ipadm delete-if $RECV_LINK >/dev/null 2>&1
+	dladm delete-simnet -t $RECV_LINK >/dev/null 2>&1
+	dladm delete-simnet -t $SEND_LINK >/dev/null 2>&1
+}
+
+function fail
+{
+	echo "FAIL: $*"
+	cleanup
+	exit 1
+}
+
+# The sum of a statistic over the fanout kstats of the receiving link
+function gro_stat
+{
+	kstat -p "$RECV_LINK:0:mac_rx_swlane0_fanout*:$1" | \
+	    awk '{ s += $2 } END { print s + 0 }'
+}
+
+trap "cleanup; exit 1" SIGHUP SIGINT SIGTERM
+
+dladm create-simnet -t $SEND_LINK || fail "can't create $SEND_LINK"
+dladm create-simnet -t $RECV_LINK || fail "can't create $RECV_LINK"
+dladm modify-simnet -t -p $RECV_LINK $SEND_LINK || fail "can't connect simnets"
+ipadm create-if -t $RECV_LINK || fail "can't plumb $RECV_LINK"
+ipadm create-addr -t -T static -a $RECV_ADDR/24 $RECV_LINK/v4 || \
+    fail "can't configure $RECV_ADDR"
+ipadm set-ifprop -t -p forwarding=off -m ipv4 $RECV_LINK || \
+    fail "can't turn forwarding off on $RECV_LINK"
+
+send_mac=$(dladm show-simnet -p -o macaddress $SEND_LINK)
+recv_mac=$(dladm show-simnet -p -o macaddress $RECV_LINK)
+arp -s $SEND_ADDR $send_mac || fail "can't add ARP entry for $SEND_ADDR"
+
+merged=$(gro_stat gromerged)
+flushes=$(gro_stat groflushes)
+
+$GRO_SEND -l $SEND_LINK -m $recv_mac -s $SEND_ADDR -d $RECV_ADDR || \
+    fail "data didn't get through intact"
+
+merged=$(( $(gro_stat gromerged) - merged ))
+flushes=$(( $(gro_stat groflushes) - flushes ))
+echo "$merged segments merged into $flushes"
+
+(( merged > 0 && flushes > 0 )) || fail "nothing was merged"
+(( merged >= flushes )) || fail "fewer segments merged than flushed"
+
+#
+# Merged segments are too big to forward, so a link that forwards IPv4
+# merges nothing.
+#
+ipadm set-ifprop -t -p forwarding=on -m ipv4 $RECV_LINK || \
+    fail "can't turn forwarding on on $RECV_LINK"
+merged=$(gro_stat gromerged)
+$GRO_SEND -l $SEND_LINK -m $recv_mac -s $SEND_ADDR -d $RECV_ADDR || \
+    fail "data didn't get through intact while forwarding"
+merged=$(( $(gro_stat gromerged) - merged ))
+(( merged == 0 )) || fail "$merged segments merged while forwarding"
+
+cleanup
+echo "PASS"
+exit 0
@@ -0,0 +1,380 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Check and time the compressed trie that IP uses for forwarding lookups.
+ *
+ * The routes are read from a file with one prefix per line ("10.1.0.0/16" or
+ * "2001:db8::/32"; anything after the prefix, and lines starting with '#',
+ * are ignored), as can be had from a dump of a full BGP table, or else
+ * generated at random.  The trie is then checked against a plain binary trie
+ * for a set of random addresses, half of them inside routed prefixes, and
+ * both are timed on the same addresses.
+ *
+ * Usage: poptrie_bench [-6] [-f table] [-n lookups] [-r routes] [-s seed]
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <net/poptrie.h>
+
+typedef struct bnode {
+	struct bnode	*bn_child[2];
+	uintptr_t	bn_value;
+} bnode_t;
+
+static boolean_t pb_v6;
+static volatile uintptr_t pb_sink;
+static uint_t pb_keybits = 32;
+static size_t pb_bnodes;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "usage: poptrie_bench [-6] [-f table] "
+	    "[-n lookups] [-r routes] [-s seed]\n");
+	exit(2);
+}
+
+static void *
+zalloc(size_t sz)
+{
+	void *p;
+
+	if ((p = calloc(1, sz)) == NULL) {
+		(void) fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	return (p);
+}
+
+static uint64_t
+rand64(void)
+{
+	return (((uint64_t)lrand48() << 62) ^ ((uint64_t)lrand48() << 31) ^
+	    (uint64_t)lrand48());
+}
+
+static void
+key_mask(uint64_t *key, uint_t plen)
+{
+	if (plen == 0) {
+		key[0] = key[1] = 0;
+	} else if (plen <= 64) {
+		key[0] &= ~0ULL << (64 - plen);
+		key[1] = 0;
+	} else if (plen < 128) {
+		key[1] &= ~0ULL << (128 - plen);
+	}
+}
+
+static uint_t
+key_bit(const uint64_t *key, uint_t i)
+{
+	return ((key[i / 64] >> (63 - i % 64)) & 1);
+}
+
+static boolean_t
+parse_prefix(char *line, poptrie_route_t *pr)
+{
+	char *slash, *end;
+	struct in6_addr a6;
+	struct in_addr a4;
+	long plen;
+	uint_t i;
+
+	line[strcspn(line, " \t\r\n")] = '\0';
+	if (line[0] == '\0' || line[0] == '#')
+		return (B_FALSE);
+	if ((slash = strchr(line, '/')) != NULL)
+		*slash++ = '\0';
+
+	bzero(pr, sizeof (*pr));
+	if (pb_v6) {
+		if (inet_pton(AF_INET6, line, &a6) != 1)
+			return (B_FALSE);
+		for (i = 0; i < 16; i++) {
+			pr->pr_key[i / 8] |=
+			    (uint64_t)a6.s6_addr[i] << (56 - 8 * (i % 8));
+		}
+	} else {
+		if (inet_pton(AF_INET, line, &a4) != 1)
+			return (B_FALSE);
+		pr->pr_key[0] = (uint64_t)ntohl(a4.s_addr) << 32;
+	}
+	if (slash == NULL) {
+		plen = pb_keybits;
+	} else {
+		errno = 0;
+		plen = strtol(slash, &end, 10);
+		if (errno != 0 || *end != '\0' || plen < 0 ||
+		    plen > pb_keybits)
+			return (B_FALSE);
+	}
+	pr->pr_plen = plen;
+	key_mask(pr->pr_key, pr->pr_plen);
+	return (B_TRUE);
+}
+
+static poptrie_route_t *
+read_table(const char *path, uint32_t *np)
+{
+	poptrie_route_t *routes = NULL;
+	uint32_t n = 0, max = 0;
+	char *line = NULL;
+	size_t linesz = 0;
+	FILE *f;
+
+	if ((f = fopen(path, "r")) == NULL) {
+		(void) fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	while (getline(&line, &linesz, f) > 0) {
+		if (n == max) {
+			max = max == 0 ? 4096 : max * 2;
+			if ((routes = realloc(routes,
+			    max * sizeof (*routes))) == NULL) {
+				(void) fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		if (parse_prefix(line, &routes[n]))
+			n++;
+	}
+	free(line);
+	(void) fclose(f);
+	*np = n;
+	return (routes);
+}
+
+/*
+ * Make up a table shaped roughly like the Internet's: a default route, and
+ * prefixes mostly between /16 and /24 (/32 and /48 for IPv6).
+ */
+static poptrie_route_t *
+random_table(uint32_t n)
+{
+	poptrie_route_t *routes = zalloc(n * sizeof (*routes));
+	uint_t lo = pb_v6 ? 32 : 16, spread = pb_v6 ? 17 : 9;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		poptrie_route_t *pr = &routes[i];
+
+		pr->pr_key[0] = rand64();
+		pr->pr_key[1] = pb_v6 ? rand64() : 0;
+		if (i == 0)
+			pr->pr_plen = 0;
+		else if (i % 64 == 0)
+			pr->pr_plen = lrand48() % (pb_keybits + 1);
+		else
+			pr->pr_plen = lo + lrand48() % spread;
+		key_mask(pr->pr_key, pr->pr_plen);
+	}
+	return (routes);
+}
+
+static void
+bnode_insert(bnode_t *root, const poptrie_route_t *pr)
+{
+	bnode_t *bn = root;
+	uint_t i, b;
+
+	for (i = 0; i < pr->pr_plen; i++) {
+		b = key_bit(pr->pr_key, i);
+		if (bn->bn_child[b] == NULL) {
+			bn->bn_child[b] = zalloc(sizeof (bnode_t));
+			pb_bnodes++;
+		}
+		bn = bn->bn_child[b];
+	}
+	bn->bn_value = pr->pr_value;
+}
+
+static uintptr_t
+bnode_lookup(const bnode_t *bn, const uint64_t *key)
+{
+	uintptr_t best = 0;
+	uint_t i = 0;
+
+	while (bn != NULL) {
+		if (bn->bn_value != 0)
+			best = bn->bn_value;
+		if (i == pb_keybits)
+			break;
+		bn = bn->bn_child[key_bit(key, i++)];
+	}
+	return (best);
+}
+
+static double
+elapsed_ns(hrtime_t start, uint32_t n)
+{
+	return ((double)(gethrtime() - start) / n);
+}
+
+int
+main(int argc, char *argv[])
+{
+	const char *table = NULL;
+	uint32_t nroutes = 0, nlookups = 1000000, i;
+	long seed = 1;
+	poptrie_route_t *routes;
+	uint_t *plens;
+	uint64_t *keys;
+	bnode_t root;
+	poptrie_t *pt;
+	uintptr_t sum, v, ref;
+	uint32_t bad = 0;
+	hrtime_t start;
+	double ns;
+	int c;
+
+	while ((c = getopt(argc, argv, "6f:n:r:s:")) != -1) {
+		switch (c) {
+		case '6':
+			pb_v6 = B_TRUE;
+			pb_keybits = 128;
+			break;
+		case 'f':
+			table = optarg;
+			break;
+		case 'n':
+			nlookups = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nroutes = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtol(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || nlookups == 0)
+		usage();
+	srand48(seed);
+
+	if (table != NULL) {
+		routes = read_table(table, &nroutes);
+	} else {
+		if (nroutes == 0)
+			nroutes = pb_v6 ? 20000 : 100000;
+		routes = random_table(nroutes);
+	}
+	if (nroutes == 0) {
+		(void) fprintf(stderr, "no routes\n");
+		return (1);
+	}
+
+	/*
+	 * Route values are the index of the route plus one.  Where a prefix
+	 * appears twice either may win, so results are compared by length.
+	 */
+	plens = zalloc((nroutes + 1) * sizeof (uint_t));
+	bzero(&root, sizeof (root));
+	for (i = 0; i < nroutes; i++) {
+		routes[i].pr_value = i + 1;
+		plens[i + 1] = routes[i].pr_plen;
+		bnode_insert(&root, &routes[i]);
+	}
+
+	keys = zalloc(nlookups * 2 * sizeof (uint64_t));
+	for (i = 0; i < nlookups; i++) {
+		uint64_t *key = &keys[i * 2];
+
+		key[0] = rand64();
+		key[1] = pb_v6 ? rand64() : 0;
+		if (!pb_v6)
+			key[0] &= ~0ULL << 32;
+		if (i % 2 == 0) {
+			const poptrie_route_t *pr =
+			    &routes[lrand48() % nroutes];
+			uint64_t host[2];
+
+			host[0] = key[0];
+			host[1] = key[1];
+			key_mask(key, pr->pr_plen);
+			key[0] = pr->pr_key[0] | (host[0] ^ key[0]);
+			key[1] = pr->pr_key[1] | (host[1] ^ key[1]);
+		}
+	}
+
+	start = gethrtime();
+	pt = poptrie_build(routes, nroutes, pb_keybits);
+	if (pt == NULL) {
+		(void) fprintf(stderr, "poptrie_build failed\n");
+		return (1);
+	}
+	(void) printf("%s: %u routes, build %.1f ms\n", pb_v6 ? "IPv6" : "IPv4",
+	    nroutes, (double)(gethrtime() - start) / 1000000);
+	(void) printf("poptrie: %u nodes, %u leaves, %lu KB\n",
+	    pt->pt_nnodes, pt->pt_nleaves, poptrie_size(pt) / 1024);
+	(void) printf("binary trie: %lu nodes, %lu KB\n", pb_bnodes,
+	    pb_bnodes * sizeof (bnode_t) / 1024);
+
+	for (i = 0; i < nlookups; i++) {
+		const uint64_t *key = &keys[i * 2];
+
+		v = poptrie_lookup(pt, key);
+		ref = bnode_lookup(&root, key);
+		if (!pb_v6 && poptrie_lookup4(pt, key[0] >> 32) != v)
+			v = (uintptr_t)-1;
+		if (v == ref || (v != 0 && v != (uintptr_t)-1 && ref != 0 &&
+		    plens[v] == plens[ref]))
+			continue;
+		if (bad++ < 10) {
+			(void) fprintf(stderr, "mismatch for %016llx%016llx: "
+			    "poptrie /%d, expected /%d\n",
+			    (u_longlong_t)key[0], (u_longlong_t)key[1],
+			    v == 0 || v == (uintptr_t)-1 ? -1 : (int)plens[v],
+			    ref == 0 ? -1 : (int)plens[ref]);
+		}
+	}
+
+	sum = 0;
+	start = gethrtime();
+	if (pb_v6) {
+		for (i = 0; i < nlookups; i++)
+			sum += poptrie_lookup(pt, &keys[i * 2]);
+	} else {
+		for (i = 0; i < nlookups; i++)
+			sum += poptrie_lookup4(pt, keys[i * 2] >> 32);
+	}
+	ns = elapsed_ns(start, nlookups);
+	(void) printf("poptrie: %u lookups, %.1f ns/lookup, %.1f M/s\n",
+	    nlookups, ns, 1000 / ns);
+
+	start = gethrtime();
+	for (i = 0; i < nlookups; i++)
+		sum += bnode_lookup(&root, &keys[i * 2]);
+	ns = elapsed_ns(start, nlookups);
+	(void) printf("binary trie: %u lookups, %.1f ns/lookup, %.1f M/s\n",
+	    nlookups, ns, 1000 / ns);
+
+	poptrie_free(pt);
+	pb_sink = sum;
+	if (bad != 0) {
+		(void) printf("FAIL: %u of %u lookups mismatched\n", bad,
+		    nlookups);
+		return (1);
+	}
+	return (0);
+}
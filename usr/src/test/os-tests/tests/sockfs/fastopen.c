@@ -0,0 +1,169 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * TCP Fast Open: check the TCP_FASTOPEN and TCP_FASTOPEN_CONNECT socket
+ * options, and that sendto() with MSG_FASTOPEN connects the socket and sends
+ * the data, for IPv4 and IPv6.  TCP does not use Fast Open on loopback, so
+ * this exercises the path where there is no cookie; the data then goes after
+ * the handshake.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+
+static int fo_failures;
+
+static void
+fail(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	(void) fprintf(stderr, "FAIL: ");
+	(void) vfprintf(stderr, fmt, args);
+	va_end(args);
+	(void) fprintf(stderr, "\n");
+	fo_failures++;
+}
+
+static void
+fo_options(void)
+{
+	int s, val;
+	socklen_t len = sizeof (val);
+
+	if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1) {
+		fail("socket: %s", strerror(errno));
+		return;
+	}
+
+	val = 16;
+	if (setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &val,
+	    sizeof (val)) == -1)
+		fail("set TCP_FASTOPEN: %s", strerror(errno));
+	val = 0;
+	if (getsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &val, &len) == -1 ||
+	    val != 16)
+		fail("get TCP_FASTOPEN: %d", val);
+
+	val = -1;
+	if (setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN, &val,
+	    sizeof (val)) != -1 || errno != EINVAL)
+		fail("set TCP_FASTOPEN to -1 did not fail with EINVAL");
+
+	val = 1;
+	if (setsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &val,
+	    sizeof (val)) == -1)
+		fail("set TCP_FASTOPEN_CONNECT: %s", strerror(errno));
+	val = 0;
+	len = sizeof (val);
+	if (getsockopt(s, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &val,
+	    &len) == -1 || val == 0)
+		fail("get TCP_FASTOPEN_CONNECT: %d", val);
+
+	(void) close(s);
+}
+
+static void
+fo_sendto(int af)
+{
+	struct sockaddr_storage ss;
+	socklen_t sslen = sizeof (ss);
+	const char msg[] = "hello, fast open";
+	char buf[sizeof (msg)];
+	int ls, s, c, i, val = 8;
+	ssize_t n;
+	size_t got;
+
+	bzero(&ss, sizeof (ss));
+	if (af == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+		sin->sin_family = AF_INET;
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+		sin6->sin6_family = AF_INET6;
+		sin6->sin6_addr = in6addr_loopback;
+	}
+
+	if ((ls = socket(af, SOCK_STREAM, 0)) == -1 ||
+	    setsockopt(ls, IPPROTO_TCP, TCP_FASTOPEN, &val,
+	    sizeof (val)) == -1 ||
+	    bind(ls, (struct sockaddr *)&ss, sslen) == -1 ||
+	    listen(ls, 4) == -1 ||
+	    getsockname(ls, (struct sockaddr *)&ss, &sslen) == -1) {
+		fail("af %d: listener: %s", af, strerror(errno));
+		return;
+	}
+
+	if ((s = socket(af, SOCK_STREAM, 0)) == -1) {
+		fail("af %d: socket: %s", af, strerror(errno));
+		(void) close(ls);
+		return;
+	}
+	if (sendto(s, msg, sizeof (msg), MSG_FASTOPEN,
+	    (struct sockaddr *)&ss, sslen) != sizeof (msg)) {
+		fail("af %d: sendto(MSG_FASTOPEN): %s", af, strerror(errno));
+		goto out;
+	}
+
+	/* The socket is connected now, and MSG_FASTOPEN is harmless. */
+	if (send(s, msg, sizeof (msg), MSG_FASTOPEN) != sizeof (msg)) {
+		fail("af %d: send: %s", af, strerror(errno));
+		goto out;
+	}
+
+	if ((c = accept(ls, NULL, NULL)) == -1) {
+		fail("af %d: accept: %s", af, strerror(errno));
+		goto out;
+	}
+	for (i = 0; i < 2; i++) {
+		for (got = 0; got < sizeof (buf); got += n) {
+			n = recv(c, buf + got, sizeof (buf) - got, 0);
+			if (n <= 0)
+				break;
+		}
+		if (got != sizeof (buf) || bcmp(buf, msg, sizeof (msg)) != 0) {
+			fail("af %d: message %d came out wrong", af, i);
+			break;
+		}
+	}
+	(void) close(c);
+out:
+	(void) close(s);
+	(void) close(ls);
+}
+
+int
+main(void)
+{
+	fo_options();
+	fo_sendto(AF_INET);
+	fo_sendto(AF_INET6);
+
+	if (fo_failures != 0)
+		return (EXIT_FAILURE);
+	(void) printf("TCP Fast Open tests passed\n");
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,404 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * sendmmsg(3SOCKET), recvmmsg(3SOCKET) and the UDP_SEGMENT and UDP_GRO
+ * options: check that batches of datagrams get through intact, then measure
+ * the rate at which datagrams of 64 and 1200 bytes go over loopback when
+ * sent and received
+ *
+ *	single		one sendto/recvfrom per datagram
+ *	mmsg		sendmmsg/recvmmsg, a batch at a time
+ *	segment		one send per batch with UDP_SEGMENT, and recvmmsg
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define	MM_MAXBATCH	64
+#define	MM_MAXSIZE	1472
+#define	MM_RCVBUF	(1024 * 1024)
+
+typedef enum {
+	MM_SINGLE,
+	MM_MMSG,
+	MM_SEGMENT
+} mm_mode_t;
+
+static const char *mm_modes[] = { "single", "mmsg", "segment" };
+
+static uint_t mm_batch = 32;
+static uint_t mm_seconds = 2;
+
+static volatile boolean_t mm_stop;
+
+typedef struct mm_args {
+	int		ma_sock;
+	mm_mode_t	ma_mode;
+	size_t		ma_size;
+	uint64_t	ma_count;
+} mm_args_t;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: mmsg [-b batch] [-d seconds]\n"
+	    "\n"
+	    "\t-b number of datagrams per call (default %u)\n"
+	    "\t-d duration of each run in seconds (default %u)\n",
+	    mm_batch, mm_seconds);
+	exit(2);
+}
+
+static void
+fatal(char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	(void) fflush(stdout);
+	va_start(args, message);
+	(void) fprintf(stderr, "mmsg: ");
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (save_errno != 0)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(1);
+}
+
+/*
+ * Open a UDP socket on the loopback address; if peer is not NULL, connect
+ * it there.  The address the socket is bound to is returned in sin.
+ */
+static int
+mm_socket(struct sockaddr_in *sin, const struct sockaddr_in *peer)
+{
+	socklen_t len = sizeof (*sin);
+	int rcvbuf = MM_RCVBUF;
+	int s;
+
+	if ((s = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+		fatal("socket");
+	if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+	    sizeof (rcvbuf)) == -1)
+		fatal("setsockopt(SO_RCVBUF)");
+
+	bzero(sin, sizeof (*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(s, (struct sockaddr *)sin, sizeof (*sin)) == -1)
+		fatal("bind");
+	if (getsockname(s, (struct sockaddr *)sin, &len) == -1)
+		fatal("getsockname");
+	if (peer != NULL && connect(s, (struct sockaddr *)peer,
+	    sizeof (*peer)) == -1)
+		fatal("connect");
+	return (s);
+}
+
+/*
+ * Point the n entries of msgs at consecutive size byte pieces of buf.
+ */
+static void
+mm_setup(struct mmsghdr *msgs, struct iovec *iov, uint_t n, char *buf,
+    size_t size)
+{
+	uint_t i;
+
+	bzero(msgs, n * sizeof (*msgs));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = buf + i * size;
+		iov[i].iov_len = size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+static void *
+mm_sender(void *arg)
+{
+	mm_args_t *ma = arg;
+	static char buf[MM_MAXBATCH * MM_MAXSIZE];
+	struct mmsghdr msgs[MM_MAXBATCH];
+	struct iovec iov[MM_MAXBATCH];
+	int n;
+
+	mm_setup(msgs, iov, mm_batch, buf, ma->ma_size);
+	while (!mm_stop) {
+		switch (ma->ma_mode) {
+		case MM_SINGLE:
+			n = send(ma->ma_sock, buf, ma->ma_size, 0) == -1 ?
+			    -1 : 1;
+			break;
+		case MM_MMSG:
+			n = sendmmsg(ma->ma_sock, msgs, mm_batch, 0);
+			break;
+		case MM_SEGMENT:
+			n = send(ma->ma_sock, buf, mm_batch * ma->ma_size,
+			    0) == -1 ? -1 : mm_batch;
+			break;
+		}
+		if (n == -1) {
+			if (errno == ENOBUFS || errno == EAGAIN)
+				continue;
+			fatal("send");
+		}
+		ma->ma_count += n;
+	}
+	return (NULL);
+}
+
+static void *
+mm_receiver(void *arg)
+{
+	mm_args_t *ma = arg;
+	static char buf[MM_MAXBATCH * MM_MAXSIZE];
+	struct mmsghdr msgs[MM_MAXBATCH];
+	struct iovec iov[MM_MAXBATCH];
+	struct timeval tv = { 0, 100000 };
+	int n;
+
+	/* Don't block past the end of the run */
+	if (setsockopt(ma->ma_sock, SOL_SOCKET, SO_RCVTIMEO, &tv,
+	    sizeof (tv)) == -1)
+		fatal("setsockopt(SO_RCVTIMEO)");
+
+	mm_setup(msgs, iov, mm_batch, buf, MM_MAXSIZE);
+	while (!mm_stop) {
+		if (ma->ma_mode == MM_SINGLE) {
+			n = recv(ma->ma_sock, buf, MM_MAXSIZE, 0) == -1 ?
+			    -1 : 1;
+		} else {
+			n = recvmmsg(ma->ma_sock, msgs, mm_batch,
+			    MSG_WAITFORONE, NULL);
+		}
+		if (n == -1) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			fatal("recv");
+		}
+		ma->ma_count += n;
+	}
+	return (NULL);
+}
+
+static void
+mm_run(mm_mode_t mode, size_t size)
+{
+	struct sockaddr_in rsin, ssin;
+	struct timeval start, end;
+	mm_args_t rargs, sargs;
+	pthread_t rtid, stid;
+	int segsize = size;
+	double secs;
+
+	rargs.ma_sock = mm_socket(&rsin, NULL);
+	sargs.ma_sock = mm_socket(&ssin, &rsin);
+	if (mode == MM_SEGMENT && setsockopt(sargs.ma_sock, IPPROTO_UDP,
+	    UDP_SEGMENT, &segsize, sizeof (segsize)) == -1)
+		fatal("setsockopt(UDP_SEGMENT)");
+	rargs.ma_mode = sargs.ma_mode = mode;
+	rargs.ma_size = sargs.ma_size = size;
+	rargs.ma_count = sargs.ma_count = 0;
+
+	mm_stop = B_FALSE;
+	if (pthread_create(&rtid, NULL, mm_receiver, &rargs) != 0 ||
+	    pthread_create(&stid, NULL, mm_sender, &sargs) != 0)
+		fatal("pthread_create");
+	(void) gettimeofday(&start, NULL);
+	(void) sleep(mm_seconds);
+	mm_stop = B_TRUE;
+	(void) gettimeofday(&end, NULL);
+	(void) pthread_join(stid, NULL);
+	(void) pthread_join(rtid, NULL);
+	(void) close(sargs.ma_sock);
+	(void) close(rargs.ma_sock);
+
+	secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	(void) printf("%-8s %5zu %12.0f sent/s %12.0f received/s\n",
+	    mm_modes[mode], size, sargs.ma_count / secs,
+	    rargs.ma_count / secs);
+}
+
+/*
+ * A batch sent with sendmmsg comes out of recvmmsg whole and in order, and
+ * MSG_WAITFORONE returns what is there.
+ */
+static int
+mm_check_mmsg(void)
+{
+	struct sockaddr_in rsin, ssin;
+	struct mmsghdr msgs[8];
+	struct iovec iov[8];
+	struct timespec ts = { 0, 0 };
+	char sbuf[8 * 16], rbuf[8 * 16];
+	int r, s, n;
+	uint_t i;
+
+	r = mm_socket(&rsin, NULL);
+	s = mm_socket(&ssin, &rsin);
+	for (i = 0; i < sizeof (sbuf); i++)
+		sbuf[i] = i;
+
+	/* Datagrams of 1 to 8 bytes */
+	mm_setup(msgs, iov, 8, sbuf, 16);
+	for (i = 0; i < 8; i++)
+		iov[i].iov_len = i + 1;
+	if ((n = sendmmsg(s, msgs, 8, 0)) != 8)
+		fatal("sendmmsg returned %d", n);
+	for (i = 0; i < 8; i++) {
+		if (msgs[i].msg_len != i + 1)
+			fatal("sendmmsg: msg_len %u is %u", i,
+			    msgs[i].msg_len);
+	}
+
+	mm_setup(msgs, iov, 8, rbuf, 16);
+	if ((n = recvmmsg(r, msgs, 8, 0, &ts)) == -1)
+		fatal("recvmmsg");
+	/* The timeout had expired after the first datagram */
+	if (n != 1) {
+		(void) fprintf(stderr, "recvmmsg with a zero timeout "
+		    "returned %d datagrams\n", n);
+		return (1);
+	}
+	if ((n = recvmmsg(r, msgs + 1, 8, MSG_WAITFORONE, NULL)) != 7) {
+		(void) fprintf(stderr, "recvmmsg with MSG_WAITFORONE "
+		    "returned %d datagrams\n", n);
+		return (1);
+	}
+	for (i = 0; i < 8; i++) {
+		if (msgs[i].msg_len != i + 1 ||
+		    bcmp(rbuf + i * 16, sbuf + i * 16, i + 1) != 0) {
+			(void) fprintf(stderr, "recvmmsg: datagram %u "
+			    "is wrong\n", i);
+			return (1);
+		}
+	}
+
+	errno = 0;
+	if (recvmmsg(r, msgs, 8, MSG_DONTWAIT, NULL) != -1 ||
+	    errno != EAGAIN) {
+		(void) fprintf(stderr, "recvmmsg on an empty socket "
+		    "didn't fail with EAGAIN\n");
+		return (1);
+	}
+	(void) close(s);
+	(void) close(r);
+	(void) printf("mmsg: ok\n");
+	return (0);
+}
+
+/*
+ * A send with UDP_SEGMENT comes out as datagrams of the segment size.
+ */
+static int
+mm_check_segment(void)
+{
+	struct sockaddr_in rsin, ssin;
+	char sbuf[1050], rbuf[2048];
+	int r, s, n, val;
+	socklen_t len = sizeof (val);
+	uint_t i, off = 0;
+
+	r = mm_socket(&rsin, NULL);
+	s = mm_socket(&ssin, &rsin);
+	for (i = 0; i < sizeof (sbuf); i++)
+		sbuf[i] = i;
+
+	val = 100;
+	if (setsockopt(s, IPPROTO_UDP, UDP_SEGMENT, &val, sizeof (val)) == -1)
+		fatal("setsockopt(UDP_SEGMENT)");
+	val = 1;
+	if (setsockopt(r, IPPROTO_UDP, UDP_GRO, &val, sizeof (val)) == -1)
+		fatal("setsockopt(UDP_GRO)");
+	val = 0;
+	if (getsockopt(r, IPPROTO_UDP, UDP_GRO, &val, &len) == -1 || val != 1)
+		fatal("getsockopt(UDP_GRO)");
+
+	if ((n = send(s, sbuf, sizeof (sbuf), 0)) != sizeof (sbuf))
+		fatal("send returned %d", n);
+	for (i = 0; i < 11; i++) {
+		if ((n = recv(r, rbuf, sizeof (rbuf), MSG_DONTWAIT)) == -1)
+			fatal("recv %u", i);
+		/* Loopback doesn't deliver chains, so nothing is merged */
+		if (n != (i < 10 ? 100 : 50)) {
+			(void) fprintf(stderr, "segment %u: %d bytes\n", i, n);
+			return (1);
+		}
+		if (bcmp(rbuf, sbuf + off, n) != 0) {
+			(void) fprintf(stderr, "segment %u is wrong\n", i);
+			return (1);
+		}
+		if ((off += n) == sizeof (sbuf))
+			break;
+	}
+	if (off != sizeof (sbuf)) {
+		(void) fprintf(stderr, "got %u bytes of %zu\n", off,
+		    sizeof (sbuf));
+		return (1);
+	}
+	(void) close(s);
+	(void) close(r);
+	(void) printf("segment: ok\n");
+	return (0);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const size_t sizes[] = { 64, 1200 };
+	int c, ret = 0;
+	uint_t i;
+
+	while ((c = getopt(argc, argv, "b:d:")) != -1) {
+		switch (c) {
+		case 'b':
+			mm_batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			mm_seconds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (mm_batch == 0 || mm_batch > MM_MAXBATCH || mm_seconds == 0)
+		usage();
+
+	ret |= mm_check_mmsg();
+	ret |= mm_check_segment();
+
+	(void) printf("%u datagrams per batch\n", mm_batch);
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++) {
+		mm_run(MM_SINGLE, sizes[i]);
+		mm_run(MM_MMSG, sizes[i]);
+		mm_run(MM_SEGMENT, sizes[i]);
+	}
+
+	if (ret == 0)
+		(void) printf("TEST PASSED\n");
+	return (ret);
+}
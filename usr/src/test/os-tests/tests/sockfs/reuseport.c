@@ -0,0 +1,417 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * SO_REUSEPORT: check that sockets with the option can share a port while
+ * others can't, and that TCP connections and UDP datagrams are spread among
+ * the members; then measure the rate at which connections to a loopback
+ * port can be set up and accepted by a number of threads:
+ *
+ *	shared		all the threads accept on a single listener
+ *	reuseport	each thread accepts on its own SO_REUSEPORT listener
+ *
+ * With -a, each accepting thread is bound to a CPU and sets SO_INCOMING_CPU
+ * to it, as are the connecting threads, so that each connection is handled
+ * on one CPU from SYN to accept.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/processor.h>
+#include <sys/procset.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define	RP_MAXTHREADS	256
+#define	RP_UDPSENDERS	64
+
+static uint_t rp_listeners = 4;
+static uint_t rp_clients = 4;
+static uint_t rp_seconds = 2;
+static boolean_t rp_affine = B_FALSE;
+
+static processorid_t rp_cpus[RP_MAXTHREADS];
+static uint_t rp_ncpus;
+
+static volatile boolean_t rp_stop;
+static in_port_t rp_port;
+
+typedef struct rp_thread {
+	pthread_t	rt_tid;
+	int		rt_sock;
+	processorid_t	rt_cpu;
+	uint64_t	rt_count;
+} rp_thread_t;
+
+static rp_thread_t rp_accepters[RP_MAXTHREADS];
+static rp_thread_t rp_connecters[RP_MAXTHREADS];
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: reuseport [-a] [-l listeners] [-c clients] [-d seconds]\n"
+	    "\n"
+	    "\t-a bind the threads to CPUs and set SO_INCOMING_CPU\n"
+	    "\t-l number of accepting threads (default %u)\n"
+	    "\t-c number of connecting threads (default %u)\n"
+	    "\t-d duration of each run in seconds (default %u)\n",
+	    rp_listeners, rp_clients, rp_seconds);
+	exit(2);
+}
+
+static void
+fatal(char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	(void) fflush(stdout);
+	va_start(args, message);
+	(void) fprintf(stderr, "reuseport: ");
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (save_errno != 0)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void
+loopback(struct sockaddr_in *sin, in_port_t port)
+{
+	bzero(sin, sizeof (*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sin->sin_port = port;
+}
+
+/*
+ * Open a socket of the given type and bind it to port on the loopback
+ * address, with SO_REUSEPORT if asked to.  Returns -1 with errno set if
+ * the bind fails.
+ */
+static int
+rp_socket(int type, in_port_t port, boolean_t reuseport, processorid_t cpu)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof (sin);
+	int on = 1;
+	int s, save_errno;
+
+	if ((s = socket(AF_INET, type, 0)) == -1)
+		fatal("socket");
+	if (reuseport && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &on,
+	    sizeof (on)) == -1)
+		fatal("setsockopt(SO_REUSEPORT)");
+	if (cpu != -1 && setsockopt(s, SOL_SOCKET, SO_INCOMING_CPU, &cpu,
+	    sizeof (cpu)) == -1)
+		fatal("setsockopt(SO_INCOMING_CPU)");
+
+	loopback(&sin, port);
+	if (bind(s, (struct sockaddr *)&sin, sizeof (sin)) == -1) {
+		save_errno = errno;
+		(void) close(s);
+		errno = save_errno;
+		return (-1);
+	}
+	if (type == SOCK_STREAM) {
+		/* Several threads may poll the same listener */
+		if (fcntl(s, F_SETFL, O_NONBLOCK) == -1)
+			fatal("fcntl");
+		if (listen(s, 1024) == -1)
+			fatal("listen");
+	}
+	if (port == 0) {
+		if (getsockname(s, (struct sockaddr *)&sin, &len) == -1)
+			fatal("getsockname");
+		rp_port = sin.sin_port;
+	}
+	return (s);
+}
+
+static void
+rp_bind_cpu(processorid_t cpu)
+{
+	if (cpu != -1 && processor_bind(P_LWPID, P_MYID, cpu, NULL) == -1)
+		fatal("processor_bind(%d)", cpu);
+}
+
+static void *
+rp_accepter(void *arg)
+{
+	rp_thread_t *rt = arg;
+	struct pollfd pfd;
+	int s;
+
+	rp_bind_cpu(rt->rt_cpu);
+	pfd.fd = rt->rt_sock;
+	pfd.events = POLLIN;
+	while (!rp_stop) {
+		if (poll(&pfd, 1, 100) <= 0)
+			continue;
+		if ((s = accept(rt->rt_sock, NULL, NULL)) == -1) {
+			if (errno == EAGAIN || errno == ECONNABORTED ||
+			    errno == EINTR)
+				continue;
+			fatal("accept");
+		}
+		(void) close(s);
+		rt->rt_count++;
+	}
+	return (NULL);
+}
+
+static void *
+rp_connecter(void *arg)
+{
+	rp_thread_t *rt = arg;
+	struct sockaddr_in sin;
+	struct linger l = { 1, 0 };
+	int s;
+
+	rp_bind_cpu(rt->rt_cpu);
+	loopback(&sin, rp_port);
+	while (!rp_stop) {
+		if ((s = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+			fatal("socket");
+		/* Reset rather than leave TIME_WAIT connections behind */
+		(void) setsockopt(s, SOL_SOCKET, SO_LINGER, &l, sizeof (l));
+		if (connect(s, (struct sockaddr *)&sin, sizeof (sin)) == -1) {
+			if (errno != ECONNREFUSED && errno != EADDRINUSE &&
+			    errno != EADDRNOTAVAIL)
+				fatal("connect");
+		} else {
+			rt->rt_count++;
+		}
+		(void) close(s);
+	}
+	return (NULL);
+}
+
+/*
+ * Run the connect-rate benchmark; returns the number of listeners that
+ * accepted nothing.  With -a, a listener only gets the connections made
+ * from its CPU, so it isn't counted.
+ */
+static uint_t
+rp_run(const char *name, boolean_t reuseport)
+{
+	struct timeval start, end;
+	uint64_t accepted = 0, connected = 0;
+	uint_t i, idle = 0;
+	double secs;
+	int s = -1;
+
+	rp_stop = B_FALSE;
+	for (i = 0; i < rp_listeners; i++) {
+		rp_thread_t *rt = &rp_accepters[i];
+
+		rt->rt_cpu = rp_affine ? rp_cpus[i % rp_ncpus] : -1;
+		rt->rt_count = 0;
+		if (reuseport) {
+			rt->rt_sock = rp_socket(SOCK_STREAM,
+			    i == 0 ? 0 : rp_port, B_TRUE, rt->rt_cpu);
+		} else {
+			if (s == -1)
+				s = rp_socket(SOCK_STREAM, 0, B_FALSE, -1);
+			rt->rt_sock = s;
+		}
+		if (rt->rt_sock == -1)
+			fatal("bind listener %u", i);
+	}
+	for (i = 0; i < rp_listeners; i++) {
+		if (pthread_create(&rp_accepters[i].rt_tid, NULL, rp_accepter,
+		    &rp_accepters[i]) != 0)
+			fatal("pthread_create");
+	}
+
+	(void) gettimeofday(&start, NULL);
+	for (i = 0; i < rp_clients; i++) {
+		rp_thread_t *rt = &rp_connecters[i];
+
+		rt->rt_cpu = rp_affine ? rp_cpus[i % rp_ncpus] : -1;
+		rt->rt_count = 0;
+		if (pthread_create(&rt->rt_tid, NULL, rp_connecter, rt) != 0)
+			fatal("pthread_create");
+	}
+	(void) sleep(rp_seconds);
+	rp_stop = B_TRUE;
+	for (i = 0; i < rp_clients; i++) {
+		(void) pthread_join(rp_connecters[i].rt_tid, NULL);
+		connected += rp_connecters[i].rt_count;
+	}
+	(void) gettimeofday(&end, NULL);
+	for (i = 0; i < rp_listeners; i++) {
+		(void) pthread_join(rp_accepters[i].rt_tid, NULL);
+		accepted += rp_accepters[i].rt_count;
+		if (reuseport || i == 0)
+			(void) close(rp_accepters[i].rt_sock);
+	}
+
+	secs = (end.tv_sec - start.tv_sec) +
+	    (end.tv_usec - start.tv_usec) / 1000000.0;
+	(void) printf("%-10s %10.0f conn/s %10.0f accept/s", name,
+	    connected / secs, accepted / secs);
+	if (reuseport) {
+		(void) printf("  (");
+		for (i = 0; i < rp_listeners; i++) {
+			(void) printf("%s%llu", i == 0 ? "" : " ",
+			    (u_longlong_t)rp_accepters[i].rt_count);
+			if (rp_accepters[i].rt_count == 0 && !rp_affine)
+				idle++;
+		}
+		(void) printf(")");
+	}
+	(void) printf("\n");
+	return (idle);
+}
+
+/*
+ * Sockets with SO_REUSEPORT share a port; others are refused.
+ */
+static int
+rp_check_bind(int type, const char *name)
+{
+	int s1, s2, s3;
+	int ret = 0;
+
+	if ((s1 = rp_socket(type, 0, B_TRUE, -1)) == -1)
+		fatal("%s: bind", name);
+	if ((s2 = rp_socket(type, rp_port, B_TRUE, -1)) == -1) {
+		(void) fprintf(stderr, "%s: second SO_REUSEPORT bind "
+		    "failed: %s\n", name, strerror(errno));
+		ret = 1;
+	}
+	errno = 0;
+	if ((s3 = rp_socket(type, rp_port, B_FALSE, -1)) != -1 ||
+	    errno != EADDRINUSE) {
+		(void) fprintf(stderr, "%s: bind without SO_REUSEPORT "
+		    "didn't fail with EADDRINUSE: %s\n", name,
+		    strerror(errno));
+		ret = 1;
+	}
+	(void) close(s1);
+	if (s2 != -1)
+		(void) close(s2);
+	if (s3 != -1)
+		(void) close(s3);
+	return (ret);
+}
+
+/*
+ * Datagrams from many flows reach every member of a UDP group.
+ */
+static int
+rp_check_udp(void)
+{
+	struct sockaddr_in sin;
+	char buf[16];
+	int r[2], s;
+	uint_t i, got[2] = { 0, 0 };
+
+	if ((r[0] = rp_socket(SOCK_DGRAM, 0, B_TRUE, -1)) == -1 ||
+	    (r[1] = rp_socket(SOCK_DGRAM, rp_port, B_TRUE, -1)) == -1)
+		fatal("udp: bind");
+	loopback(&sin, rp_port);
+	for (i = 0; i < RP_UDPSENDERS; i++) {
+		if ((s = socket(AF_INET, SOCK_DGRAM, 0)) == -1)
+			fatal("socket");
+		if (sendto(s, "x", 1, 0, (struct sockaddr *)&sin,
+		    sizeof (sin)) != 1)
+			fatal("sendto");
+		(void) close(s);
+	}
+	for (i = 0; i < 2; i++) {
+		while (recv(r[i], buf, sizeof (buf), MSG_DONTWAIT) > 0)
+			got[i]++;
+		(void) close(r[i]);
+	}
+	(void) printf("udp: %u + %u datagrams\n", got[0], got[1]);
+	if (got[0] + got[1] != RP_UDPSENDERS || got[0] == 0 || got[1] == 0) {
+		(void) fprintf(stderr, "udp: datagrams weren't spread over "
+		    "the group\n");
+		return (1);
+	}
+	return (0);
+}
+
+static void
+rp_find_cpus(void)
+{
+	processorid_t id;
+	long max = sysconf(_SC_CPUID_MAX);
+
+	for (id = 0; id <= max && rp_ncpus < RP_MAXTHREADS; id++) {
+		if (p_online(id, P_STATUS) == P_ONLINE)
+			rp_cpus[rp_ncpus++] = id;
+	}
+	if (rp_ncpus == 0)
+		fatal("no online CPU");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "al:c:d:")) != -1) {
+		switch (c) {
+		case 'a':
+			rp_affine = B_TRUE;
+			break;
+		case 'l':
+			rp_listeners = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			rp_clients = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			rp_seconds = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (rp_listeners == 0 || rp_listeners > RP_MAXTHREADS ||
+	    rp_clients == 0 || rp_clients > RP_MAXTHREADS || rp_seconds == 0)
+		usage();
+	if (rp_affine)
+		rp_find_cpus();
+
+	ret |= rp_check_bind(SOCK_STREAM, "tcp");
+	ret |= rp_check_bind(SOCK_DGRAM, "udp");
+	ret |= rp_check_udp();
+
+	(void) printf("%u accepting, %u connecting threads%s\n",
+	    rp_listeners, rp_clients, rp_affine ? ", bound to CPUs" : "");
+	(void) rp_run("shared", B_FALSE);
+	if (rp_run("reuseport", B_TRUE) != 0) {
+		(void) fprintf(stderr, "some listeners accepted no "
+		    "connection\n");
+		ret = 1;
+	}
+
+	if (ret == 0)
+		(void) printf("TEST PASSED\n");
+	return (ret);
+}
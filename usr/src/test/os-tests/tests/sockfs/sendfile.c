@@ -0,0 +1,427 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * sendfile(3EXT) over loopback TCP: check that a file arrives intact, at
+ * offsets aligned and not, and that a sendfilev(3EXT) vector running past
+ * the end of the file is followed by the next one; then measure the rate
+ * at which the file is sent
+ *
+ *	readwrite	read(2) into a buffer and write(2) that to the socket
+ *	sendfile	sendfile(3EXT) of the whole file
+ *
+ * The file is created in the directory given with -d, /var/tmp by default;
+ * point it at a ZFS file system to exercise sending loaned ARC buffers.
+ * The ZFS xuio_stats kstat, if there is one, shows how many buffers were
+ * sent without a copy.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/sysmacros.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <kstat.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+
+#define	SF_BUFSIZE	(128 * 1024)
+
+typedef enum {
+	SF_READWRITE,
+	SF_SENDFILE
+} sf_mode_t;
+
+static const char *sf_modes[] = { "readwrite", "sendfile" };
+
+static const char *sf_dir = "/var/tmp";
+static size_t sf_size = 64 * 1024 * 1024;
+static uint_t sf_rounds = 8;
+
+typedef struct sf_args {
+	int		sa_sock;
+	off_t		sa_off;		/* offset in the file of the stream */
+	uint64_t	sa_len;		/* bytes to receive */
+	boolean_t	sa_check;
+	uint64_t	sa_bad;
+} sf_args_t;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: sendfile [-d dir] [-r rounds] [-s megabytes]\n"
+	    "\n"
+	    "\t-d directory to create the file in (default %s)\n"
+	    "\t-r times the file is sent in each run (default %u)\n"
+	    "\t-s size of the file in megabytes (default %lu)\n",
+	    sf_dir, sf_rounds, sf_size / (1024 * 1024));
+	exit(2);
+}
+
+static void
+fatal(char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	(void) fflush(stdout);
+	va_start(args, message);
+	(void) fprintf(stderr, "sendfile: ");
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (save_errno != 0)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(1);
+}
+
+/*
+ * The byte at offset off in the file.
+ */
+static uchar_t
+sf_byte(uint64_t off)
+{
+	return ((uchar_t)(off ^ (off >> 12) ^ (off >> 20)));
+}
+
+static int
+sf_mkfile(char *path, size_t pathlen)
+{
+	static uchar_t buf[SF_BUFSIZE];
+	uint64_t off;
+	size_t i, n;
+	int fd;
+
+	(void) snprintf(path, pathlen, "%s/sendfile.%ld", sf_dir,
+	    (long)getpid());
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600)) == -1)
+		fatal("open %s", path);
+	for (off = 0; off < sf_size; off += n) {
+		n = MIN(sizeof (buf), sf_size - off);
+		for (i = 0; i < n; i++)
+			buf[i] = sf_byte(off + i);
+		if (write(fd, buf, n) != n)
+			fatal("write %s", path);
+	}
+	if (fsync(fd) == -1)
+		fatal("fsync %s", path);
+	return (fd);
+}
+
+/*
+ * Connect a pair of TCP sockets over loopback.
+ */
+static void
+sf_connect(int *sendp, int *recvp)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof (sin);
+	int l;
+
+	if ((l = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		fatal("socket");
+	bzero(&sin, sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(l, (struct sockaddr *)&sin, sizeof (sin)) == -1)
+		fatal("bind");
+	if (listen(l, 1) == -1)
+		fatal("listen");
+	if (getsockname(l, (struct sockaddr *)&sin, &len) == -1)
+		fatal("getsockname");
+	if ((*sendp = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+		fatal("socket");
+	if (connect(*sendp, (struct sockaddr *)&sin, sizeof (sin)) == -1)
+		fatal("connect");
+	if ((*recvp = accept(l, NULL, NULL)) == -1)
+		fatal("accept");
+	(void) close(l);
+}
+
+static void *
+sf_receiver(void *arg)
+{
+	sf_args_t *sa = arg;
+	static uchar_t buf[SF_BUFSIZE];
+	uint64_t got = 0, off;
+	ssize_t n, i;
+
+	off = sa->sa_off;
+	while (got < sa->sa_len) {
+		n = read(sa->sa_sock, buf,
+		    MIN(sizeof (buf), sa->sa_len - got));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			fatal("read from socket");
+		if (sa->sa_check) {
+			for (i = 0; i < n; i++) {
+				if (buf[i] != sf_byte(off + i))
+					sa->sa_bad++;
+			}
+		}
+		off = (off + n) % sf_size;
+		got += n;
+	}
+	return (NULL);
+}
+
+static void
+sf_send(sf_mode_t mode, int fd, int sock, off_t off, size_t len)
+{
+	static uchar_t buf[SF_BUFSIZE];
+	ssize_t n;
+
+	while (len > 0) {
+		if (mode == SF_SENDFILE) {
+			n = sendfile(sock, fd, &off, len);
+			if (n == -1 && errno != EINTR && errno != EAGAIN)
+				fatal("sendfile");
+		} else {
+			n = pread(fd, buf, MIN(sizeof (buf), len), off);
+			if (n <= 0)
+				fatal("pread");
+			if (write(sock, buf, n) != n)
+				fatal("write to socket");
+			off += n;
+		}
+		if (n > 0)
+			len -= n;
+	}
+}
+
+/*
+ * Send len bytes from off, rounds times; with check, the receiver verifies
+ * what it gets.  Returns the rate in MB/s.
+ */
+static double
+sf_run(sf_mode_t mode, int fd, off_t off, size_t len, uint_t rounds,
+    boolean_t check, uint64_t *badp)
+{
+	sf_args_t sa;
+	pthread_t tid;
+	hrtime_t start, elapsed;
+	int s, r;
+	uint_t i;
+
+	sf_connect(&s, &r);
+	bzero(&sa, sizeof (sa));
+	sa.sa_sock = r;
+	sa.sa_off = off;
+	sa.sa_len = (uint64_t)len * rounds;
+	sa.sa_check = check;
+
+	start = gethrtime();
+	if (pthread_create(&tid, NULL, sf_receiver, &sa) != 0)
+		fatal("pthread_create");
+	for (i = 0; i < rounds; i++)
+		sf_send(mode, fd, s, off, len);
+	(void) pthread_join(tid, NULL);
+	elapsed = gethrtime() - start;
+
+	(void) close(s);
+	(void) close(r);
+	if (badp != NULL)
+		*badp = sa.sa_bad;
+	return ((double)sa.sa_len / (1024 * 1024) /
+	    ((double)elapsed / NANOSEC));
+}
+
+static boolean_t
+sf_xuio_nocopy(kstat_ctl_t *kc, uint64_t *valp)
+{
+	kstat_named_t *kn;
+	kstat_t *ksp;
+
+	if (kc == NULL ||
+	    (ksp = kstat_lookup(kc, "zfs", 0, "xuio_stats")) == NULL ||
+	    kstat_read(kc, ksp, NULL) == -1 ||
+	    (kn = kstat_data_lookup(ksp, "read_buf_nocopy")) == NULL)
+		return (B_FALSE);
+	*valp = kn->value.ui64;
+	return (B_TRUE);
+}
+
+/*
+ * Pieces of the file to check: all of it, and some that start and end off
+ * block and page boundaries.
+ */
+static int
+sf_check(int fd)
+{
+	static const struct {
+		off_t	off;
+		size_t	len;
+	} pieces[] = {
+		{ 0, 0 },
+		{ 1, 1 },
+		{ 4095, 300000 },
+		{ 131072, 131072 },
+		{ 131071, 1048577 },
+	};
+	uint64_t bad;
+	sf_mode_t mode;
+	int ret = 0;
+	uint_t i;
+
+	for (mode = SF_READWRITE; mode <= SF_SENDFILE; mode++) {
+		for (i = 0; i < sizeof (pieces) / sizeof (pieces[0]); i++) {
+			off_t off = pieces[i].off;
+			size_t len = pieces[i].len;
+
+			if (len == 0)
+				len = sf_size;
+			if (off + len > sf_size)
+				continue;
+			(void) sf_run(mode, fd, off, len, 1, B_TRUE, &bad);
+			if (bad != 0) {
+				(void) printf("FAIL: %s of %lu bytes at %ld: "
+				    "%llu bytes wrong\n", sf_modes[mode], len,
+				    (long)off, (u_longlong_t)bad);
+				ret = 1;
+			}
+		}
+	}
+	return (ret);
+}
+
+/*
+ * A file vector which runs past the end of the file, followed by one from
+ * memory: the file is sent up to its end, then the trailer.
+ */
+static int
+sf_vec_check(int fd)
+{
+	static const char trailer[] = "sendfilev trailer";
+	static uchar_t buf[8192];
+	sendfilevec_t vec[2];
+	size_t xferred, got, tail, i;
+	ssize_t n;
+	off_t off;
+	int s, r, ret = 0;
+
+	tail = MIN(sf_size, 1000);
+	off = sf_size - tail;
+
+	sf_connect(&s, &r);
+	vec[0].sfv_fd = fd;
+	vec[0].sfv_flag = 0;
+	vec[0].sfv_off = off;
+	vec[0].sfv_len = tail + 4096;
+	vec[1].sfv_fd = SFV_FD_SELF;
+	vec[1].sfv_flag = 0;
+	vec[1].sfv_off = (off_t)(uintptr_t)trailer;
+	vec[1].sfv_len = sizeof (trailer);
+	if (sendfilev(s, vec, 2, &xferred) == -1)
+		fatal("sendfilev");
+	(void) close(s);
+
+	for (got = 0; got < sizeof (buf); got += n) {
+		n = read(r, buf + got, sizeof (buf) - got);
+		if (n == -1 && errno == EINTR) {
+			n = 0;
+			continue;
+		}
+		if (n == -1)
+			fatal("read from socket");
+		if (n == 0)
+			break;
+	}
+	(void) close(r);
+
+	if (xferred != tail + sizeof (trailer) ||
+	    got != tail + sizeof (trailer)) {
+		(void) printf("FAIL: sendfilev past EOF: sent %zu, "
+		    "received %zu, expected %zu bytes\n", xferred, got,
+		    tail + sizeof (trailer));
+		ret = 1;
+	} else {
+		for (i = 0; i < tail; i++) {
+			if (buf[i] != sf_byte(off + i))
+				break;
+		}
+		if (i != tail || bcmp(buf + tail, trailer,
+		    sizeof (trailer)) != 0) {
+			(void) printf("FAIL: sendfilev past EOF: "
+			    "wrong data\n");
+			ret = 1;
+		}
+	}
+	return (ret);
+}
+
+int
+main(int argc, char *argv[])
+{
+	char path[MAXPATHLEN];
+	kstat_ctl_t *kc;
+	uint64_t before, after;
+	boolean_t havestats;
+	sf_mode_t mode;
+	double rate;
+	int c, fd, ret;
+
+	while ((c = getopt(argc, argv, "d:r:s:")) != -1) {
+		switch (c) {
+		case 'd':
+			sf_dir = optarg;
+			break;
+		case 'r':
+			sf_rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			sf_size = strtoul(optarg, NULL, 0) * 1024 * 1024;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || sf_rounds == 0 || sf_size == 0)
+		usage();
+
+	fd = sf_mkfile(path, sizeof (path));
+	kc = kstat_open();
+
+	ret = sf_check(fd);
+	ret |= sf_vec_check(fd);
+
+	(void) printf("%lu MB file in %s, sent %u times\n",
+	    sf_size / (1024 * 1024), sf_dir, sf_rounds);
+	for (mode = SF_READWRITE; mode <= SF_SENDFILE; mode++) {
+		havestats = sf_xuio_nocopy(kc, &before);
+		rate = sf_run(mode, fd, 0, sf_size, sf_rounds, B_FALSE, NULL);
+		(void) printf("%-10s %8.1f MB/s", sf_modes[mode], rate);
+		if (havestats && sf_xuio_nocopy(kc, &after)) {
+			(void) printf(", %llu ARC buffers sent uncopied",
+			    (u_longlong_t)(after - before));
+		}
+		(void) printf("\n");
+	}
+
+	if (kc != NULL)
+		(void) kstat_close(kc);
+	(void) close(fd);
+	(void) unlink(path);
+	if (ret == 0)
+		(void) printf("TEST PASSED\n");
+	return (ret);
+}
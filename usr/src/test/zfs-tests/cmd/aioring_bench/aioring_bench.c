@@ -0,0 +1,393 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Compare the rate at which 4k random reads of a file can be issued and
+ * reaped with lio_listio(3C) and with an aio ring (aioring_setup(3C)).
+ * Each method keeps the requested number of reads outstanding:
+ *
+ *	lio_listio	a batch of reads is submitted with LIO_NOWAIT and
+ *			reaped with aio_waitn(3C) before the next batch
+ *	aioring		reads are queued on the SQ, submitted with a single
+ *			aioring_enter() that also waits for the completions
+ *	aioring-sqpoll	the SQ is kept full and the CQ is polled; system
+ *			calls are only made when the workers have gone idle
+ *
+ * The file is created (by default in /tmp, on tmpfs) and filled in first;
+ * run with -f pointing into a ZFS file system to compare the two there.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/sysmacros.h>
+#include <sys/aio_ring.h>
+#include <aio.h>
+#include <atomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#define	BENCH_IOSIZE	4096
+
+static char *bench_file = "/tmp/aioring_bench.dat";
+static uint64_t bench_size = 256ULL << 20;
+static uint_t bench_depth = 32;
+static uint_t bench_workers = 4;
+static uint_t bench_seconds = 5;
+static boolean_t bench_keep = B_FALSE;
+
+static int bench_fd;
+static char *bench_bufs;
+static uint64_t bench_seed = 0x2545F4914F6CDD1DULL;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: aioring_bench [-k] [-f file] [-s size] [-q depth]\n"
+	    "\t[-w workers] [-d seconds]\n"
+	    "\n"
+	    "\t-k keep the file afterwards\n"
+	    "\t-f file to read (default %s)\n"
+	    "\t-s size of that file (default %llu)\n"
+	    "\t-q number of reads to keep outstanding (default %u)\n"
+	    "\t-w number of ring worker threads (default %u)\n"
+	    "\t-d duration of each run in seconds (default %u)\n",
+	    bench_file, (u_longlong_t)bench_size, bench_depth, bench_workers,
+	    bench_seconds);
+	exit(2);
+}
+
+static void
+fatal(int do_perror, char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	(void) fflush(stdout);
+	(void) fprintf(stderr, "aioring_bench: ");
+	va_start(args, message);
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (do_perror)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(3);
+}
+
+/*
+ * A random 4k aligned offset within the file.
+ */
+static off_t
+bench_offset(void)
+{
+	bench_seed ^= bench_seed >> 12;
+	bench_seed ^= bench_seed << 25;
+	bench_seed ^= bench_seed >> 27;
+	return ((off_t)((bench_seed * 0x2545F4914F6CDD1DULL) %
+	    (bench_size / BENCH_IOSIZE)) * BENCH_IOSIZE);
+}
+
+static void
+bench_create(void)
+{
+	char *buf;
+	uint64_t off;
+
+	bench_fd = open(bench_file, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (bench_fd == -1)
+		fatal(1, "can't open %s", bench_file);
+
+	buf = malloc(1 << 20);
+	if (buf == NULL)
+		fatal(1, "malloc");
+	for (off = 0; off < bench_size; off += 1 << 20) {
+		(void) memset(buf, (int)(off >> 20), 1 << 20);
+		if (pwrite(bench_fd, buf, MIN(1 << 20, bench_size - off),
+		    off) == -1)
+			fatal(1, "can't write %s", bench_file);
+	}
+	if (fsync(bench_fd) != 0)
+		fatal(1, "can't fsync %s", bench_file);
+	free(buf);
+}
+
+static uint64_t
+bench_lio(hrtime_t end)
+{
+	aiocb_t *cbs, **list;
+	uint64_t ops = 0;
+	uint_t i, n;
+
+	cbs = calloc(bench_depth, sizeof (aiocb_t));
+	list = calloc(bench_depth, sizeof (aiocb_t *));
+	if (cbs == NULL || list == NULL)
+		fatal(1, "calloc");
+
+	while (gethrtime() < end) {
+		for (i = 0; i < bench_depth; i++) {
+			cbs[i].aio_fildes = bench_fd;
+			cbs[i].aio_buf = bench_bufs + i * BENCH_IOSIZE;
+			cbs[i].aio_nbytes = BENCH_IOSIZE;
+			cbs[i].aio_offset = bench_offset();
+			cbs[i].aio_lio_opcode = LIO_READ;
+			list[i] = &cbs[i];
+		}
+		if (lio_listio(LIO_NOWAIT, list, bench_depth, NULL) != 0)
+			fatal(1, "lio_listio");
+		for (i = 0; i < bench_depth; i += n) {
+			n = bench_depth - i;
+			if (aio_waitn(list, n, &n, NULL) != 0 &&
+			    errno != EINTR)
+				fatal(1, "aio_waitn");
+		}
+		for (i = 0; i < bench_depth; i++) {
+			if (aio_return(&cbs[i]) != BENCH_IOSIZE)
+				fatal(1, "lio_listio read");
+		}
+		ops += bench_depth;
+	}
+
+	free(list);
+	free(cbs);
+	return (ops);
+}
+
+typedef struct bench_ring {
+	int		br_id;
+	aioring_params_t br_params;
+	aioring_hdr_t	*br_hdr;
+	aioring_sqe_t	*br_sq;
+	aioring_cqe_t	*br_cq;
+	uint32_t	br_sq_tail;
+	uint32_t	br_cq_head;
+} bench_ring_t;
+
+static void
+bench_ring_setup(bench_ring_t *br, uint32_t flags)
+{
+	caddr_t addr;
+
+	bzero(br, sizeof (*br));
+	br->br_params.arp_entries = bench_depth;
+	br->br_params.arp_flags = flags;
+	br->br_params.arp_workers = bench_workers;
+	br->br_params.arp_port = -1;
+	if ((br->br_id = aioring_setup(&br->br_params)) == -1)
+		fatal(1, "aioring_setup");
+
+	addr = (caddr_t)(uintptr_t)br->br_params.arp_addr;
+	br->br_hdr = (aioring_hdr_t *)addr;
+	br->br_sq = (aioring_sqe_t *)(addr + br->br_params.arp_sq_off);
+	br->br_cq = (aioring_cqe_t *)(addr + br->br_params.arp_cq_off);
+}
+
+/*
+ * Queue a read into buffer slot i; it is submitted when the tail is
+ * published by bench_ring_publish().
+ */
+static void
+bench_ring_queue(bench_ring_t *br, uint_t i)
+{
+	aioring_sqe_t *sqe;
+
+	sqe = &br->br_sq[br->br_sq_tail++ &
+	    (br->br_params.arp_entries - 1)];
+	bzero(sqe, sizeof (*sqe));
+	sqe->sqe_opcode = AIORING_OP_READ;
+	sqe->sqe_fd = bench_fd;
+	sqe->sqe_off = bench_offset();
+	sqe->sqe_addr = (uint64_t)(uintptr_t)bench_bufs + i * BENCH_IOSIZE;
+	sqe->sqe_len = BENCH_IOSIZE;
+	sqe->sqe_user = i;
+}
+
+static void
+bench_ring_publish(bench_ring_t *br)
+{
+	membar_producer();
+	br->br_hdr->arh_sq_tail = br->br_sq_tail;
+}
+
+/*
+ * Reap whatever completions have been posted, calling back for each.
+ */
+static uint_t
+bench_ring_reap(bench_ring_t *br, void (*func)(bench_ring_t *, uint_t))
+{
+	aioring_cqe_t *cqe;
+	uint32_t tail = br->br_hdr->arh_cq_tail;
+	uint_t n = 0;
+
+	membar_consumer();
+	while (br->br_cq_head != tail) {
+		cqe = &br->br_cq[br->br_cq_head++ &
+		    (br->br_params.arp_cq_entries - 1)];
+		if (cqe->cqe_error != 0) {
+			errno = cqe->cqe_error;
+			fatal(1, "aioring read");
+		}
+		if (cqe->cqe_res != BENCH_IOSIZE)
+			fatal(0, "aioring read: short read");
+		if (func != NULL)
+			func(br, (uint_t)cqe->cqe_user);
+		n++;
+	}
+	membar_exit();
+	br->br_hdr->arh_cq_head = br->br_cq_head;
+	return (n);
+}
+
+static uint64_t
+bench_ring(hrtime_t end)
+{
+	bench_ring_t br;
+	uint64_t ops = 0;
+	uint_t i, n;
+
+	bench_ring_setup(&br, 0);
+
+	while (gethrtime() < end) {
+		for (i = 0; i < bench_depth; i++)
+			bench_ring_queue(&br, i);
+		bench_ring_publish(&br);
+		if (aioring_enter(br.br_id, bench_depth, bench_depth,
+		    AIORING_ENTER_GETEVENTS, NULL) == -1 && errno != EINTR)
+			fatal(1, "aioring_enter");
+		for (n = 0; n < bench_depth; )
+			n += bench_ring_reap(&br, NULL);
+		ops += bench_depth;
+	}
+
+	if (aioring_destroy(br.br_id) != 0)
+		fatal(1, "aioring_destroy");
+	return (ops);
+}
+
+static void
+bench_ring_requeue(bench_ring_t *br, uint_t i)
+{
+	bench_ring_queue(br, i);
+}
+
+static uint64_t
+bench_ring_sqpoll(hrtime_t end)
+{
+	bench_ring_t br;
+	uint64_t ops = 0;
+	uint_t i, n, out;
+
+	bench_ring_setup(&br, AIORING_SETUP_SQPOLL);
+
+	for (i = 0; i < bench_depth; i++)
+		bench_ring_queue(&br, i);
+	out = bench_depth;
+
+	while (out > 0) {
+		boolean_t more = gethrtime() < end;
+
+		bench_ring_publish(&br);
+		membar_enter();
+		if (br.br_hdr->arh_flags & AIORING_HDR_NEED_WAKEUP) {
+			if (aioring_enter(br.br_id, bench_depth, 0, 0,
+			    NULL) == -1 && errno != EINTR)
+				fatal(1, "aioring_enter");
+		}
+		n = bench_ring_reap(&br, more ? bench_ring_requeue : NULL);
+		ops += n;
+		if (!more)
+			out -= n;
+	}
+
+	if (aioring_destroy(br.br_id) != 0)
+		fatal(1, "aioring_destroy");
+	return (ops);
+}
+
+static void
+bench_run(const char *name, uint64_t (*func)(hrtime_t))
+{
+	hrtime_t start, elapsed;
+	uint64_t ops;
+
+	start = gethrtime();
+	ops = func(start + (hrtime_t)bench_seconds * NANOSEC);
+	elapsed = MAX(gethrtime() - start, 1);
+
+	(void) printf("%-16s %12llu %10.1f %10.2f\n", name,
+	    (u_longlong_t)(ops * NANOSEC / elapsed),
+	    (double)ops * BENCH_IOSIZE * NANOSEC / elapsed / (1 << 20),
+	    ops == 0 ? 0.0 : (double)elapsed * bench_depth / ops / 1000);
+}
+
+int
+main(int argc, char **argv)
+{
+	int c;
+
+	while ((c = getopt(argc, argv, "kf:s:q:w:d:")) != -1) {
+		switch (c) {
+		case 'k':
+			bench_keep = B_TRUE;
+			break;
+		case 'f':
+			bench_file = optarg;
+			break;
+		case 's':
+			bench_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'q':
+			bench_depth = atoi(optarg);
+			break;
+		case 'w':
+			bench_workers = atoi(optarg);
+			break;
+		case 'd':
+			bench_seconds = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (bench_size < BENCH_IOSIZE || bench_depth == 0 ||
+	    bench_depth > AIORING_MAX_ENTRIES || bench_seconds == 0)
+		usage();
+
+	/*
+	 * Ring sizes are powers of two; keep as many reads outstanding.
+	 */
+	if (!ISP2(bench_depth))
+		fatal(0, "queue depth must be a power of two");
+
+	bench_bufs = memalign(BENCH_IOSIZE, (size_t)bench_depth *
+	    BENCH_IOSIZE);
+	if (bench_bufs == NULL)
+		fatal(1, "memalign");
+
+	bench_create();
+
+	(void) printf("%-16s %12s %10s %10s\n",
+	    "method", "reads/s", "MB/s", "usec/read");
+	bench_run("lio_listio", bench_lio);
+	bench_run("aioring", bench_ring);
+	bench_run("aioring-sqpoll", bench_ring_sqpoll);
+
+	(void) close(bench_fd);
+	if (!bench_keep)
+		(void) unlink(bench_file);
+
+	return (0);
+}
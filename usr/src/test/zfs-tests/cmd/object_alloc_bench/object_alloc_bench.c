@@ -0,0 +1,252 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright (c) 2018 by Delphix. All rights reserved.
+ */
+
+/*
+ * Measure the rate at which dmu_object_alloc() can create objects in a
+ * single objset, with 1, 2, 4, ... up to the requested number of threads
+ * each creating one object per transaction.  This runs against a file
+ * backed pool created with libzpool.  After each run the objset's dnodes
+ * are walked to report how densely all of the objects created so far have
+ * been packed into dnode blocks.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/spa.h>
+#include <sys/dmu.h>
+#include <sys/dmu_objset.h>
+#include <sys/dmu_tx.h>
+#include <sys/dnode.h>
+#include <sys/txg.h>
+#include <sys/fs/zfs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <thread.h>
+
+static objset_t *bench_os;
+static volatile boolean_t bench_stop;
+
+static uint_t bench_maxthreads;
+static uint_t bench_seconds = 5;
+static char *bench_pool = "object_alloc_bench";
+static char *bench_vdev = "/var/tmp/object_alloc_bench.vdev";
+static uint64_t bench_vdev_size = 1ULL << 30;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: object_alloc_bench [-t threads] [-d seconds] [-p pool]\n"
+	    "\t[-f file] [-s size]\n"
+	    "\n"
+	    "\t-t maximum number of threads (default: number of CPUs)\n"
+	    "\t-d duration of each run in seconds (default %u)\n"
+	    "\t-p name of the pool to create (default %s)\n"
+	    "\t-f file to create the pool on (default %s)\n"
+	    "\t-s size of that file (default %llu)\n",
+	    bench_seconds, bench_pool, bench_vdev,
+	    (u_longlong_t)bench_vdev_size);
+	exit(2);
+}
+
+static void
+fatal(int do_perror, char *message, ...)
+{
+	va_list args;
+	int save_errno = errno;
+
+	(void) fflush(stdout);
+	(void) fprintf(stderr, "object_alloc_bench: ");
+	va_start(args, message);
+	(void) vfprintf(stderr, message, args);
+	va_end(args);
+	if (do_perror)
+		(void) fprintf(stderr, ": %s", strerror(save_errno));
+	(void) fprintf(stderr, "\n");
+	exit(3);
+}
+
+static void *
+bench_thread(void *arg)
+{
+	uint64_t *count = arg;
+
+	while (!bench_stop) {
+		dmu_tx_t *tx = dmu_tx_create(bench_os);
+		int error;
+
+		dmu_tx_hold_bonus(tx, DMU_NEW_OBJECT);
+		error = dmu_tx_assign(tx, TXG_WAIT);
+		if (error != 0) {
+			dmu_tx_abort(tx);
+			errno = error;
+			fatal(1, "dmu_tx_assign");
+		}
+		(void) dmu_object_alloc(bench_os, DMU_OT_UINT64_OTHER, 0,
+		    DMU_OT_NONE, 0, tx);
+		dmu_tx_commit(tx);
+		(*count)++;
+	}
+	return (NULL);
+}
+
+/*
+ * Count the allocated objects and the dnode blocks that hold them.
+ */
+static void
+bench_density(uint64_t *objects, uint64_t *blocks)
+{
+	uint64_t object = 0;
+	uint64_t lastblk = UINT64_MAX;
+
+	*objects = 0;
+	*blocks = 0;
+	while (dmu_object_next(bench_os, &object, B_FALSE, 0) == 0) {
+		(*objects)++;
+		if (object / DNODES_PER_BLOCK != lastblk) {
+			lastblk = object / DNODES_PER_BLOCK;
+			(*blocks)++;
+		}
+	}
+}
+
+static uint64_t
+bench_run(uint_t nthreads)
+{
+	thread_t *tid;
+	uint64_t *counts;
+	uint64_t total = 0;
+	hrtime_t start, elapsed;
+
+	tid = umem_zalloc(nthreads * sizeof (thread_t), UMEM_NOFAIL);
+	counts = umem_zalloc(nthreads * sizeof (uint64_t), UMEM_NOFAIL);
+
+	bench_stop = B_FALSE;
+	start = gethrtime();
+	for (uint_t t = 0; t < nthreads; t++) {
+		VERIFY0(thr_create(0, 0, bench_thread, &counts[t],
+		    THR_BOUND, &tid[t]));
+	}
+	(void) sleep(bench_seconds);
+	bench_stop = B_TRUE;
+	for (uint_t t = 0; t < nthreads; t++) {
+		VERIFY0(thr_join(tid[t], NULL, NULL));
+		total += counts[t];
+	}
+	elapsed = gethrtime() - start;
+
+	umem_free(counts, nthreads * sizeof (uint64_t));
+	umem_free(tid, nthreads * sizeof (thread_t));
+
+	txg_wait_synced(dmu_objset_pool(bench_os), 0);
+
+	return (total * NANOSEC / MAX(elapsed, 1));
+}
+
+int
+main(int argc, char **argv)
+{
+	nvlist_t *nvroot, *file;
+	char dsname[ZFS_MAX_DATASET_NAME_LEN];
+	uint64_t base = 0;
+	int c, fd, error;
+
+	bench_maxthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	while ((c = getopt(argc, argv, "t:d:p:f:s:")) != -1) {
+		switch (c) {
+		case 't':
+			bench_maxthreads = atoi(optarg);
+			break;
+		case 'd':
+			bench_seconds = atoi(optarg);
+			break;
+		case 'p':
+			bench_pool = optarg;
+			break;
+		case 'f':
+			bench_vdev = optarg;
+			break;
+		case 's':
+			bench_vdev_size = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (bench_maxthreads == 0 || bench_seconds == 0)
+		usage();
+
+	fd = open(bench_vdev, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1)
+		fatal(1, "can't open %s", bench_vdev);
+	if (ftruncate(fd, bench_vdev_size) != 0)
+		fatal(1, "can't ftruncate %s", bench_vdev);
+	(void) close(fd);
+
+	kernel_init(FREAD | FWRITE);
+
+	VERIFY0(nvlist_alloc(&file, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(file, ZPOOL_CONFIG_TYPE, VDEV_TYPE_FILE));
+	VERIFY0(nvlist_add_string(file, ZPOOL_CONFIG_PATH, bench_vdev));
+	VERIFY0(nvlist_alloc(&nvroot, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(nvroot, ZPOOL_CONFIG_TYPE, VDEV_TYPE_ROOT));
+	VERIFY0(nvlist_add_nvlist_array(nvroot, ZPOOL_CONFIG_CHILDREN,
+	    &file, 1));
+	nvlist_free(file);
+
+	error = spa_create(bench_pool, nvroot, NULL, NULL);
+	nvlist_free(nvroot);
+	if (error != 0) {
+		errno = error;
+		fatal(1, "can't create pool %s", bench_pool);
+	}
+
+	(void) snprintf(dsname, sizeof (dsname), "%s/bench", bench_pool);
+	error = dmu_objset_create(dsname, DMU_OST_OTHER, 0, NULL, NULL);
+	if (error == 0) {
+		error = dmu_objset_own(dsname, DMU_OST_OTHER, B_FALSE,
+		    FTAG, &bench_os);
+	}
+	if (error != 0) {
+		errno = error;
+		fatal(1, "can't create dataset %s", dsname);
+	}
+
+	(void) printf("%8s %12s %8s %14s\n",
+	    "threads", "objects/s", "speedup", "objects/block");
+	for (uint_t t = 1; ; t = MIN(t * 2, bench_maxthreads)) {
+		uint64_t rate, objects, blocks;
+
+		rate = bench_run(t);
+		if (base == 0)
+			base = MAX(rate, 1);
+		bench_density(&objects, &blocks);
+		(void) printf("%8u %12llu %7.2fx %14.1f\n", t,
+		    (u_longlong_t)rate, (double)rate / base,
+		    blocks == 0 ? 0.0 : (double)objects / blocks);
+		if (t == bench_maxthreads)
+			break;
+	}
+
+	dmu_objset_disown(bench_os, FTAG);
+	VERIFY0(spa_destroy(bench_pool));
+	kernel_fini();
+	(void) unlink(bench_vdev);
+
+	return (0);
+}
@@ -0,0 +1,310 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Copyright (c) 2018 by Delphix. All rights reserved.
+ */
+
+/*
+ * Stress and measure the ZFS range lock (zfs_rlock.c) from userland.
+ *
+ * A number of threads lock regions of a single simulated file as readers,
+ * writers, appenders, or (to mimic growing the block size) whole file
+ * writers that are then reduced to one region.  While a lock is held, the
+ * thread marks every unit of its range in a shared ownership map and
+ * verifies that no conflicting lock holder has marked it too, so any
+ * failure of mutual exclusion aborts the run.  At the end the number of
+ * lock operations per second is reported.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/zfs_rlock.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <thread.h>
+
+#define	BENCH_UNIT_SHIFT	12	/* ownership is tracked per 4k */
+#define	BENCH_MAXTHREADS	1024
+
+typedef enum {
+	BENCH_READ,
+	BENCH_WRITE,
+	BENCH_APPEND,
+	BENCH_GROW,
+	BENCH_NOPS
+} bench_op_t;
+
+static const char *bench_op_names[BENCH_NOPS] = {
+	"read", "write", "append", "grow"
+};
+
+typedef struct bench_thread {
+	uint_t bt_id;
+	uint64_t bt_seed;
+	uint64_t bt_ops[BENCH_NOPS];
+} bench_thread_t;
+
+static rangelock_t bench_rangelock;
+static uint32_t *bench_writer;		/* per unit: writer thread id + 1 */
+static uint32_t *bench_readers;		/* per unit: number of readers */
+static uint64_t bench_units;
+static volatile uint64_t bench_eof;
+static volatile boolean_t bench_stop;
+
+static uint_t bench_threads = 64;
+static uint64_t bench_size = 128 * 1024;
+static uint_t bench_seconds = 10;
+static uint_t bench_read_pct = 0;
+static uint_t bench_append_pct = 0;
+static uint_t bench_grow_pct = 0;
+static boolean_t bench_overlap = B_FALSE;
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr,
+	    "Usage: rangelock_bench [-o] [-t threads] [-s size] [-d seconds]\n"
+	    "\t[-r read%%] [-a append%%] [-g grow%%]\n"
+	    "\n"
+	    "\t-t number of threads (default %u)\n"
+	    "\t-s size of the region each operation locks (default %llu)\n"
+	    "\t-d duration of the run in seconds (default %u)\n"
+	    "\t-r percentage of operations that are reads\n"
+	    "\t-a percentage of operations that are appends\n"
+	    "\t-g percentage of operations that lock the whole file and\n"
+	    "\t   reduce the lock, as when growing the block size\n"
+	    "\t-o threads pick random regions, rather than each thread\n"
+	    "\t   having its own region\n",
+	    bench_threads, (u_longlong_t)bench_size, bench_seconds);
+	exit(2);
+}
+
+static uint64_t
+bench_rand(bench_thread_t *bt)
+{
+	/* xorshift64 */
+	bt->bt_seed ^= bt->bt_seed << 13;
+	bt->bt_seed ^= bt->bt_seed >> 7;
+	bt->bt_seed ^= bt->bt_seed << 17;
+	return (bt->bt_seed);
+}
+
+/*
+ * Like zfs_rangelock_cb(), append at the (simulated) end of file.
+ */
+/*ARGSUSED*/
+static void
+bench_rangelock_cb(locked_range_t *new, void *arg)
+{
+	if (new->lr_type == RL_APPEND) {
+		new->lr_offset = bench_eof;
+		new->lr_type = RL_WRITER;
+	}
+}
+
+static void
+bench_mark(bench_thread_t *bt, uint64_t off, uint64_t len,
+    rangelock_type_t type)
+{
+	uint64_t first = off >> BENCH_UNIT_SHIFT;
+	uint64_t last = MIN((off + len - 1) >> BENCH_UNIT_SHIFT,
+	    bench_units - 1);
+
+	for (uint64_t u = first; u <= last; u++) {
+		if (type == RL_READER) {
+			atomic_inc_32(&bench_readers[u]);
+			VERIFY0(bench_writer[u]);
+		} else {
+			VERIFY0(atomic_cas_32(&bench_writer[u], 0,
+			    bt->bt_id + 1));
+			VERIFY0(bench_readers[u]);
+		}
+	}
+}
+
+static void
+bench_unmark(bench_thread_t *bt, uint64_t off, uint64_t len,
+    rangelock_type_t type)
+{
+	uint64_t first = off >> BENCH_UNIT_SHIFT;
+	uint64_t last = MIN((off + len - 1) >> BENCH_UNIT_SHIFT,
+	    bench_units - 1);
+
+	for (uint64_t u = first; u <= last; u++) {
+		if (type == RL_READER) {
+			VERIFY0(bench_writer[u]);
+			atomic_dec_32(&bench_readers[u]);
+		} else {
+			VERIFY3U(atomic_cas_32(&bench_writer[u],
+			    bt->bt_id + 1, 0), ==, bt->bt_id + 1);
+		}
+	}
+}
+
+static void *
+bench_thread(void *arg)
+{
+	bench_thread_t *bt = arg;
+	uint64_t filesize = bench_units << BENCH_UNIT_SHIFT;
+	uint64_t nregions = filesize / bench_size;
+	locked_range_t *lr = NULL;
+	uint64_t off;
+
+	while (!bench_stop) {
+		uint64_t pct = bench_rand(bt) % 100;
+		bench_op_t op;
+
+		if (bench_overlap)
+			off = (bench_rand(bt) % nregions) * bench_size;
+		else
+			off = bt->bt_id * bench_size;
+
+		if (pct < bench_read_pct)
+			op = BENCH_READ;
+		else if (pct < bench_read_pct + bench_append_pct)
+			op = BENCH_APPEND;
+		else if (pct < bench_read_pct + bench_append_pct +
+		    bench_grow_pct)
+			op = BENCH_GROW;
+		else
+			op = BENCH_WRITE;
+
+		switch (op) {
+		case BENCH_READ:
+			lr = rangelock_enter(&bench_rangelock, off,
+			    bench_size, RL_READER);
+			bench_mark(bt, off, bench_size, RL_READER);
+			bench_unmark(bt, off, bench_size, RL_READER);
+			break;
+		case BENCH_WRITE:
+			lr = rangelock_enter(&bench_rangelock, off,
+			    bench_size, RL_WRITER);
+			bench_mark(bt, off, bench_size, RL_WRITER);
+			bench_unmark(bt, off, bench_size, RL_WRITER);
+			break;
+		case BENCH_APPEND:
+			lr = rangelock_enter(&bench_rangelock, 0,
+			    bench_size, RL_APPEND);
+			/*
+			 * Nobody else can move the end of file while we
+			 * hold the range starting there.
+			 */
+			VERIFY3U(lr->lr_offset, ==, bench_eof);
+			bench_mark(bt, lr->lr_offset, bench_size, RL_WRITER);
+			bench_unmark(bt, lr->lr_offset, bench_size, RL_WRITER);
+			bench_eof = (bench_eof + bench_size) % filesize;
+			break;
+		case BENCH_GROW:
+			lr = rangelock_enter(&bench_rangelock, 0, UINT64_MAX,
+			    RL_WRITER);
+			bench_mark(bt, 0, filesize, RL_WRITER);
+			bench_unmark(bt, 0, filesize, RL_WRITER);
+			rangelock_reduce(lr, off, bench_size);
+			bench_mark(bt, off, bench_size, RL_WRITER);
+			bench_unmark(bt, off, bench_size, RL_WRITER);
+			break;
+		}
+		rangelock_exit(lr);
+		bt->bt_ops[op]++;
+	}
+	return (NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+	bench_thread_t *bt;
+	thread_t *tid;
+	uint64_t total[BENCH_NOPS] = { 0 };
+	uint64_t ops = 0;
+	hrtime_t start, elapsed;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:s:d:r:a:g:o")) != -1) {
+		switch (c) {
+		case 't':
+			bench_threads = atoi(optarg);
+			break;
+		case 's':
+			bench_size = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			bench_seconds = atoi(optarg);
+			break;
+		case 'r':
+			bench_read_pct = atoi(optarg);
+			break;
+		case 'a':
+			bench_append_pct = atoi(optarg);
+			break;
+		case 'g':
+			bench_grow_pct = atoi(optarg);
+			break;
+		case 'o':
+			bench_overlap = B_TRUE;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (bench_threads == 0 || bench_threads > BENCH_MAXTHREADS ||
+	    bench_size == 0 || (bench_size & ((1 << BENCH_UNIT_SHIFT) - 1)) ||
+	    bench_read_pct + bench_append_pct + bench_grow_pct > 100)
+		usage();
+
+	kernel_init(FREAD);
+
+	bench_units = (bench_threads * bench_size) >> BENCH_UNIT_SHIFT;
+	bench_writer = umem_zalloc(bench_units * sizeof (uint32_t),
+	    UMEM_NOFAIL);
+	bench_readers = umem_zalloc(bench_units * sizeof (uint32_t),
+	    UMEM_NOFAIL);
+	bt = umem_zalloc(bench_threads * sizeof (bench_thread_t), UMEM_NOFAIL);
+	tid = umem_zalloc(bench_threads * sizeof (thread_t), UMEM_NOFAIL);
+
+	rangelock_init(&bench_rangelock, bench_rangelock_cb, NULL);
+
+	start = gethrtime();
+	for (uint_t t = 0; t < bench_threads; t++) {
+		bt[t].bt_id = t;
+		bt[t].bt_seed = start + t + 1;
+		VERIFY0(thr_create(0, 0, bench_thread, &bt[t], THR_BOUND,
+		    &tid[t]));
+	}
+	(void) sleep(bench_seconds);
+	bench_stop = B_TRUE;
+	for (uint_t t = 0; t < bench_threads; t++)
+		VERIFY0(thr_join(tid[t], NULL, NULL));
+	elapsed = gethrtime() - start;
+
+	for (uint_t t = 0; t < bench_threads; t++) {
+		for (int op = 0; op < BENCH_NOPS; op++)
+			total[op] += bt[t].bt_ops[op];
+	}
+	for (int op = 0; op < BENCH_NOPS; op++) {
+		ops += total[op];
+		(void) printf("%-8s %12llu\n", bench_op_names[op],
+		    (u_longlong_t)total[op]);
+	}
+	(void) printf("%u threads, %llu byte ranges, %llu ops/sec\n",
+	    bench_threads, (u_longlong_t)bench_size,
+	    (u_longlong_t)(ops * NANOSEC / MAX(elapsed, 1)));
+
+	rangelock_fini(&bench_rangelock);
+	umem_free(tid, bench_threads * sizeof (thread_t));
+	umem_free(bt, bench_threads * sizeof (bench_thread_t));
+	umem_free(bench_readers, bench_units * sizeof (uint32_t));
+	umem_free(bench_writer, bench_units * sizeof (uint32_t));
+
+	kernel_fini();
+	return (0);
+}
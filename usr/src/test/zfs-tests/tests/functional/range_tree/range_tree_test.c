@@ -0,0 +1,454 @@
+/*
+ * This file and its contents are supplied under the terms of the
+ * Common Development and Distribution License ("CDDL"), version 1.0.
+ * You may only use this file in accordance with the terms of version
+ * 1.0 of the CDDL.
+ *
+ * A full copy of the text of the CDDL should have accompanied this
+ * source.  A copy of the CDDL is also available via the Internet at
+ * http://www.illumos.org/license/CDDL.
+ */
+
+/*
+ * Randomized test of the B-tree and of the range trees built on it.
+ *
+ * Each tree is put through a long series of random operations, and checked
+ * against a simple reference model as it goes: a byte per possible key for
+ * the B-tree, and a byte per unit of space for a range tree.  The B-tree
+ * is tested with elements of several sizes, since the size decides how many
+ * of them fit in a leaf, and the range trees are tested with both segment
+ * formats, with a size-sorted B-tree of the segments kept up to date by the
+ * range tree ops, as metaslabs do.
+ *
+ * Usage: range_tree_test [-n ops] [-s seed]
+ *
+ * The seed is printed, so that a failure can be replayed.
+ */
+
+#include <sys/zfs_context.h>
+#include <sys/btree.h>
+#include <sys/range_tree.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+extern int zfs_btree_verify_intensity;
+
+#define	BT_NKEYS	20000	/* keys in the B-tree's key space */
+#define	BT_MAXSIZE	64	/* largest element size tested */
+#define	RT_NUNITS	20000	/* units of space in a range tree */
+#define	CHECK_EVERY	1000	/* operations between full checks */
+
+static uint64_t rtt_seed;
+
+static uint64_t
+rtt_rand(void)
+{
+	rtt_seed ^= rtt_seed << 13;
+	rtt_seed ^= rtt_seed >> 7;
+	rtt_seed ^= rtt_seed << 17;
+	return (rtt_seed);
+}
+
+static int
+bt_compare(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x < y ? -1 : x > y ? 1 : 0);
+}
+
+/*
+ * Check the whole B-tree against the model, in both directions.
+ */
+static void
+bt_check(zfs_btree_t *bt, const uchar_t *ref, uint64_t count)
+{
+	zfs_btree_index_t where;
+	uint64_t *e, last = 0, n = 0;
+
+	zfs_btree_verify(bt);
+	VERIFY3U(zfs_btree_numnodes(bt), ==, count);
+
+	for (e = zfs_btree_first(bt, &where); e != NULL;
+	    e = zfs_btree_next(bt, &where, &where)) {
+		VERIFY(ref[*e]);
+		if (n++ != 0)
+			VERIFY3U(*e, >, last);
+		last = *e;
+	}
+	VERIFY3U(n, ==, count);
+
+	last = BT_NKEYS;
+	for (e = zfs_btree_last(bt, &where); e != NULL;
+	    e = zfs_btree_prev(bt, &where, &where)) {
+		do {
+			last--;
+		} while (!ref[last]);
+		VERIFY3U(*e, ==, last);
+		n--;
+	}
+	VERIFY0(n);
+}
+
+/*
+ * Check that the neighbours of a key which was looked up at 'where' are the
+ * ones the model has.
+ */
+static void
+bt_check_neighbours(zfs_btree_t *bt, const uchar_t *ref, uint64_t key,
+    boolean_t found, zfs_btree_index_t *where)
+{
+	zfs_btree_index_t idx;
+	uint64_t *e, next, prev;
+	boolean_t has_next = B_FALSE, has_prev = B_FALSE;
+
+	for (next = key + 1; next < BT_NKEYS; next++) {
+		if (ref[next]) {
+			has_next = B_TRUE;
+			break;
+		}
+	}
+	for (prev = key; prev-- > 0; ) {
+		if (ref[prev]) {
+			has_prev = B_TRUE;
+			break;
+		}
+	}
+
+	e = zfs_btree_next(bt, where, &idx);
+	VERIFY3U(e != NULL, ==, has_next);
+	if (e != NULL) {
+		VERIFY3U(*e, ==, next);
+		e = zfs_btree_prev(bt, &idx, &idx);
+		VERIFY3U(e != NULL, ==, found || has_prev);
+		if (e != NULL)
+			VERIFY3U(*e, ==, found ? key : prev);
+	}
+
+	e = zfs_btree_prev(bt, where, &idx);
+	VERIFY3U(e != NULL, ==, has_prev);
+	if (e != NULL)
+		VERIFY3U(*e, ==, prev);
+}
+
+/*
+ * Grow and shrink a B-tree of 'size'-byte elements at random, then fill it
+ * with every key in order and empty it again.
+ */
+static void
+bt_test(size_t size, uint64_t nops)
+{
+	zfs_btree_t bt;
+	zfs_btree_index_t where;
+	uchar_t *ref;
+	uint64_t elem[BT_MAXSIZE / sizeof (uint64_t)];
+	uint64_t op, key, count = 0;
+	boolean_t grow;
+	void *found;
+	int r;
+
+	ref = umem_zalloc(BT_NKEYS, UMEM_NOFAIL);
+	zfs_btree_create(&bt, bt_compare, size);
+
+	for (op = 0; op < nops; op++) {
+		key = rtt_rand() % BT_NKEYS;
+		r = rtt_rand() % 100;
+		bzero(elem, sizeof (elem));
+		elem[0] = key;
+		(void) memset(&elem[1], (int)key, size - sizeof (uint64_t));
+
+		found = zfs_btree_find(&bt, elem, &where);
+		VERIFY3U(found != NULL, ==, ref[key]);
+		if (found != NULL)
+			VERIFY0(memcmp(found, elem, size));
+
+		/* alternately mostly grow and mostly shrink the tree */
+		grow = (op / (nops / 4 + 1)) % 2 == 0;
+		if (found == NULL && r < (grow ? 70 : 30)) {
+			if (r & 1)
+				zfs_btree_add_idx(&bt, elem, &where);
+			else
+				zfs_btree_add(&bt, elem);
+			ref[key] = 1;
+			count++;
+		} else if (found != NULL && r < (grow ? 30 : 80)) {
+			if (r & 1)
+				zfs_btree_remove_idx(&bt, &where);
+			else
+				zfs_btree_remove(&bt, elem);
+			ref[key] = 0;
+			count--;
+		} else {
+			bt_check_neighbours(&bt, ref, key, found != NULL,
+			    &where);
+		}
+
+		VERIFY3U(zfs_btree_numnodes(&bt), ==, count);
+		if (op % CHECK_EVERY == 0)
+			bt_check(&bt, ref, count);
+	}
+	bt_check(&bt, ref, count);
+
+	zfs_btree_clear(&bt);
+	VERIFY0(zfs_btree_numnodes(&bt));
+	bzero(ref, BT_NKEYS);
+
+	bzero(elem, sizeof (elem));
+	for (key = 0; key < BT_NKEYS; key++) {
+		elem[0] = key;
+		zfs_btree_add(&bt, elem);
+		ref[key] = 1;
+	}
+	bt_check(&bt, ref, BT_NKEYS);
+
+	/* remove in an order which touches every leaf over and over */
+	for (key = 0; key < BT_NKEYS; key++) {
+		elem[0] = (key * 7919) % BT_NKEYS;
+		zfs_btree_remove(&bt, elem);
+		ref[elem[0]] = 0;
+		if (key % CHECK_EVERY == 0)
+			bt_check(&bt, ref, BT_NKEYS - key - 1);
+	}
+	bt_check(&bt, ref, 0);
+	VERIFY3P(bt.bt_root, ==, NULL);
+	VERIFY0(bt.bt_num_leaves);
+	VERIFY0(bt.bt_num_cores);
+
+	zfs_btree_destroy(&bt);
+	umem_free(ref, BT_NKEYS);
+}
+
+/*
+ * State of the range tree under test, and of its size-sorted mirror.
+ */
+typedef struct rtt {
+	range_tree_t	*rtt_rt;
+	zfs_btree_t	rtt_bysize;
+	uchar_t		*rtt_ref;	/* one byte per unit */
+	uint64_t	rtt_base;	/* offset of unit 0 */
+	uint64_t	rtt_shift;	/* log2 of the unit */
+	uint64_t	rtt_walked;
+} rtt_t;
+
+static rtt_t rtt;
+
+static int
+rtt_size_compare(const void *a, const void *b)
+{
+	range_tree_t *rt = rtt.rtt_rt;
+	uint64_t s1 = rs_get_size(a, rt);
+	uint64_t s2 = rs_get_size(b, rt);
+
+	if (s1 != s2)
+		return (s1 < s2 ? -1 : 1);
+	s1 = rs_get_start(a, rt);
+	s2 = rs_get_start(b, rt);
+	return (s1 < s2 ? -1 : s1 > s2 ? 1 : 0);
+}
+
+/* ARGSUSED */
+static void
+rtt_create(range_tree_t *rt, void *arg)
+{
+	rtt.rtt_rt = rt;
+	zfs_btree_create(&rtt.rtt_bysize, rtt_size_compare,
+	    rt->rt_root.bt_elem_size);
+}
+
+/* ARGSUSED */
+static void
+rtt_destroy(range_tree_t *rt, void *arg)
+{
+	zfs_btree_destroy(&rtt.rtt_bysize);
+}
+
+/* ARGSUSED */
+static void
+rtt_add(range_tree_t *rt, range_seg_t *rs, void *arg)
+{
+	zfs_btree_add(&rtt.rtt_bysize, rs);
+}
+
+/* ARGSUSED */
+static void
+rtt_remove(range_tree_t *rt, range_seg_t *rs, void *arg)
+{
+	zfs_btree_remove(&rtt.rtt_bysize, rs);
+}
+
+/* ARGSUSED */
+static void
+rtt_vacate(range_tree_t *rt, void *arg)
+{
+	zfs_btree_clear(&rtt.rtt_bysize);
+}
+
+static range_tree_ops_t rtt_ops = {
+	rtt_create,
+	rtt_destroy,
+	rtt_add,
+	rtt_remove,
+	rtt_vacate
+};
+
+/* ARGSUSED */
+static void
+rtt_walk(void *arg, uint64_t start, uint64_t size)
+{
+	uint64_t u;
+
+	for (u = (start - rtt.rtt_base) >> rtt.rtt_shift;
+	    u < (start + size - rtt.rtt_base) >> rtt.rtt_shift; u++)
+		VERIFY(rtt.rtt_ref[u]);
+	rtt.rtt_walked += size;
+}
+
+/*
+ * Check the whole range tree against the model.
+ */
+static void
+rtt_check(void)
+{
+	range_tree_t *rt = rtt.rtt_rt;
+	zfs_btree_index_t where;
+	range_seg_t *rs;
+	uint64_t u, space = 0, end = 0, min = RT_NUNITS;
+
+	zfs_btree_verify(&rt->rt_root);
+	zfs_btree_verify(&rtt.rtt_bysize);
+	VERIFY3U(zfs_btree_numnodes(&rtt.rtt_bysize), ==,
+	    range_tree_numsegs(rt));
+	range_tree_stat_verify(rt);
+
+	for (u = 0; u < RT_NUNITS; u++) {
+		if (rtt.rtt_ref[u]) {
+			space++;
+			min = MIN(min, u);
+		}
+	}
+	VERIFY3U(space << rtt.rtt_shift, ==, range_tree_space(rt));
+	if (space != 0) {
+		VERIFY3U(range_tree_min(rt), ==,
+		    rtt.rtt_base + (min << rtt.rtt_shift));
+	}
+
+	rtt.rtt_walked = 0;
+	range_tree_walk(rt, rtt_walk, NULL);
+	VERIFY3U(rtt.rtt_walked, ==, range_tree_space(rt));
+
+	/* adjacent segments must have been merged */
+	for (rs = zfs_btree_first(&rt->rt_root, &where); rs != NULL;
+	    rs = zfs_btree_next(&rt->rt_root, &where, &where)) {
+		if (end != 0)
+			VERIFY3U(rs_get_start(rs, rt), >, end);
+		end = rs_get_end(rs, rt);
+	}
+}
+
+/*
+ * Add, remove and clear random ranges of a range tree with segments of
+ * 'type', whose space starts at 'base' in units of 1 << 'shift'.
+ */
+static void
+rtt_test(range_seg_type_t type, uint64_t base, uint64_t shift, uint64_t nops)
+{
+	range_tree_t *rt;
+	uint64_t op, start, len, u, off, size;
+	boolean_t all_set, all_clear;
+	int r;
+
+	bzero(&rtt, sizeof (rtt));
+	rtt.rtt_ref = umem_zalloc(RT_NUNITS, UMEM_NOFAIL);
+	rtt.rtt_base = base;
+	rtt.rtt_shift = shift;
+	rt = range_tree_create_impl(&rtt_ops, type, NULL, base, shift);
+
+	for (op = 0; op < nops; op++) {
+		start = rtt_rand() % RT_NUNITS;
+		len = 1 + rtt_rand() % (rtt_rand() % 4 == 0 ? 64 : 4);
+		len = MIN(len, RT_NUNITS - start);
+
+		all_set = all_clear = B_TRUE;
+		for (u = start; u < start + len; u++) {
+			if (rtt.rtt_ref[u])
+				all_clear = B_FALSE;
+			else
+				all_set = B_FALSE;
+		}
+
+		off = base + (start << shift);
+		size = len << shift;
+		VERIFY3U(range_tree_contains(rt, off, size), ==, all_set);
+
+		r = rtt_rand() % 10;
+		if (r < 4 && all_clear) {
+			range_tree_add(rt, off, size);
+			(void) memset(rtt.rtt_ref + start, 1, len);
+		} else if (r < 7 && all_set) {
+			range_tree_remove(rt, off, size);
+			(void) memset(rtt.rtt_ref + start, 0, len);
+		} else if (r < 8) {
+			range_tree_clear(rt, off, size);
+			(void) memset(rtt.rtt_ref + start, 0, len);
+		} else if (r == 9 && rtt_rand() % 500 == 0) {
+			range_tree_vacate(rt, NULL, NULL);
+			bzero(rtt.rtt_ref, RT_NUNITS);
+		}
+
+		if (op % CHECK_EVERY == 0)
+			rtt_check();
+	}
+	rtt_check();
+
+	range_tree_vacate(rt, NULL, NULL);
+	range_tree_destroy(rt);
+	umem_free(rtt.rtt_ref, RT_NUNITS);
+}
+
+static void
+usage(void)
+{
+	(void) fprintf(stderr, "usage: range_tree_test [-n ops] [-s seed]\n");
+	exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const size_t sizes[] = { 8, 16, 24, BT_MAXSIZE };
+	uint64_t nops = 200000;
+	int c, i;
+
+	rtt_seed = (uint64_t)gethrtime() | 1;
+	while ((c = getopt(argc, argv, "n:s:")) != -1) {
+		switch (c) {
+		case 'n':
+			nops = strtoull(optarg, NULL, 0);
+			break;
+		case 's':
+			rtt_seed = strtoull(optarg, NULL, 0);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || rtt_seed == 0)
+		usage();
+	(void) printf("seed %llu\n", (u_longlong_t)rtt_seed);
+
+	kernel_init(FREAD);
+	zfs_btree_verify_intensity = 1;
+
+	for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+		bt_test(sizes[i], nops);
+
+	/* metaslab-style segments: 32-bit sector offsets from a base */
+	rtt_test(RANGE_SEG32, 1ULL << 40, 9, nops);
+	rtt_test(RANGE_SEG64, 0, 0, nops);
+
+	kernel_fini();
+	return (0);
+}
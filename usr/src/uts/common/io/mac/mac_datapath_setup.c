@@ -155,6 +155,15 @@ boolean_t mac_srs_thread_bind = B_TRUE;
 boolean_t mac_tx_intr_retarget = B_FALSE;
 boolean_t mac_rx_intr_retarget = B_FALSE;
 
+/*
+ * Number of slots in the TCP flow steering table of an Rx SRS created
+ * from now on, see mac_soft_ring_steer(), or 0 to not steer flows.  Each
+ * slot is a byte, and the table is only allocated once IP steers a flow
+ * of the SRS, so that the many SRSs which never see a steered flow don't
+ * pay for it.
+ */
+uint_t mac_srs_steer_size = MAC_SRS_STEER_SIZE;
+
 /*
  * If cpu bindings are specified by user, then Tx SRS and its soft
  * rings should also be bound to the CPUs specified by user. The
@@ -390,6 +399,8 @@ mac_srs_client_poll_enable(mac_client_impl_t *mcip,
 	mrf.mrf_receive = (mac_receive_t)mac_soft_ring_poll;
 	mrf.mrf_intr_enable = (mac_intr_enable_t)mac_soft_ring_intr_enable;
 	mrf.mrf_intr_disable = (mac_intr_disable_t)mac_soft_ring_intr_disable;
+	mrf.mrf_steer = mac_soft_ring_steer;
+	mrf.mrf_gro = mac_soft_ring_gro;
 	mac_srs->srs_type |= SRST_CLIENT_POLL_ENABLED;
 
 	softring = mac_srs->srs_soft_ring_head;
@@ -1197,6 +1208,7 @@ mac_srs_fanout_list_alloc(mac_soft_ring_set_t *mac_srs)
 		mac_srs->srs_tcp_soft_rings = (mac_soft_ring_t **)
 		    kmem_zalloc(sizeof (mac_soft_ring_t *) * MAX_SR_FANOUT,
 		    KM_SLEEP);
+		mac_srs->srs_tcp_steer_size = mac_srs_steer_size;
 		mac_srs->srs_udp_soft_rings = (mac_soft_ring_t **)
 		    kmem_zalloc(sizeof (mac_soft_ring_t *) * MAX_SR_FANOUT,
 		    KM_SLEEP);
@@ -1687,6 +1699,9 @@ mac_srs_update_fanout_list(mac_soft_ring_set_t *mac_srs)
 
 	ASSERT(mac_srs->srs_soft_ring_count ==
 	    (tcp_count + udp_count + oth_count + tx_count));
+	/* Flows steered to a soft ring follow the hash again */
+	if (mac_srs->srs_tcp_steer != NULL)
+		bzero(mac_srs->srs_tcp_steer, mac_srs->srs_tcp_steer_size);
 	mac_srs->srs_tcp_ring_count = tcp_count;
 	mac_srs->srs_udp_ring_count = udp_count;
 	mac_srs->srs_oth_ring_count = oth_count;
@@ -1709,6 +1724,8 @@ mac_srs_create_proto_softrings(int id, uint16_t type, pri_t pri,
 	    (mac_intr_enable_t)mac_soft_ring_intr_enable;
 	mrf.mrf_intr_disable =
 	    (mac_intr_disable_t)mac_soft_ring_intr_disable;
+	mrf.mrf_steer = mac_soft_ring_steer;
+	mrf.mrf_gro = mac_soft_ring_gro;
 	mrf.mrf_flow_priority = pri;
 
 	softring = mac_soft_ring_create(id, mac_soft_ring_worker_wait,
@@ -3328,6 +3345,11 @@ mac_srs_fanout_list_free(mac_soft_ring_set_t *mac_srs)
 		kmem_free(mac_srs->srs_tcp_soft_rings,
 		    sizeof (mac_soft_ring_t *) * MAX_SR_FANOUT);
 		mac_srs->srs_tcp_soft_rings = NULL;
+		if (mac_srs->srs_tcp_steer != NULL) {
+			kmem_free(mac_srs->srs_tcp_steer,
+			    mac_srs->srs_tcp_steer_size);
+			mac_srs->srs_tcp_steer = NULL;
+		}
 		ASSERT(mac_srs->srs_udp_soft_rings != NULL);
 		kmem_free(mac_srs->srs_udp_soft_rings,
 		    sizeof (mac_soft_ring_t *) * MAX_SR_FANOUT);
@@ -411,6 +411,28 @@
  * help bring down latency and allows MAC to get a better sense of the overall
  * activity in the system and properly engage worker threads.
  *
+ * RECEIVE COALESCING
+ *
+ * Chains pay off a second time on the TCP soft rings. A bulk TCP receive is
+ * mostly a run of in-order, full-sized segments of one connection, and every
+ * one of them otherwise costs a pass through IP, the squeue and
+ * tcp_input_data(). Before a TCP soft ring hands a chain to its client,
+ * mac_rx_gro() merges such runs into a single large segment whose payload is
+ * the b_cont chain of the original ones, much as hardware LRO would; devices
+ * without LRO get the same benefit in software. Only plain data segments
+ * (ACK and PSH, no IP options) that follow on from each other in sequence and
+ * agree on everything else in their headers are merged. The merged segment
+ * carries valid IP and TCP checksums, and a run ends at a short segment, a
+ * PSH, or when it reaches mac_rx_gro_max_segs segments. The fanout kstats
+ * count merged segments (gromerged) and the large segments that resulted
+ * (groflushes).
+ *
+ * A merged segment is only fit for a host to receive: one to be forwarded
+ * would exceed the MTU of the next link. MAC cannot tell local traffic from
+ * traffic passing through, so a soft ring merges nothing until its client
+ * turns it on through mrf_gro (mac_soft_ring_gro()). IP does so for the TCP
+ * soft rings of an IPv4 interface that does not forward.
+ *
  * --------------------
  * Bandwidth Management
  * --------------------
@@ -975,12 +997,14 @@
 #include <sys/vlan.h>
 #include <sys/stack.h>
 #include <sys/archsystm.h>
+#include <sys/pattr.h>
 #include <inet/ipsec_impl.h>
 #include <inet/ip_impl.h>
 #include <inet/sadb.h>
 #include <inet/ipsecesp.h>
 #include <inet/ipsecah.h>
 #include <inet/ip6.h>
+#include <netinet/tcp.h>
 
 #include <sys/mac_impl.h>
 #include <sys/mac_client_impl.h>
@@ -1864,6 +1888,79 @@ src_dst_based_fanout:
 	return (0);
 }
 
+/*
+ * mac_soft_ring_steer
+ *
+ * The mrf_steer entry point of the TCP soft rings.  IP calls it on the
+ * soft ring an IPv4 TCP connection arrives on when the connection is read
+ * on another CPU, with target the TCP soft ring bound to that CPU (see
+ * ip_squeue_steer()).  From then on mac_rx_srs_fanout() sends the flow to
+ * target instead of the soft ring its hash picks.
+ *
+ * srs_tcp_steer is only a hint, indexed by the fanout hash and holding
+ * the index of the soft ring plus one.  It is written without a lock and
+ * flows which share a slot go where the last of them asked for.
+ * mac_srs_update_fanout_list() clears it when the soft rings change.  It
+ * has srs_tcp_steer_size slots (see mac_srs_steer_size), and is allocated
+ * here the first time a flow of the SRS is steered.  We may be called
+ * from interrupt context, so if memory is short the flow just isn't
+ * steered.
+ */
+boolean_t
+mac_soft_ring_steer(void *arg, void *target, uint32_t src, uint32_t dst,
+    uint32_t ports)
+{
+	mac_soft_ring_t		*softring = arg;
+	mac_soft_ring_t		*tsoftring = target;
+	mac_soft_ring_set_t	*mac_srs = softring->s_ring_set;
+	uint_t			size = mac_srs->srs_tcp_steer_size;
+	uint8_t			*steer;
+	uint_t			hash;
+	int			i;
+
+	if (tsoftring->s_ring_set != mac_srs ||
+	    !(tsoftring->s_ring_type & ST_RING_TCP) || size == 0)
+		return (B_FALSE);
+
+	for (i = 0; i < mac_srs->srs_tcp_ring_count; i++) {
+		if (mac_srs->srs_tcp_soft_rings[i] == tsoftring)
+			break;
+	}
+	if (i == mac_srs->srs_tcp_ring_count)
+		return (B_FALSE);
+
+	if ((steer = mac_srs->srs_tcp_steer) == NULL) {
+		if ((steer = kmem_zalloc(size, KM_NOSLEEP)) == NULL)
+			return (B_FALSE);
+		if (atomic_cas_ptr(&mac_srs->srs_tcp_steer, NULL,
+		    steer) != NULL) {
+			kmem_free(steer, size);
+			steer = mac_srs->srs_tcp_steer;
+		}
+	}
+
+	hash = HASH_ADDR(src, dst, ports);
+	steer[hash % size] = i + 1;
+	DTRACE_PROBE3(soft__ring__steer, mac_soft_ring_set_t *, mac_srs,
+	    uint_t, hash, mac_soft_ring_t *, tsoftring);
+	return (B_TRUE);
+}
+
+/*
+ * mac_soft_ring_gro
+ *
+ * The mrf_gro entry point of the soft rings: lets mac_rx_gro() merge the
+ * segments of the TCP soft ring arg, or stops it.
+ */
+void
+mac_soft_ring_gro(void *arg, boolean_t enable)
+{
+	mac_soft_ring_t		*softring = arg;
+
+	if (softring->s_ring_type & ST_RING_TCP)
+		softring->s_ring_gro = enable;
+}
+
 /*
  * mac_rx_srs_fanout
  *
@@ -1906,6 +2003,7 @@ mac_rx_srs_fanout(mac_soft_ring_set_t *mac_srs, mblk_t *head)
 	size_t				ipha_len;
 	size_t				hdrsize;
 	uint_t				hash;
+	uint_t				steer;
 	mblk_t				*mp;
 	mblk_t				*headmp[MAX_SR_TYPES][MAX_SR_FANOUT];
 	mblk_t				*tailmp[MAX_SR_TYPES][MAX_SR_FANOUT];
@@ -2132,6 +2230,14 @@ mac_rx_srs_fanout(mac_soft_ring_set_t *mac_srs, mblk_t *head)
 			hash = HASH_ADDR(ipha->ipha_src, ipha->ipha_dst,
 			    *(uint32_t *)(mp->b_rptr + ports_offset));
 			indx = COMPUTE_INDEX(hash, mac_srs->srs_tcp_ring_count);
+			/* Unless IP steered the flow there */
+			if (mac_srs->srs_tcp_steer != NULL) {
+				steer = mac_srs->srs_tcp_steer[hash %
+				    mac_srs->srs_tcp_steer_size];
+				if (steer != 0 &&
+				    steer <= mac_srs->srs_tcp_ring_count)
+					indx = steer - 1;
+			}
 			type = V4_TCP;
 			mp->b_rptr += hdrsize;
 			break;
@@ -4785,6 +4891,359 @@ mac_rx_soft_ring_process(mac_client_impl_t *mcip, mac_soft_ring_t *ringp,
 	}
 }
 
+/*
+ * Receive coalescing on the TCP soft rings; see "RECEIVE COALESCING" above.
+ * mac_rx_gro_enable turns it off altogether; mac_rx_gro_max_segs bounds the
+ * number of segments merged into one.
+ */
+boolean_t mac_rx_gro_enable = B_TRUE;
+uint_t mac_rx_gro_max_segs = 32;
+
+/* Connections merged into at the same time, per chain */
+#define	MAC_GRO_FLOWS	4
+
+typedef struct mac_gro_flow_s {
+	mblk_t		*mgf_head;	/* first segment, keeps its headers */
+	mblk_t		*mgf_tail;	/* last mblk of the last segment */
+	ipha_t		*mgf_ipha;
+	struct tcphdr	*mgf_tcph;
+	uint32_t	mgf_nxt;	/* sequence number that comes next */
+	uint32_t	mgf_sum;	/* payload checksum, once merging */
+	uint_t		mgf_len;	/* IP length so far */
+	uint_t		mgf_mss;	/* payload of the first segment */
+	uint_t		mgf_nsegs;
+	uint8_t		mgf_flags;	/* TCP flags to add to the head */
+	boolean_t	mgf_closed;	/* a short or PSH segment was taken */
+	boolean_t	mgf_hwok;	/* all verified by the hardware */
+} mac_gro_flow_t;
+
+/*
+ * Return the TCP header of mp if it is a segment mac_rx_gro() may merge, and
+ * its payload length in *datalenp; return NULL otherwise. The IP header is
+ * known to be aligned and in the first mblk, as mac_rx_srs_proto_fanout()
+ * only hands such packets to the TCP soft rings.
+ */
+static struct tcphdr *
+mac_rx_gro_tcph(mblk_t *mp, uint_t *datalenp)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	struct tcphdr	*tcph;
+	uint_t		iplen, thlen;
+	size_t		len;
+
+	if (MBLKL(mp) < IP_SIMPLE_HDR_LENGTH + sizeof (struct tcphdr) ||
+	    ipha->ipha_version_and_hdr_length != IP_SIMPLE_HDR_VERSION ||
+	    ipha->ipha_protocol != IPPROTO_TCP ||
+	    (ipha->ipha_fragment_offset_and_flags &
+	    htons(IPH_MF | IPH_OFFSET)) != 0)
+		return (NULL);
+
+	/* LINTED: improper alignment cast */
+	tcph = (struct tcphdr *)(mp->b_rptr + IP_SIMPLE_HDR_LENGTH);
+	thlen = tcph->th_off << 2;
+	iplen = ntohs(ipha->ipha_length);
+	len = (mp->b_cont == NULL) ? MBLKL(mp) : msgdsize(mp);
+
+	/* No link layer padding, and some data */
+	if (thlen < sizeof (struct tcphdr) ||
+	    MBLKL(mp) < IP_SIMPLE_HDR_LENGTH + thlen ||
+	    iplen != len || iplen <= IP_SIMPLE_HDR_LENGTH + thlen)
+		return (NULL);
+	if ((tcph->th_flags & ~TH_PUSH) != TH_ACK)
+		return (NULL);
+
+	/* The header of a merged segment is rewritten, so check it first */
+	if (!(DB_CKSUMFLAGS(mp) & HCK_IPV4_HDRCKSUM_OK) &&
+	    ip_csum_hdr(ipha) != 0)
+		return (NULL);
+
+	*datalenp = iplen - IP_SIMPLE_HDR_LENGTH - thlen;
+	return (tcph);
+}
+
+/*
+ * Whether mp, which mac_rx_gro() can't merge, belongs to the connection of
+ * mgf; when that can't be told, say it does.
+ */
+static boolean_t
+mac_rx_gro_same(mac_gro_flow_t *mgf, mblk_t *mp)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	uint_t		hlen;
+
+	if (MBLKL(mp) < IP_SIMPLE_HDR_LENGTH)
+		return (B_TRUE);
+	hlen = IPH_HDR_LENGTH(ipha);
+	if (MBLKL(mp) < hlen + 2 * sizeof (in_port_t) ||
+	    (ipha->ipha_fragment_offset_and_flags &
+	    htons(IPH_MF | IPH_OFFSET)) != 0)
+		return (B_TRUE);
+
+	return (ipha->ipha_src == mgf->mgf_ipha->ipha_src &&
+	    ipha->ipha_dst == mgf->mgf_ipha->ipha_dst &&
+	    ipha->ipha_protocol == IPPROTO_TCP &&
+	    bcmp(mp->b_rptr + hlen, mgf->mgf_tcph,
+	    2 * sizeof (in_port_t)) == 0);
+}
+
+/*
+ * The one's complement sum of the payload of a segment, worked out from its
+ * checksum rather than its data: the pseudo-header, TCP header and payload
+ * of a segment that is intact sum to 0xFFFF.
+ */
+static uint32_t
+mac_rx_gro_datasum(ipha_t *ipha, struct tcphdr *tcph, uint_t tcplen)
+{
+	uint32_t	sum;
+
+	sum = (ipha->ipha_src >> 16) + (ipha->ipha_src & 0xFFFF) +
+	    (ipha->ipha_dst >> 16) + (ipha->ipha_dst & 0xFFFF) +
+	    htons(tcplen) + IP_TCP_CSUM_COMP;
+	sum = IP_BCSUM_PARTIAL((uchar_t *)tcph, tcph->th_off << 2, sum);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (~sum & 0xFFFF);
+}
+
+static void
+mac_rx_gro_start(mac_gro_flow_t *mgf, mblk_t *mp, struct tcphdr *tcph,
+    uint_t datalen)
+{
+	mblk_t		*tail;
+
+	for (tail = mp; tail->b_cont != NULL; tail = tail->b_cont)
+		;
+	mgf->mgf_head = mp;
+	mgf->mgf_tail = tail;
+	mgf->mgf_ipha = (ipha_t *)mp->b_rptr;
+	mgf->mgf_tcph = tcph;
+	mgf->mgf_nxt = ntohl(tcph->th_seq) + datalen;
+	mgf->mgf_sum = 0;
+	mgf->mgf_len = ntohs(mgf->mgf_ipha->ipha_length);
+	mgf->mgf_mss = datalen;
+	mgf->mgf_nsegs = 1;
+	mgf->mgf_flags = 0;
+	mgf->mgf_closed = ((tcph->th_flags & TH_PUSH) != 0);
+	mgf->mgf_hwok = ((DB_CKSUMFLAGS(mp) & HCK_FULLCKSUM_OK) != 0);
+}
+
+/*
+ * Append the payload of mp to the segment mgf is building, if it carries on
+ * from it; return B_FALSE, leaving mp alone, if not.
+ */
+static boolean_t
+mac_rx_gro_merge(mac_gro_flow_t *mgf, mblk_t *mp, struct tcphdr *tcph,
+    uint_t datalen)
+{
+	ipha_t		*ipha = (ipha_t *)mp->b_rptr;
+	ipha_t		*hipha = mgf->mgf_ipha;
+	struct tcphdr	*htcph = mgf->mgf_tcph;
+	uint_t		thlen = tcph->th_off << 2;
+	uint32_t	sum;
+	mblk_t		*data;
+
+	if (mgf->mgf_closed || mgf->mgf_nsegs >= mac_rx_gro_max_segs ||
+	    mgf->mgf_len + datalen > IP_MAXPACKET ||
+	    datalen > mgf->mgf_mss || ntohl(tcph->th_seq) != mgf->mgf_nxt)
+		return (B_FALSE);
+	if (tcph->th_ack != htcph->th_ack || tcph->th_win != htcph->th_win ||
+	    thlen != (htcph->th_off << 2) ||
+	    ipha->ipha_type_of_service != hipha->ipha_type_of_service ||
+	    ipha->ipha_ttl != hipha->ipha_ttl ||
+	    bcmp(tcph + 1, htcph + 1, thlen - sizeof (struct tcphdr)) != 0)
+		return (B_FALSE);
+
+	/*
+	 * Keep the payload checksum of everything merged so far, from which
+	 * mac_rx_gro_flush() makes up the checksum of the merged segment.
+	 * The payload of mp lands at an odd offset if what went before has
+	 * an odd length; its sum then has its bytes swapped.
+	 */
+	if (mgf->mgf_nsegs == 1) {
+		mgf->mgf_sum = mac_rx_gro_datasum(hipha, htcph,
+		    mgf->mgf_len - IP_SIMPLE_HDR_LENGTH);
+	}
+	sum = mac_rx_gro_datasum(ipha, tcph, thlen + datalen);
+	if ((mgf->mgf_len - IP_SIMPLE_HDR_LENGTH) & 1)
+		sum = ((sum >> 8) | (sum << 8)) & 0xFFFF;
+	sum += mgf->mgf_sum;
+	mgf->mgf_sum = (sum & 0xFFFF) + (sum >> 16);
+
+	if (!(DB_CKSUMFLAGS(mp) & HCK_FULLCKSUM_OK))
+		mgf->mgf_hwok = B_FALSE;
+	if (tcph->th_flags & TH_PUSH) {
+		mgf->mgf_flags |= TH_PUSH;
+		mgf->mgf_closed = B_TRUE;
+	}
+	if (datalen < mgf->mgf_mss)
+		mgf->mgf_closed = B_TRUE;
+
+	/* Strip the headers and chain the payload on */
+	mp->b_rptr += IP_SIMPLE_HDR_LENGTH + thlen;
+	if (mp->b_rptr == mp->b_wptr) {
+		data = mp->b_cont;
+		freeb(mp);
+	} else {
+		data = mp;
+	}
+	mgf->mgf_tail->b_cont = data;
+	for (; data->b_cont != NULL; data = data->b_cont)
+		;
+	mgf->mgf_tail = data;
+
+	mgf->mgf_nxt += datalen;
+	mgf->mgf_len += datalen;
+	mgf->mgf_nsegs++;
+	return (B_TRUE);
+}
+
+/*
+ * Finish the segment mgf was building and put it at *tailp; return where
+ * the next packet goes.
+ */
+static mblk_t **
+mac_rx_gro_flush(mac_gro_flow_t *mgf, mblk_t **tailp, uint_t *mergedp,
+    uint_t *flushesp)
+{
+	mblk_t		*mp = mgf->mgf_head;
+	ipha_t		*ipha = mgf->mgf_ipha;
+	struct tcphdr	*tcph = mgf->mgf_tcph;
+	uint32_t	sum;
+
+	if (mgf->mgf_nsegs > 1) {
+		ipha->ipha_length = htons(mgf->mgf_len);
+		ipha->ipha_hdr_checksum = 0;
+		ipha->ipha_hdr_checksum = ip_csum_hdr(ipha);
+
+		tcph->th_flags |= mgf->mgf_flags;
+		tcph->th_sum = 0;
+		sum = (ipha->ipha_src >> 16) + (ipha->ipha_src & 0xFFFF) +
+		    (ipha->ipha_dst >> 16) + (ipha->ipha_dst & 0xFFFF) +
+		    htons(mgf->mgf_len - IP_SIMPLE_HDR_LENGTH) +
+		    IP_TCP_CSUM_COMP + mgf->mgf_sum;
+		sum = IP_BCSUM_PARTIAL((uchar_t *)tcph, tcph->th_off << 2,
+		    sum);
+		sum = (sum & 0xFFFF) + (sum >> 16);
+		sum = (sum & 0xFFFF) + (sum >> 16);
+		tcph->th_sum = ~sum & 0xFFFF;
+
+		/*
+		 * Whatever checksum state the hardware left on the head no
+		 * longer applies. If every segment had been verified, the
+		 * merged one counts as verified too; otherwise IP checks it
+		 * in software, once, which a corrupted segment makes fail
+		 * for the lot.
+		 */
+		DB_CKSUMFLAGS(mp) = HCK_IPV4_HDRCKSUM_OK |
+		    (mgf->mgf_hwok ? HCK_FULLCKSUM_OK : 0);
+
+		*mergedp += mgf->mgf_nsegs - 1;
+		(*flushesp)++;
+	}
+
+	mgf->mgf_head = NULL;
+	*tailp = mp;
+	return (&mp->b_next);
+}
+
+/*
+ * mac_rx_gro
+ *
+ * Merge the runs of in-order segments of a chain bound for a TCP soft ring's
+ * client, and return the new chain. Segments of up to MAC_GRO_FLOWS
+ * connections are merged at once; the order of the packets of each
+ * connection is kept.
+ */
+mblk_t *
+mac_rx_gro(mac_soft_ring_t *ringp, mblk_t *mp_chain)
+{
+	mac_gro_flow_t	flows[MAC_GRO_FLOWS];
+	mac_gro_flow_t	*mgf;
+	mblk_t		*head = NULL;
+	mblk_t		**tailp = &head;
+	mblk_t		*mp, *next;
+	struct tcphdr	*tcph;
+	ipha_t		*ipha;
+	uint_t		datalen, merged = 0, flushes = 0, victim = 0;
+	int		i;
+
+	if (!mac_rx_gro_enable || !ringp->s_ring_gro || mp_chain == NULL ||
+	    mp_chain->b_next == NULL)
+		return (mp_chain);
+
+	for (i = 0; i < MAC_GRO_FLOWS; i++)
+		flows[i].mgf_head = NULL;
+
+	for (mp = mp_chain; mp != NULL; mp = next) {
+		next = mp->b_next;
+		mp->b_next = NULL;
+
+		if ((tcph = mac_rx_gro_tcph(mp, &datalen)) == NULL) {
+			/* Let what came before it go first */
+			for (i = 0; i < MAC_GRO_FLOWS; i++) {
+				mgf = &flows[i];
+				if (mgf->mgf_head != NULL &&
+				    mac_rx_gro_same(mgf, mp)) {
+					tailp = mac_rx_gro_flush(mgf, tailp,
+					    &merged, &flushes);
+				}
+			}
+			*tailp = mp;
+			tailp = &mp->b_next;
+			continue;
+		}
+
+		ipha = (ipha_t *)mp->b_rptr;
+		mgf = NULL;
+		for (i = 0; i < MAC_GRO_FLOWS; i++) {
+			if (flows[i].mgf_head != NULL &&
+			    ipha->ipha_src == flows[i].mgf_ipha->ipha_src &&
+			    ipha->ipha_dst == flows[i].mgf_ipha->ipha_dst &&
+			    tcph->th_sport == flows[i].mgf_tcph->th_sport &&
+			    tcph->th_dport == flows[i].mgf_tcph->th_dport) {
+				mgf = &flows[i];
+				break;
+			}
+		}
+
+		if (mgf != NULL) {
+			if (mac_rx_gro_merge(mgf, mp, tcph, datalen))
+				continue;
+			tailp = mac_rx_gro_flush(mgf, tailp, &merged,
+			    &flushes);
+		} else {
+			for (i = 0; i < MAC_GRO_FLOWS; i++) {
+				if (flows[i].mgf_head == NULL) {
+					mgf = &flows[i];
+					break;
+				}
+			}
+			if (mgf == NULL) {
+				mgf = &flows[victim];
+				victim = (victim + 1) % MAC_GRO_FLOWS;
+				tailp = mac_rx_gro_flush(mgf, tailp, &merged,
+				    &flushes);
+			}
+		}
+		mac_rx_gro_start(mgf, mp, tcph, datalen);
+	}
+
+	for (i = 0; i < MAC_GRO_FLOWS; i++) {
+		if (flows[i].mgf_head != NULL) {
+			tailp = mac_rx_gro_flush(&flows[i], tailp, &merged,
+			    &flushes);
+		}
+	}
+
+	if (merged != 0) {
+		mutex_enter(&ringp->s_ring_lock);
+		ringp->s_ring_gro_merged += merged;
+		ringp->s_ring_gro_flushes += flushes;
+		mutex_exit(&ringp->s_ring_lock);
+	}
+	return (head);
+}
+
 /*
  * TX SOFTRING RELATED FUNCTIONS
  *
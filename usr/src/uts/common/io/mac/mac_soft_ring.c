@@ -389,6 +389,9 @@ mac_rx_soft_ring_drain(mac_soft_ring_t *ringp)
 			tid = NULL;
 		}
 
+		if (ringp->s_ring_type & ST_RING_TCP)
+			mp = mac_rx_gro(ringp, mp);
+
 		(*proc)(arg1, arg2, mp, NULL);
 
 		/*
@@ -589,6 +592,9 @@ mac_soft_ring_poll(mac_soft_ring_t *ringp, size_t bytes_to_pickup)
 	MAC_UPDATE_SRS_COUNT_LOCKED(mac_srs, cnt);
 	MAC_UPDATE_SRS_SIZE_LOCKED(mac_srs, sz);
 	mutex_exit(&mac_srs->srs_lock);
+
+	if (ringp->s_ring_type & ST_RING_TCP)
+		head = mac_rx_gro(ringp, head);
 	return (head);
 }
 
@@ -64,7 +64,9 @@ enum mac_stat {
 	MAC_STAT_MULTIRCVBYTES,
 	MAC_STAT_BRDCSTRCVBYTES,
 	MAC_STAT_MULTIXMTBYTES,
-	MAC_STAT_BRDCSTXMTBYTES
+	MAC_STAT_BRDCSTXMTBYTES,
+	MAC_STAT_GROMERGED,
+	MAC_STAT_GROFLUSHES
 };
 
 static mac_stat_info_t	i_mac_si[] = {
@@ -235,6 +237,8 @@ static mac_stat_info_t  i_mac_tx_hwlane_si[] = {
 static mac_stat_info_t  i_mac_rx_fanout_si[] = {
 	{ MAC_STAT_RBYTES,	"rbytes",	KSTAT_DATA_UINT64,	0},
 	{ MAC_STAT_IPACKETS,	"ipackets",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_GROMERGED,	"gromerged",	KSTAT_DATA_UINT64,	0},
+	{ MAC_STAT_GROFLUSHES,	"groflushes",	KSTAT_DATA_UINT64,	0},
 };
 #define	MAC_RX_FANOUT_NKSTAT \
 	(sizeof (i_mac_rx_fanout_si) / sizeof (mac_stat_info_t))
@@ -901,6 +905,15 @@ i_mac_rx_fanout_stat_get(void *handle, uint_t stat)
 		    (oth_ringp->s_ring_total_inpkt);
 		break;
 
+	/* Only the TCP ring merges */
+	case MAC_STAT_GROMERGED:
+		val = tcp_ringp->s_ring_gro_merged;
+		break;
+
+	case MAC_STAT_GROFLUSHES:
+		val = tcp_ringp->s_ring_gro_flushes;
+		break;
+
 	default:
 		val = 0;
 		break;
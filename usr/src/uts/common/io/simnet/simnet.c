@@ -141,6 +141,9 @@ static krwlock_t	simnet_dev_lock;
 static list_t		simnet_dev_list;
 static int		simnet_count; /* Num of simnet instances */
 
+/* Packets a device queues from its peer before it drops them */
+uint_t			simnet_rxq_max = 1024;
+
 int
 _init(void)
 {
@@ -671,21 +674,19 @@ simnet_thread_unref(simnet_dev_t *sdev)
 	mutex_exit(&sdev->sd_instlock);
 }
 
-static void
-simnet_rx(void *arg)
+/*
+ * Whether to pass up mp, which came from the peer; if not, it is freed.
+ */
+static boolean_t
+simnet_rx_accept(simnet_dev_t *sdev, mblk_t *mp)
 {
-	mblk_t *mp = arg;
 	mac_header_info_t hdr_info;
-	simnet_dev_t *sdev;
-
-	sdev = (simnet_dev_t *)mp->b_next;
-	mp->b_next = NULL;
 
 	/* Check for valid packet header */
 	if (mac_header_info(sdev->sd_mh, mp, &hdr_info) != 0) {
 		freemsg(mp);
 		sdev->sd_stats.recv_errors++;
-		goto rx_done;
+		return (B_FALSE);
 	}
 
 	/*
@@ -699,14 +700,14 @@ simnet_rx(void *arg)
 		    bcmp(hdr_info.mhi_daddr, sdev->sd_mac_addr,
 		    ETHERADDRL) != 0) {
 			freemsg(mp);
-			goto rx_done;
+			return (B_FALSE);
 		} else if (hdr_info.mhi_dsttype == MAC_ADDRTYPE_MULTICAST) {
 			mutex_enter(&sdev->sd_instlock);
 			if (mcastaddr_lookup(sdev, hdr_info.mhi_daddr) ==
 			    NULL) {
 				mutex_exit(&sdev->sd_instlock);
 				freemsg(mp);
-				goto rx_done;
+				return (B_FALSE);
 			}
 			mutex_exit(&sdev->sd_instlock);
 		}
@@ -714,8 +715,104 @@ simnet_rx(void *arg)
 
 	sdev->sd_stats.recv_count++;
 	sdev->sd_stats.rbytes += msgdsize(mp);
-	mac_rx(sdev->sd_mh, NULL, mp);
-rx_done:
+	return (B_TRUE);
+}
+
+/*
+ * Pass up everything the peer has sent since the last pass. Packets that
+ * pile up while the stack is busy go up together as one chain, as they
+ * would from the receive ring of a NIC.
+ */
+static void
+simnet_rx(void *arg)
+{
+	simnet_dev_t *sdev = arg;
+	mblk_t *mp, *next, *head, **tailp;
+	uint_t cnt;
+
+	for (;;) {
+		mutex_enter(&sdev->sd_instlock);
+		if ((mp = sdev->sd_rxq_head) == NULL) {
+			/* Drop the hold simnet_rx_enqueue() took for us */
+			sdev->sd_rxq_sched = B_FALSE;
+			if (--sdev->sd_threadcount == 0)
+				cv_broadcast(&sdev->sd_threadwait);
+			mutex_exit(&sdev->sd_instlock);
+			return;
+		}
+		sdev->sd_rxq_head = sdev->sd_rxq_tail = NULL;
+		sdev->sd_rxq_cnt = 0;
+		mutex_exit(&sdev->sd_instlock);
+
+		head = NULL;
+		tailp = &head;
+		for (cnt = 0; mp != NULL; mp = next, cnt++) {
+			next = mp->b_next;
+			mp->b_next = NULL;
+			if (simnet_rx_accept(sdev, mp)) {
+				*tailp = mp;
+				tailp = &mp->b_next;
+			}
+		}
+		if (head != NULL)
+			mac_rx(sdev->sd_mh, NULL, head);
+
+		/* Each packet held the device */
+		while (cnt-- > 0)
+			simnet_thread_unref(sdev);
+	}
+}
+
+/*
+ * Queue mp, which holds the device, for simnet_rx(), and dispatch that
+ * unless it is already on its way. Like a full receive ring, a queue of
+ * simnet_rxq_max packets drops any more.
+ */
+static void
+simnet_rx_enqueue(simnet_dev_t *sdev, mblk_t *mp)
+{
+	boolean_t dispatch = B_FALSE;
+	mblk_t *next;
+
+	mutex_enter(&sdev->sd_instlock);
+	if (sdev->sd_rxq_cnt >= simnet_rxq_max) {
+		mutex_exit(&sdev->sd_instlock);
+		freemsg(mp);
+		sdev->sd_stats.recv_errors++;
+		simnet_thread_unref(sdev);
+		return;
+	}
+	sdev->sd_rxq_cnt++;
+	if (sdev->sd_rxq_tail != NULL)
+		sdev->sd_rxq_tail->b_next = mp;
+	else
+		sdev->sd_rxq_head = mp;
+	sdev->sd_rxq_tail = mp;
+	if (!sdev->sd_rxq_sched) {
+		/* simnet_rx() holds the device as well */
+		sdev->sd_rxq_sched = B_TRUE;
+		sdev->sd_threadcount++;
+		dispatch = B_TRUE;
+	}
+	mutex_exit(&sdev->sd_instlock);
+
+	if (!dispatch || ddi_taskq_dispatch(simnet_rxq, simnet_rx, sdev,
+	    DDI_NOSLEEP) == DDI_SUCCESS)
+		return;
+
+	mutex_enter(&sdev->sd_instlock);
+	mp = sdev->sd_rxq_head;
+	sdev->sd_rxq_head = sdev->sd_rxq_tail = NULL;
+	sdev->sd_rxq_cnt = 0;
+	sdev->sd_rxq_sched = B_FALSE;
+	mutex_exit(&sdev->sd_instlock);
+	for (; mp != NULL; mp = next) {
+		next = mp->b_next;
+		mp->b_next = NULL;
+		freemsg(mp);
+		sdev->sd_stats.recv_errors++;
+		simnet_thread_unref(sdev);
+	}
 	simnet_thread_unref(sdev);
 }
 
@@ -809,17 +906,9 @@ simnet_m_tx(void *arg, mblk_t *mp_chain)
 		}
 
 		/* Use taskq for pkt receive to avoid kernel stack explosion */
-		mp->b_next = (mblk_t *)sdev_rx;
-		if (ddi_taskq_dispatch(simnet_rxq, simnet_rx, mp,
-		    DDI_NOSLEEP) == DDI_SUCCESS) {
-			sdev->sd_stats.xmit_count++;
-			sdev->sd_stats.obytes += len;
-		} else {
-			simnet_thread_unref(sdev_rx);
-			mp->b_next = NULL;
-			freemsg(mp);
-			sdev_rx->sd_stats.recv_errors++;
-		}
+		simnet_rx_enqueue(sdev_rx, mp);
+		sdev->sd_stats.xmit_count++;
+		sdev->sd_stats.obytes += len;
 	}
 
 	simnet_thread_unref(sdev);
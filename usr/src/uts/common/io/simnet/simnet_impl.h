@@ -84,6 +84,11 @@ typedef struct simnet_dev {
 	uint_t			sd_mac_len;
 	uchar_t			sd_mac_addr[MAXMACADDRLEN];
 	simnet_stats_t		sd_stats;
+	/* Packets from the peer waiting for simnet_rx(), under sd_instlock */
+	mblk_t			*sd_rxq_head;
+	mblk_t			*sd_rxq_tail;
+	uint_t			sd_rxq_cnt;	/* packets on sd_rxq_head */
+	boolean_t		sd_rxq_sched;	/* simnet_rx() dispatched */
 } simnet_dev_t;
 
 /* Simnet device flags */
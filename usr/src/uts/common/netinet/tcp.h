@@ -81,6 +81,7 @@ struct tcphdr {
 #define	TCPOPT_SACK_PERMITTED	4
 #define	TCPOPT_SACK	5
 #define	TCPOPT_TSTAMP	8
+#define	TCPOPT_FASTOPEN	34
 
 /*
  * Default maximum segment size for TCP.
@@ -129,6 +130,12 @@ struct tcphdr {
 #define	TCP_KEEPIDLE			0x22
 #define	TCP_KEEPCNT			0x23
 #define	TCP_KEEPINTVL			0x24
+#define	TCP_CONGESTION			0x25
+#define	TCP_FASTOPEN			0x26
+#define	TCP_FASTOPEN_CONNECT		0x27
+
+/* Maximum length of a TCP_CONGESTION algorithm name, including the NUL */
+#define	TCP_CA_NAME_MAX			16
 
 #ifdef	__cplusplus
 }